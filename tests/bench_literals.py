@@ -0,0 +1,85 @@
+#!/usr/bin/python
+
+# Times tsc on a generated shader that fills large lookup tables with literals of
+# every form the lexer parses: decimal and exponent floats, 'f' and 'h' suffixes,
+# hex and octal integers, and 'u', 'l' and 'ul' suffixes.
+#
+# Usage: bench_literals.py [entries per table] [runs]
+
+import os, random, subprocess, sys, tempfile, time
+
+# Go to base dir
+os.chdir(os.path.dirname(os.path.realpath(__file__)) + "/..")
+
+entries = int(sys.argv[1]) if len(sys.argv) > 1 else 16384
+runs = int(sys.argv[2]) if len(sys.argv) > 2 else 10
+
+if not os.path.exists("./build"):
+    subprocess.run(["cmake", "-Bbuild", "-DCMAKE_BUILD_TYPE=Release", os.getcwd()])
+
+subprocess.run(["cmake", "--build", "build"])
+
+if os.name == "nt":
+    if os.path.exists("build/Release/tsc.exe"):
+        compiler_exe = "build/Release/tsc.exe"
+    elif os.path.exists("build/tsc.exe"):
+        compiler_exe = "build/tsc.exe"
+    else:
+        compiler_exe = "build/Debug/tsc.exe"
+else:
+    compiler_exe = "./build/tsc"
+
+# Same table every time, so runs on different commits compare
+rng = random.Random(0)
+
+def float_literal():
+    value = rng.uniform(-1000.0, 1000.0)
+    form = rng.randrange(6)
+    if form == 0: return "%.9gf" % value
+    if form == 1: return "%.17g" % value
+    if form == 2: return "%.6e" % value
+    if form == 3: return "%.3fh" % (value / 100.0)
+    if form == 4: return "%d." % int(value)
+    return "%.8fF" % (value / 1000.0)
+
+def uint_literal():
+    value = rng.randrange(1 << 31)
+    form = rng.randrange(6)
+    if form == 0: return "0x%X" % value
+    if form == 1: return "0x%xu" % value
+    if form == 2: return "0%o" % value
+    if form == 3: return "%du" % value
+    if form == 4: return "%dul" % value
+    return "%dl" % value
+
+lines = [
+    "RWStructuredBuffer<float> float_table;",
+    "RWStructuredBuffer<uint> uint_table;",
+    "",
+    "[numthreads(1,1,1)]",
+    "void main() {",
+]
+for i in range(entries):
+    lines.append(f"    float_table[{i}] = {float_literal()}; uint_table[{i}] = {uint_literal()};")
+lines.append("}")
+source = "\n".join(lines) + "\n"
+
+with tempfile.TemporaryDirectory() as tmp:
+    shader_path = os.path.join(tmp, "lookup_tables.comp.hlsl")
+    out_path = os.path.join(tmp, "lookup_tables.spv")
+    with open(shader_path, "w") as f:
+        f.write(source)
+
+    cmd_line = [compiler_exe, "-E", "main", "-T", "compute", "-o", out_path, shader_path]
+    if subprocess.run(cmd_line).returncode != 0:
+        print("Compilation failed")
+        exit(1)
+
+    times = []
+    for _ in range(runs):
+        start = time.perf_counter()
+        subprocess.run(cmd_line, check=True)
+        times.append(time.perf_counter() - start)
+
+print(f"{2 * entries} literals, {len(source)} bytes, {runs} runs")
+print(f"  min {min(times) * 1000:.1f} ms, mean {sum(times) / runs * 1000:.1f} ms")
@@ -0,0 +1,85 @@
+#!/usr/bin/python
+
+# Times the analysis of tsc on a generated shader that nests blocks deeply, where each
+# block declares a local and looks up the locals of the blocks around it and globals.
+# The same blocks and lookups are also timed one after the other instead of nested:
+# resolving a name should not get slower with the depth of the scope stack.
+#
+# The analysis time is the one tsc reports with --phase-times.
+#
+# Usage: bench_nested_scopes.py [nesting depth] [lookups per block] [runs]
+
+import os, subprocess, sys, tempfile, time
+
+# Go to base dir
+os.chdir(os.path.dirname(os.path.realpath(__file__)) + "/..")
+
+depth = int(sys.argv[1]) if len(sys.argv) > 1 else 800
+lookups = int(sys.argv[2]) if len(sys.argv) > 2 else 10
+runs = int(sys.argv[3]) if len(sys.argv) > 3 else 10
+
+globals_count = 256
+
+if not os.path.exists("./build"):
+    subprocess.run(["cmake", "-Bbuild", "-DCMAKE_BUILD_TYPE=Release", os.getcwd()])
+
+subprocess.run(["cmake", "--build", "build"])
+
+if os.name == "nt":
+    if os.path.exists("build/Release/tsc.exe"):
+        compiler_exe = "build/Release/tsc.exe"
+    elif os.path.exists("build/tsc.exe"):
+        compiler_exe = "build/tsc.exe"
+    else:
+        compiler_exe = "build/Debug/tsc.exe"
+else:
+    compiler_exe = "./build/tsc"
+
+def generate(nested):
+    lines = ["RWStructuredBuffer<float> gOut;"]
+    for i in range(globals_count):
+        lines.append(f"static const float g{i} = {i}.0;")
+    lines += ["", "[numthreads(1,1,1)]", "void main() {", "    float acc = 0.0;"]
+
+    for i in range(depth):
+        # Without nesting every block is closed before the next one opens, so only
+        # its own local and the globals are visible
+        lines.append("    {")
+        lines.append(f"    float v{i + 1} = acc + 1.0;")
+        for j in range(lookups):
+            local = (i * 7 + j * 13) % (i + 1) + 1 if nested else i + 1
+            lines.append(f"    acc += v{local} * g{(i + j * 31) % globals_count};")
+        if not nested:
+            lines.append("    }")
+
+    if nested:
+        lines.append("    " + "}" * depth)
+    lines += ["    gOut[0] = acc;", "}"]
+    return "\n".join(lines) + "\n"
+
+def analysis_time(cmd_line):
+    output = subprocess.run(cmd_line, check=True, capture_output=True, text=True).stdout
+    for line in output.splitlines():
+        if line.startswith("analyze:"):
+            return float(line.split()[1])
+    raise RuntimeError("tsc did not report the analysis time")
+
+print(f"{depth} blocks, {depth * lookups} lookups, best of {runs} runs")
+
+with tempfile.TemporaryDirectory() as tmp:
+    for nested in [True, False]:
+        shader_path = os.path.join(tmp, "scopes.comp.hlsl")
+        out_path = os.path.join(tmp, "scopes.spv")
+        with open(shader_path, "w") as f:
+            f.write(generate(nested))
+
+        cmd_line = [compiler_exe, "-E", "main", "-T", "compute", "-o", out_path, shader_path]
+        if subprocess.run(cmd_line).returncode != 0:
+            print("Compilation failed")
+            exit(1)
+
+        cmd_line.append("--phase-times")
+        times = [analysis_time(cmd_line) for _ in range(runs)]
+
+        name = "nested" if nested else "flat"
+        print(f"  {name}: analysis min {min(times):.2f} ms, mean {sum(times) / runs:.2f} ms")
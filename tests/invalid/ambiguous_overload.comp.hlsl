@@ -0,0 +1,10 @@
+RWStructuredBuffer<float> gResult;
+
+float pick(float x, int y) { return x; }
+float pick(int x, float y) { return y; }
+
+[numthreads(1, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    gResult[id.x] = pick(1, 2);
+}
@@ -0,0 +1,12 @@
+// Registers of different classes with the same number map to the same binding, which
+// Vulkan does not allow for descriptors of different types
+struct Params { uint count; };
+ConstantBuffer<Params> gParams : register(b0);
+StructuredBuffer<float> gInput : register(t0);
+RWStructuredBuffer<float> gOutput : register(u0);
+
+[numthreads(64, 1, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    if (dtid.x < gParams.count) gOutput[dtid.x] = gInput[dtid.x] * 2.0f;
+}
@@ -0,0 +1,16 @@
+struct Value
+{
+    float x;
+};
+
+// A struct has a single layout: 16 bytes in std140, 4 bytes in std430
+ConstantBuffer<Value> gConstants;
+StructuredBuffer<Value> gValues;
+
+RWStructuredBuffer<float> gResult;
+
+[numthreads(1, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    gResult[id.x] = gConstants.x + gValues[id.x].x;
+}
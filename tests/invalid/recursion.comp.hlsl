@@ -0,0 +1,12 @@
+RWStructuredBuffer<float> gResult;
+
+float factorial(float x)
+{
+    return x <= 1 ? 1 : x * factorial(x - 1);
+}
+
+[numthreads(1, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    gResult[id.x] = factorial(float(id.x));
+}
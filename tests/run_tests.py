@@ -82,12 +82,66 @@ def test_dir(dir, expected_result):
             success = run_proc(f"spirv-val {out_path}")
             if success != expected_result: failed = True
 
+        # Valid shaders also go through the optimization passes
+        if success and expected_result:
+            opt_out_path = os.path.join(outdir, no_ext_name + ".O2.spv")
+            success = run_proc(
+                f"{compiler_exe} -E main -T {stage} -O2 -o {opt_out_path} {fullpath}")
+            if success:
+                success = run_proc(f"spirv-val {opt_out_path}")
+            if not success: failed = True
+
 
         if failed:
             failed_tests.append(fullpath)
 
+def test_pch():
+    print("\n=== Running PRECOMPILED HEADER tests ===")
+
+    # Loading the header must be the same as including it, its include guard too
+    header_path = "./tests/valid/included.hlsl"
+    pch_path = "./tests/valid_out/included.pch"
+    if not run_proc(f"{compiler_exe} --emit-pch -o {pch_path} {header_path}"):
+        failed_tests.append(header_path)
+        return
+
+    for name, stage in [("test.vert", "vertex"), ("test.frag", "fragment")]:
+        fullpath = os.path.join("./tests/valid", name + ".hlsl")
+        out_path = os.path.join("./tests/valid_out", name + ".spv")
+        pch_out_path = os.path.join("./tests/valid_out", name + ".pch.spv")
+        print("  => Testing:", fullpath)
+
+        success = run_proc(
+            f"{compiler_exe} -E main -T {stage} -o {out_path} {fullpath}")
+        if success:
+            success = run_proc(
+                f"{compiler_exe} -E main -T {stage} --pch {pch_path} -o {pch_out_path} {fullpath}")
+        if success:
+            with open(out_path, "rb") as a, open(pch_out_path, "rb") as b:
+                success = a.read() == b.read()
+        if not success:
+            failed_tests.append(fullpath)
+
+def test_binding_shift():
+    print("\n=== Running BINDING SHIFT tests ===")
+
+    # The overlapping registers compile once the classes are moved apart
+    fullpath = "./tests/invalid/binding_overlap.comp.hlsl"
+    out_path = "./tests/invalid_out/binding_overlap.comp.shift.spv"
+    print("  => Testing:", fullpath)
+
+    success = run_proc(
+        f"{compiler_exe} -E main -T compute --binding-shift t=16 --binding-shift u=32 "
+        f"-o {out_path} {fullpath}")
+    if success:
+        success = run_proc(f"spirv-val {out_path}")
+    if not success:
+        failed_tests.append(fullpath)
+
 test_dir("./tests/valid", True)
 test_dir("./tests/invalid", False)
+test_pch()
+test_binding_shift()
 
 print("\n=== RESULTS ===")
 
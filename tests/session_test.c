@@ -0,0 +1,174 @@
+// Compiles a series of edits of one shader through a session and checks that every
+// output, SPIR-V and errors, is the one tsCompile gives for the same source.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tinyshader.h"
+
+static const char *edits[] = {
+    // Initial version
+    "struct Light { float3 dir; float3 color; };\n"
+    "cbuffer gScene : register(b0) { Light gLight; float gAmbient; }\n"
+    "\n"
+    "float lambert(float3 n, float3 l)\n"
+    "{\n"
+    "    return max(dot(n, l), 0.0);\n"
+    "}\n"
+    "\n"
+    "float4 main(float3 normal : NORMAL) : SV_Target\n"
+    "{\n"
+    "    float d = lambert(normalize(normal), -gLight.dir);\n"
+    "    return float4(gLight.color * d + gAmbient, 1.0);\n"
+    "}\n",
+
+    // Body of one function changed
+    "struct Light { float3 dir; float3 color; };\n"
+    "cbuffer gScene : register(b0) { Light gLight; float gAmbient; }\n"
+    "\n"
+    "float lambert(float3 n, float3 l)\n"
+    "{\n"
+    "    return clamp(dot(n, l), 0.0, 1.0);\n"
+    "}\n"
+    "\n"
+    "float4 main(float3 normal : NORMAL) : SV_Target\n"
+    "{\n"
+    "    float d = lambert(normalize(normal), -gLight.dir);\n"
+    "    return float4(gLight.color * d + gAmbient, 1.0);\n"
+    "}\n",
+
+    // Declaration inserted, the ones after it move down
+    "struct Light { float3 dir; float3 color; };\n"
+    "cbuffer gScene : register(b0) { Light gLight; float gAmbient; }\n"
+    "\n"
+    "float wrap(float x)\n"
+    "{\n"
+    "    return x * 0.5 + 0.5;\n"
+    "}\n"
+    "\n"
+    "float lambert(float3 n, float3 l)\n"
+    "{\n"
+    "    return clamp(dot(n, l), 0.0, 1.0);\n"
+    "}\n"
+    "\n"
+    "float4 main(float3 normal : NORMAL) : SV_Target\n"
+    "{\n"
+    "    float d = wrap(lambert(normalize(normal), -gLight.dir));\n"
+    "    return float4(gLight.color * d + gAmbient, 1.0);\n"
+    "}\n",
+
+    // Error in a declaration that was not edited, its location must have moved too
+    "struct Light { float3 dir; float3 color; };\n"
+    "cbuffer gScene : register(b0) { Light gLight; float gAmbient; }\n"
+    "\n"
+    "float wrap(float x)\n"
+    "{\n"
+    "    return x * 0.5 + 0.5;\n"
+    "}\n"
+    "\n"
+    "\n"
+    "float lambert(float3 n, float3 l)\n"
+    "{\n"
+    "    return clamp(dot(n, l), 0.0, 1.0);\n"
+    "}\n"
+    "\n"
+    "float4 main(float3 normal : NORMAL) : SV_Target\n"
+    "{\n"
+    "    float d = wrap(lambert(normalize(normal), -gLight.dir));\n"
+    "    return float4(gLight.color * d + gAmbient + missing, 1.0);\n"
+    "}\n",
+
+    // Syntax error
+    "struct Light { float3 dir; float3 color; };\n"
+    "cbuffer gScene : register(b0) { Light gLight; float gAmbient; }\n"
+    "\n"
+    "float wrap(float x)\n"
+    "{\n"
+    "    return x * 0.5 + ;\n"
+    "}\n",
+
+    // Declaration removed and a macro added, so every span is lexed differently
+    "#define AMBIENT gAmbient\n"
+    "struct Light { float3 dir; float3 color; };\n"
+    "cbuffer gScene : register(b0) { Light gLight; float gAmbient; }\n"
+    "\n"
+    "float lambert(float3 n, float3 l)\n"
+    "{\n"
+    "    return clamp(dot(n, l), 0.0, 1.0);\n"
+    "}\n"
+    "\n"
+    "float4 main(float3 normal : NORMAL) : SV_Target\n"
+    "{\n"
+    "    float d = lambert(normalize(normal), -gLight.dir);\n"
+    "    return float4(gLight.color * d + AMBIENT, 1.0);\n"
+    "}\n",
+
+    // Back to the initial version
+    "struct Light { float3 dir; float3 color; };\n"
+    "cbuffer gScene : register(b0) { Light gLight; float gAmbient; }\n"
+    "\n"
+    "float lambert(float3 n, float3 l)\n"
+    "{\n"
+    "    return max(dot(n, l), 0.0);\n"
+    "}\n"
+    "\n"
+    "float4 main(float3 normal : NORMAL) : SV_Target\n"
+    "{\n"
+    "    float d = lambert(normalize(normal), -gLight.dir);\n"
+    "    return float4(gLight.color * d + gAmbient, 1.0);\n"
+    "}\n",
+};
+
+static int sameOutput(TsCompilerOutput *a, TsCompilerOutput *b)
+{
+    const char *a_errors = tsCompilerOutputGetErrors(a);
+    const char *b_errors = tsCompilerOutputGetErrors(b);
+    if ((a_errors == NULL) != (b_errors == NULL)) return 0;
+    if (a_errors && strcmp(a_errors, b_errors) != 0) return 0;
+
+    size_t a_size, b_size;
+    const unsigned char *a_spirv = tsCompilerOutputGetSpirv(a, &a_size);
+    const unsigned char *b_spirv = tsCompilerOutputGetSpirv(b, &b_size);
+    if (a_size != b_size) return 0;
+    return a_size == 0 || memcmp(a_spirv, b_spirv, a_size) == 0;
+}
+
+int main(void)
+{
+    const char *path = "session.frag.hlsl";
+    int failed = 0;
+
+    for (int opt_level = 0; opt_level <= 2; ++opt_level)
+    {
+        TsSession *session = tsSessionCreate();
+
+        for (size_t i = 0; i < sizeof(edits) / sizeof(edits[0]); ++i)
+        {
+            TsCompilerOptions *options = tsCompilerOptionsCreate();
+            tsCompilerOptionsSetStage(options, TS_SHADER_STAGE_FRAGMENT);
+            tsCompilerOptionsSetEntryPoint(options, "main", strlen("main"));
+            tsCompilerOptionsSetOptimizationLevel(options, opt_level);
+            tsCompilerOptionsSetSource(
+                options, edits[i], strlen(edits[i]), path, strlen(path));
+
+            TsCompilerOutput *expected = tsCompile(options);
+            TsCompilerOutput *output = tsSessionCompile(session, options);
+
+            if (!sameOutput(output, expected))
+            {
+                printf("Edit %zu at -O%d: the session output differs from tsCompile\n",
+                       i, opt_level);
+                failed = 1;
+            }
+
+            tsCompilerOutputDestroy(output);
+            tsCompilerOutputDestroy(expected);
+            tsCompilerOptionsDestroy(options);
+        }
+
+        tsSessionDestroy(session);
+    }
+
+    if (!failed) printf("All session edits match tsCompile\n");
+    return failed;
+}
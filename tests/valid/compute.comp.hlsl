@@ -25,7 +25,7 @@ struct BufType
     float f;
 };
 
-StructuredBuffer<BufType> Buffer0 : register(t0, space0); // register is ignored
+StructuredBuffer<BufType> Buffer0 : register(t0, space0);
 
 groupshared uint a;
 
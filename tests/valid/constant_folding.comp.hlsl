@@ -0,0 +1,57 @@
+RWStructuredBuffer<float4> values;
+RWStructuredBuffer<int> counts;
+
+float scale(float x, int mode)
+{
+    float k = 2.0;
+    if (mode > 2)
+    {
+        k = k * 1.5;
+    }
+    else
+    {
+        k = sqrt(x);
+    }
+    return x * k;
+}
+
+[numthreads(4, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    float a = 3.0;
+    float b = a * 2.0 + 1.0;
+    float3 v = float3(a, b, 1.0);
+    int i = 7;
+    int j = i / 2 + (i % 3) - (i << 2);
+    bool flag = b > 5.0;
+
+    int total = 0;
+    for (int k = 0; k < 4; ++k)
+    {
+        // Always true once 'j' is known
+        if (j < 0)
+        {
+            total += k;
+        }
+        else
+        {
+            total -= counts[k];
+        }
+    }
+
+    bool again = false;
+    do
+    {
+        total += 1;
+    } while (again);
+
+    float4 result = float4(normalize(v) * 2.0, length(v.xy));
+    if (flag && i == 7)
+    {
+        result.x += scale(a, 3);
+    }
+
+    result.w += fmod(b, 3.0) + clamp(b, 0.0, 4.0) + float(asuint(b) & 0xFF) + float(j);
+    values[id.x] = result;
+    counts[id.x] = total + int(dot(v, v));
+}
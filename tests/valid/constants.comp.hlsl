@@ -0,0 +1,26 @@
+static const float PI = 3.14159265;
+static const float TWO_PI = PI * 2;
+static const float INV_PI = 1.0 / PI;
+static const uint GROUP = 4 * 2;
+static const float3 LIGHT_DIR = normalize(float3(1, 2, 2));
+static const float3 HALF = LIGHT_DIR * 0.5 + float3(0.5, 0.5, 0.5);
+static const float2x2 ROT = float2x2(cos(0.5), -sin(0.5), sin(0.5), cos(0.5));
+static const float SQ = sqrt(2.0) * rsqrt(2.0);
+static const int NEG = -7 % 3;
+static const uint SHIFTED = (1u << 31) >> 4;
+static const bool FLAG = (GROUP > 4) && !(PI < 3);
+static const float SEL = FLAG ? 1.5 : 2.5;
+static const float3 SWZ = HALF.zyx;
+static const float DOTV = dot(LIGHT_DIR, float3(0, 0, 1));
+static const int CASTED = int(TWO_PI);
+
+RWStructuredBuffer<float> result;
+
+[numthreads(GROUP, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    static const float LOCAL = TWO_PI * INV_PI;
+    float3 v = HALF * float3(LOCAL, SQ, 1.0 / 3.0);
+    result[id.x] = v.x + v.y + v.z + ROT[1].x + SEL + SWZ.x + DOTV + float(CASTED) + float(NEG) + float(SHIFTED);
+    result[id.x + 1] = lerp(1.0, 2.0, 0.25) + float(clamp(5, 0, 3)) + float(max(2, 7)) + smoothstep(0.0, 1.0, 0.5) + LIGHT_DIR[2];
+}
@@ -0,0 +1,52 @@
+RWStructuredBuffer<uint> gValues : register(u0);
+
+[numthreads(8, 1, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    uint i = dtid.x;
+    uint v = gValues[i];
+
+    if (v > 10)
+    {
+    }
+    else
+    {
+        v += 1;
+    }
+
+    uint n = 0;
+    while (n < v && n < 16)
+    {
+        if (n == 3) break;
+        if (n == 1)
+        {
+            n += 2;
+            continue;
+        }
+        n++;
+    }
+
+    do
+    {
+        if (v == 0) continue;
+        v = v / 2;
+    } while (v > 4);
+
+    for (uint k = 0; k < 4; ++k)
+    {
+        if (gValues[k] == v)
+        {
+            if (k > 1) break;
+        }
+    }
+
+    if (i > 2)
+    {
+        if (i > 4)
+        {
+            v += 3;
+        }
+    }
+
+    gValues[i] = v + n;
+}
@@ -0,0 +1,30 @@
+static const bool DEBUG = false;
+RWStructuredBuffer<float> r;
+
+float unused(float x) { return x * 100; }
+float debugOnly(float x) { return unused(x) + 1; }
+float afterReturn(float x) { return x - 1; }
+float liveHelper(float x) { return x * 2; }
+float elseHelper(float x) { return x * 3; }
+
+float compute(float x)
+{
+    if (DEBUG)
+    {
+        x += debugOnly(x);
+    }
+    else
+    {
+        x += elseHelper(x);
+    }
+    if (!DEBUG) return liveHelper(x);
+    return afterReturn(x);
+}
+
+[numthreads(1, 1, 1)]
+void main()
+{
+    r[0] = compute(r[1]);
+    return;
+    r[2] = afterReturn(1.0);
+}
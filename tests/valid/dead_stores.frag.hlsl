@@ -0,0 +1,54 @@
+struct Data { float4 v; float s; };
+StructuredBuffer<Data> gData : register(t0);
+Texture2D gUnused : register(t1);
+SamplerState gSampler : register(s2);
+RWStructuredBuffer<float> gOut : register(u3);
+
+float pick(float x)
+{
+    if (x > 0.5f)
+    {
+        return x * 2.0f;
+    }
+    else
+    {
+        return x - 1.0f;
+    }
+}
+
+float loopy(float x)
+{
+    Data d;
+    d.v = float4(x, x, x, x);
+    d.v.y = x * 2.0f;
+    d.s = 1.0f;
+    float acc = 0.0f;
+    for (int i = 0; i < 4; ++i)
+    {
+        acc += x;
+        if (acc > 100.0f) return acc;
+        continue;
+    }
+    while (true)
+    {
+        acc += 1.0f;
+        if (acc > 8.0f) break;
+    }
+    return acc;
+}
+
+float4 main(float4 pos : SV_Position, float2 uv : TEXCOORD0, float3 unused_in : TEXCOORD1) : SV_Target
+{
+    Data tmp;
+    tmp.v = gData[0].v;
+    tmp.s = uv.x;
+    float dead = gData[1].s * 3.0f;
+    float4 dead_vec = tmp.v + float4(uv, 0, 1);
+    gOut[0] = pick(uv.x) + loopy(uv.y);
+    if (uv.x > 2.0f)
+    {
+        discard;
+        gOut[1] = 5.0f;
+    }
+    return float4(tmp.s, uv, 1) + float4(pick(uv.y), 0, 0, 0);
+}
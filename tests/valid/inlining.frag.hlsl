@@ -0,0 +1,65 @@
+struct Params
+{
+    float4 tint;
+    float threshold;
+    int mode;
+};
+
+ConstantBuffer<Params> params;
+
+float shade(float x)
+{
+    if (x < params.threshold)
+    {
+        return 0.0;
+    }
+    else if (x > 1.0)
+    {
+        return 1.0;
+    }
+    return x * x;
+}
+
+[inline]
+void split(float4 v, out float a, out float b)
+{
+    a = v.x + v.y;
+    b = v.z * v.w;
+}
+
+[noinline]
+float kept(float x)
+{
+    return x * 2.0 + 1.0;
+}
+
+float first_above(float x)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        if (float(i) > x) return float(i);
+    }
+    return -1.0;
+}
+
+float pick(int mode, float x)
+{
+    float r = x;
+    if (mode == 0) return r;
+    if (mode == 1) r = shade(x);
+    return r + kept(x);
+}
+
+float4 main(float4 color : COLOR) : SV_Target
+{
+    float a;
+    float b;
+    split(color, a, b);
+    float s = shade(a) + shade(b);
+    for (int i = 0; i < params.mode; ++i)
+    {
+        s += pick(i, s);
+        if (s > 4.0) discard;
+    }
+    return params.tint * (s + first_above(a) + first_above(b));
+}
@@ -0,0 +1,37 @@
+struct Particle
+{
+    float3 pos;
+    float mass;
+    float2 uv;
+    float3x3 rot;
+    float4x3 m43;
+};
+
+struct Shared
+{
+    float4 a;
+    float4 b;
+};
+
+cbuffer Globals : register(b2, space1)
+{
+    float4 tint : packoffset(c0);
+    float scale : packoffset(c1.y);
+    float2 offset : packoffset(c1.z);
+    float3x4 xform;
+}
+
+ConstantBuffer<Shared> cb_shared : register(b0);
+StructuredBuffer<Shared> sb_shared;
+StructuredBuffer<float3> positions : register(t3);
+RWStructuredBuffer<Particle> particles : register(u0, space2);
+RWStructuredBuffer<float2x3> mats;
+[[vk::binding(7)]] RWStructuredBuffer<float> result : register(u9, space3);
+
+[numthreads(1, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    Particle p = particles[id.x];
+    result[id.x] = p.pos.x + tint.x + scale + offset.y + positions[id.x].y + cb_shared.a.x +
+                   sb_shared[0].b.y + mats[0][1].x + xform[0].x + p.rot[1].y;
+}
@@ -0,0 +1,8 @@
+RWStructuredBuffer<float> o;
+RWStructuredBuffer<uint> u;
+[numthreads(1,1,1)]
+void main() {
+    o[0] = 0.1f; o[1] = .5; o[2] = 1.; o[3] = 1.5e-3; o[4] = 2.5E+2h;
+    o[5] = 3.14159265358979323846264338327950288f; o[6] = 1e30; o[7] = 123456789012345678901234567890.0;
+    u[0] = 0x1F; u[1] = 0777u; u[2] = 42ul; u[3] = 0XffU; u[4] = 0;
+}
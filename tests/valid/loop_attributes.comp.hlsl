@@ -0,0 +1,51 @@
+struct Params { float4 w; uint limit; };
+ConstantBuffer<Params> gParams : register(b0);
+RWStructuredBuffer<float4> gData : register(u1);
+
+float weight(int i)
+{
+    if (i < 2) return gParams.w.x * float(i);
+    return gParams.w.y - float(i);
+}
+
+[numthreads(8, 1, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    float4 sum = 0.0f;
+
+    [unroll]
+    for (int i = -2; i <= 2; ++i)
+    {
+        sum += gData[dtid.x + uint(i + 2)] * weight(i + 2);
+    }
+
+    [loop]
+    for (int j = 0; j < 2; ++j)
+    {
+        sum *= 0.5f;
+    }
+
+    int k = 0;
+    [unroll(4)]
+    while (k < 6)
+    {
+        sum.x += float(k);
+        if (sum.x > gParams.w.z) break;
+        k += 2;
+    }
+
+    uint m = 0;
+    [unroll]
+    for (uint b = 0; b < gParams.limit; ++b)
+    {
+        m += b;
+    }
+
+    [unroll]
+    do
+    {
+        sum.y += 1.0f;
+    } while (sum.y < gParams.w.w && m++ < 8);
+
+    gData[dtid.x] = sum + float(k) + float(m);
+}
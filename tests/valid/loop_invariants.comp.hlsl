@@ -0,0 +1,29 @@
+struct Params { float4x4 transform; float4 offset; uint count; uint stride; };
+ConstantBuffer<Params> gParams : register(b0);
+StructuredBuffer<float4> gPoints : register(t1);
+RWStructuredBuffer<float4> gResult : register(u2);
+
+[numthreads(8, 1, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    float4 sum = 0.0f;
+    uint count = min(gParams.count, uint(8));
+
+    for (uint i = 0; i < count; ++i)
+    {
+        float4 p = mul(gParams.transform, gParams.offset * 2.0f);
+        sum += p * gPoints[dtid.x / gParams.stride];
+        sum += gPoints[i];
+    }
+
+    uint j = 0;
+    do
+    {
+        uint slot = dtid.x / gParams.stride;
+        sum.x += float(slot) + gResult[j].x;
+        gResult[j] = sum;
+        j++;
+    } while (j < count);
+
+    gResult[dtid.x] = sum;
+}
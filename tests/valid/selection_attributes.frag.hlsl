@@ -0,0 +1,40 @@
+struct Params { float4 tint; float cutoff; uint mode; };
+ConstantBuffer<Params> gParams : register(b0);
+Texture2D gTex : register(t1);
+SamplerState gSampler : register(s2);
+
+float4 main(float2 uv : TEXCOORD0, float4 color : COLOR0) : SV_Target
+{
+    float a = uv.x;
+    if (uv.y > 0.5f) a = uv.y * 2.0f;
+
+    float3 c = color.rgb;
+    if (color.a < gParams.cutoff)
+    {
+        c = c * gParams.tint.rgb;
+    }
+    else
+    {
+        c = c + 1.0f;
+    }
+
+    float b = 0.0f;
+    [branch]
+    if (uv.x > 0.25f) b = uv.x - 0.25f;
+
+    float d = 1.0f;
+    [flatten]
+    if (gParams.mode == 2)
+    {
+        d = uv.x * uv.y + uv.x * 3.0f + uv.y * 5.0f + color.r * color.g + color.b;
+        if (d > 4.0f) d = 4.0f;
+    }
+
+    float4 t = float4(0, 0, 0, 0);
+    if (a > 1.0f) t = gTex.Sample(gSampler, uv);
+
+    uint n = gParams.mode;
+    if (n > 3) n = n / 2;
+
+    return float4(c, a + b + d + float(n)) + t;
+}
@@ -0,0 +1,20 @@
+RWStructuredBuffer<uint> gValues : register(u0);
+RWStructuredBuffer<float4> gColors : register(u1);
+
+[numthreads(8, 1, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    uint a = gValues[dtid.x];
+    uint v = a;
+    if (a > 3) v += 1;
+    if (a > 7) v += 2;
+    if (v > 9) v *= 3;
+
+    float4 c = gColors[dtid.x];
+    if (c.x > 0.5f) c *= 2.0f;
+    if (c.y > 0.5f) c += 1.0f;
+    else c -= c.x;
+
+    gValues[dtid.x] = v;
+    gColors[dtid.x] = c;
+}
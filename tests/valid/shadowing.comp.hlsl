@@ -0,0 +1,46 @@
+RWStructuredBuffer<float> o;
+
+const float scale = 2.0;
+
+struct Pair
+{
+    float scale;
+    float offset;
+};
+
+// The parameter hides the global constant
+float apply(float scale)
+{
+    return scale * 3.0;
+}
+
+float applyPair(Pair p)
+{
+    float offset = p.scale;
+    {
+        float offset = p.offset;
+        offset *= scale;
+    }
+    return offset;
+}
+
+[numthreads(1, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    float x = 1.0;
+    {
+        float x = 5.0;
+        o[0] = x;
+        {
+            float x = 7.0;
+            o[1] = x;
+        }
+    }
+    o[2] = x;
+    o[3] = apply(4.0);
+
+    Pair p;
+    p.scale = 0.5;
+    p.offset = 1.5;
+    o[4] = applyPair(p);
+}
@@ -0,0 +1,63 @@
+template <typename T>
+struct Pair
+{
+    T first;
+    T second;
+};
+
+template <typename T>
+struct Wrap
+{
+    T value;
+};
+
+RWStructuredBuffer<Wrap<Wrap<float4>>> output;
+StructuredBuffer<Pair<float>> pairs;
+
+template <typename T>
+T square(T x)
+{
+    return x * x;
+}
+
+template <typename T>
+Pair<T> makePair(T a, T b)
+{
+    Pair<T> p;
+    p.first = a;
+    p.second = b;
+    return p;
+}
+
+template <typename T>
+T twice(T x)
+{
+    return x + x;
+}
+
+template <typename T>
+T twice(T x, T y)
+{
+    return twice(x) + y;
+}
+
+float scale(float x) { return x * 2.0; }
+float2 scale(float2 x) { return x * 3.0; }
+int scale(int x) { return x * 4; }
+
+[numthreads(1, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    float a = square(2.0);
+    float3 b = square(float3(1.0, 2.0, 3.0));
+    int c = square<int>(3);
+    Pair<float2> p = makePair(float2(1.0, 2.0), float2(3.0, 4.0));
+    float s = scale(1.5) + float(scale(2));
+    float2 s2 = scale(float2(1.0, 1.0));
+    Pair<float> q = pairs[id.x];
+
+    Wrap<Wrap<float4>> w;
+    w.value.value = twice(float4(a, b.y, float(c), s), twice<float4>(1.0));
+    w.value.value.x += p.second.x + s2.x + q.first;
+    output[id.x] = w;
+}
@@ -0,0 +1,16 @@
+RWStructuredBuffer<uint> gValues : register(u0);
+
+[numthreads(8, 1, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    uint v = gValues[dtid.x];
+    uint sum = 0;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        if (v > 4) sum += v;
+        v = v / 2 + uint(i);
+    }
+
+    gValues[dtid.x] = sum + v;
+}
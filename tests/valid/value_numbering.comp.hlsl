@@ -0,0 +1,49 @@
+struct Item { float4 v; float f; uint n; };
+RWStructuredBuffer<Item> gItems : register(u0);
+RWStructuredBuffer<float> gOut : register(u1);
+groupshared float gShared;
+
+float3 shade(float3 n, float3 l)
+{
+    return normalize(n) * dot(normalize(n), l) + normalize(n);
+}
+
+[numthreads(4, 1, 1)]
+void main(uint3 dtid : SV_DispatchThreadID)
+{
+    uint i = dtid.x;
+    float a = gItems[i].f * 2.0f + gItems[i].f;
+    float b = gItems[i].f + gItems[i + 1].f;
+    gItems[i + 1].f = a;
+    float c = gItems[i].f + gItems[i + 1].f;
+
+    if (i > 1)
+    {
+        gItems[i].f = 3.0f;
+    }
+    float d = gItems[i].f;
+    float e = gItems[i + 2].f;
+    if (i > 2)
+    {
+        e = e + gItems[i + 2].f;
+    }
+
+    gShared = a;
+    GroupMemoryBarrierWithGroupSync();
+    float g = gShared + gShared;
+    GroupMemoryBarrierWithGroupSync();
+    g += gShared;
+
+    float acc = 0.0f;
+    for (uint k = 0; k < 3; ++k)
+    {
+        acc += gItems[k].f * gItems[k].f;
+        gItems[k + 4].f = acc;
+        acc += gItems[k].f;
+    }
+
+    float3 s = shade(gItems[i].v.xyz, float3(0, 1, 0));
+    float x = a * b + b * a;
+    float y = (i > 0 ? d : c) + (i > 0 ? d : c);
+    gOut[i] = a + b + c + d + e + g + acc + s.x + s.y + x + y;
+}
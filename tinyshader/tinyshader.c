@@ -13,6 +13,18 @@ struct TsCompilerOptions
 
     ARRAY_OF(const char *) include_paths;
     TsShaderStage stage;
+    bool scalar_block_layout;
+    uint32_t optimization_level;
+    uint32_t binding_shifts[TS_REGISTER_CLASS_COUNT];
+
+    // Not owned, must outlive tsCompile
+    const unsigned char *pch;
+    size_t pch_size;
+};
+
+struct TsSession
+{
+    ParseCache *parse_cache;
 };
 
 struct TsCompilerOutput
@@ -20,17 +32,25 @@ struct TsCompilerOutput
     unsigned char *spirv;
     size_t spirv_byte_size;
 
+    unsigned char *pch;
+    size_t pch_size;
+
+    TsResource *resources;
+    size_t resource_count;
+
+    TsPassStats *pass_stats;
+    size_t pass_count;
+
+    TsPhaseTimes phase_times;
+
     char *errors;
 };
 
-void ts__addErr(TsCompiler *compiler, const Location *loc, const char *fmt, ...)
+static void addErrV(
+    TsCompiler *compiler, const Location *loc, const char *fmt, va_list vl)
 {
-    va_list vl;
-
-    va_start(vl, fmt);
     ts__sbReset(&compiler->sb);
     ts__sbVsprintf(&compiler->sb, fmt, vl);
-    va_end(vl);
 
     char *msg = ts__sbBuild(&compiler->sb, &compiler->alloc);
 
@@ -40,6 +60,26 @@ void ts__addErr(TsCompiler *compiler, const Location *loc, const char *fmt, ...)
     arrPush(compiler, &compiler->errors, err);
 }
 
+void ts__addErr(TsCompiler *compiler, const Location *loc, const char *fmt, ...)
+{
+    va_list vl;
+
+    va_start(vl, fmt);
+    addErrV(compiler, loc, fmt, vl);
+    va_end(vl);
+}
+
+void ts__addErrAt(TsCompiler *compiler, SourceLoc loc, const char *fmt, ...)
+{
+    Location resolved = ts__sourceLocResolve(compiler, loc);
+
+    va_list vl;
+
+    va_start(vl, fmt);
+    addErrV(compiler, &resolved, fmt, vl);
+    va_end(vl);
+}
+
 static TsCompiler *ts__CompilerCreate(void)
 {
     TsCompiler *compiler = malloc(sizeof(TsCompiler));
@@ -47,6 +87,7 @@ static TsCompiler *ts__CompilerCreate(void)
 
     ts__bumpInit(&compiler->alloc, 1 << 16);
     ts__sbInit(&compiler->sb);
+    compiler->ast = ts__astPoolsCreate();
 
     ts__hashInit(compiler, &compiler->keyword_table, 32);
     ts__hashInit(compiler, &compiler->builtin_function_table, 32);
@@ -98,122 +139,14 @@ static TsCompiler *ts__CompilerCreate(void)
     ts__hashSet(&compiler->keyword_table, "uniform", (void *)TOKEN_UNIFORM);
     ts__hashSet(&compiler->keyword_table, "groupshared", (void *)TOKEN_GROUPSHARED);
     ts__hashSet(&compiler->keyword_table, "register", (void *)TOKEN_REGISTER);
+    ts__hashSet(&compiler->keyword_table, "template", (void *)TOKEN_TEMPLATE);
+    ts__hashSet(&compiler->keyword_table, "typename", (void *)TOKEN_TYPENAME);
 
-    ts__hashSet(&compiler->builtin_function_table, "dot", (void *)AST_BUILTIN_FUNC_DOT);
-    ts__hashSet(&compiler->builtin_function_table, "cross", (void *)AST_BUILTIN_FUNC_CROSS);
-    ts__hashSet(&compiler->builtin_function_table, "length", (void *)AST_BUILTIN_FUNC_LENGTH);
-    ts__hashSet(&compiler->builtin_function_table, "normalize", (void *)AST_BUILTIN_FUNC_NORMALIZE);
-    ts__hashSet(&compiler->builtin_function_table, "mul", (void *)AST_BUILTIN_FUNC_MUL);
-    ts__hashSet(&compiler->builtin_function_table, "distance", (void *)AST_BUILTIN_FUNC_DISTANCE);
-    ts__hashSet(&compiler->builtin_function_table, "degrees", (void *)AST_BUILTIN_FUNC_DEGREES);
-    ts__hashSet(&compiler->builtin_function_table, "radians", (void *)AST_BUILTIN_FUNC_RADIANS);
-
-    ts__hashSet(&compiler->builtin_function_table, "sin", (void *)AST_BUILTIN_FUNC_SIN);
-    ts__hashSet(&compiler->builtin_function_table, "cos", (void *)AST_BUILTIN_FUNC_COS);
-    ts__hashSet(&compiler->builtin_function_table, "tan", (void *)AST_BUILTIN_FUNC_TAN);
-    ts__hashSet(&compiler->builtin_function_table, "asin", (void *)AST_BUILTIN_FUNC_ASIN);
-    ts__hashSet(&compiler->builtin_function_table, "acos", (void *)AST_BUILTIN_FUNC_ACOS);
-    ts__hashSet(&compiler->builtin_function_table, "atan", (void *)AST_BUILTIN_FUNC_ATAN);
-    ts__hashSet(&compiler->builtin_function_table, "sinh", (void *)AST_BUILTIN_FUNC_SINH);
-    ts__hashSet(&compiler->builtin_function_table, "cosh", (void *)AST_BUILTIN_FUNC_COSH);
-    ts__hashSet(&compiler->builtin_function_table, "tanh", (void *)AST_BUILTIN_FUNC_TANH);
-    ts__hashSet(&compiler->builtin_function_table, "atan2", (void *)AST_BUILTIN_FUNC_ATAN2);
-
-    ts__hashSet(&compiler->builtin_function_table, "sqrt", (void *)AST_BUILTIN_FUNC_SQRT);
-    ts__hashSet(&compiler->builtin_function_table, "rsqrt", (void *)AST_BUILTIN_FUNC_RSQRT);
-
-    ts__hashSet(&compiler->builtin_function_table, "reflect", (void *)AST_BUILTIN_FUNC_REFLECT);
-    ts__hashSet(&compiler->builtin_function_table, "refract", (void *)AST_BUILTIN_FUNC_REFRACT);
-
-    ts__hashSet(&compiler->builtin_function_table, "pow", (void *)AST_BUILTIN_FUNC_POW);
-    ts__hashSet(&compiler->builtin_function_table, "exp", (void *)AST_BUILTIN_FUNC_EXP);
-    ts__hashSet(&compiler->builtin_function_table, "exp2", (void *)AST_BUILTIN_FUNC_EXP2);
-    ts__hashSet(&compiler->builtin_function_table, "log", (void *)AST_BUILTIN_FUNC_LOG);
-    ts__hashSet(&compiler->builtin_function_table, "log2", (void *)AST_BUILTIN_FUNC_LOG2);
-
-    ts__hashSet(&compiler->builtin_function_table, "abs", (void *)AST_BUILTIN_FUNC_ABS);
-    ts__hashSet(&compiler->builtin_function_table, "min", (void *)AST_BUILTIN_FUNC_MIN);
-    ts__hashSet(&compiler->builtin_function_table, "max", (void *)AST_BUILTIN_FUNC_MAX);
-    ts__hashSet(&compiler->builtin_function_table, "frac", (void *)AST_BUILTIN_FUNC_FRAC);
-    ts__hashSet(&compiler->builtin_function_table, "trunc", (void *)AST_BUILTIN_FUNC_TRUNC);
-    ts__hashSet(&compiler->builtin_function_table, "ceil", (void *)AST_BUILTIN_FUNC_CEIL);
-    ts__hashSet(&compiler->builtin_function_table, "floor", (void *)AST_BUILTIN_FUNC_FLOOR);
-    ts__hashSet(&compiler->builtin_function_table, "lerp", (void *)AST_BUILTIN_FUNC_LERP);
-    ts__hashSet(&compiler->builtin_function_table, "clamp", (void *)AST_BUILTIN_FUNC_CLAMP);
-    ts__hashSet(&compiler->builtin_function_table, "step", (void *)AST_BUILTIN_FUNC_STEP);
-    ts__hashSet(&compiler->builtin_function_table, "smoothstep", (void *)AST_BUILTIN_FUNC_SMOOTHSTEP);
-    ts__hashSet(&compiler->builtin_function_table, "fmod", (void *)AST_BUILTIN_FUNC_FMOD);
-
-    ts__hashSet(&compiler->builtin_function_table, "ddx", (void *)AST_BUILTIN_FUNC_DDX);
-    ts__hashSet(&compiler->builtin_function_table, "ddy", (void *)AST_BUILTIN_FUNC_DDY);
-
-    ts__hashSet(&compiler->builtin_function_table, "asuint", (void *)AST_BUILTIN_FUNC_ASUINT);
-    ts__hashSet(&compiler->builtin_function_table, "asint", (void *)AST_BUILTIN_FUNC_ASINT);
-    ts__hashSet(&compiler->builtin_function_table, "asfloat", (void *)AST_BUILTIN_FUNC_ASFLOAT);
-
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "InterlockedAdd",
-        (void *)AST_BUILTIN_FUNC_INTERLOCKED_ADD);
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "InterlockedAnd",
-        (void *)AST_BUILTIN_FUNC_INTERLOCKED_AND);
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "InterlockedMin",
-        (void *)AST_BUILTIN_FUNC_INTERLOCKED_MIN);
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "InterlockedMax",
-        (void *)AST_BUILTIN_FUNC_INTERLOCKED_MAX);
-    ts__hashSet(
-        &compiler->builtin_function_table, "InterlockedOr", (void *)AST_BUILTIN_FUNC_INTERLOCKED_OR);
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "InterlockedXor",
-        (void *)AST_BUILTIN_FUNC_INTERLOCKED_XOR);
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "InterlockedExchange",
-        (void *)AST_BUILTIN_FUNC_INTERLOCKED_EXCHANGE);
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "InterlockedCompareExchange",
-        (void *)AST_BUILTIN_FUNC_INTERLOCKED_COMPARE_EXCHANGE);
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "InterlockedCompareStore",
-        (void *)AST_BUILTIN_FUNC_INTERLOCKED_COMPARE_STORE);
-
-    ts__hashSet(&compiler->builtin_function_table, "transpose", (void *)AST_BUILTIN_FUNC_TRANSPOSE);
-    ts__hashSet(
-        &compiler->builtin_function_table, "determinant", (void *)AST_BUILTIN_FUNC_DETERMINANT);
-
-    ts__hashSet(
-        &compiler->builtin_function_table, "AllMemoryBarrier", (void *)AST_BUILTIN_FUNC_ALL_MEMORY_BARRIER);
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "AllMemoryBarrierWithGroupSync",
-        (void *)AST_BUILTIN_FUNC_ALL_MEMORY_BARRIER_WITH_GROUP_SYNC);
-
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "DeviceMemoryBarrier",
-        (void *)AST_BUILTIN_FUNC_DEVICE_MEMORY_BARRIER);
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "DeviceMemoryBarrierWithGroupSync",
-        (void *)AST_BUILTIN_FUNC_DEVICE_MEMORY_BARRIER_WITH_GROUP_SYNC);
-
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "GroupMemoryBarrier",
-        (void *)AST_BUILTIN_FUNC_GROUP_MEMORY_BARRIER);
-    ts__hashSet(
-        &compiler->builtin_function_table,
-        "GroupMemoryBarrierWithGroupSync",
-        (void *)AST_BUILTIN_FUNC_GROUP_MEMORY_BARRIER_WITH_GROUP_SYNC);
+    for (size_t i = 0; i < ts__builtin_signature_count; ++i)
+    {
+        const AstBuiltinSignature *sig = &ts__builtin_signatures[i];
+        ts__hashSet(&compiler->builtin_function_table, sig->name, (void *)sig);
+    }
 
     return compiler;
 }
@@ -224,6 +157,7 @@ static void ts__CompilerDestroy(TsCompiler *compiler)
     ts__hashDestroy(&compiler->builtin_function_table);
     ts__bumpDestroy(&compiler->alloc);
     ts__sbDestroy(&compiler->sb);
+    ts__astPoolsDestroy(compiler->ast);
     free(compiler);
 }
 
@@ -234,13 +168,6 @@ moduleInit(Module *m, TsCompiler *compiler, const char *entry_point, TsShaderSta
     m->compiler = compiler;
     m->entry_point = entry_point;
     m->stage = stage;
-
-    ts__hashInit(compiler, &m->type_cache, 0);
-}
-
-static void moduleDestroy(Module *m)
-{
-    ts__hashDestroy(&m->type_cache);
 }
 
 static bool handleErrors(TsCompiler *compiler, TsCompilerOutput *output)
@@ -282,11 +209,19 @@ File *ts__createFile(TsCompiler *compiler, const char *text, size_t text_size, c
     return file;
 }
 
+static char *copyString(const char *str, size_t length)
+{
+    char *copy = malloc(length + 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
 TsCompilerOptions *tsCompilerOptionsCreate(void)
 {
     TsCompilerOptions *options = malloc(sizeof(*options));
     memset(options, 0, sizeof(*options));
-    options->entry_point = "main";
+    options->entry_point = copyString("main", 4);
     options->stage = TS_SHADER_STAGE_VERTEX;
     return options;
 }
@@ -301,6 +236,7 @@ void tsCompilerOptionsSetEntryPoint(
     const char *entry_point,
     size_t entry_point_length)
 {
+    free(options->entry_point);
     options->entry_point = malloc(entry_point_length+1);
     memcpy(options->entry_point, entry_point, entry_point_length);
     options->entry_point[entry_point_length] = '\0';
@@ -313,6 +249,11 @@ void tsCompilerOptionsSetSource(
     const char *path,
     size_t path_length)
 {
+    // Sessions compile new versions of the source with the same options
+    free(options->source);
+    free(options->path);
+    options->path = NULL;
+
     options->source = malloc(source_length+1);
     memcpy(options->source, source, source_length);
     options->source[source_length] = '\0';
@@ -337,6 +278,30 @@ void tsCompilerOptionsAddIncludePath(
     // TODO: implement include paths
 }
 
+void tsCompilerOptionsSetPrecompiledHeader(
+    TsCompilerOptions *options, const unsigned char *data, size_t size)
+{
+    options->pch = data;
+    options->pch_size = size;
+}
+
+void tsCompilerOptionsSetScalarBlockLayout(TsCompilerOptions *options, int enabled)
+{
+    options->scalar_block_layout = enabled != 0;
+}
+
+void tsCompilerOptionsSetOptimizationLevel(TsCompilerOptions *options, int level)
+{
+    options->optimization_level = (level > 0) ? (uint32_t)level : 0;
+}
+
+void tsCompilerOptionsSetBindingShift(
+    TsCompilerOptions *options, TsRegisterClass register_class, unsigned int shift)
+{
+    assert(register_class < TS_REGISTER_CLASS_COUNT);
+    options->binding_shifts[register_class] = shift;
+}
+
 void tsCompilerOptionsDestroy(TsCompilerOptions *options)
 {
     if (options->source)
@@ -354,58 +319,224 @@ void tsCompilerOptionsDestroy(TsCompilerOptions *options)
     free(options);
 }
 
-TsCompilerOutput *tsCompile(TsCompilerOptions *options)
+// Runs the preprocessor, lexer and parser on the source, after the declarations and
+// macros of the precompiled header if there is one. 'cache' can be NULL. 'defines' is
+// left with the macros defined at the end of the source.
+static bool parseSource(
+    TsCompiler *compiler,
+    TsCompilerOptions *options,
+    ParseCache *cache,
+    ArrayOfAstDeclPtr *decls,
+    HashMap *defines)
+{
+    if (options->pch)
+    {
+        if (!ts__pchLoad(compiler, options->pch, options->pch_size, 0, decls, defines))
+        {
+            return false;
+        }
+    }
+
+    File *file = ts__createFile(compiler, options->source, options->source_size, options->path);
+
+    size_t preprocessed_text_size = 0;
+    const char *preprocessed_text =
+        ts__preprocess(compiler, file, defines, &preprocessed_text_size);
+    if (arrLength(compiler->errors) > 0) return false;
+
+    ArrayOfToken tokens =  ts__lex(compiler, file, preprocessed_text, preprocessed_text_size);
+    if (arrLength(compiler->errors) > 0) return false;
+
+    ArrayOfAstDeclPtr source_decls = ts__parse(compiler, preprocessed_text, tokens, decls, cache);
+    if (arrLength(compiler->errors) > 0) return false;
+
+    for (size_t i = 0; i < source_decls.len; ++i)
+    {
+        arrPush(compiler, decls, source_decls.ptr[i]);
+    }
+
+    return true;
+}
+
+TsCompilerOutput *tsPrecompileHeader(TsCompilerOptions *options)
 {
     TsCompiler *compiler = ts__CompilerCreate();
-    assert(options->entry_point);
 
     TsCompilerOutput *output = malloc(sizeof(*output));
     memset(output, 0, sizeof(*output));
 
-    File *file = ts__createFile(compiler, options->source, options->source_size, options->path);
-
-    Module *module = NEW(compiler, Module);
-    moduleInit(module, compiler, options->entry_point, options->stage);
+    double start = ts__getTime();
 
-    size_t preprocessed_text_size = 0;
-    const char *preprocessed_text = ts__preprocess(compiler, file, &preprocessed_text_size);
+    ArrayOfAstDeclPtr decls = {0};
+    HashMap defines;
+    ts__hashInit(compiler, &defines, 0);
+    parseSource(compiler, options, NULL, &decls, &defines);
+    output->phase_times.parse = (ts__getTime() - start) * 1000.0;
     if (handleErrors(compiler, output))
     {
+        ts__hashDestroy(&defines);
         ts__CompilerDestroy(compiler);
-        return output;   
+        return output;
     }
 
-    ArrayOfToken tokens =  ts__lex(compiler, file, preprocessed_text, preprocessed_text_size);
-    if (handleErrors(compiler, output))
+    output->pch =
+        ts__pchWrite(compiler, decls.ptr, decls.len, &defines, 0, &output->pch_size);
+    ts__hashDestroy(&defines);
+
+    ts__CompilerDestroy(compiler);
+
+    return output;
+}
+
+static bool getResourceKind(AstDecl *decl, TsResourceKind *kind)
+{
+    if (decl->kind != DECL_VAR || decl->var.kind != VAR_UNIFORM || !decl->type)
     {
-        ts__CompilerDestroy(compiler);
-        return output;   
+        return false;
+    }
+
+    switch (decl->type->kind)
+    {
+    case TYPE_CONSTANT_BUFFER: *kind = TS_RESOURCE_CONSTANT_BUFFER; return true;
+    case TYPE_STRUCTURED_BUFFER: *kind = TS_RESOURCE_STRUCTURED_BUFFER; return true;
+    case TYPE_RW_STRUCTURED_BUFFER: *kind = TS_RESOURCE_RW_STRUCTURED_BUFFER; return true;
+    case TYPE_IMAGE: *kind = TS_RESOURCE_TEXTURE; return true;
+    case TYPE_SAMPLER: *kind = TS_RESOURCE_SAMPLER; return true;
+    default: break;
+    }
+
+    return false;
+}
+
+// Copies the bindings and the buffer layouts out of the module, whose memory is freed
+// at the end of tsCompile
+static void reflectResources(Module *module, TsCompilerOutput *output)
+{
+    TsResourceKind kind;
+
+    size_t resource_count = 0;
+    for (size_t i = 0; i < module->decl_count; ++i)
+    {
+        if (getResourceKind(module->decls[i], &kind)) resource_count++;
     }
+    if (resource_count == 0) return;
+
+    output->resources = calloc(resource_count, sizeof(TsResource));
+
+    for (size_t i = 0; i < module->decl_count; ++i)
+    {
+        AstDecl *decl = module->decls[i];
+        if (!getResourceKind(decl, &kind)) continue;
+
+        TsResource *resource = &output->resources[output->resource_count++];
+        resource->kind = kind;
+        resource->set = decl->var.set;
+        resource->binding = decl->var.binding;
 
-    ArrayOfAstDeclPtr decls = ts__parse(compiler, tokens);
+        AstType *struct_type = NULL;
+        if (kind != TS_RESOURCE_TEXTURE && kind != TS_RESOURCE_SAMPLER)
+        {
+            resource->size = decl->type->buffer.stride;
+            struct_type = ts__getStructType(decl->type->buffer.sub);
+        }
+
+        if (decl->name)
+        {
+            resource->name = copyString(decl->name, strlen(decl->name));
+        }
+        else
+        {
+            // cbuffer blocks have no variable name, their struct is named after them
+            assert(struct_type);
+            const char *name = struct_type->struct_.name;
+            resource->name = copyString(name, strcspn(name, "#"));
+        }
+
+        if (!struct_type || !struct_type->struct_.layout) continue;
+
+        AstStructLayout *layout = struct_type->struct_.layout;
+        TsBufferMember *members =
+            calloc(struct_type->struct_.field_count, sizeof(TsBufferMember));
+        for (uint32_t j = 0; j < struct_type->struct_.field_count; ++j)
+        {
+            const char *field_name = struct_type->struct_.field_decls[j]->name;
+            members[j].name = copyString(field_name, strlen(field_name));
+            members[j].offset = layout->offsets[j];
+            members[j].size = layout->sizes[j];
+        }
+        resource->members = members;
+        resource->member_count = struct_type->struct_.field_count;
+    }
+}
+
+static TsCompilerOutput *compile(TsCompilerOptions *options, ParseCache *cache)
+{
+    TsCompiler *compiler = ts__CompilerCreate();
+    assert(options->entry_point);
+
+    TsCompilerOutput *output = malloc(sizeof(*output));
+    memset(output, 0, sizeof(*output));
+
+    Module *module = NEW(compiler, Module);
+    moduleInit(module, compiler, options->entry_point, options->stage);
+    module->scalar_block_layout = options->scalar_block_layout;
+    memcpy(
+        module->binding_shifts, options->binding_shifts, sizeof(module->binding_shifts));
+
+    TsPhaseTimes *times = &output->phase_times;
+    double start = ts__getTime();
+
+    ArrayOfAstDeclPtr decls = {0};
+    HashMap defines;
+    ts__hashInit(compiler, &defines, 0);
+    parseSource(compiler, options, cache, &decls, &defines);
+    ts__hashDestroy(&defines);
+    times->parse = (ts__getTime() - start) * 1000.0;
     if (handleErrors(compiler, output))
     {
         ts__CompilerDestroy(compiler);
         return output;   
     }
 
+    start = ts__getTime();
     ts__analyze(compiler, module, decls.ptr, decls.len);
+    times->analyze = (ts__getTime() - start) * 1000.0;
     if (handleErrors(compiler, output))
     {
         ts__CompilerDestroy(compiler);
         return output;   
     }
 
+    reflectResources(module, output);
+
     IRModule *ir_module = ts__irModuleCreate(compiler);
+    ir_module->fold_constants = options->optimization_level > 0;
+    start = ts__getTime();
     ts__astModuleBuild(module, ir_module);
+    times->build_ir = (ts__getTime() - start) * 1000.0;
     if (handleErrors(compiler, output))
     {
         ts__CompilerDestroy(compiler);
         return output;   
     }
 
+    start = ts__getTime();
+    ts__irOptimize(ir_module, options->optimization_level);
+    times->optimize = (ts__getTime() - start) * 1000.0;
+    if (ir_module->pass_stats.len > 0)
+    {
+        output->pass_count = ir_module->pass_stats.len;
+        output->pass_stats = malloc(sizeof(TsPassStats) * output->pass_count);
+        memcpy(
+            output->pass_stats,
+            ir_module->pass_stats.ptr,
+            sizeof(TsPassStats) * output->pass_count);
+    }
+
     size_t word_count;
+    start = ts__getTime();
     uint32_t *words = ts__irModuleCodegen(ir_module, &word_count);
+    times->codegen = (ts__getTime() - start) * 1000.0;
     if (handleErrors(compiler, output))
     {
         if (words) free(words);
@@ -417,13 +548,36 @@ TsCompilerOutput *tsCompile(TsCompilerOptions *options)
     output->spirv = (uint8_t *)words;
 
     ts__irModuleDestroy(ir_module);
-    moduleDestroy(module);
 
     ts__CompilerDestroy(compiler);
 
     return output;
 }
 
+TsCompilerOutput *tsCompile(TsCompilerOptions *options)
+{
+    return compile(options, NULL);
+}
+
+TsSession *tsSessionCreate(void)
+{
+    TsSession *session = malloc(sizeof(*session));
+    memset(session, 0, sizeof(*session));
+    session->parse_cache = ts__parseCacheCreate();
+    return session;
+}
+
+TsCompilerOutput *tsSessionCompile(TsSession *session, TsCompilerOptions *options)
+{
+    return compile(options, session->parse_cache);
+}
+
+void tsSessionDestroy(TsSession *session)
+{
+    ts__parseCacheDestroy(session->parse_cache);
+    free(session);
+}
+
 const char *tsCompilerOutputGetErrors(TsCompilerOutput *output)
 {
     return output->errors;
@@ -440,9 +594,47 @@ const unsigned char *tsCompilerOutputGetSpirv(TsCompilerOutput *output, size_t *
     return output->spirv;
 }
 
+const unsigned char *
+tsCompilerOutputGetPrecompiledHeader(TsCompilerOutput *output, size_t *pch_byte_size)
+{
+    *pch_byte_size = output->pch_size;
+    return output->pch;
+}
+
+const TsResource *tsCompilerOutputGetResources(TsCompilerOutput *output, size_t *resource_count)
+{
+    *resource_count = output->resource_count;
+    return output->resources;
+}
+
+const TsPassStats *tsCompilerOutputGetPassStats(TsCompilerOutput *output, size_t *pass_count)
+{
+    *pass_count = output->pass_count;
+    return output->pass_stats;
+}
+
+const TsPhaseTimes *tsCompilerOutputGetPhaseTimes(TsCompilerOutput *output)
+{
+    return &output->phase_times;
+}
+
 void tsCompilerOutputDestroy(TsCompilerOutput *output)
 {
+    for (size_t i = 0; i < output->resource_count; ++i)
+    {
+        TsResource *resource = &output->resources[i];
+        for (size_t j = 0; j < resource->member_count; ++j)
+        {
+            free((char *)resource->members[j].name);
+        }
+        free((TsBufferMember *)resource->members);
+        free((char *)resource->name);
+    }
+    if (output->resources) free(output->resources);
+    if (output->pass_stats) free(output->pass_stats);
+
     if (output->spirv) free(output->spirv);
+    if (output->pch) free(output->pch);
     if (output->errors) free(output->errors);
     free(output);
 }
@@ -13,6 +13,7 @@ extern "C" {
 
 typedef struct TsCompilerOptions TsCompilerOptions;
 typedef struct TsCompilerOutput TsCompilerOutput;
+typedef struct TsSession TsSession;
 
 typedef enum TsShaderStage {
     TS_SHADER_STAGE_VERTEX,
@@ -20,6 +21,55 @@ typedef enum TsShaderStage {
     TS_SHADER_STAGE_COMPUTE,
 } TsShaderStage;
 
+// The letter of an HLSL register: register(t3) is of class TS_REGISTER_CLASS_T
+typedef enum TsRegisterClass {
+    TS_REGISTER_CLASS_B, // Constant buffers
+    TS_REGISTER_CLASS_T, // Textures and read-only buffers
+    TS_REGISTER_CLASS_U, // Read-write buffers
+    TS_REGISTER_CLASS_S, // Samplers
+    TS_REGISTER_CLASS_COUNT,
+} TsRegisterClass;
+
+typedef enum TsResourceKind {
+    TS_RESOURCE_CONSTANT_BUFFER,
+    TS_RESOURCE_STRUCTURED_BUFFER,
+    TS_RESOURCE_RW_STRUCTURED_BUFFER,
+    TS_RESOURCE_TEXTURE,
+    TS_RESOURCE_SAMPLER,
+} TsResourceKind;
+
+typedef struct TsBufferMember {
+    const char *name;
+    size_t offset; // In bytes, from the start of the buffer or of the element
+    size_t size;
+} TsBufferMember;
+
+typedef struct TsResource {
+    const char *name;
+    TsResourceKind kind;
+    unsigned int set;
+    unsigned int binding;
+    size_t size; // Constant buffer size or structured buffer element stride, 0 otherwise
+    const TsBufferMember *members; // Top level fields of the buffer's struct, if any
+    size_t member_count;
+} TsResource;
+
+typedef struct TsPassStats {
+    const char *name;
+    double milliseconds;
+    size_t inst_count_before; // Instructions in function bodies before the pass ran
+    size_t inst_count_after;
+} TsPassStats;
+
+// Milliseconds spent in each phase of a compilation, 0 for the phases that did not run
+typedef struct TsPhaseTimes {
+    double parse; // Preprocessing, lexing and parsing, and loading the precompiled header
+    double analyze;
+    double build_ir;
+    double optimize;
+    double codegen;
+} TsPhaseTimes;
+
 TsCompilerOptions *tsCompilerOptionsCreate(void);
 void tsCompilerOptionsSetStage(TsCompilerOptions *options, TsShaderStage stage);
 void tsCompilerOptionsSetEntryPoint(TsCompilerOptions *options, const char *entry_point, size_t entry_point_length);
@@ -31,13 +81,42 @@ void tsCompilerOptionsSetSource(
     size_t path_length // if path is NULL, this should be zero
 );
 void tsCompilerOptionsAddIncludePath(TsCompilerOptions *options, const char* path, size_t path_length);
+void tsCompilerOptionsSetPrecompiledHeader(
+    TsCompilerOptions *options,
+    const unsigned char *data, // not copied, must stay valid until tsCompile returns
+    size_t size
+);
+// Packs buffers tightly instead of using std140/std430, the device needs
+// VK_EXT_scalar_block_layout
+void tsCompilerOptionsSetScalarBlockLayout(TsCompilerOptions *options, int enabled);
+// 0 (the default) emits the IR as built, 1 and 2 run the optimization passes
+void tsCompilerOptionsSetOptimizationLevel(TsCompilerOptions *options, int level);
+// Added to the binding of every register of a class, in all spaces, so that registers of
+// different classes with the same number do not end up on the same binding
+void tsCompilerOptionsSetBindingShift(
+    TsCompilerOptions *options, TsRegisterClass register_class, unsigned int shift);
 void tsCompilerOptionsDestroy(TsCompilerOptions *options);
 
 TsCompilerOutput *tsCompile(TsCompilerOptions *options);
+TsCompilerOutput *tsPrecompileHeader(TsCompilerOptions *options);
 const char *tsCompilerOutputGetErrors(TsCompilerOutput *output);
 const unsigned char *tsCompilerOutputGetSpirv(TsCompilerOutput *output, size_t *spirv_byte_size);
+const unsigned char *tsCompilerOutputGetPrecompiledHeader(TsCompilerOutput *output, size_t *pch_byte_size);
+// The resources declared by the shader, owned by TsCompilerOutput
+const TsResource *tsCompilerOutputGetResources(TsCompilerOutput *output, size_t *resource_count);
+// One entry per optimization pass that ran, in order, owned by TsCompilerOutput
+const TsPassStats *tsCompilerOutputGetPassStats(TsCompilerOutput *output, size_t *pass_count);
+const TsPhaseTimes *tsCompilerOutputGetPhaseTimes(TsCompilerOutput *output);
 void tsCompilerOutputDestroy(TsCompilerOutput *output);
 
+// A session keeps the parsed declarations of the last source it compiled, so that
+// compiling an edited version of it only parses the declarations that changed. It is
+// only a parse cache: analysis and code generation still run on the whole source.
+// A session must not be used by several threads at once.
+TsSession *tsSessionCreate(void);
+TsCompilerOutput *tsSessionCompile(TsSession *session, TsCompilerOptions *options);
+void tsSessionDestroy(TsSession *session);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,31 +4,233 @@
  */
 #include "tinyshader_internal.h"
 
+////////////////////////////////
+//
+// Symbol table
+//
+// All lexical scopes of a module share one table. Every distinct name owns a slot that
+// points to its innermost binding, and each binding links to the binding it shadows.
+// Opening a scope only records a marker; closing it unlinks the bindings made since the
+// marker. Lookups, declarations and scope changes are O(1) regardless of nesting depth.
+//
+////////////////////////////////
+
+typedef struct Symbol
+{
+    AstDecl *decl;
+    uint32_t slot;     // Slot of the symbol's name
+    uint32_t shadowed; // Binding hidden by this one (index + 1, 0 if none)
+    uint32_t depth;    // Depth of the scope that declared it
+} Symbol;
+
+typedef struct SymbolSlot
+{
+    const char *name;
+    uint64_t hash;
+    uint32_t binding; // Innermost binding of the name (index + 1, 0 if none)
+} SymbolSlot;
+
+typedef struct SymbolTable
+{
+    TsCompiler *compiler;
+
+    SymbolSlot *slots; // Open addressing, slots are never removed
+    uint32_t slot_cap;
+    uint32_t slot_count;
+
+    ARRAY_OF(Symbol) symbols;
+    ARRAY_OF(uint32_t) scope_starts; // symbols.len at the start of each open scope
+} SymbolTable;
+
+static void symbolTableInit(TsCompiler *compiler, SymbolTable *table)
+{
+    memset(table, 0, sizeof(*table));
+    table->compiler = compiler;
+    table->slot_cap = 64;
+    table->slots = NEW_ARRAY(compiler, SymbolSlot, table->slot_cap);
+}
+
+static uint32_t symbolTableFindSlot(SymbolTable *table, const char *name, uint64_t hash)
+{
+    uint32_t i = (uint32_t)hash & (table->slot_cap - 1);
+    while (table->slots[i].name &&
+           (table->slots[i].hash != hash || strcmp(table->slots[i].name, name) != 0))
+    {
+        i = (i + 1) & (table->slot_cap - 1);
+    }
+    return i;
+}
+
+static void symbolTableGrow(SymbolTable *table)
+{
+    SymbolSlot *old_slots = table->slots;
+    uint32_t old_cap = table->slot_cap;
+
+    table->slot_cap *= 2;
+    table->slots = NEW_ARRAY(table->compiler, SymbolSlot, table->slot_cap);
+
+    for (uint32_t i = 0; i < old_cap; ++i)
+    {
+        if (!old_slots[i].name) continue;
+
+        uint32_t slot = symbolTableFindSlot(table, old_slots[i].name, old_slots[i].hash);
+        table->slots[slot] = old_slots[i];
+
+        // Fix up the bindings that refer to the old slot
+        uint32_t binding = old_slots[i].binding;
+        while (binding != 0)
+        {
+            table->symbols.ptr[binding - 1].slot = slot;
+            binding = table->symbols.ptr[binding - 1].shadowed;
+        }
+    }
+}
+
+static void symbolTablePushScope(SymbolTable *table)
+{
+    arrPush(table->compiler, &table->scope_starts, (uint32_t)table->symbols.len);
+}
+
+static void symbolTablePopScope(SymbolTable *table)
+{
+    assert(table->scope_starts.len > 0);
+    uint32_t start = *arrPop(&table->scope_starts);
+
+    while (table->symbols.len > start)
+    {
+        Symbol *sym = arrPop(&table->symbols);
+        table->slots[sym->slot].binding = sym->shadowed;
+    }
+}
+
+static Symbol *symbolTableGet(SymbolTable *table, const char *name)
+{
+    uint32_t slot = symbolTableFindSlot(table, name, ts__hashString(name));
+    uint32_t binding = table->slots[slot].binding;
+    if (binding == 0) return NULL;
+    return &table->symbols.ptr[binding - 1];
+}
+
+// Like symbolTableGet, but skips the bindings of the local scopes below 'min_depth'.
+// The global scope, at depth 1, stays visible.
+static Symbol *symbolTableGetAbove(SymbolTable *table, const char *name, uint32_t min_depth)
+{
+    Symbol *sym = symbolTableGet(table, name);
+    while (sym && sym->depth > 1 && sym->depth < min_depth)
+    {
+        sym = sym->shadowed ? &table->symbols.ptr[sym->shadowed - 1] : NULL;
+    }
+    return sym;
+}
+
+// Returns the symbol only if it was declared in the innermost open scope
+static Symbol *symbolTableGetLocal(SymbolTable *table, const char *name)
+{
+    Symbol *sym = symbolTableGet(table, name);
+    if (sym && sym->depth == table->scope_starts.len) return sym;
+    return NULL;
+}
+
+static void symbolTableAdd(SymbolTable *table, const char *name, AstDecl *decl)
+{
+    assert(table->scope_starts.len > 0);
+
+    if ((table->slot_count + 1) * 2 > table->slot_cap)
+    {
+        symbolTableGrow(table);
+    }
+
+    uint64_t hash = ts__hashString(name);
+    uint32_t slot = symbolTableFindSlot(table, name, hash);
+    if (!table->slots[slot].name)
+    {
+        table->slots[slot].name = name;
+        table->slots[slot].hash = hash;
+        table->slot_count++;
+    }
+
+    Symbol sym = {0};
+    sym.decl = decl;
+    sym.slot = slot;
+    sym.shadowed = table->slots[slot].binding;
+    sym.depth = (uint32_t)table->scope_starts.len;
+    arrPush(table->compiler, &table->symbols, sym);
+
+    table->slots[slot].binding = (uint32_t)table->symbols.len;
+}
+
+// Copies the table, so that another thread can open its own scopes on top of it
+static void symbolTableClone(TsCompiler *compiler, SymbolTable *dst, const SymbolTable *src)
+{
+    *dst = *src;
+    dst->compiler = compiler;
+
+    dst->slots = NEW_ARRAY(compiler, SymbolSlot, src->slot_cap);
+    memcpy(dst->slots, src->slots, sizeof(SymbolSlot) * src->slot_cap);
+
+    memset(&dst->symbols, 0, sizeof(dst->symbols));
+    for (size_t i = 0; i < src->symbols.len; ++i)
+    {
+        arrPush(compiler, &dst->symbols, src->symbols.ptr[i]);
+    }
+
+    memset(&dst->scope_starts, 0, sizeof(dst->scope_starts));
+    for (size_t i = 0; i < src->scope_starts.len; ++i)
+    {
+        arrPush(compiler, &dst->scope_starts, src->scope_starts.ptr[i]);
+    }
+}
+
+// Errors reported while analyzing a function body: compiler->errors[first, first+count)
+typedef struct BodyErrors
+{
+    AstDecl *func;
+    size_t first;
+    size_t count;
+} BodyErrors;
+
 typedef struct Analyzer
 {
     TsCompiler *compiler;
     Module *module;
 
     AstDecl *scope_func;
-    ArrayOfScopePtr scope_stack;
+    SymbolTable symbols;
+
+    // While set, identifiers name struct members and are looked up here only
+    Scope *member_scope;
 
     ArrayOfAstStmtPtr continue_stack;
     ArrayOfAstStmtPtr break_stack;
 
+    // Functions reachable from the entry point whose bodies still need analysis
+    ArrayOfAstDeclPtr func_queue;
+
+    // Functions referenced by the analyzed code, merged into 'func_queue' later on
+    ArrayOfAstDeclPtr reached;
+
+    ARRAY_OF(BodyErrors) body_errors;
+
+    // Binary expressions whose left operands are being walked, see analyzerAnalyzeExpr
+    ArrayOfAstExprPtr binary_stack;
+
     uint32_t last_uniform_binding;
+    ArrayOfAstDeclPtr resources; // Resources bound so far, see analyzerCheckBinding
+    uint32_t expr_depth; // Nesting of the expressions being analyzed
+    bool dead_code;      // Set while analyzing statements that can never run
+
+    // Identifiers do not see the local scopes below this depth, which hides the locals
+    // of the function being analyzed from the templates it instantiates
+    uint32_t symbol_min_depth;
+
+    // Instantiations in progress, innermost last
+    ARRAY_OF(struct TemplateInstance) instantiating;
 } Analyzer;
 
-static void scopeInit(TsCompiler *compiler, Scope *scope, Scope *parent, AstDecl *owner)
+static void scopeInit(TsCompiler *compiler, Scope *scope)
 {
     memset(scope, 0, sizeof(*scope));
     ts__hashInit(compiler, &scope->map, 0);
-    scope->parent = parent;
-    scope->owner = owner;
-}
-
-static void scopeDestroy(Scope *scope)
-{
-    ts__hashDestroy(&scope->map);
 }
 
 static AstDecl *scopeGetLocal(Scope *scope, const char *name)
@@ -39,17 +241,6 @@ static AstDecl *scopeGetLocal(Scope *scope, const char *name)
     return NULL;
 }
 
-static AstDecl *scopeGetGlobal(Scope *scope, const char *name)
-{
-    if (scope->parent)
-    {
-        AstDecl *sym = scopeGetGlobal(scope->parent, name);
-        if (sym) return sym;
-    }
-
-    return scopeGetLocal(scope, name);
-}
-
 static bool scopeAdd(Scope *scope, const char *name, AstDecl *decl)
 {
     assert(scope);
@@ -61,177 +252,121 @@ static bool scopeAdd(Scope *scope, const char *name, AstDecl *decl)
     return true;
 }
 
-static void scopeClone(Scope *new_scope, Scope *old_scope, AstDecl *new_owner)
+static uint64_t typeHash(const void *item)
 {
-    memcpy(new_scope, old_scope, sizeof(Scope));
-    new_scope->owner = new_owner;
-}
-
-static char *typeToString(TsCompiler *compiler, AstType *type)
-{
-    if (type->string) return type->string;
-
-    char *prefix = NULL;
-    char *storage_class = NULL;
-    char *sub = NULL;
-    char *postfix = NULL;
+    const AstType *type = item;
+    uint64_t hash = ts__hashCombine(0, (uint64_t)type->kind);
 
     switch (type->kind)
     {
-    case TYPE_VOID: prefix = "void"; break;
-
-    case TYPE_TYPE: prefix = "type"; break;
-
-    case TYPE_BOOL: prefix = "bool"; break;
+    case TYPE_VOID:
+    case TYPE_TYPE:
+    case TYPE_BOOL:
+    case TYPE_SAMPLER: break;
 
-    case TYPE_FLOAT:
-        ts__sbReset(&compiler->sb);
-        ts__sbSprintf(&compiler->sb, "float%u", type->float_.bits);
-        prefix = ts__sbBuild(&compiler->sb, &compiler->alloc);
-        break;
+    case TYPE_FLOAT: hash = ts__hashCombine(hash, type->float_.bits); break;
 
     case TYPE_INT:
-        ts__sbReset(&compiler->sb);
-
-        if (type->int_.is_signed)
-            ts__sbAppend(&compiler->sb, "int");
-        else
-            ts__sbAppend(&compiler->sb, "uint");
-
-        ts__sbSprintf(&compiler->sb, "%u", type->int_.bits);
-        prefix = ts__sbBuild(&compiler->sb, &compiler->alloc);
+        hash = ts__hashCombine(hash, type->int_.bits);
+        hash = ts__hashCombine(hash, type->int_.is_signed);
         break;
 
     case TYPE_VECTOR:
-        ts__sbReset(&compiler->sb);
-        ts__sbSprintf(&compiler->sb, "vec%u", type->vector.size);
-        prefix = ts__sbBuild(&compiler->sb, &compiler->alloc);
-
-        sub = typeToString(compiler, type->vector.elem_type);
+        hash = ts__hashCombine(hash, type->vector.size);
+        hash = ts__hashCombine(hash, (uintptr_t)type->vector.elem_type);
         break;
-    case TYPE_MATRIX:
-        ts__sbReset(&compiler->sb);
-        ts__sbSprintf(&compiler->sb, "mat%u", type->matrix.col_count);
-        prefix = ts__sbBuild(&compiler->sb, &compiler->alloc);
 
-        sub = typeToString(compiler, type->matrix.col_type);
+    case TYPE_MATRIX:
+        hash = ts__hashCombine(hash, type->matrix.col_count);
+        hash = ts__hashCombine(hash, (uintptr_t)type->matrix.col_type);
         break;
 
-    case TYPE_POINTER: {
-        prefix = "ptr";
-
-        switch (type->ptr.storage_class)
-        {
-        case SpvStorageClassInput: storage_class = "input"; break;
-        case SpvStorageClassOutput: storage_class = "output"; break;
-        case SpvStorageClassUniformConstant: storage_class = "constant"; break;
-        case SpvStorageClassUniform: storage_class = "uniform"; break;
-        case SpvStorageClassStorageBuffer: storage_class = "storage"; break;
-        case SpvStorageClassFunction: storage_class = "function"; break;
-
-        default: assert(0); break;
-        }
-
-        assert(type->ptr.sub);
-        sub = typeToString(compiler, type->ptr.sub);
+    case TYPE_POINTER:
+        hash = ts__hashCombine(hash, type->ptr.storage_class);
+        hash = ts__hashCombine(hash, (uintptr_t)type->ptr.sub);
         break;
-    }
 
     case TYPE_CONSTANT_BUFFER:
-        prefix = "CB";
-        sub = typeToString(compiler, type->buffer.sub);
-        break;
-
     case TYPE_STRUCTURED_BUFFER:
-        prefix = "SB";
-        sub = typeToString(compiler, type->buffer.sub);
-        break;
-
     case TYPE_RW_STRUCTURED_BUFFER:
-        prefix = "RWSB";
-        sub = typeToString(compiler, type->buffer.sub);
+        hash = ts__hashCombine(hash, (uintptr_t)type->buffer.sub);
         break;
 
-    case TYPE_FUNC: {
-        prefix = "func";
-
-        char *return_type = typeToString(compiler, type->func.return_type);
-        char **params = NEW_ARRAY(compiler, char *, type->func.param_count);
+    case TYPE_FUNC:
+        hash = ts__hashCombine(hash, (uintptr_t)type->func.return_type);
+        hash = ts__hashCombine(hash, type->func.param_count);
         for (uint32_t i = 0; i < type->func.param_count; ++i)
         {
-            params[i] = typeToString(compiler, type->func.params[i]);
+            hash = ts__hashCombine(hash, (uintptr_t)type->func.params[i]);
         }
+        break;
 
-        ts__sbReset(&compiler->sb);
-        ts__sbAppend(&compiler->sb, return_type);
-        ts__sbAppend(&compiler->sb, "$");
-        ts__sbSprintf(&compiler->sb, "%u", type->func.param_count);
-        for (uint32_t i = 0; i < type->func.param_count; ++i)
-        {
-            if (i != 0) ts__sbAppend(&compiler->sb, "_");
-            ts__sbAppend(&compiler->sb, params[i]);
-        }
-        sub = ts__sbBuild(&compiler->sb, &compiler->alloc);
+    // Structs are nominal
+    case TYPE_STRUCT: hash = ts__hashCombine(hash, ts__hashString(type->struct_.name)); break;
 
+    case TYPE_IMAGE:
+        hash = ts__hashCombine(hash, (uintptr_t)type->image.sampled_type);
+        hash = ts__hashCombine(hash, type->image.dim);
         break;
     }
 
-    case TYPE_STRUCT: {
-        ts__sbReset(&compiler->sb);
-        ts__sbSprintf(
-            &compiler->sb, "struct%u%s", strlen(type->struct_.name), type->struct_.name);
-        prefix = ts__sbBuild(&compiler->sb, &compiler->alloc);
-        break;
-    }
+    return hash;
+}
 
-    case TYPE_SAMPLER: {
-        prefix = "sampler";
-        break;
-    }
+// Sub-types are interned already, so they compare by pointer
+static bool typeEqual(const void *a_item, const void *b_item)
+{
+    const AstType *a = a_item;
+    const AstType *b = b_item;
+    if (a->kind != b->kind) return false;
 
-    case TYPE_IMAGE: {
-        prefix = "image";
+    switch (a->kind)
+    {
+    case TYPE_VOID:
+    case TYPE_TYPE:
+    case TYPE_BOOL:
+    case TYPE_SAMPLER: return true;
 
-        sub = typeToString(compiler, type->image.sampled_type);
+    case TYPE_FLOAT: return a->float_.bits == b->float_.bits;
 
-        switch (type->image.dim)
-        {
-        case SpvDimCube: postfix = "Cube"; break;
-        case SpvDim1D: postfix = "1D"; break;
-        case SpvDim2D: postfix = "2D"; break;
-        case SpvDim3D: postfix = "3D"; break;
-        default: assert(0); break;
-        }
+    case TYPE_INT:
+        return a->int_.bits == b->int_.bits && a->int_.is_signed == b->int_.is_signed;
 
-        break;
-    }
-    }
+    case TYPE_VECTOR:
+        return a->vector.size == b->vector.size &&
+               a->vector.elem_type == b->vector.elem_type;
 
-    ts__sbReset(&compiler->sb);
+    case TYPE_MATRIX:
+        return a->matrix.col_count == b->matrix.col_count &&
+               a->matrix.col_type == b->matrix.col_type;
 
-    assert(prefix);
-    ts__sbAppend(&compiler->sb, prefix);
+    case TYPE_POINTER:
+        return a->ptr.storage_class == b->ptr.storage_class && a->ptr.sub == b->ptr.sub;
 
-    if (storage_class)
-    {
-        ts__sbAppend(&compiler->sb, "_");
-        ts__sbAppend(&compiler->sb, storage_class);
-    }
+    case TYPE_CONSTANT_BUFFER:
+    case TYPE_STRUCTURED_BUFFER:
+    case TYPE_RW_STRUCTURED_BUFFER: return a->buffer.sub == b->buffer.sub;
 
-    if (sub)
-    {
-        ts__sbAppend(&compiler->sb, "_");
-        ts__sbAppend(&compiler->sb, sub);
-    }
+    case TYPE_FUNC:
+        if (a->func.return_type != b->func.return_type ||
+            a->func.param_count != b->func.param_count)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < a->func.param_count; ++i)
+        {
+            if (a->func.params[i] != b->func.params[i]) return false;
+        }
+        return true;
 
-    if (postfix)
-    {
-        ts__sbAppend(&compiler->sb, "_");
-        ts__sbAppend(&compiler->sb, postfix);
+    case TYPE_STRUCT: return strcmp(a->struct_.name, b->struct_.name) == 0;
+
+    case TYPE_IMAGE:
+        return a->image.sampled_type == b->image.sampled_type &&
+               a->image.dim == b->image.dim;
     }
 
-    type->string = ts__sbBuild(&compiler->sb, &compiler->alloc);
-    return type->string;
+    return false;
 }
 
 static char *typeToPrettyString(TsCompiler *compiler, AstType *type)
@@ -404,271 +539,519 @@ static uint32_t padToAlignment(uint32_t current, uint32_t align)
     return current;
 }
 
-static uint32_t typeAlignOf(Module *m, AstType *type)
+static uint32_t scalarSizeOf(AstType *type)
+{
+    type = ts__getScalarType(type);
+    return (type->kind == TYPE_FLOAT ? type->float_.bits : type->int_.bits) / 8;
+}
+
+// Size and alignment of a vector with 'count' components of 'elem_size' bytes each
+static void vectorLayoutOf(
+    uint32_t elem_size,
+    uint32_t count,
+    AstLayoutRules rules,
+    uint32_t *size,
+    uint32_t *align)
 {
-    assert(type);
-    if (type->align > 0) return type->align;
+    *size = elem_size * count;
+    *align = elem_size;
+    if (rules == LAYOUT_SCALAR) return;
 
-    uint32_t align = 1;
-    switch (type->kind)
+    switch (count)
     {
-    case TYPE_INT: align = type->int_.bits / 8; break;
-    case TYPE_FLOAT: align = type->float_.bits / 8; break;
+    case 1: break;
+    case 2: *align = elem_size * 2; break;
+    case 3:
+    case 4: *align = elem_size * 4; break;
+    default: assert(0); break;
+    }
+}
+
+// Matrices are decorated RowMajor, so they are laid out as an array of rows which each
+// hold one component of every column
+static uint32_t matrixStrideOf(AstType *type, AstLayoutRules rules, uint32_t *align)
+{
+    uint32_t row_size, row_align;
+    vectorLayoutOf(
+        scalarSizeOf(type->matrix.col_type),
+        type->matrix.col_count,
+        rules,
+        &row_size,
+        &row_align);
+
+    // Array elements are padded to 16 bytes in std140
+    if (rules == LAYOUT_STD140) row_align = padToAlignment(row_align, 16);
+
+    *align = row_align;
+    return padToAlignment(row_size, row_align);
+}
+
+static AstStructLayout *structLayoutOf(Module *m, AstType *type, AstLayoutRules rules);
 
-    case TYPE_CONSTANT_BUFFER: align = typeAlignOf(m, type->buffer.sub); break;
-    case TYPE_STRUCTURED_BUFFER: align = typeAlignOf(m, type->buffer.sub); break;
-    case TYPE_RW_STRUCTURED_BUFFER: align = typeAlignOf(m, type->buffer.sub); break;
+// Returns false for the types that cannot be stored in a buffer
+static bool typeLayoutOf(
+    Module *m, AstType *type, AstLayoutRules rules, uint32_t *size, uint32_t *align)
+{
+    switch (type->kind)
+    {
+    case TYPE_INT: *size = *align = type->int_.bits / 8; return true;
+    case TYPE_FLOAT: *size = *align = type->float_.bits / 8; return true;
 
     case TYPE_VECTOR: {
-        switch (type->vector.size)
+        uint32_t elem_size, elem_align;
+        if (!typeLayoutOf(m, type->vector.elem_type, rules, &elem_size, &elem_align))
         {
-        case 2: align = typeAlignOf(m, type->vector.elem_type) * 2; break;
-        case 3:
-        case 4: align = typeAlignOf(m, type->vector.elem_type) * 4; break;
-        default: assert(0); break;
+            return false;
         }
-
-        break;
+        vectorLayoutOf(elem_size, type->vector.size, rules, size, align);
+        return true;
     }
 
     case TYPE_MATRIX: {
-        align = typeAlignOf(m, type->matrix.col_type);
-        break;
+        uint32_t stride = matrixStrideOf(type, rules, align);
+        *size = stride * type->matrix.col_type->vector.size;
+        return true;
     }
 
     case TYPE_STRUCT: {
-        for (AstType **field = type->struct_.fields;
-             field != type->struct_.fields + type->struct_.field_count;
-             ++field)
-        {
-            uint32_t field_align = typeAlignOf(m, *field);
-            if (field_align > align) align = field_align;
-        }
-
-        break;
+        AstStructLayout *layout = structLayoutOf(m, type, rules);
+        *size = layout->size;
+        *align = layout->align;
+        return true;
     }
 
+    case TYPE_BOOL:
     case TYPE_IMAGE:
     case TYPE_SAMPLER:
     case TYPE_POINTER:
-    case TYPE_BOOL:
     case TYPE_FUNC:
     case TYPE_VOID:
-    case TYPE_TYPE: align = 0; break;
+    case TYPE_TYPE:
+    case TYPE_CONSTANT_BUFFER:
+    case TYPE_STRUCTURED_BUFFER:
+    case TYPE_RW_STRUCTURED_BUFFER: break;
     }
 
-    type->align = align;
+    return false;
+}
+
+// Checks an offset given with packoffset. Vectors may sit at any multiple of their
+// component size as long as they do not cross a 16 byte register, like the relaxed block
+// layout of Vulkan 1.1 allows.
+static bool isPackOffsetValid(
+    AstType *type, AstLayoutRules rules, uint32_t offset, uint32_t size, uint32_t align)
+{
+    if (type->kind == TYPE_VECTOR)
+    {
+        align = scalarSizeOf(type);
+        if (rules != LAYOUT_SCALAR && size <= 16 && offset / 16 != (offset + size - 1) / 16)
+        {
+            return false;
+        }
+    }
 
-    return type->align;
+    return offset % align == 0;
 }
 
-static uint32_t typeSizeOf(Module *m, AstType *type)
+// Memoized, the layout of a struct is computed once for each set of rules
+static AstStructLayout *structLayoutOf(Module *m, AstType *type, AstLayoutRules rules)
 {
-    assert(type);
-    if (type->size > 0) return type->size;
+    if (type->struct_.layouts[rules]) return type->struct_.layouts[rules];
+
+    TsCompiler *compiler = m->compiler;
+    uint32_t field_count = type->struct_.field_count;
+
+    AstStructLayout *layout = NEW(compiler, AstStructLayout);
+    layout->rules = rules;
+    layout->offsets = NEW_ARRAY(compiler, uint32_t, field_count);
+    layout->sizes = NEW_ARRAY(compiler, uint32_t, field_count);
+    layout->matrix_strides = NEW_ARRAY(compiler, uint32_t, field_count);
 
     uint32_t size = 0;
+    uint32_t align = 1;
 
-    switch (type->kind)
+    for (uint32_t i = 0; i < field_count; ++i)
     {
-    case TYPE_INT: size = type->int_.bits / 8; break;
-    case TYPE_FLOAT: size = type->float_.bits / 8; break;
+        AstType *field = type->struct_.fields[i];
+        AstDecl *field_decl = type->struct_.field_decls[i];
 
-    case TYPE_CONSTANT_BUFFER: size = typeSizeOf(m, type->buffer.sub); break;
-    case TYPE_STRUCTURED_BUFFER: size = typeSizeOf(m, type->buffer.sub); break;
-    case TYPE_RW_STRUCTURED_BUFFER: size = typeSizeOf(m, type->buffer.sub); break;
-
-    case TYPE_VECTOR: {
-        switch (type->vector.size)
+        uint32_t field_size, field_align;
+        if (!typeLayoutOf(m, field, rules, &field_size, &field_align))
         {
-        case 2: size = typeSizeOf(m, type->vector.elem_type) * 2; break;
-        case 3: size = typeSizeOf(m, type->vector.elem_type) * 3; break;
-        case 4: size = typeSizeOf(m, type->vector.elem_type) * 4; break;
-        default: assert(0); break;
+            ts__addErrAt(
+                compiler,
+                field_decl->loc,
+                "field '%s' of type '%s' cannot be stored in a buffer",
+                field_decl->name,
+                typeToPrettyString(compiler, field));
+            field_size = 0;
+            field_align = 1;
         }
-        break;
-    }
 
-    case TYPE_MATRIX: {
-        size = typeSizeOf(m, type->matrix.col_type) * type->matrix.col_count;
-        break;
-    }
+        uint32_t offset = padToAlignment(size, field_align);
 
-    case TYPE_STRUCT: {
-        for (uint32_t i = 0; i < type->struct_.field_count; ++i)
+        if (field_decl->struct_field.has_packoffset)
         {
-            AstType *field = type->struct_.fields[i];
-            uint32_t field_align = typeAlignOf(m, field);
-            size = padToAlignment(size, field_align); // Add padding
-
-            IRMemberDecoration member_dec = {0};
-            member_dec.kind = SpvDecorationOffset;
-            member_dec.member_index = i;
-            member_dec.value = size;
-            arrPush(m->compiler, &type->struct_.field_decorations, member_dec);
+            uint32_t packed = field_decl->struct_field.packoffset;
+            if (packed < size)
+            {
+                ts__addErrAt(
+                    compiler,
+                    field_decl->loc,
+                    "packoffset of '%s' overlaps the previous fields",
+                    field_decl->name);
+            }
+            else if (!isPackOffsetValid(field, rules, packed, field_size, field_align))
+            {
+                ts__addErrAt(
+                    compiler,
+                    field_decl->loc,
+                    "packoffset of '%s' is misaligned for type '%s'",
+                    field_decl->name,
+                    typeToPrettyString(compiler, field));
+            }
+            else
+            {
+                offset = packed;
+            }
+        }
 
-            size += typeSizeOf(m, field);
+        if (field->kind == TYPE_MATRIX)
+        {
+            uint32_t matrix_align;
+            layout->matrix_strides[i] = matrixStrideOf(field, rules, &matrix_align);
         }
 
-        break;
-    }
+        layout->offsets[i] = offset;
+        layout->sizes[i] = field_size;
 
-    case TYPE_IMAGE:
-    case TYPE_SAMPLER:
-    case TYPE_POINTER:
-    case TYPE_BOOL:
-    case TYPE_FUNC:
-    case TYPE_VOID:
-    case TYPE_TYPE: size = 0; break;
+        size = offset + field_size;
+        if (field_align > align) align = field_align;
     }
 
-    type->size = size;
-    return type->size;
+    // Structs are aligned like vec4 in std140
+    if (rules == LAYOUT_STD140) align = padToAlignment(align, 16);
+
+    layout->align = align;
+    layout->size = padToAlignment(size, align);
+
+    type->struct_.layouts[rules] = layout;
+    return layout;
 }
 
-static AstType *getCachedType(Module *m, AstType *type)
+static bool structLayoutEqual(AstType *type, AstStructLayout *a, AstStructLayout *b)
 {
-    char *type_string = typeToString(m->compiler, type);
-    assert(type_string);
-    assert(strlen(type_string) > 0);
-
-    AstType *found_type = NULL;
-    if (ts__hashGet(&m->type_cache, type_string, (void **)&found_type))
+    if (a->size != b->size) return false;
+    for (uint32_t i = 0; i < type->struct_.field_count; ++i)
     {
-        assert(found_type);
-        return found_type;
+        if (a->offsets[i] != b->offsets[i] || a->matrix_strides[i] != b->matrix_strides[i])
+        {
+            return false;
+        }
     }
+    return true;
+}
 
-    ts__hashSet(&m->type_cache, type_string, type);
+// Gives a struct, and the structs nested in it, the layout of a buffer that holds it.
+// There is a single SPIR-V type for each struct, so returns false if another buffer
+// already needed a different layout.
+static bool structAssignLayout(Module *m, AstType *type, AstLayoutRules rules)
+{
+    TsCompiler *compiler = m->compiler;
+    AstStructLayout *layout = structLayoutOf(m, type, rules);
 
-    typeSizeOf(m, type);
+    bool compatible = true;
+    for (uint32_t i = 0; i < type->struct_.field_count; ++i)
+    {
+        AstType *field = type->struct_.fields[i];
+        if (field->kind == TYPE_STRUCT && !structAssignLayout(m, field, rules))
+        {
+            compatible = false;
+        }
+    }
 
-    return type;
+    if (type->struct_.layout)
+    {
+        return compatible && structLayoutEqual(type, type->struct_.layout, layout);
+    }
+
+    type->struct_.layout = layout;
+
+    for (uint32_t i = 0; i < type->struct_.field_count; ++i)
+    {
+        IRMemberDecoration member_dec = {0};
+        member_dec.kind = SpvDecorationOffset;
+        member_dec.member_index = i;
+        member_dec.value = layout->offsets[i];
+        arrPush(compiler, &type->struct_.field_decorations, member_dec);
+
+        if (type->struct_.fields[i]->kind == TYPE_MATRIX)
+        {
+            member_dec.kind = SpvDecorationRowMajor;
+            member_dec.value = 0;
+            arrPush(compiler, &type->struct_.field_decorations, member_dec);
+
+            member_dec.kind = SpvDecorationMatrixStride;
+            member_dec.value = layout->matrix_strides[i];
+            arrPush(compiler, &type->struct_.field_decorations, member_dec);
+        }
+    }
+
+    return compatible;
+}
+
+// Lays out the contents of a buffer variable. Runs on the main thread, with the global
+// declarations.
+static void analyzerLayoutBuffer(Analyzer *a, AstDecl *decl)
+{
+    TsCompiler *compiler = a->compiler;
+    Module *m = a->module;
+    AstType *type = decl->type;
+
+    AstLayoutRules rules;
+    switch (type->kind)
+    {
+    case TYPE_CONSTANT_BUFFER: rules = LAYOUT_STD140; break;
+    case TYPE_STRUCTURED_BUFFER:
+    case TYPE_RW_STRUCTURED_BUFFER: rules = LAYOUT_STD430; break;
+    default: return;
+    }
+
+    if (m->scalar_block_layout) rules = LAYOUT_SCALAR;
+
+    AstType *sub = type->buffer.sub;
+
+    uint32_t size, align;
+    if (!typeLayoutOf(m, sub, rules, &size, &align))
+    {
+        ts__addErrAt(
+            compiler,
+            decl->loc,
+            "type '%s' cannot be stored in a buffer",
+            typeToPrettyString(compiler, sub));
+        return;
+    }
+
+    if (sub->kind == TYPE_STRUCT && !structAssignLayout(m, sub, rules))
+    {
+        ts__addErrAt(
+            compiler,
+            decl->loc,
+            "struct '%s' is laid out differently by another buffer",
+            sub->struct_.name);
+    }
+
+    type->buffer.stride = padToAlignment(size, align);
+    if (sub->kind == TYPE_MATRIX)
+    {
+        type->buffer.matrix_stride = matrixStrideOf(sub, rules, &align);
+    }
+}
+
+#define TYPE_CACHE_SHARD_BITS 4
+#define TYPE_CACHE_SHARD_COUNT (1 << TYPE_CACHE_SHARD_BITS)
+
+// Function bodies can be analyzed on several threads, so the cache is split into shards
+// that each have their own lock and their own allocator for the table
+typedef struct TypeCacheShard
+{
+    TsCompiler compiler; // Only the allocator is used
+    Mutex *mutex;
+    InternTable table;
+} TypeCacheShard;
+
+struct TypeCache
+{
+    TypeCacheShard shards[TYPE_CACHE_SHARD_COUNT];
+};
+
+static TypeCache *typeCacheCreate(TsCompiler *compiler)
+{
+    TypeCache *cache = NEW(compiler, TypeCache);
+    for (uint32_t i = 0; i < TYPE_CACHE_SHARD_COUNT; ++i)
+    {
+        TypeCacheShard *shard = &cache->shards[i];
+        ts__bumpInit(&shard->compiler.alloc, 1 << 12);
+        shard->mutex = ts__mutexCreate();
+        ts__internInit(&shard->compiler, &shard->table, typeHash, typeEqual);
+    }
+    return cache;
+}
+
+// The types themselves live in the compiler's allocator, only the tables are freed
+static void typeCacheDestroy(TypeCache *cache)
+{
+    for (uint32_t i = 0; i < TYPE_CACHE_SHARD_COUNT; ++i)
+    {
+        TypeCacheShard *shard = &cache->shards[i];
+        ts__bumpDestroy(&shard->compiler.alloc);
+        ts__mutexDestroy(shard->mutex);
+    }
+}
+
+// Returns the interned type equal to 'key', copying the key into the arena only when
+// the type is new, so lookups of existing types allocate nothing
+static AstType *getCachedType(Module *m, const AstType *key)
+{
+    uint64_t hash = typeHash(key);
+
+    // The low bits of the hash pick the slot inside the shard, so mix it before
+    // taking the high bits
+    uint64_t shard_index = (hash * 0x9e3779b97f4a7c15ULL) >> (64 - TYPE_CACHE_SHARD_BITS);
+    TypeCacheShard *shard = &m->type_cache->shards[shard_index];
+
+    ts__mutexLock(shard->mutex);
+    AstType *found_type = ts__internFind(&shard->table, key, hash);
+    if (!found_type)
+    {
+        found_type = NEW(m->compiler, AstType);
+        *found_type = *key;
+
+        if (key->kind == TYPE_FUNC && key->func.param_count > 0)
+        {
+            uint32_t param_count = key->func.param_count;
+            found_type->func.params = NEW_ARRAY(m->compiler, AstType *, param_count);
+            memcpy(
+                found_type->func.params,
+                key->func.params,
+                sizeof(AstType *) * param_count);
+        }
+        else if (key->kind == TYPE_STRUCT && key->struct_.field_count > 0)
+        {
+            uint32_t field_count = key->struct_.field_count;
+
+            found_type->struct_.fields = NEW_ARRAY(m->compiler, AstType *, field_count);
+            memcpy(
+                found_type->struct_.fields,
+                key->struct_.fields,
+                sizeof(AstType *) * field_count);
+
+            found_type->struct_.field_decls =
+                NEW_ARRAY(m->compiler, AstDecl *, field_count);
+            memcpy(
+                found_type->struct_.field_decls,
+                key->struct_.field_decls,
+                sizeof(AstDecl *) * field_count);
+        }
+
+        ts__internHashed(&shard->table, found_type, hash);
+    }
+    ts__mutexUnlock(shard->mutex);
+
+    return found_type;
 }
 
 static AstType *newBasicType(Module *m, AstTypeKind kind)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = kind;
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = kind;
+    return getCachedType(m, &key);
 }
 
 static AstType *newPointerType(Module *m, SpvStorageClass storage_class, AstType *sub)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = TYPE_POINTER;
-    ty->ptr.storage_class = storage_class;
-    ty->ptr.sub = sub;
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = TYPE_POINTER;
+    key.ptr.storage_class = storage_class;
+    key.ptr.sub = sub;
+    return getCachedType(m, &key);
 }
 
 static AstType *newVectorType(Module *m, AstType *elem_type, uint32_t size)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = TYPE_VECTOR;
-    ty->vector.elem_type = elem_type;
-    ty->vector.size = size;
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = TYPE_VECTOR;
+    key.vector.elem_type = elem_type;
+    key.vector.size = size;
+    return getCachedType(m, &key);
 }
 
 static AstType *newMatrixType(Module *m, AstType *col_type, uint32_t col_count)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = TYPE_MATRIX;
-    ty->matrix.col_type = col_type;
-    ty->matrix.col_count = col_count;
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = TYPE_MATRIX;
+    key.matrix.col_type = col_type;
+    key.matrix.col_count = col_count;
+    return getCachedType(m, &key);
 }
 
 static AstType *newFloatType(Module *m, uint32_t bits)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = TYPE_FLOAT;
-    ty->float_.bits = bits;
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = TYPE_FLOAT;
+    key.float_.bits = bits;
+    return getCachedType(m, &key);
 }
 
 static AstType *newIntType(Module *m, uint32_t bits, bool is_signed)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = TYPE_INT;
-    ty->int_.bits = bits;
-    ty->int_.is_signed = is_signed;
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = TYPE_INT;
+    key.int_.bits = bits;
+    key.int_.is_signed = is_signed;
+    return getCachedType(m, &key);
 }
 
 static AstType *
 newFuncType(Module *m, AstType *return_type, AstType **params, uint32_t param_count)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = TYPE_FUNC;
-    ty->func.return_type = return_type;
-    if (param_count > 0)
-    {
-        ty->func.param_count = param_count;
-        ty->func.params = NEW_ARRAY(m->compiler, AstType *, param_count);
-        memcpy(ty->func.params, params, sizeof(AstType *) * param_count);
-    }
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = TYPE_FUNC;
+    key.func.return_type = return_type;
+    key.func.params = params;
+    key.func.param_count = param_count;
+    return getCachedType(m, &key);
 }
 
 static AstType *newStructType(
     Module *m, char *name, AstType **fields, AstDecl **field_decls, uint32_t field_count)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = TYPE_STRUCT;
-    ty->struct_.name = name;
-
-    if (field_count > 0)
-    {
-        ty->struct_.field_count = field_count;
-
-        ty->struct_.fields = NEW_ARRAY(m->compiler, AstType *, field_count);
-        memcpy(ty->struct_.fields, fields, sizeof(AstType *) * field_count);
-
-        ty->struct_.field_decls = NEW_ARRAY(m->compiler, AstDecl *, field_count);
-        memcpy(ty->struct_.field_decls, field_decls, sizeof(AstDecl *) * field_count);
-    }
-
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = TYPE_STRUCT;
+    key.struct_.name = name;
+    key.struct_.fields = fields;
+    key.struct_.field_decls = field_decls;
+    key.struct_.field_count = field_count;
+
+    return getCachedType(m, &key);
 }
 
 static AstType *newImageType(Module *m, AstType *sampled_type, SpvDim dim)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = TYPE_IMAGE;
-    ty->image.sampled_type = sampled_type;
-    ty->image.dim = dim;
-    ty->image.depth = 0;
-    ty->image.arrayed = 0;
-    ty->image.multisampled = 0;
-    ty->image.sampled = 1;
-    ty->image.format = SpvImageFormatUnknown;
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = TYPE_IMAGE;
+    key.image.sampled_type = sampled_type;
+    key.image.dim = dim;
+    key.image.depth = 0;
+    key.image.arrayed = 0;
+    key.image.multisampled = 0;
+    key.image.sampled = 1;
+    key.image.format = SpvImageFormatUnknown;
+    return getCachedType(m, &key);
 }
 
 static AstType *newConstantBufferType(Module *m, AstType *sub)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = TYPE_CONSTANT_BUFFER;
-    ty->buffer.sub = sub;
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = TYPE_CONSTANT_BUFFER;
+    key.buffer.sub = sub;
+    return getCachedType(m, &key);
 }
 
 static AstType *newStructuredBufferType(Module *m, AstType *sub)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = TYPE_STRUCTURED_BUFFER;
-    ty->buffer.sub = sub;
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = TYPE_STRUCTURED_BUFFER;
+    key.buffer.sub = sub;
+    return getCachedType(m, &key);
 }
 
 static AstType *newRWStructuredBufferType(Module *m, AstType *sub)
 {
-    AstType *ty = NEW(m->compiler, AstType);
-    ty->kind = TYPE_RW_STRUCTURED_BUFFER;
-    ty->buffer.sub = sub;
-    return getCachedType(m, ty);
+    AstType key = {0};
+    key.kind = TYPE_RW_STRUCTURED_BUFFER;
+    key.buffer.sub = sub;
+    return getCachedType(m, &key);
 }
 
 static bool isTypeCastable(AstType *src_type, AstType *dst_type)
@@ -864,23 +1247,14 @@ AstType *ts__getStructType(AstType *type)
 
 static bool canCoerceExprToScalarType(Analyzer *a, AstExpr *expr, AstType *scalar_type)
 {
+    TsCompiler *compiler = a->compiler;
+
     if (!scalar_type) return false;
 
-    switch (expr->kind)
+    // Left operands are followed in a loop, chains like 'a + b + c' are as deep as
+    // they are long
+    while (expr->kind == EXPR_BINARY)
     {
-    case EXPR_PRIMARY: {
-        switch (expr->primary.token->kind)
-        {
-        case TOKEN_INT_LIT: {
-            return scalar_type->kind == TYPE_FLOAT || scalar_type->kind == TYPE_INT;
-        }
-
-        default: break;
-        }
-        break;
-    }
-
-    case EXPR_BINARY: {
         switch (expr->binary.op)
         {
         case BINOP_ADD:
@@ -894,14 +1268,27 @@ static bool canCoerceExprToScalarType(Analyzer *a, AstExpr *expr, AstType *scala
         case BINOP_LESS:
         case BINOP_LESSEQ:
         case BINOP_EQ:
-        case BINOP_NOTEQ: {
-            return canCoerceExprToScalarType(a, expr->binary.left, scalar_type) &&
-                   canCoerceExprToScalarType(a, expr->binary.right, scalar_type);
+        case BINOP_NOTEQ: break;
+
+        default: return false;
         }
 
-        default: break;
+        AstExpr *right = ts__expr(compiler, expr->binary.right);
+        if (!canCoerceExprToScalarType(a, right, scalar_type)) return false;
+        expr = ts__expr(compiler, expr->binary.left);
+    }
+
+    switch (expr->kind)
+    {
+    case EXPR_PRIMARY: {
+        switch (expr->primary.token->kind)
+        {
+        case TOKEN_INT_LIT: {
+            return scalar_type->kind == TYPE_FLOAT || scalar_type->kind == TYPE_INT;
         }
 
+        default: break;
+        }
         break;
     }
 
@@ -909,7 +1296,8 @@ static bool canCoerceExprToScalarType(Analyzer *a, AstExpr *expr, AstType *scala
         switch (expr->unary.op)
         {
         case UNOP_NEG: {
-            return canCoerceExprToScalarType(a, expr->unary.right, scalar_type);
+            AstExpr *right = ts__expr(compiler, expr->unary.right);
+            return canCoerceExprToScalarType(a, right, scalar_type);
         }
 
         default: break;
@@ -926,6 +1314,8 @@ static bool canCoerceExprToScalarType(Analyzer *a, AstExpr *expr, AstType *scala
 
 static void tryCoerceExprToScalarType(Analyzer *a, AstExpr *expr, AstType *scalar_type)
 {
+    TsCompiler *compiler = a->compiler;
+
     if (!scalar_type) return;
 
     switch (expr->kind)
@@ -939,19 +1329,24 @@ static void tryCoerceExprToScalarType(Analyzer *a, AstExpr *expr, AstType *scala
     }
 
     case EXPR_BINARY: {
-        if (canCoerceExprToScalarType(a, expr, scalar_type))
+        if (!canCoerceExprToScalarType(a, expr, scalar_type)) break;
+
+        // The whole chain can be coerced, left operands are followed in a loop
+        for (; expr->kind == EXPR_BINARY; expr = ts__expr(compiler, expr->binary.left))
         {
-            tryCoerceExprToScalarType(a, expr->binary.left, scalar_type);
-            tryCoerceExprToScalarType(a, expr->binary.right, scalar_type);
+            AstExpr *right = ts__expr(compiler, expr->binary.right);
+            tryCoerceExprToScalarType(a, right, scalar_type);
             expr->type = scalar_type;
         }
+        tryCoerceExprToScalarType(a, expr, scalar_type);
         break;
     }
 
     case EXPR_UNARY: {
         if (canCoerceExprToScalarType(a, expr, scalar_type))
         {
-            tryCoerceExprToScalarType(a, expr->unary.right, scalar_type);
+            AstExpr *right = ts__expr(compiler, expr->unary.right);
+            tryCoerceExprToScalarType(a, right, scalar_type);
             expr->type = scalar_type;
         }
         break;
@@ -961,1806 +1356,2556 @@ static void tryCoerceExprToScalarType(Analyzer *a, AstExpr *expr, AstType *scala
     }
 }
 
-static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_type);
-static void analyzerAnalyzeStmt(Analyzer *a, AstStmt *stmt);
-static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl);
+// Implicit conversions of values to the type expected by their context
+static bool isAutoCastable(AstType *src_type, AstType *dst_type)
+{
+    bool is_auto_castable = false;
+
+    // Cast scalar to vector
+    is_auto_castable |=
+        (dst_type->kind == TYPE_VECTOR && ts__getScalarTypeNoVec(src_type));
+
+    // Cast scalar to scalar
+    is_auto_castable |=
+        (ts__getScalarTypeNoVec(dst_type) && ts__getScalarTypeNoVec(src_type));
 
-static void analyzerPushScope(Analyzer *a, Scope *scope)
+    // Cast vector to vector
+    is_auto_castable |=
+        (dst_type->kind == TYPE_VECTOR && src_type->kind == TYPE_VECTOR &&
+         dst_type->vector.size == src_type->vector.size);
+
+    return is_auto_castable;
+}
+
+static void exprAutoCast(TsCompiler *compiler, AstExpr *expr, AstType *type)
 {
-    assert(scope);
-    arrPush(a->compiler, &a->scope_stack, scope);
-    if (scope->owner && scope->owner->kind == DECL_FUNC)
+    AstExpr *sub_expr = ts__newExpr(compiler);
+    AstExprId sub_id = sub_expr->id;
+    *sub_expr = *expr;
+    sub_expr->id = sub_id;
+
+    // The sub-expression keeps the analysis results, the cast starts from a copy
+    if (expr->info)
     {
-        a->scope_func = scope->owner;
+        AstExprInfo info = *ts__exprInfo(compiler, expr);
+        expr->info = 0;
+        *ts__exprInfoEdit(compiler, expr) = info;
     }
+
+    expr->kind = EXPR_AUTO_CAST;
+    expr->auto_cast.sub = sub_id;
+    expr->type = type;
 }
 
-static void analyzerPopScope(Analyzer *a, Scope *scope)
-{
-    assert(scope);
-    assert(arrLength(a->scope_stack) > 0);
+static void analyzerAnalyzeExpr(Analyzer *a, AstExprId expr_id, AstType *expected_type);
+static void analyzerAnalyzeStmt(Analyzer *a, AstStmtId stmt_id);
+static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl);
+static void analyzerMarkReachable(Analyzer *a, AstDecl *func_decl);
 
-    Scope *last_scope = a->scope_stack.ptr[arrLength(a->scope_stack) - 1];
-    assert(last_scope == scope);
+static void analyzerTryRegisterDecl(Analyzer *a, AstDecl *decl)
+{
+    TsCompiler *compiler = a->compiler;
 
-    arrPop(&a->scope_stack);
+    if (!decl->name) return;
 
-    a->scope_func = NULL;
-    for (uint32_t i = 0; i < arrLength(a->scope_stack); ++i)
+    Symbol *sym = symbolTableGetLocal(&a->symbols, decl->name);
+    if (sym && sym->decl->kind == DECL_FUNC && decl->kind == DECL_FUNC)
     {
-        if (a->scope_stack.ptr[i]->owner &&
-            a->scope_stack.ptr[i]->owner->kind == DECL_FUNC)
-        {
-            a->scope_func = a->scope_stack.ptr[i]->owner;
-        }
+        // Overloads are chained in declaration order
+        AstDecl *last = sym->decl;
+        while (last->func.overload) last = ts__decl(compiler, last->func.overload);
+        last->func.overload = decl->id;
+    }
+    else if (sym)
+    {
+        ts__addErrAt(compiler, decl->loc, "duplicate declaration: '%s'", decl->name);
+    }
+    else
+    {
+        symbolTableAdd(&a->symbols, decl->name, decl);
     }
 }
 
-static Scope *analyzerCurrentScope(Analyzer *a)
+////////////////////////////////
+//
+// Templates
+//
+// Each instantiation is a copy of the template's AST where the parameters are bound to
+// the type arguments, analyzed and lowered like a declaration of its own. The cache
+// hands out one instance per (template, type arguments) for the whole module.
+//
+////////////////////////////////
+
+#define TEMPLATE_MAX_DEPTH 32
+
+typedef struct TemplateInstance
+{
+    AstDecl *template_decl;
+    AstType **args; // Interned, so they compare by address
+    uint32_t arg_count;
+    AstDecl *instance;
+} TemplateInstance;
+
+// Function bodies can be analyzed on several threads, which share the instances
+struct TemplateCache
+{
+    TsCompiler compiler; // Only the allocator is used
+    Mutex *mutex;
+    InternTable table;
+};
+
+static uint64_t templateInstanceHash(const void *item)
 {
-    if (arrLength(a->scope_stack) > 0)
+    const TemplateInstance *inst = item;
+    uint64_t hash = ts__hashCombine(0, (uint64_t)(uintptr_t)inst->template_decl);
+    for (uint32_t i = 0; i < inst->arg_count; ++i)
     {
-        return a->scope_stack.ptr[arrLength(a->scope_stack) - 1];
+        hash = ts__hashCombine(hash, (uint64_t)(uintptr_t)inst->args[i]);
     }
-    return NULL;
+    return hash;
 }
 
-static void analyzerTryRegisterDecl(Analyzer *a, AstDecl *decl)
+static bool templateInstanceEqual(const void *a_item, const void *b_item)
 {
-    if (!decl->name) return;
+    const TemplateInstance *a = a_item;
+    const TemplateInstance *b = b_item;
+    if (a->template_decl != b->template_decl || a->arg_count != b->arg_count) return false;
+    return memcmp(a->args, b->args, sizeof(AstType *) * a->arg_count) == 0;
+}
+
+static TemplateCache *templateCacheCreate(TsCompiler *compiler)
+{
+    TemplateCache *cache = NEW(compiler, TemplateCache);
+    ts__bumpInit(&cache->compiler.alloc, 1 << 12);
+    cache->mutex = ts__mutexCreate();
+    ts__internInit(
+        &cache->compiler, &cache->table, templateInstanceHash, templateInstanceEqual);
+    return cache;
+}
+
+// The instances live in the compiler's allocator, only the table is freed
+static void templateCacheDestroy(TemplateCache *cache)
+{
+    ts__bumpDestroy(&cache->compiler.alloc);
+    ts__mutexDestroy(cache->mutex);
+}
+
+static bool isTemplate(const TsCompiler *compiler, AstDecl *decl)
+{
+    return decl->template_params.len > 0 && !ts__declInfo(compiler, decl)->instance_of;
+}
+
+// Returns the instance of the template for the type arguments, analyzing its signature
+// the first time. The body of a function instance is analyzed once it is found to be
+// reachable, like the body of any other function.
+static AstDecl *analyzerInstantiate(
+    Analyzer *a, AstDecl *template_decl, AstType **args, SourceLoc loc)
+{
+    TsCompiler *compiler = a->compiler;
+    Module *m = a->module;
+    TemplateCache *cache = m->template_cache;
+
+    TemplateInstance key = {0};
+    key.template_decl = template_decl;
+    key.args = args;
+    key.arg_count = (uint32_t)template_decl->template_params.len;
+    uint64_t hash = templateInstanceHash(&key);
 
-    Scope *scope = analyzerCurrentScope(a);
+    ts__mutexLock(cache->mutex);
+    TemplateInstance *found = ts__internFind(&cache->table, &key, hash);
+    ts__mutexUnlock(cache->mutex);
 
-    if (scopeGetLocal(scope, decl->name))
+    if (found) return found->instance;
+
+    for (size_t i = 0; i < a->instantiating.len; ++i)
     {
-        ts__addErr(a->compiler, &decl->loc, "duplicate declaration: '%s'", decl->name);
+        if (!templateInstanceEqual(&a->instantiating.ptr[i], &key)) continue;
+
+        ts__addErrAt(
+            compiler, loc, "instantiation of '%s' depends on itself", template_decl->name);
+        return NULL;
     }
-    else
+
+    if (a->instantiating.len >= TEMPLATE_MAX_DEPTH)
     {
-        scopeAdd(scope, decl->name, decl);
+        ts__addErrAt(
+            compiler,
+            loc,
+            "instantiation of '%s' is nested too deeply",
+            template_decl->name);
+        return NULL;
     }
+
+    char **arg_names = NEW_ARRAY(compiler, char *, key.arg_count);
+    for (uint32_t i = 0; i < key.arg_count; ++i)
+    {
+        arg_names[i] = typeToPrettyString(compiler, args[i]);
+    }
+
+    ts__sbReset(&compiler->sb);
+    ts__sbAppend(&compiler->sb, template_decl->name);
+    ts__sbAppendChar(&compiler->sb, '<');
+    for (uint32_t i = 0; i < key.arg_count; ++i)
+    {
+        if (i > 0) ts__sbAppend(&compiler->sb, ", ");
+        ts__sbAppend(&compiler->sb, arg_names[i]);
+    }
+    ts__sbAppendChar(&compiler->sb, '>');
+
+    AstDecl *instance = ts__pchCloneDecl(compiler, template_decl);
+    instance->name = ts__sbBuild(&compiler->sb, &compiler->alloc);
+    ts__declInfoEdit(compiler, instance)->instance_of = template_decl->id;
+
+    size_t first_error = compiler->errors.len;
+
+    // The signature is analyzed as if it was declared at global scope, with the
+    // template parameters on top
+    AstDecl *prev_scope_func = a->scope_func;
+    Scope *prev_member_scope = a->member_scope;
+    uint32_t prev_expr_depth = a->expr_depth;
+    uint32_t prev_symbol_min_depth = a->symbol_min_depth;
+    bool prev_dead_code = a->dead_code;
+
+    a->scope_func = NULL;
+    a->member_scope = NULL;
+    a->expr_depth = 0;
+    a->dead_code = false;
+    arrPush(compiler, &a->instantiating, key);
+
+    symbolTablePushScope(&a->symbols);
+    a->symbol_min_depth = (uint32_t)a->symbols.scope_starts.len;
+
+    for (uint32_t i = 0; i < key.arg_count; ++i)
+    {
+        AstDecl *param = ts__decl(compiler, instance->template_params.ptr[i]);
+        param->type = newBasicType(m, TYPE_TYPE);
+        ts__declInfoEdit(compiler, param)->as_type = args[i];
+        analyzerTryRegisterDecl(a, param);
+    }
+
+    analyzerAnalyzeDecl(a, instance);
+
+    symbolTablePopScope(&a->symbols);
+
+    a->scope_func = prev_scope_func;
+    a->member_scope = prev_member_scope;
+    a->expr_depth = prev_expr_depth;
+    a->symbol_min_depth = prev_symbol_min_depth;
+    a->dead_code = prev_dead_code;
+    arrPop(&a->instantiating);
+
+    TemplateInstance *entry = NEW(compiler, TemplateInstance);
+    *entry = key;
+    entry->args = NEW_ARRAY(compiler, AstType *, key.arg_count);
+    memcpy(entry->args, args, sizeof(AstType *) * key.arg_count);
+    entry->instance = instance;
+
+    ts__mutexLock(cache->mutex);
+    found = ts__internHashed(&cache->table, entry, hash);
+    ts__mutexUnlock(cache->mutex);
+
+    // Another thread made the same instance in the meantime. Its copy is the one in
+    // use and it reported the errors of the signature.
+    if (found != entry)
+    {
+        compiler->errors.len = first_error;
+        return found->instance;
+    }
+
+    return instance;
 }
 
-static void analyzerRecursivelyCheckForSemanticStrings(
-    Analyzer *a, AstDecl *decl)
+// Analyzes the type arguments of 'name<args>'
+static AstType **analyzerTemplateArgs(Analyzer *a, AstExpr *ident_expr)
 {
     TsCompiler *compiler = a->compiler;
+    Module *m = a->module;
 
-    switch (decl->kind)
-    {
-    case DECL_FUNC:
-    {
-        for (uint32_t i = 0; i < decl->func.params.len; ++i)
-        {
-            AstDecl *param_decl = decl->func.params.ptr[i];
-            analyzerRecursivelyCheckForSemanticStrings(a, param_decl);
-        }
+    uint32_t arg_count = ident_expr->ident.template_arg_count;
+    AstType **args = NEW_ARRAY(compiler, AstType *, arg_count);
 
-        AstType *return_type = decl->func.return_type->as_type;
-        if (return_type->kind != TYPE_VOID)
-        {
-            if (return_type->kind == TYPE_STRUCT)
-            {
-                for (uint32_t i = 0; i < return_type->struct_.field_count; ++i)
-                {
-                    AstDecl *struct_field_decl = return_type->struct_.field_decls[i];
-                    analyzerRecursivelyCheckForSemanticStrings(a, struct_field_decl);
-                }
-            }
-            else if (!decl->semantic)
-            {
-                ts__addErr(
-                    compiler,
-                    &decl->loc,
-                    "function return value needs a semantic string");
-            }
-        }
-        break;
+    bool got_all_args = true;
+    for (uint32_t i = 0; i < arg_count; ++i)
+    {
+        AstExprId arg_expr = ident_expr->ident.template_args[i];
+        analyzerAnalyzeExpr(a, arg_expr, newBasicType(m, TYPE_TYPE));
+        args[i] = ts__exprInfo(compiler, ts__expr(compiler, arg_expr))->as_type;
+        if (!args[i]) got_all_args = false;
     }
 
-    case DECL_VAR:
+    return got_all_args ? args : NULL;
+}
+
+// Binds the parameters of a function template that the call does not give explicitly
+// to the types of the arguments passed where the function takes a plain 'T'
+static AstDecl *analyzerDeduceCall(
+    Analyzer *a,
+    AstExpr *expr,
+    AstDecl *template_decl,
+    AstType **explicit_args,
+    uint32_t explicit_count)
+{
+    TsCompiler *compiler = a->compiler;
+
+    AstDeclList template_params = template_decl->template_params;
+    if (explicit_count > template_params.len) return NULL;
+
+    AstType **args = NEW_ARRAY(compiler, AstType *, template_params.len);
+    for (uint32_t i = 0; i < explicit_count; ++i)
     {
-        AstType *var_type = decl->type;
-        assert(var_type);
+        args[i] = explicit_args[i];
+    }
 
-        if (var_type->kind == TYPE_STRUCT)
+    for (uint32_t i = 0; i < template_decl->func.params.len; ++i)
+    {
+        AstDecl *param = ts__decl(compiler, template_decl->func.params.ptr[i]);
+        AstExpr *type_expr = ts__expr(compiler, param->var.type_expr);
+        if (type_expr->kind != EXPR_IDENT || type_expr->ident.template_arg_count > 0)
         {
-            for (uint32_t i = 0; i < var_type->struct_.field_count; ++i)
-            {
-                AstDecl *struct_field_decl = var_type->struct_.field_decls[i];
-                analyzerRecursivelyCheckForSemanticStrings(a, struct_field_decl);
-            }
+            continue;
         }
-        else if (!decl->semantic)
+
+        for (uint32_t j = explicit_count; j < template_params.len; ++j)
         {
-            ts__addErr(
-                compiler,
-                &decl->loc,
-                "variable declaration needs a semantic string");
+            AstDecl *template_param = ts__decl(compiler, template_params.ptr[j]);
+            if (strcmp(template_param->name, type_expr->ident.name) != 0) continue;
+
+            AstType *arg_type = ts__expr(compiler, expr->func_call.params.ptr[i])->type;
+            if (args[j] && args[j] != arg_type) return NULL;
+            args[j] = arg_type;
         }
-        break;
     }
 
-    case DECL_STRUCT_FIELD:
+    for (uint32_t j = 0; j < template_params.len; ++j)
     {
-        if (!decl->semantic)
-        {
-            ts__addErr(
-                compiler,
-                &decl->loc,
-                "struct field declaration needs a semantic string");
-        }
-        break;
+        if (!args[j]) return NULL;
     }
 
-    default: break;
-    }
+    return analyzerInstantiate(a, template_decl, args, expr->loc);
 }
 
-static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_type)
+// Overloads must differ in their parameter types
+static void analyzerCheckOverload(Analyzer *a, AstDecl *decl)
 {
-    assert(expr);
-
     TsCompiler *compiler = a->compiler;
-    Scope *scope = analyzerCurrentScope(a);
-    Module *m = a->module;
 
-    expr->inhabited_scope = scope;
+    Symbol *sym = symbolTableGet(&a->symbols, decl->name);
+    if (!sym || sym->decl->kind != DECL_FUNC) return;
 
-    switch (expr->kind)
+    AstType *type = decl->type;
+    for (AstDecl *other = sym->decl; other && other != decl;
+         other = ts__decl(compiler, other->func.overload))
     {
-    case EXPR_PRIMARY: {
-        switch (expr->primary.token->kind)
+        if (isTemplate(compiler, other) || !other->type) continue;
+
+        AstType *other_type = other->type;
+        if (other_type->func.param_count != type->func.param_count) continue;
+        if (type->func.param_count > 0 &&
+            memcmp(
+                other_type->func.params,
+                type->func.params,
+                sizeof(AstType *) * type->func.param_count) != 0)
         {
-        case TOKEN_VOID: {
-            expr->as_type = newBasicType(a->module, TYPE_VOID);
-            expr->type = newBasicType(a->module, TYPE_TYPE);
-            break;
+            continue;
         }
 
-        case TOKEN_BOOL: {
-            expr->as_type = newBasicType(a->module, TYPE_BOOL);
-            expr->type = newBasicType(a->module, TYPE_TYPE);
-            break;
-        }
+        ts__addErrAt(
+            compiler,
+            decl->loc,
+            "function '%s' is already defined with the same parameter types",
+            decl->name);
+        return;
+    }
+}
 
-        case TOKEN_FLOAT: {
-            expr->as_type = newFloatType(a->module, 32);
-            expr->type = newBasicType(a->module, TYPE_TYPE);
-            break;
-        }
+// Cost of passing 'param' to a parameter of type 'param_type', UINT32_MAX if it cannot
+// be passed
+static uint32_t paramConversionCost(Analyzer *a, AstExpr *param, AstType *param_type)
+{
+    // 'out' and 'inout' parameters take the variable itself
+    if (param_type->kind == TYPE_POINTER)
+    {
+        return param->type == param_type->ptr.sub ? 0 : UINT32_MAX;
+    }
 
-        case TOKEN_INT: {
-            expr->as_type = newIntType(a->module, 32, true);
-            expr->type = newBasicType(a->module, TYPE_TYPE);
-            break;
-        }
+    if (param->type == param_type) return 0;
+    if (canCoerceExprToScalarType(a, param, param_type)) return 1;
+    if (isAutoCastable(param->type, param_type)) return 2;
+    return UINT32_MAX;
+}
 
-        case TOKEN_UINT: {
-            expr->as_type = newIntType(a->module, 32, false);
-            expr->type = newBasicType(a->module, TYPE_TYPE);
-            break;
-        }
+// Picks the function an overloaded name or a function template refers to from the
+// types of the parameters: the cheapest conversions win, then functions over templates
+static void analyzerAnalyzeOverloadedCall(Analyzer *a, AstExpr *expr, AstDecl *first)
+{
+    TsCompiler *compiler = a->compiler;
 
-        case TOKEN_VECTOR_TYPE: {
-            AstType *elem_type = NULL;
+    AstExpr *func_expr = ts__expr(compiler, expr->func_call.func_expr);
+    AstExprList params = expr->func_call.params;
 
-            switch (expr->primary.token->vector_type.elem_type)
-            {
-            case TOKEN_FLOAT: {
-                elem_type = newFloatType(a->module, 32);
-                break;
-            }
+    bool got_param_types = true;
+    for (uint32_t i = 0; i < params.len; ++i)
+    {
+        analyzerAnalyzeExpr(a, params.ptr[i], NULL);
+        if (!ts__expr(compiler, params.ptr[i])->type) got_param_types = false;
+    }
 
-            case TOKEN_INT: {
-                elem_type = newIntType(a->module, 32, true);
-                break;
-            }
+    uint32_t explicit_count = func_expr->ident.template_arg_count;
+    AstType **explicit_args = NULL;
+    if (explicit_count > 0)
+    {
+        explicit_args = analyzerTemplateArgs(a, func_expr);
+        if (!explicit_args) return;
+    }
 
-            case TOKEN_UINT: {
-                elem_type = newIntType(a->module, 32, false);
-                break;
-            }
+    if (!got_param_types) return;
 
-            default: assert(0); break;
-            }
+    AstDecl *best = NULL;
+    uint64_t best_cost = UINT64_MAX;
+    bool ambiguous = false;
 
-            assert(elem_type);
+    for (AstDecl *candidate = first; candidate;
+         candidate = ts__decl(compiler, candidate->func.overload))
+    {
+        if (candidate->func.params.len != params.len) continue;
 
-            expr->as_type = newVectorType(
-                a->module, elem_type, (uint32_t)expr->primary.token->vector_type.dim);
-            expr->type = newBasicType(a->module, TYPE_TYPE);
-            break;
+        AstDecl *callee = candidate;
+        if (isTemplate(compiler, candidate))
+        {
+            callee = analyzerDeduceCall(a, expr, candidate, explicit_args, explicit_count);
+        }
+        else if (explicit_count > 0)
+        {
+            callee = NULL;
         }
 
-        case TOKEN_MATRIX_TYPE: {
-            AstType *elem_type = NULL;
+        // The signature failed to resolve, which was already reported
+        if (!callee || !callee->type) continue;
 
-            switch (expr->primary.token->matrix_type.elem_type)
+        uint64_t cost = isTemplate(compiler, candidate) ? 1 : 0;
+        for (uint32_t i = 0; i < params.len; ++i)
+        {
+            uint32_t param_cost = paramConversionCost(
+                a, ts__expr(compiler, params.ptr[i]), callee->type->func.params[i]);
+            if (param_cost == UINT32_MAX)
             {
-            case TOKEN_FLOAT: {
-                elem_type = newFloatType(a->module, 32);
-                break;
-            }
-
-            case TOKEN_INT: {
-                elem_type = newIntType(a->module, 32, true);
+                cost = UINT64_MAX;
                 break;
             }
+            cost += (uint64_t)param_cost * 2;
+        }
 
-            case TOKEN_UINT: {
-                elem_type = newIntType(a->module, 32, false);
-                break;
-            }
+        if (cost == UINT64_MAX) continue;
 
-            default: assert(0); break;
-            }
+        if (cost < best_cost)
+        {
+            best = callee;
+            best_cost = cost;
+            ambiguous = false;
+        }
+        else if (cost == best_cost)
+        {
+            ambiguous = true;
+        }
+    }
 
-            assert(elem_type);
+    if (!best)
+    {
+        char **type_names = NEW_ARRAY(compiler, char *, params.len);
+        for (uint32_t i = 0; i < params.len; ++i)
+        {
+            type_names[i] =
+                typeToPrettyString(compiler, ts__expr(compiler, params.ptr[i])->type);
+        }
 
-            AstType *col_type = newVectorType(
-                a->module, elem_type, (uint32_t)expr->primary.token->matrix_type.dim1);
-            expr->as_type = newMatrixType(
-                a->module, col_type, (uint32_t)expr->primary.token->matrix_type.dim2);
-            expr->type = newBasicType(a->module, TYPE_TYPE);
-            break;
+        ts__sbReset(&compiler->sb);
+        for (uint32_t i = 0; i < params.len; ++i)
+        {
+            if (i > 0) ts__sbAppend(&compiler->sb, ", ");
+            ts__sbAppend(&compiler->sb, type_names[i]);
         }
+        char *param_types = ts__sbBuild(&compiler->sb, &compiler->alloc);
+
+        ts__addErrAt(
+            compiler,
+            expr->loc,
+            "no overload of '%s' takes the parameters (%s)",
+            func_expr->ident.name,
+            param_types);
+        return;
+    }
 
-        case TOKEN_FALSE:
-        case TOKEN_TRUE: {
-            expr->type = newBasicType(a->module, TYPE_BOOL);
-            break;
+    if (ambiguous)
+    {
+        ts__addErrAt(
+            compiler,
+            expr->loc,
+            "call to overloaded function '%s' is ambiguous",
+            func_expr->ident.name);
+        return;
+    }
+
+    AstType *func_type = best->type;
+    for (uint32_t i = 0; i < params.len; ++i)
+    {
+        AstExpr *param = ts__expr(compiler, params.ptr[i]);
+        AstType *param_type = func_type->func.params[i];
+        if (param_type->kind == TYPE_POINTER || param->type == param_type) continue;
+
+        tryCoerceExprToScalarType(a, param, param_type);
+        if (param->type != param_type) exprAutoCast(compiler, param, param_type);
+    }
+
+    analyzerMarkReachable(a, best);
+
+    func_expr->ident.decl = best->id;
+    func_expr->type = func_type;
+    expr->type = func_type->func.return_type;
+}
+
+static void analyzerRecursivelyCheckForSemanticStrings(
+    Analyzer *a, AstDecl *decl)
+{
+    TsCompiler *compiler = a->compiler;
+
+    switch (decl->kind)
+    {
+    case DECL_FUNC:
+    {
+        for (uint32_t i = 0; i < decl->func.params.len; ++i)
+        {
+            AstDecl *param_decl = ts__decl(compiler, decl->func.params.ptr[i]);
+            analyzerRecursivelyCheckForSemanticStrings(a, param_decl);
         }
 
-        case TOKEN_FLOAT_LIT: {
-            if (expected_type)
+        AstType *return_type =
+            ts__exprInfo(compiler, ts__expr(compiler, decl->func.return_type))->as_type;
+        if (return_type->kind != TYPE_VOID)
+        {
+            if (return_type->kind == TYPE_STRUCT)
             {
-                if ((expected_type->kind == TYPE_FLOAT) || (expected_type->kind == TYPE_BOOL))
+                for (uint32_t i = 0; i < return_type->struct_.field_count; ++i)
                 {
-                    expr->type = expected_type;
+                    AstDecl *struct_field_decl = return_type->struct_.field_decls[i];
+                    analyzerRecursivelyCheckForSemanticStrings(a, struct_field_decl);
                 }
             }
-            
-            if (!expr->type)
+            else if (!decl->semantic)
             {
-                expr->type = newFloatType(a->module, 32);
+                ts__addErrAt(
+                    compiler,
+                    decl->loc,
+                    "function return value needs a semantic string");
             }
-            break;
         }
+        break;
+    }
 
-        case TOKEN_INT_LIT: {
-            if (expected_type)
-            {
-                if ((expected_type->kind == TYPE_INT) ||
-                    (expected_type->kind == TYPE_FLOAT) ||
-                    (expected_type->kind == TYPE_BOOL))
-                {
-                    expr->type = expected_type;
-                }
-            }
+    case DECL_VAR:
+    {
+        AstType *var_type = decl->type;
+        assert(var_type);
 
-            if (!expr->type)
+        if (var_type->kind == TYPE_STRUCT)
+        {
+            for (uint32_t i = 0; i < var_type->struct_.field_count; ++i)
             {
-                expr->type = newIntType(a->module, 32, true);
+                AstDecl *struct_field_decl = var_type->struct_.field_decls[i];
+                analyzerRecursivelyCheckForSemanticStrings(a, struct_field_decl);
             }
-
-            expr->resolved_int = NEW(compiler, int64_t);
-            *expr->resolved_int = expr->primary.token->int_;
-
-            break;
         }
-
-        default: assert(0); break;
+        else if (!decl->semantic)
+        {
+            ts__addErrAt(
+                compiler,
+                decl->loc,
+                "variable declaration needs a semantic string");
         }
         break;
     }
 
-    case EXPR_VAR_ASSIGN: {
-        AstExpr *assigned_expr = expr->var_assign.assigned_expr;
-
-        analyzerAnalyzeExpr(a, assigned_expr, NULL);
-        if (!assigned_expr->type)
+    case DECL_STRUCT_FIELD:
+    {
+        if (!decl->semantic)
         {
-            ts__addErr(
+            ts__addErrAt(
                 compiler,
-                &assigned_expr->loc,
-                "could not resolve type for expression");
-            break;
+                decl->loc,
+                "struct field declaration needs a semantic string");
         }
+        break;
+    }
 
-        expr->type = assigned_expr->type;
+    default: break;
+    }
+}
 
-        if (!assigned_expr->assignable)
+#define S BUILTIN_SHAPE_SCALAR
+#define V BUILTIN_SHAPE_VECTOR
+#define M BUILTIN_SHAPE_MATRIX
+#define F BUILTIN_ELEM_FLOAT
+#define I BUILTIN_ELEM_INT
+#define B BUILTIN_ELEM_BOOL
+#define BUILTIN(name, kind, params, shapes, elems, coercion, same, check, result)         \
+    {                                                                                    \
+        name, AST_BUILTIN_FUNC_##kind, params, shapes, elems, BUILTIN_COERCE_##coercion, \
+            same, BUILTIN_CHECK_##check, BUILTIN_RESULT_##result, IR_BUILTIN_##kind      \
+    }
+// Barriers are not builtin instructions, they are lowered to OpControlBarrier or
+// OpMemoryBarrier
+#define BARRIER(name, kind)                                                              \
+    {                                                                                    \
+        name, AST_BUILTIN_FUNC_##kind, 0, 0, 0, BUILTIN_COERCE_NONE, 0, BUILTIN_CHECK_NONE, \
+            BUILTIN_RESULT_VOID, (IRBuiltinInstKind)0                                    \
+    }
+
+const AstBuiltinSignature ts__builtin_signatures[] = {
+    BUILTIN("dot", DOT, 2, V, F | I, NONE, 2, NONE, ELEM),
+    BUILTIN("cross", CROSS, 2, V, F | I, NONE, 2, VEC3, SAME),
+    BUILTIN("length", LENGTH, 1, V, F | I, NONE, 1, NONE, ELEM),
+    BUILTIN("normalize", NORMALIZE, 1, V, F | I, NONE, 1, NONE, SAME),
+    BUILTIN("mul", MUL, 2, V | M, F | I, NONE, 1, NONE, MUL),
+    BUILTIN("distance", DISTANCE, 2, V, F | I, FLOAT, 2, NONE, ELEM),
+    BUILTIN("degrees", DEGREES, 1, S, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("radians", RADIANS, 1, S, F, FLOAT, 1, NONE, SAME),
+
+    BUILTIN("sin", SIN, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("cos", COS, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("tan", TAN, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("asin", ASIN, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("acos", ACOS, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("atan", ATAN, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("sinh", SINH, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("cosh", COSH, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("tanh", TANH, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("atan2", ATAN2, 2, S, F, FLOAT, 2, NONE, SAME),
+
+    BUILTIN("sqrt", SQRT, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("rsqrt", RSQRT, 1, S | V, F, FLOAT, 1, NONE, SAME),
+
+    BUILTIN("reflect", REFLECT, 2, V, F | I, NONE, 2, NONE, SAME),
+    BUILTIN("refract", REFRACT, 3, V, F | I, FLOAT, 2, SCALAR_LAST, SAME),
+
+    BUILTIN("pow", POW, 2, S | V, F, FLOAT, 2, NONE, SAME),
+    BUILTIN("exp", EXP, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("exp2", EXP2, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("log", LOG, 1, S | V, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("log2", LOG2, 1, S | V, F, FLOAT, 1, NONE, SAME),
+
+    BUILTIN("abs", ABS, 1, S | V, F | I, EXPECTED, 1, NONE, SAME),
+    BUILTIN("min", MIN, 2, S | V, F | I, EXPECTED, 2, NONE, SAME),
+    BUILTIN("max", MAX, 2, S | V, F | I, EXPECTED, 2, NONE, SAME),
+    BUILTIN("frac", FRAC, 1, S | V, F, EXPECTED, 1, NONE, SAME),
+    BUILTIN("trunc", TRUNC, 1, S | V, F, EXPECTED, 1, NONE, SAME),
+    BUILTIN("ceil", CEIL, 1, S | V, F, EXPECTED, 1, NONE, SAME),
+    BUILTIN("floor", FLOOR, 1, S | V, F, EXPECTED, 1, NONE, SAME),
+    BUILTIN("lerp", LERP, 3, S | V, F, EXPECTED, 3, NONE, SAME),
+    BUILTIN("clamp", CLAMP, 3, S | V, F | I, EXPECTED_OR_FIRST, 3, NONE, SAME),
+    BUILTIN("step", STEP, 2, S | V, F, FLOAT, 2, NONE, SAME),
+    BUILTIN("smoothstep", SMOOTHSTEP, 3, S | V, F, FLOAT, 3, NONE, SAME),
+    BUILTIN("fmod", FMOD, 2, S | V, F, FLOAT, 2, NONE, SAME),
+
+    BUILTIN("ddx", DDX, 1, S, F, FLOAT, 1, NONE, SAME),
+    BUILTIN("ddy", DDY, 1, S, F, FLOAT, 1, NONE, SAME),
+
+    BUILTIN("asuint", ASUINT, 1, S | V, F | I, NONE, 1, NONE, AS_UINT),
+    BUILTIN("asint", ASINT, 1, S | V, F | I, NONE, 1, NONE, AS_INT),
+    BUILTIN("asfloat", ASFLOAT, 1, S | V, F | I, NONE, 1, NONE, AS_FLOAT),
+
+    BUILTIN("InterlockedAdd", INTERLOCKED_ADD, 2, S, I, FIRST, 2, GROUPSHARED, VOID),
+    BUILTIN("InterlockedAnd", INTERLOCKED_AND, 2, S, I, FIRST, 2, GROUPSHARED, VOID),
+    BUILTIN("InterlockedMin", INTERLOCKED_MIN, 2, S, I, FIRST, 2, GROUPSHARED, VOID),
+    BUILTIN("InterlockedMax", INTERLOCKED_MAX, 2, S, I, FIRST, 2, GROUPSHARED, VOID),
+    BUILTIN("InterlockedOr", INTERLOCKED_OR, 2, S, I, FIRST, 2, GROUPSHARED, VOID),
+    BUILTIN("InterlockedXor", INTERLOCKED_XOR, 2, S, I, FIRST, 2, GROUPSHARED, VOID),
+    BUILTIN(
+        "InterlockedExchange", INTERLOCKED_EXCHANGE, 3, S, I, FIRST, 3, GROUPSHARED_OUT, VOID),
+    BUILTIN(
+        "InterlockedCompareExchange",
+        INTERLOCKED_COMPARE_EXCHANGE, 4, S, I, FIRST, 4, GROUPSHARED_OUT, VOID),
+    BUILTIN(
+        "InterlockedCompareStore",
+        INTERLOCKED_COMPARE_STORE, 3, S, I, FIRST, 3, GROUPSHARED, VOID),
+
+    BUILTIN("transpose", TRANSPOSE, 1, M, F | I | B, NONE, 1, NONE, TRANSPOSE),
+    BUILTIN("determinant", DETERMINANT, 1, M, F | I | B, NONE, 1, SQUARE, ELEM),
+
+    BARRIER("AllMemoryBarrier", ALL_MEMORY_BARRIER),
+    BARRIER("AllMemoryBarrierWithGroupSync", ALL_MEMORY_BARRIER_WITH_GROUP_SYNC),
+    BARRIER("DeviceMemoryBarrier", DEVICE_MEMORY_BARRIER),
+    BARRIER("DeviceMemoryBarrierWithGroupSync", DEVICE_MEMORY_BARRIER_WITH_GROUP_SYNC),
+    BARRIER("GroupMemoryBarrier", GROUP_MEMORY_BARRIER),
+    BARRIER("GroupMemoryBarrierWithGroupSync", GROUP_MEMORY_BARRIER_WITH_GROUP_SYNC),
+};
+
+const size_t ts__builtin_signature_count =
+    sizeof(ts__builtin_signatures) / sizeof(ts__builtin_signatures[0]);
+
+#undef S
+#undef V
+#undef M
+#undef F
+#undef I
+#undef B
+#undef BUILTIN
+#undef BARRIER
+
+// Element type of a scalar, vector or matrix, along with its BUILTIN_SHAPE_* bit
+static AstType *builtinShapeOf(AstType *type, uint32_t *shape)
+{
+    switch (type->kind)
+    {
+    case TYPE_FLOAT:
+    case TYPE_INT:
+    case TYPE_BOOL: *shape = BUILTIN_SHAPE_SCALAR; return type;
+    case TYPE_VECTOR: *shape = BUILTIN_SHAPE_VECTOR; return type->vector.elem_type;
+    case TYPE_MATRIX:
+        *shape = BUILTIN_SHAPE_MATRIX;
+        return type->matrix.col_type->vector.elem_type;
+    default: *shape = 0; return NULL;
+    }
+}
+
+static uint32_t builtinElemOf(AstType *elem_type)
+{
+    switch (elem_type->kind)
+    {
+    case TYPE_FLOAT: return BUILTIN_ELEM_FLOAT;
+    case TYPE_INT: return BUILTIN_ELEM_INT;
+    case TYPE_BOOL: return BUILTIN_ELEM_BOOL;
+    default: return 0;
+    }
+}
+
+static void analyzerCoerceBuiltinParams(
+    Analyzer *a,
+    const AstBuiltinSignature *sig,
+    AstExprList params,
+    AstType *expected_type)
+{
+    TsCompiler *compiler = a->compiler;
+    Module *m = a->module;
+
+    bool coerced = false;
+    switch (sig->coercion)
+    {
+    case BUILTIN_COERCE_NONE: break;
+
+    case BUILTIN_COERCE_FLOAT: {
+        for (uint32_t i = 0; i < params.len; ++i)
         {
-            if (assigned_expr->kind == EXPR_IDENT &&
-                assigned_expr->ident.decl->kind == DECL_VAR &&
-                assigned_expr->ident.decl->var.immutable)
-            {
-                ts__addErr(
-                    compiler,
-                    &assigned_expr->loc,
-                    "assigned variable is constant: '%s'",
-                    assigned_expr->ident.name);
-            }
-            else
-            {
-                ts__addErr(
-                    compiler,
-                    &assigned_expr->loc,
-                    "expression is not assignable");
-            }
+            tryCoerceExprToScalarType(
+                a, ts__expr(compiler, params.ptr[i]), newFloatType(m, 32));
         }
-
-        analyzerAnalyzeExpr(a, expr->var_assign.value_expr, assigned_expr->type);
         break;
     }
 
-    case EXPR_IDENT: {
-        AstDecl *decl = scopeGetGlobal(scope, expr->ident.name);
-        if (!decl)
+    case BUILTIN_COERCE_EXPECTED:
+    case BUILTIN_COERCE_EXPECTED_OR_FIRST: {
+        if (!expected_type) break;
+
+        coerced = true;
+        for (uint32_t i = 0; i < params.len; ++i)
         {
-            ts__addErr(compiler, &expr->loc, "unknown identifier: '%s'", expr->ident.name);
-            break;
+            coerced = coerced && canCoerceExprToScalarType(
+                a, ts__expr(compiler, params.ptr[i]), expected_type);
         }
 
-        if (decl->kind == DECL_FUNC)
+        if (!coerced) break;
+
+        for (uint32_t i = 0; i < params.len; ++i)
         {
-            decl->func.called = true;
+            tryCoerceExprToScalarType(
+                a, ts__expr(compiler, params.ptr[i]), expected_type);
         }
+        break;
+    }
 
-        if (decl->kind == DECL_VAR)
+    case BUILTIN_COERCE_FIRST: break;
+    }
+
+    if (sig->coercion == BUILTIN_COERCE_FIRST ||
+        (sig->coercion == BUILTIN_COERCE_EXPECTED_OR_FIRST && !coerced))
+    {
+        for (uint32_t i = 1; i < params.len; ++i)
         {
-            expr->assignable = !decl->var.immutable;
+            tryCoerceExprToScalarType(
+                a,
+                ts__expr(compiler, params.ptr[i]),
+                ts__expr(compiler, params.ptr[0])->type);
         }
+    }
+}
 
-        expr->ident.decl = decl;
+static bool isGroupsharedVar(const TsCompiler *compiler, AstExpr *expr)
+{
+    if (expr->kind != EXPR_IDENT) return false;
 
-        expr->type = decl->type;
-        expr->as_type = decl->as_type;
-        expr->scope = decl->scope;
-        expr->resolved_int = decl->resolved_int;
-        break;
+    AstDecl *decl = ts__decl(compiler, expr->ident.decl);
+    return decl && decl->kind == DECL_VAR && decl->var.kind == VAR_GROUPSHARED;
+}
+
+// Matches the parameters of a builtin call against its signature and sets the type of
+// the call. The parameters have already been analyzed.
+static void analyzerAnalyzeBuiltinCall(
+    Analyzer *a, AstExpr *expr, const AstBuiltinSignature *sig, AstType *expected_type)
+{
+    TsCompiler *compiler = a->compiler;
+    Module *m = a->module;
+    AstExprList params = expr->func_call.params;
+
+    if (params.len != sig->param_count)
+    {
+        ts__addErrAt(
+            compiler,
+            expr->loc,
+            "%s takes %u parameter%s",
+            sig->name,
+            (uint32_t)sig->param_count,
+            sig->param_count == 1 ? "" : "s");
+        return;
     }
 
-    case EXPR_SUBSCRIPT: {
-        AstExpr *left = expr->subscript.left;
-        analyzerAnalyzeExpr(a, left, NULL);
+    if (sig->param_count == 0)
+    {
+        expr->type = newBasicType(m, TYPE_VOID);
+        return;
+    }
 
-        AstExpr *right = expr->subscript.right;
-        analyzerAnalyzeExpr(a, right, NULL);
+    analyzerCoerceBuiltinParams(a, sig, params, expected_type);
 
-        if (!left->type || !right->type) break;
+    AstType *type = ts__expr(compiler, params.ptr[0])->type;
 
-        switch (left->type->kind)
+    uint32_t shape;
+    AstType *elem_type = builtinShapeOf(type, &shape);
+    if (!(shape & sig->shapes) || !(builtinElemOf(elem_type) & sig->elems))
+    {
+        ts__addErrAt(
+            compiler,
+            expr->loc,
+            "%s does not operate on '%s'",
+            sig->name,
+            typeToPrettyString(compiler, type));
+        return;
+    }
+
+    for (uint32_t i = 1; i < sig->same_count; ++i)
+    {
+        if (ts__expr(compiler, params.ptr[i])->type != type)
         {
-        case TYPE_STRUCTURED_BUFFER: {
-            expr->assignable = false;
-            expr->type = left->type->buffer.sub;
-            break;
+            ts__addErrAt(
+                compiler,
+                expr->loc,
+                "%s operates on parameters of equal types",
+                sig->name);
+            return;
         }
-        case TYPE_RW_STRUCTURED_BUFFER: {
-            expr->assignable = true;
-            expr->type = left->type->buffer.sub;
-            break;
+    }
+
+    switch ((AstBuiltinCheck)sig->check)
+    {
+    case BUILTIN_CHECK_NONE: break;
+
+    case BUILTIN_CHECK_VEC3: {
+        if (type->vector.size != 3)
+        {
+            ts__addErrAt(compiler, expr->loc, "%s operates on 3D vectors", sig->name);
+            return;
         }
-        case TYPE_VECTOR: {
-            expr->assignable = left->assignable;
-            expr->type = left->type->vector.elem_type;
-            if (!right->resolved_int)
-            {
-                ts__addErr(compiler, &right->loc, "index is not an integer constant");
-            }
-            else if ((*right->resolved_int) >= left->type->vector.size)
+        break;
+    }
+
+    case BUILTIN_CHECK_SQUARE: {
+        if (type->matrix.col_count != type->matrix.col_type->vector.size)
+        {
+            ts__addErrAt(
+                compiler, expr->loc, "%s operates on square matrices", sig->name);
+            return;
+        }
+        break;
+    }
+
+    case BUILTIN_CHECK_SCALAR_LAST: {
+        AstType *last_type = ts__expr(compiler, params.ptr[params.len - 1])->type;
+        if (last_type->kind != TYPE_FLOAT)
+        {
+            ts__addErrAt(
+                compiler,
+                expr->loc,
+                "%s takes a float scalar as the last parameter",
+                sig->name);
+            return;
+        }
+        break;
+    }
+
+    case BUILTIN_CHECK_GROUPSHARED:
+    case BUILTIN_CHECK_GROUPSHARED_OUT: {
+        if (!isGroupsharedVar(compiler, ts__expr(compiler, params.ptr[0])))
+        {
+            ts__addErrAt(
+                compiler,
+                expr->loc,
+                "%s requires the first parameter to be a groupshared variable",
+                sig->name);
+            return;
+        }
+
+        if (sig->check == BUILTIN_CHECK_GROUPSHARED_OUT &&
+            !ts__expr(compiler, params.ptr[params.len - 1])->assignable)
+        {
+            ts__addErrAt(
+                compiler,
+                expr->loc,
+                "%s requires the last parameter to be assignable",
+                sig->name);
+            return;
+        }
+        break;
+    }
+    }
+
+    switch ((AstBuiltinResult)sig->result)
+    {
+    case BUILTIN_RESULT_SAME: expr->type = type; break;
+    case BUILTIN_RESULT_ELEM: expr->type = elem_type; break;
+    case BUILTIN_RESULT_VOID: expr->type = newBasicType(m, TYPE_VOID); break;
+
+    case BUILTIN_RESULT_TRANSPOSE: {
+        uint32_t col_count = type->matrix.col_count;
+        uint32_t row_count = type->matrix.col_type->vector.size;
+
+        AstType *col_type = newVectorType(m, elem_type, col_count);
+        expr->type = newMatrixType(m, col_type, row_count);
+        break;
+    }
+
+    case BUILTIN_RESULT_MUL: {
+        AstType *other = ts__expr(compiler, params.ptr[1])->type;
+
+        // The operands are swapped, HLSL matrices are row major
+        if (type->kind == TYPE_VECTOR && other->kind == TYPE_MATRIX)
+        {
+            if (type != other->matrix.col_type)
             {
-                ts__addErr(compiler, &right->loc, "index is out of bounds");
+                ts__addErrAt(
+                    compiler, expr->loc, "mismatched matrix columns with vector type");
+                return;
             }
-            break;
+            expr->type = type;
         }
-        case TYPE_MATRIX: {
-            expr->assignable = left->assignable;
-            expr->type = left->type->matrix.col_type;
-            if (!right->resolved_int)
+        else if (type->kind == TYPE_MATRIX && other->kind == TYPE_VECTOR)
+        {
+            if (other != type->matrix.col_type)
             {
-                ts__addErr(compiler, &right->loc, "index is not an integer constant");
+                ts__addErrAt(
+                    compiler, expr->loc, "mismatched matrix columns with vector type");
+                return;
             }
-            else if ((*right->resolved_int) >= left->type->matrix.col_count)
+            expr->type = other;
+        }
+        else if (type->kind == TYPE_VECTOR && other->kind == TYPE_VECTOR)
+        {
+            if (other != type)
             {
-                ts__addErr(compiler, &right->loc, "index is out of bounds");
+                ts__addErrAt(compiler, expr->loc, "mismatched vector types");
+                return;
             }
-            break;
-        }
-        default: {
-            ts__addErr(compiler, &left->loc, "expression is not subscriptable");
-            break;
-        }
+            expr->type = elem_type;
         }
-
-        AstType *struct_type = ts__getStructType(expr->type);
-        if (struct_type)
+        else if (type->kind == TYPE_MATRIX && other->kind == TYPE_MATRIX)
         {
-            expr->scope = NEW(compiler, Scope);
-            scopeInit(compiler, expr->scope, NULL, NULL);
-            for (uint32_t i = 0; i < struct_type->struct_.field_count; ++i)
+            if (other != type)
             {
-                AstDecl *field_decl = struct_type->struct_.field_decls[i];
-                scopeAdd(expr->scope, field_decl->name, field_decl);
+                ts__addErrAt(compiler, expr->loc, "mismatched matrix types");
+                return;
             }
+            expr->type = type;
         }
-
-        if (right->type->kind != TYPE_INT)
+        else
         {
-            ts__addErr(compiler, &right->loc, "subscript index must be of integer type");
-            break;
+            ts__addErrAt(compiler, expr->loc, "invalid parameters for mul");
+            return;
         }
-
         break;
     }
 
-    case EXPR_ACCESS: {
-        AstExpr *left = expr->access.base;
-        analyzerAnalyzeExpr(a, left, NULL);
-
-        assert(arrLength(expr->access.chain) > 0);
-
-        for (uint32_t i = 0; i < arrLength(expr->access.chain); ++i)
+    case BUILTIN_RESULT_AS_FLOAT:
+    case BUILTIN_RESULT_AS_INT:
+    case BUILTIN_RESULT_AS_UINT: {
+        AstType *result_elem_type = NULL;
+        switch ((AstBuiltinResult)sig->result)
         {
-            AstExpr *right = expr->access.chain.ptr[i];
+        case BUILTIN_RESULT_AS_FLOAT: result_elem_type = newFloatType(m, 32); break;
+        case BUILTIN_RESULT_AS_INT: result_elem_type = newIntType(m, 32, true); break;
+        default: result_elem_type = newIntType(m, 32, false); break;
+        }
 
-            if (!left->type)
-            {
-                assert(arrLength(compiler->errors) > 0);
-                break;
-            }
+        expr->type = result_elem_type;
+        if (type->kind == TYPE_VECTOR)
+        {
+            expr->type = newVectorType(m, result_elem_type, type->vector.size);
+        }
+        break;
+    }
+    }
+}
 
-            AstType *struct_type = ts__getStructType(left->type);
+////////////////////////////////
+//
+// Constant evaluation
+//
+// Once the types of an expression are final, every sub-expression that only depends on
+// literals, constants, casts and pure builtins is folded into an AstConst. The IR
+// builder emits those as OpConstant/OpConstantComposite instead of instructions.
+// Scalars are computed by the ts__fold* functions shared with the optimizer, following
+// the SPIR-V instruction that would have been emitted; when that result is undefined
+// (division by zero, out of range shifts, ...) the expression is left to be evaluated at
+// runtime.
+//
+////////////////////////////////
+
+static AstConst *newConst(Analyzer *a, AstType *type)
+{
+    AstConst *c = NEW(a->compiler, AstConst);
+    c->type = type;
 
-            if (struct_type)
-            {
-                assert(left->scope);
+    switch (type->kind)
+    {
+    case TYPE_VECTOR: c->elem_count = type->vector.size; break;
+    case TYPE_MATRIX: c->elem_count = type->matrix.col_count; break;
+    default: break;
+    }
 
-                analyzerPushScope(a, left->scope);
-                analyzerAnalyzeExpr(a, right, NULL);
-                analyzerPopScope(a, left->scope);
-            }
-            else if (left->type->kind == TYPE_VECTOR)
-            {
-                assert(right->kind == EXPR_IDENT);
+    if (c->elem_count > 0)
+    {
+        c->elems = NEW_ARRAY(a->compiler, AstConst *, c->elem_count);
+    }
 
-                char *selector = right->ident.name;
-                size_t new_vec_dim = strlen(selector);
-                if (new_vec_dim > 4)
-                {
-                    ts__addErr(
-                        compiler,
-                        &right->loc,
-                        "vector shuffle must select at most 4 elements");
-                    break;
-                }
+    return c;
+}
 
-                uint32_t *positions = NEW_ARRAY(compiler, uint32_t, new_vec_dim);
+static AstConst *constFloat(Analyzer *a, AstType *type, double value)
+{
+    assert(type->kind == TYPE_FLOAT);
+    AstConst *c = newConst(a, type);
+    c->f = (type->float_.bits == 32) ? (double)(float)value : value;
+    return c;
+}
 
-                for (uint32_t j = 0; j < new_vec_dim; ++j)
-                {
-                    bool valid = true;
-                    switch (selector[j])
-                    {
-                    case 'r':
-                    case 'x': positions[j] = 0; break;
-                    case 'g':
-                    case 'y': positions[j] = 1; break;
-                    case 'b':
-                    case 'z': positions[j] = 2; break;
-                    case 'a':
-                    case 'w': positions[j] = 3; break;
+static AstConst *constInt(Analyzer *a, AstType *type, uint64_t value)
+{
+    AstConst *c = newConst(a, type);
 
-                    default:
-                        ts__addErr(compiler, &right->loc, "invalid vector shuffle: '%s'", selector);
-                        valid = false;
-                        break;
-                    }
+    if (type->kind == TYPE_BOOL)
+    {
+        c->i = (value != 0);
+        return c;
+    }
 
-                    if (positions[j] >= left->type->vector.size)
-                    {
-                        ts__addErr(compiler, &right->loc, "invalid vector shuffle: '%s'", selector);
-                        valid = false;
-                        break;
-                    }
+    assert(type->kind == TYPE_INT);
+    uint32_t bits = type->int_.bits;
+    if (bits < 64)
+    {
+        uint64_t mask = (UINT64_C(1) << bits) - 1;
+        value &= mask;
+        if (type->int_.is_signed && (value >> (bits - 1)) & 1) value |= ~mask;
+    }
+    c->i = (int64_t)value;
 
-                    if (!valid) break;
-                }
+    return c;
+}
 
-                right->ident.shuffle_indices = positions;
-                right->ident.shuffle_index_count = (uint32_t)new_vec_dim;
+static bool isConstScalarType(AstType *type)
+{
+    switch (type->kind)
+    {
+    case TYPE_BOOL: return true;
+    case TYPE_INT: return type->int_.bits <= 64;
+    case TYPE_FLOAT: return type->float_.bits == 32 || type->float_.bits == 64;
+    default: return false;
+    }
+}
 
-                if (new_vec_dim == 1)
-                {
-                    right->type = left->type->vector.elem_type;
-                }
-                else
-                {
-                    right->type = newVectorType(
-                        m, left->type->vector.elem_type, (uint32_t)new_vec_dim);
-                }
-            }
-            else
-            {
-                ts__addErr(compiler, &left->loc, "expression is not accessible");
-                break;
-            }
+static ScalarValue constScalarValue(AstConst *c)
+{
+    ScalarValue value = {0};
+    switch (c->type->kind)
+    {
+    case TYPE_FLOAT: {
+        value.kind = SCALAR_FLOAT;
+        value.f = c->f;
+        break;
+    }
+    case TYPE_INT: {
+        value.kind = c->type->int_.is_signed ? SCALAR_INT : SCALAR_UINT;
+        value.bits = c->type->int_.bits;
+        value.u = (uint64_t)c->i;
+        break;
+    }
+    case TYPE_BOOL: {
+        value.kind = SCALAR_BOOL;
+        value.u = (c->i != 0);
+        break;
+    }
+    default: assert(0); break;
+    }
+    return value;
+}
 
-            if (i == (arrLength(expr->access.chain) - 1))
-            {
-                expr->type = right->type;
-                expr->as_type = right->as_type;
-                expr->scope = right->scope;
-                expr->resolved_int = right->resolved_int;
-            }
+static AstConst *constFromScalarValue(Analyzer *a, AstType *type, ScalarValue value)
+{
+    if ((type->kind == TYPE_FLOAT) != (value.kind == SCALAR_FLOAT)) return NULL;
+    if (type->kind == TYPE_FLOAT) return constFloat(a, type, value.f);
+    return constInt(a, type, value.u);
+}
 
-            left = right;
-        }
+// Scalar conversion, as done by OpConvert*, OpSConvert/OpUConvert and OpBitcast
+static AstConst *constCastScalar(Analyzer *a, AstConst *c, AstType *dst_type)
+{
+    if (c->type == dst_type) return c;
+    if (c->elem_count > 0 || !isConstScalarType(dst_type)) return NULL;
 
-        expr->assignable = expr->access.base->assignable;
+    AstType *src_type = c->type;
+    if (src_type->kind == TYPE_BOOL)
+    {
+        if (dst_type->kind != TYPE_FLOAT) return constInt(a, dst_type, (uint64_t)c->i);
+        return constFloat(a, dst_type, c->i ? 1.0 : 0.0);
+    }
 
+    SpvOp op = SpvOpNop;
+    ScalarKind kind = SCALAR_FLOAT;
+    uint32_t bits = 0;
+    switch (dst_type->kind)
+    {
+    case TYPE_FLOAT: {
+        if (src_type->kind == TYPE_FLOAT) op = SpvOpFConvert;
+        else if (src_type->kind != TYPE_INT) return NULL;
+        else op = src_type->int_.is_signed ? SpvOpConvertSToF : SpvOpConvertUToF;
         break;
     }
 
-    case EXPR_FUNC_CALL: {
-        AstExpr *func_expr = expr->func_call.func_expr;
-
-        bool is_builtin_func = false;
-        AstBuiltinFunction builtin_func_kind;
-
-        // Builtin function
-        if (func_expr->kind == EXPR_IDENT)
+    case TYPE_INT: {
+        kind = dst_type->int_.is_signed ? SCALAR_INT : SCALAR_UINT;
+        bits = dst_type->int_.bits;
+        if (src_type->kind == TYPE_FLOAT)
         {
-            void *result;
-            is_builtin_func = ts__hashGet(
-                &compiler->builtin_function_table,
-                func_expr->ident.name,
-                &result);
-            if (is_builtin_func)
-            {
-                builtin_func_kind = (AstBuiltinFunction)result;
-            }
+            op = dst_type->int_.is_signed ? SpvOpConvertFToS : SpvOpConvertFToU;
         }
+        else if (src_type->kind != TYPE_INT) return NULL;
+        else op = src_type->int_.is_signed ? SpvOpSConvert : SpvOpUConvert;
+        break;
+    }
 
-        if (is_builtin_func)
-        {
-            uint32_t param_count = arrLength(expr->func_call.params);
-            ArrayOfAstExprPtr params = expr->func_call.params;
+    case TYPE_BOOL: {
+        if (src_type->kind == TYPE_FLOAT) return constInt(a, dst_type, c->f != 0.0);
+        return constInt(a, dst_type, c->i != 0);
+    }
 
-            bool got_param_types = true;
+    default: return NULL;
+    }
 
-            for (uint32_t i = 0; i < param_count; ++i)
-            {
-                AstExpr *param = params.ptr[i];
-                analyzerAnalyzeExpr(a, param, NULL);
-                if (!param->type)
-                {
-                    got_param_types = false;
-                    continue;
-                }
-            }
+    ScalarValue result;
+    if (!ts__foldConvert(op, constScalarValue(c), kind, bits, &result)) return NULL;
+    return constFromScalarValue(a, dst_type, result);
+}
 
-            if (!got_param_types) break;
+// Converts a scalar or vector, splatting scalars into vectors like EXPR_AUTO_CAST does
+static AstConst *constCast(Analyzer *a, AstConst *c, AstType *dst_type)
+{
+    if (!c) return NULL;
+    if (c->type == dst_type) return c;
 
-            switch (builtin_func_kind)
-            {
-            case AST_BUILTIN_FUNC_DOT: {
-                if (param_count != 2)
-                {
-                    ts__addErr(compiler, &expr->loc, "dot needs 2 parameters");
-                    break;
-                }
+    if (dst_type->kind != TYPE_VECTOR) return constCastScalar(a, c, dst_type);
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
+    if (c->type->kind == TYPE_VECTOR && c->elem_count != dst_type->vector.size)
+    {
+        return NULL;
+    }
 
-                if ((a->type->kind != TYPE_VECTOR) || (b->type->kind != TYPE_VECTOR))
-                {
-                    ts__addErr(compiler, &expr->loc, "dot operates on vectors");
-                    break;
-                }
+    AstConst *result = newConst(a, dst_type);
+    for (uint32_t i = 0; i < result->elem_count; ++i)
+    {
+        AstConst *elem = (c->type->kind == TYPE_VECTOR) ? c->elems[i] : c;
+        result->elems[i] = constCastScalar(a, elem, dst_type->vector.elem_type);
+        if (!result->elems[i]) return NULL;
+    }
 
-                if (a->type != b->type)
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "dot cannot operate on different types");
-                    break;
-                }
+    return result;
+}
 
-                expr->type = a->type->vector.elem_type;
-                break;
-            }
+// The instruction the IR builder emits for 'op' on operands of 'type'
+static SpvOp constBinaryOp(AstBinaryOp op, AstType *type)
+{
+    bool is_float = (type->kind == TYPE_FLOAT);
+    bool is_signed = (type->kind == TYPE_INT && type->int_.is_signed);
 
-            case AST_BUILTIN_FUNC_CROSS: {
-                if (param_count != 2)
-                {
-                    ts__addErr(compiler, &expr->loc, "cross needs 2 parameters");
-                    break;
-                }
+    if (type->kind == TYPE_BOOL)
+    {
+        switch (op)
+        {
+        case BINOP_EQ: return SpvOpLogicalEqual;
+        case BINOP_NOTEQ: return SpvOpLogicalNotEqual;
+        case BINOP_LOGICAL_AND: return SpvOpLogicalAnd;
+        case BINOP_LOGICAL_OR: return SpvOpLogicalOr;
+        default: return SpvOpNop;
+        }
+    }
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
+    switch (op)
+    {
+    case BINOP_ADD: return is_float ? SpvOpFAdd : SpvOpIAdd;
+    case BINOP_SUB: return is_float ? SpvOpFSub : SpvOpISub;
+    case BINOP_MUL: return is_float ? SpvOpFMul : SpvOpIMul;
+    case BINOP_DIV: return is_float ? SpvOpFDiv : (is_signed ? SpvOpSDiv : SpvOpUDiv);
+    case BINOP_MOD: return is_float ? SpvOpFRem : (is_signed ? SpvOpSMod : SpvOpUMod);
+
+    case BINOP_EQ: return is_float ? SpvOpFOrdEqual : SpvOpIEqual;
+    case BINOP_NOTEQ: return is_float ? SpvOpFOrdNotEqual : SpvOpINotEqual;
+    case BINOP_LESS: {
+        if (is_float) return SpvOpFOrdLessThan;
+        return is_signed ? SpvOpSLessThan : SpvOpULessThan;
+    }
+    case BINOP_LESSEQ: {
+        if (is_float) return SpvOpFOrdLessThanEqual;
+        return is_signed ? SpvOpSLessThanEqual : SpvOpULessThanEqual;
+    }
+    case BINOP_GREATER: {
+        if (is_float) return SpvOpFOrdGreaterThan;
+        return is_signed ? SpvOpSGreaterThan : SpvOpUGreaterThan;
+    }
+    case BINOP_GREATEREQ: {
+        if (is_float) return SpvOpFOrdGreaterThanEqual;
+        return is_signed ? SpvOpSGreaterThanEqual : SpvOpUGreaterThanEqual;
+    }
 
-                if ((a->type->kind != TYPE_VECTOR) || (b->type->kind != TYPE_VECTOR))
-                {
-                    ts__addErr(compiler, &expr->loc, "cross operates on vectors");
-                    break;
-                }
+    // Shifts are logical, as emitted by the IR builder
+    case BINOP_LSHIFT: return is_float ? SpvOpNop : SpvOpShiftLeftLogical;
+    case BINOP_RSHIFT: return is_float ? SpvOpNop : SpvOpShiftRightLogical;
 
-                if (a->type != b->type)
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "cross cannot operate on different types");
-                    break;
-                }
+    case BINOP_BITOR: return is_float ? SpvOpNop : SpvOpBitwiseOr;
+    case BINOP_BITAND: return is_float ? SpvOpNop : SpvOpBitwiseAnd;
+    case BINOP_BITXOR: return is_float ? SpvOpNop : SpvOpBitwiseXor;
 
-                if (a->type->vector.size != 3)
-                {
-                    ts__addErr(compiler, &expr->loc, "cross operates on 3D vectors");
-                    break;
-                }
+    default: break;
+    }
 
-                expr->type = a->type;
-                break;
-            }
+    return SpvOpNop;
+}
 
-            case AST_BUILTIN_FUNC_LENGTH: {
-                if (param_count != 1)
-                {
-                    ts__addErr(compiler, &expr->loc, "length needs 1 parameter");
-                    break;
-                }
+static AstConst *
+constBinaryScalar(Analyzer *a, AstBinaryOp op, AstType *type, AstConst *l, AstConst *r)
+{
+    if (l->elem_count > 0 || r->elem_count > 0) return NULL;
+    if (!isConstScalarType(l->type) || !isConstScalarType(r->type)) return NULL;
 
-                AstExpr *a = params.ptr[0];
+    // Shift amounts may have a different integer type, everything else matches
+    if (op != BINOP_LSHIFT && op != BINOP_RSHIFT && l->type != r->type) return NULL;
 
-                if (a->type->kind != TYPE_VECTOR)
-                {
-                    ts__addErr(compiler, &expr->loc, "length operates on a vector");
-                    break;
-                }
-
-                expr->type = a->type->vector.elem_type;
-                break;
-            }
+    ScalarValue result;
+    SpvOp spv_op = constBinaryOp(op, l->type);
+    if (!ts__foldBinary(spv_op, constScalarValue(l), constScalarValue(r), &result))
+    {
+        return NULL;
+    }
+    return constFromScalarValue(a, type, result);
+}
 
-            case AST_BUILTIN_FUNC_NORMALIZE: {
-                if (param_count != 1)
-                {
-                    ts__addErr(compiler, &expr->loc, "normalize needs 1 parameter");
-                    break;
-                }
+static AstConst *constBinary(Analyzer *a, AstExpr *expr, AstConst *l, AstConst *r)
+{
+    AstType *type = expr->type;
+    if (type->kind != TYPE_VECTOR)
+    {
+        return constBinaryScalar(a, expr->binary.op, type, l, r);
+    }
 
-                AstExpr *a = params.ptr[0];
+    if (l->elem_count > 0 && l->elem_count != type->vector.size) return NULL;
+    if (r->elem_count > 0 && r->elem_count != type->vector.size) return NULL;
 
-                if (a->type->kind != TYPE_VECTOR)
-                {
-                    ts__addErr(compiler, &expr->loc, "normalize operates on a vector");
-                    break;
-                }
+    // Scalar operands are broadcast to the size of the vector
+    AstConst *result = newConst(a, type);
+    for (uint32_t i = 0; i < result->elem_count; ++i)
+    {
+        AstConst *left_elem = l->elem_count > 0 ? l->elems[i] : l;
+        AstConst *right_elem = r->elem_count > 0 ? r->elems[i] : r;
 
-                expr->type = a->type;
-                break;
-            }
+        result->elems[i] = constBinaryScalar(
+            a, expr->binary.op, type->vector.elem_type, left_elem, right_elem);
+        if (!result->elems[i]) return NULL;
+    }
 
-            case AST_BUILTIN_FUNC_MUL: {
-                if (param_count != 2)
-                {
-                    ts__addErr(compiler, &expr->loc, "dot needs 2 parameters");
-                    break;
-                }
+    return result;
+}
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
+static AstConst *constUnaryScalar(Analyzer *a, AstUnaryOp op, AstType *type, AstConst *c)
+{
+    if (c->elem_count > 0 || c->type != type || !isConstScalarType(type)) return NULL;
 
-                if (!((a->type->kind == TYPE_VECTOR && b->type->kind == TYPE_MATRIX) ||
-                      (a->type->kind == TYPE_MATRIX && b->type->kind == TYPE_VECTOR) ||
-                      (a->type->kind == TYPE_VECTOR && b->type->kind == TYPE_VECTOR) ||
-                      (a->type->kind == TYPE_MATRIX && b->type->kind == TYPE_MATRIX)))
-                {
-                    ts__addErr(compiler, &expr->loc, "invalid parameters for mul");
-                    break;
-                }
+    SpvOp spv_op = SpvOpNop;
+    switch (op)
+    {
+    case UNOP_NEG: {
+        if (type->kind == TYPE_FLOAT) spv_op = SpvOpFNegate;
+        if (type->kind == TYPE_INT) spv_op = SpvOpSNegate;
+        break;
+    }
 
-                if (a->type->kind == TYPE_VECTOR && b->type->kind == TYPE_MATRIX)
-                {
-                    // Matrix times vector, yes, it's backwards
-                    if (a->type != b->type->matrix.col_type)
-                    {
-                        ts__addErr(
-                            compiler,
-                            &expr->loc,
-                            "mismatched matrix columns with vector type");
-                        break;
-                    }
+    case UNOP_NOT: {
+        if (type->kind == TYPE_BOOL) spv_op = SpvOpLogicalNot;
+        break;
+    }
 
-                    expr->type = a->type;
-                }
-                else if (a->type->kind == TYPE_MATRIX && b->type->kind == TYPE_VECTOR)
-                {
-                    // Vector times matrix, yes, it's backwards
-                    if (b->type != a->type->matrix.col_type)
-                    {
-                        ts__addErr(
-                            compiler,
-                            &expr->loc,
-                            "mismatched matrix columns with vector type");
-                        break;
-                    }
+    case UNOP_BITNOT: {
+        if (type->kind == TYPE_INT) spv_op = SpvOpNot;
+        break;
+    }
 
-                    expr->type = b->type;
-                }
-                else if (a->type->kind == TYPE_VECTOR && b->type->kind == TYPE_VECTOR)
-                {
-                    // Vector dot product
-                    if (b->type != a->type)
-                    {
-                        ts__addErr(compiler, &expr->loc, "mismatched vector types");
-                        break;
-                    }
+    default: break;
+    }
 
-                    expr->type = a->type->vector.elem_type;
-                }
-                else if (a->type->kind == TYPE_MATRIX && b->type->kind == TYPE_MATRIX)
-                {
-                    // Matrix times matrix
-                    if (b->type != a->type)
-                    {
-                        ts__addErr(compiler, &expr->loc, "mismatched matrix types");
-                        break;
-                    }
+    ScalarValue result;
+    if (!ts__foldUnary(spv_op, constScalarValue(c), &result)) return NULL;
+    return constFromScalarValue(a, type, result);
+}
 
-                    expr->type = a->type;
-                }
-                else
-                {
-                    assert(0);
-                }
+static AstConst *constUnary(Analyzer *a, AstExpr *expr, AstConst *right)
+{
+    AstType *type = expr->type;
+    if (type->kind != TYPE_VECTOR)
+    {
+        return constUnaryScalar(a, expr->unary.op, type, right);
+    }
 
-                break;
-            }
+    if (right->elem_count != type->vector.size) return NULL;
 
-            case AST_BUILTIN_FUNC_DISTANCE: {
-                if (param_count != 2)
-                {
-                    ts__addErr(compiler, &expr->loc, "distance needs 2 parameters");
-                    break;
-                }
+    AstConst *result = newConst(a, type);
+    for (uint32_t i = 0; i < result->elem_count; ++i)
+    {
+        result->elems[i] = constUnaryScalar(
+            a, expr->unary.op, type->vector.elem_type, right->elems[i]);
+        if (!result->elems[i]) return NULL;
+    }
 
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
-                tryCoerceExprToScalarType(a, params.ptr[1], newFloatType(m, 32));
+    return result;
+}
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
+// Builtins that operate on each component, called with one scalar of each parameter
+static AstConst *constBuiltinScalar(
+    Analyzer *a, const AstBuiltinSignature *sig, AstType *type, AstConst **args)
+{
+    if (!isConstScalarType(type)) return NULL;
 
-                if ((a->type->kind != TYPE_VECTOR) || (b->type->kind != TYPE_VECTOR))
-                {
-                    ts__addErr(compiler, &expr->loc, "distance operates on vectors");
-                    break;
-                }
+    ScalarValue values[3];
+    for (uint32_t i = 0; i < sig->param_count; ++i)
+    {
+        values[i] = constScalarValue(args[i]);
+    }
 
-                if (a->type != b->type)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "distance cannot operate on different types");
-                    break;
-                }
+    ScalarValue result;
+    if (!ts__foldBuiltin(sig->ir_kind, values, sig->param_count, &result)) return NULL;
+    return constFromScalarValue(a, type, result);
+}
 
-                expr->type = ts__getElemType(a->type);
-                break;
-            }
+static AstConst *constBuiltin(
+    Analyzer *a, AstExpr *expr, const AstBuiltinSignature *sig, AstConst **args)
+{
+    AstType *type = expr->type;
 
-            case AST_BUILTIN_FUNC_RADIANS:
-            case AST_BUILTIN_FUNC_DEGREES: {
-                if (param_count != 1)
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "degrees/radians call needs 1 parameter");
-                    break;
-                }
+    switch (sig->kind)
+    {
+    case AST_BUILTIN_FUNC_DOT:
+    case AST_BUILTIN_FUNC_LENGTH:
+    case AST_BUILTIN_FUNC_DISTANCE:
+    case AST_BUILTIN_FUNC_NORMALIZE:
+    case AST_BUILTIN_FUNC_CROSS: {
+        AstConst *v = args[0];
+        AstConst *w = args[1];
+        if (v->type->kind != TYPE_VECTOR) return NULL;
+        if (v->type->vector.elem_type->kind != TYPE_FLOAT) return NULL;
+        if (w && w->type != v->type) return NULL;
+
+        AstType *elem_type = v->type->vector.elem_type;
+        uint32_t size = v->elem_count;
+        assert(size <= 4);
+
+        double vs[4];
+        double ws[4];
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            vs[i] = v->elems[i]->f;
+            ws[i] = w ? w->elems[i]->f : 0.0;
+        }
 
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
+        double values[4];
+        if (!ts__foldGeometric(sig->ir_kind, vs, ws, size, values)) return NULL;
 
-                AstExpr *a = params.ptr[0];
-                if (!a->type) break;
+        // dot, length and distance give a scalar
+        AstBuiltinFunction kind = sig->kind;
+        if (kind != AST_BUILTIN_FUNC_NORMALIZE && kind != AST_BUILTIN_FUNC_CROSS)
+        {
+            return constFloat(a, elem_type, values[0]);
+        }
 
-                if (a->type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "degrees/radians call needs a float parameter");
-                    break;
-                }
+        AstConst *result = newConst(a, v->type);
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            result->elems[i] = constFloat(a, elem_type, values[i]);
+        }
+        return result;
+    }
 
-                expr->type = a->type;
+    default: break;
+    }
 
-                break;
-            }
+    // Everything else works on each component of parameters of the result type
+    if (sig->result != BUILTIN_RESULT_SAME || sig->param_count == 0) return NULL;
+    for (uint32_t i = 0; i < sig->param_count; ++i)
+    {
+        if (args[i]->type != type) return NULL;
+    }
 
-            case AST_BUILTIN_FUNC_SIN:
-            case AST_BUILTIN_FUNC_COS:
-            case AST_BUILTIN_FUNC_TAN:
-            case AST_BUILTIN_FUNC_ASIN:
-            case AST_BUILTIN_FUNC_ACOS:
-            case AST_BUILTIN_FUNC_ATAN:
-            case AST_BUILTIN_FUNC_SINH:
-            case AST_BUILTIN_FUNC_COSH:
-            case AST_BUILTIN_FUNC_TANH: {
-                if (param_count != 1)
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "trigonometric functions take 1 parameter");
-                    break;
-                }
+    if (type->kind != TYPE_VECTOR) return constBuiltinScalar(a, sig, type, args);
 
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
+    AstConst *result = newConst(a, type);
+    for (uint32_t i = 0; i < result->elem_count; ++i)
+    {
+        AstConst *elem_args[3] = {0};
+        for (uint32_t j = 0; j < sig->param_count; ++j)
+        {
+            elem_args[j] = args[j]->elems[i];
+        }
 
-                AstType *scalar_type = ts__getScalarType(params.ptr[0]->type);
+        result->elems[i] = constBuiltinScalar(a, sig, type->vector.elem_type, elem_args);
+        if (!result->elems[i]) return NULL;
+    }
 
-                if (scalar_type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "trigonometric functions operate on floats");
-                    break;
-                }
+    return result;
+}
 
-                expr->type = params.ptr[0]->type;
-                break;
-            }
+// Mirrors the type constructors built by the IR builder, matrices are filled one
+// column at a time
+static AstConst *constConstruct(Analyzer *a, AstType *type, AstExprList params)
+{
+    TsCompiler *compiler = a->compiler;
 
-            case AST_BUILTIN_FUNC_ATAN2: {
-                if (param_count != 2)
-                {
-                    ts__addErr(compiler, &expr->loc, "atan2 takes 2 parameters");
-                    break;
-                }
+    switch (type->kind)
+    {
+    case TYPE_VECTOR: {
+        AstType *elem_type = type->vector.elem_type;
+        AstConst *result = newConst(a, type);
 
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
-                tryCoerceExprToScalarType(a, params.ptr[1], newFloatType(m, 32));
+        uint32_t elem_index = 0;
+        for (uint32_t i = 0; i < params.len; ++i)
+        {
+            AstConst *param =
+                ts__exprInfo(compiler, ts__expr(compiler, params.ptr[i]))->const_value;
+            uint32_t param_elem_count = param->elem_count > 0 ? param->elem_count : 1;
+            if (param->type->kind == TYPE_MATRIX) return NULL;
+            if (elem_index + param_elem_count > result->elem_count) return NULL;
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
+            for (uint32_t j = 0; j < param_elem_count; ++j)
+            {
+                AstConst *elem = param->elem_count > 0 ? param->elems[j] : param;
+                result->elems[elem_index] = constCastScalar(a, elem, elem_type);
+                if (!result->elems[elem_index]) return NULL;
+                elem_index++;
+            }
+        }
 
-                if (a->kind == EXPR_PRIMARY && a->type->kind == TYPE_INT)
-                {
-                    a->type = newFloatType(m, 32);
-                }
+        if (elem_index != result->elem_count) return NULL;
+        return result;
+    }
 
-                if (b->kind == EXPR_PRIMARY && b->type->kind == TYPE_INT)
-                {
-                    b->type = newFloatType(m, 32);
-                }
+    case TYPE_MATRIX: {
+        AstType *col_type = type->matrix.col_type;
+        uint32_t col_size = col_type->vector.size;
+        if (params.len != type->matrix.col_count * col_size) return NULL;
 
-                if (a->type != b->type)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "atan2 requires 2 parameters of identical types");
-                    break;
-                }
+        AstConst *result = newConst(a, type);
+        for (uint32_t i = 0; i < result->elem_count; ++i)
+        {
+            AstConst *col = newConst(a, col_type);
+            for (uint32_t j = 0; j < col_size; ++j)
+            {
+                AstExpr *param = ts__expr(compiler, params.ptr[i * col_size + j]);
+                AstConst *elem = ts__exprInfo(compiler, param)->const_value;
+                col->elems[j] = constCastScalar(a, elem, col_type->vector.elem_type);
+                if (!col->elems[j]) return NULL;
+            }
+            result->elems[i] = col;
+        }
 
-                if (a->type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(compiler, &expr->loc, "atan2 operates on floats");
-                    break;
-                }
+        return result;
+    }
 
-                expr->type = a->type;
-                break;
-            }
+    case TYPE_INT:
+    case TYPE_FLOAT: {
+        if (params.len != 1) return NULL;
+        return constCastScalar(
+            a,
+            ts__exprInfo(compiler, ts__expr(compiler, params.ptr[0]))->const_value,
+            type);
+    }
 
-            case AST_BUILTIN_FUNC_SQRT:
-            case AST_BUILTIN_FUNC_RSQRT: {
-                if (param_count != 1)
-                {
-                    ts__addErr(compiler, &expr->loc, "sqrt/rsqrt takes 1 parameter");
-                    break;
-                }
+    default: break;
+    }
 
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
+    return NULL;
+}
 
-                AstExpr *a = params.ptr[0];
-                if (!a->type) break;
+static AstConst *analyzerFoldExpr(Analyzer *a, AstExpr *expr);
 
-                AstType *scalar_type = ts__getScalarType(a->type);
-                if (!scalar_type || scalar_type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "sqrt/rsqrt operates on vectors or scalars of float type");
-                    break;
-                }
+// Stores the value of a folded expression, which only counts if it kept the type of
+// the expression
+static AstConst *exprSetConstValue(TsCompiler *compiler, AstExpr *expr, AstConst *value)
+{
+    if (value && value->type != expr->type) value = NULL;
+    if (!value && !expr->info) return NULL;
 
-                expr->type = a->type;
+    AstExprInfo *info = ts__exprInfoEdit(compiler, expr);
+    info->const_value = value;
+    if (value && value->type->kind == TYPE_INT)
+    {
+        expr->has_resolved_int = true;
+        info->resolved_int = value->i;
+    }
 
-                break;
-            }
+    return value;
+}
 
-            case AST_BUILTIN_FUNC_REFLECT: {
-                if (param_count != 2)
-                {
-                    ts__addErr(compiler, &expr->loc, "reflect needs 2 parameters");
-                    break;
-                }
+// Returns true if all of the parameters are constant
+static bool analyzerFoldParams(Analyzer *a, AstExprList params)
+{
+    TsCompiler *compiler = a->compiler;
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
+    bool params_const = true;
+    for (uint32_t i = 0; i < params.len; ++i)
+    {
+        if (!analyzerFoldExpr(a, ts__expr(compiler, params.ptr[i]))) params_const = false;
+    }
+    return params_const;
+}
 
-                if ((a->type->kind != TYPE_VECTOR) || (b->type->kind != TYPE_VECTOR))
-                {
-                    ts__addErr(compiler, &expr->loc, "reflect operates on vectors");
-                    break;
-                }
+// Folds every constant sub-expression of 'expr' and returns the value of 'expr'
+// itself, or NULL if it is only known at runtime
+static AstConst *analyzerFoldExpr(Analyzer *a, AstExpr *expr)
+{
+    TsCompiler *compiler = a->compiler;
 
-                if (a->type != b->type)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "reflect cannot operate on different vector types");
-                    break;
-                }
+    AstConst *result = NULL;
 
-                expr->type = a->type;
+    switch (expr->kind)
+    {
+    case EXPR_PRIMARY: {
+        if (!expr->type || !isConstScalarType(expr->type)) break;
 
-                break;
+        Token *token = expr->primary.token;
+        switch (token->kind)
+        {
+        case TOKEN_INT_LIT: {
+            if (expr->type->kind == TYPE_FLOAT)
+            {
+                result = constFloat(a, expr->type, (double)token->int_);
             }
+            else
+            {
+                result = constInt(a, expr->type, (uint64_t)token->int_);
+            }
+            break;
+        }
 
-            case AST_BUILTIN_FUNC_REFRACT: {
-                if (param_count != 3)
-                {
-                    ts__addErr(compiler, &expr->loc, "refract needs 2 parameters");
-                    break;
-                }
-
-                tryCoerceExprToScalarType(a, params.ptr[2], newFloatType(m, 32));
+        case TOKEN_FLOAT_LIT: {
+            if (expr->type->kind == TYPE_FLOAT)
+            {
+                result = constFloat(a, expr->type, token->double_);
+            }
+            else if (expr->type->kind == TYPE_BOOL)
+            {
+                result = constInt(a, expr->type, token->double_ != 0.0);
+            }
+            break;
+        }
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
-                AstExpr *c = params.ptr[2];
+        case TOKEN_TRUE:
+        case TOKEN_FALSE: {
+            if (expr->type->kind == TYPE_BOOL)
+            {
+                result = constInt(a, expr->type, token->kind == TOKEN_TRUE);
+            }
+            break;
+        }
 
-                if (!a->type || !b->type || !c->type) break;
+        default: break;
+        }
+        break;
+    }
 
-                if ((a->type->kind != TYPE_VECTOR) || (b->type->kind != TYPE_VECTOR))
-                {
-                    ts__addErr(compiler, &expr->loc, "refract operates on vectors");
-                    break;
-                }
+    case EXPR_IDENT: {
+        AstDecl *decl = ts__decl(compiler, expr->ident.decl);
+        if (decl && decl->kind == DECL_CONST && expr->type)
+        {
+            result = constCast(a, ts__declInfo(compiler, decl)->const_value, expr->type);
+        }
+        break;
+    }
 
-                if (a->type != b->type)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "refract cannot operate on different vector types");
-                    break;
-                }
+    case EXPR_VAR_ASSIGN: {
+        analyzerFoldExpr(a, ts__expr(compiler, expr->var_assign.assigned_expr));
+        analyzerFoldExpr(a, ts__expr(compiler, expr->var_assign.value_expr));
+        break;
+    }
 
-                if (c->type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "refract takes a scalar as the third parameter");
-                    break;
-                }
+    case EXPR_SUBSCRIPT: {
+        AstConst *left = analyzerFoldExpr(a, ts__expr(compiler, expr->subscript.left));
+        AstConst *right = analyzerFoldExpr(a, ts__expr(compiler, expr->subscript.right));
+        if (left && right && right->type->kind == TYPE_INT &&
+            (uint64_t)right->i < left->elem_count)
+        {
+            result = left->elems[right->i];
+        }
+        break;
+    }
 
-                expr->type = a->type;
+    case EXPR_ACCESS: {
+        AstConst *value = analyzerFoldExpr(a, ts__expr(compiler, expr->access.base));
 
+        // Only vector swizzles, struct members are never constant
+        for (uint32_t i = 0; i < expr->access.chain.len && value; ++i)
+        {
+            AstExpr *selector = ts__expr(compiler, expr->access.chain.ptr[i]);
+            if (selector->kind != EXPR_IDENT ||
+                !ts__exprInfo(compiler, selector)->shuffle_indices || !selector->type ||
+                value->type->kind != TYPE_VECTOR)
+            {
+                value = NULL;
                 break;
             }
 
-            case AST_BUILTIN_FUNC_POW: {
-                if (param_count != 2)
-                {
-                    ts__addErr(compiler, &expr->loc, "pow takes 2 parameters");
-                    break;
-                }
-
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
-                tryCoerceExprToScalarType(a, params.ptr[1], newFloatType(m, 32));
-
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
-                if (!a->type || !b->type) break;
+            uint32_t *indices = ts__exprInfo(compiler, selector)->shuffle_indices;
+            uint32_t index_count = ts__exprInfo(compiler, selector)->shuffle_index_count;
 
-                if (a->type != b->type)
+            AstConst *shuffled = NULL;
+            if (index_count == 1)
+            {
+                if (indices[0] < value->elem_count) shuffled = value->elems[indices[0]];
+            }
+            else
+            {
+                shuffled = newConst(a, selector->type);
+                for (uint32_t j = 0; j < index_count; ++j)
                 {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "pow operates on parameters of the same type");
-                    break;
+                    if (indices[j] >= value->elem_count || j >= shuffled->elem_count)
+                    {
+                        shuffled = NULL;
+                        break;
+                    }
+                    shuffled->elems[j] = value->elems[indices[j]];
                 }
+            }
 
-                AstType *scalar_type = ts__getScalarType(a->type);
-                if (!scalar_type || scalar_type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "pow operates on vectors or scalars of float type");
-                    break;
-                }
+            value = shuffled;
+        }
 
-                expr->type = a->type;
+        result = value;
+        break;
+    }
 
-                break;
-            }
+    case EXPR_FUNC_CALL: {
+        if (expr->func_call.self_param)
+        {
+            analyzerFoldExpr(a, ts__expr(compiler, expr->func_call.self_param));
+        }
 
-            case AST_BUILTIN_FUNC_EXP:
-            case AST_BUILTIN_FUNC_EXP2: {
-                if (param_count != 1)
-                {
-                    ts__addErr(compiler, &expr->loc, "exp/exp2 takes 1 parameter");
-                    break;
-                }
+        bool params_const = analyzerFoldParams(a, expr->func_call.params);
 
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
+        AstExpr *func_expr = ts__expr(compiler, expr->func_call.func_expr);
+        if (!params_const || !expr->type || expr->func_call.self_param) break;
 
-                AstExpr *a = params.ptr[0];
-                if (!a->type) break;
+        void *builtin = NULL;
+        if (func_expr->kind == EXPR_IDENT &&
+            ts__hashGet(&a->compiler->builtin_function_table, func_expr->ident.name, &builtin))
+        {
+            const AstBuiltinSignature *sig = builtin;
+            if (expr->func_call.params.len != sig->param_count) break;
 
-                AstType *scalar_type = ts__getScalarType(a->type);
-                if (!scalar_type || scalar_type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "exp/exp2 operates on vectors or scalars of float type");
-                    break;
-                }
+            AstConst *args[3] = {0};
+            for (uint32_t i = 0; i < sig->param_count && i < 3; ++i)
+            {
+                AstExpr *param = ts__expr(compiler, expr->func_call.params.ptr[i]);
+                args[i] = ts__exprInfo(compiler, param)->const_value;
+            }
 
-                expr->type = a->type;
+            if (sig->param_count <= 3) result = constBuiltin(a, expr, sig, args);
+            break;
+        }
 
-                break;
-            }
+        AstType *constructed_type = ts__exprInfo(compiler, func_expr)->as_type;
+        if (func_expr->type && func_expr->type->kind == TYPE_TYPE && constructed_type)
+        {
+            result = constConstruct(a, constructed_type, expr->func_call.params);
+        }
+        break;
+    }
 
-            case AST_BUILTIN_FUNC_LOG:
-            case AST_BUILTIN_FUNC_LOG2: {
-                if (param_count != 1)
-                {
-                    ts__addErr(compiler, &expr->loc, "log/log2 takes 1 parameter");
-                    break;
-                }
+    case EXPR_UNARY: {
+        AstConst *right = analyzerFoldExpr(a, ts__expr(compiler, expr->unary.right));
+        if (right && expr->type) result = constUnary(a, expr, right);
+        break;
+    }
 
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
+    case EXPR_BINARY: {
+        // Left operands are folded in a loop, chains like 'a + b + c' are as deep as
+        // they are long
+        size_t base = a->binary_stack.len;
+        AstExpr *leaf = expr;
+        for (; leaf->kind == EXPR_BINARY; leaf = ts__expr(compiler, leaf->binary.left))
+        {
+            arrPush(compiler, &a->binary_stack, leaf);
+        }
 
-                AstExpr *a = params.ptr[0];
-                if (!a->type) break;
+        AstConst *left = analyzerFoldExpr(a, leaf);
+        for (size_t i = a->binary_stack.len; i-- > base;)
+        {
+            AstExpr *binary = a->binary_stack.ptr[i];
+            AstConst *right =
+                analyzerFoldExpr(a, ts__expr(compiler, binary->binary.right));
 
-                AstType *scalar_type = ts__getScalarType(a->type);
-                if (!scalar_type || scalar_type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "log/log2 operates on vectors or scalars of float type");
-                    break;
-                }
+            AstConst *value = NULL;
+            if (left && right && binary->type) value = constBinary(a, binary, left, right);
+            left = (i > base) ? exprSetConstValue(compiler, binary, value) : value;
+        }
+        a->binary_stack.len = base;
 
-                expr->type = a->type;
+        result = left;
+        break;
+    }
 
-                break;
-            }
+    case EXPR_TERNARY: {
+        AstConst *cond = analyzerFoldExpr(a, ts__expr(compiler, expr->ternary.cond));
+        AstConst *true_value =
+            analyzerFoldExpr(a, ts__expr(compiler, expr->ternary.true_expr));
+        AstConst *false_value =
+            analyzerFoldExpr(a, ts__expr(compiler, expr->ternary.false_expr));
+
+        // Both sides are evaluated by OpSelect, so both need to be constant
+        if (cond && true_value && false_value && cond->type->kind == TYPE_BOOL &&
+            expr->type)
+        {
+            result = constCast(a, cond->i ? true_value : false_value, expr->type);
+        }
+        break;
+    }
 
-            case AST_BUILTIN_FUNC_ABS: {
-                if (param_count != 1)
-                {
-                    ts__addErr(compiler, &expr->loc, "abs takes 1 parameter");
-                    break;
-                }
+    case EXPR_AUTO_CAST: {
+        AstConst *sub = analyzerFoldExpr(a, ts__expr(compiler, expr->auto_cast.sub));
+        if (sub && expr->type) result = constCast(a, sub, expr->type);
+        break;
+    }
 
-                if (expected_type)
-                {
-                    tryCoerceExprToScalarType(a, params.ptr[0], expected_type);
-                }
+    case EXPR_SAMPLER_TYPE:
+    case EXPR_TEXTURE_TYPE:
+    case EXPR_CONSTANT_BUFFER_TYPE:
+    case EXPR_STRUCTURED_BUFFER_TYPE:
+    case EXPR_RW_STRUCTURED_BUFFER_TYPE: break;
+    }
 
-                AstExpr *a = params.ptr[0];
-                if (!a->type) break;
+    return exprSetConstValue(compiler, expr, result);
+}
 
-                AstType *scalar_type = ts__getScalarType(a->type);
-                if (!scalar_type ||
-                    !(scalar_type->kind == TYPE_INT || scalar_type->kind == TYPE_FLOAT))
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "abs operates on vectors or scalars");
-                    break;
-                }
+// Converts an analyzed expression to the type its context expects
+static void analyzerCheckExpectedType(Analyzer *a, AstExpr *expr, AstType *expected_type)
+{
+    TsCompiler *compiler = a->compiler;
+    if (!expected_type) return;
 
-                expr->type = a->type;
+    if (!expr->type)
+    {
+        ts__addErrAt(compiler, expr->loc, "could not resolve type for expression");
+    }
+    else if (expr->type != expected_type)
+    {
+        if (isAutoCastable(expr->type, expected_type))
+        {
+            exprAutoCast(compiler, expr, expected_type);
+        }
+        else
+        {
+            ts__addErrAt(compiler, expr->loc,
+                    "unmatched types, expected '%s', instead got '%s'",
+                    typeToPrettyString(compiler, expected_type),
+                    typeToPrettyString(compiler, expr->type));
+        }
+    }
+}
 
-                break;
-            }
+// Operands of the logical operators are converted to bool, the others keep their type
+static AstType *binaryOperandType(Module *m, AstExpr *expr)
+{
+    switch (expr->binary.op)
+    {
+    case BINOP_LOGICAL_AND:
+    case BINOP_LOGICAL_OR: return newBasicType(m, TYPE_BOOL);
+    default: return NULL;
+    }
+}
 
-            case AST_BUILTIN_FUNC_MIN:
-            case AST_BUILTIN_FUNC_MAX: {
-                if (param_count != 2)
-                {
-                    ts__addErr(compiler, &expr->loc, "min/max takes 2 parameters");
-                    break;
-                }
+// Types a binary expression whose operands are already analyzed
+static void analyzerAnalyzeBinaryExpr(Analyzer *a, AstExpr *expr, AstType *expected_type)
+{
+    TsCompiler *compiler = a->compiler;
+    Module *m = a->module;
+    AstExpr *left = ts__expr(compiler, expr->binary.left);
+    AstExpr *right = ts__expr(compiler, expr->binary.right);
 
-                if (expected_type &&
-                    canCoerceExprToScalarType(a, params.ptr[0], expected_type) &&
-                    canCoerceExprToScalarType(a, params.ptr[1], expected_type))
-                {
-                    tryCoerceExprToScalarType(a, params.ptr[0], expected_type);
-                    tryCoerceExprToScalarType(a, params.ptr[1], expected_type);
-                }
+    switch (expr->binary.op)
+    {
+    case BINOP_ADD:
+    case BINOP_SUB:
+    case BINOP_MUL:
+    case BINOP_DIV:
+    case BINOP_MOD: {
+        if (!left->type || !right->type) break;
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
-                if (!a->type || !b->type) break;
+        tryCoerceExprToScalarType(a, left, expected_type);
+        tryCoerceExprToScalarType(a, right, expected_type);
 
-                if (a->type != b->type)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "min/max operates parameters of equal types");
-                    break;
-                }
+        tryCoerceExprToScalarType(a, left, right->type);
+        tryCoerceExprToScalarType(a, right, left->type);
 
-                AstType *scalar_type = ts__getScalarType(a->type);
-                if (!scalar_type ||
-                    !(scalar_type->kind == TYPE_INT || scalar_type->kind == TYPE_FLOAT))
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "min/max operates on vectors or scalars");
-                    break;
-                }
+        AstType *left_type = left->type;
+        AstType *right_type = right->type;
+
+        if (!left_type || !right_type)
+        {
+            ts__addErrAt(
+                compiler,
+                expr->loc,
+                "invalid types for binary arithmentic operation");
+            break;
+        }
 
-                expr->type = a->type;
+        AstType *left_scalar = ts__getScalarTypeNoVec(left_type);
+        AstType *right_scalar = ts__getScalarTypeNoVec(right_type);
 
+        if (left_type->kind == TYPE_VECTOR && right_type->kind == TYPE_VECTOR)
+        {
+            // Vector and vector
+            left_scalar = left_type->vector.elem_type;
+            right_scalar = right_type->vector.elem_type;
+            if (left_scalar != right_scalar ||
+                left_type->vector.size != right_type->vector.size)
+            {
+                ts__addErrAt(
+                    compiler,
+                    expr->loc,
+                    "invalid types for binary arithmentic operation: '%s' and '%s'",
+                    typeToPrettyString(compiler, left_type),
+                    typeToPrettyString(compiler, right_type));
                 break;
             }
 
-            case AST_BUILTIN_FUNC_TRUNC:
-            case AST_BUILTIN_FUNC_CEIL:
-            case AST_BUILTIN_FUNC_FLOOR:
-            case AST_BUILTIN_FUNC_FRAC: {
-                if (param_count != 1)
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "frac/ceil/trunc/floor take 1 parameter");
-                    break;
-                }
-
-                if (expected_type &&
-                    canCoerceExprToScalarType(a, params.ptr[0], expected_type))
-                {
-                    tryCoerceExprToScalarType(a, params.ptr[0], expected_type);
-                }
-
-                if (!params.ptr[0]->type) break;
+            expr->type = left_type;
+        }
+        else if (left_scalar && right_scalar)
+        {
+            // Scalar and scalar
+            if (left_scalar != right_scalar)
+            {
+                ts__addErrAt(
+                    compiler,
+                    expr->loc,
+                    "invalid types for binary arithmentic operation: '%s' and '%s'",
+                    typeToPrettyString(compiler, left_type),
+                    typeToPrettyString(compiler, right_type));
+                break;
+            }
 
-                AstType *scalar_type = ts__getScalarType(params.ptr[0]->type);
-                if (!scalar_type || scalar_type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "frac/ceil/trunc/floor operates on vectors or scalars of "
-                        "floating point types");
-                    break;
-                }
+            expr->type = left_scalar;
+        }
+        else
+        {
+            // Vector and scalar
+            AstType *vector_type = NULL;
+            AstType *scalar_type = NULL;
+            if (left_type->kind == TYPE_VECTOR)
+            {
+                assert(!vector_type);
+                vector_type = left_type;
+                scalar_type = right_type;
+            }
+            else if (right_type->kind == TYPE_VECTOR)
+            {
+                assert(!vector_type);
+                vector_type = right_type;
+                scalar_type = left_type;
+            }
+            else
+            {
+                ts__addErrAt(
+                    compiler,
+                    expr->loc,
+                    "invalid types for binary arithmentic operation: '%s' and '%s'",
+                    typeToPrettyString(compiler, left_type),
+                    typeToPrettyString(compiler, right_type));
+                break;
+            }
 
-                expr->type = params.ptr[0]->type;
+            assert(vector_type);
+            assert(scalar_type);
+            assert(vector_type->kind == TYPE_VECTOR);
+            assert(scalar_type->kind != TYPE_VECTOR);
 
+            if (ts__getScalarType(vector_type) != scalar_type)
+            {
+                ts__addErrAt(
+                    compiler,
+                    expr->loc,
+                    "invalid types for binary arithmentic operation");
                 break;
             }
 
-            case AST_BUILTIN_FUNC_LERP: {
-                if (param_count != 3)
-                {
-                    ts__addErr(compiler, &expr->loc, "lerp takes 3 parameters");
-                    break;
-                }
+            expr->type = vector_type;
+        }
 
-                if (expected_type &&
-                    canCoerceExprToScalarType(a, params.ptr[0], expected_type) &&
-                    canCoerceExprToScalarType(a, params.ptr[1], expected_type) &&
-                    canCoerceExprToScalarType(a, params.ptr[2], expected_type))
-                {
-                    tryCoerceExprToScalarType(a, params.ptr[0], expected_type);
-                    tryCoerceExprToScalarType(a, params.ptr[1], expected_type);
-                    tryCoerceExprToScalarType(a, params.ptr[2], expected_type);
-                }
+        assert(expr->type);
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
-                AstExpr *c = params.ptr[2];
-                if (!a->type || !b->type || !c->type) break;
+        break;
+    }
 
-                if (a->type != b->type || a->type != c->type)
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "lerp operates parameters of equal types");
-                    break;
-                }
+    case BINOP_EQ:
+    case BINOP_NOTEQ:
+    case BINOP_LESS:
+    case BINOP_LESSEQ:
+    case BINOP_GREATER:
+    case BINOP_GREATEREQ: {
+        if (!left->type || !right->type) break;
 
-                AstType *scalar_type = ts__getScalarType(a->type);
-                if (!scalar_type || scalar_type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "lerp operates on vectors or scalars of float type");
-                    break;
-                }
+        tryCoerceExprToScalarType(a, left, right->type);
+        tryCoerceExprToScalarType(a, right, left->type);
 
-                expr->type = a->type;
+        AstType *left_type = left->type;
+        AstType *right_type = right->type;
 
-                break;
-            }
+        AstType *left_comparable = ts__getComparableType(left_type);
+        AstType *right_comparable = ts__getComparableType(right_type);
 
-            case AST_BUILTIN_FUNC_CLAMP: {
-                if (param_count != 3)
-                {
-                    ts__addErr(compiler, &expr->loc, "clamp takes 3 parameters");
-                    break;
-                }
+        if ((!left_comparable) || (!right_comparable) || (left_type != right_type))
+        {
+            ts__addErrAt(
+                compiler,
+                expr->loc,
+                "invalid types for binary comparison operation");
+        }
 
-                if (expected_type &&
-                    canCoerceExprToScalarType(a, params.ptr[0], expected_type) &&
-                    canCoerceExprToScalarType(a, params.ptr[1], expected_type) &&
-                    canCoerceExprToScalarType(a, params.ptr[2], expected_type))
-                {
-                    tryCoerceExprToScalarType(a, params.ptr[0], expected_type);
-                    tryCoerceExprToScalarType(a, params.ptr[1], expected_type);
-                    tryCoerceExprToScalarType(a, params.ptr[2], expected_type);
-                }
-                else if (
-                    canCoerceExprToScalarType(a, params.ptr[1], params.ptr[0]->type) &&
-                    canCoerceExprToScalarType(a, params.ptr[2], params.ptr[0]->type))
-                {
-                    tryCoerceExprToScalarType(a, params.ptr[1], params.ptr[0]->type);
-                    tryCoerceExprToScalarType(a, params.ptr[2], params.ptr[0]->type);
-                }
+        expr->type = newBasicType(m, TYPE_BOOL);
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
-                AstExpr *c = params.ptr[2];
-                if (!a->type || !b->type || !c->type) break;
+        break;
+    }
 
-                if (a->type != b->type || a->type != c->type)
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "clamp operates parameters of equal types");
-                    break;
-                }
+    case BINOP_RSHIFT:
+    case BINOP_LSHIFT: {
+        if (!left->type || !right->type) break;
 
-                AstType *scalar_type = ts__getScalarType(a->type);
-                if (!scalar_type ||
-                    !(scalar_type->kind == TYPE_FLOAT || scalar_type->kind == TYPE_INT))
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "clamp operates on vectors or scalars of float type");
-                    break;
-                }
+        tryCoerceExprToScalarType(a, left, right->type);
+        tryCoerceExprToScalarType(a, right, left->type);
 
-                expr->type = a->type;
+        AstType *left_type = left->type;
+        AstType *right_type = right->type;
 
-                break;
-            }
+        if (left_type->kind != TYPE_INT || right_type->kind != TYPE_INT)
+        {
+            ts__addErrAt(
+                compiler,
+                expr->loc,
+                "bitwise shift requires both operands to be integers");
+        }
 
-            case AST_BUILTIN_FUNC_STEP: {
-                if (param_count != 2)
-                {
-                    ts__addErr(compiler, &expr->loc, "step takes 2 parameters");
-                    break;
-                }
+        expr->type = left_type;
 
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
-                tryCoerceExprToScalarType(a, params.ptr[1], newFloatType(m, 32));
+        break;
+    }
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
-                if (!a->type || !b->type) break;
+    case BINOP_BITXOR:
+    case BINOP_BITOR:
+    case BINOP_BITAND: {
+        if (!left->type || !right->type) break;
 
-                if (a->type != b->type)
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "step operates parameters of equal types");
-                    break;
-                }
+        tryCoerceExprToScalarType(a, left, right->type);
+        tryCoerceExprToScalarType(a, right, left->type);
 
-                AstType *scalar_type = ts__getScalarType(a->type);
-                if (!scalar_type || scalar_type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "step operates on vectors or scalars of float type");
-                    break;
-                }
+        AstType *left_type = left->type;
+        AstType *right_type = right->type;
 
-                expr->type = a->type;
+        if (left_type->kind != TYPE_INT || right_type->kind != TYPE_INT ||
+            left_type != right_type)
+        {
+            ts__addErrAt(
+                compiler,
+                expr->loc,
+                "bitwise logical operator requires both operands to be integers of "
+                "equal type");
+        }
 
-                break;
-            }
+        expr->type = left_type;
 
-            case AST_BUILTIN_FUNC_SMOOTHSTEP: {
-                if (param_count != 3)
-                {
-                    ts__addErr(compiler, &expr->loc, "smoothstep takes 3 parameters");
-                    break;
-                }
+        break;
+    }
 
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
-                tryCoerceExprToScalarType(a, params.ptr[1], newFloatType(m, 32));
-                tryCoerceExprToScalarType(a, params.ptr[2], newFloatType(m, 32));
+    case BINOP_LOGICAL_AND:
+    case BINOP_LOGICAL_OR: {
+        expr->type = newBasicType(m, TYPE_BOOL);
+        break;
+    }
+    }
+}
 
-                AstExpr *a = params.ptr[0];
-                AstExpr *b = params.ptr[1];
-                AstExpr *c = params.ptr[2];
-                if (!a->type || !b->type || !c->type) break;
+static void analyzerAnalyzeExpr(Analyzer *a, AstExprId expr_id, AstType *expected_type)
+{
+    TsCompiler *compiler = a->compiler;
+    Module *m = a->module;
 
-                if ((a->type != b->type) || (a->type != c->type))
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "smoothstep operates parameters of equal types");
-                    break;
-                }
+    AstExpr *expr = ts__expr(compiler, expr_id);
+    assert(expr);
 
-                AstType *scalar_type = ts__getScalarType(a->type);
-                if (!scalar_type || scalar_type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "smoothstep operates on vectors or scalars of float type");
-                    break;
-                }
+    a->expr_depth++;
 
-                expr->type = a->type;
+    switch (expr->kind)
+    {
+    case EXPR_PRIMARY: {
+        switch (expr->primary.token->kind)
+        {
+        case TOKEN_VOID: {
+            ts__exprInfoEdit(compiler, expr)->as_type =
+                newBasicType(a->module, TYPE_VOID);
+            expr->type = newBasicType(a->module, TYPE_TYPE);
+            break;
+        }
 
-                break;
-            }
+        case TOKEN_BOOL: {
+            ts__exprInfoEdit(compiler, expr)->as_type =
+                newBasicType(a->module, TYPE_BOOL);
+            expr->type = newBasicType(a->module, TYPE_TYPE);
+            break;
+        }
 
-            case AST_BUILTIN_FUNC_FMOD: {
-                if (param_count != 2)
-                {
-                    ts__addErr(compiler, &expr->loc, "fmod needs 2 parameters");
-                    break;
-                }
+        case TOKEN_FLOAT: {
+            ts__exprInfoEdit(compiler, expr)->as_type = newFloatType(a->module, 32);
+            expr->type = newBasicType(a->module, TYPE_TYPE);
+            break;
+        }
 
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
-                tryCoerceExprToScalarType(a, params.ptr[1], newFloatType(m, 32));
+        case TOKEN_INT: {
+            ts__exprInfoEdit(compiler, expr)->as_type = newIntType(a->module, 32, true);
+            expr->type = newBasicType(a->module, TYPE_TYPE);
+            break;
+        }
 
-                if (!params.ptr[0]->type || !params.ptr[1]->type) break;
+        case TOKEN_UINT: {
+            ts__exprInfoEdit(compiler, expr)->as_type = newIntType(a->module, 32, false);
+            expr->type = newBasicType(a->module, TYPE_TYPE);
+            break;
+        }
 
-                if (params.ptr[0]->type != params.ptr[1]->type)
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "fmod operates parameters of equal types");
-                    break;
-                }
+        case TOKEN_VECTOR_TYPE: {
+            AstType *elem_type = NULL;
 
-                AstType *scalar_type = ts__getScalarType(params.ptr[0]->type);
-                if (!scalar_type || scalar_type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "fmod operates on vectors or scalars of float type");
-                    break;
-                }
+            switch (expr->primary.token->vector_type.elem_type)
+            {
+            case TOKEN_FLOAT: {
+                elem_type = newFloatType(a->module, 32);
+                break;
+            }
 
-                expr->type = params.ptr[0]->type;
+            case TOKEN_INT: {
+                elem_type = newIntType(a->module, 32, true);
                 break;
             }
 
-            case AST_BUILTIN_FUNC_TRANSPOSE: {
-                if (param_count != 1)
-                {
-                    ts__addErr(compiler, &expr->loc, "transpose takes 1 parameter");
-                    break;
-                }
+            case TOKEN_UINT: {
+                elem_type = newIntType(a->module, 32, false);
+                break;
+            }
 
-                AstExpr *a = params.ptr[0];
-                if (!a->type) break;
+            default: assert(0); break;
+            }
 
-                if (a->type->kind != TYPE_MATRIX)
-                {
-                    ts__addErr(compiler, &expr->loc, "transpose operates on matrices");
-                    break;
-                }
+            assert(elem_type);
 
-                AstType *elem_type = a->type->matrix.col_type->vector.elem_type;
-                uint32_t col_count = a->type->matrix.col_count;
-                uint32_t row_count = a->type->matrix.col_type->vector.size;
+            ts__exprInfoEdit(compiler, expr)->as_type = newVectorType(
+                a->module, elem_type, (uint32_t)expr->primary.token->vector_type.dim);
+            expr->type = newBasicType(a->module, TYPE_TYPE);
+            break;
+        }
 
-                AstType *col_type = newVectorType(m, elem_type, col_count);
-                expr->type = newMatrixType(m, col_type, row_count);
+        case TOKEN_MATRIX_TYPE: {
+            AstType *elem_type = NULL;
 
+            switch (expr->primary.token->matrix_type.elem_type)
+            {
+            case TOKEN_FLOAT: {
+                elem_type = newFloatType(a->module, 32);
                 break;
             }
 
-            case AST_BUILTIN_FUNC_DETERMINANT: {
-                if (param_count != 1)
-                {
-                    ts__addErr(compiler, &expr->loc, "determinant takes 1 parameter");
-                    break;
-                }
+            case TOKEN_INT: {
+                elem_type = newIntType(a->module, 32, true);
+                break;
+            }
 
-                AstExpr *a = params.ptr[0];
-                if (!a->type) break;
+            case TOKEN_UINT: {
+                elem_type = newIntType(a->module, 32, false);
+                break;
+            }
 
-                if (a->type->kind != TYPE_MATRIX)
-                {
-                    ts__addErr(compiler, &expr->loc, "determinant operates on matrices");
-                    break;
-                }
+            default: assert(0); break;
+            }
 
-                AstType *elem_type = a->type->matrix.col_type->vector.elem_type;
-                uint32_t col_count = a->type->matrix.col_count;
-                uint32_t row_count = a->type->matrix.col_type->vector.size;
+            assert(elem_type);
 
-                expr->type = elem_type;
+            AstType *col_type = newVectorType(
+                a->module, elem_type, (uint32_t)expr->primary.token->matrix_type.dim1);
+            ts__exprInfoEdit(compiler, expr)->as_type = newMatrixType(
+                a->module, col_type, (uint32_t)expr->primary.token->matrix_type.dim2);
+            expr->type = newBasicType(a->module, TYPE_TYPE);
+            break;
+        }
 
-                if (col_count != row_count)
+        case TOKEN_FALSE:
+        case TOKEN_TRUE: {
+            expr->type = newBasicType(a->module, TYPE_BOOL);
+            break;
+        }
+
+        case TOKEN_FLOAT_LIT: {
+            if (expected_type)
+            {
+                if ((expected_type->kind == TYPE_FLOAT) || (expected_type->kind == TYPE_BOOL))
                 {
-                    ts__addErr(
-                        compiler, &expr->loc, "determinant operates on square matrices");
-                    break;
+                    expr->type = expected_type;
                 }
-
-                break;
             }
+            
+            if (!expr->type)
+            {
+                expr->type = newFloatType(a->module, 32);
+            }
+            break;
+        }
 
-            case AST_BUILTIN_FUNC_DDX:
-            case AST_BUILTIN_FUNC_DDY: {
-                if (param_count != 1)
+        case TOKEN_INT_LIT: {
+            if (expected_type)
+            {
+                if ((expected_type->kind == TYPE_INT) ||
+                    (expected_type->kind == TYPE_FLOAT) ||
+                    (expected_type->kind == TYPE_BOOL))
                 {
-                    ts__addErr(compiler, &expr->loc, "ddx/ddy call needs 1 parameter");
-                    break;
+                    expr->type = expected_type;
                 }
+            }
 
-                tryCoerceExprToScalarType(a, params.ptr[0], newFloatType(m, 32));
+            if (!expr->type)
+            {
+                expr->type = newIntType(a->module, 32, true);
+            }
 
-                AstExpr *a = params.ptr[0];
-                if (!a->type) break;
+            expr->has_resolved_int = true;
+            ts__exprInfoEdit(compiler, expr)->resolved_int = expr->primary.token->int_;
 
-                if (a->type->kind != TYPE_FLOAT)
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "ddx/ddy call needs a float parameter");
-                    break;
-                }
+            break;
+        }
 
-                expr->type = a->type;
+        default: assert(0); break;
+        }
+        break;
+    }
 
-                break;
-            }
+    case EXPR_VAR_ASSIGN: {
+        AstExpr *assigned_expr = ts__expr(compiler, expr->var_assign.assigned_expr);
 
-            case AST_BUILTIN_FUNC_ASFLOAT:
-            case AST_BUILTIN_FUNC_ASINT:
-            case AST_BUILTIN_FUNC_ASUINT: {
-                if (param_count != 1)
-                {
-                    ts__addErr(compiler, &expr->loc, "bitcast needs 1 parameter");
-                    break;
-                }
+        analyzerAnalyzeExpr(a, assigned_expr->id, NULL);
+        if (!assigned_expr->type)
+        {
+            ts__addErrAt(
+                compiler,
+                assigned_expr->loc,
+                "could not resolve type for expression");
+            break;
+        }
 
-                AstExpr *a = params.ptr[0];
-                if (!a->type) break;
+        expr->type = assigned_expr->type;
 
-                uint32_t dim = 0;
-                if (a->type->kind == TYPE_VECTOR)
-                {
-                    dim = a->type->vector.size;
-                }
+        if (!assigned_expr->assignable)
+        {
+            AstDecl *assigned_decl = NULL;
+            if (assigned_expr->kind == EXPR_IDENT)
+            {
+                assigned_decl = ts__decl(compiler, assigned_expr->ident.decl);
+            }
 
-                AstType *scalar_type = ts__getScalarType(a->type);
-                if (!scalar_type)
-                {
-                    ts__addErr(
-                        compiler, &expr->loc, "bitcast needs a scalar/vector parameter");
-                    break;
-                }
+            if (assigned_decl && assigned_decl->kind == DECL_VAR &&
+                assigned_decl->var.immutable)
+            {
+                ts__addErrAt(
+                    compiler,
+                    assigned_expr->loc,
+                    "assigned variable is constant: '%s'",
+                    assigned_expr->ident.name);
+            }
+            else
+            {
+                ts__addErrAt(
+                    compiler,
+                    assigned_expr->loc,
+                    "expression is not assignable");
+            }
+        }
 
-                switch (builtin_func_kind)
-                {
-                case AST_BUILTIN_FUNC_ASFLOAT: {
-                    expr->type = newFloatType(m, 32);
-                    break;
-                }
-                case AST_BUILTIN_FUNC_ASINT: {
-                    expr->type = newIntType(m, 32, true);
-                    break;
-                }
-                case AST_BUILTIN_FUNC_ASUINT: {
-                    expr->type = newIntType(m, 32, false);
-                    break;
-                }
-                default: assert(0); break;
-                }
+        analyzerAnalyzeExpr(a, expr->var_assign.value_expr, assigned_expr->type);
+        break;
+    }
 
-                if (dim > 0)
-                {
-                    expr->type = newVectorType(m, expr->type, dim);
-                }
+    case EXPR_IDENT: {
+        AstDecl *decl = NULL;
+        if (a->member_scope)
+        {
+            decl = scopeGetLocal(a->member_scope, expr->ident.name);
+        }
+        else
+        {
+            Symbol *sym =
+                symbolTableGetAbove(&a->symbols, expr->ident.name, a->symbol_min_depth);
+            if (sym) decl = sym->decl;
+        }
+
+        if (!decl)
+        {
+            ts__addErrAt(
+                compiler, expr->loc, "unknown identifier: '%s'", expr->ident.name);
+            break;
+        }
 
+        if (isTemplate(compiler, decl))
+        {
+            if (decl->kind == DECL_FUNC)
+            {
+                ts__addErrAt(
+                    compiler,
+                    expr->loc,
+                    "function template '%s' can only be called",
+                    expr->ident.name);
                 break;
             }
 
-            case AST_BUILTIN_FUNC_INTERLOCKED_OR:
-            case AST_BUILTIN_FUNC_INTERLOCKED_XOR:
-            case AST_BUILTIN_FUNC_INTERLOCKED_MIN:
-            case AST_BUILTIN_FUNC_INTERLOCKED_MAX:
-            case AST_BUILTIN_FUNC_INTERLOCKED_AND:
-            case AST_BUILTIN_FUNC_INTERLOCKED_ADD: {
-                expr->type = newBasicType(m, TYPE_VOID);
+            uint32_t param_count = (uint32_t)decl->template_params.len;
+            if (expr->ident.template_arg_count != param_count)
+            {
+                ts__addErrAt(
+                    compiler,
+                    expr->loc,
+                    "'%s' takes %u template argument%s",
+                    expr->ident.name,
+                    param_count,
+                    param_count == 1 ? "" : "s");
+                break;
+            }
 
-                if (param_count != 2)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked function requires 2 parameters");
-                    break;
-                }
+            AstType **args = analyzerTemplateArgs(a, expr);
+            if (!args) break;
 
-                if (!params.ptr[0]->type || !params.ptr[1]->type) break;
+            decl = analyzerInstantiate(a, decl, args, expr->loc);
+            if (!decl) break;
+        }
+        else if (expr->ident.template_arg_count > 0)
+        {
+            ts__addErrAt(compiler, expr->loc, "'%s' is not a template", expr->ident.name);
+            break;
+        }
 
-                tryCoerceExprToScalarType(a, params.ptr[1], params.ptr[0]->type);
+        if (decl->kind == DECL_FUNC)
+        {
+            analyzerMarkReachable(a, decl);
+        }
 
-                if (params.ptr[0]->type != params.ptr[1]->type)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "mismatched types for Interlocked function parameters");
-                    break;
-                }
+        if (decl->kind == DECL_VAR)
+        {
+            expr->assignable = !decl->var.immutable;
+        }
 
-                if (params.ptr[0]->type->kind != TYPE_INT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked function requires scalar integer parameters");
-                    break;
-                }
+        expr->ident.decl = decl->id;
 
-                if ((params.ptr[0]->kind != EXPR_IDENT) || (!params.ptr[0]->ident.decl) ||
-                    (params.ptr[0]->ident.decl->kind != DECL_VAR) ||
-                    (params.ptr[0]->ident.decl->var.kind != VAR_GROUPSHARED))
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked functions require first parameter to be a "
-                        "groupshared "
-                        "variable");
-                    break;
-                }
+        expr->type = decl->type;
+        expr->has_resolved_int = decl->has_resolved_int;
+        if (decl->info || expr->info)
+        {
+            const AstDeclInfo *decl_info = ts__declInfo(compiler, decl);
+            AstExprInfo *info = ts__exprInfoEdit(compiler, expr);
+            info->as_type = decl_info->as_type;
+            info->scope = decl_info->scope;
+            info->resolved_int = decl_info->resolved_int;
+        }
+        break;
+    }
+
+    case EXPR_SUBSCRIPT: {
+        AstExpr *left = ts__expr(compiler, expr->subscript.left);
+        analyzerAnalyzeExpr(a, left->id, NULL);
+
+        AstExpr *right = ts__expr(compiler, expr->subscript.right);
+        analyzerAnalyzeExpr(a, right->id, NULL);
+
+        // The index is checked below, before the enclosing expression gets folded
+        analyzerFoldExpr(a, right);
+
+        if (!left->type || !right->type) break;
 
+        switch (left->type->kind)
+        {
+        case TYPE_STRUCTURED_BUFFER: {
+            expr->assignable = false;
+            expr->type = left->type->buffer.sub;
+            break;
+        }
+        case TYPE_RW_STRUCTURED_BUFFER: {
+            expr->assignable = true;
+            expr->type = left->type->buffer.sub;
+            break;
+        }
+        case TYPE_VECTOR: {
+            expr->assignable = left->assignable;
+            expr->type = left->type->vector.elem_type;
+            if (!right->has_resolved_int)
+            {
+                ts__addErrAt(compiler, right->loc, "index is not an integer constant");
+            }
+            else if (ts__exprInfo(compiler, right)->resolved_int >=
+                     left->type->vector.size)
+            {
+                ts__addErrAt(compiler, right->loc, "index is out of bounds");
+            }
+            break;
+        }
+        case TYPE_MATRIX: {
+            expr->assignable = left->assignable;
+            expr->type = left->type->matrix.col_type;
+            if (!right->has_resolved_int)
+            {
+                ts__addErrAt(compiler, right->loc, "index is not an integer constant");
+            }
+            else if (ts__exprInfo(compiler, right)->resolved_int >=
+                     left->type->matrix.col_count)
+            {
+                ts__addErrAt(compiler, right->loc, "index is out of bounds");
+            }
+            break;
+        }
+        default: {
+            ts__addErrAt(compiler, left->loc, "expression is not subscriptable");
+            break;
+        }
+        }
+
+        AstType *struct_type = ts__getStructType(expr->type);
+        if (struct_type)
+        {
+            ts__exprInfoEdit(compiler, expr)->scope = NEW(compiler, Scope);
+            scopeInit(compiler, ts__exprInfo(compiler, expr)->scope);
+            for (uint32_t i = 0; i < struct_type->struct_.field_count; ++i)
+            {
+                AstDecl *field_decl = struct_type->struct_.field_decls[i];
+                scopeAdd(
+                    ts__exprInfo(compiler, expr)->scope, field_decl->name, field_decl);
+            }
+        }
+
+        if (right->type->kind != TYPE_INT)
+        {
+            ts__addErrAt(compiler, right->loc, "subscript index must be of integer type");
+            break;
+        }
+
+        break;
+    }
+
+    case EXPR_ACCESS: {
+        AstExpr *left = ts__expr(compiler, expr->access.base);
+        analyzerAnalyzeExpr(a, left->id, NULL);
+
+        assert(arrLength(expr->access.chain) > 0);
+
+        for (uint32_t i = 0; i < arrLength(expr->access.chain); ++i)
+        {
+            AstExpr *right = ts__expr(compiler, expr->access.chain.ptr[i]);
+
+            if (!left->type)
+            {
+                assert(arrLength(compiler->errors) > 0);
                 break;
             }
 
-            case AST_BUILTIN_FUNC_INTERLOCKED_EXCHANGE: {
-                expr->type = newBasicType(m, TYPE_VOID);
-
-                if (param_count != 3)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked function requires 3 parameters");
-                    break;
-                }
-
-                if (!params.ptr[0]->type || !params.ptr[1]->type || !params.ptr[2]->type)
-                    break;
+            AstType *struct_type = ts__getStructType(left->type);
 
-                tryCoerceExprToScalarType(a, params.ptr[1], params.ptr[0]->type);
+            if (struct_type)
+            {
+                assert(ts__exprInfo(compiler, left)->scope);
 
-                if (params.ptr[0]->type != params.ptr[1]->type ||
-                    params.ptr[0]->type != params.ptr[2]->type)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "mismatched types for Interlocked function parameters");
-                    break;
-                }
+                Scope *prev_member_scope = a->member_scope;
+                a->member_scope = ts__exprInfo(compiler, left)->scope;
+                analyzerAnalyzeExpr(a, right->id, NULL);
+                a->member_scope = prev_member_scope;
+            }
+            else if (left->type->kind == TYPE_VECTOR)
+            {
+                assert(right->kind == EXPR_IDENT);
 
-                if (params.ptr[0]->type->kind != TYPE_INT)
+                char *selector = right->ident.name;
+                size_t new_vec_dim = strlen(selector);
+                if (new_vec_dim > 4)
                 {
-                    ts__addErr(
+                    ts__addErrAt(
                         compiler,
-                        &expr->loc,
-                        "Interlocked function requires scalar integer parameters");
+                        right->loc,
+                        "vector shuffle must select at most 4 elements");
                     break;
                 }
 
-                if ((params.ptr[0]->kind != EXPR_IDENT) || (!params.ptr[0]->ident.decl) ||
-                    (params.ptr[0]->ident.decl->kind != DECL_VAR) ||
-                    (params.ptr[0]->ident.decl->var.kind != VAR_GROUPSHARED))
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked functions require first parameter to be a "
-                        "groupshared "
-                        "variable");
-                    break;
-                }
+                uint32_t *positions = NEW_ARRAY(compiler, uint32_t, new_vec_dim);
 
-                if (!params.ptr[2]->assignable)
+                for (uint32_t j = 0; j < new_vec_dim; ++j)
                 {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked function requires third parameter to be assignable");
-                    break;
-                }
+                    bool valid = true;
+                    switch (selector[j])
+                    {
+                    case 'r':
+                    case 'x': positions[j] = 0; break;
+                    case 'g':
+                    case 'y': positions[j] = 1; break;
+                    case 'b':
+                    case 'z': positions[j] = 2; break;
+                    case 'a':
+                    case 'w': positions[j] = 3; break;
 
-                break;
-            }
+                    default:
+                        ts__addErrAt(
+                            compiler,
+                            right->loc,
+                            "invalid vector shuffle: '%s'",
+                            selector);
+                        valid = false;
+                        break;
+                    }
 
-            case AST_BUILTIN_FUNC_INTERLOCKED_COMPARE_EXCHANGE: {
-                expr->type = newBasicType(m, TYPE_VOID);
+                    if (positions[j] >= left->type->vector.size)
+                    {
+                        ts__addErrAt(
+                            compiler,
+                            right->loc,
+                            "invalid vector shuffle: '%s'",
+                            selector);
+                        valid = false;
+                        break;
+                    }
 
-                if (param_count != 4)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked function requires 4 parameters");
-                    break;
+                    if (!valid) break;
                 }
 
-                if (!params.ptr[0]->type || !params.ptr[1]->type ||
-                    !params.ptr[2]->type || !params.ptr[3]->type)
-                    break;
-
-                tryCoerceExprToScalarType(a, params.ptr[1], params.ptr[0]->type);
-                tryCoerceExprToScalarType(a, params.ptr[2], params.ptr[0]->type);
+                ts__exprInfoEdit(compiler, right)->shuffle_indices = positions;
+                ts__exprInfoEdit(compiler, right)->shuffle_index_count =
+                    (uint32_t)new_vec_dim;
 
-                if (params.ptr[0]->type != params.ptr[1]->type ||
-                    params.ptr[0]->type != params.ptr[2]->type ||
-                    params.ptr[0]->type != params.ptr[3]->type)
+                if (new_vec_dim == 1)
                 {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "mismatched types for Interlocked function parameters");
-                    break;
+                    right->type = left->type->vector.elem_type;
                 }
-
-                if (params.ptr[0]->type->kind != TYPE_INT)
+                else
                 {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked function requires scalar integer parameters");
-                    break;
+                    right->type = newVectorType(
+                        m, left->type->vector.elem_type, (uint32_t)new_vec_dim);
                 }
+            }
+            else
+            {
+                ts__addErrAt(compiler, left->loc, "expression is not accessible");
+                break;
+            }
 
-                if ((params.ptr[0]->kind != EXPR_IDENT) || (!params.ptr[0]->ident.decl) ||
-                    (params.ptr[0]->ident.decl->kind != DECL_VAR) ||
-                    (params.ptr[0]->ident.decl->var.kind != VAR_GROUPSHARED))
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked functions require first parameter to be a "
-                        "groupshared "
-                        "variable");
-                    break;
-                }
+            if (i == (arrLength(expr->access.chain) - 1))
+            {
+                expr->type = right->type;
+                ts__exprInfoEdit(compiler, expr)->as_type =
+                    ts__exprInfo(compiler, right)->as_type;
+                ts__exprInfoEdit(compiler, expr)->scope =
+                    ts__exprInfo(compiler, right)->scope;
+                expr->has_resolved_int = right->has_resolved_int;
+                ts__exprInfoEdit(compiler, expr)->resolved_int =
+                    ts__exprInfo(compiler, right)->resolved_int;
+            }
 
-                if (!params.ptr[3]->assignable)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked function requires fourth parameter to be "
-                        "assignable");
-                    break;
-                }
+            left = right;
+        }
 
-                break;
-            }
+        expr->assignable = ts__expr(compiler, expr->access.base)->assignable;
 
-            case AST_BUILTIN_FUNC_INTERLOCKED_COMPARE_STORE: {
-                expr->type = newBasicType(m, TYPE_VOID);
+        break;
+    }
 
-                if (param_count != 3)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked function requires 3 parameters");
-                    break;
-                }
+    case EXPR_FUNC_CALL: {
+        AstExpr *func_expr = ts__expr(compiler, expr->func_call.func_expr);
 
-                if (!params.ptr[0]->type || !params.ptr[1]->type || !params.ptr[2]->type)
-                    break;
+        const AstBuiltinSignature *builtin_sig = NULL;
 
-                tryCoerceExprToScalarType(a, params.ptr[1], params.ptr[0]->type);
-                tryCoerceExprToScalarType(a, params.ptr[2], params.ptr[0]->type);
+        // Builtin function
+        if (func_expr->kind == EXPR_IDENT)
+        {
+            void *result;
+            if (ts__hashGet(
+                    &compiler->builtin_function_table, func_expr->ident.name, &result))
+            {
+                builtin_sig = result;
+            }
+        }
 
-                if (params.ptr[0]->type != params.ptr[1]->type ||
-                    params.ptr[0]->type != params.ptr[2]->type)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "mismatched types for Interlocked function parameters");
-                    break;
-                }
+        if (builtin_sig)
+        {
+            uint32_t param_count = arrLength(expr->func_call.params);
+            AstExprList params = expr->func_call.params;
 
-                if (params.ptr[0]->type->kind != TYPE_INT)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked function requires scalar integer parameters");
-                    break;
-                }
+            bool got_param_types = true;
 
-                if ((params.ptr[0]->kind != EXPR_IDENT) || (!params.ptr[0]->ident.decl) ||
-                    (params.ptr[0]->ident.decl->kind != DECL_VAR) ||
-                    (params.ptr[0]->ident.decl->var.kind != VAR_GROUPSHARED))
+            for (uint32_t i = 0; i < param_count; ++i)
+            {
+                AstExpr *param = ts__expr(compiler, params.ptr[i]);
+                analyzerAnalyzeExpr(a, param->id, NULL);
+                if (!param->type)
                 {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "Interlocked functions require first parameter to be a "
-                        "groupshared "
-                        "variable");
-                    break;
+                    got_param_types = false;
+                    continue;
                 }
-
-                break;
             }
 
-            case AST_BUILTIN_FUNC_ALL_MEMORY_BARRIER:
-            case AST_BUILTIN_FUNC_ALL_MEMORY_BARRIER_WITH_GROUP_SYNC:
-            case AST_BUILTIN_FUNC_DEVICE_MEMORY_BARRIER:
-            case AST_BUILTIN_FUNC_DEVICE_MEMORY_BARRIER_WITH_GROUP_SYNC:
-            case AST_BUILTIN_FUNC_GROUP_MEMORY_BARRIER:
-            case AST_BUILTIN_FUNC_GROUP_MEMORY_BARRIER_WITH_GROUP_SYNC: {
-                expr->type = newBasicType(m, TYPE_VOID);
+            if (!got_param_types) break;
 
-                if (param_count != 0)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "barrier functions require 0 parameters");
-                    break;
-                }
+            analyzerAnalyzeBuiltinCall(a, expr, builtin_sig, expected_type);
+            break;
+        }
 
+        // Overloaded function or function template
+        if (func_expr->kind == EXPR_IDENT && !a->member_scope)
+        {
+            Symbol *sym =
+                symbolTableGetAbove(&a->symbols, func_expr->ident.name, a->symbol_min_depth);
+            if (sym && sym->decl->kind == DECL_FUNC &&
+                (sym->decl->func.overload || isTemplate(compiler, sym->decl)))
+            {
+                analyzerAnalyzeOverloadedCall(a, expr, sym->decl);
                 break;
             }
-            }
-
-            break;
         }
 
         // Builtin method call
         if (func_expr->kind == EXPR_ACCESS)
         {
-            AstExpr *method_name_expr =
-                func_expr->access.chain.ptr[arrLength(func_expr->access.chain) - 1];
+            AstExprList chain = func_expr->access.chain;
+            AstExpr *method_name_expr = ts__expr(compiler, chain.ptr[chain.len - 1]);
             assert(method_name_expr->kind == EXPR_IDENT);
             char *method_name = method_name_expr->ident.name;
 
@@ -2769,14 +3914,14 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
 
             if (arrLength(func_expr->access.chain) == 0)
             {
-                func_expr = func_expr->access.base;
+                func_expr = ts__expr(compiler, func_expr->access.base);
             }
 
-            expr->func_call.self_param = func_expr;
-            expr->func_call.func_expr = method_name_expr;
+            expr->func_call.self_param = func_expr->id;
+            expr->func_call.func_expr = method_name_expr->id;
 
             analyzerAnalyzeExpr(a, expr->func_call.self_param, NULL);
-            AstType *self_type = expr->func_call.self_param->type;
+            AstType *self_type = ts__expr(compiler, expr->func_call.self_param)->type;
             if (!self_type)
             {
                 break;
@@ -2811,17 +3956,17 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
 
                 if (func_param_count != arrLength(expr->func_call.params))
                 {
-                    ts__addErr(
+                    ts__addErrAt(
                         compiler,
-                        &expr->loc,
+                        expr->loc,
                         "wrong amount of parameters for function call");
                     break;
                 }
 
                 for (uint32_t i = 0; i < arrLength(expr->func_call.params); ++i)
                 {
-                    AstExpr *param = expr->func_call.params.ptr[i];
-                    analyzerAnalyzeExpr(a, param, func_param_types[i]);
+                    AstExpr *param = ts__expr(compiler, expr->func_call.params.ptr[i]);
+                    analyzerAnalyzeExpr(a, param->id, func_param_types[i]);
                 }
 
                 expr->type = texture_component_type;
@@ -2858,17 +4003,17 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
 
                 if (func_param_count != arrLength(expr->func_call.params))
                 {
-                    ts__addErr(
+                    ts__addErrAt(
                         compiler,
-                        &expr->loc,
+                        expr->loc,
                         "wrong amount of parameters for function call");
                     break;
                 }
 
                 for (uint32_t i = 0; i < arrLength(expr->func_call.params); ++i)
                 {
-                    AstExpr *param = expr->func_call.params.ptr[i];
-                    analyzerAnalyzeExpr(a, param, func_param_types[i]);
+                    AstExpr *param = ts__expr(compiler, expr->func_call.params.ptr[i]);
+                    analyzerAnalyzeExpr(a, param->id, func_param_types[i]);
                 }
 
                 expr->type = texture_component_type;
@@ -2929,30 +4074,30 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
 
                 if (func_param_count != arrLength(expr->func_call.params))
                 {
-                    ts__addErr(
+                    ts__addErrAt(
                         compiler,
-                        &expr->loc,
+                        expr->loc,
                         "wrong amount of parameters for function call");
                     break;
                 }
 
                 for (uint32_t i = 0; i < arrLength(expr->func_call.params); ++i)
                 {
-                    AstExpr *param = expr->func_call.params.ptr[i];
-                    analyzerAnalyzeExpr(a, param, func_param_types[i]);
+                    AstExpr *param = ts__expr(compiler, expr->func_call.params.ptr[i]);
+                    analyzerAnalyzeExpr(a, param->id, func_param_types[i]);
                 }
 
                 expr->type = newBasicType(m, TYPE_VOID);
             }
             else
             {
-                ts__addErr(compiler, &expr->loc, "invalid method call");
+                ts__addErrAt(compiler, expr->loc, "invalid method call");
             }
 
             break;
         }
 
-        analyzerAnalyzeExpr(a, func_expr, NULL);
+        analyzerAnalyzeExpr(a, func_expr->id, NULL);
         AstType *func_type = func_expr->type;
         if (!func_type)
         {
@@ -2963,13 +4108,13 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
         {
             // Type constructor
 
-            AstType *constructed_type = func_expr->as_type;
+            AstType *constructed_type = ts__exprInfo(compiler, func_expr)->as_type;
             assert(constructed_type);
 
             expr->type = constructed_type;
 
             uint32_t param_count = arrLength(expr->func_call.params);
-            ArrayOfAstExprPtr params = expr->func_call.params;
+            AstExprList params = expr->func_call.params;
 
             AstType *wanted_elem_type = NULL;
             uint32_t wanted_elem_count = 0;
@@ -2980,43 +4125,44 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
                 wanted_elem_count = constructed_type->vector.size;
                 wanted_elem_type = constructed_type->vector.elem_type;
 
-                if (!a->scope_func)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "composite constructor needs to be inside a function");
-                    break;
-                }
-
                 uint32_t elem_count = 0;
 
                 for (uint32_t i = 0; i < param_count; ++i)
                 {
                     analyzerAnalyzeExpr(a, params.ptr[i], NULL);
-                    tryCoerceExprToScalarType(a, params.ptr[i], wanted_elem_type);
-                    if (!params.ptr[i]->type) continue;
+                    AstExpr *param = ts__expr(compiler, params.ptr[i]);
+                    tryCoerceExprToScalarType(a, param, wanted_elem_type);
+                    if (!param->type) continue;
 
-                    if (ts__getScalarType(params.ptr[i]->type) != wanted_elem_type)
+                    if (ts__getScalarType(param->type) != wanted_elem_type)
                     {
-                        ts__addErr(
+                        ts__addErrAt(
                             compiler,
-                            &params.ptr[i]->loc,
+                            param->loc,
                             "invalid composite constructor element type");
                     }
 
-                    elem_count += ts__getTypeElemCount(params.ptr[i]->type);
+                    elem_count += ts__getTypeElemCount(param->type);
                 }
 
                 if (elem_count != wanted_elem_count)
                 {
-                    ts__addErr(
+                    ts__addErrAt(
                         compiler,
-                        &expr->loc,
+                        expr->loc,
                         "invalid composite constructor element count");
                     break;
                 }
 
+                if (!a->scope_func && !analyzerFoldParams(a, params))
+                {
+                    ts__addErrAt(
+                        compiler,
+                        expr->loc,
+                        "composite constructor outside of a function needs constant "
+                        "parameters");
+                }
+
                 break;
             }
             case TYPE_MATRIX: {
@@ -3026,20 +4172,11 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
                     constructed_type->matrix.col_count * col_type->vector.size;
                 wanted_elem_type = col_type->vector.elem_type;
 
-                if (!a->scope_func)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "composite constructor needs to be inside a function");
-                    break;
-                }
-
                 if (param_count != wanted_elem_count)
                 {
-                    ts__addErr(
+                    ts__addErrAt(
                         compiler,
-                        &expr->loc,
+                        expr->loc,
                         "invalid composite constructor parameter count");
                     break;
                 }
@@ -3048,6 +4185,15 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
                 {
                     analyzerAnalyzeExpr(a, params.ptr[i], wanted_elem_type);
                 }
+
+                if (!a->scope_func && !analyzerFoldParams(a, params))
+                {
+                    ts__addErrAt(
+                        compiler,
+                        expr->loc,
+                        "composite constructor outside of a function needs constant "
+                        "parameters");
+                }
                 break;
             }
             case TYPE_INT:
@@ -3057,26 +4203,27 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
 
                 if (param_count != wanted_elem_count)
                 {
-                    ts__addErr(
+                    ts__addErrAt(
                         compiler,
-                        &expr->loc,
+                        expr->loc,
                         "invalid composite constructor parameter count");
                     break;
                 }
 
                 analyzerAnalyzeExpr(a, params.ptr[0], NULL);
+                AstExpr *param = ts__expr(compiler, params.ptr[0]);
 
-                if (!params.ptr[0]->type)
+                if (!param->type)
                 {
                     assert(compiler->errors.len > 0);
                     break;
                 }
 
-                if (!isTypeCastable(params.ptr[0]->type, wanted_elem_type))
+                if (!isTypeCastable(param->type, wanted_elem_type))
                 {
-                    ts__addErr(
+                    ts__addErrAt(
                         compiler,
-                        &params.ptr[0]->loc,
+                        param->loc,
                         "value is not castable to this type");
                     break;
                 }
@@ -3084,7 +4231,7 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
                 break;
             }
             default: {
-                ts__addErr(compiler, &expr->loc, "invalid constructor");
+                ts__addErrAt(compiler, expr->loc, "invalid constructor");
                 break;
             }
             }
@@ -3095,29 +4242,29 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
 
             if (func_type->func.param_count != arrLength(expr->func_call.params))
             {
-                ts__addErr(
-                    compiler, &expr->loc, "wrong amount of parameters for function call");
+                ts__addErrAt(
+                    compiler, expr->loc, "wrong amount of parameters for function call");
                 break;
             }
 
             for (uint32_t i = 0; i < func_type->func.param_count; ++i)
             {
-                AstExpr *param = expr->func_call.params.ptr[i];
+                AstExpr *param = ts__expr(compiler, expr->func_call.params.ptr[i]);
                 AstType *param_expected = func_type->func.params[i];
                 if (param_expected->kind == TYPE_POINTER)
                 {
                     param_expected = param_expected->ptr.sub;
                 }
-                analyzerAnalyzeExpr(a, param, param_expected);
+                analyzerAnalyzeExpr(a, param->id, param_expected);
             }
 
             expr->type = func_type->func.return_type;
         }
         else
         {
-            ts__addErr(
+            ts__addErrAt(
                 compiler,
-                &expr->func_call.func_expr->loc,
+                ts__expr(compiler, expr->func_call.func_expr)->loc,
                 "expression does not represent a function");
         }
 
@@ -3126,7 +4273,7 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
 
     case EXPR_SAMPLER_TYPE: {
         expr->type = newBasicType(m, TYPE_TYPE);
-        expr->as_type = newBasicType(m, TYPE_SAMPLER);
+        ts__exprInfoEdit(compiler, expr)->as_type = newBasicType(m, TYPE_SAMPLER);
         break;
     }
 
@@ -3137,9 +4284,10 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
         if (expr->texture.sampled_type_expr)
         {
             analyzerAnalyzeExpr(a, expr->texture.sampled_type_expr, type_type);
-            if (!expr->texture.sampled_type_expr->type) break;
+            AstExpr *type_expr = ts__expr(compiler, expr->texture.sampled_type_expr);
+            if (!type_expr->type) break;
 
-            sampled_type = expr->texture.sampled_type_expr->as_type;
+            sampled_type = ts__exprInfo(compiler, type_expr)->as_type;
         }
         else
         {
@@ -3151,13 +4299,14 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
         if (!(sampled_type->kind == TYPE_VECTOR || sampled_type->kind == TYPE_INT ||
               sampled_type->kind == TYPE_FLOAT))
         {
-            ts__addErr(
-                compiler, &expr->loc, "invalid scalar type for sampled type for texture");
+            ts__addErrAt(
+                compiler, expr->loc, "invalid scalar type for sampled type for texture");
             break;
         }
 
         expr->type = type_type;
-        expr->as_type = newImageType(m, sampled_type, expr->texture.dim);
+        ts__exprInfoEdit(compiler, expr)->as_type =
+            newImageType(m, sampled_type, expr->texture.dim);
         break;
     }
 
@@ -3167,13 +4316,14 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
         AstType *type_type = newBasicType(m, TYPE_TYPE);
 
         analyzerAnalyzeExpr(a, expr->buffer.sub_expr, type_type);
-        if (!expr->buffer.sub_expr->type) break;
+        AstExpr *sub_expr = ts__expr(compiler, expr->buffer.sub_expr);
+        if (!sub_expr->type) break;
 
-        AstType *subtype = expr->buffer.sub_expr->as_type;
+        AstType *subtype = ts__exprInfo(compiler, sub_expr)->as_type;
         assert(subtype);
 
         expr->type = type_type;
-        expr->as_type = newConstantBufferType(m, subtype);
+        ts__exprInfoEdit(compiler, expr)->as_type = newConstantBufferType(m, subtype);
         break;
     }
 
@@ -3183,13 +4333,14 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
         AstType *type_type = newBasicType(m, TYPE_TYPE);
 
         analyzerAnalyzeExpr(a, expr->buffer.sub_expr, type_type);
-        if (!expr->buffer.sub_expr->type) break;
+        AstExpr *sub_expr = ts__expr(compiler, expr->buffer.sub_expr);
+        if (!sub_expr->type) break;
 
-        AstType *subtype = expr->buffer.sub_expr->as_type;
+        AstType *subtype = ts__exprInfo(compiler, sub_expr)->as_type;
         assert(subtype);
 
         expr->type = type_type;
-        expr->as_type = newStructuredBufferType(m, subtype);
+        ts__exprInfoEdit(compiler, expr)->as_type = newStructuredBufferType(m, subtype);
         break;
     }
 
@@ -3199,40 +4350,43 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
         AstType *type_type = newBasicType(m, TYPE_TYPE);
 
         analyzerAnalyzeExpr(a, expr->buffer.sub_expr, type_type);
-        if (!expr->buffer.sub_expr->type) break;
+        AstExpr *sub_expr = ts__expr(compiler, expr->buffer.sub_expr);
+        if (!sub_expr->type) break;
 
-        AstType *subtype = expr->buffer.sub_expr->as_type;
+        AstType *subtype = ts__exprInfo(compiler, sub_expr)->as_type;
         assert(subtype);
 
         expr->type = type_type;
-        expr->as_type = newRWStructuredBufferType(m, subtype);
+        ts__exprInfoEdit(compiler, expr)->as_type = newRWStructuredBufferType(m, subtype);
         break;
     }
 
     case EXPR_UNARY: {
+        AstExpr *right = ts__expr(compiler, expr->unary.right);
         switch (expr->unary.op)
         {
         case UNOP_NEG: {
             analyzerAnalyzeExpr(a, expr->unary.right, NULL);
-            if (!expr->unary.right->type) break;
-            AstType *right_type = expr->unary.right->type;
+            if (!right->type) break;
+            AstType *right_type = right->type;
             AstType *scalar_type = ts__getScalarType(right_type);
 
             if (!scalar_type)
             {
-                ts__addErr(
+                ts__addErrAt(
                     compiler,
-                    &expr->unary.right->loc,
+                    right->loc,
                     "\'negation\' expression does not work on this type");
                 break;
             }
 
             expr->type = right_type;
 
-            if (expr->unary.right->resolved_int)
+            if (right->has_resolved_int)
             {
-                expr->resolved_int = NEW(compiler, int64_t);
-                *expr->resolved_int = -(*expr->unary.right->resolved_int);
+                expr->has_resolved_int = true;
+                ts__exprInfoEdit(compiler, expr)->resolved_int =
+                    -ts__exprInfo(compiler, right)->resolved_int;
             }
 
             break;
@@ -3241,15 +4395,15 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
         case UNOP_POST_INC:
         case UNOP_PRE_INC: {
             analyzerAnalyzeExpr(a, expr->unary.right, NULL);
-            if (!expr->unary.right->type) break;
-            AstType *right_type = expr->unary.right->type;
+            if (!right->type) break;
+            AstType *right_type = right->type;
             AstType *scalar_type = ts__getScalarTypeNoVec(right_type);
 
             if (!scalar_type)
             {
-                ts__addErr(
+                ts__addErrAt(
                     compiler,
-                    &expr->unary.right->loc,
+                    right->loc,
                     "\'increment\' expression does not work on this type");
                 break;
             }
@@ -3262,15 +4416,15 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
         case UNOP_POST_DEC:
         case UNOP_PRE_DEC: {
             analyzerAnalyzeExpr(a, expr->unary.right, NULL);
-            if (!expr->unary.right->type) break;
-            AstType *right_type = expr->unary.right->type;
+            if (!right->type) break;
+            AstType *right_type = right->type;
             AstType *scalar_type = ts__getScalarTypeNoVec(right_type);
 
             if (!scalar_type)
             {
-                ts__addErr(
+                ts__addErrAt(
                     compiler,
-                    &expr->unary.right->loc,
+                    right->loc,
                     "\'decrement\' expression does not work on this type");
                 break;
             }
@@ -3282,15 +4436,15 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
 
         case UNOP_NOT: {
             analyzerAnalyzeExpr(a, expr->unary.right, NULL);
-            if (!expr->unary.right->type) break;
-            AstType *right_type = expr->unary.right->type;
+            if (!right->type) break;
+            AstType *right_type = right->type;
             AstType *logical_type = ts__getLogicalType(right_type);
 
             if (!logical_type)
             {
-                ts__addErr(
+                ts__addErrAt(
                     compiler,
-                    &expr->unary.right->loc,
+                    right->loc,
                     "\'not\' expression does not work on this type");
                 break;
             }
@@ -3302,14 +4456,14 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
 
         case UNOP_BITNOT: {
             analyzerAnalyzeExpr(a, expr->unary.right, NULL);
-            if (!expr->unary.right->type) break;
-            AstType *right_type = expr->unary.right->type;
+            if (!right->type) break;
+            AstType *right_type = right->type;
 
             if (right_type->kind != TYPE_INT)
             {
-                ts__addErr(
+                ts__addErrAt(
                     compiler,
-                    &expr->unary.right->loc,
+                    right->loc,
                     "\'bitwise not\' expression only works on integer types");
                 break;
             }
@@ -3324,214 +4478,37 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
     }
 
     case EXPR_BINARY: {
-        analyzerAnalyzeExpr(a, expr->binary.left, NULL);
-        analyzerAnalyzeExpr(a, expr->binary.right, NULL);
-
-        switch (expr->binary.op)
+        // Left operands are analyzed in a loop, machine generated chains like
+        // 'a + b + c + ...' are as deep as they are long
+        size_t base = a->binary_stack.len;
+        AstExpr *leaf = expr;
+        for (; leaf->kind == EXPR_BINARY; leaf = ts__expr(compiler, leaf->binary.left))
         {
-        case BINOP_ADD:
-        case BINOP_SUB:
-        case BINOP_MUL:
-        case BINOP_DIV:
-        case BINOP_MOD: {
-            if (!expr->binary.left->type || !expr->binary.right->type) break;
-
-            tryCoerceExprToScalarType(a, expr->binary.left, expected_type);
-            tryCoerceExprToScalarType(a, expr->binary.right, expected_type);
-
-            tryCoerceExprToScalarType(a, expr->binary.left, expr->binary.right->type);
-            tryCoerceExprToScalarType(a, expr->binary.right, expr->binary.left->type);
-
-            AstType *left_type = expr->binary.left->type;
-            AstType *right_type = expr->binary.right->type;
-
-            if (!left_type || !right_type)
-            {
-                ts__addErr(
-                    compiler,
-                    &expr->loc,
-                    "invalid types for binary arithmentic operation");
-                break;
-            }
-
-            AstType *left_scalar = ts__getScalarTypeNoVec(left_type);
-            AstType *right_scalar = ts__getScalarTypeNoVec(right_type);
-
-            if (left_type->kind == TYPE_VECTOR && right_type->kind == TYPE_VECTOR)
-            {
-                // Vector and vector
-                left_scalar = left_type->vector.elem_type;
-                right_scalar = right_type->vector.elem_type;
-                if (left_scalar != right_scalar ||
-                    left_type->vector.size != right_type->vector.size)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "invalid types for binary arithmentic operation: '%s' and '%s'",
-                        typeToPrettyString(compiler, left_type),
-                        typeToPrettyString(compiler, right_type));
-                    break;
-                }
-
-                expr->type = left_type;
-            }
-            else if (left_scalar && right_scalar)
-            {
-                // Scalar and scalar
-                if (left_scalar != right_scalar)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "invalid types for binary arithmentic operation: '%s' and '%s'",
-                        typeToPrettyString(compiler, left_type),
-                        typeToPrettyString(compiler, right_type));
-                    break;
-                }
-
-                expr->type = left_scalar;
-            }
-            else
-            {
-                // Vector and scalar
-                AstType *vector_type = NULL;
-                AstType *scalar_type = NULL;
-                if (left_type->kind == TYPE_VECTOR)
-                {
-                    assert(!vector_type);
-                    vector_type = left_type;
-                    scalar_type = right_type;
-                }
-                else if (right_type->kind == TYPE_VECTOR)
-                {
-                    assert(!vector_type);
-                    vector_type = right_type;
-                    scalar_type = left_type;
-                }
-                else
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "invalid types for binary arithmentic operation: '%s' and '%s'",
-                        typeToPrettyString(compiler, left_type),
-                        typeToPrettyString(compiler, right_type));
-                    break;
-                }
-
-                assert(vector_type);
-                assert(scalar_type);
-                assert(vector_type->kind == TYPE_VECTOR);
-                assert(scalar_type->kind != TYPE_VECTOR);
-
-                if (ts__getScalarType(vector_type) != scalar_type)
-                {
-                    ts__addErr(
-                        compiler,
-                        &expr->loc,
-                        "invalid types for binary arithmentic operation");
-                    break;
-                }
-
-                expr->type = vector_type;
-            }
-
-            assert(expr->type);
-
-            break;
-        }
-
-        case BINOP_EQ:
-        case BINOP_NOTEQ:
-        case BINOP_LESS:
-        case BINOP_LESSEQ:
-        case BINOP_GREATER:
-        case BINOP_GREATEREQ: {
-            if (!expr->binary.left->type || !expr->binary.right->type) break;
-
-            tryCoerceExprToScalarType(a, expr->binary.left, expr->binary.right->type);
-            tryCoerceExprToScalarType(a, expr->binary.right, expr->binary.left->type);
-
-            AstType *left_type = expr->binary.left->type;
-            AstType *right_type = expr->binary.right->type;
-
-            AstType *left_comparable = ts__getComparableType(left_type);
-            AstType *right_comparable = ts__getComparableType(right_type);
-
-            if ((!left_comparable) || (!right_comparable) || (left_type != right_type))
-            {
-                ts__addErr(
-                    compiler,
-                    &expr->loc,
-                    "invalid types for binary comparison operation");
-            }
-
-            expr->type = newBasicType(m, TYPE_BOOL);
-
-            break;
-        }
-
-        case BINOP_RSHIFT:
-        case BINOP_LSHIFT: {
-            if (!expr->binary.left->type || !expr->binary.right->type) break;
-
-            tryCoerceExprToScalarType(a, expr->binary.left, expr->binary.right->type);
-            tryCoerceExprToScalarType(a, expr->binary.right, expr->binary.left->type);
-
-            AstType *left_type = expr->binary.left->type;
-            AstType *right_type = expr->binary.right->type;
-
-            if (left_type->kind != TYPE_INT || right_type->kind != TYPE_INT)
-            {
-                ts__addErr(
-                    compiler,
-                    &expr->loc,
-                    "bitwise shift requires both operands to be integers");
-            }
-
-            expr->type = left_type;
-
-            break;
+            arrPush(compiler, &a->binary_stack, leaf);
         }
+        size_t top = a->binary_stack.len;
 
-        case BINOP_BITXOR:
-        case BINOP_BITOR:
-        case BINOP_BITAND: {
-            if (!expr->binary.left->type || !expr->binary.right->type) break;
-
-            tryCoerceExprToScalarType(a, expr->binary.left, expr->binary.right->type);
-            tryCoerceExprToScalarType(a, expr->binary.right, expr->binary.left->type);
-
-            AstType *left_type = expr->binary.left->type;
-            AstType *right_type = expr->binary.right->type;
+        for (size_t i = top; i-- > base;)
+        {
+            AstExpr *binary = a->binary_stack.ptr[i];
+            AstType *operand_type = binaryOperandType(m, binary);
 
-            if (left_type->kind != TYPE_INT || right_type->kind != TYPE_INT ||
-                left_type != right_type)
+            if (i + 1 == top)
             {
-                ts__addErr(
-                    compiler,
-                    &expr->loc,
-                    "bitwise logical operator requires both operands to be integers of "
-                    "equal type");
+                analyzerAnalyzeExpr(a, binary->binary.left, operand_type);
             }
+            else
+            {
+                AstExpr *left = ts__expr(compiler, binary->binary.left);
+                analyzerCheckExpectedType(a, left, operand_type);
+            }
+            analyzerAnalyzeExpr(a, binary->binary.right, operand_type);
 
-            expr->type = left_type;
-
-            break;
-        }
-
-        case BINOP_LOGICAL_AND:
-        case BINOP_LOGICAL_OR: {
-            AstType *bool_type = newBasicType(m, TYPE_BOOL);
-
-            analyzerAnalyzeExpr(a, expr->binary.left, bool_type);
-            analyzerAnalyzeExpr(a, expr->binary.right, bool_type);
-
-            expr->type = bool_type;
-            break;
-        }
+            AstType *binary_expected = expected_type;
+            if (i > base) binary_expected = binaryOperandType(m, a->binary_stack.ptr[i - 1]);
+            analyzerAnalyzeBinaryExpr(a, binary, binary_expected);
         }
+        a->binary_stack.len = base;
 
         break;
     }
@@ -3539,72 +4516,177 @@ static void analyzerAnalyzeExpr(Analyzer *a, AstExpr *expr, AstType *expected_ty
     case EXPR_TERNARY: {
         analyzerAnalyzeExpr(a, expr->ternary.cond, newBasicType(m, TYPE_BOOL));
         analyzerAnalyzeExpr(a, expr->ternary.true_expr, expected_type);
-        analyzerAnalyzeExpr(a, expr->ternary.false_expr, expr->ternary.true_expr->type);
+        AstType *true_type = ts__expr(compiler, expr->ternary.true_expr)->type;
+        analyzerAnalyzeExpr(a, expr->ternary.false_expr, true_type);
 
-        expr->type = expr->ternary.true_expr->type;
+        expr->type = true_type;
         break;
     }
 
     case EXPR_AUTO_CAST:
     {
         assert(expr->auto_cast.sub);
-        assert(expr->auto_cast.sub->type);
+        assert(ts__expr(compiler, expr->auto_cast.sub)->type);
         break;
     }
     }
 
-    if (expected_type)
+    analyzerCheckExpectedType(a, expr, expected_type);
+
+    // Operand types may still be coerced by the enclosing expression, so folding waits
+    // until the outermost one is done
+    a->expr_depth--;
+    if (a->expr_depth == 0) analyzerFoldExpr(a, expr);
+}
+
+// Statements after one of these in a block never run. ast_ir stops emitting a block at
+// the same places, so only what it builds as a terminator of the current block counts.
+static bool stmtAlwaysExits(const TsCompiler *compiler, AstStmt *stmt)
+{
+    switch (stmt->kind)
     {
-        if (!expr->type)
-        {
-            ts__addErr(compiler, &expr->loc, "could not resolve type for expression");
-        }
-        else if (expr->type != expected_type)
-        {
-            bool is_auto_castable = false;
+    case STMT_RETURN:
+    case STMT_DISCARD:
+    case STMT_CONTINUE:
+    case STMT_BREAK: return true;
+
+    // Known once the block was analyzed, so nested blocks are not walked again
+    case STMT_BLOCK: return stmt->always_exits;
+
+    case STMT_IF: {
+        if (!stmt->if_.has_const_cond) return false;
+        AstStmtId taken = stmt->if_.const_cond ? stmt->if_.if_stmt : stmt->if_.else_stmt;
+        return taken && stmtAlwaysExits(compiler, ts__stmt(compiler, taken));
+    }
 
-            // Cast scalar to vector
-            is_auto_castable |= (expected_type->kind == TYPE_VECTOR &&
-                                 ts__getScalarTypeNoVec(expr->type));
+    default: break;
+    }
 
-            // Cast scalar to scalar
-            is_auto_castable |= (ts__getScalarTypeNoVec(expected_type) &&
-                                 ts__getScalarTypeNoVec(expr->type));
+    return false;
+}
 
-            // Cast vector to vector
-            is_auto_castable |= (expected_type->kind == TYPE_VECTOR &&
-                                 expr->type->kind == TYPE_VECTOR &&
-                                 expected_type->vector.size == expr->type->vector.size);
+// Returns whether one of the statements always exits
+static bool analyzerAnalyzeStmts(Analyzer *a, AstStmtList stmts)
+{
+    TsCompiler *compiler = a->compiler;
 
-            if (is_auto_castable)
-            {
-                AstExpr *sub_expr = NEW(compiler, AstExpr);
-                *sub_expr = *expr;
+    bool prev_dead_code = a->dead_code;
+    bool exits = false;
+    for (uint32_t i = 0; i < arrLength(stmts); ++i)
+    {
+        analyzerAnalyzeStmt(a, stmts.ptr[i]);
+        AstStmt *stmt = ts__stmt(compiler, stmts.ptr[i]);
+        if (stmtAlwaysExits(compiler, stmt))
+        {
+            a->dead_code = true;
+            exits = true;
+        }
+    }
+    a->dead_code = prev_dead_code;
+    return exits;
+}
+
+// Checks the attributes of a statement. Unknown attributes are ignored, like the ones
+// of declarations.
+static void analyzerAnalyzeStmtAttributes(Analyzer *a, AstStmt *stmt)
+{
+    TsCompiler *compiler = a->compiler;
+    bool is_loop = stmt->kind == STMT_WHILE || stmt->kind == STMT_DO_WHILE ||
+                   stmt->kind == STMT_FOR;
+    bool has_unroll = false;
+    bool has_loop = false;
+    bool has_branch = false;
+    bool has_flatten = false;
+
+    for (uint32_t i = 0; i < arrLength(stmt->attributes); ++i)
+    {
+        AstAttribute *attr = &stmt->attributes.ptr[i];
+        for (uint32_t j = 0; j < arrLength(attr->values); ++j)
+        {
+            analyzerAnalyzeExpr(a, attr->values.ptr[j], NULL);
+        }
 
-                expr->kind = EXPR_AUTO_CAST;
-                expr->auto_cast.sub = sub_expr;
-                expr->type = expected_type;
+        if (ts__strcasecmp(attr->name, "unroll") == 0)
+        {
+            has_unroll = true;
+            if (arrLength(attr->values) > 1)
+            {
+                ts__addErrAt(
+                    compiler, stmt->loc, "unroll attribute takes at most 1 parameter");
             }
-            else
+            else if (arrLength(attr->values) == 1)
             {
-                ts__addErr(compiler, &expr->loc,
-                        "unmatched types, expected '%s', instead got '%s'",
-                        typeToPrettyString(compiler, expected_type),
-                        typeToPrettyString(compiler, expr->type));
+                AstExpr *count = ts__expr(compiler, attr->values.ptr[0]);
+                if (!count->has_resolved_int ||
+                    ts__exprInfo(compiler, count)->resolved_int <= 0)
+                {
+                    ts__addErrAt(
+                        compiler,
+                        count->loc,
+                        "unroll count must be a positive integer constant");
+                }
             }
         }
+        else if (ts__strcasecmp(attr->name, "loop") == 0)
+        {
+            has_loop = true;
+        }
+        else if (ts__strcasecmp(attr->name, "branch") == 0)
+        {
+            has_branch = true;
+        }
+        else if (ts__strcasecmp(attr->name, "flatten") == 0)
+        {
+            has_flatten = true;
+        }
+        else
+        {
+            continue;
+        }
+
+        bool is_selection_attr = ts__strcasecmp(attr->name, "branch") == 0 ||
+                                 ts__strcasecmp(attr->name, "flatten") == 0;
+        if (is_selection_attr && stmt->kind != STMT_IF)
+        {
+            ts__addErrAt(
+                compiler,
+                stmt->loc,
+                "%s attribute can only be used on if statements",
+                attr->name);
+        }
+        else if (!is_selection_attr && !is_loop)
+        {
+            ts__addErrAt(
+                compiler,
+                stmt->loc,
+                "%s attribute can only be used on loops",
+                attr->name);
+        }
+    }
+
+    if (has_unroll && has_loop)
+    {
+        ts__addErrAt(compiler, stmt->loc, "loop cannot be both [unroll] and [loop]");
+    }
+    if (has_branch && has_flatten)
+    {
+        ts__addErrAt(
+            compiler, stmt->loc, "if statement cannot be both [branch] and [flatten]");
     }
 }
 
-static void analyzerAnalyzeStmt(Analyzer *a, AstStmt *stmt)
+static void analyzerAnalyzeStmt(Analyzer *a, AstStmtId stmt_id)
 {
     TsCompiler *compiler = a->compiler;
+    AstStmt *stmt = ts__stmt(compiler, stmt_id);
+
+    if (arrLength(stmt->attributes) > 0) analyzerAnalyzeStmtAttributes(a, stmt);
 
     switch (stmt->kind)
     {
     case STMT_DECL: {
-        analyzerTryRegisterDecl(a, stmt->decl);
-        analyzerAnalyzeDecl(a, stmt->decl);
+        analyzerTryRegisterDecl(a, ts__decl(compiler, stmt->decl));
+        analyzerAnalyzeDecl(a, ts__decl(compiler, stmt->decl));
         break;
     }
 
@@ -3621,12 +4703,12 @@ static void analyzerAnalyzeStmt(Analyzer *a, AstStmt *stmt)
 
         if (return_type->kind == TYPE_VOID && stmt->return_.value)
         {
-            ts__addErr(compiler, &stmt->loc, "function does not return a value");
+            ts__addErrAt(compiler, stmt->loc, "function does not return a value");
         }
 
         if (return_type->kind != TYPE_VOID && !stmt->return_.value)
         {
-            ts__addErr(compiler, &stmt->loc, "function needs a return value");
+            ts__addErrAt(compiler, stmt->loc, "function needs a return value");
         }
 
         if (stmt->return_.value)
@@ -3645,8 +4727,8 @@ static void analyzerAnalyzeStmt(Analyzer *a, AstStmt *stmt)
         assert(a->scope_func);
         if (arrLength(a->continue_stack) == 0)
         {
-            ts__addErr(
-                compiler, &stmt->loc, "continue must be inside a control flow structure");
+            ts__addErrAt(
+                compiler, stmt->loc, "continue must be inside a control flow structure");
         }
         break;
     }
@@ -3655,49 +4737,59 @@ static void analyzerAnalyzeStmt(Analyzer *a, AstStmt *stmt)
         assert(a->scope_func);
         if (arrLength(a->break_stack) == 0)
         {
-            ts__addErr(
-                compiler, &stmt->loc, "break must be inside a control flow structure");
+            ts__addErrAt(
+                compiler, stmt->loc, "break must be inside a control flow structure");
         }
         break;
     }
 
     case STMT_BLOCK: {
-        Scope *scope = analyzerCurrentScope(a);
-
-        stmt->block.scope = NEW(compiler, Scope);
-        scopeInit(compiler, stmt->block.scope, scope, NULL);
-
-        analyzerPushScope(a, stmt->block.scope);
-        for (uint32_t i = 0; i < arrLength(stmt->block.stmts); ++i)
-        {
-            AstStmt *sub_stmt = stmt->block.stmts.ptr[i];
-            analyzerAnalyzeStmt(a, sub_stmt);
-        }
-        analyzerPopScope(a, stmt->block.scope);
+        symbolTablePushScope(&a->symbols);
+        stmt->always_exits = analyzerAnalyzeStmts(a, stmt->block.stmts);
+        symbolTablePopScope(&a->symbols);
         break;
     }
 
     case STMT_IF: {
         analyzerAnalyzeExpr(a, stmt->if_.cond, NULL);
-        if (stmt->if_.cond->type && !ts__getComparableType(stmt->if_.cond->type))
+        AstExpr *cond_expr = ts__expr(compiler, stmt->if_.cond);
+        if (cond_expr->type && !ts__getComparableType(cond_expr->type))
+        {
+            ts__addErrAt(compiler, cond_expr->loc, "expression is not comparable");
+        }
+
+        AstConst *cond = ts__exprInfo(compiler, cond_expr)->const_value;
+        if (cond && isConstScalarType(cond->type))
         {
-            ts__addErr(compiler, &stmt->if_.cond->loc, "expression is not comparable");
+            stmt->if_.has_const_cond = true;
+            stmt->if_.const_cond =
+                cond->type->kind == TYPE_FLOAT ? cond->f != 0.0 : cond->i != 0;
         }
 
+        // The branch that is not taken is still checked, but what it calls is not
+        // reachable
+        bool prev_dead_code = a->dead_code;
+
+        a->dead_code = prev_dead_code || (stmt->if_.has_const_cond && !stmt->if_.const_cond);
         analyzerAnalyzeStmt(a, stmt->if_.if_stmt);
+
         if (stmt->if_.else_stmt)
         {
+            a->dead_code =
+                prev_dead_code || (stmt->if_.has_const_cond && stmt->if_.const_cond);
             analyzerAnalyzeStmt(a, stmt->if_.else_stmt);
         }
 
+        a->dead_code = prev_dead_code;
         break;
     }
 
     case STMT_WHILE: {
         analyzerAnalyzeExpr(a, stmt->while_.cond, NULL);
-        if (stmt->while_.cond->type && !ts__getComparableType(stmt->while_.cond->type))
+        AstExpr *cond_expr = ts__expr(compiler, stmt->while_.cond);
+        if (cond_expr->type && !ts__getComparableType(cond_expr->type))
         {
-            ts__addErr(compiler, &stmt->while_.cond->loc, "expression is not comparable");
+            ts__addErrAt(compiler, cond_expr->loc, "expression is not comparable");
         }
 
         arrPush(a->compiler, &a->continue_stack, stmt);
@@ -3710,11 +4802,10 @@ static void analyzerAnalyzeStmt(Analyzer *a, AstStmt *stmt)
 
     case STMT_DO_WHILE: {
         analyzerAnalyzeExpr(a, stmt->do_while.cond, NULL);
-        if (stmt->do_while.cond->type &&
-            !ts__getComparableType(stmt->do_while.cond->type))
+        AstExpr *cond_expr = ts__expr(compiler, stmt->do_while.cond);
+        if (cond_expr->type && !ts__getComparableType(cond_expr->type))
         {
-            ts__addErr(
-                compiler, &stmt->do_while.cond->loc, "expression is not comparable");
+            ts__addErrAt(compiler, cond_expr->loc, "expression is not comparable");
         }
 
         arrPush(a->compiler, &a->continue_stack, stmt);
@@ -3734,10 +4825,10 @@ static void analyzerAnalyzeStmt(Analyzer *a, AstStmt *stmt)
         if (stmt->for_.cond)
         {
             analyzerAnalyzeExpr(a, stmt->for_.cond, NULL);
-            if (stmt->for_.cond->type && !ts__getComparableType(stmt->for_.cond->type))
+            AstExpr *cond_expr = ts__expr(compiler, stmt->for_.cond);
+            if (cond_expr->type && !ts__getComparableType(cond_expr->type))
             {
-                ts__addErr(
-                    compiler, &stmt->for_.cond->loc, "expression is not comparable");
+                ts__addErrAt(compiler, cond_expr->loc, "expression is not comparable");
             }
         }
 
@@ -3756,11 +4847,172 @@ static void analyzerAnalyzeStmt(Analyzer *a, AstStmt *stmt)
     }
 }
 
+// Adds an edge to the call graph. Bodies may be analyzed on several threads, so the
+// 'called' flag is only set when the reached functions are merged into the queue.
+static void analyzerMarkReachable(Analyzer *a, AstDecl *func_decl)
+{
+    TsCompiler *compiler = a->compiler;
+
+    if (a->dead_code) return;
+
+    if (a->scope_func)
+    {
+        ArrayOfAstDeclPtr *callees = &ts__declInfoEdit(compiler, a->scope_func)->callees;
+        for (size_t i = 0; i < callees->len; ++i)
+        {
+            if (callees->ptr[i] == func_decl) return;
+        }
+        arrPush(a->compiler, callees, func_decl);
+    }
+
+    if (!func_decl->func.called) arrPush(a->compiler, &a->reached, func_decl);
+}
+
+// SPIR-V has no recursion. Walks the call graph depth first from 'func_decl', 'path'
+// holds the functions being walked.
+static void analyzerCheckRecursion(Analyzer *a, AstDecl *func_decl, ArrayOfAstDeclPtr *path)
+{
+    TsCompiler *compiler = a->compiler;
+
+    for (size_t i = 0; i < path->len; ++i)
+    {
+        if (path->ptr[i] != func_decl) continue;
+
+        ts__addErrAt(
+            a->compiler,
+            func_decl->loc,
+            "function '%s' is called recursively",
+            func_decl->name);
+        return;
+    }
+
+    if (func_decl->func.graph_visited) return;
+    func_decl->func.graph_visited = true;
+
+    arrPush(a->compiler, path, func_decl);
+    for (size_t i = 0; i < ts__declInfo(compiler, func_decl)->callees.len; ++i)
+    {
+        analyzerCheckRecursion(
+            a, ts__declInfo(compiler, func_decl)->callees.ptr[i], path);
+    }
+    arrPop(path);
+}
+
+static void analyzerQueueReached(Analyzer *a, Analyzer *from)
+{
+    for (size_t i = 0; i < from->reached.len; ++i)
+    {
+        AstDecl *func_decl = from->reached.ptr[i];
+        if (func_decl->func.called) continue;
+
+        func_decl->func.called = true;
+        arrPush(a->compiler, &a->func_queue, func_decl);
+    }
+    from->reached.len = 0;
+}
+
+static void analyzerAnalyzeFuncBody(Analyzer *a, AstDecl *decl)
+{
+    TsCompiler *compiler = a->compiler;
+
+    // The signature failed to resolve, which was already reported
+    AstExpr *return_type_expr = ts__expr(compiler, decl->func.return_type);
+    if (!ts__exprInfo(compiler, return_type_expr)->as_type) return;
+
+    size_t first_error = a->compiler->errors.len;
+
+    AstDecl *prev_scope_func = a->scope_func;
+    a->scope_func = decl;
+    symbolTablePushScope(&a->symbols);
+    for (uint32_t i = 0; i < arrLength(decl->template_params); ++i)
+    {
+        analyzerTryRegisterDecl(a, ts__decl(compiler, decl->template_params.ptr[i]));
+    }
+    for (uint32_t i = 0; i < arrLength(decl->func.params); ++i)
+    {
+        analyzerTryRegisterDecl(a, ts__decl(compiler, decl->func.params.ptr[i]));
+    }
+
+    analyzerAnalyzeStmts(a, decl->func.stmts);
+    symbolTablePopScope(&a->symbols);
+    a->scope_func = prev_scope_func;
+
+    if (a->compiler->errors.len > first_error)
+    {
+        BodyErrors body_errors = {0};
+        body_errors.func = decl;
+        body_errors.first = first_error;
+        body_errors.count = a->compiler->errors.len - first_error;
+        arrPush(a->compiler, &a->body_errors, body_errors);
+    }
+}
+
+// The register class of the resources of a type, false if it is not a resource type
+static bool getRegisterClass(const AstType *type, TsRegisterClass *register_class)
+{
+    switch (type->kind)
+    {
+    case TYPE_CONSTANT_BUFFER: *register_class = TS_REGISTER_CLASS_B; return true;
+    case TYPE_STRUCTURED_BUFFER:
+    case TYPE_IMAGE: *register_class = TS_REGISTER_CLASS_T; return true;
+    case TYPE_RW_STRUCTURED_BUFFER: *register_class = TS_REGISTER_CLASS_U; return true;
+    case TYPE_SAMPLER: *register_class = TS_REGISTER_CLASS_S; return true;
+    default: break;
+    }
+    return false;
+}
+
+// Resources of different register classes have different descriptor types, which
+// cannot share a binding. register(b0) and register(t0) are both binding 0 unless a
+// binding shift moves one of them.
+static void analyzerCheckBinding(Analyzer *a, AstDecl *decl)
+{
+    TsCompiler *compiler = a->compiler;
+
+    TsRegisterClass register_class;
+    if (!decl->type || !getRegisterClass(decl->type, &register_class)) return;
+
+    for (size_t i = 0; i < a->resources.len; ++i)
+    {
+        AstDecl *other = a->resources.ptr[i];
+
+        TsRegisterClass other_class;
+        getRegisterClass(other->type, &other_class);
+        if (other->var.binding != decl->var.binding || other->var.set != decl->var.set ||
+            other_class == register_class)
+        {
+            continue;
+        }
+
+        // cbuffer blocks have no variable name, their struct is named after them
+        const char *other_name = other->name;
+        if (!other_name)
+        {
+            other_name = ts__getStructType(other->type->buffer.sub)->struct_.name;
+        }
+
+        ts__addErrAt(
+            compiler,
+            decl->loc,
+            "binding %u of descriptor set %u is already used by '%.*s', a resource of a "
+            "different register class",
+            decl->var.binding,
+            decl->var.set,
+            (int)strcspn(other_name, "#"),
+            other_name);
+        break;
+    }
+
+    arrPush(compiler, &a->resources, decl);
+}
+
 static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
 {
     TsCompiler *compiler = a->compiler;
     Module *m = a->module;
-    Scope *scope = analyzerCurrentScope(a);
+
+    // Templates are only analyzed through their instances
+    if (isTemplate(compiler, decl)) return;
 
     for (uint32_t i = 0; i < arrLength(decl->attributes); ++i)
     {
@@ -3774,16 +5026,14 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
     switch (decl->kind)
     {
     case DECL_FUNC: {
-        decl->scope = NEW(compiler, Scope);
-        scopeInit(compiler, decl->scope, scope, decl);
-
         analyzerAnalyzeExpr(a, decl->func.return_type, newBasicType(m, TYPE_TYPE));
-        AstType *return_type = decl->func.return_type->as_type;
+        AstType *return_type =
+            ts__exprInfo(compiler, ts__expr(compiler, decl->func.return_type))->as_type;
 
         if (!return_type)
         {
-            ts__addErr(
-                compiler, &decl->loc, "could not resolve return type for function");
+            ts__addErrAt(
+                compiler, decl->loc, "could not resolve return type for function");
             break;
         }
 
@@ -3795,10 +5045,14 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
                 NEW_ARRAY(compiler, AstType *, arrLength(decl->func.params));
         }
 
-        analyzerPushScope(a, decl->scope);
+        // Only the signature is checked here, the body is analyzed once the function
+        // is found to be reachable from the entry point
+        AstDecl *prev_scope_func = a->scope_func;
+        a->scope_func = decl;
+        symbolTablePushScope(&a->symbols);
         for (uint32_t i = 0; i < arrLength(decl->func.params); ++i)
         {
-            AstDecl *param_decl = decl->func.params.ptr[i];
+            AstDecl *param_decl = ts__decl(compiler, decl->func.params.ptr[i]);
             assert(param_decl->kind == DECL_VAR);
 
             analyzerTryRegisterDecl(a, param_decl);
@@ -3806,9 +5060,9 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
             param_types[i] = param_decl->type;
             if (!param_types[i])
             {
-                ts__addErr(
+                ts__addErrAt(
                     compiler,
-                    &param_decl->loc,
+                    param_decl->loc,
                     "could not resolve type for function parameter");
                 param_types_valid = false;
                 continue;
@@ -3827,17 +5081,17 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
             decl->type = newFuncType(
                 m, return_type, param_types, arrLength(decl->func.params));
         }
+        symbolTablePopScope(&a->symbols);
+        a->scope_func = prev_scope_func;
 
-        for (uint32_t i = 0; i < arrLength(decl->func.stmts); ++i)
+        if (decl->type && !ts__declInfo(compiler, decl)->instance_of)
         {
-            AstStmt *stmt = decl->func.stmts.ptr[i];
-            analyzerAnalyzeStmt(a, stmt);
+            analyzerCheckOverload(a, decl);
         }
-        analyzerPopScope(a, decl->scope);
 
         if (strcmp(m->entry_point, decl->name) == 0)
         {
-            decl->func.called = true;
+            analyzerMarkReachable(a, decl);
             m->entry_point_func = decl;
 
             switch (m->stage)
@@ -3856,9 +5110,9 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
                         got_numthreads = true;
                         if (arrLength(attr->values) != 3)
                         {
-                            ts__addErr(
+                            ts__addErrAt(
                                 compiler,
-                                &decl->loc,
+                                decl->loc,
                                 "numthreads attribute must have exactly 3 integer "
                                 "parameters");
                         }
@@ -3866,19 +5120,19 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
                         {
                             for (size_t j = 0; j < 3; ++j)
                             {
-                                if (!attr->values.ptr[j]->resolved_int)
+                                AstExpr *value = ts__expr(compiler, attr->values.ptr[j]);
+                                if (!value->has_resolved_int)
                                 {
-                                    ts__addErr(
+                                    ts__addErrAt(
                                         compiler,
-                                        &attr->values.ptr[j]->loc,
+                                        value->loc,
                                         "could not resolve integer from expression");
                                 }
                                 else
                                 {
-                                    uint32_t dim =
-                                        (uint32_t)*attr->values.ptr[j]->resolved_int;
-
-                                    m->compute_dims[j] = dim;
+                                    int64_t dim =
+                                        ts__exprInfo(compiler, value)->resolved_int;
+                                    m->compute_dims[j] = (uint32_t)dim;
                                 }
                             }
                         }
@@ -3887,9 +5141,9 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
 
                 if (!got_numthreads)
                 {
-                    ts__addErr(
+                    ts__addErrAt(
                         compiler,
-                        &decl->loc,
+                        decl->loc,
                         "thread group size [numthreads(x,y,z)] is missing from the "
                         "entry-point function");
                 }
@@ -3907,40 +5161,44 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
     case DECL_VAR: {
         if (decl->var.kind == VAR_PLAIN && !a->scope_func)
         {
-            ts__addErr(
-                compiler, &decl->loc, "variable declaration must be inside a function");
+            ts__addErrAt(
+                compiler, decl->loc, "variable declaration must be inside a function");
             break;
         }
 
         analyzerAnalyzeExpr(a, decl->var.type_expr, newBasicType(m, TYPE_TYPE));
-        if (!decl->var.type_expr->as_type)
+        AstType *var_type =
+            ts__exprInfo(compiler, ts__expr(compiler, decl->var.type_expr))->as_type;
+        if (!var_type)
         {
             break;
         }
 
         if (decl->var.value_expr)
         {
-            analyzerAnalyzeExpr(a, decl->var.value_expr, decl->var.type_expr->as_type);
+            analyzerAnalyzeExpr(a, decl->var.value_expr, var_type);
         }
 
-        decl->type = decl->var.type_expr->as_type;
+        decl->type = var_type;
 
         if (decl->var.kind == VAR_PLAIN && a->scope_func)
         {
-            arrPush(compiler, &a->scope_func->func.var_decls, decl);
+            arrPush(
+                compiler, &ts__declInfoEdit(compiler, a->scope_func)->var_decls, decl);
         }
 
         AstType *struct_type = ts__getStructType(decl->type);
 
         if (struct_type)
         {
-            decl->scope = NEW(compiler, Scope);
-            scopeInit(compiler, decl->scope, NULL, decl);
+            Scope *scope = NEW(compiler, Scope);
+            scopeInit(compiler, scope);
             for (uint32_t i = 0; i < struct_type->struct_.field_count; ++i)
             {
                 AstDecl *field_decl = struct_type->struct_.field_decls[i];
-                scopeAdd(decl->scope, field_decl->name, field_decl);
+                scopeAdd(scope, field_decl->name, field_decl);
             }
+            ts__declInfoEdit(compiler, decl)->scope = scope;
         }
 
         bool got_binding_index = false;
@@ -3948,6 +5206,15 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
         uint32_t binding_index = 0;
         uint32_t set_index = 0;
 
+        // [[vk::binding]] takes precedence over register()
+        if (decl->var.kind == VAR_UNIFORM && decl->var.has_register)
+        {
+            binding_index =
+                decl->var.register_binding + m->binding_shifts[decl->var.register_class];
+            set_index = decl->var.register_space;
+            got_binding_index = true;
+        }
+
         // Retrieve set & binding from attributes
         for (uint32_t i = 0; i < arrLength(decl->attributes); ++i)
         {
@@ -3957,32 +5224,36 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
             {
                 if (arrLength(attr->values) >= 1)
                 {
-                    if (!attr->values.ptr[0]->resolved_int)
+                    AstExpr *value = ts__expr(compiler, attr->values.ptr[0]);
+                    if (!value->has_resolved_int)
                     {
-                        ts__addErr(
+                        ts__addErrAt(
                             compiler,
-                            &attr->values.ptr[0]->loc,
+                            value->loc,
                             "could not resolve integer from expression");
                     }
                     else
                     {
-                        binding_index = (uint32_t)*attr->values.ptr[0]->resolved_int;
+                        binding_index =
+                            (uint32_t)ts__exprInfo(compiler, value)->resolved_int;
+                        set_index = 0;
                         got_binding_index = true;
                     }
                 }
 
                 if (arrLength(attr->values) >= 2)
                 {
-                    if (!attr->values.ptr[1]->resolved_int)
+                    AstExpr *value = ts__expr(compiler, attr->values.ptr[1]);
+                    if (!value->has_resolved_int)
                     {
-                        ts__addErr(
+                        ts__addErrAt(
                             compiler,
-                            &attr->values.ptr[1]->loc,
+                            value->loc,
                             "could not resolve integer from expression");
                     }
                     else
                     {
-                        set_index = (uint32_t)*attr->values.ptr[1]->resolved_int;
+                        set_index = (uint32_t)ts__exprInfo(compiler, value)->resolved_int;
                     }
                 }
             }
@@ -4001,6 +5272,9 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
 
             decl->var.binding = binding_index;
             decl->var.set = set_index;
+
+            analyzerCheckBinding(a, decl);
+            analyzerLayoutBuffer(a, decl);
         }
 
         break;
@@ -4008,45 +5282,65 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
 
     case DECL_CONST: {
         analyzerAnalyzeExpr(a, decl->constant.type_expr, newBasicType(m, TYPE_TYPE));
-        if (!decl->constant.type_expr->as_type)
+        AstType *const_type =
+            ts__exprInfo(compiler, ts__expr(compiler, decl->constant.type_expr))->as_type;
+        if (!const_type)
         {
-            ts__addErr(
+            ts__addErrAt(
                 compiler,
-                &decl->loc,
+                decl->loc,
                 "constant type expression does not represent a type");
         }
 
-        analyzerAnalyzeExpr(
-            a, decl->constant.value_expr, decl->constant.type_expr->as_type);
+        size_t error_count = compiler->errors.len;
+        analyzerAnalyzeExpr(a, decl->constant.value_expr, const_type);
+        AstExpr *value_expr = ts__expr(compiler, decl->constant.value_expr);
+        const AstExprInfo *value_info = ts__exprInfo(compiler, value_expr);
+
+        decl->type = const_type;
+        decl->has_resolved_int = value_expr->has_resolved_int;
+        ts__declInfoEdit(compiler, decl)->resolved_int = value_info->resolved_int;
+        if (!decl->type) break;
+
+        AstConst *const_value = constCast(a, value_info->const_value, decl->type);
+        ts__declInfoEdit(compiler, decl)->const_value = const_value;
 
-        decl->type = decl->constant.type_expr->as_type;
-        decl->resolved_int = decl->constant.value_expr->resolved_int;
+        // There is no function to compute the value in at global scope
+        if (!a->scope_func && !const_value && compiler->errors.len == error_count)
+        {
+            ts__addErrAt(
+                compiler,
+                value_expr->loc,
+                "initializer of '%s' is not a compile-time constant",
+                decl->name);
+        }
 
         break;
     }
 
     case DECL_STRUCT_FIELD: {
         analyzerAnalyzeExpr(a, decl->struct_field.type_expr, newBasicType(m, TYPE_TYPE));
-        if (!decl->struct_field.type_expr->as_type)
+        AstExpr *type_expr = ts__expr(compiler, decl->struct_field.type_expr);
+        decl->type = ts__exprInfo(compiler, type_expr)->as_type;
+        if (!decl->type)
         {
-            ts__addErr(
+            ts__addErrAt(
                 compiler,
-                &decl->loc,
+                decl->loc,
                 "could not resolve type of struct field '%s'", decl->name);
         }
 
-        decl->type = decl->struct_field.type_expr->as_type;
-
         AstType *struct_type = ts__getStructType(decl->type);
         if (struct_type)
         {
-            decl->scope = NEW(compiler, Scope);
-            scopeInit(compiler, decl->scope, NULL, decl);
+            Scope *scope = NEW(compiler, Scope);
+            scopeInit(compiler, scope);
             for (uint32_t i = 0; i < struct_type->struct_.field_count; ++i)
             {
                 AstDecl *field_decl = struct_type->struct_.field_decls[i];
-                scopeAdd(decl->scope, field_decl->name, field_decl);
+                scopeAdd(scope, field_decl->name, field_decl);
             }
+            ts__declInfoEdit(compiler, decl)->scope = scope;
         }
 
         break;
@@ -4055,18 +5349,26 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
     case DECL_STRUCT: {
         uint32_t field_count = arrLength(decl->struct_.fields);
         AstType **field_types = NEW_ARRAY(compiler, AstType *, field_count);
+        AstDecl **field_decls = NEW_ARRAY(compiler, AstDecl *, field_count);
 
-        decl->scope = NEW(compiler, Scope);
-        scopeInit(compiler, decl->scope, scope, NULL);
+        // Fields only go in the struct's member scope, they are not visible to the
+        // type expressions of the other fields
+        Scope *scope = NEW(compiler, Scope);
+        scopeInit(compiler, scope);
+        ts__declInfoEdit(compiler, decl)->scope = scope;
 
         bool got_all_field_types = true;
 
-        analyzerPushScope(a, decl->scope);
         for (uint32_t i = 0; i < arrLength(decl->struct_.fields); ++i)
         {
-            AstDecl *field = decl->struct_.fields.ptr[i];
+            AstDecl *field = ts__decl(compiler, decl->struct_.fields.ptr[i]);
+            field_decls[i] = field;
             field->struct_field.index = i;
-            analyzerTryRegisterDecl(a, field);
+            if (!scopeAdd(scope, field->name, field))
+            {
+                ts__addErrAt(
+                    compiler, field->loc, "duplicate declaration: '%s'", field->name);
+            }
             analyzerAnalyzeDecl(a, field);
 
             field_types[i] = field->type;
@@ -4075,60 +5377,40 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
                 got_all_field_types = false;
             }
         }
-        analyzerPopScope(a, decl->scope);
 
         if (!got_all_field_types)
         {
-            ts__addErr(
+            ts__addErrAt(
                 a->compiler,
-                &decl->loc,
+                decl->loc,
                 "could not create a complete struct type for '%s'",
                 decl->name);
             break;
         }
 
         decl->type = newBasicType(m, TYPE_TYPE);
-        decl->as_type = newStructType(
-            m, decl->name, field_types, decl->struct_.fields.ptr, field_count);
-
-        for (uint32_t i = 0; i < arrLength(decl->struct_.fields); ++i)
-        {
-            if (field_types[i]->kind == TYPE_MATRIX)
-            {
-                IRMemberDecoration member_dec = {0};
-                member_dec.kind = SpvDecorationRowMajor;
-                member_dec.member_index = i;
-                arrPush(compiler, &decl->as_type->struct_.field_decorations, member_dec);
-
-                uint32_t row_stride =
-                    field_types[i]->matrix.col_count *
-                    typeSizeOf(m, field_types[i]->matrix.col_type->vector.elem_type);
-
-                member_dec.kind = SpvDecorationMatrixStride;
-                member_dec.member_index = i;
-                member_dec.value = row_stride;
-                arrPush(compiler, &decl->as_type->struct_.field_decorations, member_dec);
-            }
-        }
-
+        ts__declInfoEdit(compiler, decl)->as_type =
+            newStructType(m, decl->name, field_types, field_decls, field_count);
         break;
     }
 
     case DECL_ALIAS: {
         char *name = decl->name;
 
-        AstDecl *accessed = decl->alias.accessed;
+        AstDecl *accessed = ts__decl(compiler, decl->alias.accessed);
         assert(accessed->type);
         switch (accessed->type->kind)
         {
         case TYPE_CONSTANT_BUFFER:
         {
-            assert(accessed->scope);
-            AstDecl *field_decl = scopeGetLocal(accessed->scope, name);
+            assert(ts__declInfo(compiler, accessed)->scope);
+            AstDecl *field_decl =
+                scopeGetLocal(ts__declInfo(compiler, accessed)->scope, name);
             assert(field_decl->type);
             decl->type = field_decl->type;
-            decl->scope = field_decl->scope;
-            decl->alias.field_decl = field_decl;
+            ts__declInfoEdit(compiler, decl)->scope =
+                ts__declInfo(compiler, field_decl)->scope;
+            decl->alias.field_decl = field_decl->id;
             break;
         }
 
@@ -4137,7 +5419,199 @@ static void analyzerAnalyzeDecl(Analyzer *a, AstDecl *decl)
 
         break;
     }
+
+    case DECL_TYPE_PARAM: break; // Bound to a type by the instantiation
+    }
+}
+
+// Below this many function bodies in a pass, analysis stays on the calling thread
+#ifndef TS_PARALLEL_ANALYSIS_MIN_FUNCS
+#define TS_PARALLEL_ANALYSIS_MIN_FUNCS 32
+#endif
+
+#define ANALYSIS_MAX_JOBS 16
+
+// Function bodies only read the global declarations, so each job gets its own
+// allocator, error list and copy of the global symbols
+typedef struct AnalysisJob
+{
+    TsCompiler compiler;
+    Module module;
+    Analyzer analyzer;
+    AstDecl **funcs;
+    size_t func_count;
+} AnalysisJob;
+
+static void analysisJobRun(void *arg)
+{
+    AnalysisJob *job = arg;
+    for (size_t i = 0; i < job->func_count; ++i)
+    {
+        analyzerAnalyzeFuncBody(&job->analyzer, job->funcs[i]);
+    }
+}
+
+static void analyzerAnalyzeBodies(Analyzer *a, size_t begin, size_t end, uint32_t job_count)
+{
+    TsCompiler *compiler = a->compiler;
+
+    size_t func_count = end - begin;
+    job_count = TS__MIN(job_count, ANALYSIS_MAX_JOBS);
+
+    if (job_count < 2 || func_count < TS_PARALLEL_ANALYSIS_MIN_FUNCS)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            analyzerAnalyzeFuncBody(a, a->func_queue.ptr[i]);
+        }
+        analyzerQueueReached(a, a);
+        return;
+    }
+
+    AnalysisJob *jobs = NEW_ARRAY(compiler, AnalysisJob, job_count);
+    Thread *threads[ANALYSIS_MAX_JOBS] = {0};
+
+    size_t pos = begin;
+    for (uint32_t i = 0; i < job_count; ++i)
+    {
+        AnalysisJob *job = &jobs[i];
+
+        // Shares the read-only tables of the compiler
+        job->compiler = *compiler;
+        ts__bumpInit(&job->compiler.alloc, 1 << 16);
+        ts__sbInit(&job->compiler.sb);
+        memset(&job->compiler.errors, 0, sizeof(job->compiler.errors));
+        memset(job->compiler.ast_runs, 0, sizeof(job->compiler.ast_runs));
+
+        job->module = *a->module;
+        job->module.compiler = &job->compiler;
+
+        job->analyzer.compiler = &job->compiler;
+        job->analyzer.module = &job->module;
+        symbolTableClone(&job->compiler, &job->analyzer.symbols, &a->symbols);
+
+        size_t job_end = begin + func_count * (i + 1) / job_count;
+        job->funcs = &a->func_queue.ptr[pos];
+        job->func_count = job_end - pos;
+        pos = job_end;
+    }
+
+    // The calling thread takes the first job
+    for (uint32_t i = 1; i < job_count; ++i)
+    {
+        threads[i] = ts__threadStart(analysisJobRun, &jobs[i]);
+        if (!threads[i]) analysisJobRun(&jobs[i]);
+    }
+
+    analysisJobRun(&jobs[0]);
+
+    // Jobs read the 'called' flags that merging sets, so all of them must be done first
+    for (uint32_t i = 1; i < job_count; ++i)
+    {
+        if (threads[i]) ts__threadJoin(threads[i]);
+    }
+
+    // Merged in queue order, so the result does not depend on thread timing
+    for (uint32_t i = 0; i < job_count; ++i)
+    {
+        AnalysisJob *job = &jobs[i];
+
+        size_t error_offset = compiler->errors.len;
+        for (size_t j = 0; j < job->compiler.errors.len; ++j)
+        {
+            arrPush(compiler, &compiler->errors, job->compiler.errors.ptr[j]);
+        }
+
+        for (size_t j = 0; j < job->analyzer.body_errors.len; ++j)
+        {
+            BodyErrors body_errors = job->analyzer.body_errors.ptr[j];
+            body_errors.first += error_offset;
+            arrPush(compiler, &a->body_errors, body_errors);
+        }
+
+        analyzerQueueReached(a, &job->analyzer);
+
+        ts__bumpAdopt(&compiler->alloc, &job->compiler.alloc);
+        ts__sbDestroy(&job->compiler.sb);
+    }
+}
+
+static int compareDeclNames(const void *a_ptr, const void *b_ptr)
+{
+    const AstDecl *a = *(AstDecl *const *)a_ptr;
+    const AstDecl *b = *(AstDecl *const *)b_ptr;
+    return strcmp(a->name, b->name);
+}
+
+// Replaces each template in the module's declarations by its instances, sorted by name
+// so that the output does not depend on the order threads created them in
+static void analyzerAddInstances(Analyzer *a)
+{
+    TsCompiler *compiler = a->compiler;
+    Module *m = a->module;
+
+    InternTable *table = &m->template_cache->table;
+    if (table->values.len == 0) return;
+
+    AstDecl **decls = NEW_ARRAY(compiler, AstDecl *, m->decl_count + table->values.len);
+    size_t decl_count = 0;
+
+    for (size_t i = 0; i < m->decl_count; ++i)
+    {
+        AstDecl *decl = m->decls[i];
+        if (!isTemplate(compiler, decl))
+        {
+            decls[decl_count++] = decl;
+            continue;
+        }
+
+        size_t first_instance = decl_count;
+        for (size_t j = 0; j < table->values.len; ++j)
+        {
+            TemplateInstance *inst = table->values.ptr[j];
+            if (inst->template_decl == decl) decls[decl_count++] = inst->instance;
+        }
+
+        qsort(
+            &decls[first_instance],
+            decl_count - first_instance,
+            sizeof(AstDecl *),
+            compareDeclNames);
+    }
+
+    m->decls = decls;
+    m->decl_count = decl_count;
+}
+
+// Bodies are analyzed in reachability order, put their errors back in source order
+static void analyzerSortBodyErrors(Analyzer *a, size_t first_error)
+{
+    TsCompiler *compiler = a->compiler;
+    Module *m = a->module;
+
+    if (a->body_errors.len == 0) return;
+
+    size_t error_count = compiler->errors.len - first_error;
+    Error *errors = NEW_ARRAY(compiler, Error, error_count);
+    memcpy(errors, &compiler->errors.ptr[first_error], sizeof(Error) * error_count);
+    compiler->errors.len = first_error;
+
+    for (size_t i = 0; i < m->decl_count; ++i)
+    {
+        for (size_t j = 0; j < a->body_errors.len; ++j)
+        {
+            BodyErrors *body_errors = &a->body_errors.ptr[j];
+            if (body_errors->func != m->decls[i]) continue;
+
+            for (size_t k = 0; k < body_errors->count; ++k)
+            {
+                Error err = errors[body_errors->first - first_error + k];
+                arrPush(compiler, &compiler->errors, err);
+            }
+        }
     }
+
+    assert(compiler->errors.len == first_error + error_count);
 }
 
 void ts__analyze(
@@ -4149,13 +5623,11 @@ void ts__analyze(
     a->module = module;
     a->module->decls = decls;
     a->module->decl_count = decl_count;
+    a->module->type_cache = typeCacheCreate(compiler);
+    a->module->template_cache = templateCacheCreate(compiler);
 
-    assert(!module->scope);
-
-    module->scope = NEW(compiler, Scope);
-    scopeInit(compiler, module->scope, NULL, NULL);
-
-    analyzerPushScope(a, a->module->scope);
+    symbolTableInit(compiler, &a->symbols);
+    symbolTablePushScope(&a->symbols);
 
     for (uint32_t i = 0; i < decl_count; ++i)
     {
@@ -4169,5 +5641,35 @@ void ts__analyze(
         analyzerAnalyzeDecl(a, decl);
     }
 
-    analyzerPopScope(a, a->module->scope);
+    // Function bodies are only analyzed when reachable from the entry point. Each pass
+    // analyzes the bodies queued by the previous one.
+    analyzerQueueReached(a, a);
+
+    uint32_t cpu_count = ts__getCpuCount();
+    size_t first_body_error = compiler->errors.len;
+
+    size_t begin = 0;
+    while (begin < a->func_queue.len)
+    {
+        size_t end = a->func_queue.len;
+        analyzerAnalyzeBodies(a, begin, end, cpu_count);
+        begin = end;
+    }
+
+    analyzerAddInstances(a);
+    analyzerSortBodyErrors(a, first_body_error);
+
+    if (module->entry_point_func)
+    {
+        ArrayOfAstDeclPtr path = {0};
+        analyzerCheckRecursion(a, module->entry_point_func, &path);
+    }
+
+    symbolTablePopScope(&a->symbols);
+
+    typeCacheDestroy(a->module->type_cache);
+    a->module->type_cache = NULL;
+
+    templateCacheDestroy(a->module->template_cache);
+    a->module->template_cache = NULL;
 }
@@ -11,8 +11,8 @@
 ////////////////////////////////
 
 static void astBuildDecl(Module *ast_mod, IRModule *ir_mod, AstDecl *decl);
-static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmt *stmt);
-static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr);
+static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmtId stmt_id);
+static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExprId expr_id);
 
 static IRInst *boolVal(IRModule *m, IRInst *value)
 {
@@ -62,6 +62,21 @@ static IRInst *loadVal(IRModule *m, IRInst *value)
     return value;
 }
 
+// The runtime array of a structured buffer of matrices is the first member of its
+// wrapper struct, which carries the matrix layout. Returns the decoration count.
+static uint32_t addMatrixLayout(AstType *buffer_type, IRMemberDecoration *decs)
+{
+    if (buffer_type->buffer.sub->kind != TYPE_MATRIX) return 0;
+
+    decs[0].kind = SpvDecorationRowMajor;
+    decs[0].member_index = 0;
+
+    decs[1].kind = SpvDecorationMatrixStride;
+    decs[1].member_index = 0;
+    decs[1].value = buffer_type->buffer.matrix_stride;
+    return 2;
+}
+
 static IRType *convertTypeToIR(Module *module, IRModule *ir_module, AstType *type)
 {
     switch (type->kind)
@@ -99,11 +114,11 @@ static IRType *convertTypeToIR(Module *module, IRModule *ir_module, AstType *typ
         IRType *subtype = convertTypeToIR(module, ir_module, type->buffer.sub);
         IRType *array_type = ts__irNewRuntimeArrayType(ir_module, subtype);
 
-        assert(type->buffer.sub->size > 0);
+        assert(type->buffer.stride > 0);
 
         IRDecoration array_dec = {0};
         array_dec.kind = SpvDecorationArrayStride;
-        array_dec.value = type->buffer.sub->size;
+        array_dec.value = type->buffer.stride;
 
         ts__irDecorateType(ir_module, array_type, &array_dec);
 
@@ -112,13 +127,16 @@ static IRType *convertTypeToIR(Module *module, IRModule *ir_module, AstType *typ
             &module->compiler->sb, "__tmp_struct%u", module->compiler->counter++);
         char *struct_name = ts__sbBuild(&module->compiler->sb, &module->compiler->alloc);
 
-        IRMemberDecoration member_decs[1] = {0};
+        IRMemberDecoration member_decs[3] = {0};
         member_decs[0].kind = SpvDecorationOffset;
         member_decs[0].member_index = 0;
         member_decs[0].value = 0;
 
-        IRType *struct_wrapper =
-            ts__irNewStructType(ir_module, struct_name, &array_type, 1, member_decs, 1);
+        uint32_t member_dec_count = 1;
+        member_dec_count += addMatrixLayout(type, &member_decs[member_dec_count]);
+
+        IRType *struct_wrapper = ts__irNewStructType(
+            ir_module, struct_name, &array_type, 1, member_decs, member_dec_count);
 
         IRDecoration struct_dec = {0};
         struct_dec.kind = SpvDecorationBufferBlock;
@@ -132,11 +150,11 @@ static IRType *convertTypeToIR(Module *module, IRModule *ir_module, AstType *typ
         IRType *subtype = convertTypeToIR(module, ir_module, type->buffer.sub);
         IRType *array_type = ts__irNewRuntimeArrayType(ir_module, subtype);
 
-        assert(type->buffer.sub->size > 0);
+        assert(type->buffer.stride > 0);
 
         IRDecoration array_dec = {0};
         array_dec.kind = SpvDecorationArrayStride;
-        array_dec.value = type->buffer.sub->size;
+        array_dec.value = type->buffer.stride;
 
         ts__irDecorateType(ir_module, array_type, &array_dec);
 
@@ -145,7 +163,7 @@ static IRType *convertTypeToIR(Module *module, IRModule *ir_module, AstType *typ
             &module->compiler->sb, "__tmp_struct%u", module->compiler->counter++);
         char *struct_name = ts__sbBuild(&module->compiler->sb, &module->compiler->alloc);
 
-        IRMemberDecoration member_decs[2] = {0};
+        IRMemberDecoration member_decs[4] = {0};
         member_decs[0].kind = SpvDecorationOffset;
         member_decs[0].member_index = 0;
         member_decs[0].value = 0;
@@ -153,8 +171,11 @@ static IRType *convertTypeToIR(Module *module, IRModule *ir_module, AstType *typ
         member_decs[1].kind = SpvDecorationNonWritable;
         member_decs[1].member_index = 0;
 
-        IRType *struct_wrapper =
-            ts__irNewStructType(ir_module, struct_name, &array_type, 1, member_decs, 2);
+        uint32_t member_dec_count = 2;
+        member_dec_count += addMatrixLayout(type, &member_decs[member_dec_count]);
+
+        IRType *struct_wrapper = ts__irNewStructType(
+            ir_module, struct_name, &array_type, 1, member_decs, member_dec_count);
 
         IRDecoration struct_dec = {0};
         struct_dec.kind = SpvDecorationBufferBlock;
@@ -222,12 +243,271 @@ static IRType *convertTypeToIR(Module *module, IRModule *ir_module, AstType *typ
     return NULL;
 }
 
-static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
+static IRInst *astBuildConst(Module *ast_mod, IRModule *ir_mod, AstConst *value)
+{
+    IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, value->type);
+
+    switch (value->type->kind)
+    {
+    case TYPE_FLOAT: return ts__irBuildConstFloat(ir_mod, ir_type, value->f);
+    case TYPE_INT: return ts__irBuildConstInt(ir_mod, ir_type, (uint64_t)value->i);
+    case TYPE_BOOL: return ts__irBuildConstBool(ir_mod, value->i != 0);
+
+    case TYPE_VECTOR:
+    case TYPE_MATRIX: {
+        IRInst **elems = NEW_ARRAY(ast_mod->compiler, IRInst *, value->elem_count);
+        for (uint32_t i = 0; i < value->elem_count; ++i)
+        {
+            elems[i] = astBuildConst(ast_mod, ir_mod, value->elems[i]);
+        }
+        return ts__irBuildConstComposite(ir_mod, ir_type, elems, value->elem_count);
+    }
+
+    default: assert(0); break;
+    }
+
+    return NULL;
+}
+
+// Builds a binary expression from the values of its operands
+static void astBuildBinaryExpr(
+    Module *ast_mod, IRModule *ir_mod, AstExpr *expr, IRInst *left_val, IRInst *right_val)
+{
+    TsCompiler *compiler = ast_mod->compiler;
+
+    AstType *elem_type = ts__getElemType(ts__expr(compiler, expr->binary.left)->type);
+    assert(elem_type);
+    SpvOp op = {0};
+
+    IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
+
+    switch (expr->binary.op)
+    {
+    case BINOP_ADD:
+    case BINOP_SUB:
+    case BINOP_MUL:
+    case BINOP_DIV:
+    case BINOP_MOD: {
+        if (left_val->type->kind == IR_TYPE_VECTOR &&
+            right_val->type->kind != IR_TYPE_VECTOR)
+        {
+            uint32_t field_count = left_val->type->vector.size;
+
+            IRInst **fields = NEW_ARRAY(compiler, IRInst *, field_count);
+            for (uint32_t i = 0; i < field_count; ++i)
+            {
+                fields[i] = right_val;
+            }
+            right_val = ts__irBuildCompositeConstruct(ir_mod, ir_type, fields, field_count);
+        }
+        else if (
+            right_val->type->kind == IR_TYPE_VECTOR &&
+            left_val->type->kind != IR_TYPE_VECTOR)
+        {
+            uint32_t field_count = right_val->type->vector.size;
+
+            IRInst **fields = NEW_ARRAY(compiler, IRInst *, field_count);
+            for (uint32_t i = 0; i < field_count; ++i)
+            {
+                fields[i] = left_val;
+            }
+            left_val = ts__irBuildCompositeConstruct(ir_mod, ir_type, fields, field_count);
+        }
+
+        break;
+    }
+
+    default: break;
+    }
+
+    switch (expr->binary.op)
+    {
+    case BINOP_ADD: {
+        switch (elem_type->kind)
+        {
+        case TYPE_FLOAT: op = SpvOpFAdd; break;
+        case TYPE_INT: op = SpvOpIAdd; break;
+        default: assert(0); break;
+        }
+        break;
+    }
+    case BINOP_SUB: {
+        switch (elem_type->kind)
+        {
+        case TYPE_FLOAT: op = SpvOpFSub; break;
+        case TYPE_INT: op = SpvOpISub; break;
+        default: assert(0); break;
+        }
+        break;
+    }
+    case BINOP_MUL: {
+        switch (elem_type->kind)
+        {
+        case TYPE_FLOAT: op = SpvOpFMul; break;
+        case TYPE_INT: op = SpvOpIMul; break;
+        default: assert(0); break;
+        }
+        break;
+    }
+    case BINOP_DIV: {
+        switch (elem_type->kind)
+        {
+        case TYPE_FLOAT: op = SpvOpFDiv; break;
+        case TYPE_INT:
+            if (elem_type->int_.is_signed)
+                op = SpvOpSDiv;
+            else
+                op = SpvOpUDiv;
+            break;
+        default: assert(0); break;
+        }
+        break;
+    }
+    case BINOP_MOD: {
+        switch (elem_type->kind)
+        {
+        case TYPE_FLOAT: op = SpvOpFRem; break;
+        case TYPE_INT:
+            if (elem_type->int_.is_signed)
+                op = SpvOpSMod;
+            else
+                op = SpvOpUMod;
+            break;
+        default: assert(0); break;
+        }
+        break;
+    }
+
+    case BINOP_EQ: {
+        switch (elem_type->kind)
+        {
+        case TYPE_FLOAT: op = SpvOpFOrdEqual; break;
+        case TYPE_INT: op = SpvOpIEqual; break;
+        case TYPE_BOOL: op = SpvOpLogicalEqual; break;
+        default: assert(0); break;
+        }
+        break;
+    }
+
+    case BINOP_NOTEQ: {
+        switch (elem_type->kind)
+        {
+        case TYPE_FLOAT: op = SpvOpFOrdNotEqual; break;
+        case TYPE_INT: op = SpvOpINotEqual; break;
+        case TYPE_BOOL: op = SpvOpLogicalNotEqual; break;
+        default: assert(0); break;
+        }
+        break;
+    }
+
+    case BINOP_LESS: {
+        switch (elem_type->kind)
+        {
+        case TYPE_FLOAT: op = SpvOpFOrdLessThan; break;
+        case TYPE_INT:
+            if (elem_type->int_.is_signed)
+                op = SpvOpSLessThan;
+            else
+                op = SpvOpULessThan;
+            break;
+        default: assert(0); break;
+        }
+        break;
+    }
+
+    case BINOP_LESSEQ: {
+        switch (elem_type->kind)
+        {
+        case TYPE_FLOAT: op = SpvOpFOrdLessThanEqual; break;
+        case TYPE_INT:
+            if (elem_type->int_.is_signed)
+                op = SpvOpSLessThanEqual;
+            else
+                op = SpvOpULessThanEqual;
+            break;
+        default: assert(0); break;
+        }
+        break;
+    }
+
+    case BINOP_GREATER: {
+        switch (elem_type->kind)
+        {
+        case TYPE_FLOAT: op = SpvOpFOrdGreaterThan; break;
+        case TYPE_INT:
+            if (elem_type->int_.is_signed)
+                op = SpvOpSGreaterThan;
+            else
+                op = SpvOpUGreaterThan;
+            break;
+        default: assert(0); break;
+        }
+        break;
+    }
+
+    case BINOP_GREATEREQ: {
+        switch (elem_type->kind)
+        {
+        case TYPE_FLOAT: op = SpvOpFOrdGreaterThanEqual; break;
+        case TYPE_INT:
+            if (elem_type->int_.is_signed)
+                op = SpvOpSGreaterThanEqual;
+            else
+                op = SpvOpUGreaterThanEqual;
+            break;
+        default: assert(0); break;
+        }
+        break;
+    }
+    case BINOP_LSHIFT: {
+        op = SpvOpShiftLeftLogical;
+        break;
+    }
+    case BINOP_RSHIFT: {
+        op = SpvOpShiftRightLogical;
+        break;
+    }
+    case BINOP_BITXOR: {
+        op = SpvOpBitwiseXor;
+        break;
+    }
+    case BINOP_BITOR: {
+        op = SpvOpBitwiseOr;
+        break;
+    }
+    case BINOP_BITAND: {
+        op = SpvOpBitwiseAnd;
+        break;
+    }
+    case BINOP_LOGICAL_AND: {
+        op = SpvOpLogicalAnd;
+        break;
+    }
+    case BINOP_LOGICAL_OR: {
+        op = SpvOpLogicalOr;
+        break;
+    }
+    }
+
+    ast_mod->expr_values[expr->id] =
+        ts__irBuildBinary(ir_mod, op, ir_type, left_val, right_val);
+}
+
+static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExprId expr_id)
 {
     TsCompiler *compiler = ast_mod->compiler;
+    AstExpr *expr = ts__expr(compiler, expr_id);
 
     assert(expr->type);
 
+    // Folded during analysis, the operands have no side effects to emit
+    AstConst *const_value = ts__exprInfo(compiler, expr)->const_value;
+    if (const_value)
+    {
+        ast_mod->expr_values[expr_id] = astBuildConst(ast_mod, ir_mod, const_value);
+        return;
+    }
+
     switch (expr->kind)
     {
     case EXPR_PRIMARY: {
@@ -240,13 +520,13 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             switch (elem_type->kind)
             {
             case TYPE_FLOAT: {
-                expr->value =
+                ast_mod->expr_values[expr->id] =
                     ts__irBuildConstFloat(ir_mod, ir_elem_type, (double)expr->primary.token->double_);
                 break;
             }
 
             case TYPE_BOOL: {
-                expr->value = ts__irBuildConstBool(
+                ast_mod->expr_values[expr->id] = ts__irBuildConstBool(
                         ir_mod, expr->primary.token->double_ ? true : false);
                 break;
             }
@@ -263,19 +543,19 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             switch (elem_type->kind)
             {
             case TYPE_FLOAT: {
-                expr->value =
+                ast_mod->expr_values[expr->id] =
                     ts__irBuildConstFloat(ir_mod, ir_elem_type, (double)expr->primary.token->int_);
                 break;
             }
 
             case TYPE_INT: {
-                expr->value =
+                ast_mod->expr_values[expr->id] =
                     ts__irBuildConstInt(ir_mod, ir_elem_type, (uint64_t)expr->primary.token->int_);
                 break;
             }
 
             case TYPE_BOOL: {
-                expr->value = ts__irBuildConstBool(
+                ast_mod->expr_values[expr->id] = ts__irBuildConstBool(
                         ir_mod, expr->primary.token->int_ ? true : false);
                 break;
             }
@@ -287,12 +567,12 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
         }
 
         case TOKEN_TRUE: {
-            expr->value = ts__irBuildConstBool(ir_mod, true);
+            ast_mod->expr_values[expr->id] = ts__irBuildConstBool(ir_mod, true);
             break;
         }
 
         case TOKEN_FALSE: {
-            expr->value = ts__irBuildConstBool(ir_mod, false);
+            ast_mod->expr_values[expr->id] = ts__irBuildConstBool(ir_mod, false);
             break;
         }
 
@@ -303,31 +583,35 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
 
     case EXPR_VAR_ASSIGN: {
         astBuildExpr(ast_mod, ir_mod, expr->var_assign.value_expr);
-        IRInst *to_store = expr->var_assign.value_expr->value;
+        IRInst *to_store = ast_mod->expr_values[expr->var_assign.value_expr];
         assert(to_store);
         to_store = loadVal(ir_mod, to_store);
 
         astBuildExpr(ast_mod, ir_mod, expr->var_assign.assigned_expr);
-        IRInst *assigned_value = expr->var_assign.assigned_expr->value;
+        IRInst *assigned_value = ast_mod->expr_values[expr->var_assign.assigned_expr];
 
         ts__irBuildStore(ir_mod, assigned_value, to_store);
 
+        // The result of an assignment is the assigned value, so that
+        // chained assignments like 'a = b = c' work
+        ast_mod->expr_values[expr->id] = to_store;
+
         break;
     }
 
     case EXPR_IDENT: {
-        AstDecl *decl = expr->ident.decl;
+        AstDecl *decl = ts__decl(compiler, expr->ident.decl);
         switch (decl->kind)
         {
         case DECL_ALIAS:
         {
-            AstDecl *accessed = decl->alias.accessed;
+            AstDecl *accessed = ts__decl(compiler, decl->alias.accessed);
             assert(accessed->type);
             switch (accessed->type->kind)
             {
             case TYPE_CONSTANT_BUFFER:
             {
-                AstDecl *field_decl = decl->alias.field_decl;
+                AstDecl *field_decl = ts__decl(compiler, decl->alias.field_decl);
 
                 uint32_t field_index = field_decl->struct_field.index;
                 IRType *index_type = ts__irNewIntType(ir_mod, 32, false);
@@ -335,11 +619,11 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
 
                 IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, decl->type);
 
-                assert(decl->alias.accessed->value);
-                expr->value = ts__irBuildAccessChain(
+                assert(ast_mod->decl_values[decl->alias.accessed]);
+                ast_mod->expr_values[expr->id] = ts__irBuildAccessChain(
                     ir_mod,
                     ir_type,
-                    decl->alias.accessed->value,
+                    ast_mod->decl_values[decl->alias.accessed],
                     &index,
                     1);
 
@@ -355,7 +639,7 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
         default:
         {
             assert(decl);
-            expr->value = decl->value;
+            ast_mod->expr_values[expr->id] = ast_mod->decl_values[decl->id];
             break;
         }
         }
@@ -365,8 +649,8 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
     case EXPR_SUBSCRIPT: {
         astBuildExpr(ast_mod, ir_mod, expr->subscript.left);
         astBuildExpr(ast_mod, ir_mod, expr->subscript.right);
-        assert(expr->subscript.left->value);
-        assert(expr->subscript.right->value);
+        assert(ast_mod->expr_values[expr->subscript.left]);
+        assert(ast_mod->expr_values[expr->subscript.right]);
 
         IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
 
@@ -375,7 +659,7 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
 
         IRType *index_type = ts__irNewIntType(ir_mod, 32, false);
 
-        switch (expr->subscript.left->type->kind)
+        switch (ts__expr(compiler, expr->subscript.left)->type->kind)
         {
         case TYPE_RW_STRUCTURED_BUFFER:
         case TYPE_STRUCTURED_BUFFER: {
@@ -383,21 +667,21 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             indices = NEW_ARRAY(compiler, IRInst *, index_count);
 
             indices[0] = ts__irBuildConstInt(ir_mod, index_type, 0);
-            indices[1] = loadVal(ir_mod, expr->subscript.right->value);
+            indices[1] = loadVal(ir_mod, ast_mod->expr_values[expr->subscript.right]);
             break;
         }
 
         case TYPE_VECTOR: {
             index_count = 1;
             indices = NEW_ARRAY(compiler, IRInst *, index_count);
-            indices[0] = loadVal(ir_mod, expr->subscript.right->value);
+            indices[0] = loadVal(ir_mod, ast_mod->expr_values[expr->subscript.right]);
             break;
         }
 
         case TYPE_MATRIX: {
             index_count = 1;
             indices = NEW_ARRAY(compiler, IRInst *, index_count);
-            indices[0] = loadVal(ir_mod, expr->subscript.right->value);
+            indices[0] = loadVal(ir_mod, ast_mod->expr_values[expr->subscript.right]);
             break;
         }
 
@@ -406,8 +690,12 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
 
         assert(index_count > 0);
 
-        expr->value = ts__irBuildAccessChain(
-            ir_mod, ir_type, expr->subscript.left->value, indices, index_count);
+        ast_mod->expr_values[expr->id] = ts__irBuildAccessChain(
+            ir_mod,
+            ir_type,
+            ast_mod->expr_values[expr->subscript.left],
+            indices,
+            index_count);
 
         break;
     }
@@ -415,11 +703,11 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
     case EXPR_ACCESS: {
         IRType *index_type = ts__irNewIntType(ir_mod, 32, false);
 
-        AstExpr *base = expr->access.base;
+        AstExpr *base = ts__expr(compiler, expr->access.base);
         assert(base->type);
 
-        astBuildExpr(ast_mod, ir_mod, base);
-        IRInst *value = base->value;
+        astBuildExpr(ast_mod, ir_mod, base->id);
+        IRInst *value = ast_mod->expr_values[base->id];
         assert(value);
 
         uint32_t index_count = 0;
@@ -433,38 +721,45 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
 
             for (uint32_t i = 0; i < expr->access.chain.len; ++i)
             {
-                AstExpr *field_ident = expr->access.chain.ptr[i];
+                AstExpr *field_ident = ts__expr(compiler, expr->access.chain.ptr[i]);
                 assert(field_ident->kind == EXPR_IDENT);
 
                 if (!field_ident->ident.decl) break;
 
                 index_count++;
 
-                AstDecl *field_decl = field_ident->ident.decl;
+                AstDecl *field_decl = ts__decl(compiler, field_ident->ident.decl);
                 assert(field_decl->kind == DECL_STRUCT_FIELD);
 
                 indices[i] =
                     ts__irBuildConstInt(ir_mod, index_type, field_decl->struct_field.index);
             }
 
-            AstType *last_type = expr->access.chain.ptr[index_count - 1]->type;
+            AstType *last_type =
+                ts__expr(compiler, expr->access.chain.ptr[index_count - 1])->type;
             IRType *ir_last_type = convertTypeToIR(ast_mod, ir_mod, last_type);
             value =
-                ts__irBuildAccessChain(ir_mod, ir_last_type, base->value, indices, index_count);
+                ts__irBuildAccessChain(
+                    ir_mod,
+                    ir_last_type,
+                    ast_mod->expr_values[base->id],
+                    indices,
+                    index_count);
         }
 
         for (uint32_t i = index_count; i < expr->access.chain.len; ++i)
         {
             // Must be a vector swizzle
 
-            AstExpr *field_ident = expr->access.chain.ptr[i];
+            AstExpr *field_ident = ts__expr(compiler, expr->access.chain.ptr[i]);
             assert(field_ident->kind == EXPR_IDENT);
             assert(!field_ident->ident.decl);
-            assert(field_ident->ident.shuffle_indices);
-            assert(field_ident->ident.shuffle_index_count > 0);
+            const AstExprInfo *field_info = ts__exprInfo(compiler, field_ident);
+            assert(field_info->shuffle_indices);
+            assert(field_info->shuffle_index_count > 0);
 
-            uint32_t *shuffle_indices = field_ident->ident.shuffle_indices;
-            uint32_t shuffle_index_count = field_ident->ident.shuffle_index_count;
+            uint32_t *shuffle_indices = field_info->shuffle_indices;
+            uint32_t shuffle_index_count = field_info->shuffle_index_count;
 
             if (shuffle_index_count == 1)
             {
@@ -493,32 +788,28 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             }
         }
 
-        expr->value = value;
+        ast_mod->expr_values[expr->id] = value;
 
         break;
     }
 
     case EXPR_FUNC_CALL: {
-        AstExpr *func_expr = expr->func_call.func_expr;
+        AstExpr *func_expr = ts__expr(compiler, expr->func_call.func_expr);
 
-        bool is_builtin_func = false;
-        AstBuiltinFunction builtin_func_kind;
+        const AstBuiltinSignature *builtin_sig = NULL;
 
         // Builtin function
         if (func_expr->kind == EXPR_IDENT)
         {
             void *result;
-            is_builtin_func = ts__hashGet(
-                &compiler->builtin_function_table,
-                func_expr->ident.name,
-                &result);
-            if (is_builtin_func)
+            if (ts__hashGet(
+                    &compiler->builtin_function_table, func_expr->ident.name, &result))
             {
-                builtin_func_kind = (AstBuiltinFunction)result;
+                builtin_sig = result;
             }
         }
 
-        if (is_builtin_func)
+        if (builtin_sig)
         {
             IRType *result_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
             uint32_t param_count = expr->func_call.params.len;
@@ -526,13 +817,13 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
 
             for (uint32_t i = 0; i < param_count; ++i)
             {
-                AstExpr *param = expr->func_call.params.ptr[i];
+                AstExprId param = expr->func_call.params.ptr[i];
                 astBuildExpr(ast_mod, ir_mod, param);
-                param_values[i] = param->value;
+                param_values[i] = ast_mod->expr_values[param];
                 assert(param_values[i]);
             }
 
-            switch (builtin_func_kind)
+            switch (builtin_sig->kind)
             {
             case AST_BUILTIN_FUNC_INTERLOCKED_ADD:
             case AST_BUILTIN_FUNC_INTERLOCKED_AND:
@@ -551,20 +842,8 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                     ts__irBuildConstInt(ir_mod, uint_type, SpvMemorySemanticsMaskNone);
                 ir_param_values[3] = param_values[1];
 
-                IRBuiltinInstKind ir_builtin_kind;
-                switch (builtin_func_kind)
-                {
-                case AST_BUILTIN_FUNC_INTERLOCKED_ADD: ir_builtin_kind = IR_BUILTIN_INTERLOCKED_ADD; break;
-                case AST_BUILTIN_FUNC_INTERLOCKED_AND: ir_builtin_kind = IR_BUILTIN_INTERLOCKED_AND; break;
-                case AST_BUILTIN_FUNC_INTERLOCKED_MIN: ir_builtin_kind = IR_BUILTIN_INTERLOCKED_MIN; break;
-                case AST_BUILTIN_FUNC_INTERLOCKED_MAX: ir_builtin_kind = IR_BUILTIN_INTERLOCKED_MAX; break;
-                case AST_BUILTIN_FUNC_INTERLOCKED_OR: ir_builtin_kind = IR_BUILTIN_INTERLOCKED_OR; break;
-                case AST_BUILTIN_FUNC_INTERLOCKED_XOR: ir_builtin_kind = IR_BUILTIN_INTERLOCKED_XOR; break;
-                default: assert(0); break;
-                }
-
-                expr->value = ts__irBuildBuiltinCall(
-                    ir_mod, ir_builtin_kind, result_type, ir_param_values, ir_param_count);
+                ast_mod->expr_values[expr->id] = ts__irBuildBuiltinCall(
+                    ir_mod, builtin_sig->ir_kind, result_type, ir_param_values, ir_param_count);
                 break;
             }
 
@@ -580,12 +859,12 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 ir_param_values[3] = param_values[1];
                 ir_param_values[4] = param_values[2];
 
-                expr->value = ts__irBuildBuiltinCall(
+                ast_mod->expr_values[expr->id] = ts__irBuildBuiltinCall(
                     ir_mod, IR_BUILTIN_INTERLOCKED_EXCHANGE, result_type, ir_param_values, ir_param_count);
                 break;
             }
 
-            case IR_BUILTIN_INTERLOCKED_COMPARE_EXCHANGE: {
+            case AST_BUILTIN_FUNC_INTERLOCKED_COMPARE_EXCHANGE: {
                 uint32_t ir_param_count = 7;
                 IRInst **ir_param_values = NEW_ARRAY(compiler, IRInst *, ir_param_count);
 
@@ -599,7 +878,7 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 ir_param_values[5] = param_values[2];
                 ir_param_values[6] = param_values[3];
 
-                expr->value = ts__irBuildBuiltinCall(
+                ast_mod->expr_values[expr->id] = ts__irBuildBuiltinCall(
                     ir_mod, IR_BUILTIN_INTERLOCKED_COMPARE_EXCHANGE, result_type, ir_param_values, ir_param_count);
                 break;
             }
@@ -617,7 +896,7 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 ir_param_values[4] = param_values[1];
                 ir_param_values[5] = param_values[2];
 
-                expr->value = ts__irBuildBuiltinCall(
+                ast_mod->expr_values[expr->id] = ts__irBuildBuiltinCall(
                     ir_mod, IR_BUILTIN_INTERLOCKED_COMPARE_STORE, result_type, ir_param_values, ir_param_count);
                 break;
             }
@@ -633,7 +912,7 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 uint32_t barrier_memory_scope = 0;
                 uint32_t barrier_semantics = 0;
 
-                switch (builtin_func_kind)
+                switch (builtin_sig->kind)
                 {
                 case AST_BUILTIN_FUNC_ALL_MEMORY_BARRIER: {
                     with_group_sync = false;
@@ -688,7 +967,7 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 default: assert(0); break;
                 }
 
-                expr->value = ts__irBuildBarrier(
+                ast_mod->expr_values[expr->id] = ts__irBuildBarrier(
                     ir_mod,
                     with_group_sync,
                     barrier_execution_scope,
@@ -699,75 +978,6 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             }
 
             default: {
-                IRBuiltinInstKind ir_builtin_kind;
-                switch (builtin_func_kind)
-                {
-                case AST_BUILTIN_FUNC_ABS: ir_builtin_kind = IR_BUILTIN_ABS; break;
-                case AST_BUILTIN_FUNC_ACOS: ir_builtin_kind = IR_BUILTIN_ACOS; break;
-                case AST_BUILTIN_FUNC_ASFLOAT: ir_builtin_kind = IR_BUILTIN_ASFLOAT; break;
-                case AST_BUILTIN_FUNC_ASIN: ir_builtin_kind = IR_BUILTIN_ASIN; break;
-                case AST_BUILTIN_FUNC_ASINT: ir_builtin_kind = IR_BUILTIN_ASINT; break;
-                case AST_BUILTIN_FUNC_ASUINT: ir_builtin_kind = IR_BUILTIN_ASUINT; break;
-                case AST_BUILTIN_FUNC_ATAN: ir_builtin_kind = IR_BUILTIN_ATAN; break;
-                case AST_BUILTIN_FUNC_ATAN2: ir_builtin_kind = IR_BUILTIN_ATAN2; break;
-                case AST_BUILTIN_FUNC_CEIL: ir_builtin_kind = IR_BUILTIN_CEIL; break;
-                case AST_BUILTIN_FUNC_CLAMP: ir_builtin_kind = IR_BUILTIN_CLAMP; break;
-                case AST_BUILTIN_FUNC_COS: ir_builtin_kind = IR_BUILTIN_COS; break;
-                case AST_BUILTIN_FUNC_COSH: ir_builtin_kind = IR_BUILTIN_COSH; break;
-                case AST_BUILTIN_FUNC_CROSS: ir_builtin_kind = IR_BUILTIN_CROSS; break;
-                case AST_BUILTIN_FUNC_DDX: ir_builtin_kind = IR_BUILTIN_DDX; break;
-                case AST_BUILTIN_FUNC_DDY: ir_builtin_kind = IR_BUILTIN_DDY; break;
-                case AST_BUILTIN_FUNC_DEGREES: ir_builtin_kind = IR_BUILTIN_DEGREES; break;
-                case AST_BUILTIN_FUNC_DETERMINANT: ir_builtin_kind = IR_BUILTIN_DETERMINANT; break;
-                case AST_BUILTIN_FUNC_DISTANCE: ir_builtin_kind = IR_BUILTIN_DISTANCE; break;
-                case AST_BUILTIN_FUNC_DOT: ir_builtin_kind = IR_BUILTIN_DOT; break;
-                case AST_BUILTIN_FUNC_EXP: ir_builtin_kind = IR_BUILTIN_EXP; break;
-                case AST_BUILTIN_FUNC_EXP2: ir_builtin_kind = IR_BUILTIN_EXP2; break;
-                case AST_BUILTIN_FUNC_FLOOR: ir_builtin_kind = IR_BUILTIN_FLOOR; break;
-                case AST_BUILTIN_FUNC_FMOD: ir_builtin_kind = IR_BUILTIN_FMOD; break;
-                case AST_BUILTIN_FUNC_FRAC: ir_builtin_kind = IR_BUILTIN_FRAC; break;
-                case AST_BUILTIN_FUNC_LENGTH: ir_builtin_kind = IR_BUILTIN_LENGTH; break;
-                case AST_BUILTIN_FUNC_LERP: ir_builtin_kind = IR_BUILTIN_LERP; break;
-                case AST_BUILTIN_FUNC_LOG: ir_builtin_kind = IR_BUILTIN_LOG; break;
-                case AST_BUILTIN_FUNC_LOG2: ir_builtin_kind = IR_BUILTIN_LOG2; break;
-                case AST_BUILTIN_FUNC_MAX: ir_builtin_kind = IR_BUILTIN_MAX; break;
-                case AST_BUILTIN_FUNC_MIN: ir_builtin_kind = IR_BUILTIN_MIN; break;
-                case AST_BUILTIN_FUNC_MUL: ir_builtin_kind = IR_BUILTIN_MUL; break;
-                case AST_BUILTIN_FUNC_NORMALIZE: ir_builtin_kind = IR_BUILTIN_NORMALIZE; break;
-                case AST_BUILTIN_FUNC_POW: ir_builtin_kind = IR_BUILTIN_POW; break;
-                case AST_BUILTIN_FUNC_RADIANS: ir_builtin_kind = IR_BUILTIN_RADIANS; break;
-                case AST_BUILTIN_FUNC_REFLECT: ir_builtin_kind = IR_BUILTIN_REFLECT; break;
-                case AST_BUILTIN_FUNC_REFRACT: ir_builtin_kind = IR_BUILTIN_REFRACT; break;
-                case AST_BUILTIN_FUNC_RSQRT: ir_builtin_kind = IR_BUILTIN_RSQRT; break;
-                case AST_BUILTIN_FUNC_SIN: ir_builtin_kind = IR_BUILTIN_SIN; break;
-                case AST_BUILTIN_FUNC_SINH: ir_builtin_kind = IR_BUILTIN_SINH; break;
-                case AST_BUILTIN_FUNC_SMOOTHSTEP: ir_builtin_kind = IR_BUILTIN_SMOOTHSTEP; break;
-                case AST_BUILTIN_FUNC_SQRT: ir_builtin_kind = IR_BUILTIN_SQRT; break;
-                case AST_BUILTIN_FUNC_STEP: ir_builtin_kind = IR_BUILTIN_STEP; break;
-                case AST_BUILTIN_FUNC_TAN: ir_builtin_kind = IR_BUILTIN_TAN; break;
-                case AST_BUILTIN_FUNC_TANH: ir_builtin_kind = IR_BUILTIN_TANH; break;
-                case AST_BUILTIN_FUNC_TRANSPOSE: ir_builtin_kind = IR_BUILTIN_TRANSPOSE; break;
-                case AST_BUILTIN_FUNC_TRUNC: ir_builtin_kind = IR_BUILTIN_TRUNC; break;
-
-                case AST_BUILTIN_FUNC_INTERLOCKED_ADD:
-                case AST_BUILTIN_FUNC_INTERLOCKED_AND:
-                case AST_BUILTIN_FUNC_INTERLOCKED_COMPARE_EXCHANGE:
-                case AST_BUILTIN_FUNC_INTERLOCKED_COMPARE_STORE:
-                case AST_BUILTIN_FUNC_INTERLOCKED_EXCHANGE:
-                case AST_BUILTIN_FUNC_INTERLOCKED_MAX:
-                case AST_BUILTIN_FUNC_INTERLOCKED_MIN:
-                case AST_BUILTIN_FUNC_INTERLOCKED_OR:
-                case AST_BUILTIN_FUNC_INTERLOCKED_XOR:
-                case AST_BUILTIN_FUNC_ALL_MEMORY_BARRIER:
-                case AST_BUILTIN_FUNC_ALL_MEMORY_BARRIER_WITH_GROUP_SYNC:
-                case AST_BUILTIN_FUNC_DEVICE_MEMORY_BARRIER:
-                case AST_BUILTIN_FUNC_DEVICE_MEMORY_BARRIER_WITH_GROUP_SYNC:
-                case AST_BUILTIN_FUNC_GROUP_MEMORY_BARRIER:
-                case AST_BUILTIN_FUNC_GROUP_MEMORY_BARRIER_WITH_GROUP_SYNC:
-                    assert(0);
-                    break;
-                }
-
                 uint32_t ir_param_count = param_count;
                 IRInst **ir_param_values = NEW_ARRAY(compiler, IRInst *, ir_param_count);
 
@@ -777,41 +987,42 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                     assert(ir_param_values[i]);
                 }
 
-                expr->value = ts__irBuildBuiltinCall(
-                    ir_mod, ir_builtin_kind, result_type, ir_param_values, ir_param_count);
+                ast_mod->expr_values[expr->id] = ts__irBuildBuiltinCall(
+                    ir_mod, builtin_sig->ir_kind, result_type, ir_param_values, ir_param_count);
                 break;
             }
             }
 
-            assert(expr->value);
+            assert(ast_mod->expr_values[expr->id]);
             break;
         }
 
         if (expr->func_call.self_param)
         {
             // Method call
-            AstExpr *method_name_expr = expr->func_call.func_expr;
+            AstExpr *method_name_expr = ts__expr(compiler, expr->func_call.func_expr);
             assert(method_name_expr->kind == EXPR_IDENT);
             char *method_name = method_name_expr->ident.name;
 
-            AstType *self_type = expr->func_call.self_param->type;
+            AstType *self_type = ts__expr(compiler, expr->func_call.self_param)->type;
 
             astBuildExpr(ast_mod, ir_mod, expr->func_call.self_param);
-            assert(expr->func_call.self_param->value);
+            assert(ast_mod->expr_values[expr->func_call.self_param]);
 
             if (self_type->kind == TYPE_IMAGE && strcmp(method_name, "Sample") == 0)
             {
                 uint32_t param_count = arrLength(expr->func_call.params);
                 IRInst **param_values = NEW_ARRAY(compiler, IRInst *, param_count);
 
-                IRInst *self_value = loadVal(ir_mod, expr->func_call.self_param->value);
+                IRInst *self_value =
+                    loadVal(ir_mod, ast_mod->expr_values[expr->func_call.self_param]);
 
                 for (uint32_t i = 0; i < arrLength(expr->func_call.params); ++i)
                 {
-                    AstExpr *param = expr->func_call.params.ptr[i];
+                    AstExprId param = expr->func_call.params.ptr[i];
                     astBuildExpr(ast_mod, ir_mod, param);
-                    assert(param->value);
-                    param_values[i] = loadVal(ir_mod, param->value);
+                    assert(ast_mod->expr_values[param]);
+                    param_values[i] = loadVal(ir_mod, ast_mod->expr_values[param]);
                 }
 
                 IRInst **sampled_image_params = NEW_ARRAY(compiler, IRInst *, 2);
@@ -827,7 +1038,7 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
 
                 IRType *result_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
                 IRInst *coords = param_values[1];
-                expr->value =
+                ast_mod->expr_values[expr->id] =
                     ts__irBuildSampleImplicitLod(ir_mod, result_type, sampled_image, coords);
             }
             else if (
@@ -836,14 +1047,15 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 uint32_t param_count = arrLength(expr->func_call.params);
                 IRInst **param_values = NEW_ARRAY(compiler, IRInst *, param_count);
 
-                IRInst *self_value = loadVal(ir_mod, expr->func_call.self_param->value);
+                IRInst *self_value =
+                    loadVal(ir_mod, ast_mod->expr_values[expr->func_call.self_param]);
 
                 for (uint32_t i = 0; i < arrLength(expr->func_call.params); ++i)
                 {
-                    AstExpr *param = expr->func_call.params.ptr[i];
+                    AstExprId param = expr->func_call.params.ptr[i];
                     astBuildExpr(ast_mod, ir_mod, param);
-                    assert(param->value);
-                    param_values[i] = loadVal(ir_mod, param->value);
+                    assert(ast_mod->expr_values[param]);
+                    param_values[i] = loadVal(ir_mod, ast_mod->expr_values[param]);
                 }
 
                 IRInst **sampled_image_params = NEW_ARRAY(compiler, IRInst *, 2);
@@ -860,7 +1072,7 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 IRType *result_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
                 IRInst *coords = param_values[1];
                 IRInst *lod = param_values[2];
-                expr->value =
+                ast_mod->expr_values[expr->id] =
                     ts__irBuildSampleExplicitLod(ir_mod, result_type, sampled_image, coords, lod);
             }
             else if (
@@ -870,14 +1082,15 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 uint32_t param_count = expr->func_call.params.len;
                 IRInst **param_values = NEW_ARRAY(compiler, IRInst *, param_count);
 
-                IRInst *image = loadVal(ir_mod, expr->func_call.self_param->value);
+                IRInst *image =
+                    loadVal(ir_mod, ast_mod->expr_values[expr->func_call.self_param]);
 
                 for (uint32_t i = 0; i < expr->func_call.params.len; ++i)
                 {
-                    AstExpr *param = expr->func_call.params.ptr[i];
+                    AstExprId param = expr->func_call.params.ptr[i];
                     astBuildExpr(ast_mod, ir_mod, param);
-                    assert(param->value);
-                    param_values[i] = param->value;
+                    assert(ast_mod->expr_values[param]);
+                    param_values[i] = ast_mod->expr_values[param];
                 }
 
                 IRInst *lod = loadVal(ir_mod, param_values[0]);
@@ -973,18 +1186,18 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             break;
         }
 
-        AstType *func_type = expr->func_call.func_expr->type;
+        AstType *func_type = func_expr->type;
         assert(func_type);
 
         if (func_type->kind == TYPE_TYPE)
         {
             // Type constructor
-            AstType *constructed_type = expr->func_call.func_expr->as_type;
+            AstType *constructed_type = ts__exprInfo(compiler, func_expr)->as_type;
             assert(constructed_type);
             IRType *ir_constructed_type = convertTypeToIR(ast_mod, ir_mod, constructed_type);
 
             uint32_t param_count = arrLength(expr->func_call.params);
-            ArrayOfAstExprPtr params = expr->func_call.params;
+            AstExprList params = expr->func_call.params;
 
             switch (constructed_type->kind)
             {
@@ -996,13 +1209,15 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 for (uint32_t i = 0; i < param_count; ++i)
                 {
                     astBuildExpr(ast_mod, ir_mod, params.ptr[i]);
-                    assert(params.ptr[i]->value);
-                    IRInst *param_val = loadVal(ir_mod, params.ptr[i]->value);
+                    assert(ast_mod->expr_values[params.ptr[i]]);
+                    IRInst *param_val =
+                        loadVal(ir_mod, ast_mod->expr_values[params.ptr[i]]);
 
-                    if (params.ptr[i]->type->kind == TYPE_VECTOR)
+                    AstType *param_type = ts__expr(compiler, params.ptr[i])->type;
+                    if (param_type->kind == TYPE_VECTOR)
                     {
                         for (uint32_t j = 0;
-                            j < ts__getTypeElemCount(params.ptr[i]->type);
+                            j < ts__getTypeElemCount(param_type);
                             ++j)
                         {
                             elems[elem_index++] =
@@ -1017,7 +1232,7 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
 
                 assert(elem_index == elem_count);
 
-                expr->value = ts__irBuildCompositeConstruct(
+                ast_mod->expr_values[expr->id] = ts__irBuildCompositeConstruct(
                     ir_mod, ir_constructed_type, elems, elem_count);
                 break;
             }
@@ -1038,18 +1253,18 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                     IRInst **col_fields = NEW_ARRAY(compiler, IRInst *, col_size);
                     for (uint32_t j = 0; j < col_size; ++j)
                     {
-                        AstExpr *elem = params.ptr[i * col_size + j];
+                        AstExprId elem = params.ptr[i * col_size + j];
 
                         astBuildExpr(ast_mod, ir_mod, elem);
-                        assert(elem->value);
-                        col_fields[j] = loadVal(ir_mod, elem->value);
+                        assert(ast_mod->expr_values[elem]);
+                        col_fields[j] = loadVal(ir_mod, ast_mod->expr_values[elem]);
                     }
 
                     columns[i] = ts__irBuildCompositeConstruct(
                         ir_mod, ir_constructed_type->matrix.col_type, col_fields, col_size);
                 }
 
-                expr->value =
+                ast_mod->expr_values[expr->id] =
                     ts__irBuildCompositeConstruct(ir_mod, ir_constructed_type, columns, col_count);
                 break;
             }
@@ -1058,9 +1273,10 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 assert(param_count == 1);
 
                 astBuildExpr(ast_mod, ir_mod, params.ptr[0]);
-                assert(params.ptr[0]->value);
-                expr->value = ts__irBuildCast(
-                    ir_mod, ir_constructed_type, loadVal(ir_mod, params.ptr[0]->value));
+                assert(ast_mod->expr_values[params.ptr[0]]);
+                ast_mod->expr_values[expr->id] = ts__irBuildCast(
+                    ir_mod, ir_constructed_type, loadVal(
+                        ir_mod, ast_mod->expr_values[params.ptr[0]]));
                 break;
             }
             default: {
@@ -1075,7 +1291,7 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             assert(func_type->kind == TYPE_FUNC);
 
             astBuildExpr(ast_mod, ir_mod, expr->func_call.func_expr);
-            IRInst *func_val = expr->func_call.func_expr->value;
+            IRInst *func_val = ast_mod->expr_values[expr->func_call.func_expr];
             assert(func_val);
 
             uint32_t param_count = arrLength(expr->func_call.params);
@@ -1083,17 +1299,17 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
 
             for (uint32_t i = 0; i < param_count; ++i)
             {
-                AstExpr *param = expr->func_call.params.ptr[i];
+                AstExprId param = expr->func_call.params.ptr[i];
                 astBuildExpr(ast_mod, ir_mod, param);
-                assert(param->value);
-                param_values[i] = param->value;
+                assert(ast_mod->expr_values[param]);
+                param_values[i] = ast_mod->expr_values[param];
                 if (func_type->func.params[i]->kind == TYPE_POINTER)
                 {
                     if (!isLvalue(param_values[i]))
                     {
-                        ts__addErr(
+                        ts__addErrAt(
                             compiler,
-                            &param->loc,
+                            ts__expr(compiler, param)->loc,
                             "function parameter needs to be an lvalue");
                     }
                 }
@@ -1103,7 +1319,8 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 }
             }
 
-            expr->value = ts__irBuildFuncCall(ir_mod, func_val, param_values, param_count);
+            ast_mod->expr_values[expr->id] =
+                ts__irBuildFuncCall(ir_mod, func_val, param_values, param_count);
         }
 
         break;
@@ -1114,7 +1331,7 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
         {
         case UNOP_NEG: {
             astBuildExpr(ast_mod, ir_mod, expr->unary.right);
-            IRInst *right_val = loadVal(ir_mod, expr->unary.right->value);
+            IRInst *right_val = loadVal(ir_mod, ast_mod->expr_values[expr->unary.right]);
 
             AstType *scalar_type = ts__getScalarType(expr->type);
             SpvOp op = {0};
@@ -1127,7 +1344,8 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             }
 
             IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
-            expr->value = ts__irBuildUnary(ir_mod, op, ir_type, right_val);
+            ast_mod->expr_values[expr->id] =
+                ts__irBuildUnary(ir_mod, op, ir_type, right_val);
             break;
         }
 
@@ -1135,16 +1353,17 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             assert(0); // TODO: broken: use SpvINotEqual + SpvOpLogicalNot
 
             astBuildExpr(ast_mod, ir_mod, expr->unary.right);
-            IRInst *right_val = loadVal(ir_mod, expr->unary.right->value);
+            IRInst *right_val = loadVal(ir_mod, ast_mod->expr_values[expr->unary.right]);
 
             IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
-            expr->value = ts__irBuildUnary(ir_mod, SpvOpNot, ir_type, right_val);
+            ast_mod->expr_values[expr->id] =
+                ts__irBuildUnary(ir_mod, SpvOpNot, ir_type, right_val);
             break;
         }
 
         case UNOP_PRE_INC: {
             astBuildExpr(ast_mod, ir_mod, expr->unary.right);
-            IRInst *right_val_ptr = expr->unary.right->value;
+            IRInst *right_val_ptr = ast_mod->expr_values[expr->unary.right];
             IRInst *right_val = loadVal(ir_mod, right_val_ptr);
 
             IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
@@ -1165,18 +1384,19 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             default: assert(0); break;
             }
 
-            expr->value = ts__irBuildBinary(ir_mod, op_kind, ir_type, right_val, one_val);
+            ast_mod->expr_values[expr->id] =
+                ts__irBuildBinary(ir_mod, op_kind, ir_type, right_val, one_val);
 
             if (isLvalue(right_val_ptr))
             {
-                ts__irBuildStore(ir_mod, right_val_ptr, expr->value);
+                ts__irBuildStore(ir_mod, right_val_ptr, ast_mod->expr_values[expr->id]);
             }
             break;
         }
 
         case UNOP_PRE_DEC: {
             astBuildExpr(ast_mod, ir_mod, expr->unary.right);
-            IRInst *right_val_ptr = expr->unary.right->value;
+            IRInst *right_val_ptr = ast_mod->expr_values[expr->unary.right];
             IRInst *right_val = loadVal(ir_mod, right_val_ptr);
 
             IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
@@ -1197,18 +1417,19 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             default: assert(0); break;
             }
 
-            expr->value = ts__irBuildBinary(ir_mod, op_kind, ir_type, right_val, one_val);
+            ast_mod->expr_values[expr->id] =
+                ts__irBuildBinary(ir_mod, op_kind, ir_type, right_val, one_val);
 
             if (isLvalue(right_val_ptr))
             {
-                ts__irBuildStore(ir_mod, right_val_ptr, expr->value);
+                ts__irBuildStore(ir_mod, right_val_ptr, ast_mod->expr_values[expr->id]);
             }
             break;
         }
 
         case UNOP_POST_INC: {
             astBuildExpr(ast_mod, ir_mod, expr->unary.right);
-            IRInst *right_val_ptr = expr->unary.right->value;
+            IRInst *right_val_ptr = ast_mod->expr_values[expr->unary.right];
             IRInst *right_val = loadVal(ir_mod, right_val_ptr);
 
             IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
@@ -1237,13 +1458,13 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                     ts__irBuildBinary(ir_mod, op_kind, ir_type, right_val, one_val));
             }
 
-            expr->value = right_val;
+            ast_mod->expr_values[expr->id] = right_val;
             break;
         }
 
         case UNOP_POST_DEC: {
             astBuildExpr(ast_mod, ir_mod, expr->unary.right);
-            IRInst *right_val_ptr = expr->unary.right->value;
+            IRInst *right_val_ptr = ast_mod->expr_values[expr->unary.right];
             IRInst *right_val = loadVal(ir_mod, right_val_ptr);
 
             IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
@@ -1272,16 +1493,17 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                     ts__irBuildBinary(ir_mod, op_kind, ir_type, right_val, one_val));
             }
 
-            expr->value = right_val;
+            ast_mod->expr_values[expr->id] = right_val;
             break;
         }
 
         case UNOP_BITNOT: {
             astBuildExpr(ast_mod, ir_mod, expr->unary.right);
-            IRInst *right_val = loadVal(ir_mod, expr->unary.right->value);
+            IRInst *right_val = loadVal(ir_mod, ast_mod->expr_values[expr->unary.right]);
 
             IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
-            expr->value = ts__irBuildUnary(ir_mod, SpvOpNot, ir_type, right_val);
+            ast_mod->expr_values[expr->id] =
+                ts__irBuildUnary(ir_mod, SpvOpNot, ir_type, right_val);
             break;
         }
         }
@@ -1289,224 +1511,29 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
     }
 
     case EXPR_BINARY: {
-        astBuildExpr(ast_mod, ir_mod, expr->binary.left);
-        IRInst *left_val = loadVal(ir_mod, expr->binary.left->value);
-        astBuildExpr(ast_mod, ir_mod, expr->binary.right);
-        IRInst *right_val = loadVal(ir_mod, expr->binary.right->value);
-
-        AstType *elem_type = ts__getElemType(expr->binary.left->type);
-        assert(elem_type);
-        SpvOp op = {0};
-
-        IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
-
-        switch (expr->binary.op)
+        // Left operands are built in a loop, machine generated chains like
+        // 'a + b + c + ...' are as deep as they are long
+        size_t base = ast_mod->binary_stack.len;
+        AstExpr *leaf = expr;
+        while (leaf->kind == EXPR_BINARY && !ts__exprInfo(compiler, leaf)->const_value)
         {
-        case BINOP_ADD:
-        case BINOP_SUB:
-        case BINOP_MUL:
-        case BINOP_DIV:
-        case BINOP_MOD: {
-            if (left_val->type->kind == IR_TYPE_VECTOR &&
-                right_val->type->kind != IR_TYPE_VECTOR)
-            {
-                uint32_t field_count = left_val->type->vector.size;
-
-                IRInst **fields = NEW_ARRAY(compiler, IRInst *, field_count);
-                for (uint32_t i = 0; i < field_count; ++i)
-                {
-                    fields[i] = right_val;
-                }
-                right_val = ts__irBuildCompositeConstruct(ir_mod, ir_type, fields, field_count);
-            }
-            else if (
-                right_val->type->kind == IR_TYPE_VECTOR &&
-                left_val->type->kind != IR_TYPE_VECTOR)
-            {
-                uint32_t field_count = right_val->type->vector.size;
-
-                IRInst **fields = NEW_ARRAY(compiler, IRInst *, field_count);
-                for (uint32_t i = 0; i < field_count; ++i)
-                {
-                    fields[i] = left_val;
-                }
-                left_val = ts__irBuildCompositeConstruct(ir_mod, ir_type, fields, field_count);
-            }
-
-            break;
-        }
-
-        default: break;
+            arrPush(compiler, &ast_mod->binary_stack, leaf);
+            leaf = ts__expr(compiler, leaf->binary.left);
         }
 
-        switch (expr->binary.op)
+        astBuildExpr(ast_mod, ir_mod, leaf->id);
+        IRInst *left_val = loadVal(ir_mod, ast_mod->expr_values[leaf->id]);
+        for (size_t i = ast_mod->binary_stack.len; i-- > base;)
         {
-        case BINOP_ADD: {
-            switch (elem_type->kind)
-            {
-            case TYPE_FLOAT: op = SpvOpFAdd; break;
-            case TYPE_INT: op = SpvOpIAdd; break;
-            default: assert(0); break;
-            }
-            break;
-        }
-        case BINOP_SUB: {
-            switch (elem_type->kind)
-            {
-            case TYPE_FLOAT: op = SpvOpFSub; break;
-            case TYPE_INT: op = SpvOpISub; break;
-            default: assert(0); break;
-            }
-            break;
-        }
-        case BINOP_MUL: {
-            switch (elem_type->kind)
-            {
-            case TYPE_FLOAT: op = SpvOpFMul; break;
-            case TYPE_INT: op = SpvOpIMul; break;
-            default: assert(0); break;
-            }
-            break;
-        }
-        case BINOP_DIV: {
-            switch (elem_type->kind)
-            {
-            case TYPE_FLOAT: op = SpvOpFDiv; break;
-            case TYPE_INT:
-                if (elem_type->int_.is_signed)
-                    op = SpvOpSDiv;
-                else
-                    op = SpvOpUDiv;
-                break;
-            default: assert(0); break;
-            }
-            break;
-        }
-        case BINOP_MOD: {
-            switch (elem_type->kind)
-            {
-            case TYPE_FLOAT: op = SpvOpFRem; break;
-            case TYPE_INT:
-                if (elem_type->int_.is_signed)
-                    op = SpvOpSMod;
-                else
-                    op = SpvOpUMod;
-                break;
-            default: assert(0); break;
-            }
-            break;
-        }
+            AstExpr *binary = ast_mod->binary_stack.ptr[i];
+            astBuildExpr(ast_mod, ir_mod, binary->binary.right);
+            IRInst *right_val =
+                loadVal(ir_mod, ast_mod->expr_values[binary->binary.right]);
 
-        case BINOP_EQ: {
-            switch (elem_type->kind)
-            {
-            case TYPE_FLOAT: op = SpvOpFOrdEqual; break;
-            case TYPE_INT: op = SpvOpIEqual; break;
-            default: assert(0); break;
-            }
-            break;
+            astBuildBinaryExpr(ast_mod, ir_mod, binary, left_val, right_val);
+            left_val = loadVal(ir_mod, ast_mod->expr_values[binary->id]);
         }
-
-        case BINOP_NOTEQ: {
-            switch (elem_type->kind)
-            {
-            case TYPE_FLOAT: op = SpvOpFOrdNotEqual; break;
-            case TYPE_INT: op = SpvOpINotEqual; break;
-            default: assert(0); break;
-            }
-            break;
-        }
-
-        case BINOP_LESS: {
-            switch (elem_type->kind)
-            {
-            case TYPE_FLOAT: op = SpvOpFOrdLessThan; break;
-            case TYPE_INT:
-                if (elem_type->int_.is_signed)
-                    op = SpvOpSLessThan;
-                else
-                    op = SpvOpULessThan;
-                break;
-            default: assert(0); break;
-            }
-            break;
-        }
-
-        case BINOP_LESSEQ: {
-            switch (elem_type->kind)
-            {
-            case TYPE_FLOAT: op = SpvOpFOrdLessThanEqual; break;
-            case TYPE_INT:
-                if (elem_type->int_.is_signed)
-                    op = SpvOpSLessThanEqual;
-                else
-                    op = SpvOpULessThanEqual;
-                break;
-            default: assert(0); break;
-            }
-            break;
-        }
-
-        case BINOP_GREATER: {
-            switch (elem_type->kind)
-            {
-            case TYPE_FLOAT: op = SpvOpFOrdGreaterThan; break;
-            case TYPE_INT:
-                if (elem_type->int_.is_signed)
-                    op = SpvOpSGreaterThan;
-                else
-                    op = SpvOpUGreaterThan;
-                break;
-            default: assert(0); break;
-            }
-            break;
-        }
-
-        case BINOP_GREATEREQ: {
-            switch (elem_type->kind)
-            {
-            case TYPE_FLOAT: op = SpvOpFOrdGreaterThanEqual; break;
-            case TYPE_INT:
-                if (elem_type->int_.is_signed)
-                    op = SpvOpSGreaterThanEqual;
-                else
-                    op = SpvOpUGreaterThanEqual;
-                break;
-            default: assert(0); break;
-            }
-            break;
-        }
-        case BINOP_LSHIFT: {
-            op = SpvOpShiftLeftLogical;
-            break;
-        }
-        case BINOP_RSHIFT: {
-            op = SpvOpShiftRightLogical;
-            break;
-        }
-        case BINOP_BITXOR: {
-            op = SpvOpBitwiseXor;
-            break;
-        }
-        case BINOP_BITOR: {
-            op = SpvOpBitwiseOr;
-            break;
-        }
-        case BINOP_BITAND: {
-            op = SpvOpBitwiseAnd;
-            break;
-        }
-        case BINOP_LOGICAL_AND: {
-            op = SpvOpLogicalAnd;
-            break;
-        }
-        case BINOP_LOGICAL_OR: {
-            op = SpvOpLogicalOr;
-            break;
-        }
-        }
-
-        expr->value = ts__irBuildBinary(ir_mod, op, ir_type, left_val, right_val);
+        ast_mod->binary_stack.len = base;
 
         break;
     }
@@ -1515,13 +1542,15 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
         IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
 
         astBuildExpr(ast_mod, ir_mod, expr->ternary.cond);
-        IRInst *cond = loadVal(ir_mod, expr->ternary.cond->value);
+        IRInst *cond = loadVal(ir_mod, ast_mod->expr_values[expr->ternary.cond]);
 
         astBuildExpr(ast_mod, ir_mod, expr->ternary.true_expr);
-        IRInst *true_value = loadVal(ir_mod, expr->ternary.true_expr->value);
+        IRInst *true_value =
+            loadVal(ir_mod, ast_mod->expr_values[expr->ternary.true_expr]);
 
         astBuildExpr(ast_mod, ir_mod, expr->ternary.false_expr);
-        IRInst *false_value = loadVal(ir_mod, expr->ternary.false_expr->value);
+        IRInst *false_value =
+            loadVal(ir_mod, ast_mod->expr_values[expr->ternary.false_expr]);
 
         if (ir_type->kind == IR_TYPE_VECTOR)
         {
@@ -1536,18 +1565,20 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
                 ts__irBuildCompositeConstruct(ir_mod, cond_vec_type, fields, ir_type->vector.size);
         }
 
-        expr->value = ts__irBuildSelect(ir_mod, ir_type, cond, true_value, false_value);
+        ast_mod->expr_values[expr->id] =
+            ts__irBuildSelect(ir_mod, ir_type, cond, true_value, false_value);
         break;
     }
 
     case EXPR_AUTO_CAST:
     {
+        AstExpr *sub = ts__expr(compiler, expr->auto_cast.sub);
         if (expr->type->kind == TYPE_VECTOR &&
-            ts__getScalarTypeNoVec(expr->auto_cast.sub->type))
+            ts__getScalarTypeNoVec(sub->type))
         {
             astBuildExpr(ast_mod, ir_mod, expr->auto_cast.sub);
-            IRInst *value = loadVal(ir_mod, expr->auto_cast.sub->value);
-            if (expr->auto_cast.sub->type != expr->type->vector.elem_type)
+            IRInst *value = loadVal(ir_mod, ast_mod->expr_values[expr->auto_cast.sub]);
+            if (sub->type != expr->type->vector.elem_type)
             {
                 IRType *dst_type =
                     convertTypeToIR(ast_mod, ir_mod, expr->type->vector.elem_type);
@@ -1563,32 +1594,32 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
             }
 
             IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
-            expr->value = ts__irBuildCompositeConstruct(
+            ast_mod->expr_values[expr->id] = ts__irBuildCompositeConstruct(
                 ir_mod,
                 ir_type,
                 fields,
                 field_count);
         }
         else if (ts__getScalarTypeNoVec(expr->type) &&
-                 ts__getScalarTypeNoVec(expr->auto_cast.sub->type))
+                 ts__getScalarTypeNoVec(sub->type))
         {
             // Cast scalar
             astBuildExpr(ast_mod, ir_mod, expr->auto_cast.sub);
-            IRInst *value = loadVal(ir_mod, expr->auto_cast.sub->value);
+            IRInst *value = loadVal(ir_mod, ast_mod->expr_values[expr->auto_cast.sub]);
 
             IRType *dst_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
-            expr->value = ts__irBuildCast(ir_mod, dst_type, value);
+            ast_mod->expr_values[expr->id] = ts__irBuildCast(ir_mod, dst_type, value);
         }
         else if (expr->type->kind == TYPE_VECTOR &&
-                 expr->auto_cast.sub->type->kind == TYPE_VECTOR &&
-                 expr->auto_cast.sub->type->vector.size == expr->type->vector.size)
+                 sub->type->kind == TYPE_VECTOR &&
+                 sub->type->vector.size == expr->type->vector.size)
         {
             // Cast vector to vector
             astBuildExpr(ast_mod, ir_mod, expr->auto_cast.sub);
-            IRInst *value = loadVal(ir_mod, expr->auto_cast.sub->value);
+            IRInst *value = loadVal(ir_mod, ast_mod->expr_values[expr->auto_cast.sub]);
 
             IRType *dst_type = convertTypeToIR(ast_mod, ir_mod, expr->type);
-            expr->value = ts__irBuildCast(ir_mod, dst_type, value);
+            ast_mod->expr_values[expr->id] = ts__irBuildCast(ir_mod, dst_type, value);
         }
         else
         {
@@ -1608,14 +1639,59 @@ static void astBuildExpr(Module *ast_mod, IRModule *ir_mod, AstExpr *expr)
 }
 
 
-static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmt *stmt)
+// [unroll] and [loop] become hints of the loop header. There is no hint for
+// [unroll(N)] (PartialCount needs SPIR-V 1.4), the count is only used by the unroll pass.
+static void astSetLoopControl(TsCompiler *compiler, AstStmt *stmt, IRInst *header)
+{
+    for (uint32_t i = 0; i < arrLength(stmt->attributes); ++i)
+    {
+        AstAttribute *attr = &stmt->attributes.ptr[i];
+        if (ts__strcasecmp(attr->name, "unroll") == 0)
+        {
+            AstExpr *count =
+                ts__expr(compiler, attr->values.len ? attr->values.ptr[0] : 0);
+            if (!count)
+            {
+                header->block.loop_control = SpvLoopControlUnrollMask;
+            }
+            else if (count->has_resolved_int)
+            {
+                header->block.unroll_count =
+                    (uint32_t)ts__exprInfo(compiler, count)->resolved_int;
+            }
+        }
+        else if (ts__strcasecmp(attr->name, "loop") == 0)
+        {
+            header->block.loop_control = SpvLoopControlDontUnrollMask;
+        }
+    }
+}
+
+static void astSetSelectionControl(AstStmt *stmt, IRInst *header)
+{
+    for (uint32_t i = 0; i < arrLength(stmt->attributes); ++i)
+    {
+        AstAttribute *attr = &stmt->attributes.ptr[i];
+        if (ts__strcasecmp(attr->name, "branch") == 0)
+        {
+            header->block.selection_control = SpvSelectionControlDontFlattenMask;
+        }
+        else if (ts__strcasecmp(attr->name, "flatten") == 0)
+        {
+            header->block.selection_control = SpvSelectionControlFlattenMask;
+        }
+    }
+}
+
+static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmtId stmt_id)
 {
     TsCompiler *compiler = ast_mod->compiler;
+    AstStmt *stmt = ts__stmt(compiler, stmt_id);
 
     switch (stmt->kind)
     {
     case STMT_DECL: {
-        astBuildDecl(ast_mod, ir_mod, stmt->decl);
+        astBuildDecl(ast_mod, ir_mod, ts__decl(compiler, stmt->decl));
         break;
     }
 
@@ -1628,8 +1704,9 @@ static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmt *stmt)
         if (stmt->return_.value)
         {
             astBuildExpr(ast_mod, ir_mod, stmt->return_.value);
-            assert(stmt->return_.value->value);
-            ts__irBuildReturn(ir_mod, loadVal(ir_mod, stmt->return_.value->value));
+            assert(ast_mod->expr_values[stmt->return_.value]);
+            ts__irBuildReturn(
+                ir_mod, loadVal(ir_mod, ast_mod->expr_values[stmt->return_.value]));
         }
         else
         {
@@ -1660,8 +1737,7 @@ static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmt *stmt)
     case STMT_BLOCK: {
         for (uint32_t i = 0; i < stmt->block.stmts.len; ++i)
         {
-            AstStmt *sub_stmt = stmt->block.stmts.ptr[i];
-            astBuildStmt(ast_mod, ir_mod, sub_stmt);
+            astBuildStmt(ast_mod, ir_mod, stmt->block.stmts.ptr[i]);
 
             if (ts__irBlockHasTerminator(ts__irGetCurrentBlock(ir_mod)))
             {
@@ -1672,8 +1748,17 @@ static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmt *stmt)
     }
 
     case STMT_IF: {
+        // The analysis left the calls of the other branch out of the call graph
+        if (stmt->if_.has_const_cond)
+        {
+            AstStmtId taken =
+                stmt->if_.const_cond ? stmt->if_.if_stmt : stmt->if_.else_stmt;
+            if (taken) astBuildStmt(ast_mod, ir_mod, taken);
+            break;
+        }
+
         astBuildExpr(ast_mod, ir_mod, stmt->if_.cond);
-        IRInst *cond = stmt->if_.cond->value;
+        IRInst *cond = ast_mod->expr_values[stmt->if_.cond];
         assert(cond);
         cond = loadVal(ir_mod, cond);
         cond = boolVal(ir_mod, cond);
@@ -1690,6 +1775,7 @@ static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmt *stmt)
         IRInst *merge_block = ts__irCreateBlock(ir_mod, func);
         if (!else_block) else_block = merge_block;
 
+        astSetSelectionControl(stmt, current_block);
         ts__irBuildCondBr(ir_mod, cond, then_block, else_block, merge_block, NULL);
 
         // Then
@@ -1739,9 +1825,10 @@ static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmt *stmt)
         {
             ts__irPositionAtEnd(ir_mod, check_block);
             ts__irAddBlock(ir_mod, check_block);
+            astSetLoopControl(compiler, stmt, check_block);
 
             astBuildExpr(ast_mod, ir_mod, stmt->while_.cond);
-            IRInst *cond = stmt->while_.cond->value;
+            IRInst *cond = ast_mod->expr_values[stmt->while_.cond];
             assert(cond);
             cond = loadVal(ir_mod, cond);
             cond = boolVal(ir_mod, cond);
@@ -1796,6 +1883,7 @@ static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmt *stmt)
         {
             ts__irPositionAtEnd(ir_mod, header_block);
             ts__irAddBlock(ir_mod, header_block);
+            astSetLoopControl(compiler, stmt, header_block);
 
             ts__irBuildBr(ir_mod, body_block, merge_block, continue_block);
         }
@@ -1821,7 +1909,7 @@ static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmt *stmt)
             ts__irAddBlock(ir_mod, continue_block);
 
             astBuildExpr(ast_mod, ir_mod, stmt->do_while.cond);
-            IRInst *cond = stmt->do_while.cond->value;
+            IRInst *cond = ast_mod->expr_values[stmt->do_while.cond];
             assert(cond);
             cond = loadVal(ir_mod, cond);
             cond = boolVal(ir_mod, cond);
@@ -1857,13 +1945,14 @@ static void astBuildStmt(Module *ast_mod, IRModule *ir_mod, AstStmt *stmt)
         {
             ts__irPositionAtEnd(ir_mod, check_block);
             ts__irAddBlock(ir_mod, check_block);
+            astSetLoopControl(compiler, stmt, check_block);
 
             IRInst *cond = NULL;
 
             if (stmt->for_.cond)
             {
                 astBuildExpr(ast_mod, ir_mod, stmt->for_.cond);
-                cond = stmt->for_.cond->value;
+                cond = ast_mod->expr_values[stmt->for_.cond];
                 assert(cond);
                 cond = loadVal(ir_mod, cond);
                 cond = boolVal(ir_mod, cond);
@@ -1925,7 +2014,7 @@ static void astBuildDecl(Module *ast_mod, IRModule *ir_mod, AstDecl *decl)
     case DECL_FUNC: {
         if (!decl->func.called) break;
 
-        IRInst *entry_block = ts__irCreateBlock(ir_mod, decl->value);
+        IRInst *entry_block = ts__irCreateBlock(ir_mod, ast_mod->decl_values[decl->id]);
         ts__irPositionAtEnd(ir_mod, entry_block);
         ts__irAddBlock(ir_mod, entry_block);
 
@@ -1935,8 +2024,8 @@ static void astBuildDecl(Module *ast_mod, IRModule *ir_mod, AstDecl *decl)
         // We make allocas for input parameters
         for (uint32_t i = 0; i < arrLength(decl->func.params); ++i)
         {
-            AstDecl *param_decl = decl->func.params.ptr[i];
-            ptr_func_params[i] = param_decl->value;
+            AstDecl *param_decl = ts__decl(compiler, decl->func.params.ptr[i]);
+            ptr_func_params[i] = ast_mod->decl_values[param_decl->id];
 
             switch (param_decl->var.kind)
             {
@@ -1951,22 +2040,26 @@ static void astBuildDecl(Module *ast_mod, IRModule *ir_mod, AstDecl *decl)
         }
 
         // Make allocas for local variables
-        for (uint32_t i = 0; i < arrLength(decl->func.var_decls); ++i)
+        const ArrayOfAstDeclPtr *var_decls = &ts__declInfo(compiler, decl)->var_decls;
+        for (uint32_t i = 0; i < var_decls->len; ++i)
         {
-            AstDecl *var_decl = decl->func.var_decls.ptr[i];
+            AstDecl *var_decl = var_decls->ptr[i];
             IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, var_decl->type);
-            var_decl->value = ts__irBuildAlloca(ir_mod, ir_type);
+            ast_mod->decl_values[var_decl->id] = ts__irBuildAlloca(ir_mod, ir_type);
         }
 
         // Then we copy inputs into the allocas:
         for (uint32_t i = 0; i < arrLength(decl->func.params); ++i)
         {
-            AstDecl *param_decl = decl->func.params.ptr[i];
+            AstDecl *param_decl = ts__decl(compiler, decl->func.params.ptr[i]);
             switch (param_decl->var.kind)
             {
             case VAR_IN_PARAM: {
-                ts__irBuildStore(ir_mod, ptr_func_params[i], loadVal(ir_mod, param_decl->value));
-                param_decl->value = ptr_func_params[i];
+                ts__irBuildStore(
+                    ir_mod,
+                    ptr_func_params[i],
+                    loadVal(ir_mod, ast_mod->decl_values[param_decl->id]));
+                ast_mod->decl_values[param_decl->id] = ptr_func_params[i];
                 break;
             }
 
@@ -1977,8 +2070,7 @@ static void astBuildDecl(Module *ast_mod, IRModule *ir_mod, AstDecl *decl)
         // And then generate the statements:
         for (uint32_t i = 0; i < arrLength(decl->func.stmts); ++i)
         {
-            AstStmt *stmt = decl->func.stmts.ptr[i];
-            astBuildStmt(ast_mod, ir_mod, stmt);
+            astBuildStmt(ast_mod, ir_mod, decl->func.stmts.ptr[i]);
             if (ts__irBlockHasTerminator(ts__irGetCurrentBlock(ir_mod)))
             {
                 break;
@@ -2001,10 +2093,10 @@ static void astBuildDecl(Module *ast_mod, IRModule *ir_mod, AstDecl *decl)
         if (decl->var.value_expr)
         {
             astBuildExpr(ast_mod, ir_mod, decl->var.value_expr);
-            initializer = decl->var.value_expr->value;
+            initializer = ast_mod->expr_values[decl->var.value_expr];
             assert(initializer);
             initializer = loadVal(ir_mod, initializer);
-            ts__irBuildStore(ir_mod, decl->value, initializer);
+            ts__irBuildStore(ir_mod, ast_mod->decl_values[decl->id], initializer);
         }
 
         break;
@@ -2012,13 +2104,14 @@ static void astBuildDecl(Module *ast_mod, IRModule *ir_mod, AstDecl *decl)
 
     case DECL_CONST: {
         astBuildExpr(ast_mod, ir_mod, decl->constant.value_expr);
-        decl->value = decl->constant.value_expr->value;
+        ast_mod->decl_values[decl->id] = ast_mod->expr_values[decl->constant.value_expr];
         break;
     }
 
     case DECL_ALIAS: break;
     case DECL_STRUCT_FIELD: break;
     case DECL_STRUCT: break;
+    case DECL_TYPE_PARAM: break;
     }
 }
 
@@ -2142,7 +2235,7 @@ static void astRecursivelyAddOutputs(
 
         for (uint32_t i = 0; i < decl->func.params.len; ++i)
         {
-            AstDecl *param_decl = decl->func.params.ptr[i];
+            AstDecl *param_decl = ts__decl(compiler, decl->func.params.ptr[i]);
             if (param_decl->var.kind == VAR_OUT_PARAM)
             {
                 astRecursivelyAddOutputs(
@@ -2215,7 +2308,7 @@ static void astRecursivelyAddInputs(
     {
         for (uint32_t i = 0; i < decl->func.params.len; ++i)
         {
-            AstDecl *param_decl = decl->func.params.ptr[i];
+            AstDecl *param_decl = ts__decl(compiler, decl->func.params.ptr[i]);
             if (param_decl->var.kind == VAR_IN_PARAM)
             {
                 astRecursivelyAddInputs(
@@ -2273,10 +2366,25 @@ static void astRecursivelyAddInputs(
     }
 }
 
+static bool astHasAttribute(AstDecl *decl, const char *name)
+{
+    for (uint32_t i = 0; i < arrLength(decl->attributes); ++i)
+    {
+        if (ts__strcasecmp(decl->attributes.ptr[i].name, name) == 0) return true;
+    }
+    return false;
+}
+
 void ts__astModuleBuild(Module *ast_mod, IRModule *ir_mod)
 {
     TsCompiler *compiler = ast_mod->compiler;
 
+    // Values of the nodes, indexed by id
+    ast_mod->expr_values =
+        NEW_ARRAY(compiler, IRInst *, compiler->ast->pools[AST_POOL_EXPR].next);
+    ast_mod->decl_values =
+        NEW_ARRAY(compiler, IRInst *, compiler->ast->pools[AST_POOL_DECL].next);
+
     // Add functions / globals
     for (uint32_t i = 0; i < ast_mod->decl_count; ++i)
     {
@@ -2288,12 +2396,20 @@ void ts__astModuleBuild(Module *ast_mod, IRModule *ir_mod)
 
             if (!decl->func.called) break;
 
+            SpvFunctionControlMask control = SpvFunctionControlInlineMask;
+            if (astHasAttribute(decl, "noinline"))
+            {
+                control = SpvFunctionControlDontInlineMask;
+            }
+
             IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, decl->type);
-            decl->value = ts__irAddFunction(ir_mod, ir_type, SpvFunctionControlInlineMask);
+            IRInst *func = ts__irAddFunction(ir_mod, ir_type, control);
+            func->func.always_inline = astHasAttribute(decl, "inline");
+            ast_mod->decl_values[decl->id] = func;
 
             for (uint32_t k = 0; k < arrLength(decl->func.params); ++k)
             {
-                AstDecl *param = decl->func.params.ptr[k];
+                AstDecl *param = ts__decl(compiler, decl->func.params.ptr[k]);
                 IRType *ir_param_type = convertTypeToIR(ast_mod, ir_mod, param->type);
                 bool by_reference = false;
                 if (param->var.kind == VAR_OUT_PARAM)
@@ -2302,8 +2418,8 @@ void ts__astModuleBuild(Module *ast_mod, IRModule *ir_mod)
                         ts__irNewPointerType(ir_mod, SpvStorageClassFunction, ir_param_type);
                     by_reference = true;
                 }
-                param->value =
-                    ts__irAddFuncParam(ir_mod, decl->value, ir_param_type, by_reference);
+                ast_mod->decl_values[param->id] =
+                    ts__irAddFuncParam(ir_mod, func, ir_param_type, by_reference);
             }
 
             break;
@@ -2336,7 +2452,7 @@ void ts__astModuleBuild(Module *ast_mod, IRModule *ir_mod)
             default: assert(0); break;
             }
 
-            decl->value = ts__irAddUniformGlobal(
+            ast_mod->decl_values[decl->id] = ts__irAddUniformGlobal(
                 ir_mod,
                 ir_type,
                 storage_class);
@@ -2344,12 +2460,12 @@ void ts__astModuleBuild(Module *ast_mod, IRModule *ir_mod)
             IRDecoration set_dec = {0};
             set_dec.kind = SpvDecorationDescriptorSet;
             set_dec.value = decl->var.set;
-            ts__irDecorateInst(ir_mod, decl->value, &set_dec);
+            ts__irDecorateInst(ir_mod, ast_mod->decl_values[decl->id], &set_dec);
 
             IRDecoration binding_dec = {0};
             binding_dec.kind = SpvDecorationBinding;
             binding_dec.value = decl->var.binding;
-            ts__irDecorateInst(ir_mod, decl->value, &binding_dec);
+            ts__irDecorateInst(ir_mod, ast_mod->decl_values[decl->id], &binding_dec);
             break;
         }
 
@@ -2409,7 +2525,7 @@ void ts__astModuleBuild(Module *ast_mod, IRModule *ir_mod)
         ArrayOfIRInstPtr out_param_allocas = {0};
         for (uint32_t i = 0; i < func_decl->func.params.len; ++i)
         {
-            AstDecl *param_decl = func_decl->func.params.ptr[i];
+            AstDecl *param_decl = ts__decl(compiler, func_decl->func.params.ptr[i]);
             if (param_decl->var.kind == VAR_OUT_PARAM)
             {
                 IRType *ir_type = convertTypeToIR(ast_mod, ir_mod, param_decl->type);
@@ -2423,7 +2539,7 @@ void ts__astModuleBuild(Module *ast_mod, IRModule *ir_mod)
         ArrayOfIRInstPtr in_params = {0};
         for (uint32_t i = 0; i < func_decl->func.params.len; ++i)
         {
-            AstDecl *param_decl = func_decl->func.params.ptr[i];
+            AstDecl *param_decl = ts__decl(compiler, func_decl->func.params.ptr[i]);
             if (param_decl->var.kind == VAR_IN_PARAM)
             {
                 if (param_decl->type->kind == TYPE_STRUCT)
@@ -2460,7 +2576,7 @@ void ts__astModuleBuild(Module *ast_mod, IRModule *ir_mod)
         current_output_loc = 0;
         for (uint32_t i = 0; i < func_decl->func.params.len; ++i)
         {
-            AstDecl *param_decl = func_decl->func.params.ptr[i];
+            AstDecl *param_decl = ts__decl(compiler, func_decl->func.params.ptr[i]);
             if (param_decl->var.kind == VAR_IN_PARAM)
             {
                 arrPush(compiler, &func_params, in_params.ptr[current_input_loc]);
@@ -2475,7 +2591,7 @@ void ts__astModuleBuild(Module *ast_mod, IRModule *ir_mod)
 
         IRInst *return_value = ts__irBuildFuncCall(
             ir_mod,
-            func_decl->value,
+            ast_mod->decl_values[func_decl->id],
             func_params.ptr,
             func_params.len);
 
@@ -2512,7 +2628,7 @@ void ts__astModuleBuild(Module *ast_mod, IRModule *ir_mod)
         uint32_t out_param_index = 0;
         for (uint32_t i = 0; i < func_decl->func.params.len; ++i)
         {
-            AstDecl *param_decl = func_decl->func.params.ptr[i];
+            AstDecl *param_decl = ts__decl(compiler, func_decl->func.params.ptr[i]);
             if (param_decl->var.kind == VAR_OUT_PARAM)
             {
                 if (param_decl->type->kind == TYPE_STRUCT)
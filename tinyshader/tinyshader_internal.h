@@ -17,6 +17,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <stddef.h>
+#include <math.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #include "spirv.h"
 #include "GLSL.std.450.h"
 #include "tinyshader.h"
@@ -107,6 +112,27 @@ typedef struct HashMap
     ARRAY_OF(void *) values;
 } HashMap;
 
+// Hash-consing table: maps structurally equal items to a single canonical pointer.
+// Items are kept in insertion order in 'values'.
+typedef struct InternTable
+{
+    TsCompiler *compiler;
+    uint64_t (*hash)(const void *item);
+    bool (*equal)(const void *a, const void *b);
+
+    uint32_t *slots; // Index + 1 into 'values', 0 if empty
+    uint64_t *hashes;
+    uint32_t size;
+
+    ARRAY_OF(void *) values;
+} InternTable;
+
+static inline uint64_t ts__hashCombine(uint64_t hash, uint64_t value)
+{
+    hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
 typedef struct BumpBlock
 {
     unsigned char *data;
@@ -131,11 +157,16 @@ typedef struct StringBuilder
     size_t cap;
 } StringBuilder;
 
+typedef struct Thread Thread;
+typedef struct Mutex Mutex;
+
 typedef struct File File;
 typedef struct Module Module;
+typedef struct TypeCache TypeCache;
+typedef struct TemplateCache TemplateCache;
+typedef struct ParseCache ParseCache;
 
 typedef struct Scope Scope;
-typedef ARRAY_OF(Scope *) ArrayOfScopePtr;
 
 typedef struct AstExpr AstExpr;
 typedef struct AstStmt AstStmt;
@@ -145,11 +176,43 @@ typedef ARRAY_OF(AstExpr *) ArrayOfAstExprPtr;
 typedef ARRAY_OF(AstStmt *) ArrayOfAstStmtPtr;
 typedef ARRAY_OF(AstDecl *) ArrayOfAstDeclPtr;
 
+// AST nodes refer to each other by their index in the compiler's pools, 0 is no node
+typedef uint32_t AstExprId;
+typedef uint32_t AstStmtId;
+typedef uint32_t AstDeclId;
+
+typedef ARRAY_OF(AstExprId) ArrayOfAstExprId;
+typedef ARRAY_OF(AstStmtId) ArrayOfAstStmtId;
+typedef ARRAY_OF(AstDeclId) ArrayOfAstDeclId;
+
+// Fixed size lists stored in the nodes, built from the arrays above with AST_LIST
+typedef struct AstExprList
+{
+    AstExprId *ptr;
+    uint32_t len;
+} AstExprList;
+
+typedef struct AstStmtList
+{
+    AstStmtId *ptr;
+    uint32_t len;
+} AstStmtList;
+
+typedef struct AstDeclList
+{
+    AstDeclId *ptr;
+    uint32_t len;
+} AstDeclList;
+
+#define AST_LIST(type, arr) ((type){(arr).ptr, (uint32_t)(arr).len})
+
+// Handle to a Location, resolved with the source map of the compiler. 0 is no location.
+typedef uint32_t SourceLoc;
+
 typedef struct Location
 {
     char *path;
-    const char *buffer; // This is the entire source buffer, starting from the beginning
-    uint32_t pos;
+    uint32_t pos; // Offset into the preprocessed source
     uint32_t length;
     uint32_t line;
     uint32_t col;
@@ -279,6 +342,8 @@ typedef enum TokenKind {
     TOKEN_GROUPSHARED,
     TOKEN_UNIFORM,
     TOKEN_REGISTER,
+    TOKEN_TEMPLATE,
+    TOKEN_TYPENAME,
 
     TOKEN_MAX,
 } TokenKind;
@@ -286,8 +351,8 @@ typedef enum TokenKind {
 typedef struct Token
 {
     TokenKind kind;
-    Location loc;
     bool at_bol; // If the token is at the beginning of a line
+    Location loc;
     union
     {
         char *str;
@@ -357,8 +422,8 @@ typedef enum IRTypeKind {
 typedef struct IRType
 {
     IRTypeKind kind;
-    char *string;
     uint32_t id;
+    uint32_t mark; // Scratch value for the optimization passes
 
     ArrayOfIRDecoration decorations;
 
@@ -442,6 +507,7 @@ typedef enum IRInstKind {
     IR_INST_CONSTANT_BOOL,
     IR_INST_RETURN,
     IR_INST_DISCARD,
+    IR_INST_UNREACHABLE,
     IR_INST_STORE,
     IR_INST_LOAD,
     IR_INST_ACCESS_CHAIN,
@@ -464,6 +530,9 @@ typedef enum IRInstKind {
     IR_INST_UNARY,
     IR_INST_BINARY,
     IR_INST_SELECT,
+
+    IR_INST_PHI,
+    IR_INST_UNDEF,
 } IRInstKind;
 
 typedef enum IRBuiltinInstKind {
@@ -542,6 +611,11 @@ struct IRInst
     IRType *type;
     ArrayOfIRDecoration decorations;
 
+    // Set by ts__irComputeUses for the parameters and instructions of a function
+    IRInst *parent;         // Block holding the instruction
+    ArrayOfIRInstPtr users; // One entry per operand that refers to the instruction
+    uint32_t mark;          // Scratch value for the optimization passes
+
     union
     {
         struct
@@ -561,16 +635,34 @@ struct IRInst
         struct
         {
             SpvFunctionControlMask control;
+            bool always_inline; // [inline]: inlined whatever its size
             ArrayOfIRInstPtr params;
             ArrayOfIRInstPtr blocks;
             ArrayOfIRInstPtr inputs;
             ArrayOfIRInstPtr outputs;
+
+            ArrayOfIRInstPtr rpo; // Reachable blocks in reverse post-order
         } func;
 
         struct
         {
             IRInst *func;
             ArrayOfIRInstPtr insts;
+
+            // Set by ts__irComputeCfg
+            ArrayOfIRInstPtr preds;
+            ArrayOfIRInstPtr succs;
+            uint32_t rpo_index; // UINT32_MAX when the block is unreachable
+
+            // Set by ts__irComputeDominators, NULL for the entry and unreachable blocks
+            IRInst *idom;
+
+            // Hints of the loop this block is the header of, from [unroll] and [loop]
+            SpvLoopControlMask loop_control;
+            uint32_t unroll_count; // [unroll(N)]: N, zero when not given
+
+            // Hint of the selection this block heads, from [branch] and [flatten]
+            SpvSelectionControlMask selection_control;
         } block;
 
         struct
@@ -728,6 +820,12 @@ struct IRInst
             IRInst *true_value;
             IRInst *false_value;
         } select;
+
+        struct
+        {
+            ArrayOfIRInstPtr values;
+            ArrayOfIRInstPtr blocks; // The predecessor each value comes from
+        } phi;
     };
 };
 
@@ -735,8 +833,8 @@ struct IRModule
 {
     TsCompiler *compiler;
 
-    HashMap type_cache;
-    HashMap const_cache;
+    InternTable type_cache;
+    InternTable const_cache;
 
     ArrayOfIRInstPtr entry_points;
     ArrayOfIRInstPtr constants;
@@ -749,13 +847,41 @@ struct IRModule
 
     uint32_t glsl_ext_inst; // ID of the imported GLSL instruction set
     bool uses_image_query;
+    bool fold_constants; // Builders return constants instead of instructions on constants
 
     IRInst *current_block;
 
+    ARRAY_OF(TsPassStats) pass_stats;
+
     uint32_t id_bound;
     ARRAY_OF(uint32_t) stream;
 };
 
+//
+// Constant folding
+//
+
+typedef enum ScalarKind {
+    SCALAR_BOOL,
+    SCALAR_INT,
+    SCALAR_UINT,
+    SCALAR_FLOAT,
+} ScalarKind;
+
+// An operand or result of the ts__fold* functions, shared by the constant evaluation of
+// the analyzer and the folding of the optimizer. Integers only use the low 'bits' bits
+// of 'u', and results are left for the caller to wrap. Bools are 0 or 1 in 'u'.
+typedef struct ScalarValue
+{
+    ScalarKind kind;
+    uint32_t bits; // Of integers
+    union
+    {
+        uint64_t u;
+        double f;
+    };
+} ScalarValue;
+
 //
 // AST
 //
@@ -834,6 +960,65 @@ typedef enum AstBuiltinFunction {
     AST_BUILTIN_FUNC_GROUP_MEMORY_BARRIER_WITH_GROUP_SYNC,
 } AstBuiltinFunction;
 
+// Shapes and element types accepted for the first parameter of a builtin
+enum {
+    BUILTIN_SHAPE_SCALAR = 1 << 0,
+    BUILTIN_SHAPE_VECTOR = 1 << 1,
+    BUILTIN_SHAPE_MATRIX = 1 << 2,
+};
+
+enum {
+    BUILTIN_ELEM_FLOAT = 1 << 0,
+    BUILTIN_ELEM_INT = 1 << 1,
+    BUILTIN_ELEM_BOOL = 1 << 2,
+};
+
+// How integer literal parameters get their type before the signature is matched
+typedef enum AstBuiltinCoercion {
+    BUILTIN_COERCE_NONE,
+    BUILTIN_COERCE_FLOAT,    // All parameters to float
+    BUILTIN_COERCE_EXPECTED, // All parameters to the expected type, if they all can be
+    BUILTIN_COERCE_FIRST,    // The other parameters to the type of the first one
+    BUILTIN_COERCE_EXPECTED_OR_FIRST,
+} AstBuiltinCoercion;
+
+typedef enum AstBuiltinCheck {
+    BUILTIN_CHECK_NONE,
+    BUILTIN_CHECK_VEC3,        // First parameter is a 3 component vector
+    BUILTIN_CHECK_SQUARE,      // First parameter is a square matrix
+    BUILTIN_CHECK_SCALAR_LAST, // Last parameter is a float scalar
+    BUILTIN_CHECK_GROUPSHARED, // First parameter is a groupshared variable
+    BUILTIN_CHECK_GROUPSHARED_OUT, // Same, and the last parameter is assignable
+} AstBuiltinCheck;
+
+typedef enum AstBuiltinResult {
+    BUILTIN_RESULT_SAME, // Type of the first parameter
+    BUILTIN_RESULT_ELEM, // Element type of the first parameter
+    BUILTIN_RESULT_VOID,
+    BUILTIN_RESULT_TRANSPOSE,
+    BUILTIN_RESULT_MUL,
+    BUILTIN_RESULT_AS_FLOAT, // Shape of the first parameter with another element type
+    BUILTIN_RESULT_AS_INT,
+    BUILTIN_RESULT_AS_UINT,
+} AstBuiltinResult;
+
+typedef struct AstBuiltinSignature
+{
+    const char *name;
+    AstBuiltinFunction kind;
+    uint8_t param_count;
+    uint8_t shapes;
+    uint8_t elems;
+    uint8_t coercion;   // AstBuiltinCoercion
+    uint8_t same_count; // Number of leading parameters that share a single type
+    uint8_t check;      // AstBuiltinCheck
+    uint8_t result;     // AstBuiltinResult
+    IRBuiltinInstKind ir_kind;
+} AstBuiltinSignature;
+
+extern const AstBuiltinSignature ts__builtin_signatures[];
+extern const size_t ts__builtin_signature_count;
+
 typedef enum AstTypeKind {
     TYPE_VOID,
     TYPE_TYPE,
@@ -857,12 +1042,27 @@ typedef enum AstTypeKind {
     TYPE_RW_STRUCTURED_BUFFER,
 } AstTypeKind;
 
-typedef struct AstType
+typedef enum AstLayoutRules {
+    LAYOUT_STD140, // Constant buffers
+    LAYOUT_STD430, // Structured buffers
+    LAYOUT_SCALAR, // Tight packing, needs VK_EXT_scalar_block_layout
+    LAYOUT_RULES_COUNT,
+} AstLayoutRules;
+
+// Memory layout of a struct under one set of rules
+typedef struct AstStructLayout
 {
-    AstTypeKind kind;
-    char *string;
+    AstLayoutRules rules;
     uint32_t size;
     uint32_t align;
+    uint32_t *offsets;
+    uint32_t *sizes;
+    uint32_t *matrix_strides; // Zero for the fields that are not matrices
+} AstStructLayout;
+
+typedef struct AstType
+{
+    AstTypeKind kind;
 
     union
     {
@@ -903,8 +1103,15 @@ typedef struct AstType
 
             AstDecl **field_decls;
             struct AstType **fields;
-            ArrayOfIRMemberDecoration field_decorations;
             uint32_t field_count;
+
+            // Computed on demand for each set of rules
+            AstStructLayout *layouts[LAYOUT_RULES_COUNT];
+
+            // The layout used by the buffers that hold the struct, which the fields are
+            // decorated with
+            AstStructLayout *layout;
+            ArrayOfIRMemberDecoration field_decorations;
         } struct_;
         struct
         {
@@ -923,17 +1130,39 @@ typedef struct AstType
         struct
         {
             struct AstType *sub;
+            uint32_t stride;        // Array stride of structured buffers
+            uint32_t matrix_stride; // Set if 'sub' is a matrix
         } buffer;
     };
 } AstType;
 
+// A value known at compile time. Vectors keep their components and matrices their
+// columns in 'elems'.
+typedef struct AstConst
+{
+    AstType *type;
+    union
+    {
+        double f;  // TYPE_FLOAT, rounded to the type's precision
+        int64_t i; // TYPE_INT and TYPE_BOOL, wrapped to the type's width
+    };
+    struct AstConst **elems;
+    uint32_t elem_count;
+} AstConst;
+
 typedef struct AstAttribute
 {
     char *name;
-    ArrayOfAstExprPtr values;
+    AstExprList values;
 } AstAttribute;
 typedef ARRAY_OF(AstAttribute) ArrayOfAstAttribute;
 
+typedef struct AstAttributeList
+{
+    AstAttribute *ptr;
+    uint32_t len;
+} AstAttributeList;
+
 typedef enum AstUnaryOp {
     UNOP_NEG,
     UNOP_NOT,
@@ -999,6 +1228,8 @@ typedef enum AstDeclKind {
 
     DECL_STRUCT,
     DECL_STRUCT_FIELD,
+
+    DECL_TYPE_PARAM, // 'typename T' of a template
 } AstDeclKind;
 
 typedef enum AstExprKind {
@@ -1021,130 +1252,177 @@ typedef enum AstExprKind {
 
 struct AstStmt
 {
-    AstStmtKind kind;
-    Location loc;
+    uint8_t kind; // AstStmtKind
+    bool always_exits; // Set by the analysis on blocks one of whose statements exits
+    SourceLoc loc;
+    AstStmtId id;
+    AstAttributeList attributes;
 
     union
     {
-        AstDecl *decl;
-        AstExpr *expr;
+        AstDeclId decl;
+        AstExprId expr;
         struct
         {
-            AstExpr *value;
+            AstExprId value;
         } return_;
 
         struct
         {
-            ArrayOfAstStmtPtr stmts;
-            Scope *scope;
+            AstStmtList stmts;
         } block;
 
         struct
         {
-            AstExpr *cond;
-            AstStmt *if_stmt;
-            AstStmt *else_stmt;
+            AstExprId cond;
+            AstStmtId if_stmt;
+            AstStmtId else_stmt;
+
+            // Set by the analysis, only the taken branch is compiled
+            bool has_const_cond;
+            bool const_cond;
         } if_;
 
         struct
         {
-            AstExpr *cond;
-            AstStmt *stmt;
+            AstExprId cond;
+            AstStmtId stmt;
         } while_;
 
         struct
         {
-            AstExpr *cond;
-            AstStmt *stmt;
+            AstExprId cond;
+            AstStmtId stmt;
         } do_while;
 
         struct
         {
-            AstStmt *init;
-            AstExpr *cond;
-            AstExpr *inc;
+            AstStmtId init;
+            AstExprId cond;
+            AstExprId inc;
 
-            AstStmt *stmt;
+            AstStmtId stmt;
         } for_;
     };
 };
 
+// Analysis results of a declaration that most declarations do without, kept out of
+// AstDecl and created on first write
+typedef struct AstDeclInfo
+{
+    AstType *as_type;
+    Scope *scope;
+    AstConst *const_value; // Set for constants with a compile-time value
+    int64_t resolved_int;  // Valid if has_resolved_int is set
+    AstDeclId instance_of; // The template this declaration was instantiated from
+
+    // Functions only:
+    ArrayOfAstDeclPtr var_decls;
+
+    // Functions referenced by the code of the body that can run
+    ArrayOfAstDeclPtr callees;
+} AstDeclInfo;
+
 struct AstDecl
 {
-    AstDeclKind kind;
-    Location loc;
+    uint8_t kind; // AstDeclKind
+    bool has_resolved_int;
+    SourceLoc loc;
+    AstDeclId id;
+    uint32_t info; // Index of the AstDeclInfo, 0 if there is none yet
     char *name;
     AstType *type;
-    AstType *as_type;
-    IRInst *value;
-    Scope *scope;
-    ArrayOfAstAttribute attributes;
-    int64_t *resolved_int;
     char *semantic;
+    AstAttributeList attributes;
+
+    // Set for templates and their instances. In an instance each parameter is bound to
+    // the type it was instantiated with.
+    AstDeclList template_params;
 
     union
     {
         struct
         {
-            ArrayOfAstStmtPtr stmts;
-            ArrayOfAstDeclPtr params;
-            AstExpr *return_type;
+            AstStmtList stmts;
+            AstDeclList params;
+            AstExprId return_type;
 
-            // To be filled later:
-            ArrayOfAstDeclPtr var_decls;
+            AstDeclId overload; // Next function declared with the same name
 
-            bool called; // if this function was called or if it's an entry point
+            bool called; // Reachable from the entry point through the call graph
+            bool graph_visited; // Used while walking the call graph
         } func;
 
         struct
         {
-            AstExpr *type_expr;
-            AstExpr *value_expr;
+            AstExprId type_expr;
+            AstExprId value_expr;
             AstVarKind kind;
             bool immutable;
 
             uint32_t binding;
             uint32_t set;
+
+            // From ': register(b0, space1)'
+            bool has_register;
+            TsRegisterClass register_class;
+            uint32_t register_binding;
+            uint32_t register_space;
         } var;
 
         struct
         {
-            AstExpr *type_expr;
-            AstExpr *value_expr;
+            AstExprId type_expr;
+            AstExprId value_expr;
         } constant;
 
         struct
         {
-            ArrayOfAstDeclPtr fields;
+            AstDeclList fields;
         } struct_;
 
         struct
         {
-            AstExpr *type_expr;
+            AstExprId type_expr;
             uint32_t index;
+
+            // From ': packoffset(c1.y)', in bytes
+            bool has_packoffset;
+            uint32_t packoffset;
         } struct_field;
 
         struct
         {
-            AstDecl *accessed; // The variable to access
+            AstDeclId accessed; // The variable to access
 
             // To be filled in analysis:
-            AstDecl *field_decl; // The declration of the struct field
+            AstDeclId field_decl; // The declration of the struct field
         } alias;
     };
 };
 
-struct AstExpr
+// Like AstDeclInfo, for expressions
+typedef struct AstExprInfo
 {
-    AstExprKind kind;
-    Location loc;
-    IRInst *value;
-    AstType *type;
     AstType *as_type;
-    bool assignable;
-    Scope *inhabited_scope;
     Scope *scope;
-    int64_t *resolved_int;
+    AstConst *const_value; // Set if the expression was folded to a compile-time value
+    int64_t resolved_int;  // Valid if has_resolved_int is set
+
+    // Components picked by a vector shuffle, set on its identifier
+    uint32_t *shuffle_indices;
+    uint32_t shuffle_index_count;
+} AstExprInfo;
+
+struct AstExpr
+{
+    uint8_t kind; // AstExprKind
+    bool assignable;
+    bool has_resolved_int;
+    SourceLoc loc;
+    AstExprId id;
+    uint32_t info; // Index of the AstExprInfo, 0 if there is none yet
+    AstType *type;
 
     union
     {
@@ -1156,71 +1434,71 @@ struct AstExpr
         struct
         {
             char *name;
+            AstDeclId decl; // The declaration this identifier refers to
 
-            uint32_t *shuffle_indices;
-            uint32_t shuffle_index_count;
-            AstDecl *decl; // The declaration this identifier refers to
+            uint32_t template_arg_count; // From 'name<args>'
+            AstExprId *template_args;
         } ident;
 
         struct
         {
-            AstExpr *base;
-            ArrayOfAstExprPtr chain;
+            AstExprId base;
+            AstExprList chain;
         } access;
 
         struct
         {
-            AstExpr *left;
-            AstExpr *right;
+            AstExprId left;
+            AstExprId right;
         } subscript;
 
         struct
         {
-            AstExpr *func_expr;
-            ArrayOfAstExprPtr params;
-            AstExpr *self_param;
+            AstExprId func_expr;
+            AstExprId self_param;
+            AstExprList params;
         } func_call;
 
         struct
         {
-            AstExpr *sampled_type_expr;
+            AstExprId sampled_type_expr;
             SpvDim dim;
         } texture;
 
         struct
         {
-            AstExpr *sub_expr;
+            AstExprId sub_expr;
         } buffer;
 
         struct
         {
-            AstExpr *assigned_expr;
-            AstExpr *value_expr;
+            AstExprId assigned_expr;
+            AstExprId value_expr;
         } var_assign;
 
         struct
         {
             AstUnaryOp op;
-            AstExpr *right;
+            AstExprId right;
         } unary;
 
         struct
         {
             AstBinaryOp op;
-            AstExpr *left;
-            AstExpr *right;
+            AstExprId left;
+            AstExprId right;
         } binary;
 
         struct
         {
-            AstExpr *cond;
-            AstExpr *true_expr;
-            AstExpr *false_expr;
+            AstExprId cond;
+            AstExprId true_expr;
+            AstExprId false_expr;
         } ternary;
 
         struct
         {
-            AstExpr *sub;
+            AstExprId sub;
         } auto_cast;
     };
 };
@@ -1229,13 +1507,67 @@ struct AstExpr
 // Scope
 //
 
+// Members of a struct or constant buffer. Lexical scopes are handled by the
+// analyzer's symbol table.
 struct Scope
 {
-    struct Scope *parent;
-    AstDecl *owner;
     HashMap map; // string -> *AstDecl
 };
 
+//
+// AST pools
+//
+// The nodes of all the parses and analyses of a compilation live in one set of typed
+// pools, shared by the worker threads. Chunk k of a pool holds 256 << k nodes and never
+// moves, so node addresses stay valid until the pools are destroyed. Ids are handed out
+// to each thread's TsCompiler in runs, so allocating a node does not take the lock.
+//
+
+typedef enum AstPoolKind {
+    AST_POOL_EXPR,
+    AST_POOL_STMT,
+    AST_POOL_DECL,
+    AST_POOL_EXPR_INFO,
+    AST_POOL_DECL_INFO,
+    AST_POOL_COUNT,
+} AstPoolKind;
+
+#define AST_POOL_CHUNK_BITS 8
+#define AST_POOL_MAX_CHUNKS 24
+#define AST_POOL_RUN 64
+
+typedef struct AstPool
+{
+    size_t item_size;
+    uint32_t next; // First id that was not handed out
+    unsigned char *chunks[AST_POOL_MAX_CHUNKS];
+} AstPool;
+
+// Locations 'base' to 'base + count - 1' are the ones at 'locs', 'stride' bytes apart,
+// such as the locations of a token array
+typedef struct SourceRange
+{
+    SourceLoc base;
+    uint32_t count;
+    const unsigned char *locs;
+    size_t stride;
+} SourceRange;
+
+typedef struct AstPools
+{
+    Mutex *mutex;
+    AstPool pools[AST_POOL_COUNT];
+
+    ARRAY_OF(SourceRange) source_ranges; // Sorted by base
+    SourceLoc next_loc;
+} AstPools;
+
+typedef struct AstIdRun
+{
+    uint32_t next;
+    uint32_t end;
+} AstIdRun;
+
 //
 // Compiler
 //
@@ -1252,8 +1584,114 @@ typedef struct TsCompiler
     ArrayOfError errors;
 
     uint32_t counter; // General purpose unique number generator
+
+    AstPools *ast;
+    AstIdRun ast_runs[AST_POOL_COUNT]; // Ids claimed by this compiler, not used yet
 } TsCompiler;
 
+uint32_t ts__astReserve(TsCompiler *compiler, AstPoolKind kind, uint32_t count);
+
+static inline uint32_t ts__log2(uint32_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, value);
+    return (uint32_t)index;
+#else
+    return 31 - (uint32_t)__builtin_clz(value);
+#endif
+}
+
+static inline void *ts__astPoolGet(const AstPool *pool, uint32_t id)
+{
+    uint32_t chunk = ts__log2((id >> AST_POOL_CHUNK_BITS) + 1);
+    uint32_t index = id - (((1u << chunk) - 1) << AST_POOL_CHUNK_BITS);
+    return pool->chunks[chunk] + index * pool->item_size;
+}
+
+static inline uint32_t ts__astNewId(TsCompiler *compiler, AstPoolKind kind)
+{
+    AstIdRun *run = &compiler->ast_runs[kind];
+    if (run->next == run->end)
+    {
+        run->next = ts__astReserve(compiler, kind, AST_POOL_RUN);
+        run->end = run->next + AST_POOL_RUN;
+    }
+    return run->next++;
+}
+
+static inline AstExpr *ts__expr(const TsCompiler *compiler, AstExprId id)
+{
+    if (!id) return NULL;
+    return ts__astPoolGet(&compiler->ast->pools[AST_POOL_EXPR], id);
+}
+
+static inline AstStmt *ts__stmt(const TsCompiler *compiler, AstStmtId id)
+{
+    if (!id) return NULL;
+    return ts__astPoolGet(&compiler->ast->pools[AST_POOL_STMT], id);
+}
+
+static inline AstDecl *ts__decl(const TsCompiler *compiler, AstDeclId id)
+{
+    if (!id) return NULL;
+    return ts__astPoolGet(&compiler->ast->pools[AST_POOL_DECL], id);
+}
+
+// New nodes are zeroed, the pools never hand out an id twice
+static inline AstExpr *ts__newExpr(TsCompiler *compiler)
+{
+    AstExprId id = ts__astNewId(compiler, AST_POOL_EXPR);
+    AstExpr *expr = ts__expr(compiler, id);
+    expr->id = id;
+    return expr;
+}
+
+static inline AstStmt *ts__newStmt(TsCompiler *compiler)
+{
+    AstStmtId id = ts__astNewId(compiler, AST_POOL_STMT);
+    AstStmt *stmt = ts__stmt(compiler, id);
+    stmt->id = id;
+    return stmt;
+}
+
+static inline AstDecl *ts__newDecl(TsCompiler *compiler)
+{
+    AstDeclId id = ts__astNewId(compiler, AST_POOL_DECL);
+    AstDecl *decl = ts__decl(compiler, id);
+    decl->id = id;
+    return decl;
+}
+
+// The side records read as all zeroes until something is stored in them
+static inline const AstExprInfo *
+ts__exprInfo(const TsCompiler *compiler, const AstExpr *expr)
+{
+    static const AstExprInfo none = {0};
+    if (!expr->info) return &none;
+    return ts__astPoolGet(&compiler->ast->pools[AST_POOL_EXPR_INFO], expr->info);
+}
+
+static inline AstExprInfo *ts__exprInfoEdit(TsCompiler *compiler, AstExpr *expr)
+{
+    if (!expr->info) expr->info = ts__astNewId(compiler, AST_POOL_EXPR_INFO);
+    return ts__astPoolGet(&compiler->ast->pools[AST_POOL_EXPR_INFO], expr->info);
+}
+
+static inline const AstDeclInfo *
+ts__declInfo(const TsCompiler *compiler, const AstDecl *decl)
+{
+    static const AstDeclInfo none = {0};
+    if (!decl->info) return &none;
+    return ts__astPoolGet(&compiler->ast->pools[AST_POOL_DECL_INFO], decl->info);
+}
+
+static inline AstDeclInfo *ts__declInfoEdit(TsCompiler *compiler, AstDecl *decl)
+{
+    if (!decl->info) decl->info = ts__astNewId(compiler, AST_POOL_DECL_INFO);
+    return ts__astPoolGet(&compiler->ast->pools[AST_POOL_DECL_INFO], decl->info);
+}
+
 //
 // File
 //
@@ -1270,15 +1708,23 @@ struct File
 struct Module
 {
     TsCompiler *compiler;
-    Scope *scope;
 
     const char *entry_point; // Requested entry point name
     TsShaderStage stage;
+    bool scalar_block_layout; // Buffers use LAYOUT_SCALAR
+    uint32_t binding_shifts[TS_REGISTER_CLASS_COUNT]; // Added to register() bindings
 
-    HashMap type_cache;
+    TypeCache *type_cache;         // Only valid during analysis
+    TemplateCache *template_cache; // Only valid during analysis
 
     ArrayOfIRInstPtr continue_stack;
     ArrayOfIRInstPtr break_stack;
+    ArrayOfAstExprPtr binary_stack; // Binary expressions whose left operands are built
+
+    // Built values of the expressions and declarations, indexed by id. Only valid while
+    // building the IR.
+    IRInst **expr_values;
+    IRInst **decl_values;
 
     AstDecl **decls;
     size_t decl_count;
@@ -1303,18 +1749,41 @@ char *ts__getCurrentDir(TsCompiler *compiler);
 char *ts__pathConcat(TsCompiler *compiler, const char *a, const char *b);
 bool ts__fileExists(TsCompiler *compiler, const char *path);
 
+uint64_t ts__hashString(const char *string);
+uint64_t ts__hashBytes(const void *bytes, size_t size);
 void ts__hashInit(TsCompiler *compiler, HashMap *map, uint64_t size);
 void *ts__hashSet(HashMap *map, const char *key, void *value);
 bool ts__hashGet(HashMap *map, const char *key, void **result);
 void ts__hashRemove(HashMap *map, const char *key);
 void ts__hashDestroy(HashMap *map);
 
+void ts__internInit(
+    TsCompiler *compiler,
+    InternTable *table,
+    uint64_t (*hash)(const void *item),
+    bool (*equal)(const void *a, const void *b));
+void *ts__intern(InternTable *table, void *item);
+void *ts__internHashed(InternTable *table, void *item, uint64_t hash);
+void *ts__internFind(InternTable *table, const void *item, uint64_t hash);
+void ts__internReplace(InternTable *table, void *item, uint64_t hash);
+void ts__internFilter(InternTable *table, bool (*keep)(const void *item));
+
 void ts__bumpInit(BumpAlloc *alloc, size_t block_size);
 void *ts__bumpAlloc(BumpAlloc *alloc, size_t size);
 void *ts__bumpZeroAlloc(BumpAlloc *alloc, size_t size);
 char *ts__bumpStrndup(BumpAlloc *alloc, const char *str, size_t length);
+void ts__bumpAdopt(BumpAlloc *alloc, BumpAlloc *other);
 void ts__bumpDestroy(BumpAlloc *alloc);
 
+uint32_t ts__getCpuCount(void);
+double ts__getTime(void); // In seconds, from an arbitrary origin
+Thread *ts__threadStart(void (*proc)(void *), void *arg);
+void ts__threadJoin(Thread *thread);
+Mutex *ts__mutexCreate(void);
+void ts__mutexDestroy(Mutex *mutex);
+void ts__mutexLock(Mutex *mutex);
+void ts__mutexUnlock(Mutex *mutex);
+
 void ts__sbInit(StringBuilder *sb);
 void ts__sbDestroy(StringBuilder *sb);
 void ts__sbReset(StringBuilder *sb);
@@ -1326,15 +1795,64 @@ void ts__sbVsprintf(StringBuilder *sb, const char *fmt, va_list vl);
 char *ts__sbBuildMalloc(StringBuilder *sb);
 char *ts__sbBuild(StringBuilder *sb, BumpAlloc *bump);
 
+// Each returns false when the result is undefined, the operation is then left to be
+// evaluated at runtime
+bool ts__foldBinary(SpvOp op, ScalarValue l, ScalarValue r, ScalarValue *result);
+bool ts__foldUnary(SpvOp op, ScalarValue value, ScalarValue *result);
+bool ts__foldConvert(
+    SpvOp op, ScalarValue value, ScalarKind kind, uint32_t bits, ScalarValue *result);
+bool ts__foldBuiltin(
+    IRBuiltinInstKind kind,
+    const ScalarValue *args,
+    uint32_t arg_count,
+    ScalarValue *result);
+// dot, length and distance give one value, normalize and cross one per component
+bool ts__foldGeometric(
+    IRBuiltinInstKind kind,
+    const double *v,
+    const double *w,
+    uint32_t size,
+    double *result);
+
 void ts__addErr(TsCompiler *compiler, const Location *loc, const char *msg, ...);
+void ts__addErrAt(TsCompiler *compiler, SourceLoc loc, const char *msg, ...);
+
+AstPools *ts__astPoolsCreate(void);
+void ts__astPoolsDestroy(AstPools *pools);
+SourceLoc ts__sourceMapAdd(
+    TsCompiler *compiler, const Location *first, size_t stride, uint32_t count);
+Location ts__sourceLocResolve(TsCompiler *compiler, SourceLoc loc);
 
 File *ts__createFile(
     TsCompiler *compiler, const char *text, size_t text_size, const char *path);
 
 
-const char *ts__preprocess(TsCompiler *compiler, File *base_file, size_t *out_size);
+const char *ts__preprocess(
+    TsCompiler *compiler, File *base_file, HashMap *defines, size_t *out_size);
 ArrayOfToken ts__lex(TsCompiler *compiler, File *file, const char *text, size_t text_size);
-ArrayOfAstDeclPtr ts__parse(TsCompiler *compiler, ArrayOfToken tokens);
+ArrayOfAstDeclPtr ts__parse(
+    TsCompiler *compiler,
+    const char *text,
+    ArrayOfToken tokens,
+    const ArrayOfAstDeclPtr *prior_decls,
+    ParseCache *cache);
+ParseCache *ts__parseCacheCreate(void);
+void ts__parseCacheDestroy(ParseCache *cache);
+uint8_t *ts__pchWrite(
+    TsCompiler *compiler,
+    AstDecl **decls,
+    size_t decl_count,
+    HashMap *defines, // can be NULL
+    SourceLoc origin,
+    size_t *size);
+bool ts__pchLoad(
+    TsCompiler *compiler,
+    const uint8_t *data,
+    size_t size,
+    SourceLoc origin,
+    ArrayOfAstDeclPtr *decls,
+    HashMap *defines); // can be NULL
+AstDecl *ts__pchCloneDecl(TsCompiler *compiler, AstDecl *decl);
 void ts__analyze(
     TsCompiler *compiler,
     Module *module,
@@ -1406,6 +1924,7 @@ IRInst *ts__irBuildConstFloat(IRModule *m, IRType *type, double value);
 IRInst *ts__irBuildConstInt(IRModule *m, IRType *type, uint64_t value);
 IRInst *ts__irBuildConstComposite(IRModule *m, IRType *type, IRInst **values, uint32_t value_count);
 IRInst *ts__irBuildConstBool(IRModule *m, bool value);
+IRInst *ts__irBuildUndef(IRModule *m, IRType *type);
 IRInst *ts__irBuildAlloca(IRModule *m, IRType *type);
 void ts__irBuildStore(IRModule *m, IRInst *pointer, IRInst *value);
 IRInst *ts__irBuildLoad(IRModule *m, IRInst *pointer);
@@ -1458,7 +1977,27 @@ void ts__irBuildCondBr(
     IRInst *false_block,
     IRInst *merge_block,
     IRInst *continue_block);
+IRInst *ts__irCreatePhi(IRModule *m, IRType *type);
+void ts__irPhiAddIncoming(IRModule *m, IRInst *phi, IRInst *value, IRInst *block);
 
 uint32_t *ts__irModuleCodegen(IRModule *mod, size_t *word_count);
 
+typedef ARRAY_OF(IRInst **) ArrayOfIRInstSlot;
+
+typedef struct IRPass
+{
+    const char *name;
+    bool (*run)(IRModule *m); // Returns whether the module changed
+} IRPass;
+
+void ts__irInstOperands(IRModule *m, IRInst *inst, ArrayOfIRInstSlot *slots);
+void ts__irComputeUses(IRModule *m, IRInst *func);
+void ts__irReplaceAllUses(IRModule *m, IRInst *inst, IRInst *value);
+void ts__irComputeCfg(IRModule *m, IRInst *func);
+void ts__irComputeDominators(IRInst *func);
+bool ts__irDominates(IRInst *a, IRInst *b);
+size_t ts__irCountInsts(IRModule *m);
+IRInst *ts__irFoldInst(IRModule *m, IRInst *inst);
+void ts__irOptimize(IRModule *m, uint32_t level);
+
 #endif
@@ -4,169 +4,124 @@
  */
 #include "tinyshader_internal.h"
 
-static char *irTypeToString(TsCompiler *compiler, IRType *type)
+static uint64_t irTypeHash(const void *item)
 {
-    if (type->string) return type->string;
-
-    char *prefix = NULL;
-    char *storage_class = NULL;
-    char *sub = NULL;
-    char *postfix = NULL;
+    const IRType *type = item;
+    uint64_t hash = ts__hashCombine(0, (uint64_t)type->kind);
 
     switch (type->kind)
     {
-    case IR_TYPE_VOID: prefix = "void"; break;
-
-    case IR_TYPE_BOOL: prefix = "bool"; break;
+    case IR_TYPE_VOID:
+    case IR_TYPE_BOOL:
+    case IR_TYPE_SAMPLER: break;
 
-    case IR_TYPE_FLOAT:
-        ts__sbReset(&compiler->sb);
-        ts__sbSprintf(&compiler->sb, "float%u", type->float_.bits);
-        prefix = ts__sbBuild(&compiler->sb, &compiler->alloc);
-        break;
+    case IR_TYPE_FLOAT: hash = ts__hashCombine(hash, type->float_.bits); break;
 
     case IR_TYPE_INT:
-        ts__sbReset(&compiler->sb);
-
-        if (type->int_.is_signed)
-            ts__sbAppend(&compiler->sb, "int");
-        else
-            ts__sbAppend(&compiler->sb, "uint");
-
-        ts__sbSprintf(&compiler->sb, "%u", type->int_.bits);
-        prefix = ts__sbBuild(&compiler->sb, &compiler->alloc);
+        hash = ts__hashCombine(hash, type->int_.bits);
+        hash = ts__hashCombine(hash, type->int_.is_signed);
         break;
 
     case IR_TYPE_VECTOR:
-        ts__sbReset(&compiler->sb);
-        ts__sbSprintf(&compiler->sb, "vec%u", type->vector.size);
-        prefix = ts__sbBuild(&compiler->sb, &compiler->alloc);
-
-        sub = irTypeToString(compiler, type->vector.elem_type);
+        hash = ts__hashCombine(hash, type->vector.size);
+        hash = ts__hashCombine(hash, (uintptr_t)type->vector.elem_type);
         break;
-    case IR_TYPE_MATRIX:
-        ts__sbReset(&compiler->sb);
-        ts__sbSprintf(&compiler->sb, "mat%u", type->matrix.col_count);
-        prefix = ts__sbBuild(&compiler->sb, &compiler->alloc);
 
-        sub = irTypeToString(compiler, type->matrix.col_type);
+    case IR_TYPE_MATRIX:
+        hash = ts__hashCombine(hash, type->matrix.col_count);
+        hash = ts__hashCombine(hash, (uintptr_t)type->matrix.col_type);
         break;
 
-    case IR_TYPE_POINTER: {
-        prefix = "ptr";
-
-        switch (type->ptr.storage_class)
-        {
-        case SpvStorageClassInput: storage_class = "input"; break;
-        case SpvStorageClassOutput: storage_class = "output"; break;
-        case SpvStorageClassUniformConstant: storage_class = "constant"; break;
-        case SpvStorageClassUniform: storage_class = "uniform"; break;
-        case SpvStorageClassStorageBuffer: storage_class = "storage"; break;
-        case SpvStorageClassFunction: storage_class = "function"; break;
-        case SpvStorageClassWorkgroup: storage_class = "groupshared"; break;
-
-        default: assert(0); break;
-        }
-
-        assert(type->ptr.sub);
-        sub = irTypeToString(compiler, type->ptr.sub);
+    case IR_TYPE_POINTER:
+        hash = ts__hashCombine(hash, type->ptr.storage_class);
+        hash = ts__hashCombine(hash, (uintptr_t)type->ptr.sub);
         break;
-    }
 
-    case IR_TYPE_RUNTIME_ARRAY: {
-        prefix = "r_array";
-
-        assert(type->array.sub);
-        sub = irTypeToString(compiler, type->array.sub);
+    case IR_TYPE_RUNTIME_ARRAY:
+        hash = ts__hashCombine(hash, (uintptr_t)type->array.sub);
         break;
-    }
-
-    case IR_TYPE_FUNC: {
-        prefix = "func";
-
-        char *return_type = irTypeToString(compiler, type->func.return_type);
-        char **params = NEW_ARRAY(compiler, char *, type->func.param_count);
-        for (uint32_t i = 0; i < type->func.param_count; ++i)
-        {
-            params[i] = irTypeToString(compiler, type->func.params[i]);
-        }
 
-        ts__sbReset(&compiler->sb);
-        ts__sbAppend(&compiler->sb, return_type);
-        ts__sbAppend(&compiler->sb, "$");
-        ts__sbSprintf(&compiler->sb, "%u", type->func.param_count);
+    case IR_TYPE_FUNC:
+        hash = ts__hashCombine(hash, (uintptr_t)type->func.return_type);
+        hash = ts__hashCombine(hash, type->func.param_count);
         for (uint32_t i = 0; i < type->func.param_count; ++i)
         {
-            if (i != 0) ts__sbAppend(&compiler->sb, "_");
-            ts__sbAppend(&compiler->sb, params[i]);
+            hash = ts__hashCombine(hash, (uintptr_t)type->func.params[i]);
         }
-        sub = ts__sbBuild(&compiler->sb, &compiler->alloc);
+        break;
 
+    // Structs are nominal
+    case IR_TYPE_STRUCT:
+        hash = ts__hashCombine(hash, ts__hashString(type->struct_.name));
         break;
-    }
 
-    case IR_TYPE_STRUCT: {
-        ts__sbReset(&compiler->sb);
-        ts__sbSprintf(
-            &compiler->sb, "struct%u%s", strlen(type->struct_.name), type->struct_.name);
-        prefix = ts__sbBuild(&compiler->sb, &compiler->alloc);
+    case IR_TYPE_IMAGE:
+        hash = ts__hashCombine(hash, (uintptr_t)type->image.sampled_type);
+        hash = ts__hashCombine(hash, type->image.dim);
         break;
-    }
 
-    case IR_TYPE_SAMPLER: {
-        prefix = "sampler";
+    case IR_TYPE_SAMPLED_IMAGE:
+        hash = ts__hashCombine(hash, (uintptr_t)type->sampled_image.image_type);
         break;
     }
 
-    case IR_TYPE_IMAGE: {
-        prefix = "image";
+    return hash;
+}
+
+// Sub-types are interned already, so they compare by pointer
+static bool irTypeEqual(const void *a_item, const void *b_item)
+{
+    const IRType *a = a_item;
+    const IRType *b = b_item;
+    if (a->kind != b->kind) return false;
 
-        sub = irTypeToString(compiler, type->image.sampled_type);
+    switch (a->kind)
+    {
+    case IR_TYPE_VOID:
+    case IR_TYPE_BOOL:
+    case IR_TYPE_SAMPLER: return true;
 
-        switch (type->image.dim)
-        {
-        case SpvDimCube: postfix = "Cube"; break;
-        case SpvDim1D: postfix = "1D"; break;
-        case SpvDim2D: postfix = "2D"; break;
-        case SpvDim3D: postfix = "3D"; break;
-        default: assert(0); break;
-        }
+    case IR_TYPE_FLOAT: return a->float_.bits == b->float_.bits;
 
-        break;
-    }
+    case IR_TYPE_INT:
+        return a->int_.bits == b->int_.bits && a->int_.is_signed == b->int_.is_signed;
 
-    case IR_TYPE_SAMPLED_IMAGE: {
-        prefix = "sampledImage";
-        sub = irTypeToString(compiler, type->sampled_image.image_type);
-        break;
-    }
-    }
+    case IR_TYPE_VECTOR:
+        return a->vector.size == b->vector.size &&
+               a->vector.elem_type == b->vector.elem_type;
 
-    ts__sbReset(&compiler->sb);
+    case IR_TYPE_MATRIX:
+        return a->matrix.col_count == b->matrix.col_count &&
+               a->matrix.col_type == b->matrix.col_type;
 
-    assert(prefix);
-    ts__sbAppend(&compiler->sb, prefix);
+    case IR_TYPE_POINTER:
+        return a->ptr.storage_class == b->ptr.storage_class && a->ptr.sub == b->ptr.sub;
 
-    if (storage_class)
-    {
-        ts__sbAppend(&compiler->sb, "_");
-        ts__sbAppend(&compiler->sb, storage_class);
-    }
+    case IR_TYPE_RUNTIME_ARRAY: return a->array.sub == b->array.sub;
 
-    if (sub)
-    {
-        ts__sbAppend(&compiler->sb, "_");
-        ts__sbAppend(&compiler->sb, sub);
-    }
+    case IR_TYPE_FUNC:
+        if (a->func.return_type != b->func.return_type ||
+            a->func.param_count != b->func.param_count)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < a->func.param_count; ++i)
+        {
+            if (a->func.params[i] != b->func.params[i]) return false;
+        }
+        return true;
 
-    if (postfix)
-    {
-        ts__sbAppend(&compiler->sb, "_");
-        ts__sbAppend(&compiler->sb, postfix);
+    case IR_TYPE_STRUCT: return strcmp(a->struct_.name, b->struct_.name) == 0;
+
+    case IR_TYPE_IMAGE:
+        return a->image.sampled_type == b->image.sampled_type &&
+               a->image.dim == b->image.dim;
+
+    case IR_TYPE_SAMPLED_IMAGE:
+        return a->sampled_image.image_type == b->sampled_image.image_type;
     }
 
-    type->string = ts__sbBuild(&compiler->sb, &compiler->alloc);
-    return type->string;
+    return false;
 }
 
 static bool irIsTypeCastable(IRType *src_type, IRType *dst_type, SpvOp *op)
@@ -274,96 +229,114 @@ static bool irIsTypeCastable(IRType *src_type, IRType *dst_type, SpvOp *op)
     assert(0);
 }
 
-static IRType *irGetCachedType(IRModule *m, IRType *type)
+// Returns the interned type equal to 'key', copying the key into the arena only when
+// the type is new, so lookups of existing types allocate nothing
+static IRType *irGetCachedType(IRModule *m, const IRType *key)
 {
-    char *type_string = irTypeToString(m->compiler, type);
-    assert(type_string);
-    assert(strlen(type_string) > 0);
+    uint64_t hash = irTypeHash(key);
+    IRType *ty = ts__internFind(&m->type_cache, key, hash);
+    if (ty) return ty;
+
+    ty = NEW(m->compiler, IRType);
+    *ty = *key;
 
-    IRType *found_type = NULL;
-    if (ts__hashGet(&m->type_cache, type_string, (void **)&found_type))
+    if (ty->kind == IR_TYPE_FUNC && ty->func.param_count > 0)
     {
-        assert(found_type);
-        return found_type;
+        ty->func.params = NEW_ARRAY(m->compiler, IRType *, ty->func.param_count);
+        memcpy(
+            ty->func.params, key->func.params, sizeof(IRType *) * ty->func.param_count);
     }
 
-    ts__hashSet(&m->type_cache, type_string, type);
+    if (ty->kind == IR_TYPE_STRUCT && ty->struct_.field_count > 0)
+    {
+        ty->struct_.fields = NEW_ARRAY(m->compiler, IRType *, ty->struct_.field_count);
+        memcpy(
+            ty->struct_.fields,
+            key->struct_.fields,
+            sizeof(IRType *) * ty->struct_.field_count);
+    }
+
+    if (ty->kind == IR_TYPE_STRUCT && ty->struct_.field_decoration_count > 0)
+    {
+        ty->struct_.field_decorations = NEW_ARRAY(
+            m->compiler, IRMemberDecoration, ty->struct_.field_decoration_count);
+        memcpy(
+            ty->struct_.field_decorations,
+            key->struct_.field_decorations,
+            sizeof(IRMemberDecoration) * ty->struct_.field_decoration_count);
+    }
 
-    return type;
+    return ts__internHashed(&m->type_cache, ty, hash);
 }
 
 IRType *ts__irNewBasicType(IRModule *m, IRTypeKind kind)
 {
-    IRType *ty = NEW(m->compiler, IRType);
-    ty->kind = kind;
-    return irGetCachedType(m, ty);
+    IRType key = {0};
+    key.kind = kind;
+    return irGetCachedType(m, &key);
 }
 
 IRType *ts__irNewPointerType(IRModule *m, SpvStorageClass storage_class, IRType *sub)
 {
-    IRType *ty = NEW(m->compiler, IRType);
-    ty->kind = IR_TYPE_POINTER;
-    ty->ptr.storage_class = storage_class;
-    ty->ptr.sub = sub;
-    return irGetCachedType(m, ty);
+    IRType key = {0};
+    key.kind = IR_TYPE_POINTER;
+    key.ptr.storage_class = storage_class;
+    key.ptr.sub = sub;
+    return irGetCachedType(m, &key);
 }
 
 IRType *ts__irNewVectorType(IRModule *m, IRType *elem_type, uint32_t size)
 {
-    IRType *ty = NEW(m->compiler, IRType);
-    ty->kind = IR_TYPE_VECTOR;
-    ty->vector.elem_type = elem_type;
-    ty->vector.size = size;
-    return irGetCachedType(m, ty);
+    IRType key = {0};
+    key.kind = IR_TYPE_VECTOR;
+    key.vector.elem_type = elem_type;
+    key.vector.size = size;
+    return irGetCachedType(m, &key);
 }
 
 IRType *ts__irNewMatrixType(IRModule *m, IRType *col_type, uint32_t col_count)
 {
-    IRType *ty = NEW(m->compiler, IRType);
-    ty->kind = IR_TYPE_MATRIX;
-    ty->matrix.col_type = col_type;
-    ty->matrix.col_count = col_count;
-    return irGetCachedType(m, ty);
+    IRType key = {0};
+    key.kind = IR_TYPE_MATRIX;
+    key.matrix.col_type = col_type;
+    key.matrix.col_count = col_count;
+    return irGetCachedType(m, &key);
 }
 
 IRType *ts__irNewFloatType(IRModule *m, uint32_t bits)
 {
-    IRType *ty = NEW(m->compiler, IRType);
-    ty->kind = IR_TYPE_FLOAT;
-    ty->float_.bits = bits;
-    return irGetCachedType(m, ty);
+    IRType key = {0};
+    key.kind = IR_TYPE_FLOAT;
+    key.float_.bits = bits;
+    return irGetCachedType(m, &key);
 }
 
 IRType *ts__irNewIntType(IRModule *m, uint32_t bits, bool is_signed)
 {
-    IRType *ty = NEW(m->compiler, IRType);
-    ty->kind = IR_TYPE_INT;
-    ty->int_.bits = bits;
-    ty->int_.is_signed = is_signed;
-    return irGetCachedType(m, ty);
+    IRType key = {0};
+    key.kind = IR_TYPE_INT;
+    key.int_.bits = bits;
+    key.int_.is_signed = is_signed;
+    return irGetCachedType(m, &key);
 }
 
 IRType *ts__irNewRuntimeArrayType(IRModule *m, IRType *sub)
 {
-    IRType *ty = NEW(m->compiler, IRType);
-    ty->kind = IR_TYPE_RUNTIME_ARRAY;
-    ty->array.sub = sub;
-    return irGetCachedType(m, ty);
+    IRType key = {0};
+    key.kind = IR_TYPE_RUNTIME_ARRAY;
+    key.array.sub = sub;
+    return irGetCachedType(m, &key);
 }
 
 IRType *
 ts__irNewFuncType(IRModule *m, IRType *return_type, IRType **params, uint32_t param_count)
 {
-    IRType *ty = NEW(m->compiler, IRType);
-    ty->kind = IR_TYPE_FUNC;
-    ty->func.return_type = return_type;
-    if (param_count > 0)
-    {
-        ty->func.param_count = param_count;
-        ty->func.params = NEW_ARRAY(m->compiler, IRType *, param_count);
-        memcpy(ty->func.params, params, sizeof(IRType *) * param_count);
-    }
-    return irGetCachedType(m, ty);
+    IRType key = {0};
+    key.kind = IR_TYPE_FUNC;
+    key.func.return_type = return_type;
+    key.func.params = params;
+    key.func.param_count = param_count;
+    return irGetCachedType(m, &key);
 }
 
 IRType *ts__irNewStructType(
@@ -374,50 +347,39 @@ IRType *ts__irNewStructType(
     IRMemberDecoration *field_decorations,
     uint32_t field_decoration_count)
 {
-    IRType *ty = NEW(m->compiler, IRType);
-    ty->kind = IR_TYPE_STRUCT;
-    ty->struct_.name = name;
-
-    if (field_count > 0)
-    {
-        ty->struct_.field_count = field_count;
-
-        ty->struct_.fields = NEW_ARRAY(m->compiler, IRType *, field_count);
-        memcpy(ty->struct_.fields, fields, sizeof(IRType *) * field_count);
+    IRType key = {0};
+    key.kind = IR_TYPE_STRUCT;
+    key.struct_.name = name;
+    key.struct_.fields = fields;
+    key.struct_.field_count = field_count;
 
-        ty->struct_.field_decoration_count = field_decoration_count;
+    // Structs that are not stored in buffers have no layout to decorate
+    key.struct_.field_decorations = field_decorations;
+    key.struct_.field_decoration_count = field_decoration_count;
 
-        ty->struct_.field_decorations =
-            NEW_ARRAY(m->compiler, IRMemberDecoration, field_decoration_count);
-        memcpy(
-            ty->struct_.field_decorations,
-            field_decorations,
-            sizeof(IRMemberDecoration) * field_decoration_count);
-    }
-
-    return irGetCachedType(m, ty);
+    return irGetCachedType(m, &key);
 }
 
 IRType *ts__irNewImageType(IRModule *m, IRType *sampled_type, SpvDim dim)
 {
-    IRType *ty = NEW(m->compiler, IRType);
-    ty->kind = IR_TYPE_IMAGE;
-    ty->image.sampled_type = sampled_type;
-    ty->image.dim = dim;
-    ty->image.depth = 0;
-    ty->image.arrayed = 0;
-    ty->image.multisampled = 0;
-    ty->image.sampled = 1;
-    ty->image.format = SpvImageFormatUnknown;
-    return irGetCachedType(m, ty);
+    IRType key = {0};
+    key.kind = IR_TYPE_IMAGE;
+    key.image.sampled_type = sampled_type;
+    key.image.dim = dim;
+    key.image.depth = 0;
+    key.image.arrayed = 0;
+    key.image.multisampled = 0;
+    key.image.sampled = 1;
+    key.image.format = SpvImageFormatUnknown;
+    return irGetCachedType(m, &key);
 }
 
 IRType *ts__irNewSampledImageType(IRModule *m, IRType *image_type)
 {
-    IRType *ty = NEW(m->compiler, IRType);
-    ty->kind = IR_TYPE_SAMPLED_IMAGE;
-    ty->sampled_image.image_type = image_type;
-    return irGetCachedType(m, ty);
+    IRType key = {0};
+    key.kind = IR_TYPE_SAMPLED_IMAGE;
+    key.sampled_image.image_type = image_type;
+    return irGetCachedType(m, &key);
 }
 
 static uint32_t irModuleReserveId(IRModule *m)
@@ -580,6 +542,7 @@ bool ts__irBlockHasTerminator(IRInst *block)
     case IR_INST_COND_BRANCH:
     case IR_INST_BRANCH:
     case IR_INST_DISCARD:
+    case IR_INST_UNREACHABLE:
     case IR_INST_RETURN: return true;
     default: return false;
     }
@@ -587,143 +550,107 @@ bool ts__irBlockHasTerminator(IRInst *block)
     return false;
 }
 
-static char *irConstToString(TsCompiler *compiler, IRInst *inst)
+static uint64_t irConstHash(const void *item)
 {
+    const IRInst *inst = item;
+    uint64_t hash = ts__hashCombine(0, (uint64_t)inst->kind);
+    hash = ts__hashCombine(hash, (uintptr_t)inst->type);
 
     switch (inst->kind)
     {
     case IR_INST_CONSTANT: {
-        ts__sbReset(&compiler->sb);
-
-        if (inst->type->kind == IR_TYPE_FLOAT)
+        const uint8_t *bytes = inst->constant.value;
+        for (size_t i = 0; i < inst->constant.value_size_bytes; ++i)
         {
-            switch (inst->type->float_.bits)
-            {
-            case 32:
-                ts__sbSprintf(&compiler->sb, "float%f", *((float *)inst->constant.value));
-                break;
-            case 64:
-                ts__sbSprintf(
-                    &compiler->sb, "double%lf", *((double *)inst->constant.value));
-                break;
-            default: assert(0); break;
-            }
-        }
-        else if (inst->type->kind == IR_TYPE_INT)
-        {
-            if (inst->type->int_.is_signed)
-            {
-                switch (inst->type->int_.bits)
-                {
-                case 8:
-                    ts__sbSprintf(
-                        &compiler->sb, "char%c", *((char *)inst->constant.value));
-                    break;
-                case 16:
-                    ts__sbSprintf(
-                        &compiler->sb, "short%h", *((short *)inst->constant.value));
-                    break;
-                case 32:
-                    ts__sbSprintf(&compiler->sb, "int%d", *((int *)inst->constant.value));
-                    break;
-                case 64:
-                    ts__sbSprintf(
-                        &compiler->sb, "long%ld", *((long *)inst->constant.value));
-                    break;
-                default: assert(0); break;
-                }
-            }
-            else
-            {
-                switch (inst->type->int_.bits)
-                {
-                case 8:
-                    ts__sbSprintf(
-                        &compiler->sb,
-                        "uchar%uc",
-                        *((unsigned char *)inst->constant.value));
-                    break;
-                case 16:
-                    ts__sbSprintf(
-                        &compiler->sb,
-                        "ushort%hu",
-                        *((unsigned short *)inst->constant.value));
-                    break;
-                case 32:
-                    ts__sbSprintf(
-                        &compiler->sb, "uint%u", *((unsigned int *)inst->constant.value));
-                    break;
-                case 64:
-                    ts__sbSprintf(
-                        &compiler->sb,
-                        "ulong%lu",
-                        *((unsigned long *)inst->constant.value));
-                    break;
-                default: assert(0); break;
-                }
-            }
-        }
-        else
-        {
-            assert(0);
+            hash = ts__hashCombine(hash, bytes[i]);
         }
         break;
     }
 
     case IR_INST_CONSTANT_BOOL: {
-        ts__sbReset(&compiler->sb);
-
-        if (inst->constant_bool.value)
-        {
-            ts__sbAppendChar(&compiler->sb, 't');
-        }
-        else
-        {
-            ts__sbAppendChar(&compiler->sb, 'f');
-        }
+        hash = ts__hashCombine(hash, inst->constant_bool.value);
         break;
     }
 
     case IR_INST_CONSTANT_COMPOSITE: {
-        char **substrings = NEW_ARRAY(compiler, char*, inst->constant_composite.value_count);
         for (uint32_t i = 0; i < inst->constant_composite.value_count; ++i)
         {
-            IRInst *value = inst->constant_composite.values[i];
-            substrings[i] = irConstToString(compiler, value);
-        }
-
-        ts__sbReset(&compiler->sb);
-        ts__sbSprintf(&compiler->sb, "C%u$", inst->constant_composite.value_count);
-        for (uint32_t i = 0; i < inst->constant_composite.value_count; ++i)
-        {
-            ts__sbAppend(&compiler->sb, substrings[i]);
-            ts__sbAppend(&compiler->sb, ",");
+            hash = ts__hashCombine(hash, (uintptr_t)inst->constant_composite.values[i]);
         }
         break;
     }
 
+    case IR_INST_UNDEF: break;
+
     default: assert(0); break;
     }
 
-    char *const_name = ts__sbBuild(&compiler->sb, &compiler->alloc);
-    return const_name;
+    return hash;
+}
+
+// Constants compare by type and bit pattern, so values that only differ past the
+// printed precision stay distinct. Composite members are interned already.
+static bool irConstEqual(const void *a_item, const void *b_item)
+{
+    const IRInst *a = a_item;
+    const IRInst *b = b_item;
+    if (a->kind != b->kind || a->type != b->type) return false;
+
+    switch (a->kind)
+    {
+    case IR_INST_CONSTANT:
+        return a->constant.value_size_bytes == b->constant.value_size_bytes &&
+               memcmp(a->constant.value, b->constant.value, a->constant.value_size_bytes) ==
+                   0;
+
+    case IR_INST_CONSTANT_BOOL: return a->constant_bool.value == b->constant_bool.value;
+
+    case IR_INST_CONSTANT_COMPOSITE:
+        if (a->constant_composite.value_count != b->constant_composite.value_count)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < a->constant_composite.value_count; ++i)
+        {
+            if (a->constant_composite.values[i] != b->constant_composite.values[i])
+            {
+                return false;
+            }
+        }
+        return true;
+
+    case IR_INST_UNDEF: return true;
+
+    default: break;
+    }
+
+    return false;
 }
 
 static IRInst *irGetCachedConst(IRModule *m, IRInst *inst)
 {
-    char *const_string = irConstToString(m->compiler, inst);
-    assert(const_string);
-    assert(strlen(const_string) > 0);
+    IRInst *found_inst = ts__intern(&m->const_cache, inst);
+    if (found_inst == inst)
+    {
+        arrPush(m->compiler, &m->constants, inst);
+    }
 
-    IRInst *found_inst = NULL;
-    if (ts__hashGet(&m->const_cache, const_string, (void **)&found_inst))
+    return found_inst;
+}
+
+// Appends an instruction that computes a value to the current block, unless folding
+// is enabled and the value is known from constant operands
+static IRInst *irInsertValue(IRModule *m, IRInst *inst)
+{
+    if (m->fold_constants)
     {
-        assert(found_inst);
-        return found_inst;
+        IRInst *folded = ts__irFoldInst(m, inst);
+        if (folded) return folded;
     }
 
-    ts__hashSet(&m->const_cache, const_string, inst);
-    arrPush(m->compiler, &m->constants, inst);
+    IRInst *block = ts__irGetCurrentBlock(m);
+    assert(block);
+    arrPush(m->compiler, &block->block.insts, inst);
 
     return inst;
 }
@@ -846,6 +773,18 @@ IRInst *ts__irBuildConstBool(IRModule *m, bool value)
     return inst;
 }
 
+// Undefined values live with the constants, there is one per type
+IRInst *ts__irBuildUndef(IRModule *m, IRType *type)
+{
+    IRInst *inst = NEW(m->compiler, IRInst);
+    inst->kind = IR_INST_UNDEF;
+    inst->type = type;
+
+    inst = irGetCachedConst(m, inst);
+
+    return inst;
+}
+
 IRInst *ts__irBuildAlloca(IRModule *m, IRType *type)
 {
     IRInst *inst = NEW(m->compiler, IRInst);
@@ -933,10 +872,7 @@ IRInst *ts__irBuildVectorShuffle(
     inst->vector_shuffle.indices = indices;
     inst->vector_shuffle.index_count = index_count;
 
-    IRInst *block = ts__irGetCurrentBlock(m);
-    arrPush(m->compiler, &block->block.insts, inst);
-
-    return inst;
+    return irInsertValue(m, inst);
 }
 
 IRInst *ts__irBuildCompositeExtract(
@@ -982,10 +918,7 @@ IRInst *ts__irBuildCompositeExtract(
 
     inst->composite_extract.index_count = index_count;
 
-    IRInst *block = ts__irGetCurrentBlock(m);
-    arrPush(m->compiler, &block->block.insts, inst);
-
-    return inst;
+    return irInsertValue(m, inst);
 }
 
 IRInst *ts__irBuildCompositeConstruct(
@@ -999,11 +932,7 @@ IRInst *ts__irBuildCompositeConstruct(
     inst->composite_construct.fields = fields;
     inst->composite_construct.field_count = field_count;
 
-    IRInst *block = ts__irGetCurrentBlock(m);
-    assert(block);
-    arrPush(m->compiler, &block->block.insts, inst);
-
-    return inst;
+    return irInsertValue(m, inst);
 }
 
 IRInst *
@@ -1044,10 +973,7 @@ IRInst *ts__irBuildBuiltinCall(
     inst->builtin_call.params = params;
     inst->builtin_call.param_count = param_count;
 
-    IRInst *block = ts__irGetCurrentBlock(m);
-    arrPush(m->compiler, &block->block.insts, inst);
-
-    return inst;
+    return irInsertValue(m, inst);
 }
 
 IRInst *ts__irBuildBarrier(
@@ -1181,10 +1107,7 @@ IRInst *ts__irBuildCast(IRModule *m, IRType *dst_type, IRInst *value)
     inst->cast.dst_type = dst_type;
     inst->cast.value = value;
 
-    IRInst *block = ts__irGetCurrentBlock(m);
-    arrPush(m->compiler, &block->block.insts, inst);
-
-    return inst;
+    return irInsertValue(m, inst);
 }
 
 IRInst *ts__irBuildUnary(IRModule *m, SpvOp op, IRType *type, IRInst *right)
@@ -1197,10 +1120,7 @@ IRInst *ts__irBuildUnary(IRModule *m, SpvOp op, IRType *type, IRInst *right)
     inst->unary.op = op;
     inst->unary.right = right;
 
-    IRInst *block = ts__irGetCurrentBlock(m);
-    arrPush(m->compiler, &block->block.insts, inst);
-
-    return inst;
+    return irInsertValue(m, inst);
 }
 
 IRInst *
@@ -1215,10 +1135,7 @@ ts__irBuildBinary(IRModule *m, SpvOp op, IRType *type, IRInst *left, IRInst *rig
     inst->binary.left = left;
     inst->binary.right = right;
 
-    IRInst *block = ts__irGetCurrentBlock(m);
-    arrPush(m->compiler, &block->block.insts, inst);
-
-    return inst;
+    return irInsertValue(m, inst);
 }
 
 IRInst *ts__irBuildSelect(
@@ -1233,10 +1150,7 @@ IRInst *ts__irBuildSelect(
     inst->select.true_value = true_value;
     inst->select.false_value = false_value;
 
-    IRInst *block = ts__irGetCurrentBlock(m);
-    arrPush(m->compiler, &block->block.insts, inst);
-
-    return inst;
+    return irInsertValue(m, inst);
 }
 
 void ts__irBuildReturn(IRModule *m, IRInst *value)
@@ -1291,6 +1205,24 @@ void ts__irBuildCondBr(
     arrPush(m->compiler, &block->block.insts, inst);
 }
 
+// Does not add the phi to a block, phis have to come before the other instructions
+IRInst *ts__irCreatePhi(IRModule *m, IRType *type)
+{
+    IRInst *inst = NEW(m->compiler, IRInst);
+    inst->kind = IR_INST_PHI;
+    inst->type = type;
+
+    return inst;
+}
+
+void ts__irPhiAddIncoming(IRModule *m, IRInst *phi, IRInst *value, IRInst *block)
+{
+    assert(phi->kind == IR_INST_PHI);
+    assert(block->kind == IR_INST_BLOCK);
+    arrPush(m->compiler, &phi->phi.values, value);
+    arrPush(m->compiler, &phi->phi.blocks, block);
+}
+
 ////////////////////////////////
 //
 // IR instruction encoding
@@ -1633,6 +1565,11 @@ static void irModuleEncodeBlock(IRModule *m, IRInst *block)
             break;
         }
 
+        case IR_INST_UNREACHABLE: {
+            irModuleEncodeInst(m, SpvOpUnreachable, NULL, 0);
+            break;
+        }
+
         case IR_INST_BRANCH: {
             if (inst->branch.continue_block && inst->branch.merge_block)
             {
@@ -1641,7 +1578,7 @@ static void irModuleEncodeBlock(IRModule *m, IRInst *block)
                 uint32_t params[3] = {
                     inst->branch.merge_block->id,
                     inst->branch.continue_block->id,
-                    SpvLoopControlMaskNone,
+                    block->block.loop_control,
                 };
                 irModuleEncodeInst(m, SpvOpLoopMerge, params, 3);
             }
@@ -1656,7 +1593,7 @@ static void irModuleEncodeBlock(IRModule *m, IRInst *block)
             {
                 uint32_t params[2] = {
                     inst->cond_branch.merge_block->id,
-                    SpvSelectionControlMaskNone,
+                    block->block.selection_control,
                 };
                 irModuleEncodeInst(m, SpvOpSelectionMerge, params, 2);
             }
@@ -1665,7 +1602,7 @@ static void irModuleEncodeBlock(IRModule *m, IRInst *block)
                 uint32_t params[3] = {
                     inst->cond_branch.merge_block->id,
                     inst->cond_branch.continue_block->id,
-                    SpvLoopControlMaskNone,
+                    block->block.loop_control,
                 };
                 irModuleEncodeInst(m, SpvOpLoopMerge, params, 3);
             }
@@ -2556,10 +2493,28 @@ static void irModuleEncodeBlock(IRModule *m, IRInst *block)
             break;
         }
 
+        case IR_INST_PHI: {
+            inst->id = irModuleReserveId(m);
+
+            // The values are filled in by irModuleResolvePhis
+            uint32_t param_count = 2 + inst->phi.values.len * 2;
+            uint32_t *params = NEW_ARRAY(m->compiler, uint32_t, param_count);
+            params[0] = inst->type->id;
+            params[1] = inst->id;
+            for (uint32_t i = 0; i < inst->phi.blocks.len; ++i)
+            {
+                params[3 + i * 2] = inst->phi.blocks.ptr[i]->id;
+            }
+
+            irModuleEncodeInst(m, SpvOpPhi, params, param_count);
+            break;
+        }
+
         case IR_INST_FUNC_PARAM:
         case IR_INST_CONSTANT:
         case IR_INST_CONSTANT_BOOL:
         case IR_INST_CONSTANT_COMPOSITE:
+        case IR_INST_UNDEF:
         case IR_INST_FUNCTION:
         case IR_INST_ENTRY_POINT:
         case IR_INST_BLOCK: assert(0); break;
@@ -2567,6 +2522,36 @@ static void irModuleEncodeBlock(IRModule *m, IRInst *block)
     }
 }
 
+// The value of a phi coming through a back edge is defined after the phi, so the ids
+// of the values are only known once the whole function is encoded.
+// 'offset' is where the function starts in the stream.
+static void irModuleResolvePhis(IRModule *m, IRInst *func, size_t offset)
+{
+    for (uint32_t i = 0; i < arrLength(func->func.blocks); ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        for (uint32_t j = 0; j < arrLength(block->block.insts); ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            if (inst->kind != IR_INST_PHI) continue;
+
+            while ((m->stream.ptr[offset] & 0xffff) != SpvOpPhi)
+            {
+                offset += m->stream.ptr[offset] >> 16;
+            }
+
+            uint32_t *words = &m->stream.ptr[offset + 3];
+            for (uint32_t k = 0; k < inst->phi.values.len; ++k)
+            {
+                assert(inst->phi.values.ptr[k]->id);
+                words[k * 2] = inst->phi.values.ptr[k]->id;
+            }
+
+            offset += m->stream.ptr[offset] >> 16;
+        }
+    }
+}
+
 static void irModuleEncodeConstants(IRModule *m)
 {
     for (uint32_t i = 0; i < arrLength(m->constants); ++i)
@@ -2622,6 +2607,13 @@ static void irModuleEncodeConstants(IRModule *m)
             break;
         }
 
+        case IR_INST_UNDEF: {
+            inst->id = irModuleReserveId(m);
+            uint32_t params[2] = {inst->type->id, inst->id};
+            irModuleEncodeInst(m, SpvOpUndef, params, 2);
+            break;
+        }
+
         default: assert(0); break;
         }
     }
@@ -2647,6 +2639,8 @@ static void irModuleEncodeFunctions(IRModule *m)
         assert(inst->kind == IR_INST_FUNCTION);
         assert(inst->id);
 
+        size_t func_offset = m->stream.len;
+
         {
             uint32_t params[4] = {
                 inst->type->func.return_type->id,
@@ -2673,6 +2667,8 @@ static void irModuleEncodeFunctions(IRModule *m)
             irModuleEncodeBlock(m, block);
         }
 
+        irModuleResolvePhis(m, inst, func_offset);
+
         irModuleEncodeInst(m, SpvOpFunctionEnd, NULL, 0);
     }
 }
@@ -2746,8 +2742,8 @@ IRModule *ts__irModuleCreate(TsCompiler *compiler)
     memset(m, 0, sizeof(*m));
     m->compiler = compiler;
 
-    ts__hashInit(compiler, &m->type_cache, 0);
-    ts__hashInit(compiler, &m->const_cache, 0);
+    ts__internInit(compiler, &m->type_cache, irTypeHash, irTypeEqual);
+    ts__internInit(compiler, &m->const_cache, irConstHash, irConstEqual);
 
     irModuleReserveId(m); // 0th ID
     m->glsl_ext_inst = irModuleReserveId(m);
@@ -2757,8 +2753,6 @@ IRModule *ts__irModuleCreate(TsCompiler *compiler)
 
 void ts__irModuleDestroy(IRModule *m)
 {
-    ts__hashDestroy(&m->type_cache);
-    ts__hashDestroy(&m->const_cache);
     arrFree(m->compiler, &m->stream);
 }
 
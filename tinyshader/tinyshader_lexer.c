@@ -66,7 +66,6 @@ static inline bool lexerConsume(Lexer *l, char c)
         err_loc.col = l->col;
         err_loc.pos = (uint32_t)l->pos;
         err_loc.path = l->file_path;
-        err_loc.buffer = l->text;
         ts__addErr(l->compiler, &err_loc, "unexpected character: '%c'", lexerPeek(l, 0));
         lexerNext(l, 1);
         return false;
@@ -82,6 +81,293 @@ static inline void lexerAddSimpleToken(Lexer *l, TokenKind kind, size_t length)
     l->token.loc.length = (uint32_t)length;
 }
 
+////////////////////////////////
+//
+// Numeric literals
+//
+////////////////////////////////
+
+// Powers of ten that are exactly representable as doubles
+static const double LEXER_POW10[23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#define LEXER_MAX_MANTISSA_DIGITS 19
+#define LEXER_MAX_EXACT_MANTISSA (((uint64_t)1) << 53)
+
+static inline bool isHexDigit(char c)
+{
+    return isNumeric(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static inline uint64_t hexDigitValue(char c)
+{
+    if (c >= 'a' && c <= 'f') return (uint64_t)(c - 'a' + 10);
+    if (c >= 'A' && c <= 'F') return (uint64_t)(c - 'A' + 10);
+    return (uint64_t)(c - '0');
+}
+
+static void lexerNumberError(Lexer *l, const char *p, const char *msg)
+{
+    Location err_loc = l->token.loc;
+    err_loc.length = (uint32_t)(p - &l->text[l->pos]);
+    if (err_loc.length == 0) err_loc.length = 1;
+    ts__addErr(l->compiler, &err_loc, "%s", msg);
+}
+
+// Converts the decimal literal spanning [start, end) to a double.
+//
+// When every significant digit fits in the mantissa and the power of ten is
+// exactly representable, a single IEEE multiplication or division gives the
+// correctly rounded result (Clinger's fast path). That covers virtually every
+// literal found in shaders. The remaining cases hand the digits to strtod
+// without a radix character, so the result does not depend on the C locale.
+static double lexerDecimalToDouble(
+    Lexer *l,
+    const char *start,
+    const char *end,
+    uint64_t mantissa,
+    bool truncated,
+    int64_t exp10,
+    int64_t full_exp10)
+{
+    if (!truncated && mantissa <= LEXER_MAX_EXACT_MANTISSA)
+    {
+        double value = (double)mantissa;
+        if (mantissa == 0) return 0.0;
+
+        if (exp10 >= 0 && exp10 <= 22)
+        {
+            return value * LEXER_POW10[exp10];
+        }
+
+        if (exp10 < 0 && exp10 >= -22)
+        {
+            return value / LEXER_POW10[-exp10];
+        }
+
+        // Shift part of the exponent into the mantissa while it stays exact,
+        // e.g. 12e24 == 12000e21
+        if (exp10 > 22 && exp10 <= 22 + 15)
+        {
+            uint64_t scaled = mantissa;
+            int64_t e = exp10;
+            while (e > 22 && scaled <= LEXER_MAX_EXACT_MANTISSA / 10)
+            {
+                scaled *= 10;
+                e--;
+            }
+            if (e == 22) return (double)scaled * LEXER_POW10[22];
+        }
+    }
+
+    StringBuilder *sb = &l->compiler->sb;
+    ts__sbReset(sb);
+    for (const char *c = start; c != end; ++c)
+    {
+        if (isNumeric(*c)) ts__sbAppendChar(sb, *c);
+    }
+    ts__sbSprintf(sb, "e%lld", (long long)full_exp10);
+    ts__sbAppendChar(sb, '\0');
+
+    return strtod(sb->buf, NULL);
+}
+
+// Scans a numeric literal starting at the current position, in place.
+//
+// Accepted forms:
+//   decimal integers     123, 123u, 123l, 123ul
+//   octal integers       0777, 0777u
+//   hexadecimal integers 0xFF, 0XffU
+//   floats               1.0, 1., .5, 1e5, 1.5e-3, 2.5E+2
+//   float suffixes       f, F, h, H, l, L, lf, LF
+static void lexerNumber(Lexer *l)
+{
+    const char *start = &l->text[l->pos];
+    const char *p = start;
+
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+    {
+        l->token.kind = TOKEN_INT_LIT;
+        p += 2;
+
+        if (!isHexDigit(*p))
+        {
+            lexerNumberError(l, p, "expected hexadecimal digits after '0x'");
+        }
+
+        uint64_t value = 0;
+        bool overflow = false;
+        while (isHexDigit(*p))
+        {
+            if (value > (UINT64_MAX >> 4)) overflow = true;
+            value = (value << 4) | hexDigitValue(*p);
+            p++;
+        }
+
+        while (*p == 'u' || *p == 'U' || *p == 'l' || *p == 'L') p++;
+
+        if (overflow)
+        {
+            lexerNumberError(l, p, "integer literal is too large");
+        }
+
+        l->token.int_ = (int64_t)value;
+        l->token.loc.length = (uint32_t)(p - start);
+        lexerNext(l, (size_t)(p - start));
+        return;
+    }
+
+    uint64_t mantissa = 0;
+    uint32_t mantissa_digits = 0; // Significant digits accumulated in mantissa
+    int64_t dropped_int_digits = 0;
+    int64_t frac_digits = 0;      // Fraction digits accumulated in mantissa
+    int64_t all_frac_digits = 0;
+    bool truncated = false;
+    bool is_float = false;
+    bool has_invalid_octal = false;
+
+    const char *int_start = p;
+    while (isNumeric(*p))
+    {
+        if (*p > '7') has_invalid_octal = true;
+
+        if (mantissa_digits < LEXER_MAX_MANTISSA_DIGITS)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            if (mantissa > 0) mantissa_digits++;
+        }
+        else
+        {
+            if (*p != '0') truncated = true;
+            dropped_int_digits++;
+        }
+        p++;
+    }
+    const char *int_end = p;
+
+    if (*p == '.')
+    {
+        is_float = true;
+        p++;
+
+        while (isNumeric(*p))
+        {
+            all_frac_digits++;
+            if (mantissa_digits < LEXER_MAX_MANTISSA_DIGITS)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                if (mantissa > 0) mantissa_digits++;
+                frac_digits++;
+            }
+            else if (*p != '0')
+            {
+                truncated = true;
+            }
+            p++;
+        }
+    }
+
+    const char *digits_end = p;
+
+    int64_t exponent = 0;
+    if ((*p == 'e' || *p == 'E') &&
+        (isNumeric(p[1]) || ((p[1] == '-' || p[1] == '+') && isNumeric(p[2]))))
+    {
+        is_float = true;
+        p++;
+
+        bool negative = false;
+        if (*p == '-' || *p == '+')
+        {
+            negative = (*p == '-');
+            p++;
+        }
+
+        while (isNumeric(*p))
+        {
+            // Clamp absurd exponents, the result is 0 or inf either way
+            if (exponent < 100000) exponent = exponent * 10 + (*p - '0');
+            p++;
+        }
+
+        if (negative) exponent = -exponent;
+    }
+
+    if (*p == 'f' || *p == 'F' || *p == 'h' || *p == 'H')
+    {
+        is_float = true;
+        p++;
+    }
+    else if (is_float && (*p == 'l' || *p == 'L'))
+    {
+        p++;
+        if (*p == 'f' || *p == 'F') p++;
+    }
+
+    if (is_float)
+    {
+        l->token.kind = TOKEN_FLOAT_LIT;
+        l->token.double_ = lexerDecimalToDouble(
+            l,
+            start,
+            digits_end,
+            mantissa,
+            truncated,
+            exponent + dropped_int_digits - frac_digits,
+            exponent - all_frac_digits);
+    }
+    else
+    {
+        l->token.kind = TOKEN_INT_LIT;
+
+        uint64_t value = 0;
+        bool overflow = false;
+
+        if (int_start[0] == '0' && int_end - int_start > 1)
+        {
+            // Octal
+            if (has_invalid_octal)
+            {
+                lexerNumberError(l, int_end, "invalid digit in octal literal");
+            }
+
+            for (const char *c = int_start + 1; c != int_end; ++c)
+            {
+                if (value > (UINT64_MAX >> 3)) overflow = true;
+                value = (value << 3) | (uint64_t)(*c - '0');
+            }
+        }
+        else if (dropped_int_digits == 0)
+        {
+            value = mantissa;
+        }
+        else
+        {
+            value = mantissa;
+            for (const char *c = int_end - dropped_int_digits; c != int_end; ++c)
+            {
+                uint64_t digit = (uint64_t)(*c - '0');
+                if (value > (UINT64_MAX - digit) / 10) overflow = true;
+                value = value * 10 + digit;
+            }
+        }
+
+        while (*p == 'u' || *p == 'U' || *p == 'l' || *p == 'L') p++;
+
+        if (overflow)
+        {
+            lexerNumberError(l, p, "integer literal is too large");
+        }
+
+        l->token.int_ = (int64_t)value;
+    }
+
+    l->token.loc.length = (uint32_t)(p - start);
+    lexerNext(l, (size_t)(p - start));
+}
+
 ArrayOfToken ts__lex(TsCompiler *compiler, File *file, const char *text, size_t text_size)
 {
     Lexer *l = NEW(compiler, Lexer);
@@ -101,7 +387,6 @@ ArrayOfToken ts__lex(TsCompiler *compiler, File *file, const char *text, size_t
     {
         memset(&l->token, 0, sizeof(Token));
         l->token.loc.path = l->file_path;
-        l->token.loc.buffer = l->text;
         l->token.loc.pos = (uint32_t)l->pos;
         l->token.loc.length = 0;
         l->token.loc.line = l->line;
@@ -155,7 +440,10 @@ ArrayOfToken ts__lex(TsCompiler *compiler, File *file, const char *text, size_t
         }
 
         case '.': {
-            lexerAddSimpleToken(l, TOKEN_PERIOD, 1);
+            if (isNumeric(lexerPeek(l, 1)))
+                lexerNumber(l);
+            else
+                lexerAddSimpleToken(l, TOKEN_PERIOD, 1);
             break;
         }
 
@@ -232,7 +520,6 @@ ArrayOfToken ts__lex(TsCompiler *compiler, File *file, const char *text, size_t
                     Location err_loc = l->token.loc;
                     err_loc.length = 1;
                     err_loc.path = l->file_path;
-                    err_loc.buffer = l->text;
                     err_loc.pos = (uint32_t)l->pos;
                     err_loc.line = l->line;
                     err_loc.col = l->col;
@@ -318,6 +605,8 @@ ArrayOfToken ts__lex(TsCompiler *compiler, File *file, const char *text, size_t
         case '>': {
             if (lexerPeek(l, 1) == '=')
                 lexerAddSimpleToken(l, TOKEN_GREATEREQ, 2);
+            else if (lexerPeek(l, 1) == '>' && lexerPeek(l, 2) == '=')
+                lexerAddSimpleToken(l, TOKEN_RSHIFT_ASSIGN, 3);
             else if (lexerPeek(l, 1) == '>')
                 lexerAddSimpleToken(l, TOKEN_RSHIFT, 2);
             else
@@ -327,6 +616,8 @@ ArrayOfToken ts__lex(TsCompiler *compiler, File *file, const char *text, size_t
         case '<': {
             if (lexerPeek(l, 1) == '=')
                 lexerAddSimpleToken(l, TOKEN_LESSEQ, 2);
+            else if (lexerPeek(l, 1) == '<' && lexerPeek(l, 2) == '=')
+                lexerAddSimpleToken(l, TOKEN_LSHIFT_ASSIGN, 3);
             else if (lexerPeek(l, 1) == '<')
                 lexerAddSimpleToken(l, TOKEN_LSHIFT, 2);
             else
@@ -413,7 +704,6 @@ ArrayOfToken ts__lex(TsCompiler *compiler, File *file, const char *text, size_t
                 Location err_loc = l->token.loc;
                 err_loc.length = 1;
                 err_loc.path = l->file_path;
-                err_loc.buffer = l->text;
                 err_loc.pos = (uint32_t)l->pos;
                 err_loc.line = l->line;
                 err_loc.col = l->col;
@@ -507,113 +797,13 @@ ArrayOfToken ts__lex(TsCompiler *compiler, File *file, const char *text, size_t
             }
             else if (!lexerIsAtEnd(l) && isNumeric(lexerPeek(l, 0)))
             {
-                if (lexerPeek(l, 0) == '0' && lexerPeek(l, 1) == 'x')
-                {
-                    // Hexadecimal
-                    l->token.kind = TOKEN_INT_LIT;
-                    lexerNext(l, 2);
-                    l->token.loc.length += 2;
-
-                    const char *hex_start = &l->text[l->pos];
-
-                    while (isNumeric(lexerPeek(l, 0)) ||
-                           (lexerPeek(l, 0) >= 'a' && lexerPeek(l, 0) <= 'f') ||
-                           (lexerPeek(l, 0) >= 'A' && lexerPeek(l, 0) <= 'F'))
-                    {
-                        l->token.loc.length++;
-                        lexerNext(l, 1);
-                    }
-
-                    char *str = NEW_ARRAY(compiler, char, l->token.loc.length - 2 + 1);
-                    memcpy(str, hex_start, l->token.loc.length - 2);
-
-                    if (lexerPeek(l, 0) == 'u' || lexerPeek(l, 0) == 'U')
-                    {
-                        l->token.loc.length++;
-                        lexerNext(l, 1);
-                    }
-
-                    l->token.int_ = strtol(str, NULL, 16);
-                }
-                else
-                {
-                    const char *number_start = &l->text[l->pos];
-                    bool is_float = false;
-
-                    while (isNumeric(lexerPeek(l, 0)))
-                    {
-                        l->token.loc.length++;
-                        lexerNext(l, 1);
-                    }
-
-                    if (lexerPeek(l, 0) == 'u' || lexerPeek(l, 0) == 'U')
-                    {
-                        l->token.loc.length++;
-                        lexerNext(l, 1);
-                    }
-                    else
-                    {
-                        if (lexerPeek(l, 0) == '.')
-                        {
-                            is_float = true;
-                            l->token.loc.length++;
-                            lexerNext(l, 1);
-                        }
-
-                        while (isNumeric(lexerPeek(l, 0)))
-                        {
-                            l->token.loc.length++;
-                            lexerNext(l, 1);
-                        }
-
-                        if (lexerPeek(l, 0) == 'e' || lexerPeek(l, 0) == 'E')
-                        {
-                            is_float = true;
-                            l->token.loc.length++;
-                            lexerNext(l, 1);
-
-                            if (lexerPeek(l, 0) == '-')
-                            {
-                                l->token.loc.length++;
-                                lexerNext(l, 1);
-                            }
-
-                            while (isNumeric(lexerPeek(l, 0)))
-                            {
-                                l->token.loc.length++;
-                                lexerNext(l, 1);
-                            }
-                        }
-
-                        if (lexerPeek(l, 0) == 'f')
-                        {
-                            is_float = true;
-                            l->token.loc.length++;
-                            lexerNext(l, 1);
-                        }
-                    }
-
-                    char *str = NEW_ARRAY(compiler, char, l->token.loc.length + 1);
-                    memcpy(str, number_start, l->token.loc.length);
-
-                    if (is_float)
-                    {
-                        l->token.kind = TOKEN_FLOAT_LIT;
-                        l->token.double_ = strtod(str, NULL);
-                    }
-                    else
-                    {
-                        l->token.kind = TOKEN_INT_LIT;
-                        l->token.int_ = strtol(str, NULL, 10);
-                    }
-                }
+                lexerNumber(l);
             }
             else if (!lexerIsAtEnd(l))
             {
                 Location err_loc = l->token.loc;
                 err_loc.length = 1;
                 err_loc.path = l->file_path;
-                err_loc.buffer = l->text;
                 err_loc.pos = (uint32_t)l->pos;
                 err_loc.line = l->line;
                 err_loc.col = l->col;
@@ -663,7 +853,6 @@ ArrayOfToken ts__lex(TsCompiler *compiler, File *file, const char *text, size_t
     {
         Location err_loc = {0};
         err_loc.path = l->file_path;
-        err_loc.buffer = l->text;
         ts__addErr(l->compiler, &err_loc, "no input, reached end of file");
     }
 
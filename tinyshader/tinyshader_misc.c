@@ -3,6 +3,7 @@
  * See tinyshader.h for license details.
  */
 #include "tinyshader_internal.h"
+#include <time.h>
 
 #define TS_PATHSEP '/'
 
@@ -12,6 +13,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <spawn.h>
+#include <pthread.h>
 
 extern char **environ;
 #endif
@@ -259,6 +261,19 @@ static inline uint64_t hashStr(const char *string)
 
 static void hashGrow(HashMap *map);
 
+uint64_t ts__hashString(const char *string)
+{
+    return hashStr(string);
+}
+
+uint64_t ts__hashBytes(const void *bytes, size_t size)
+{
+    uint64_t hash;
+    fnvHashReset(&hash);
+    fnvHashUpdate(&hash, (uint8_t *)bytes, size);
+    return hash;
+}
+
 void ts__hashInit(TsCompiler *compiler, HashMap *map, uint64_t size)
 {
     memset(map, 0, sizeof(*map));
@@ -402,6 +417,141 @@ void ts__hashDestroy(HashMap *map)
     arrFree(map->compiler, &map->values);
 }
 
+////////////////////////////////
+//
+// Intern table
+//
+////////////////////////////////
+
+void ts__internInit(
+    TsCompiler *compiler,
+    InternTable *table,
+    uint64_t (*hash)(const void *item),
+    bool (*equal)(const void *a, const void *b))
+{
+    memset(table, 0, sizeof(*table));
+    table->compiler = compiler;
+    table->hash = hash;
+    table->equal = equal;
+
+    table->size = DEFAULT_HASHMAP_SIZE;
+    table->slots = NEW_ARRAY(compiler, uint32_t, table->size);
+    table->hashes = NEW_ARRAY(compiler, uint64_t, table->size);
+}
+
+static uint32_t internFindSlot(InternTable *table, const void *item, uint64_t hash)
+{
+    uint32_t i = (uint32_t)hash & (table->size - 1);
+    while (table->slots[i] != 0)
+    {
+        if (table->hashes[i] == hash &&
+            table->equal(table->values.ptr[table->slots[i] - 1], item))
+        {
+            break;
+        }
+        i = (i + 1) & (table->size - 1);
+    }
+    return i;
+}
+
+static void internGrow(InternTable *table)
+{
+    uint32_t *old_slots = table->slots;
+    uint64_t *old_hashes = table->hashes;
+    uint32_t old_size = table->size;
+
+    table->size *= 2;
+    table->slots = NEW_ARRAY(table->compiler, uint32_t, table->size);
+    table->hashes = NEW_ARRAY(table->compiler, uint64_t, table->size);
+
+    for (uint32_t i = 0; i < old_size; ++i)
+    {
+        if (old_slots[i] == 0) continue;
+
+        // Entries are unique, so only an empty slot needs to be found
+        uint32_t j = (uint32_t)old_hashes[i] & (table->size - 1);
+        while (table->slots[j] != 0) j = (j + 1) & (table->size - 1);
+
+        table->slots[j] = old_slots[i];
+        table->hashes[j] = old_hashes[i];
+    }
+}
+
+void *ts__internHashed(InternTable *table, void *item, uint64_t hash)
+{
+    uint32_t slot = internFindSlot(table, item, hash);
+    if (table->slots[slot] != 0)
+    {
+        return table->values.ptr[table->slots[slot] - 1];
+    }
+
+    arrPush(table->compiler, &table->values, item);
+    table->slots[slot] = (uint32_t)table->values.len;
+    table->hashes[slot] = hash;
+
+    if (table->values.len * 2 > table->size)
+    {
+        internGrow(table);
+    }
+
+    return item;
+}
+
+// Returns the canonical item equal to 'item' without inserting it, or NULL
+void *ts__internFind(InternTable *table, const void *item, uint64_t hash)
+{
+    uint32_t slot = internFindSlot(table, item, hash);
+    if (table->slots[slot] == 0) return NULL;
+    return table->values.ptr[table->slots[slot] - 1];
+}
+
+void *ts__intern(InternTable *table, void *item)
+{
+    return ts__internHashed(table, item, table->hash(item));
+}
+
+// Makes 'item' the canonical item in place of the one equal to it
+void ts__internReplace(InternTable *table, void *item, uint64_t hash)
+{
+    uint32_t slot = internFindSlot(table, item, hash);
+    assert(table->slots[slot] != 0);
+    table->values.ptr[table->slots[slot] - 1] = item;
+}
+
+// Removes the items 'keep' returns false for, the others stay in insertion order
+void ts__internFilter(InternTable *table, bool (*keep)(const void *item))
+{
+    uint32_t *new_indices = NEW_ARRAY(table->compiler, uint32_t, table->values.len);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < table->values.len; ++i)
+    {
+        if (!keep(table->values.ptr[i])) continue;
+
+        table->values.ptr[kept++] = table->values.ptr[i];
+        new_indices[i] = (uint32_t)kept;
+    }
+
+    if (kept == table->values.len) return;
+    table->values.len = kept;
+
+    uint32_t *old_slots = table->slots;
+    uint64_t *old_hashes = table->hashes;
+    table->slots = NEW_ARRAY(table->compiler, uint32_t, table->size);
+    table->hashes = NEW_ARRAY(table->compiler, uint64_t, table->size);
+
+    for (uint32_t i = 0; i < table->size; ++i)
+    {
+        if (old_slots[i] == 0 || new_indices[old_slots[i] - 1] == 0) continue;
+
+        uint32_t j = (uint32_t)old_hashes[i] & (table->size - 1);
+        while (table->slots[j] != 0) j = (j + 1) & (table->size - 1);
+
+        table->slots[j] = new_indices[old_slots[i] - 1];
+        table->hashes[j] = old_hashes[i];
+    }
+}
+
 ////////////////////////////////
 //
 // Bump allocator
@@ -490,11 +640,326 @@ char *ts__bumpStrndup(BumpAlloc *alloc, const char *str, size_t length)
     return ptr;
 }
 
+void ts__bumpAdopt(BumpAlloc *alloc, BumpAlloc *other)
+{
+    // The base block lives inside 'other', so it needs a heap copy before it can be
+    // linked into our chain. New allocations keep going into the adopted tail block.
+    BumpBlock *head = malloc(sizeof(BumpBlock));
+    *head = other->base_block;
+
+    BumpBlock *tail = other->last_block;
+    if (tail == &other->base_block) tail = head;
+
+    assert(alloc->last_block->next == NULL);
+    alloc->last_block->next = head;
+    alloc->last_block = tail;
+
+    memset(other, 0, sizeof(*other));
+}
+
 void ts__bumpDestroy(BumpAlloc *alloc)
 {
     blockDestroy(&alloc->base_block);
 }
 
+////////////////////////////////
+//
+// Threads
+//
+////////////////////////////////
+
+struct Thread
+{
+#if defined(__unix__) || defined(__APPLE__)
+    pthread_t handle;
+#elif defined(_WIN32)
+    HANDLE handle;
+#endif
+    void (*proc)(void *);
+    void *arg;
+};
+
+// Parsing and analysis recurse on expression depth, so ask for a main-thread sized stack
+// (macOS would otherwise give secondary threads only 512k)
+#define THREAD_STACK_SIZE (8 << 20)
+
+#if defined(__unix__) || defined(__APPLE__)
+static void *threadEntry(void *arg)
+{
+    Thread *thread = arg;
+    thread->proc(thread->arg);
+    return NULL;
+}
+#elif defined(_WIN32)
+static DWORD WINAPI threadEntry(LPVOID arg)
+{
+    Thread *thread = arg;
+    thread->proc(thread->arg);
+    return 0;
+}
+#endif
+
+uint32_t ts__getCpuCount(void)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (uint32_t)count : 1;
+#elif defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? (uint32_t)info.dwNumberOfProcessors : 1;
+#else
+    return 1;
+#endif
+}
+
+double ts__getTime(void)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#elif defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+Thread *ts__threadStart(void (*proc)(void *), void *arg)
+{
+#if defined(__unix__) || defined(__APPLE__) || defined(_WIN32)
+    Thread *thread = malloc(sizeof(Thread));
+    thread->proc = proc;
+    thread->arg = arg;
+
+#if defined(_WIN32)
+    thread->handle = CreateThread(
+        NULL,
+        THREAD_STACK_SIZE,
+        threadEntry,
+        thread,
+        STACK_SIZE_PARAM_IS_A_RESERVATION,
+        NULL);
+    if (thread->handle != NULL) return thread;
+#else
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, THREAD_STACK_SIZE);
+    int res = pthread_create(&thread->handle, &attr, threadEntry, thread);
+    pthread_attr_destroy(&attr);
+    if (res == 0) return thread;
+#endif
+
+    free(thread);
+#endif
+    // No thread support: the caller is expected to run 'proc' itself
+    return NULL;
+}
+
+void ts__threadJoin(Thread *thread)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    pthread_join(thread->handle, NULL);
+#elif defined(_WIN32)
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#endif
+    free(thread);
+}
+
+#if defined(__unix__) || defined(__APPLE__) || defined(_WIN32)
+struct Mutex
+{
+#if defined(_WIN32)
+    CRITICAL_SECTION handle;
+#else
+    pthread_mutex_t handle;
+#endif
+};
+#endif
+
+// Returns NULL when there is no thread support, locking is then a no-op
+Mutex *ts__mutexCreate(void)
+{
+#if defined(__unix__) || defined(__APPLE__) || defined(_WIN32)
+    Mutex *mutex = malloc(sizeof(Mutex));
+#if defined(_WIN32)
+    InitializeCriticalSection(&mutex->handle);
+#else
+    pthread_mutex_init(&mutex->handle, NULL);
+#endif
+    return mutex;
+#else
+    return NULL;
+#endif
+}
+
+void ts__mutexDestroy(Mutex *mutex)
+{
+    if (!mutex) return;
+#if defined(_WIN32)
+    DeleteCriticalSection(&mutex->handle);
+#elif defined(__unix__) || defined(__APPLE__)
+    pthread_mutex_destroy(&mutex->handle);
+#endif
+    free(mutex);
+}
+
+void ts__mutexLock(Mutex *mutex)
+{
+    if (!mutex) return;
+#if defined(_WIN32)
+    EnterCriticalSection(&mutex->handle);
+#elif defined(__unix__) || defined(__APPLE__)
+    pthread_mutex_lock(&mutex->handle);
+#endif
+}
+
+void ts__mutexUnlock(Mutex *mutex)
+{
+    if (!mutex) return;
+#if defined(_WIN32)
+    LeaveCriticalSection(&mutex->handle);
+#elif defined(__unix__) || defined(__APPLE__)
+    pthread_mutex_unlock(&mutex->handle);
+#endif
+}
+
+////////////////////////////////
+//
+// AST pools
+//
+////////////////////////////////
+
+AstPools *ts__astPoolsCreate(void)
+{
+    AstPools *pools = malloc(sizeof(AstPools));
+    memset(pools, 0, sizeof(*pools));
+    pools->mutex = ts__mutexCreate();
+
+    pools->pools[AST_POOL_EXPR].item_size = sizeof(AstExpr);
+    pools->pools[AST_POOL_STMT].item_size = sizeof(AstStmt);
+    pools->pools[AST_POOL_DECL].item_size = sizeof(AstDecl);
+    pools->pools[AST_POOL_EXPR_INFO].item_size = sizeof(AstExprInfo);
+    pools->pools[AST_POOL_DECL_INFO].item_size = sizeof(AstDeclInfo);
+
+    // Id 0 stands for no node
+    for (uint32_t i = 0; i < AST_POOL_COUNT; ++i)
+    {
+        pools->pools[i].next = 1;
+    }
+    pools->next_loc = 1;
+
+    return pools;
+}
+
+void ts__astPoolsDestroy(AstPools *pools)
+{
+    for (uint32_t i = 0; i < AST_POOL_COUNT; ++i)
+    {
+        for (uint32_t j = 0; j < AST_POOL_MAX_CHUNKS; ++j)
+        {
+            free(pools->pools[i].chunks[j]);
+        }
+    }
+    ts__mutexDestroy(pools->mutex);
+    free(pools);
+}
+
+// Hands out 'count' consecutive ids of the pool, with their chunks allocated
+uint32_t ts__astReserve(TsCompiler *compiler, AstPoolKind kind, uint32_t count)
+{
+    AstPools *pools = compiler->ast;
+    AstPool *pool = &pools->pools[kind];
+
+    ts__mutexLock(pools->mutex);
+
+    uint32_t first = pool->next;
+    uint64_t end = (uint64_t)first + count;
+    assert(end <= ((((uint64_t)1 << AST_POOL_MAX_CHUNKS) - 1) << AST_POOL_CHUNK_BITS));
+    pool->next = (uint32_t)end;
+
+    if (count > 0)
+    {
+        uint32_t last_chunk = ts__log2(((uint32_t)(end - 1) >> AST_POOL_CHUNK_BITS) + 1);
+        for (uint32_t chunk = ts__log2((first >> AST_POOL_CHUNK_BITS) + 1);
+             chunk <= last_chunk;
+             ++chunk)
+        {
+            if (pool->chunks[chunk]) continue;
+            size_t chunk_size = (size_t)1 << (chunk + AST_POOL_CHUNK_BITS);
+            pool->chunks[chunk] = calloc(chunk_size, pool->item_size);
+        }
+    }
+
+    ts__mutexUnlock(pools->mutex);
+
+    return first;
+}
+
+// Makes the 'count' locations at 'first', 'stride' bytes apart, reachable through
+// source locations. Returns the source location of the first one.
+SourceLoc ts__sourceMapAdd(
+    TsCompiler *compiler, const Location *first, size_t stride, uint32_t count)
+{
+    AstPools *pools = compiler->ast;
+
+    ts__mutexLock(pools->mutex);
+
+    SourceRange range = {0};
+    range.base = pools->next_loc;
+    range.count = count;
+    range.locs = (const unsigned char *)first;
+    range.stride = stride;
+    arrPush(compiler, &pools->source_ranges, range);
+
+    assert((uint64_t)pools->next_loc + count <= UINT32_MAX);
+    pools->next_loc += count;
+
+    ts__mutexUnlock(pools->mutex);
+
+    return range.base;
+}
+
+Location ts__sourceLocResolve(TsCompiler *compiler, SourceLoc loc)
+{
+    AstPools *pools = compiler->ast;
+    Location result = {0};
+
+    ts__mutexLock(pools->mutex);
+
+    size_t lo = 0;
+    size_t hi = pools->source_ranges.len;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (pools->source_ranges.ptr[mid].base <= loc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (loc != 0 && lo > 0)
+    {
+        SourceRange *range = &pools->source_ranges.ptr[lo - 1];
+        if (loc - range->base < range->count)
+        {
+            memcpy(
+                &result,
+                range->locs + (size_t)(loc - range->base) * range->stride,
+                sizeof(result));
+        }
+    }
+
+    ts__mutexUnlock(pools->mutex);
+
+    return result;
+}
+
 ////////////////////////////////
 //
 // String builder
@@ -589,6 +1054,416 @@ char *ts__sbBuild(StringBuilder *sb, BumpAlloc *bump)
     return result;
 }
 
+////////////////////////////////
+//
+// Constant folding
+//
+// Results follow the SPIR-V instruction or GLSL.std.450 function the operation is
+// lowered to. The analyzer and the optimizer both fold through these, so that an
+// expression gets the same value whichever of them folds it.
+//
+////////////////////////////////
+
+#define FOLD_PI 3.14159265358979323846
+
+// The bits of an integer, zero extended
+static uint64_t scalarBits(ScalarValue value)
+{
+    if (value.bits >= 64) return value.u;
+    return value.u & ((UINT64_C(1) << value.bits) - 1);
+}
+
+static int64_t scalarSigned(ScalarValue value)
+{
+    uint64_t bits = scalarBits(value);
+    if (value.bits < 64 && (bits >> (value.bits - 1)) & 1)
+    {
+        bits |= ~UINT64_C(0) << value.bits;
+    }
+    return (int64_t)bits;
+}
+
+static bool scalarIntLess(ScalarValue l, ScalarValue r)
+{
+    if (l.kind == SCALAR_INT) return scalarSigned(l) < scalarSigned(r);
+    return scalarBits(l) < scalarBits(r);
+}
+
+static bool foldInt(ScalarValue *result, ScalarKind kind, uint32_t bits, uint64_t value)
+{
+    result->kind = kind;
+    result->bits = bits;
+    result->u = value;
+    return true;
+}
+
+static bool foldFloat(ScalarValue *result, double value)
+{
+    result->kind = SCALAR_FLOAT;
+    result->bits = 0;
+    result->f = value;
+    return true;
+}
+
+static bool foldBool(ScalarValue *result, bool value)
+{
+    return foldInt(result, SCALAR_BOOL, 0, value);
+}
+
+bool ts__foldBinary(SpvOp op, ScalarValue l, ScalarValue r, ScalarValue *result)
+{
+    switch (l.kind)
+    {
+    case SCALAR_FLOAT: {
+        double x = l.f;
+        double y = r.f;
+        bool unordered = isnan(x) || isnan(y);
+
+        switch (op)
+        {
+        case SpvOpFAdd: return foldFloat(result, x + y);
+        case SpvOpFSub: return foldFloat(result, x - y);
+        case SpvOpFMul: return foldFloat(result, x * y);
+        case SpvOpFDiv: {
+            if (y == 0.0) return false;
+            return foldFloat(result, x / y);
+        }
+        case SpvOpFRem: {
+            if (y == 0.0) return false;
+            return foldFloat(result, fmod(x, y));
+        }
+
+        case SpvOpFOrdEqual: return foldBool(result, !unordered && x == y);
+        case SpvOpFOrdNotEqual: return foldBool(result, !unordered && x != y);
+        case SpvOpFOrdLessThan: return foldBool(result, x < y);
+        case SpvOpFOrdLessThanEqual: return foldBool(result, x <= y);
+        case SpvOpFOrdGreaterThan: return foldBool(result, x > y);
+        case SpvOpFOrdGreaterThanEqual: return foldBool(result, x >= y);
+
+        default: return false;
+        }
+    }
+
+    case SCALAR_INT:
+    case SCALAR_UINT: {
+        ScalarKind kind = l.kind;
+        uint32_t bits = l.bits;
+        uint64_t x = scalarBits(l);
+        uint64_t y = scalarBits(r);
+        int64_t sx = scalarSigned(l);
+        int64_t sy = scalarSigned(r);
+
+        switch (op)
+        {
+        case SpvOpIAdd: return foldInt(result, kind, bits, x + y);
+        case SpvOpISub: return foldInt(result, kind, bits, x - y);
+        case SpvOpIMul: return foldInt(result, kind, bits, x * y);
+
+        case SpvOpUDiv: return (y != 0) && foldInt(result, kind, bits, x / y);
+        case SpvOpUMod: return (y != 0) && foldInt(result, kind, bits, x % y);
+
+        case SpvOpSDiv:
+        case SpvOpSRem:
+        case SpvOpSMod: {
+            if (sy == 0) return false;
+
+            // Overflows for the most negative value divided by -1
+            int64_t min = (bits < 64) ? -(INT64_C(1) << (bits - 1)) : INT64_MIN;
+            if (sx == min && sy == -1) return false;
+
+            if (op == SpvOpSDiv) return foldInt(result, kind, bits, (uint64_t)(sx / sy));
+
+            // OpSRem takes the sign of the dividend and OpSMod the one of the divisor
+            int64_t rem = sx % sy;
+            if (op == SpvOpSMod && rem != 0 && ((rem < 0) != (sy < 0))) rem += sy;
+            return foldInt(result, kind, bits, (uint64_t)rem);
+        }
+
+        // The shift amount may have another integer type, it is read as unsigned
+        case SpvOpShiftLeftLogical:
+        case SpvOpShiftRightLogical:
+        case SpvOpShiftRightArithmetic: {
+            if (r.kind != SCALAR_INT && r.kind != SCALAR_UINT) return false;
+            if (y >= bits) return false;
+            if (op == SpvOpShiftLeftLogical) return foldInt(result, kind, bits, x << y);
+            if (op == SpvOpShiftRightLogical) return foldInt(result, kind, bits, x >> y);
+            return foldInt(result, kind, bits, (uint64_t)(sx >> y));
+        }
+
+        case SpvOpBitwiseOr: return foldInt(result, kind, bits, x | y);
+        case SpvOpBitwiseAnd: return foldInt(result, kind, bits, x & y);
+        case SpvOpBitwiseXor: return foldInt(result, kind, bits, x ^ y);
+
+        case SpvOpIEqual: return foldBool(result, x == y);
+        case SpvOpINotEqual: return foldBool(result, x != y);
+        case SpvOpULessThan: return foldBool(result, x < y);
+        case SpvOpULessThanEqual: return foldBool(result, x <= y);
+        case SpvOpUGreaterThan: return foldBool(result, x > y);
+        case SpvOpUGreaterThanEqual: return foldBool(result, x >= y);
+        case SpvOpSLessThan: return foldBool(result, sx < sy);
+        case SpvOpSLessThanEqual: return foldBool(result, sx <= sy);
+        case SpvOpSGreaterThan: return foldBool(result, sx > sy);
+        case SpvOpSGreaterThanEqual: return foldBool(result, sx >= sy);
+
+        default: return false;
+        }
+    }
+
+    case SCALAR_BOOL: {
+        bool x = l.u != 0;
+        bool y = r.u != 0;
+
+        switch (op)
+        {
+        case SpvOpLogicalEqual: return foldBool(result, x == y);
+        case SpvOpLogicalNotEqual: return foldBool(result, x != y);
+        case SpvOpLogicalAnd: return foldBool(result, x && y);
+        case SpvOpLogicalOr: return foldBool(result, x || y);
+        default: return false;
+        }
+    }
+    }
+
+    return false;
+}
+
+bool ts__foldUnary(SpvOp op, ScalarValue value, ScalarValue *result)
+{
+    switch (op)
+    {
+    case SpvOpFNegate: return foldFloat(result, -value.f);
+    case SpvOpSNegate: return foldInt(result, value.kind, value.bits, 0 - value.u);
+    case SpvOpNot: return foldInt(result, value.kind, value.bits, ~value.u);
+    case SpvOpLogicalNot: return foldBool(result, value.u == 0);
+    default: break;
+    }
+
+    return false;
+}
+
+// Converts to an integer of 'kind' and 'bits', or to a float
+bool ts__foldConvert(
+    SpvOp op, ScalarValue value, ScalarKind kind, uint32_t bits, ScalarValue *result)
+{
+    switch (op)
+    {
+    case SpvOpConvertFToS:
+    case SpvOpConvertFToU: {
+        // Out of range conversions are undefined
+        double truncated = trunc(value.f);
+        if (kind == SCALAR_INT)
+        {
+            double limit = ldexp(1.0, (int)bits - 1);
+            if (!(truncated >= -limit && truncated < limit)) return false;
+            return foldInt(result, kind, bits, (uint64_t)(int64_t)truncated);
+        }
+
+        double limit = ldexp(1.0, (int)bits);
+        if (!(truncated >= 0.0 && truncated < limit)) return false;
+        return foldInt(result, kind, bits, (uint64_t)truncated);
+    }
+
+    case SpvOpConvertSToF: return foldFloat(result, (double)scalarSigned(value));
+    case SpvOpConvertUToF: return foldFloat(result, (double)scalarBits(value));
+    case SpvOpFConvert: return foldFloat(result, value.f);
+    case SpvOpSConvert: return foldInt(result, kind, bits, (uint64_t)scalarSigned(value));
+    case SpvOpUConvert:
+    case SpvOpBitcast: return foldInt(result, kind, bits, scalarBits(value));
+
+    default: break;
+    }
+
+    return false;
+}
+
+// Builtins that operate on each component, called with one scalar of each parameter
+bool ts__foldBuiltin(
+    IRBuiltinInstKind kind,
+    const ScalarValue *args,
+    uint32_t arg_count,
+    ScalarValue *result)
+{
+    assert(arg_count > 0);
+
+    if (args[0].kind == SCALAR_INT || args[0].kind == SCALAR_UINT)
+    {
+        switch (kind)
+        {
+        case IR_BUILTIN_ABS: {
+            // Lowered to SAbs, which is only meaningful for signed integers
+            if (args[0].kind != SCALAR_INT) return false;
+            int64_t value = scalarSigned(args[0]);
+            return foldInt(
+                result,
+                args[0].kind,
+                args[0].bits,
+                (value < 0) ? 0 - (uint64_t)value : (uint64_t)value);
+        }
+
+        case IR_BUILTIN_MIN: {
+            *result = scalarIntLess(args[1], args[0]) ? args[1] : args[0];
+            return true;
+        }
+        case IR_BUILTIN_MAX: {
+            *result = scalarIntLess(args[0], args[1]) ? args[1] : args[0];
+            return true;
+        }
+
+        case IR_BUILTIN_CLAMP: {
+            if (scalarIntLess(args[2], args[1])) return false;
+            if (scalarIntLess(args[0], args[1])) *result = args[1];
+            else if (scalarIntLess(args[2], args[0])) *result = args[2];
+            else *result = args[0];
+            return true;
+        }
+
+        default: return false;
+        }
+    }
+
+    if (args[0].kind != SCALAR_FLOAT) return false;
+
+    double x = args[0].f;
+    double y = (arg_count > 1) ? args[1].f : 0.0;
+    double z = (arg_count > 2) ? args[2].f : 0.0;
+    double value = 0.0;
+
+    switch (kind)
+    {
+    case IR_BUILTIN_DEGREES: value = x * (180.0 / FOLD_PI); break;
+    case IR_BUILTIN_RADIANS: value = x * (FOLD_PI / 180.0); break;
+
+    case IR_BUILTIN_SIN: value = sin(x); break;
+    case IR_BUILTIN_COS: value = cos(x); break;
+    case IR_BUILTIN_TAN: value = tan(x); break;
+    case IR_BUILTIN_ASIN: value = asin(x); break;
+    case IR_BUILTIN_ACOS: value = acos(x); break;
+    case IR_BUILTIN_ATAN: value = atan(x); break;
+    case IR_BUILTIN_SINH: value = sinh(x); break;
+    case IR_BUILTIN_COSH: value = cosh(x); break;
+    case IR_BUILTIN_TANH: value = tanh(x); break;
+    case IR_BUILTIN_ATAN2: {
+        if (x == 0.0 && y == 0.0) return false;
+        value = atan2(x, y);
+        break;
+    }
+
+    case IR_BUILTIN_SQRT: value = sqrt(x); break;
+    case IR_BUILTIN_RSQRT: {
+        if (x <= 0.0) return false;
+        value = 1.0 / sqrt(x);
+        break;
+    }
+
+    case IR_BUILTIN_POW: {
+        if (x < 0.0 || (x == 0.0 && y <= 0.0)) return false;
+        value = pow(x, y);
+        break;
+    }
+    case IR_BUILTIN_EXP: value = exp(x); break;
+    case IR_BUILTIN_EXP2: value = exp2(x); break;
+    case IR_BUILTIN_LOG: {
+        if (x <= 0.0) return false;
+        value = log(x);
+        break;
+    }
+    case IR_BUILTIN_LOG2: {
+        if (x <= 0.0) return false;
+        value = log2(x);
+        break;
+    }
+
+    case IR_BUILTIN_ABS: value = fabs(x); break;
+    case IR_BUILTIN_MIN: value = (y < x) ? y : x; break;
+    case IR_BUILTIN_MAX: value = (x < y) ? y : x; break;
+    case IR_BUILTIN_FRAC: value = x - floor(x); break;
+    case IR_BUILTIN_TRUNC: value = trunc(x); break;
+    case IR_BUILTIN_CEIL: value = ceil(x); break;
+    case IR_BUILTIN_FLOOR: value = floor(x); break;
+    case IR_BUILTIN_LERP: value = x * (1.0 - z) + y * z; break;
+    case IR_BUILTIN_CLAMP: {
+        if (y > z) return false;
+        value = (x < y) ? y : ((z < x) ? z : x);
+        break;
+    }
+    case IR_BUILTIN_STEP: value = (y < x) ? 0.0 : 1.0; break;
+    case IR_BUILTIN_SMOOTHSTEP: {
+        if (x >= y) return false;
+        double t = (z - x) / (y - x);
+        t = (t < 0.0) ? 0.0 : ((t > 1.0) ? 1.0 : t);
+        value = t * t * (3.0 - 2.0 * t);
+        break;
+    }
+    case IR_BUILTIN_FMOD: {
+        if (y == 0.0) return false;
+        value = fmod(x, y);
+        break;
+    }
+
+    default: return false;
+    }
+
+    // Outside of the domain of the function
+    if (isnan(value)) return false;
+
+    return foldFloat(result, value);
+}
+
+// 'v' and 'w' are float vectors of 'size' components, 'w' is only read by the builtins
+// taking two of them
+bool ts__foldGeometric(
+    IRBuiltinInstKind kind,
+    const double *v,
+    const double *w,
+    uint32_t size,
+    double *result)
+{
+    double sum = 0.0;
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        double x = v[i];
+        if (kind == IR_BUILTIN_DOT)
+        {
+            sum += x * w[i];
+            continue;
+        }
+
+        if (kind == IR_BUILTIN_DISTANCE) x -= w[i];
+        sum += x * x;
+    }
+
+    switch (kind)
+    {
+    case IR_BUILTIN_DOT: result[0] = sum; return true;
+    case IR_BUILTIN_LENGTH:
+    case IR_BUILTIN_DISTANCE: result[0] = sqrt(sum); return true;
+
+    case IR_BUILTIN_NORMALIZE: {
+        if (sum == 0.0) return false;
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            result[i] = v[i] / sqrt(sum);
+        }
+        return true;
+    }
+
+    case IR_BUILTIN_CROSS: {
+        if (size != 3) return false;
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            uint32_t j = (i + 1) % 3;
+            uint32_t k = (i + 2) % 3;
+            result[i] = v[j] * w[k] - v[k] * w[j];
+        }
+        return true;
+    }
+
+    default: break;
+    }
+
+    return false;
+}
+
 static const char *TOKEN_STRINGS[TOKEN_MAX] = {
     [TOKEN_LPAREN] = "(",
     [TOKEN_RPAREN] = ")",
@@ -680,6 +1555,8 @@ static const char *TOKEN_STRINGS[TOKEN_MAX] = {
     [TOKEN_UNIFORM] = "uniform",
     [TOKEN_GROUPSHARED] = "groupshared",
     [TOKEN_REGISTER] = "register",
+    [TOKEN_TEMPLATE] = "template",
+    [TOKEN_TYPENAME] = "typename",
 };
 
 const char *ts__getTokenString(TokenKind kind)
@@ -0,0 +1,4679 @@
+/**
+ * This file is part of the tinyshader library.
+ * See tinyshader.h for license details.
+ */
+#include "tinyshader_internal.h"
+
+////////////////////////////////
+//
+// Use-def chains and control flow graph
+//
+////////////////////////////////
+
+// Pushes the address of every value operand of the instruction, so that passes can
+// read and rewrite them without knowing the layout of each instruction kind.
+// Blocks and called functions are not value operands.
+void ts__irInstOperands(IRModule *m, IRInst *inst, ArrayOfIRInstSlot *slots)
+{
+    slots->len = 0;
+
+    switch (inst->kind)
+    {
+    case IR_INST_VARIABLE:
+        if (inst->var.initializer) arrPush(m->compiler, slots, &inst->var.initializer);
+        break;
+
+    case IR_INST_RETURN:
+        if (inst->return_.value) arrPush(m->compiler, slots, &inst->return_.value);
+        break;
+
+    case IR_INST_STORE:
+        arrPush(m->compiler, slots, &inst->store.pointer);
+        arrPush(m->compiler, slots, &inst->store.value);
+        break;
+
+    case IR_INST_LOAD: arrPush(m->compiler, slots, &inst->load.pointer); break;
+
+    case IR_INST_ACCESS_CHAIN:
+        arrPush(m->compiler, slots, &inst->access_chain.base);
+        for (uint32_t i = 0; i < inst->access_chain.index_count; ++i)
+        {
+            arrPush(m->compiler, slots, &inst->access_chain.indices[i]);
+        }
+        break;
+
+    case IR_INST_FUNC_CALL:
+        for (uint32_t i = 0; i < inst->func_call.param_count; ++i)
+        {
+            arrPush(m->compiler, slots, &inst->func_call.params[i]);
+        }
+        break;
+
+    case IR_INST_COND_BRANCH: arrPush(m->compiler, slots, &inst->cond_branch.cond); break;
+
+    case IR_INST_BUILTIN_CALL:
+        for (uint32_t i = 0; i < inst->builtin_call.param_count; ++i)
+        {
+            arrPush(m->compiler, slots, &inst->builtin_call.params[i]);
+        }
+        break;
+
+    case IR_INST_BARRIER:
+        arrPush(m->compiler, slots, &inst->barrier.memory_scope);
+        arrPush(m->compiler, slots, &inst->barrier.execution_scope);
+        arrPush(m->compiler, slots, &inst->barrier.semantics);
+        break;
+
+    case IR_INST_CAST: arrPush(m->compiler, slots, &inst->cast.value); break;
+
+    case IR_INST_COMPOSITE_CONSTRUCT:
+        for (uint32_t i = 0; i < inst->composite_construct.field_count; ++i)
+        {
+            arrPush(m->compiler, slots, &inst->composite_construct.fields[i]);
+        }
+        break;
+
+    case IR_INST_COMPOSITE_EXTRACT:
+        arrPush(m->compiler, slots, &inst->composite_extract.value);
+        break;
+
+    case IR_INST_VECTOR_SHUFFLE:
+        arrPush(m->compiler, slots, &inst->vector_shuffle.vector_a);
+        arrPush(m->compiler, slots, &inst->vector_shuffle.vector_b);
+        break;
+
+    case IR_INST_SAMPLE_IMPLICIT_LOD:
+    case IR_INST_SAMPLE_EXPLICIT_LOD:
+        arrPush(m->compiler, slots, &inst->sample.image_sampler);
+        arrPush(m->compiler, slots, &inst->sample.coords);
+        if (inst->sample.lod) arrPush(m->compiler, slots, &inst->sample.lod);
+        break;
+
+    case IR_INST_QUERY_SIZE_LOD:
+        arrPush(m->compiler, slots, &inst->query_size_lod.image);
+        arrPush(m->compiler, slots, &inst->query_size_lod.lod);
+        break;
+
+    case IR_INST_QUERY_LEVELS: arrPush(m->compiler, slots, &inst->query_levels.image); break;
+
+    case IR_INST_UNARY: arrPush(m->compiler, slots, &inst->unary.right); break;
+
+    case IR_INST_BINARY:
+        arrPush(m->compiler, slots, &inst->binary.left);
+        arrPush(m->compiler, slots, &inst->binary.right);
+        break;
+
+    case IR_INST_SELECT:
+        arrPush(m->compiler, slots, &inst->select.cond);
+        arrPush(m->compiler, slots, &inst->select.true_value);
+        arrPush(m->compiler, slots, &inst->select.false_value);
+        break;
+
+    case IR_INST_PHI:
+        for (size_t i = 0; i < inst->phi.values.len; ++i)
+        {
+            arrPush(m->compiler, slots, &inst->phi.values.ptr[i]);
+        }
+        break;
+
+    case IR_INST_UNDEF:
+    case IR_INST_ENTRY_POINT:
+    case IR_INST_FUNCTION:
+    case IR_INST_BLOCK:
+    case IR_INST_FUNC_PARAM:
+    case IR_INST_CONSTANT:
+    case IR_INST_CONSTANT_COMPOSITE:
+    case IR_INST_CONSTANT_BOOL:
+    case IR_INST_DISCARD:
+    case IR_INST_UNREACHABLE:
+    case IR_INST_BRANCH: break;
+    }
+}
+
+// Values that belong to a single function. Constants and globals are shared by the
+// whole module, so their users are not tracked.
+static bool irIsLocalValue(IRInst *inst)
+{
+    switch (inst->kind)
+    {
+    case IR_INST_ENTRY_POINT:
+    case IR_INST_FUNCTION:
+    case IR_INST_BLOCK:
+    case IR_INST_CONSTANT:
+    case IR_INST_CONSTANT_COMPOSITE:
+    case IR_INST_CONSTANT_BOOL:
+    case IR_INST_UNDEF: return false;
+
+    case IR_INST_VARIABLE: return inst->var.storage_class == SpvStorageClassFunction;
+
+    default: return true;
+    }
+}
+
+static void irRemoveUser(IRInst *value, IRInst *user)
+{
+    for (size_t i = 0; i < value->users.len; ++i)
+    {
+        if (value->users.ptr[i] == user)
+        {
+            value->users.ptr[i] = value->users.ptr[--value->users.len];
+            return;
+        }
+    }
+}
+
+// Adds an instruction built after the uses were computed to the users of its operands
+static void irAddUses(IRModule *m, IRInst *inst)
+{
+    ArrayOfIRInstSlot slots = {0};
+    ts__irInstOperands(m, inst, &slots);
+    for (size_t i = 0; i < slots.len; ++i)
+    {
+        IRInst *value = *slots.ptr[i];
+        if (irIsLocalValue(value)) arrPush(m->compiler, &value->users, inst);
+    }
+}
+
+// Grows the user list to the counted length and empties it
+static void irReserveUsers(IRModule *m, IRInst *inst)
+{
+    if (inst->users.len > inst->users.cap)
+    {
+        inst->users.ptr = NEW_ARRAY_UNINIT(m->compiler, IRInst *, inst->users.len);
+        inst->users.cap = inst->users.len;
+    }
+    inst->users.len = 0;
+}
+
+void ts__irComputeUses(IRModule *m, IRInst *func)
+{
+    for (size_t i = 0; i < func->func.params.len; ++i)
+    {
+        IRInst *param = func->func.params.ptr[i];
+        param->parent = NULL;
+        param->users.len = 0;
+    }
+
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            inst->parent = block;
+            inst->users.len = 0;
+        }
+    }
+
+    // Count the users first so that each list is allocated once, at its final size
+    ArrayOfIRInstSlot slots = {0};
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (size_t i = 0; i < func->func.blocks.len; ++i)
+        {
+            IRInst *block = func->func.blocks.ptr[i];
+            for (size_t j = 0; j < block->block.insts.len; ++j)
+            {
+                IRInst *inst = block->block.insts.ptr[j];
+                ts__irInstOperands(m, inst, &slots);
+                for (size_t k = 0; k < slots.len; ++k)
+                {
+                    IRInst *value = *slots.ptr[k];
+                    if (!irIsLocalValue(value)) continue;
+
+                    if (pass == 0)
+                    {
+                        value->users.len++;
+                    }
+                    else
+                    {
+                        value->users.ptr[value->users.len++] = inst;
+                    }
+                }
+            }
+        }
+
+        if (pass > 0) break;
+
+        for (size_t i = 0; i < func->func.params.len; ++i)
+        {
+            irReserveUsers(m, func->func.params.ptr[i]);
+        }
+        for (size_t i = 0; i < func->func.blocks.len; ++i)
+        {
+            IRInst *block = func->func.blocks.ptr[i];
+            for (size_t j = 0; j < block->block.insts.len; ++j)
+            {
+                irReserveUsers(m, block->block.insts.ptr[j]);
+            }
+        }
+    }
+}
+
+// Needs the uses of the function computed
+void ts__irReplaceAllUses(IRModule *m, IRInst *inst, IRInst *value)
+{
+    assert(inst != value);
+
+    ArrayOfIRInstSlot slots = {0};
+    for (size_t i = 0; i < inst->users.len; ++i)
+    {
+        IRInst *user = inst->users.ptr[i];
+        ts__irInstOperands(m, user, &slots);
+        for (size_t j = 0; j < slots.len; ++j)
+        {
+            if (*slots.ptr[j] == inst) *slots.ptr[j] = value;
+        }
+
+        if (irIsLocalValue(value)) arrPush(m->compiler, &value->users, user);
+    }
+
+    inst->users.len = 0;
+}
+
+static IRInst *irBlockTerminator(IRInst *block)
+{
+    if (!ts__irBlockHasTerminator(block)) return NULL;
+    return block->block.insts.ptr[block->block.insts.len - 1];
+}
+
+static void irAddEdge(IRModule *m, IRInst *from, IRInst *to)
+{
+    for (size_t i = 0; i < from->block.succs.len; ++i)
+    {
+        if (from->block.succs.ptr[i] == to) return;
+    }
+
+    arrPush(m->compiler, &from->block.succs, to);
+    arrPush(m->compiler, &to->block.preds, from);
+}
+
+// Only branch targets are edges: merge and continue blocks are structural
+// information and do not make a block reachable by themselves.
+void ts__irComputeCfg(IRModule *m, IRInst *func)
+{
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        block->block.preds.len = 0;
+        block->block.succs.len = 0;
+        block->block.rpo_index = UINT32_MAX;
+        block->mark = 0;
+    }
+
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        IRInst *term = irBlockTerminator(block);
+        if (!term) continue;
+
+        if (term->kind == IR_INST_BRANCH)
+        {
+            irAddEdge(m, block, term->branch.target);
+        }
+        else if (term->kind == IR_INST_COND_BRANCH)
+        {
+            irAddEdge(m, block, term->cond_branch.true_block);
+            irAddEdge(m, block, term->cond_branch.false_block);
+        }
+    }
+
+    func->func.rpo.len = 0;
+    if (func->func.blocks.len == 0) return;
+
+    // Iterative depth first search, 'next' holds the successor to visit next for
+    // each block of the stack
+    ArrayOfIRInstPtr post_order = {0};
+    ArrayOfIRInstPtr stack = {0};
+    ARRAY_OF(size_t) next = {0};
+
+    IRInst *entry = func->func.blocks.ptr[0];
+    entry->mark = 1;
+    arrPush(m->compiler, &stack, entry);
+    arrPush(m->compiler, &next, 0);
+
+    while (stack.len > 0)
+    {
+        IRInst *block = stack.ptr[stack.len - 1];
+        size_t *succ_index = &next.ptr[next.len - 1];
+        if (*succ_index < block->block.succs.len)
+        {
+            IRInst *succ = block->block.succs.ptr[(*succ_index)++];
+            if (!succ->mark)
+            {
+                succ->mark = 1;
+                arrPush(m->compiler, &stack, succ);
+                arrPush(m->compiler, &next, 0);
+            }
+        }
+        else
+        {
+            arrPush(m->compiler, &post_order, block);
+            stack.len--;
+            next.len--;
+        }
+    }
+
+    for (size_t i = post_order.len; i > 0; --i)
+    {
+        IRInst *block = post_order.ptr[i - 1];
+        block->block.rpo_index = (uint32_t)func->func.rpo.len;
+        arrPush(m->compiler, &func->func.rpo, block);
+    }
+}
+
+static IRInst *irIntersectDominators(IRInst *a, IRInst *b)
+{
+    while (a != b)
+    {
+        while (a->block.rpo_index > b->block.rpo_index) a = a->block.idom;
+        while (b->block.rpo_index > a->block.rpo_index) b = b->block.idom;
+    }
+    return a;
+}
+
+// Cooper, Harvey and Kennedy's iterative algorithm over the reverse post-order.
+// Needs the CFG computed.
+void ts__irComputeDominators(IRInst *func)
+{
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        func->func.blocks.ptr[i]->block.idom = NULL;
+    }
+
+    if (func->func.rpo.len == 0) return;
+
+    // The entry block is its own dominator while the others are computed
+    IRInst *entry = func->func.rpo.ptr[0];
+    entry->block.idom = entry;
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 1; i < func->func.rpo.len; ++i)
+        {
+            IRInst *block = func->func.rpo.ptr[i];
+            IRInst *new_idom = NULL;
+            for (size_t j = 0; j < block->block.preds.len; ++j)
+            {
+                IRInst *pred = block->block.preds.ptr[j];
+                if (!pred->block.idom) continue;
+                new_idom = new_idom ? irIntersectDominators(pred, new_idom) : pred;
+            }
+
+            if (block->block.idom != new_idom)
+            {
+                block->block.idom = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    entry->block.idom = NULL;
+}
+
+bool ts__irDominates(IRInst *a, IRInst *b)
+{
+    if (a->block.rpo_index == UINT32_MAX || b->block.rpo_index == UINT32_MAX) return false;
+
+    while (b->block.rpo_index > a->block.rpo_index) b = b->block.idom;
+    return a == b;
+}
+
+size_t ts__irCountInsts(IRModule *m)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < m->functions.len; ++i)
+    {
+        IRInst *func = m->functions.ptr[i];
+        for (size_t j = 0; j < func->func.blocks.len; ++j)
+        {
+            count += func->func.blocks.ptr[j]->block.insts.len;
+        }
+    }
+    return count;
+}
+
+static bool irBuiltinHasSideEffects(IRBuiltinInstKind kind)
+{
+    switch (kind)
+    {
+    case IR_BUILTIN_INTERLOCKED_ADD:
+    case IR_BUILTIN_INTERLOCKED_AND:
+    case IR_BUILTIN_INTERLOCKED_MIN:
+    case IR_BUILTIN_INTERLOCKED_MAX:
+    case IR_BUILTIN_INTERLOCKED_OR:
+    case IR_BUILTIN_INTERLOCKED_XOR:
+    case IR_BUILTIN_INTERLOCKED_EXCHANGE:
+    case IR_BUILTIN_INTERLOCKED_COMPARE_EXCHANGE:
+    case IR_BUILTIN_INTERLOCKED_COMPARE_STORE: return true;
+    default: return false;
+    }
+}
+
+// Instructions that only compute their result, so they can go away when nothing
+// uses it
+static bool irIsRemovableWhenUnused(IRInst *inst)
+{
+    switch (inst->kind)
+    {
+    case IR_INST_VARIABLE:
+    case IR_INST_LOAD:
+    case IR_INST_ACCESS_CHAIN:
+    case IR_INST_CAST:
+    case IR_INST_COMPOSITE_CONSTRUCT:
+    case IR_INST_COMPOSITE_EXTRACT:
+    case IR_INST_VECTOR_SHUFFLE:
+    case IR_INST_SAMPLE_IMPLICIT_LOD:
+    case IR_INST_SAMPLE_EXPLICIT_LOD:
+    case IR_INST_QUERY_SIZE_LOD:
+    case IR_INST_QUERY_LEVELS:
+    case IR_INST_UNARY:
+    case IR_INST_BINARY:
+    case IR_INST_SELECT:
+    case IR_INST_PHI: return true;
+
+    case IR_INST_BUILTIN_CALL: return !irBuiltinHasSideEffects(inst->builtin_call.kind);
+
+    default: return false;
+    }
+}
+
+// Drops the instructions whose mark is set
+static void irSweepMarkedInsts(IRInst *func)
+{
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        size_t kept = 0;
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            if (!inst->mark) block->block.insts.ptr[kept++] = inst;
+        }
+        block->block.insts.len = kept;
+    }
+}
+
+////////////////////////////////
+//
+// Constant folding
+//
+// Scalars are computed by the ts__fold* functions, which the constant evaluation of
+// the analyzer uses as well. When the result is undefined (division by zero, out of
+// range shifts and conversions, ...) the instruction is not folded.
+//
+////////////////////////////////
+
+typedef IRInst *(*IRFoldScalarFn)(IRModule *m, IRInst *inst, IRType *type, IRInst **args);
+
+static bool irIsConstant(IRInst *inst)
+{
+    return inst->kind == IR_INST_CONSTANT || inst->kind == IR_INST_CONSTANT_BOOL ||
+           inst->kind == IR_INST_CONSTANT_COMPOSITE;
+}
+
+static bool irAllConstant(IRInst **values, uint32_t value_count)
+{
+    for (uint32_t i = 0; i < value_count; ++i)
+    {
+        if (!irIsConstant(values[i])) return false;
+    }
+    return true;
+}
+
+static double irConstFloat(IRInst *c)
+{
+    if (c->constant.value_size_bytes == sizeof(float)) return *(float *)c->constant.value;
+    return *(double *)c->constant.value;
+}
+
+// The bits of a scalar constant, zero extended
+static uint64_t irConstBits(IRInst *c)
+{
+    switch (c->constant.value_size_bytes)
+    {
+    case 1: return *(uint8_t *)c->constant.value;
+    case 2: return *(uint16_t *)c->constant.value;
+    case 4: return *(uint32_t *)c->constant.value;
+    default: return *(uint64_t *)c->constant.value;
+    }
+}
+
+static ScalarValue irScalarValue(IRInst *c)
+{
+    ScalarValue value = {0};
+    switch (c->type->kind)
+    {
+    case IR_TYPE_FLOAT: {
+        value.kind = SCALAR_FLOAT;
+        value.f = irConstFloat(c);
+        break;
+    }
+    case IR_TYPE_INT: {
+        value.kind = c->type->int_.is_signed ? SCALAR_INT : SCALAR_UINT;
+        value.bits = c->type->int_.bits;
+        value.u = irConstBits(c);
+        break;
+    }
+    case IR_TYPE_BOOL: {
+        value.kind = SCALAR_BOOL;
+        value.u = c->constant_bool.value;
+        break;
+    }
+    default: assert(0); break;
+    }
+    return value;
+}
+
+static IRInst *irBuildScalar(IRModule *m, IRType *type, ScalarValue value)
+{
+    switch (type->kind)
+    {
+    case IR_TYPE_FLOAT: {
+        if (value.kind != SCALAR_FLOAT) return NULL;
+        return ts__irBuildConstFloat(m, type, value.f);
+    }
+    case IR_TYPE_INT: {
+        if (value.kind != SCALAR_INT && value.kind != SCALAR_UINT) return NULL;
+        return ts__irBuildConstInt(m, type, value.u);
+    }
+    case IR_TYPE_BOOL: {
+        if (value.kind != SCALAR_BOOL) return NULL;
+        return ts__irBuildConstBool(m, value.u != 0);
+    }
+    default: break;
+    }
+    return NULL;
+}
+
+// Applies a scalar fold to each component of vector operands of the result size
+static IRInst *irFoldComponents(
+    IRModule *m, IRInst *inst, IRInst **args, uint32_t arg_count, IRFoldScalarFn fold)
+{
+    assert(arg_count <= 3);
+    IRType *type = inst->type;
+
+    if (type->kind != IR_TYPE_VECTOR)
+    {
+        for (uint32_t i = 0; i < arg_count; ++i)
+        {
+            if (args[i]->kind == IR_INST_CONSTANT_COMPOSITE) return NULL;
+        }
+        return fold(m, inst, type, args);
+    }
+
+    uint32_t size = type->vector.size;
+    for (uint32_t i = 0; i < arg_count; ++i)
+    {
+        if (args[i]->kind != IR_INST_CONSTANT_COMPOSITE) return NULL;
+        if (args[i]->constant_composite.value_count != size) return NULL;
+    }
+
+    IRInst **elems = NEW_ARRAY(m->compiler, IRInst *, size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        IRInst *elem_args[3] = {0};
+        for (uint32_t j = 0; j < arg_count; ++j)
+        {
+            elem_args[j] = args[j]->constant_composite.values[i];
+        }
+
+        elems[i] = fold(m, inst, type->vector.elem_type, elem_args);
+        if (!elems[i]) return NULL;
+    }
+
+    return ts__irBuildConstComposite(m, type, elems, size);
+}
+
+static IRInst *irFoldBinaryScalar(IRModule *m, IRInst *inst, IRType *type, IRInst **args)
+{
+    ScalarValue result;
+    if (!ts__foldBinary(
+            inst->binary.op, irScalarValue(args[0]), irScalarValue(args[1]), &result))
+    {
+        return NULL;
+    }
+    return irBuildScalar(m, type, result);
+}
+
+static IRInst *irFoldUnaryScalar(IRModule *m, IRInst *inst, IRType *type, IRInst **args)
+{
+    ScalarValue result;
+    if (!ts__foldUnary(inst->unary.op, irScalarValue(args[0]), &result)) return NULL;
+    return irBuildScalar(m, type, result);
+}
+
+static IRInst *irFoldCastScalar(IRModule *m, IRInst *inst, IRType *type, IRInst **args)
+{
+    ScalarKind kind = SCALAR_FLOAT;
+    uint32_t bits = 0;
+    if (type->kind == IR_TYPE_INT)
+    {
+        kind = type->int_.is_signed ? SCALAR_INT : SCALAR_UINT;
+        bits = type->int_.bits;
+    }
+
+    ScalarValue result;
+    if (!ts__foldConvert(inst->cast.op, irScalarValue(args[0]), kind, bits, &result))
+    {
+        return NULL;
+    }
+    return irBuildScalar(m, type, result);
+}
+
+// asfloat, asint and asuint keep the bits of their parameter
+static IRInst *irFoldBitcastScalar(IRModule *m, IRInst *inst, IRType *type, IRInst **args)
+{
+    (void)inst;
+    IRInst *c = args[0];
+    if (c->kind != IR_INST_CONSTANT) return NULL;
+
+    uint64_t bits = irConstBits(c);
+    switch (type->kind)
+    {
+    case IR_TYPE_INT: {
+        if (type->int_.bits / 8 != c->constant.value_size_bytes) return NULL;
+        return ts__irBuildConstInt(m, type, bits);
+    }
+
+    case IR_TYPE_FLOAT: {
+        if (type->float_.bits != 32 || c->constant.value_size_bytes != sizeof(float))
+        {
+            return NULL;
+        }
+
+        uint32_t word = (uint32_t)bits;
+        float value;
+        memcpy(&value, &word, sizeof(value));
+        if (isnan(value)) return NULL;
+        return ts__irBuildConstFloat(m, type, value);
+    }
+
+    default: break;
+    }
+
+    return NULL;
+}
+
+// Builtins that operate on each component, called with one scalar of each parameter
+static IRInst *irFoldBuiltinScalar(IRModule *m, IRInst *inst, IRType *type, IRInst **args)
+{
+    uint32_t param_count = inst->builtin_call.param_count;
+    ScalarValue values[3];
+    for (uint32_t i = 0; i < param_count; ++i)
+    {
+        values[i] = irScalarValue(args[i]);
+    }
+
+    ScalarValue result;
+    if (!ts__foldBuiltin(inst->builtin_call.kind, values, param_count, &result))
+    {
+        return NULL;
+    }
+    return irBuildScalar(m, type, result);
+}
+
+// dot, length, distance, normalize and cross take float vectors
+static IRInst *irFoldGeometric(IRModule *m, IRInst *inst)
+{
+    IRInst *v = inst->builtin_call.params[0];
+    IRInst *w = (inst->builtin_call.param_count > 1) ? inst->builtin_call.params[1] : NULL;
+    if (v->type->kind != IR_TYPE_VECTOR) return NULL;
+    if (w && w->type != v->type) return NULL;
+
+    IRType *elem_type = v->type->vector.elem_type;
+    if (elem_type->kind != IR_TYPE_FLOAT) return NULL;
+
+    uint32_t size = v->type->vector.size;
+    assert(size <= 4);
+
+    double vs[4];
+    double ws[4];
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        vs[i] = irConstFloat(v->constant_composite.values[i]);
+        ws[i] = w ? irConstFloat(w->constant_composite.values[i]) : 0.0;
+    }
+
+    double result[4];
+    IRBuiltinInstKind kind = inst->builtin_call.kind;
+    if (!ts__foldGeometric(kind, vs, ws, size, result)) return NULL;
+
+    if (kind != IR_BUILTIN_NORMALIZE && kind != IR_BUILTIN_CROSS)
+    {
+        return ts__irBuildConstFloat(m, elem_type, result[0]);
+    }
+
+    IRInst **elems = NEW_ARRAY(m->compiler, IRInst *, size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        elems[i] = ts__irBuildConstFloat(m, elem_type, result[i]);
+    }
+    return ts__irBuildConstComposite(m, v->type, elems, size);
+}
+
+static IRInst *irFoldBuiltin(IRModule *m, IRInst *inst)
+{
+    IRInst **params = inst->builtin_call.params;
+    uint32_t param_count = inst->builtin_call.param_count;
+    if (param_count == 0 || param_count > 3) return NULL;
+    if (!irAllConstant(params, param_count)) return NULL;
+
+    switch (inst->builtin_call.kind)
+    {
+    case IR_BUILTIN_DOT:
+    case IR_BUILTIN_LENGTH:
+    case IR_BUILTIN_DISTANCE:
+    case IR_BUILTIN_NORMALIZE:
+    case IR_BUILTIN_CROSS: return irFoldGeometric(m, inst);
+
+    case IR_BUILTIN_ASUINT:
+    case IR_BUILTIN_ASINT:
+    case IR_BUILTIN_ASFLOAT:
+        return irFoldComponents(m, inst, params, 1, irFoldBitcastScalar);
+
+    default: break;
+    }
+
+    // Everything else works on each component of parameters of the result type
+    for (uint32_t i = 0; i < param_count; ++i)
+    {
+        if (params[i]->type != inst->type) return NULL;
+    }
+
+    return irFoldComponents(m, inst, params, param_count, irFoldBuiltinScalar);
+}
+
+static IRInst *irFoldCompositeConstruct(IRModule *m, IRInst *inst)
+{
+    IRType *type = inst->type;
+    IRInst **fields = inst->composite_construct.fields;
+    uint32_t field_count = inst->composite_construct.field_count;
+    if (!irAllConstant(fields, field_count)) return NULL;
+
+    if (type->kind != IR_TYPE_VECTOR)
+    {
+        return ts__irBuildConstComposite(m, type, fields, field_count);
+    }
+
+    // Vectors may be built from smaller vectors, constant vectors only hold scalars
+    uint32_t size = type->vector.size;
+    IRInst **elems = NEW_ARRAY(m->compiler, IRInst *, size);
+    uint32_t elem_count = 0;
+    for (uint32_t i = 0; i < field_count; ++i)
+    {
+        IRInst *field = fields[i];
+        if (field->kind != IR_INST_CONSTANT_COMPOSITE)
+        {
+            if (elem_count == size) return NULL;
+            elems[elem_count++] = field;
+            continue;
+        }
+
+        for (uint32_t j = 0; j < field->constant_composite.value_count; ++j)
+        {
+            if (elem_count == size) return NULL;
+            elems[elem_count++] = field->constant_composite.values[j];
+        }
+    }
+
+    if (elem_count != size) return NULL;
+    return ts__irBuildConstComposite(m, type, elems, size);
+}
+
+static IRInst *irFoldCompositeExtract(IRInst *inst)
+{
+    IRInst *value = inst->composite_extract.value;
+    for (uint32_t i = 0; i < inst->composite_extract.index_count; ++i)
+    {
+        uint32_t index = inst->composite_extract.indices[i];
+        if (value->kind != IR_INST_CONSTANT_COMPOSITE) return NULL;
+        if (index >= value->constant_composite.value_count) return NULL;
+        value = value->constant_composite.values[index];
+    }
+
+    return (value->type == inst->type) ? value : NULL;
+}
+
+static IRInst *irFoldVectorShuffle(IRModule *m, IRInst *inst)
+{
+    IRInst *a = inst->vector_shuffle.vector_a;
+    IRInst *b = inst->vector_shuffle.vector_b;
+    if (a->kind != IR_INST_CONSTANT_COMPOSITE || b->kind != IR_INST_CONSTANT_COMPOSITE)
+    {
+        return NULL;
+    }
+
+    uint32_t a_size = a->constant_composite.value_count;
+    uint32_t b_size = b->constant_composite.value_count;
+
+    uint32_t size = inst->vector_shuffle.index_count;
+    IRInst **elems = NEW_ARRAY(m->compiler, IRInst *, size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        uint32_t index = inst->vector_shuffle.indices[i];
+        if (index < a_size)
+        {
+            elems[i] = a->constant_composite.values[index];
+        }
+        else if (index - a_size < b_size)
+        {
+            elems[i] = b->constant_composite.values[index - a_size];
+        }
+        else
+        {
+            return NULL;
+        }
+    }
+
+    return ts__irBuildConstComposite(m, inst->type, elems, size);
+}
+
+static IRInst *irFoldSelectComponent(IRModule *m, IRInst *inst, IRType *type, IRInst **args)
+{
+    (void)m;
+    (void)inst;
+    (void)type;
+    return args[0]->constant_bool.value ? args[1] : args[2];
+}
+
+// Returns the value of an instruction when it can be computed from its constant
+// operands, or NULL. The instruction itself is left untouched.
+IRInst *ts__irFoldInst(IRModule *m, IRInst *inst)
+{
+    switch (inst->kind)
+    {
+    case IR_INST_BINARY: {
+        IRInst *args[2] = {inst->binary.left, inst->binary.right};
+        if (!irAllConstant(args, 2)) return NULL;
+        return irFoldComponents(m, inst, args, 2, irFoldBinaryScalar);
+    }
+
+    case IR_INST_UNARY: {
+        if (!irIsConstant(inst->unary.right)) return NULL;
+        return irFoldComponents(m, inst, &inst->unary.right, 1, irFoldUnaryScalar);
+    }
+
+    case IR_INST_CAST: {
+        if (!irIsConstant(inst->cast.value)) return NULL;
+        if (inst->cast.redundant) return inst->cast.value;
+        return irFoldComponents(m, inst, &inst->cast.value, 1, irFoldCastScalar);
+    }
+
+    case IR_INST_SELECT: {
+        // A constant condition picks one side, whether it is constant or not
+        IRInst *cond = inst->select.cond;
+        if (cond->kind == IR_INST_CONSTANT_BOOL)
+        {
+            return cond->constant_bool.value ? inst->select.true_value
+                                             : inst->select.false_value;
+        }
+
+        IRInst *args[3] = {cond, inst->select.true_value, inst->select.false_value};
+        if (!irAllConstant(args, 3)) return NULL;
+        return irFoldComponents(m, inst, args, 3, irFoldSelectComponent);
+    }
+
+    case IR_INST_BUILTIN_CALL: return irFoldBuiltin(m, inst);
+    case IR_INST_COMPOSITE_CONSTRUCT: return irFoldCompositeConstruct(m, inst);
+    case IR_INST_COMPOSITE_EXTRACT: return irFoldCompositeExtract(inst);
+    case IR_INST_VECTOR_SHUFFLE: return irFoldVectorShuffle(m, inst);
+
+    default: break;
+    }
+
+    return NULL;
+}
+
+////////////////////////////////
+//
+// Passes
+//
+////////////////////////////////
+
+// Removes instructions whose result is never used, and then the instructions that
+// only they were using
+static bool irPassDeadInsts(IRModule *m)
+{
+    bool changed = false;
+    ArrayOfIRInstSlot slots = {0};
+    ArrayOfIRInstPtr worklist = {0};
+
+    for (size_t f = 0; f < m->functions.len; ++f)
+    {
+        IRInst *func = m->functions.ptr[f];
+        ts__irComputeUses(m, func);
+
+        worklist.len = 0;
+        for (size_t i = 0; i < func->func.blocks.len; ++i)
+        {
+            IRInst *block = func->func.blocks.ptr[i];
+            for (size_t j = 0; j < block->block.insts.len; ++j)
+            {
+                IRInst *inst = block->block.insts.ptr[j];
+                inst->mark = 0;
+                if (inst->users.len == 0 && irIsRemovableWhenUnused(inst))
+                {
+                    arrPush(m->compiler, &worklist, inst);
+                }
+            }
+        }
+
+        if (worklist.len == 0) continue;
+
+        while (worklist.len > 0)
+        {
+            IRInst *inst = *arrPop(&worklist);
+            if (inst->mark) continue;
+            inst->mark = 1;
+
+            ts__irInstOperands(m, inst, &slots);
+            for (size_t k = 0; k < slots.len; ++k)
+            {
+                IRInst *value = *slots.ptr[k];
+                if (!irIsLocalValue(value)) continue;
+
+                irRemoveUser(value, inst);
+                if (value->users.len == 0 && irIsRemovableWhenUnused(value))
+                {
+                    arrPush(m->compiler, &worklist, value);
+                }
+            }
+        }
+
+        irSweepMarkedInsts(func);
+        changed = true;
+    }
+
+    return changed;
+}
+
+static bool irIsFunctionVariable(IRInst *inst)
+{
+    return inst->kind == IR_INST_VARIABLE && inst->var.storage_class == SpvStorageClassFunction;
+}
+
+// The variable or parameter a pointer points into
+static IRInst *irPointerRoot(IRInst *pointer)
+{
+    while (pointer->kind == IR_INST_ACCESS_CHAIN) pointer = pointer->access_chain.base;
+    return pointer;
+}
+
+// Instructions that are needed whether or not their result is used. Stores to Function
+// variables are only needed once something reads the variable.
+static bool irIsLiveRoot(IRInst *inst)
+{
+    switch (inst->kind)
+    {
+    case IR_INST_RETURN:
+    case IR_INST_DISCARD:
+    case IR_INST_UNREACHABLE:
+    case IR_INST_BRANCH:
+    case IR_INST_COND_BRANCH:
+    case IR_INST_BARRIER:
+    case IR_INST_FUNC_CALL: return true;
+
+    case IR_INST_STORE: return !irIsFunctionVariable(irPointerRoot(inst->store.pointer));
+
+    case IR_INST_BUILTIN_CALL: return irBuiltinHasSideEffects(inst->builtin_call.kind);
+
+    default: return false;
+    }
+}
+
+// Unreachable blocks that a reachable header names as its merge or continue block
+// have to stay: merge blocks become OpUnreachable and continue blocks branch back to
+// their header. 'mark' is set on the blocks that are kept.
+static void irKeepStructuralBlock(IRModule *m, IRInst *header, IRInst *block, bool is_continue)
+{
+    if (!block || block->mark) return;
+    block->mark = 1;
+
+    IRInst *term = NEW(m->compiler, IRInst);
+    if (is_continue)
+    {
+        term->kind = IR_INST_BRANCH;
+        term->branch.target = header;
+    }
+    else
+    {
+        term->kind = IR_INST_UNREACHABLE;
+    }
+
+    block->block.insts.len = 0;
+    arrPush(m->compiler, &block->block.insts, term);
+}
+
+// Each phi gets exactly one value per predecessor, undefined for the unreachable ones.
+// Needs the CFG computed.
+static void irFixPhis(IRModule *m, IRInst *block)
+{
+    for (size_t i = 0; i < block->block.insts.len; ++i)
+    {
+        IRInst *phi = block->block.insts.ptr[i];
+        if (phi->kind != IR_INST_PHI) break;
+
+        size_t kept = 0;
+        for (size_t j = 0; j < phi->phi.values.len; ++j)
+        {
+            IRInst *pred = phi->phi.blocks.ptr[j];
+            bool is_pred = false;
+            for (size_t k = 0; k < block->block.preds.len; ++k)
+            {
+                if (block->block.preds.ptr[k] == pred) is_pred = true;
+            }
+            if (!is_pred) continue;
+
+            IRInst *value = phi->phi.values.ptr[j];
+            if (pred->block.rpo_index == UINT32_MAX) value = ts__irBuildUndef(m, phi->type);
+
+            phi->phi.values.ptr[kept] = value;
+            phi->phi.blocks.ptr[kept] = pred;
+            kept++;
+        }
+        phi->phi.values.len = kept;
+        phi->phi.blocks.len = kept;
+
+        for (size_t k = 0; k < block->block.preds.len; ++k)
+        {
+            IRInst *pred = block->block.preds.ptr[k];
+            bool found = false;
+            for (size_t j = 0; j < phi->phi.blocks.len; ++j)
+            {
+                if (phi->phi.blocks.ptr[j] == pred) found = true;
+            }
+            if (found) continue;
+
+            arrPush(m->compiler, &phi->phi.values, ts__irBuildUndef(m, phi->type));
+            arrPush(m->compiler, &phi->phi.blocks, pred);
+        }
+    }
+}
+
+// Drops the blocks that cannot run, except the merge and continue blocks of the
+// constructs that can, which are reduced to their terminator. Needs the CFG computed.
+static bool irRemoveUnreachableBlocks(IRModule *m, IRInst *func)
+{
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        block->mark = block->block.rpo_index != UINT32_MAX;
+    }
+
+    for (size_t i = 0; i < func->func.rpo.len; ++i)
+    {
+        IRInst *block = func->func.rpo.ptr[i];
+        IRInst *term = irBlockTerminator(block);
+        if (!term) continue;
+
+        if (term->kind == IR_INST_BRANCH)
+        {
+            irKeepStructuralBlock(m, block, term->branch.continue_block, true);
+            irKeepStructuralBlock(m, block, term->branch.merge_block, false);
+        }
+        else if (term->kind == IR_INST_COND_BRANCH)
+        {
+            irKeepStructuralBlock(m, block, term->cond_branch.continue_block, true);
+            irKeepStructuralBlock(m, block, term->cond_branch.merge_block, false);
+        }
+    }
+
+    size_t kept_blocks = 0;
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        if (block->mark) func->func.blocks.ptr[kept_blocks++] = block;
+    }
+    if (kept_blocks == func->func.blocks.len && func->func.rpo.len == kept_blocks)
+    {
+        return false;
+    }
+    func->func.blocks.len = kept_blocks;
+
+    ts__irComputeCfg(m, func);
+    for (size_t i = 0; i < func->func.rpo.len; ++i)
+    {
+        irFixPhis(m, func->func.rpo.ptr[i]);
+    }
+
+    return true;
+}
+
+// Mark and sweep: everything the roots of the reachable blocks need is live, and a
+// Function variable becoming live makes the stores into it live.
+static bool irEliminateFunctionDeadCode(IRModule *m, IRInst *func)
+{
+    TsCompiler *compiler = m->compiler;
+    if (func->func.blocks.len == 0) return false;
+
+    ts__irComputeCfg(m, func);
+
+    ArrayOfIRInstPtr worklist = {0};
+    ArrayOfIRInstPtr local_stores = {0};
+    ArrayOfIRInstSlot slots = {0};
+
+    for (size_t i = 0; i < func->func.params.len; ++i)
+    {
+        func->func.params.ptr[i]->mark = 0;
+    }
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            inst->mark = 0;
+            if (block->block.rpo_index == UINT32_MAX) continue;
+
+            if (irIsLiveRoot(inst))
+            {
+                arrPush(compiler, &worklist, inst);
+            }
+            else if (inst->kind == IR_INST_STORE)
+            {
+                arrPush(compiler, &local_stores, inst);
+            }
+        }
+    }
+
+    while (worklist.len > 0)
+    {
+        while (worklist.len > 0)
+        {
+            IRInst *inst = *arrPop(&worklist);
+            if (inst->mark) continue;
+            inst->mark = 1;
+
+            ts__irInstOperands(m, inst, &slots);
+            for (size_t k = 0; k < slots.len; ++k)
+            {
+                IRInst *value = *slots.ptr[k];
+                if (!irIsLocalValue(value) || value->mark) continue;
+
+                // Values coming from unreachable blocks become undefined
+                if (inst->kind == IR_INST_PHI &&
+                    inst->phi.blocks.ptr[k]->block.rpo_index == UINT32_MAX)
+                {
+                    continue;
+                }
+
+                arrPush(compiler, &worklist, value);
+            }
+        }
+
+        for (size_t i = 0; i < local_stores.len; ++i)
+        {
+            IRInst *store = local_stores.ptr[i];
+            if (!store->mark && irPointerRoot(store->store.pointer)->mark)
+            {
+                arrPush(compiler, &worklist, store);
+            }
+        }
+    }
+
+    bool changed = false;
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        block->mark = block->block.rpo_index != UINT32_MAX;
+        if (!block->mark) continue;
+
+        size_t kept = 0;
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            if (inst->mark) block->block.insts.ptr[kept++] = inst;
+        }
+        changed |= kept != block->block.insts.len;
+        block->block.insts.len = kept;
+    }
+
+    changed |= irRemoveUnreachableBlocks(m, func);
+    return changed;
+}
+
+// Constants, globals and types are marked when an instruction still refers to them
+static void irMarkType(IRType *type)
+{
+    if (!type || type->mark) return;
+    type->mark = 1;
+
+    switch (type->kind)
+    {
+    case IR_TYPE_VECTOR: irMarkType(type->vector.elem_type); break;
+    case IR_TYPE_MATRIX: irMarkType(type->matrix.col_type); break;
+    case IR_TYPE_RUNTIME_ARRAY: irMarkType(type->array.sub); break;
+    case IR_TYPE_POINTER: irMarkType(type->ptr.sub); break;
+    case IR_TYPE_IMAGE: irMarkType(type->image.sampled_type); break;
+    case IR_TYPE_SAMPLED_IMAGE: irMarkType(type->sampled_image.image_type); break;
+
+    case IR_TYPE_FUNC:
+        irMarkType(type->func.return_type);
+        for (uint32_t i = 0; i < type->func.param_count; ++i)
+        {
+            irMarkType(type->func.params[i]);
+        }
+        break;
+
+    case IR_TYPE_STRUCT:
+        for (uint32_t i = 0; i < type->struct_.field_count; ++i)
+        {
+            irMarkType(type->struct_.fields[i]);
+        }
+        break;
+
+    case IR_TYPE_VOID:
+    case IR_TYPE_BOOL:
+    case IR_TYPE_FLOAT:
+    case IR_TYPE_INT:
+    case IR_TYPE_SAMPLER: break;
+    }
+}
+
+static void irMarkModuleValue(IRInst *value)
+{
+    if (value->mark) return;
+
+    switch (value->kind)
+    {
+    case IR_INST_CONSTANT_COMPOSITE:
+        for (uint32_t i = 0; i < value->constant_composite.value_count; ++i)
+        {
+            irMarkModuleValue(value->constant_composite.values[i]);
+        }
+        // fallthrough
+    case IR_INST_CONSTANT:
+    case IR_INST_CONSTANT_BOOL:
+    case IR_INST_UNDEF:
+        value->mark = 1;
+        irMarkType(value->type);
+        break;
+
+    case IR_INST_VARIABLE:
+        if (value->var.storage_class == SpvStorageClassFunction) break;
+        value->mark = 1;
+        irMarkType(value->type);
+        break;
+
+    default: break;
+    }
+}
+
+static bool irIsMarkedType(const void *item)
+{
+    return ((const IRType *)item)->mark;
+}
+
+static bool irIsMarkedInst(const void *item)
+{
+    return ((const IRInst *)item)->mark;
+}
+
+static bool irFilterMarkedInsts(ArrayOfIRInstPtr *insts)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < insts->len; ++i)
+    {
+        if (insts->ptr[i]->mark) insts->ptr[kept++] = insts->ptr[i];
+    }
+
+    bool changed = kept != insts->len;
+    insts->len = kept;
+    return changed;
+}
+
+// Drops the constants, globals and types that no instruction refers to anymore, so
+// that they do not get IDs
+static bool irPruneModule(IRModule *m)
+{
+    for (size_t i = 0; i < m->type_cache.values.len; ++i)
+    {
+        ((IRType *)m->type_cache.values.ptr[i])->mark = 0;
+    }
+    for (size_t i = 0; i < m->constants.len; ++i)
+    {
+        m->constants.ptr[i]->mark = 0;
+    }
+    for (size_t i = 0; i < m->globals.len; ++i)
+    {
+        m->globals.ptr[i]->mark = 0;
+    }
+
+    ArrayOfIRInstSlot slots = {0};
+    for (size_t f = 0; f < m->functions.len; ++f)
+    {
+        IRInst *func = m->functions.ptr[f];
+        irMarkType(func->type);
+
+        for (size_t i = 0; i < func->func.blocks.len; ++i)
+        {
+            IRInst *block = func->func.blocks.ptr[i];
+            for (size_t j = 0; j < block->block.insts.len; ++j)
+            {
+                IRInst *inst = block->block.insts.ptr[j];
+                irMarkType(inst->type);
+                if (inst->kind == IR_INST_CAST) irMarkType(inst->cast.dst_type);
+
+                ts__irInstOperands(m, inst, &slots);
+                for (size_t k = 0; k < slots.len; ++k)
+                {
+                    irMarkModuleValue(*slots.ptr[k]);
+                }
+            }
+        }
+    }
+
+    bool changed = false;
+    changed |= irFilterMarkedInsts(&m->constants);
+    changed |= irFilterMarkedInsts(&m->globals);
+    irFilterMarkedInsts(&m->input_globals);
+    irFilterMarkedInsts(&m->output_globals);
+    irFilterMarkedInsts(&m->uniform_globals);
+
+    for (size_t i = 0; i < m->entry_points.len; ++i)
+    {
+        IRInst *entry_point = m->entry_points.ptr[i];
+        uint32_t kept = 0;
+        for (uint32_t j = 0; j < entry_point->entry_point.global_count; ++j)
+        {
+            IRInst *global = entry_point->entry_point.globals[j];
+            if (global->mark) entry_point->entry_point.globals[kept++] = global;
+        }
+        entry_point->entry_point.global_count = kept;
+    }
+
+    size_t type_count = m->type_cache.values.len;
+    ts__internFilter(&m->const_cache, irIsMarkedInst);
+    ts__internFilter(&m->type_cache, irIsMarkedType);
+
+    return changed || type_count != m->type_cache.values.len;
+}
+
+static bool irPassDce(IRModule *m)
+{
+    bool changed = false;
+    for (size_t i = 0; i < m->functions.len; ++i)
+    {
+        changed |= irEliminateFunctionDeadCode(m, m->functions.ptr[i]);
+    }
+    changed |= irPruneModule(m);
+    return changed;
+}
+
+// A Function variable can be turned into SSA values when it is only loaded and stored
+// as a whole: access chains or calls that take its address keep it in memory.
+// Opaque types stay in memory too, they cannot go through phis.
+static bool irIsPromotable(IRInst *var)
+{
+    if (var->kind != IR_INST_VARIABLE) return false;
+    if (var->var.storage_class != SpvStorageClassFunction) return false;
+    if (var->var.initializer) return false;
+
+    switch (var->type->ptr.sub->kind)
+    {
+    case IR_TYPE_IMAGE:
+    case IR_TYPE_SAMPLER:
+    case IR_TYPE_SAMPLED_IMAGE:
+    case IR_TYPE_RUNTIME_ARRAY: return false;
+    default: break;
+    }
+
+    for (size_t i = 0; i < var->users.len; ++i)
+    {
+        IRInst *user = var->users.ptr[i];
+        if (user->kind == IR_INST_LOAD) continue;
+        if (user->kind == IR_INST_STORE && user->store.pointer == var &&
+            user->store.value != var)
+        {
+            continue;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+// Returns the promoted variable an instruction loads or stores, if any.
+// Promoted variables have their index + 1 in 'mark'.
+static IRInst *irPromotedPointer(IRInst *inst)
+{
+    IRInst *pointer = NULL;
+    if (inst->kind == IR_INST_LOAD) pointer = inst->load.pointer;
+    if (inst->kind == IR_INST_STORE) pointer = inst->store.pointer;
+    if (pointer && pointer->kind == IR_INST_VARIABLE && pointer->mark) return pointer;
+    return NULL;
+}
+
+static IRInst *irCurrentValue(IRModule *m, ArrayOfIRInstPtr *stack, IRInst *var)
+{
+    if (stack->len == 0) return ts__irBuildUndef(m, var->type->ptr.sub);
+    return stack->ptr[stack->len - 1];
+}
+
+// Builds pruned SSA form (Cytron et al.): phis are placed on the iterated dominance
+// frontier of the stores, in the blocks where the variable is live, and then loads
+// are renamed to the reaching value while walking the dominator tree.
+static bool irPromoteFunctionVariables(IRModule *m, IRInst *func)
+{
+    TsCompiler *compiler = m->compiler;
+    if (func->func.blocks.len == 0) return false;
+
+    ts__irComputeCfg(m, func);
+    ts__irComputeDominators(func);
+    ts__irComputeUses(m, func);
+
+    ArrayOfIRInstPtr vars = {0};
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            block->block.insts.ptr[j]->mark = 0;
+        }
+    }
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            if (irIsPromotable(inst))
+            {
+                arrPush(compiler, &vars, inst);
+                inst->mark = (uint32_t)vars.len;
+            }
+        }
+    }
+
+    if (vars.len == 0) return false;
+
+    size_t block_count = func->func.rpo.len;
+    IRInst **rpo = func->func.rpo.ptr;
+
+    // Dominance frontiers, indexed like the reverse post-order
+    ArrayOfIRInstPtr *frontiers = NEW_ARRAY(compiler, ArrayOfIRInstPtr, block_count);
+    for (size_t i = 0; i < block_count; ++i)
+    {
+        IRInst *block = rpo[i];
+        if (block->block.preds.len < 2) continue;
+
+        for (size_t j = 0; j < block->block.preds.len; ++j)
+        {
+            IRInst *runner = block->block.preds.ptr[j];
+            if (runner->block.rpo_index == UINT32_MAX) continue;
+
+            while (runner != block->block.idom)
+            {
+                ArrayOfIRInstPtr *frontier = &frontiers[runner->block.rpo_index];
+                if (frontier->len > 0 && frontier->ptr[frontier->len - 1] == block) break;
+                arrPush(compiler, frontier, block);
+                runner = runner->block.idom;
+            }
+        }
+    }
+
+    // Blocks that store each variable, and blocks that load it before storing it
+    ArrayOfIRInstPtr *def_blocks = NEW_ARRAY(compiler, ArrayOfIRInstPtr, vars.len);
+    ArrayOfIRInstPtr *use_blocks = NEW_ARRAY(compiler, ArrayOfIRInstPtr, vars.len);
+    uint32_t *stored_in = NEW_ARRAY(compiler, uint32_t, vars.len);
+    uint32_t *loaded_in = NEW_ARRAY(compiler, uint32_t, vars.len);
+    for (size_t i = 0; i < block_count; ++i)
+    {
+        IRInst *block = rpo[i];
+        uint32_t stamp = (uint32_t)i + 1;
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            IRInst *var = irPromotedPointer(inst);
+            if (!var) continue;
+
+            uint32_t index = var->mark - 1;
+            if (inst->kind == IR_INST_STORE && stored_in[index] != stamp)
+            {
+                stored_in[index] = stamp;
+                arrPush(compiler, &def_blocks[index], block);
+            }
+            else if (
+                inst->kind == IR_INST_LOAD && stored_in[index] != stamp &&
+                loaded_in[index] != stamp)
+            {
+                loaded_in[index] = stamp;
+                arrPush(compiler, &use_blocks[index], block);
+            }
+        }
+    }
+
+    // Phi insertion, the stamps tell which variable last visited each block
+    ArrayOfIRInstPtr *block_phis = NEW_ARRAY(compiler, ArrayOfIRInstPtr, block_count);
+    uint32_t *def_stamps = NEW_ARRAY(compiler, uint32_t, block_count);
+    uint32_t *live_stamps = NEW_ARRAY(compiler, uint32_t, block_count);
+    uint32_t *phi_stamps = NEW_ARRAY(compiler, uint32_t, block_count);
+    uint32_t *work_stamps = NEW_ARRAY(compiler, uint32_t, block_count);
+    ArrayOfIRInstPtr worklist = {0};
+
+    for (size_t v = 0; v < vars.len; ++v)
+    {
+        IRInst *var = vars.ptr[v];
+        uint32_t stamp = (uint32_t)v + 1;
+
+        for (size_t i = 0; i < def_blocks[v].len; ++i)
+        {
+            def_stamps[def_blocks[v].ptr[i]->block.rpo_index] = stamp;
+        }
+
+        // The variable is live into a block that loads it before storing it, and into
+        // the predecessors of such a block that do not store it
+        worklist.len = 0;
+        for (size_t i = 0; i < use_blocks[v].len; ++i)
+        {
+            IRInst *block = use_blocks[v].ptr[i];
+            live_stamps[block->block.rpo_index] = stamp;
+            arrPush(compiler, &worklist, block);
+        }
+        while (worklist.len > 0)
+        {
+            IRInst *block = *arrPop(&worklist);
+            for (size_t i = 0; i < block->block.preds.len; ++i)
+            {
+                IRInst *pred = block->block.preds.ptr[i];
+                uint32_t index = pred->block.rpo_index;
+                if (index == UINT32_MAX) continue;
+                if (live_stamps[index] == stamp || def_stamps[index] == stamp) continue;
+
+                live_stamps[index] = stamp;
+                arrPush(compiler, &worklist, pred);
+            }
+        }
+
+        worklist.len = 0;
+        for (size_t i = 0; i < def_blocks[v].len; ++i)
+        {
+            IRInst *block = def_blocks[v].ptr[i];
+            work_stamps[block->block.rpo_index] = stamp;
+            arrPush(compiler, &worklist, block);
+        }
+        while (worklist.len > 0)
+        {
+            IRInst *block = *arrPop(&worklist);
+            ArrayOfIRInstPtr *frontier = &frontiers[block->block.rpo_index];
+            for (size_t i = 0; i < frontier->len; ++i)
+            {
+                IRInst *target = frontier->ptr[i];
+                uint32_t index = target->block.rpo_index;
+                if (phi_stamps[index] == stamp || live_stamps[index] != stamp) continue;
+                phi_stamps[index] = stamp;
+
+                // Every predecessor gets an entry, unreachable ones keep the undefined
+                // value
+                IRInst *phi = ts__irCreatePhi(m, var->type->ptr.sub);
+                phi->mark = stamp;
+                for (size_t j = 0; j < target->block.preds.len; ++j)
+                {
+                    ts__irPhiAddIncoming(
+                        m,
+                        phi,
+                        ts__irBuildUndef(m, phi->type),
+                        target->block.preds.ptr[j]);
+                }
+                arrPush(compiler, &block_phis[index], phi);
+
+                if (work_stamps[index] != stamp)
+                {
+                    work_stamps[index] = stamp;
+                    arrPush(compiler, &worklist, target);
+                }
+            }
+        }
+    }
+
+    // Renaming, in a preorder walk of the dominator tree. 'log' records which
+    // variable each pushed value belongs to, so that leaving a block can pop them.
+    ArrayOfIRInstPtr *children = NEW_ARRAY(compiler, ArrayOfIRInstPtr, block_count);
+    for (size_t i = 1; i < block_count; ++i)
+    {
+        arrPush(compiler, &children[rpo[i]->block.idom->block.rpo_index], rpo[i]);
+    }
+
+    ArrayOfIRInstPtr *stacks = NEW_ARRAY(compiler, ArrayOfIRInstPtr, vars.len);
+    ARRAY_OF(uint32_t) log = {0};
+    ArrayOfIRInstPtr walk = {0};
+    ARRAY_OF(size_t) walk_log_len = {0};
+    ArrayOfIRInstPtr removed = {0};
+
+    arrPush(compiler, &walk, rpo[0]);
+    arrPush(compiler, &walk_log_len, 0);
+    while (walk.len > 0)
+    {
+        IRInst *block = *arrPop(&walk);
+        size_t log_len = *arrPop(&walk_log_len);
+        if (!block)
+        {
+            while (log.len > log_len)
+            {
+                stacks[*arrPop(&log)].len--;
+            }
+            continue;
+        }
+
+        arrPush(compiler, &walk, NULL);
+        arrPush(compiler, &walk_log_len, log.len);
+
+        ArrayOfIRInstPtr *phis = &block_phis[block->block.rpo_index];
+        for (size_t i = 0; i < phis->len; ++i)
+        {
+            IRInst *phi = phis->ptr[i];
+            arrPush(compiler, &stacks[phi->mark - 1], phi);
+            arrPush(compiler, &log, phi->mark - 1);
+        }
+
+        for (size_t i = 0; i < block->block.insts.len; ++i)
+        {
+            IRInst *inst = block->block.insts.ptr[i];
+            IRInst *var = irPromotedPointer(inst);
+            if (!var) continue;
+
+            uint32_t index = var->mark - 1;
+            if (inst->kind == IR_INST_LOAD)
+            {
+                ts__irReplaceAllUses(m, inst, irCurrentValue(m, &stacks[index], var));
+            }
+            else
+            {
+                arrPush(compiler, &stacks[index], inst->store.value);
+                arrPush(compiler, &log, index);
+            }
+            arrPush(compiler, &removed, inst);
+        }
+
+        for (size_t i = 0; i < block->block.succs.len; ++i)
+        {
+            IRInst *succ = block->block.succs.ptr[i];
+            ArrayOfIRInstPtr *succ_phis = &block_phis[succ->block.rpo_index];
+            for (size_t j = 0; j < succ_phis->len; ++j)
+            {
+                IRInst *phi = succ_phis->ptr[j];
+                IRInst *var = vars.ptr[phi->mark - 1];
+                for (size_t k = 0; k < phi->phi.blocks.len; ++k)
+                {
+                    if (phi->phi.blocks.ptr[k] != block) continue;
+                    phi->phi.values.ptr[k] = irCurrentValue(m, &stacks[phi->mark - 1], var);
+                }
+            }
+        }
+
+        ArrayOfIRInstPtr *block_children = &children[block->block.rpo_index];
+        for (size_t i = 0; i < block_children->len; ++i)
+        {
+            arrPush(compiler, &walk, block_children->ptr[i]);
+            arrPush(compiler, &walk_log_len, 0);
+        }
+    }
+
+    // Unreachable blocks are never renamed, what they load is undefined
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        if (block->block.rpo_index != UINT32_MAX) continue;
+
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            IRInst *var = irPromotedPointer(inst);
+            if (!var) continue;
+
+            if (inst->kind == IR_INST_LOAD)
+            {
+                ts__irReplaceAllUses(m, inst, ts__irBuildUndef(m, inst->type));
+            }
+            arrPush(compiler, &removed, inst);
+        }
+    }
+
+    // Put the phis in front of their blocks and drop the variables with their loads
+    // and stores
+    for (size_t i = 0; i < block_count; ++i)
+    {
+        ArrayOfIRInstPtr *phis = &block_phis[i];
+        if (phis->len == 0) continue;
+
+        IRInst *block = rpo[i];
+        ArrayOfIRInstPtr insts = {0};
+        for (size_t j = 0; j < phis->len; ++j)
+        {
+            arrPush(compiler, &insts, phis->ptr[j]);
+        }
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            arrPush(compiler, &insts, block->block.insts.ptr[j]);
+        }
+        block->block.insts = insts;
+    }
+
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            block->block.insts.ptr[j]->mark = 0;
+        }
+    }
+    for (size_t i = 0; i < vars.len; ++i)
+    {
+        vars.ptr[i]->mark = 1;
+    }
+    for (size_t i = 0; i < removed.len; ++i)
+    {
+        removed.ptr[i]->mark = 1;
+    }
+    irSweepMarkedInsts(func);
+
+    return true;
+}
+
+static bool irPassMem2Reg(IRModule *m)
+{
+    bool changed = false;
+    for (size_t i = 0; i < m->functions.len; ++i)
+    {
+        changed |= irPromoteFunctionVariables(m, m->functions.ptr[i]);
+    }
+    return changed;
+}
+
+// Sparse conditional constant propagation (Wegman and Zadeck). The lattice value of
+// each instruction, indexed by its mark, is NULL while nothing is known about it, a
+// constant, or the instruction itself once it can vary. Blocks have their mark set
+// once an executable edge reaches them.
+typedef struct IRSccp
+{
+    IRModule *m;
+    IRInst **lattice;
+    bool *executable_edges; // edge_offsets[rpo index of the target] + index of the pred
+    size_t *edge_offsets;
+    ArrayOfIRInstPtr block_worklist;
+    ArrayOfIRInstPtr inst_worklist;
+    ArrayOfIRInstSlot slots;
+    ArrayOfIRInstPtr saved;
+} IRSccp;
+
+static IRInst *irSccpValue(IRSccp *s, IRInst *value)
+{
+    if (!irIsLocalValue(value)) return value;
+    return s->lattice[value->mark];
+}
+
+static bool *irSccpEdge(IRSccp *s, IRInst *from, IRInst *to)
+{
+    if (to->block.rpo_index == UINT32_MAX) return NULL;
+
+    for (size_t i = 0; i < to->block.preds.len; ++i)
+    {
+        if (to->block.preds.ptr[i] == from)
+        {
+            return &s->executable_edges[s->edge_offsets[to->block.rpo_index] + i];
+        }
+    }
+    return NULL;
+}
+
+static void irSccpMarkEdge(IRSccp *s, IRInst *from, IRInst *to)
+{
+    bool *edge = irSccpEdge(s, from, to);
+    assert(edge);
+    if (*edge) return;
+
+    *edge = true;
+    arrPush(s->m->compiler, &s->block_worklist, to);
+}
+
+static IRInst *irSccpEvaluatePhi(IRSccp *s, IRInst *phi)
+{
+    IRInst *result = NULL;
+    for (size_t i = 0; i < phi->phi.values.len; ++i)
+    {
+        bool *edge = irSccpEdge(s, phi->phi.blocks.ptr[i], phi->parent);
+        if (!edge || !*edge) continue;
+
+        IRInst *value = irSccpValue(s, phi->phi.values.ptr[i]);
+        if (!value) continue;
+        if (!irIsConstant(value) || (result && result != value)) return phi;
+        result = value;
+    }
+    return result;
+}
+
+static IRInst *irSccpEvaluate(IRSccp *s, IRInst *inst)
+{
+    switch (inst->kind)
+    {
+    case IR_INST_SELECT: {
+        IRInst *cond = irSccpValue(s, inst->select.cond);
+        if (!cond) return NULL;
+        if (cond->kind != IR_INST_CONSTANT_BOOL) break;
+
+        IRInst *value = irSccpValue(
+            s, cond->constant_bool.value ? inst->select.true_value : inst->select.false_value);
+        if (value && !irIsConstant(value)) return inst;
+        return value;
+    }
+
+    case IR_INST_BUILTIN_CALL:
+        if (irBuiltinHasSideEffects(inst->builtin_call.kind)) return inst;
+        break;
+
+    case IR_INST_BINARY:
+    case IR_INST_UNARY:
+    case IR_INST_CAST:
+    case IR_INST_COMPOSITE_CONSTRUCT:
+    case IR_INST_COMPOSITE_EXTRACT:
+    case IR_INST_VECTOR_SHUFFLE: break;
+
+    default: return inst;
+    }
+
+    ts__irInstOperands(s->m, inst, &s->slots);
+
+    bool unknown = false;
+    for (size_t i = 0; i < s->slots.len; ++i)
+    {
+        IRInst *value = irSccpValue(s, *s->slots.ptr[i]);
+        if (!value)
+        {
+            unknown = true;
+        }
+        else if (!irIsConstant(value))
+        {
+            return inst;
+        }
+    }
+    if (unknown) return NULL;
+
+    // Fold with the constants in place of the operands, and then put them back
+    s->saved.len = 0;
+    for (size_t i = 0; i < s->slots.len; ++i)
+    {
+        arrPush(s->m->compiler, &s->saved, *s->slots.ptr[i]);
+        *s->slots.ptr[i] = irSccpValue(s, *s->slots.ptr[i]);
+    }
+
+    IRInst *folded = ts__irFoldInst(s->m, inst);
+
+    for (size_t i = 0; i < s->slots.len; ++i)
+    {
+        *s->slots.ptr[i] = s->saved.ptr[i];
+    }
+
+    return folded ? folded : inst;
+}
+
+static void irSccpVisit(IRSccp *s, IRInst *inst)
+{
+    IRInst *value = NULL;
+
+    switch (inst->kind)
+    {
+    case IR_INST_BRANCH: irSccpMarkEdge(s, inst->parent, inst->branch.target); return;
+
+    case IR_INST_COND_BRANCH: {
+        IRInst *cond = irSccpValue(s, inst->cond_branch.cond);
+        if (!cond) return;
+
+        if (cond->kind != IR_INST_CONSTANT_BOOL || cond->constant_bool.value)
+        {
+            irSccpMarkEdge(s, inst->parent, inst->cond_branch.true_block);
+        }
+        if (cond->kind != IR_INST_CONSTANT_BOOL || !cond->constant_bool.value)
+        {
+            irSccpMarkEdge(s, inst->parent, inst->cond_branch.false_block);
+        }
+        return;
+    }
+
+    case IR_INST_PHI: value = irSccpEvaluatePhi(s, inst); break;
+    default: value = irSccpEvaluate(s, inst); break;
+    }
+
+    // Values only go down the lattice: a constant that changes can vary
+    IRInst *old = s->lattice[inst->mark];
+    if (old && old != value) value = inst;
+    if (value == old) return;
+
+    s->lattice[inst->mark] = value;
+    for (size_t i = 0; i < inst->users.len; ++i)
+    {
+        arrPush(s->m->compiler, &s->inst_worklist, inst->users.ptr[i]);
+    }
+}
+
+// A constant condition only keeps the edge it takes. Loop headers keep their merge
+// instruction and back edges are kept, so that loops stay structured.
+static bool irSccpFoldBranch(IRInst *block, IRInst *term, bool cond)
+{
+    IRInst *taken = cond ? term->cond_branch.true_block : term->cond_branch.false_block;
+    IRInst *untaken = cond ? term->cond_branch.false_block : term->cond_branch.true_block;
+    IRInst *merge_block = term->cond_branch.merge_block;
+    IRInst *continue_block = term->cond_branch.continue_block;
+
+    if (continue_block && taken == merge_block) return false;
+    if (!continue_block && ts__irDominates(untaken, block)) return false;
+
+    if (!continue_block) merge_block = NULL;
+
+    term->kind = IR_INST_BRANCH;
+    term->branch.target = taken;
+    term->branch.merge_block = merge_block;
+    term->branch.continue_block = continue_block;
+
+    if (untaken == taken) return true;
+
+    for (size_t i = 0; i < untaken->block.insts.len; ++i)
+    {
+        IRInst *phi = untaken->block.insts.ptr[i];
+        if (phi->kind != IR_INST_PHI) break;
+
+        size_t kept = 0;
+        for (size_t j = 0; j < phi->phi.blocks.len; ++j)
+        {
+            if (phi->phi.blocks.ptr[j] == block) continue;
+            phi->phi.values.ptr[kept] = phi->phi.values.ptr[j];
+            phi->phi.blocks.ptr[kept] = phi->phi.blocks.ptr[j];
+            kept++;
+        }
+        phi->phi.values.len = kept;
+        phi->phi.blocks.len = kept;
+    }
+
+    return true;
+}
+
+static bool irPropagateFunctionConstants(IRModule *m, IRInst *func)
+{
+    TsCompiler *compiler = m->compiler;
+    if (func->func.blocks.len == 0) return false;
+
+    ts__irComputeCfg(m, func);
+    ts__irComputeDominators(func);
+    ts__irComputeUses(m, func);
+
+    IRSccp s = {0};
+    s.m = m;
+
+    uint32_t value_count = 0;
+    for (size_t i = 0; i < func->func.params.len; ++i)
+    {
+        func->func.params.ptr[i]->mark = ++value_count;
+    }
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        block->mark = 0;
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            block->block.insts.ptr[j]->mark = ++value_count;
+        }
+    }
+
+    s.lattice = NEW_ARRAY(compiler, IRInst *, value_count + 1);
+    for (size_t i = 0; i < func->func.params.len; ++i)
+    {
+        IRInst *param = func->func.params.ptr[i];
+        s.lattice[param->mark] = param;
+    }
+
+    size_t edge_count = 0;
+    s.edge_offsets = NEW_ARRAY(compiler, size_t, func->func.rpo.len);
+    for (size_t i = 0; i < func->func.rpo.len; ++i)
+    {
+        s.edge_offsets[i] = edge_count;
+        edge_count += func->func.rpo.ptr[i]->block.preds.len;
+    }
+    s.executable_edges = NEW_ARRAY(compiler, bool, edge_count + 1);
+
+    // A block is visited whole when it first becomes executable, and then only its
+    // phis are visited again for each new executable edge
+    arrPush(compiler, &s.block_worklist, func->func.blocks.ptr[0]);
+    while (s.block_worklist.len > 0 || s.inst_worklist.len > 0)
+    {
+        while (s.block_worklist.len > 0)
+        {
+            IRInst *block = *arrPop(&s.block_worklist);
+            bool first_visit = !block->mark;
+            block->mark = 1;
+
+            for (size_t i = 0; i < block->block.insts.len; ++i)
+            {
+                IRInst *inst = block->block.insts.ptr[i];
+                if (!first_visit && inst->kind != IR_INST_PHI) break;
+                irSccpVisit(&s, inst);
+            }
+        }
+
+        while (s.inst_worklist.len > 0)
+        {
+            IRInst *inst = *arrPop(&s.inst_worklist);
+            if (inst->parent->mark) irSccpVisit(&s, inst);
+        }
+    }
+
+    // Constants replace the values, and branches on them only keep the taken edge.
+    // Phis of blocks that never run are undefined.
+    bool changed = false;
+    ArrayOfIRInstPtr removed = {0};
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            IRInst *value = block->mark ? s.lattice[inst->mark] : NULL;
+
+            if (!block->mark && inst->kind == IR_INST_PHI)
+            {
+                value = ts__irBuildUndef(m, inst->type);
+            }
+            else if (!value || !irIsConstant(value))
+            {
+                continue;
+            }
+
+            ts__irReplaceAllUses(m, inst, value);
+            arrPush(compiler, &removed, inst);
+        }
+    }
+
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        IRInst *term = irBlockTerminator(block);
+        if (!block->mark || !term || term->kind != IR_INST_COND_BRANCH) continue;
+
+        IRInst *cond = term->cond_branch.cond;
+        if (cond->kind != IR_INST_CONSTANT_BOOL) continue;
+
+        changed |= irSccpFoldBranch(block, term, cond->constant_bool.value);
+    }
+
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            block->block.insts.ptr[j]->mark = 0;
+        }
+    }
+    for (size_t i = 0; i < removed.len; ++i)
+    {
+        removed.ptr[i]->mark = 1;
+    }
+    irSweepMarkedInsts(func);
+
+    return changed || removed.len > 0;
+}
+
+static bool irPassSccp(IRModule *m)
+{
+    bool changed = false;
+    for (size_t i = 0; i < m->functions.len; ++i)
+    {
+        changed |= irPropagateFunctionConstants(m, m->functions.ptr[i]);
+    }
+    return changed;
+}
+
+// What defines the value of a pure instruction, besides its kind and type
+typedef struct IRValueKey
+{
+    uint64_t extra; // Opcode, builtin or memory version
+    IRInst *operands[3];
+    IRInst **array;
+    uint32_t array_count;
+    uint32_t *literals;
+    uint32_t literal_count;
+} IRValueKey;
+
+static bool irIsCommutative(SpvOp op)
+{
+    switch (op)
+    {
+    case SpvOpFAdd:
+    case SpvOpFMul:
+    case SpvOpIAdd:
+    case SpvOpIMul:
+    case SpvOpBitwiseAnd:
+    case SpvOpBitwiseOr:
+    case SpvOpBitwiseXor:
+    case SpvOpIEqual:
+    case SpvOpINotEqual:
+    case SpvOpFOrdEqual:
+    case SpvOpFOrdNotEqual:
+    case SpvOpLogicalAnd:
+    case SpvOpLogicalOr:
+    case SpvOpLogicalEqual:
+    case SpvOpLogicalNotEqual: return true;
+    default: return false;
+    }
+}
+
+// Returns false for the instructions that are not numbered. Loads are numbered with
+// the memory version in their mark.
+static bool irValueKey(const IRInst *inst, IRValueKey *key)
+{
+    memset(key, 0, sizeof(*key));
+
+    switch (inst->kind)
+    {
+    case IR_INST_LOAD:
+        key->extra = inst->mark;
+        key->operands[0] = inst->load.pointer;
+        return true;
+
+    case IR_INST_ACCESS_CHAIN:
+        key->operands[0] = inst->access_chain.base;
+        key->array = inst->access_chain.indices;
+        key->array_count = inst->access_chain.index_count;
+        return true;
+
+    case IR_INST_CAST:
+        key->extra = ((uint64_t)inst->cast.op << 1) | inst->cast.redundant;
+        key->operands[0] = inst->cast.value;
+        return true;
+
+    case IR_INST_COMPOSITE_CONSTRUCT:
+        key->array = inst->composite_construct.fields;
+        key->array_count = inst->composite_construct.field_count;
+        return true;
+
+    case IR_INST_COMPOSITE_EXTRACT:
+        key->operands[0] = inst->composite_extract.value;
+        key->literals = inst->composite_extract.indices;
+        key->literal_count = inst->composite_extract.index_count;
+        return true;
+
+    case IR_INST_VECTOR_SHUFFLE:
+        key->operands[0] = inst->vector_shuffle.vector_a;
+        key->operands[1] = inst->vector_shuffle.vector_b;
+        key->literals = inst->vector_shuffle.indices;
+        key->literal_count = inst->vector_shuffle.index_count;
+        return true;
+
+    case IR_INST_SAMPLE_IMPLICIT_LOD:
+    case IR_INST_SAMPLE_EXPLICIT_LOD:
+        key->operands[0] = inst->sample.image_sampler;
+        key->operands[1] = inst->sample.coords;
+        key->operands[2] = inst->sample.lod;
+        return true;
+
+    case IR_INST_QUERY_SIZE_LOD:
+        key->operands[0] = inst->query_size_lod.image;
+        key->operands[1] = inst->query_size_lod.lod;
+        return true;
+
+    case IR_INST_QUERY_LEVELS: key->operands[0] = inst->query_levels.image; return true;
+
+    case IR_INST_UNARY:
+        key->extra = inst->unary.op;
+        key->operands[0] = inst->unary.right;
+        return true;
+
+    case IR_INST_BINARY:
+        key->extra = inst->binary.op;
+        key->operands[0] = inst->binary.left;
+        key->operands[1] = inst->binary.right;
+        if (irIsCommutative(inst->binary.op) && key->operands[0] > key->operands[1])
+        {
+            key->operands[0] = inst->binary.right;
+            key->operands[1] = inst->binary.left;
+        }
+        return true;
+
+    case IR_INST_SELECT:
+        key->operands[0] = inst->select.cond;
+        key->operands[1] = inst->select.true_value;
+        key->operands[2] = inst->select.false_value;
+        return true;
+
+    case IR_INST_BUILTIN_CALL:
+        if (irBuiltinHasSideEffects(inst->builtin_call.kind)) return false;
+        key->extra = inst->builtin_call.kind;
+        key->array = inst->builtin_call.params;
+        key->array_count = inst->builtin_call.param_count;
+        return true;
+
+    default: return false;
+    }
+}
+
+static uint64_t irValueHash(const void *item)
+{
+    const IRInst *inst = item;
+    IRValueKey key;
+    irValueKey(inst, &key);
+
+    uint64_t hash = ts__hashCombine(0, (uint64_t)inst->kind);
+    hash = ts__hashCombine(hash, (uintptr_t)inst->type);
+    hash = ts__hashCombine(hash, key.extra);
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        hash = ts__hashCombine(hash, (uintptr_t)key.operands[i]);
+    }
+    for (uint32_t i = 0; i < key.array_count; ++i)
+    {
+        hash = ts__hashCombine(hash, (uintptr_t)key.array[i]);
+    }
+    for (uint32_t i = 0; i < key.literal_count; ++i)
+    {
+        hash = ts__hashCombine(hash, key.literals[i]);
+    }
+    return hash;
+}
+
+static bool irValueEqual(const void *a_item, const void *b_item)
+{
+    const IRInst *a = a_item;
+    const IRInst *b = b_item;
+    if (a->kind != b->kind || a->type != b->type) return false;
+
+    IRValueKey ka, kb;
+    irValueKey(a, &ka);
+    irValueKey(b, &kb);
+
+    if (ka.extra != kb.extra || ka.array_count != kb.array_count ||
+        ka.literal_count != kb.literal_count)
+    {
+        return false;
+    }
+    if (memcmp(ka.operands, kb.operands, sizeof(ka.operands)) != 0) return false;
+    for (uint32_t i = 0; i < ka.array_count; ++i)
+    {
+        if (ka.array[i] != kb.array[i]) return false;
+    }
+    for (uint32_t i = 0; i < ka.literal_count; ++i)
+    {
+        if (ka.literals[i] != kb.literals[i]) return false;
+    }
+    return true;
+}
+
+// Two loads of the same pointer with the same memory version see the same value. A
+// version changes whenever that memory may be written, and at joins of paths that
+// did not end with the same version. Function variables are versioned apart from the
+// rest of the memory, which pointer parameters are part of.
+typedef struct IRMemoryVersion
+{
+    uint32_t local;
+    uint32_t global;
+} IRMemoryVersion;
+
+static void irUpdateMemoryVersion(IRInst *inst, IRMemoryVersion *version, uint32_t *next)
+{
+    switch (inst->kind)
+    {
+    case IR_INST_STORE:
+        if (irIsFunctionVariable(irPointerRoot(inst->store.pointer)))
+        {
+            version->local = ++*next;
+        }
+        else
+        {
+            version->global = ++*next;
+        }
+        break;
+
+    case IR_INST_BARRIER: version->global = ++*next; break;
+
+    case IR_INST_BUILTIN_CALL:
+        if (!irBuiltinHasSideEffects(inst->builtin_call.kind)) break;
+        // fallthrough
+    case IR_INST_FUNC_CALL:
+        version->local = ++*next;
+        version->global = ++*next;
+        break;
+
+    default: break;
+    }
+}
+
+// Sets the mark of the loads to the version of the memory they read, and clears it
+// for the other instructions. Back edges have not been seen yet when their header is
+// reached, so loop headers get new versions.
+static void irComputeLoadVersions(IRModule *m, IRInst *func)
+{
+    size_t block_count = func->func.rpo.len;
+    IRMemoryVersion *exit = NEW_ARRAY(m->compiler, IRMemoryVersion, block_count);
+    uint32_t next = 0;
+
+    for (size_t i = 0; i < block_count; ++i)
+    {
+        IRInst *block = func->func.rpo.ptr[i];
+
+        bool first = true;
+        bool local_known = true;
+        bool global_known = true;
+        IRMemoryVersion version = {0};
+        for (size_t j = 0; j < block->block.preds.len; ++j)
+        {
+            IRInst *pred = block->block.preds.ptr[j];
+            if (pred->block.rpo_index == UINT32_MAX) continue;
+            if (pred->block.rpo_index >= i)
+            {
+                local_known = global_known = false;
+                break;
+            }
+
+            IRMemoryVersion pred_version = exit[pred->block.rpo_index];
+            if (first)
+            {
+                version = pred_version;
+                first = false;
+            }
+            local_known &= version.local == pred_version.local;
+            global_known &= version.global == pred_version.global;
+        }
+        if (first || !local_known) version.local = ++next;
+        if (first || !global_known) version.global = ++next;
+
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            irUpdateMemoryVersion(inst, &version, &next);
+
+            inst->mark = 0;
+            if (inst->kind == IR_INST_LOAD)
+            {
+                bool local = irIsFunctionVariable(irPointerRoot(inst->load.pointer));
+                inst->mark = local ? version.local : version.global;
+            }
+        }
+        exit[i] = version;
+    }
+}
+
+// Walks the dominator tree depth first, so the instruction found for a value is
+// either in a dominating block or in a finished subtree, where it is replaced by the
+// new one.
+static bool irNumberFunctionValues(IRModule *m, IRInst *func)
+{
+    TsCompiler *compiler = m->compiler;
+    if (func->func.blocks.len == 0) return false;
+
+    ts__irComputeCfg(m, func);
+    ts__irComputeDominators(func);
+    ts__irComputeUses(m, func);
+
+    size_t block_count = func->func.rpo.len;
+    irComputeLoadVersions(m, func);
+
+    ArrayOfIRInstPtr *children = NEW_ARRAY(compiler, ArrayOfIRInstPtr, block_count);
+    for (size_t i = block_count; i > 1; --i)
+    {
+        IRInst *block = func->func.rpo.ptr[i - 1];
+        arrPush(compiler, &children[block->block.idom->block.rpo_index], block);
+    }
+
+    InternTable values;
+    ts__internInit(compiler, &values, irValueHash, irValueEqual);
+
+    ArrayOfIRInstPtr removed = {0};
+    ArrayOfIRInstPtr stack = {0};
+    arrPush(compiler, &stack, func->func.rpo.ptr[0]);
+
+    while (stack.len > 0)
+    {
+        IRInst *block = *arrPop(&stack);
+        for (size_t i = 0; i < block->block.insts.len; ++i)
+        {
+            IRInst *inst = block->block.insts.ptr[i];
+
+            IRValueKey key;
+            if (!irValueKey(inst, &key)) continue;
+
+            uint64_t hash = irValueHash(inst);
+            IRInst *found = ts__internHashed(&values, inst, hash);
+            if (found == inst) continue;
+
+            // Sampled images have to be created in the block that uses them
+            bool available = ts__irDominates(found->parent, block);
+            if (inst->kind == IR_INST_BUILTIN_CALL &&
+                inst->builtin_call.kind == IR_BUILTIN_CREATE_SAMPLED_IMAGE)
+            {
+                available = found->parent == block;
+            }
+
+            if (available)
+            {
+                ts__irReplaceAllUses(m, inst, found);
+                arrPush(compiler, &removed, inst);
+            }
+            else
+            {
+                ts__internReplace(&values, inst, hash);
+            }
+        }
+
+        ArrayOfIRInstPtr *block_children = &children[block->block.rpo_index];
+        for (size_t i = 0; i < block_children->len; ++i)
+        {
+            arrPush(compiler, &stack, block_children->ptr[i]);
+        }
+    }
+
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            block->block.insts.ptr[j]->mark = 0;
+        }
+    }
+    for (size_t i = 0; i < removed.len; ++i)
+    {
+        removed.ptr[i]->mark = 1;
+    }
+    irSweepMarkedInsts(func);
+
+    return removed.len > 0;
+}
+
+static bool irPassGvn(IRModule *m)
+{
+    bool changed = false;
+    for (size_t i = 0; i < m->functions.len; ++i)
+    {
+        changed |= irNumberFunctionValues(m, m->functions.ptr[i]);
+    }
+    return changed;
+}
+
+// Functions up to this many instructions are inlined at every call
+#define IR_INLINE_MAX_INSTS 64
+
+typedef struct IRCallee
+{
+    bool analyzed;
+    size_t inst_count;
+    size_t call_count;
+    bool nested_returns; // A return is inside a selection or a loop
+    bool loop_returns;   // A return is inside a loop
+} IRCallee;
+
+// Returns nested in a construct cannot simply branch to the code after the call:
+// they break out of a loop that wraps the inlined code instead. Breaking out of
+// several loops is not structured, so functions that return from a loop are not
+// inlined. Needs the CFG and dominators of the function computed.
+static void irAnalyzeCallee(IRModule *m, IRInst *func, IRCallee *callee)
+{
+    ArrayOfIRInstPtr returns = {0};
+    callee->analyzed = true;
+    callee->inst_count = 0;
+    callee->nested_returns = false;
+    callee->loop_returns = false;
+
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        callee->inst_count += block->block.insts.len;
+
+        IRInst *term = irBlockTerminator(block);
+        if (term && term->kind == IR_INST_RETURN && block->block.rpo_index != UINT32_MAX)
+        {
+            arrPush(m->compiler, &returns, block);
+        }
+    }
+
+    // A return is inside a construct when the header of the construct dominates it and
+    // its merge does not, i.e. the merge is not further down the dominator tree path
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        func->func.blocks.ptr[i]->mark = 0;
+    }
+    for (size_t i = 0; i < returns.len; ++i)
+    {
+        for (IRInst *block = returns.ptr[i]; block; block = block->block.idom)
+        {
+            block->mark = (uint32_t)i + 1;
+
+            IRInst *term = irBlockTerminator(block);
+            IRInst *merge = NULL;
+            bool is_loop = false;
+            if (term && term->kind == IR_INST_BRANCH)
+            {
+                merge = term->branch.merge_block;
+                is_loop = term->branch.continue_block != NULL;
+            }
+            else if (term && term->kind == IR_INST_COND_BRANCH)
+            {
+                merge = term->cond_branch.merge_block;
+                is_loop = term->cond_branch.continue_block != NULL;
+            }
+
+            if (merge && merge->mark != (uint32_t)i + 1)
+            {
+                callee->nested_returns = true;
+                callee->loop_returns |= is_loop;
+            }
+        }
+    }
+}
+
+static IRInst *irCloneInst(IRModule *m, IRInst *inst)
+{
+    TsCompiler *compiler = m->compiler;
+    IRInst *clone = NEW(compiler, IRInst);
+    *clone = *inst;
+    memset(&clone->users, 0, sizeof(clone->users));
+
+    // The operand arrays get remapped, so they cannot be shared
+    switch (inst->kind)
+    {
+    case IR_INST_ACCESS_CHAIN:
+        clone->access_chain.indices =
+            NEW_ARRAY_UNINIT(compiler, IRInst *, inst->access_chain.index_count);
+        memcpy(
+            clone->access_chain.indices,
+            inst->access_chain.indices,
+            sizeof(IRInst *) * inst->access_chain.index_count);
+        break;
+
+    case IR_INST_FUNC_CALL:
+        clone->func_call.params =
+            NEW_ARRAY_UNINIT(compiler, IRInst *, inst->func_call.param_count);
+        memcpy(
+            clone->func_call.params,
+            inst->func_call.params,
+            sizeof(IRInst *) * inst->func_call.param_count);
+        break;
+
+    case IR_INST_BUILTIN_CALL:
+        clone->builtin_call.params =
+            NEW_ARRAY_UNINIT(compiler, IRInst *, inst->builtin_call.param_count);
+        memcpy(
+            clone->builtin_call.params,
+            inst->builtin_call.params,
+            sizeof(IRInst *) * inst->builtin_call.param_count);
+        break;
+
+    case IR_INST_COMPOSITE_CONSTRUCT:
+        clone->composite_construct.fields =
+            NEW_ARRAY_UNINIT(compiler, IRInst *, inst->composite_construct.field_count);
+        memcpy(
+            clone->composite_construct.fields,
+            inst->composite_construct.fields,
+            sizeof(IRInst *) * inst->composite_construct.field_count);
+        break;
+
+    case IR_INST_PHI:
+        memset(&clone->phi, 0, sizeof(clone->phi));
+        for (size_t i = 0; i < inst->phi.values.len; ++i)
+        {
+            arrPush(compiler, &clone->phi.values, inst->phi.values.ptr[i]);
+            arrPush(compiler, &clone->phi.blocks, inst->phi.blocks.ptr[i]);
+        }
+        break;
+
+    default: break;
+    }
+
+    return clone;
+}
+
+// An empty block with the loop hints of 'block'
+static IRInst *irCloneBlock(IRModule *m, IRInst *func, IRInst *block)
+{
+    IRInst *clone = ts__irCreateBlock(m, func);
+    clone->block.loop_control = block->block.loop_control;
+    clone->block.unroll_count = block->block.unroll_count;
+    clone->block.selection_control = block->block.selection_control;
+    return clone;
+}
+
+// Blocks are looked up by their mark, a zero mark keeps the block
+static IRInst *irMapBlock(IRInst *block, IRInst **blocks)
+{
+    return block->mark ? blocks[block->mark] : block;
+}
+
+static void irRemapBlocks(IRInst *inst, IRInst **blocks)
+{
+    switch (inst->kind)
+    {
+    case IR_INST_BRANCH:
+        inst->branch.target = irMapBlock(inst->branch.target, blocks);
+        if (inst->branch.merge_block)
+        {
+            inst->branch.merge_block = irMapBlock(inst->branch.merge_block, blocks);
+        }
+        if (inst->branch.continue_block)
+        {
+            inst->branch.continue_block = irMapBlock(inst->branch.continue_block, blocks);
+        }
+        break;
+
+    case IR_INST_COND_BRANCH:
+        inst->cond_branch.true_block = irMapBlock(inst->cond_branch.true_block, blocks);
+        inst->cond_branch.false_block = irMapBlock(inst->cond_branch.false_block, blocks);
+        if (inst->cond_branch.merge_block)
+        {
+            inst->cond_branch.merge_block =
+                irMapBlock(inst->cond_branch.merge_block, blocks);
+        }
+        if (inst->cond_branch.continue_block)
+        {
+            inst->cond_branch.continue_block =
+                irMapBlock(inst->cond_branch.continue_block, blocks);
+        }
+        break;
+
+    case IR_INST_PHI:
+        for (size_t i = 0; i < inst->phi.blocks.len; ++i)
+        {
+            inst->phi.blocks.ptr[i] = irMapBlock(inst->phi.blocks.ptr[i], blocks);
+        }
+        break;
+
+    default: break;
+    }
+}
+
+static IRInst *irNewBranch(IRModule *m, IRInst *target)
+{
+    IRInst *inst = NEW(m->compiler, IRInst);
+    inst->kind = IR_INST_BRANCH;
+    inst->branch.target = target;
+    return inst;
+}
+
+// Replaces the call at 'inst_index' of the block by a copy of the body of the callee.
+// The instructions after the call move to a new block, which the returns branch to,
+// and the call itself becomes the phi of the returned values. Returns the index of that
+// block in the function.
+static size_t irInlineCall(
+    IRModule *m,
+    IRInst *func,
+    size_t block_index,
+    size_t inst_index,
+    IRCallee *callee_info)
+{
+    TsCompiler *compiler = m->compiler;
+    IRInst *block = func->func.blocks.ptr[block_index];
+    IRInst *call = block->block.insts.ptr[inst_index];
+    IRInst *callee = call->func_call.func;
+
+    IRInst *after = ts__irCreateBlock(m, func);
+    for (size_t i = inst_index + 1; i < block->block.insts.len; ++i)
+    {
+        arrPush(compiler, &after->block.insts, block->block.insts.ptr[i]);
+    }
+    block->block.insts.len = inst_index;
+
+    // The successors are now reached from the new block
+    IRInst *term = irBlockTerminator(after);
+    IRInst *succs[2] = {NULL, NULL};
+    if (term && term->kind == IR_INST_BRANCH)
+    {
+        succs[0] = term->branch.target;
+    }
+    else if (term && term->kind == IR_INST_COND_BRANCH)
+    {
+        succs[0] = term->cond_branch.true_block;
+        succs[1] = term->cond_branch.false_block;
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        if (!succs[i] || (i == 1 && succs[1] == succs[0])) continue;
+        for (size_t j = 0; j < succs[i]->block.insts.len; ++j)
+        {
+            IRInst *phi = succs[i]->block.insts.ptr[j];
+            if (phi->kind != IR_INST_PHI) break;
+            for (size_t k = 0; k < phi->phi.blocks.len; ++k)
+            {
+                if (phi->phi.blocks.ptr[k] == block) phi->phi.blocks.ptr[k] = after;
+            }
+        }
+    }
+
+    // Values of the callee are numbered in their mark, blocks by their index
+    uint32_t value_count = 0;
+    for (size_t i = 0; i < callee->func.params.len; ++i)
+    {
+        callee->func.params.ptr[i]->mark = ++value_count;
+    }
+    for (size_t i = 0; i < callee->func.blocks.len; ++i)
+    {
+        IRInst *callee_block = callee->func.blocks.ptr[i];
+        for (size_t j = 0; j < callee_block->block.insts.len; ++j)
+        {
+            callee_block->block.insts.ptr[j]->mark = ++value_count;
+        }
+    }
+
+    IRInst **values = NEW_ARRAY(compiler, IRInst *, value_count + 1);
+    for (size_t i = 0; i < callee->func.params.len; ++i)
+    {
+        values[callee->func.params.ptr[i]->mark] = call->func_call.params[i];
+    }
+
+    // The only call of a function takes its body instead of a copy
+    bool move = callee_info->call_count == 1;
+
+    ArrayOfIRInstPtr clones = {0};
+    IRInst **blocks = NEW_ARRAY(compiler, IRInst *, callee->func.blocks.len + 1);
+    for (size_t i = 0; i < callee->func.blocks.len; ++i)
+    {
+        IRInst *callee_block = callee->func.blocks.ptr[i];
+        IRInst *clone_block = callee_block;
+        if (move)
+        {
+            clone_block->block.func = func;
+            for (size_t j = 0; j < callee_block->block.insts.len; ++j)
+            {
+                IRInst *inst = callee_block->block.insts.ptr[j];
+                values[inst->mark] = inst;
+            }
+        }
+        else
+        {
+            clone_block = irCloneBlock(m, func, callee_block);
+            for (size_t j = 0; j < callee_block->block.insts.len; ++j)
+            {
+                IRInst *inst = callee_block->block.insts.ptr[j];
+                IRInst *clone = irCloneInst(m, inst);
+                values[inst->mark] = clone;
+                arrPush(compiler, &clone_block->block.insts, clone);
+            }
+        }
+        blocks[i + 1] = clone_block;
+        arrPush(compiler, &clones, clone_block);
+    }
+    for (size_t i = 0; i < callee->func.blocks.len; ++i)
+    {
+        callee->func.blocks.ptr[i]->mark = (uint32_t)i + 1;
+    }
+
+    ArrayOfIRInstSlot slots = {0};
+    ArrayOfIRInstPtr return_values = {0};
+    ArrayOfIRInstPtr return_blocks = {0};
+    IRType *return_type = callee->type->func.return_type;
+    bool returns_value = return_type->kind != IR_TYPE_VOID;
+
+    for (size_t i = 0; i < clones.len; ++i)
+    {
+        IRInst *clone_block = clones.ptr[i];
+        bool reachable = callee->func.blocks.ptr[i]->block.rpo_index != UINT32_MAX;
+
+        for (size_t j = 0; j < clone_block->block.insts.len; ++j)
+        {
+            IRInst *inst = clone_block->block.insts.ptr[j];
+
+            ts__irInstOperands(m, inst, &slots);
+            for (size_t k = 0; k < slots.len; ++k)
+            {
+                IRInst *value = *slots.ptr[k];
+                if (irIsLocalValue(value)) *slots.ptr[k] = values[value->mark];
+            }
+            irRemapBlocks(inst, blocks);
+
+            if (inst->kind != IR_INST_RETURN) continue;
+
+            if (!reachable)
+            {
+                inst->kind = IR_INST_UNREACHABLE;
+                continue;
+            }
+
+            if (returns_value)
+            {
+                IRInst *value = inst->return_.value;
+                if (!value) value = ts__irBuildUndef(m, return_type);
+                arrPush(compiler, &return_values, value);
+                arrPush(compiler, &return_blocks, clone_block);
+            }
+
+            *inst = *irNewBranch(m, after);
+        }
+    }
+
+    // Variables have to be at the start of the entry block of the function
+    IRInst *entry = func->func.blocks.ptr[0];
+    IRInst *clone_entry = clones.ptr[0];
+    size_t var_insert = 0;
+    while (var_insert < entry->block.insts.len &&
+           entry->block.insts.ptr[var_insert]->kind == IR_INST_VARIABLE)
+    {
+        var_insert++;
+    }
+
+    size_t kept = 0;
+    ArrayOfIRInstPtr vars = {0};
+    ArrayOfIRInstPtr initial_stores = {0};
+    for (size_t i = 0; i < clone_entry->block.insts.len; ++i)
+    {
+        IRInst *inst = clone_entry->block.insts.ptr[i];
+        if (!irIsFunctionVariable(inst))
+        {
+            clone_entry->block.insts.ptr[kept++] = inst;
+            continue;
+        }
+
+        // An initializer runs again at every call
+        if (inst->var.initializer)
+        {
+            IRInst *store = NEW(compiler, IRInst);
+            store->kind = IR_INST_STORE;
+            store->store.pointer = inst;
+            store->store.value = inst->var.initializer;
+            arrPush(compiler, &initial_stores, store);
+            inst->var.initializer = NULL;
+        }
+        arrPush(compiler, &vars, inst);
+    }
+    clone_entry->block.insts.len = kept;
+
+    if (initial_stores.len > 0)
+    {
+        for (size_t i = 0; i < clone_entry->block.insts.len; ++i)
+        {
+            arrPush(compiler, &initial_stores, clone_entry->block.insts.ptr[i]);
+        }
+        clone_entry->block.insts = initial_stores;
+    }
+
+    if (vars.len > 0)
+    {
+        ArrayOfIRInstPtr entry_insts = {0};
+        for (size_t i = 0; i < var_insert; ++i)
+        {
+            arrPush(compiler, &entry_insts, entry->block.insts.ptr[i]);
+        }
+        for (size_t i = 0; i < vars.len; ++i)
+        {
+            arrPush(compiler, &entry_insts, vars.ptr[i]);
+        }
+        for (size_t i = var_insert; i < entry->block.insts.len; ++i)
+        {
+            arrPush(compiler, &entry_insts, entry->block.insts.ptr[i]);
+        }
+        entry->block.insts = entry_insts;
+    }
+
+    // The call becomes the phi of the returned values
+    if (returns_value)
+    {
+        memset(&call->phi, 0, sizeof(call->phi));
+        call->kind = IR_INST_PHI;
+        call->phi.values = return_values;
+        call->phi.blocks = return_blocks;
+
+        ArrayOfIRInstPtr after_insts = {0};
+        arrPush(compiler, &after_insts, call);
+        for (size_t i = 0; i < after->block.insts.len; ++i)
+        {
+            arrPush(compiler, &after_insts, after->block.insts.ptr[i]);
+        }
+        after->block.insts = after_insts;
+    }
+
+    // Nested returns break out of a loop that runs once
+    ArrayOfIRInstPtr new_blocks = {0};
+    if (callee_info->nested_returns)
+    {
+        IRInst *header = ts__irCreateBlock(m, func);
+        IRInst *cont = ts__irCreateBlock(m, func);
+
+        IRInst *loop = irNewBranch(m, clone_entry);
+        loop->branch.merge_block = after;
+        loop->branch.continue_block = cont;
+        arrPush(compiler, &header->block.insts, loop);
+        arrPush(compiler, &cont->block.insts, irNewBranch(m, header));
+
+        arrPush(compiler, &block->block.insts, irNewBranch(m, header));
+        arrPush(compiler, &new_blocks, header);
+        for (size_t i = 0; i < clones.len; ++i)
+        {
+            arrPush(compiler, &new_blocks, clones.ptr[i]);
+        }
+        arrPush(compiler, &new_blocks, cont);
+    }
+    else
+    {
+        arrPush(compiler, &block->block.insts, irNewBranch(m, clone_entry));
+        for (size_t i = 0; i < clones.len; ++i)
+        {
+            arrPush(compiler, &new_blocks, clones.ptr[i]);
+        }
+    }
+    arrPush(compiler, &new_blocks, after);
+
+    ArrayOfIRInstPtr func_blocks = {0};
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        arrPush(compiler, &func_blocks, func->func.blocks.ptr[i]);
+        if (i != block_index) continue;
+        for (size_t j = 0; j < new_blocks.len; ++j)
+        {
+            arrPush(compiler, &func_blocks, new_blocks.ptr[j]);
+        }
+    }
+    func->func.blocks = func_blocks;
+
+    if (move) callee->func.blocks = (ArrayOfIRInstPtr){0};
+    return block_index + new_blocks.len;
+}
+
+static bool irShouldInline(IRInst *block, IRInst *call, IRCallee *callee_info)
+{
+    IRInst *callee = call->func_call.func;
+    if (!callee_info->analyzed || callee->func.blocks.len == 0) return false;
+    if (callee->func.control & SpvFunctionControlDontInlineMask) return false;
+    if (callee_info->loop_returns) return false;
+
+    // The code of a loop header cannot be split, it has to stay a single block
+    IRInst *term = irBlockTerminator(block);
+    if (term && term->kind == IR_INST_BRANCH && term->branch.continue_block) return false;
+    if (term && term->kind == IR_INST_COND_BRANCH && term->cond_branch.continue_block)
+    {
+        return false;
+    }
+
+    return callee->func.always_inline || callee_info->call_count == 1 ||
+           callee_info->inst_count <= IR_INLINE_MAX_INSTS;
+}
+
+// Phis the calls became have a single value when there was one return
+static void irRemoveTrivialPhis(IRModule *m, IRInst *func)
+{
+    ts__irComputeUses(m, func);
+
+    bool removed = false;
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *phi = block->block.insts.ptr[j];
+            phi->mark = 0;
+            if (phi->kind != IR_INST_PHI) continue;
+
+            IRInst *value = NULL;
+            bool trivial = true;
+            for (size_t k = 0; k < phi->phi.values.len; ++k)
+            {
+                IRInst *v = phi->phi.values.ptr[k];
+                if (v == phi || v == value) continue;
+                if (value) trivial = false;
+                value = v;
+            }
+            if (!trivial) continue;
+            if (!value) value = ts__irBuildUndef(m, phi->type);
+
+            ts__irReplaceAllUses(m, phi, value);
+            phi->mark = 1;
+            removed = true;
+        }
+    }
+
+    if (removed) irSweepMarkedInsts(func);
+}
+
+// Callees are visited before their callers, so that what they call is already inlined
+static bool irInlineIntoFunction(
+    IRModule *m, IRInst *func, IRCallee *callees, uint8_t *visit_state)
+{
+    uint32_t index = func->mark;
+    if (visit_state[index]) return false;
+    visit_state[index] = 1;
+
+    bool inlined = false;
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            if (inst->kind != IR_INST_FUNC_CALL) continue;
+            IRInst *callee = inst->func_call.func;
+            inlined |= irInlineIntoFunction(m, callee, callees, visit_state);
+        }
+    }
+
+    // The inlined code was already processed, the search goes on after it
+    size_t i = 0;
+    while (i < func->func.blocks.len)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        size_t next = i + 1;
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            if (inst->kind != IR_INST_FUNC_CALL) continue;
+
+            IRCallee *callee_info = &callees[inst->func_call.func->mark];
+            if (!irShouldInline(block, inst, callee_info)) continue;
+
+            next = irInlineCall(m, func, i, j, callee_info);
+            inlined = true;
+            break;
+        }
+        i = next;
+    }
+
+    ts__irComputeCfg(m, func);
+    ts__irComputeDominators(func);
+    irAnalyzeCallee(m, func, &callees[index]);
+    visit_state[index] = 2;
+    return inlined;
+}
+
+static bool irPassInline(IRModule *m)
+{
+    TsCompiler *compiler = m->compiler;
+    size_t func_count = m->functions.len;
+    IRCallee *callees = NEW_ARRAY(compiler, IRCallee, func_count);
+    uint8_t *visit_state = NEW_ARRAY(compiler, uint8_t, func_count);
+
+    for (size_t i = 0; i < func_count; ++i)
+    {
+        m->functions.ptr[i]->mark = (uint32_t)i;
+    }
+    for (size_t i = 0; i < func_count; ++i)
+    {
+        IRInst *func = m->functions.ptr[i];
+        for (size_t j = 0; j < func->func.blocks.len; ++j)
+        {
+            IRInst *block = func->func.blocks.ptr[j];
+            for (size_t k = 0; k < block->block.insts.len; ++k)
+            {
+                IRInst *inst = block->block.insts.ptr[k];
+                if (inst->kind != IR_INST_FUNC_CALL) continue;
+                callees[inst->func_call.func->mark].call_count++;
+            }
+        }
+    }
+
+    // An entry point counts as a call, its body cannot be moved into a caller
+    for (size_t i = 0; i < m->entry_points.len; ++i)
+    {
+        callees[m->entry_points.ptr[i]->entry_point.func->mark].call_count++;
+    }
+
+    bool inlined = false;
+    for (size_t i = 0; i < func_count; ++i)
+    {
+        inlined |= irInlineIntoFunction(m, m->functions.ptr[i], callees, visit_state);
+    }
+
+    // Functions that are not called anymore go away, entry points are never called
+    for (size_t i = 0; i < func_count; ++i)
+    {
+        m->functions.ptr[i]->mark = 0;
+    }
+    for (size_t i = 0; i < m->entry_points.len; ++i)
+    {
+        m->entry_points.ptr[i]->entry_point.func->mark = 1;
+    }
+    for (size_t i = 0; i < func_count; ++i)
+    {
+        IRInst *func = m->functions.ptr[i];
+        for (size_t j = 0; j < func->func.blocks.len; ++j)
+        {
+            IRInst *block = func->func.blocks.ptr[j];
+            for (size_t k = 0; k < block->block.insts.len; ++k)
+            {
+                IRInst *inst = block->block.insts.ptr[k];
+                if (inst->kind == IR_INST_FUNC_CALL) inst->func_call.func->mark = 1;
+            }
+        }
+    }
+
+    bool removed = irFilterMarkedInsts(&m->functions);
+    if (inlined)
+    {
+        for (size_t i = 0; i < m->functions.len; ++i)
+        {
+            irRemoveTrivialPhis(m, m->functions.ptr[i]);
+        }
+    }
+
+    return inlined || removed;
+}
+
+// Loops without hints are unrolled when the unrolled code has at most this many
+// instructions, [unroll] loops up to the second limit
+#define IR_UNROLL_MAX_INSTS 256
+#define IR_UNROLL_FORCED_MAX_INSTS 16384
+
+// A loop of the form built for 'while' and 'for': the header only tests a condition
+// and the continue block branches back to it
+typedef struct IRLoop
+{
+    IRInst *header;
+    IRInst *preheader;
+    IRInst *body;
+    IRInst *latch; // The continue block
+    IRInst *merge;
+    ArrayOfIRInstPtr blocks; // In function order, the header first
+    ArrayOfIRInstPtr phis;   // The phis of the header
+    bool has_breaks;
+
+    // The counter is a phi of the header that starts at a constant and is incremented
+    // by a constant, and the condition compares it to a constant
+    IRInst *counter;
+    IRInst *cond;
+    IRInst *step;
+    bool exit_on_true;
+} IRLoop;
+
+static IRInst *irPhiIncoming(IRInst *phi, IRInst *block)
+{
+    for (size_t i = 0; i < phi->phi.blocks.len; ++i)
+    {
+        if (phi->phi.blocks.ptr[i] == block) return phi->phi.values.ptr[i];
+    }
+    return NULL;
+}
+
+static IRInst *irMergeBlockOf(IRInst *header)
+{
+    IRInst *term = irBlockTerminator(header);
+    if (term && term->kind == IR_INST_BRANCH) return term->branch.merge_block;
+    if (term && term->kind == IR_INST_COND_BRANCH) return term->cond_branch.merge_block;
+    return NULL;
+}
+
+// Whether the block is inside a selection or a loop nested in the construct of 'top'
+static bool irIsNestedIn(IRInst *block, IRInst *top)
+{
+    while (block->block.idom && block->block.idom != top)
+    {
+        // The merge block of a construct is where its header is, even when the
+        // construct is only left through breaks out of the selections inside it
+        IRInst *owner = NULL;
+        for (IRInst *header = block->block.idom; header && header != top;
+             header = header->block.idom)
+        {
+            if (irMergeBlockOf(header) == block) owner = header;
+        }
+        if (owner)
+        {
+            block = owner;
+            continue;
+        }
+
+        IRInst *header = block->block.idom;
+        IRInst *merge = irMergeBlockOf(header);
+        if (merge && !ts__irDominates(merge, block)) return true;
+        block = header;
+    }
+    return false;
+}
+
+// Evaluates the integer operations a counter can go through, with the wrapping of the
+// type. Returns false for the other operations.
+static bool irEvalCounterOp(SpvOp op, IRType *type, uint64_t x, uint64_t y, uint64_t *out)
+{
+    uint32_t bits = type->int_.bits;
+    uint64_t mask = (bits < 64) ? ((UINT64_C(1) << bits) - 1) : ~UINT64_C(0);
+    x &= mask;
+    y &= mask;
+
+    int64_t sx = (int64_t)x;
+    int64_t sy = (int64_t)y;
+    if (bits < 64 && (x >> (bits - 1)) & 1) sx = (int64_t)(x | ~mask);
+    if (bits < 64 && (y >> (bits - 1)) & 1) sy = (int64_t)(y | ~mask);
+
+    switch (op)
+    {
+    case SpvOpIAdd: *out = (x + y) & mask; break;
+    case SpvOpISub: *out = (x - y) & mask; break;
+
+    case SpvOpIEqual: *out = x == y; break;
+    case SpvOpINotEqual: *out = x != y; break;
+    case SpvOpULessThan: *out = x < y; break;
+    case SpvOpULessThanEqual: *out = x <= y; break;
+    case SpvOpUGreaterThan: *out = x > y; break;
+    case SpvOpUGreaterThanEqual: *out = x >= y; break;
+    case SpvOpSLessThan: *out = sx < sy; break;
+    case SpvOpSLessThanEqual: *out = sx <= sy; break;
+    case SpvOpSGreaterThan: *out = sx > sy; break;
+    case SpvOpSGreaterThanEqual: *out = sx >= sy; break;
+
+    default: return false;
+    }
+    return true;
+}
+
+// Applies a binary instruction whose other operand is a constant to the counter value
+static bool
+irEvalCounterInst(IRInst *inst, IRInst *counter, uint64_t value, uint64_t *out)
+{
+    if (inst->kind != IR_INST_BINARY) return false;
+
+    IRInst *l = inst->binary.left;
+    IRInst *r = inst->binary.right;
+    if (l->type->kind != IR_TYPE_INT || r->type->kind != IR_TYPE_INT) return false;
+
+    uint64_t x, y;
+    if (l == counter && r->kind == IR_INST_CONSTANT)
+    {
+        x = value;
+        y = irConstBits(r);
+    }
+    else if (r == counter && l->kind == IR_INST_CONSTANT)
+    {
+        x = irConstBits(l);
+        y = value;
+    }
+    else
+    {
+        return false;
+    }
+
+    return irEvalCounterOp(inst->binary.op, counter->type, x, y, out);
+}
+
+// Finds the loop headed by 'header' and checks that it can be unrolled. Needs the CFG
+// and the uses of the function computed.
+static bool irFindLoop(IRModule *m, IRInst *func, IRInst *header, IRLoop *loop)
+{
+    TsCompiler *compiler = m->compiler;
+    memset(loop, 0, sizeof(*loop));
+
+    IRInst *term = irBlockTerminator(header);
+    if (!term || term->kind != IR_INST_COND_BRANCH || !term->cond_branch.continue_block)
+    {
+        return false;
+    }
+    if (header->block.loop_control & SpvLoopControlDontUnrollMask) return false;
+
+    loop->header = header;
+    loop->merge = term->cond_branch.merge_block;
+    loop->latch = term->cond_branch.continue_block;
+    if (term->cond_branch.true_block == loop->merge)
+    {
+        loop->exit_on_true = true;
+        loop->body = term->cond_branch.false_block;
+    }
+    else if (term->cond_branch.false_block == loop->merge)
+    {
+        loop->body = term->cond_branch.true_block;
+    }
+    else
+    {
+        return false;
+    }
+
+    // Entered from a single block, and 'continue' is only the end of the body
+    if (header->block.preds.len != 2) return false;
+    for (size_t i = 0; i < 2; ++i)
+    {
+        IRInst *pred = header->block.preds.ptr[i];
+        if (pred != loop->latch) loop->preheader = pred;
+    }
+    if (!loop->preheader || loop->latch->block.preds.len != 1) return false;
+    if (irIsNestedIn(loop->latch->block.preds.ptr[0], header)) return false;
+
+    IRInst *latch_term = irBlockTerminator(loop->latch);
+    if (!latch_term || latch_term->kind != IR_INST_BRANCH ||
+        latch_term->branch.target != header || latch_term->branch.merge_block)
+    {
+        return false;
+    }
+
+    // The blocks of the loop, including the merge and continue blocks of nested
+    // constructs that cannot be reached
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        func->func.blocks.ptr[i]->mark = 0;
+    }
+    ArrayOfIRInstPtr stack = {0};
+    header->mark = 1;
+    arrPush(compiler, &stack, loop->body);
+    while (stack.len > 0)
+    {
+        IRInst *block = *arrPop(&stack);
+        if (block->mark || block == loop->merge) continue;
+        block->mark = 1;
+
+        IRInst *targets[4] = {0};
+        IRInst *block_term = irBlockTerminator(block);
+        if (block_term && block_term->kind == IR_INST_BRANCH)
+        {
+            targets[0] = block_term->branch.target;
+            targets[1] = block_term->branch.merge_block;
+            targets[2] = block_term->branch.continue_block;
+        }
+        else if (block_term && block_term->kind == IR_INST_COND_BRANCH)
+        {
+            targets[0] = block_term->cond_branch.true_block;
+            targets[1] = block_term->cond_branch.false_block;
+            targets[2] = block_term->cond_branch.merge_block;
+            targets[3] = block_term->cond_branch.continue_block;
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            if (targets[i]) arrPush(compiler, &stack, targets[i]);
+        }
+    }
+    if (!loop->latch->mark) return false;
+
+    arrPush(compiler, &loop->blocks, header);
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        if (block->mark && block != header) arrPush(compiler, &loop->blocks, block);
+    }
+
+    // Breaks out of nested selections stay breaks of a loop that runs once
+    for (size_t i = 0; i < loop->merge->block.preds.len; ++i)
+    {
+        IRInst *pred = loop->merge->block.preds.ptr[i];
+        if (pred != header) loop->has_breaks = true;
+    }
+
+    // Only the values of the header, which dominates the merge block, can be used
+    // after the loop
+    for (size_t i = 0; i < loop->blocks.len; ++i)
+    {
+        IRInst *block = loop->blocks.ptr[i];
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            for (size_t k = 0; k < inst->users.len; ++k)
+            {
+                IRInst *user = inst->users.ptr[k];
+                if (user->parent->mark) continue;
+                if (user->kind == IR_INST_PHI && user->parent == loop->merge) continue;
+                if (block != header) return false;
+            }
+        }
+    }
+
+    // The counter
+    IRInst *cond = term->cond_branch.cond;
+    if (cond->kind != IR_INST_BINARY) return false;
+    for (size_t i = 0; i < header->block.insts.len; ++i)
+    {
+        IRInst *phi = header->block.insts.ptr[i];
+        if (phi->kind != IR_INST_PHI) break;
+        arrPush(compiler, &loop->phis, phi);
+
+        if (cond->binary.left != phi && cond->binary.right != phi) continue;
+        if (phi->type->kind != IR_TYPE_INT) continue;
+
+        IRInst *init = irPhiIncoming(phi, loop->preheader);
+        IRInst *step = irPhiIncoming(phi, loop->latch);
+        if (!init || init->kind != IR_INST_CONSTANT || !step) continue;
+        if (step->kind != IR_INST_BINARY ||
+            (step->binary.op != SpvOpIAdd && step->binary.op != SpvOpISub))
+        {
+            continue;
+        }
+        if (step->binary.op == SpvOpISub && step->binary.left != phi) continue;
+
+        loop->counter = phi;
+        loop->step = step;
+        loop->cond = cond;
+    }
+
+    return loop->counter != NULL;
+}
+
+// The number of times the body runs, or -1 when it is more than 'max_trips'
+static int64_t irLoopTripCount(IRLoop *loop, uint32_t max_trips)
+{
+    uint64_t value = irConstBits(irPhiIncoming(loop->counter, loop->preheader));
+    for (uint32_t trips = 0; trips <= max_trips; ++trips)
+    {
+        uint64_t cond;
+        if (!irEvalCounterInst(loop->cond, loop->counter, value, &cond)) return -1;
+        if ((cond != 0) == loop->exit_on_true) return trips;
+
+        if (!irEvalCounterInst(loop->step, loop->counter, value, &value)) return -1;
+    }
+    return -1;
+}
+
+static IRInst *irMapValue(IRInst *value, IRInst **map)
+{
+    return (irIsLocalValue(value) && value->mark) ? map[value->mark] : value;
+}
+
+// Replaces the loop by 'trip_count' copies of its body, each one followed by a copy
+// of the header that feeds the next one. The values of the counter are constants in
+// each copy, and the instructions they make constant are folded.
+static void irUnrollLoop(IRModule *m, IRInst *func, IRLoop *loop, uint32_t trip_count)
+{
+    TsCompiler *compiler = m->compiler;
+    IRInst *header = loop->header;
+
+    // Blocks and instructions of the loop are numbered in their mark
+    for (size_t i = 0; i < func->func.params.len; ++i)
+    {
+        func->func.params.ptr[i]->mark = 0;
+    }
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        block->mark = 0;
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            block->block.insts.ptr[j]->mark = 0;
+        }
+    }
+    uint32_t count = 0;
+    for (size_t i = 0; i < loop->blocks.len; ++i)
+    {
+        IRInst *block = loop->blocks.ptr[i];
+        block->mark = ++count;
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            block->block.insts.ptr[j]->mark = ++count;
+        }
+    }
+
+    // Instructions are remapped in dominance order, so that the folded values are
+    // known before they are used
+    ArrayOfIRInstPtr order = {0};
+    for (size_t i = 0; i < func->func.rpo.len; ++i)
+    {
+        IRInst *block = func->func.rpo.ptr[i];
+        if (block->mark) arrPush(compiler, &order, block);
+    }
+    for (size_t i = 0; i < loop->blocks.len; ++i)
+    {
+        IRInst *block = loop->blocks.ptr[i];
+        if (block->block.rpo_index == UINT32_MAX) arrPush(compiler, &order, block);
+    }
+
+    IRInst **map = NEW_ARRAY(compiler, IRInst *, count + 1);
+    IRInst **clones = NEW_ARRAY(compiler, IRInst *, count + 1);
+    IRInst **carried = NEW_ARRAY(compiler, IRInst *, loop->phis.len);
+    for (size_t i = 0; i < loop->phis.len; ++i)
+    {
+        carried[i] = irPhiIncoming(loop->phis.ptr[i], loop->preheader);
+    }
+
+    ArrayOfIRInstSlot slots = {0};
+    IRInst **headers = NEW_ARRAY(compiler, IRInst *, trip_count + 1);
+    for (uint32_t k = 0; k <= trip_count; ++k)
+    {
+        headers[k] = ts__irCreateBlock(m, func);
+    }
+
+    // With breaks the values of the header used after the loop depend on the copy
+    // that left it, they go through new phis of the merge block
+    IRInst *merge = loop->merge;
+    if (loop->has_breaks)
+    {
+        ArrayOfIRInstPtr phis = {0};
+        for (size_t i = 0; i < header->block.insts.len; ++i)
+        {
+            IRInst *inst = header->block.insts.ptr[i];
+            IRInst *phi = NULL;
+            for (size_t j = 0; j < inst->users.len; ++j)
+            {
+                IRInst *user = inst->users.ptr[j];
+                if (user->parent->mark) continue;
+                if (user->kind == IR_INST_PHI && user->parent == merge) continue;
+
+                if (!phi)
+                {
+                    phi = ts__irCreatePhi(m, inst->type);
+                    for (size_t k = 0; k < merge->block.preds.len; ++k)
+                    {
+                        ts__irPhiAddIncoming(m, phi, inst, merge->block.preds.ptr[k]);
+                    }
+                    arrPush(compiler, &phis, phi);
+                }
+
+                ts__irInstOperands(m, user, &slots);
+                for (size_t s = 0; s < slots.len; ++s)
+                {
+                    if (*slots.ptr[s] == inst) *slots.ptr[s] = phi;
+                }
+            }
+        }
+
+        if (phis.len > 0)
+        {
+            for (size_t i = 0; i < merge->block.insts.len; ++i)
+            {
+                arrPush(compiler, &phis, merge->block.insts.ptr[i]);
+            }
+            merge->block.insts = phis;
+        }
+    }
+
+    // The incoming values the phis of the merge block get from the copies
+    size_t merge_phi_count = 0;
+    while (merge_phi_count < merge->block.insts.len &&
+           merge->block.insts.ptr[merge_phi_count]->kind == IR_INST_PHI)
+    {
+        merge_phi_count++;
+    }
+    IRInst **merge_phis = NEW_ARRAY(compiler, IRInst *, merge_phi_count + 1);
+    for (size_t i = 0; i < merge_phi_count; ++i)
+    {
+        IRInst *phi = merge->block.insts.ptr[i];
+        IRInst *new_phi = NEW(compiler, IRInst);
+        new_phi->kind = IR_INST_PHI;
+        for (size_t j = 0; j < phi->phi.blocks.len; ++j)
+        {
+            if (phi->phi.blocks.ptr[j]->mark) continue;
+            arrPush(compiler, &new_phi->phi.values, phi->phi.values.ptr[j]);
+            arrPush(compiler, &new_phi->phi.blocks, phi->phi.blocks.ptr[j]);
+        }
+        merge_phis[i] = new_phi;
+    }
+
+    ArrayOfIRInstPtr new_blocks = {0};
+    for (uint32_t k = 0; k <= trip_count; ++k)
+    {
+        // The last copy of the header only leads out of the loop
+        size_t block_count = (k < trip_count) ? loop->blocks.len : 1;
+
+        for (size_t i = 0; i < loop->phis.len; ++i)
+        {
+            map[loop->phis.ptr[i]->mark] = carried[i];
+        }
+
+        for (size_t i = 0; i < block_count; ++i)
+        {
+            IRInst *block = loop->blocks.ptr[i];
+            IRInst *clone_block = (i == 0) ? headers[k] : irCloneBlock(m, func, block);
+            map[block->mark] = clone_block;
+            arrPush(compiler, &new_blocks, clone_block);
+
+            for (size_t j = 0; j < block->block.insts.len; ++j)
+            {
+                IRInst *inst = block->block.insts.ptr[j];
+                if (block == header && inst->kind == IR_INST_PHI) continue;
+
+                IRInst *clone = irCloneInst(m, inst);
+                clone->mark = 0;
+                map[inst->mark] = clone;
+                clones[inst->mark] = clone;
+                arrPush(compiler, &clone_block->block.insts, clone);
+            }
+        }
+
+        for (size_t i = 0; i < order.len; ++i)
+        {
+            IRInst *block = order.ptr[i];
+            if (k == trip_count && block != header) continue;
+
+            for (size_t j = 0; j < block->block.insts.len; ++j)
+            {
+                IRInst *inst = block->block.insts.ptr[j];
+                if (inst->kind == IR_INST_PHI) continue;
+
+                IRInst *clone = clones[inst->mark];
+                ts__irInstOperands(m, clone, &slots);
+                for (size_t s = 0; s < slots.len; ++s)
+                {
+                    *slots.ptr[s] = irMapValue(*slots.ptr[s], map);
+                }
+                irRemapBlocks(clone, map);
+
+                IRInst *folded = ts__irFoldInst(m, clone);
+                if (folded)
+                {
+                    map[inst->mark] = folded;
+                    clone->mark = 1;
+                }
+            }
+        }
+
+        // Phis are remapped last, they can refer to values defined after them
+        for (size_t i = 0; i < block_count; ++i)
+        {
+            IRInst *block = loop->blocks.ptr[i];
+            if (block == header) continue;
+
+            for (size_t j = 0; j < block->block.insts.len; ++j)
+            {
+                IRInst *phi = block->block.insts.ptr[j];
+                if (phi->kind != IR_INST_PHI) break;
+
+                IRInst *clone = clones[phi->mark];
+                for (size_t s = 0; s < phi->phi.values.len; ++s)
+                {
+                    clone->phi.values.ptr[s] = irMapValue(phi->phi.values.ptr[s], map);
+                    clone->phi.blocks.ptr[s] = irMapBlock(phi->phi.blocks.ptr[s], map);
+                }
+            }
+        }
+
+        // The header copies do not test the condition anymore
+        IRInst *header_term = irBlockTerminator(headers[k]);
+        header_term->kind = IR_INST_BRANCH;
+        header_term->branch.target = (k < trip_count) ? map[loop->body->mark] : merge;
+        header_term->branch.merge_block = NULL;
+        header_term->branch.continue_block = NULL;
+
+        for (size_t i = 0; i < merge_phi_count; ++i)
+        {
+            IRInst *phi = merge->block.insts.ptr[i];
+            for (size_t j = 0; j < phi->phi.blocks.len; ++j)
+            {
+                IRInst *pred = phi->phi.blocks.ptr[j];
+                if (!pred->mark || (pred == header) != (k == trip_count)) continue;
+
+                IRInst *value = irMapValue(phi->phi.values.ptr[j], map);
+                arrPush(compiler, &merge_phis[i]->phi.values, value);
+                arrPush(compiler, &merge_phis[i]->phi.blocks, map[pred->mark]);
+            }
+        }
+
+        if (k == trip_count) break;
+
+        irBlockTerminator(map[loop->latch->mark])->branch.target = headers[k + 1];
+        for (size_t i = 0; i < loop->phis.len; ++i)
+        {
+            IRInst *value = irPhiIncoming(loop->phis.ptr[i], loop->latch);
+            carried[i] = irMapValue(value, map);
+        }
+    }
+
+    for (size_t i = 0; i < merge_phi_count; ++i)
+    {
+        IRInst *phi = merge->block.insts.ptr[i];
+        phi->phi.values = merge_phis[i]->phi.values;
+        phi->phi.blocks = merge_phis[i]->phi.blocks;
+    }
+
+    // The last copy of the header computes the values used after the loop
+    for (size_t i = 0; i < header->block.insts.len; ++i)
+    {
+        IRInst *inst = header->block.insts.ptr[i];
+        IRInst *value = irMapValue(inst, map);
+        if (inst->users.len > 0 && value != inst) ts__irReplaceAllUses(m, inst, value);
+    }
+
+    IRInst *entry = headers[0];
+    if (loop->has_breaks)
+    {
+        IRInst *loop_header = ts__irCreateBlock(m, func);
+        IRInst *loop_continue = ts__irCreateBlock(m, func);
+
+        IRInst *branch = irNewBranch(m, entry);
+        branch->branch.merge_block = merge;
+        branch->branch.continue_block = loop_continue;
+        arrPush(compiler, &loop_header->block.insts, branch);
+        arrPush(compiler, &loop_continue->block.insts, irNewBranch(m, loop_header));
+
+        ArrayOfIRInstPtr wrapped = {0};
+        arrPush(compiler, &wrapped, loop_header);
+        for (size_t i = 0; i < new_blocks.len; ++i)
+        {
+            arrPush(compiler, &wrapped, new_blocks.ptr[i]);
+        }
+        arrPush(compiler, &wrapped, loop_continue);
+        new_blocks = wrapped;
+        entry = loop_header;
+    }
+
+    IRInst *pre_term = irBlockTerminator(loop->preheader);
+    if (pre_term->kind == IR_INST_BRANCH && pre_term->branch.target == header)
+    {
+        pre_term->branch.target = entry;
+    }
+    else if (pre_term->kind == IR_INST_COND_BRANCH)
+    {
+        if (pre_term->cond_branch.true_block == header)
+        {
+            pre_term->cond_branch.true_block = entry;
+        }
+        if (pre_term->cond_branch.false_block == header)
+        {
+            pre_term->cond_branch.false_block = entry;
+        }
+    }
+
+    // The copies take the place of the loop
+    ArrayOfIRInstPtr func_blocks = {0};
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        if (block == header)
+        {
+            for (size_t j = 0; j < new_blocks.len; ++j)
+            {
+                arrPush(compiler, &func_blocks, new_blocks.ptr[j]);
+            }
+        }
+        if (!block->mark) arrPush(compiler, &func_blocks, block);
+
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            block->block.insts.ptr[j]->mark = 0;
+        }
+    }
+    func->func.blocks = func_blocks;
+
+    irSweepMarkedInsts(func);
+}
+
+static bool irUnrollFunctionLoops(IRModule *m, IRInst *func)
+{
+    if (func->func.blocks.len == 0) return false;
+
+    bool changed = false;
+    bool unrolled = true;
+    while (unrolled)
+    {
+        unrolled = false;
+        ts__irComputeCfg(m, func);
+        changed |= irRemoveUnreachableBlocks(m, func);
+        ts__irComputeDominators(func);
+        ts__irComputeUses(m, func);
+
+        // Inner loops come last in reverse post-order, they are unrolled first
+        ArrayOfIRInstPtr headers = {0};
+        for (size_t i = 0; i < func->func.rpo.len; ++i)
+        {
+            arrPush(m->compiler, &headers, func->func.rpo.ptr[i]);
+        }
+
+        for (size_t i = headers.len; i-- > 0;)
+        {
+            IRLoop loop;
+            if (!irFindLoop(m, func, headers.ptr[i], &loop)) continue;
+
+            size_t inst_count = 0;
+            for (size_t j = 0; j < loop.blocks.len; ++j)
+            {
+                inst_count += loop.blocks.ptr[j]->block.insts.len;
+            }
+
+            IRInst *header = loop.header;
+            bool forced = (header->block.loop_control & SpvLoopControlUnrollMask) ||
+                          header->block.unroll_count > 0;
+            size_t max_insts = forced ? IR_UNROLL_FORCED_MAX_INSTS : IR_UNROLL_MAX_INSTS;
+            size_t max_trips = max_insts / inst_count;
+            if (header->block.unroll_count > 0 && header->block.unroll_count < max_trips)
+            {
+                max_trips = header->block.unroll_count;
+            }
+
+            int64_t trip_count = irLoopTripCount(&loop, (uint32_t)max_trips);
+            if (trip_count < 0) continue;
+
+            irUnrollLoop(m, func, &loop, (uint32_t)trip_count);
+            unrolled = true;
+            changed = true;
+            break;
+        }
+    }
+    return changed;
+}
+
+static bool irPassUnroll(IRModule *m)
+{
+    bool changed = false;
+    for (size_t i = 0; i < m->functions.len; ++i)
+    {
+        changed |= irUnrollFunctionLoops(m, m->functions.ptr[i]);
+    }
+    return changed;
+}
+
+// Selections whose sides have at most this many instructions each become selects,
+// [flatten] selections whatever their size
+#define IR_SELECT_MAX_INSTS 4
+
+static bool irTypeHasRuntimeArray(IRType *type)
+{
+    if (type->kind == IR_TYPE_RUNTIME_ARRAY) return true;
+    if (type->kind != IR_TYPE_STRUCT) return false;
+    for (uint32_t i = 0; i < type->struct_.field_count; ++i)
+    {
+        if (irTypeHasRuntimeArray(type->struct_.fields[i])) return true;
+    }
+    return false;
+}
+
+// Instructions that can run whether or not the side of the selection holding them
+// is taken: they have no side effect, cannot fault and only load memory that is
+// always in bounds
+static bool irIsSpeculatable(IRInst *inst)
+{
+    switch (inst->kind)
+    {
+    case IR_INST_ACCESS_CHAIN:
+    case IR_INST_CAST:
+    case IR_INST_COMPOSITE_CONSTRUCT:
+    case IR_INST_COMPOSITE_EXTRACT:
+    case IR_INST_VECTOR_SHUFFLE:
+    case IR_INST_UNARY:
+    case IR_INST_SELECT: return true;
+
+    case IR_INST_BINARY: {
+        switch (inst->binary.op)
+        {
+        case SpvOpUDiv:
+        case SpvOpSDiv:
+        case SpvOpUMod:
+        case SpvOpSMod:
+        case SpvOpSRem: return false;
+        default: return true;
+        }
+    }
+
+    case IR_INST_LOAD: {
+        IRInst *pointer = inst->load.pointer;
+        while (pointer->kind == IR_INST_ACCESS_CHAIN)
+        {
+            for (uint32_t i = 0; i < pointer->access_chain.index_count; ++i)
+            {
+                if (!irIsConstant(pointer->access_chain.indices[i])) return false;
+            }
+            pointer = pointer->access_chain.base;
+        }
+        return !irTypeHasRuntimeArray(pointer->type->ptr.sub);
+    }
+
+    case IR_INST_BUILTIN_CALL: return !irBuiltinHasSideEffects(inst->builtin_call.kind);
+
+    default: return false;
+    }
+}
+
+// Follows one side of a selection from 'target': blocks that are only reached from
+// the previous one and branch to the next one, until the merge block. Returns the
+// block the side enters the merge block from, or NULL when it does anything else.
+static IRInst *irSelectSide(
+    IRModule *m,
+    IRInst *header,
+    IRInst *target,
+    ArrayOfIRInstPtr *blocks,
+    size_t *inst_count)
+{
+    IRInst *merge = irBlockTerminator(header)->cond_branch.merge_block;
+    IRInst *from = header;
+    *inst_count = 0;
+
+    for (IRInst *block = target; block != merge;)
+    {
+        if (block->block.preds.len != 1) return NULL;
+
+        IRInst *term = irBlockTerminator(block);
+        if (!term || term->kind != IR_INST_BRANCH || term->branch.merge_block)
+        {
+            return NULL;
+        }
+
+        for (size_t i = 0; i + 1 < block->block.insts.len; ++i)
+        {
+            IRInst *inst = block->block.insts.ptr[i];
+            if (!irIsSpeculatable(inst)) return NULL;
+            (*inst_count)++;
+        }
+
+        arrPush(m->compiler, blocks, block);
+        from = block;
+        block = term->branch.target;
+    }
+    return from;
+}
+
+// Replaces a selection that only computes values by the instructions of both sides
+// followed by selects of the values the merge block takes from each side
+static bool irConvertSelection(IRModule *m, IRInst *header)
+{
+    TsCompiler *compiler = m->compiler;
+
+    IRInst *term = irBlockTerminator(header);
+    if (!term || term->kind != IR_INST_COND_BRANCH || !term->cond_branch.merge_block ||
+        term->cond_branch.continue_block)
+    {
+        return false;
+    }
+    if (term->cond_branch.true_block == term->cond_branch.false_block) return false;
+
+    SpvSelectionControlMask control = header->block.selection_control;
+    if (control & SpvSelectionControlDontFlattenMask) return false;
+
+    IRInst *merge = term->cond_branch.merge_block;
+    if (merge->block.preds.len != 2) return false;
+
+    ArrayOfIRInstPtr blocks = {0};
+    size_t true_count, false_count;
+    IRInst *true_from =
+        irSelectSide(m, header, term->cond_branch.true_block, &blocks, &true_count);
+    if (!true_from) return false;
+    IRInst *false_from =
+        irSelectSide(m, header, term->cond_branch.false_block, &blocks, &false_count);
+    if (!false_from || true_from == false_from) return false;
+
+    if (!(control & SpvSelectionControlFlattenMask) &&
+        (true_count > IR_SELECT_MAX_INSTS || false_count > IR_SELECT_MAX_INSTS))
+    {
+        return false;
+    }
+
+    // OpSelect only takes scalars and vectors before SPIR-V 1.4
+    size_t phi_count = 0;
+    for (; phi_count < merge->block.insts.len; ++phi_count)
+    {
+        IRInst *phi = merge->block.insts.ptr[phi_count];
+        if (phi->kind != IR_INST_PHI) break;
+
+        IRType *type = phi->type;
+        if (type->kind == IR_TYPE_VECTOR) type = type->vector.elem_type;
+        if (type->kind != IR_TYPE_BOOL && type->kind != IR_TYPE_INT &&
+            type->kind != IR_TYPE_FLOAT)
+        {
+            return false;
+        }
+        if (!irPhiIncoming(phi, true_from) || !irPhiIncoming(phi, false_from))
+        {
+            return false;
+        }
+    }
+
+    // The header runs both sides and then goes straight to the merge block
+    arrPop(&header->block.insts);
+    for (size_t i = 0; i < blocks.len; ++i)
+    {
+        IRInst *block = blocks.ptr[i];
+        for (size_t j = 0; j + 1 < block->block.insts.len; ++j)
+        {
+            arrPush(compiler, &header->block.insts, block->block.insts.ptr[j]);
+        }
+        block->mark = 1;
+    }
+
+    IRInst *saved_block = ts__irGetCurrentBlock(m);
+    ts__irPositionAtEnd(m, header);
+
+    IRInst *cond = term->cond_branch.cond;
+    IRInst *vector_conds[5] = {0};
+    for (size_t i = 0; i < phi_count; ++i)
+    {
+        IRInst *phi = merge->block.insts.ptr[i];
+        IRInst *true_value = irPhiIncoming(phi, true_from);
+        IRInst *false_value = irPhiIncoming(phi, false_from);
+
+        IRInst *value = true_value;
+        if (true_value != false_value)
+        {
+            IRInst *select_cond = cond;
+            if (phi->type->kind == IR_TYPE_VECTOR)
+            {
+                uint32_t size = phi->type->vector.size;
+                if (!vector_conds[size])
+                {
+                    IRInst **fields = NEW_ARRAY(compiler, IRInst *, size);
+                    for (uint32_t j = 0; j < size; ++j) fields[j] = cond;
+                    IRType *type = ts__irNewVectorType(m, cond->type, size);
+                    vector_conds[size] =
+                        ts__irBuildCompositeConstruct(m, type, fields, size);
+                    irAddUses(m, vector_conds[size]);
+                }
+                select_cond = vector_conds[size];
+            }
+            value = ts__irBuildSelect(m, phi->type, select_cond, true_value, false_value);
+            irAddUses(m, value);
+        }
+
+        ts__irReplaceAllUses(m, phi, value);
+    }
+
+    ts__irPositionAtEnd(m, saved_block);
+
+    arrPush(compiler, &header->block.insts, irNewBranch(m, merge));
+    for (size_t i = 0; i < header->block.insts.len; ++i)
+    {
+        header->block.insts.ptr[i]->parent = header;
+    }
+
+    ArrayOfIRInstPtr merge_insts = {0};
+    for (size_t i = phi_count; i < merge->block.insts.len; ++i)
+    {
+        arrPush(compiler, &merge_insts, merge->block.insts.ptr[i]);
+    }
+    merge->block.insts = merge_insts;
+
+    merge->block.preds.len = 0;
+    arrPush(compiler, &merge->block.preds, header);
+    header->block.succs.len = 0;
+    arrPush(compiler, &header->block.succs, merge);
+
+    return true;
+}
+
+static bool irConvertFunctionSelections(IRModule *m, IRInst *func)
+{
+    if (func->func.blocks.len == 0) return false;
+
+    ts__irComputeCfg(m, func);
+    ts__irComputeUses(m, func);
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        func->func.blocks.ptr[i]->mark = 0;
+    }
+
+    // Inner selections come first, so that the outer ones see them as straight code
+    bool changed = false;
+    for (size_t i = func->func.rpo.len; i-- > 0;)
+    {
+        IRInst *block = func->func.rpo.ptr[i];
+        if (!block->mark) changed |= irConvertSelection(m, block);
+    }
+    if (!changed) return false;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < func->func.blocks.len; ++i)
+    {
+        IRInst *block = func->func.blocks.ptr[i];
+        if (!block->mark) func->func.blocks.ptr[kept++] = block;
+    }
+    func->func.blocks.len = kept;
+    return true;
+}
+
+static bool irPassIfConvert(IRModule *m)
+{
+    bool changed = false;
+    for (size_t i = 0; i < m->functions.len; ++i)
+    {
+        changed |= irConvertFunctionSelections(m, m->functions.ptr[i]);
+    }
+    return changed;
+}
+
+// 'mark' of the blocks during control flow simplification
+#define IR_CFG_STRUCTURAL 1 // Named as a merge or continue block, so it has to stay
+#define IR_CFG_REMOVED 2
+
+static void irReplacePred(IRModule *m, IRInst *block, IRInst *old_pred, IRInst *new_pred)
+{
+    size_t kept = 0;
+    bool found = false;
+    for (size_t i = 0; i < block->block.preds.len; ++i)
+    {
+        IRInst *pred = block->block.preds.ptr[i];
+        if (pred == old_pred) continue;
+        if (pred == new_pred) found = true;
+        block->block.preds.ptr[kept++] = pred;
+    }
+    block->block.preds.len = kept;
+    if (!found) arrPush(m->compiler, &block->block.preds, new_pred);
+
+    for (size_t i = 0; i < block->block.insts.len; ++i)
+    {
+        IRInst *phi = block->block.insts.ptr[i];
+        if (phi->kind != IR_INST_PHI) break;
+        for (size_t j = 0; j < phi->phi.blocks.len; ++j)
+        {
+            if (phi->phi.blocks.ptr[j] == old_pred) phi->phi.blocks.ptr[j] = new_pred;
+        }
+    }
+}
+
+// Appends the only successor of a block to it, when the block is its only predecessor
+static bool irMergeSuccessor(IRModule *m, IRInst *block)
+{
+    IRInst *term = irBlockTerminator(block);
+    if (!term || term->kind != IR_INST_BRANCH || term->branch.merge_block) return false;
+
+    IRInst *next = term->branch.target;
+    if (next == block || next->mark || next->block.preds.len != 1) return false;
+
+    arrPop(&block->block.insts);
+    for (size_t i = 0; i < next->block.insts.len; ++i)
+    {
+        IRInst *inst = next->block.insts.ptr[i];
+        if (inst->kind == IR_INST_PHI)
+        {
+            ts__irReplaceAllUses(m, inst, inst->phi.values.ptr[0]);
+            continue;
+        }
+        inst->parent = block;
+        arrPush(m->compiler, &block->block.insts, inst);
+    }
+
+    block->block.succs = next->block.succs;
+    for (size_t i = 0; i < block->block.succs.len; ++i)
+    {
+        irReplacePred(m, block->block.succs.ptr[i], next, block);
+    }
+
+    block->block.loop_control = next->block.loop_control;
+    block->block.unroll_count = next->block.unroll_count;
+    block->block.selection_control = next->block.selection_control;
+
+    next->mark = IR_CFG_REMOVED;
+    return true;
+}
+
+// Makes the predecessors of a block that only branches somewhere else branch there
+// directly
+static bool irBypassBlock(IRModule *m, IRInst *block)
+{
+    if (block->mark || block->block.insts.len != 1) return false;
+    if (block == block->block.func->func.blocks.ptr[0]) return false;
+
+    IRInst *term = irBlockTerminator(block);
+    if (!term || term->kind != IR_INST_BRANCH || term->branch.merge_block ||
+        term->branch.continue_block)
+    {
+        return false;
+    }
+
+    IRInst *target = term->branch.target;
+    if (target == block) return false;
+
+    // The phis of the target can only take the value of a single new predecessor
+    bool has_phis = target->block.insts.len > 0 &&
+                    target->block.insts.ptr[0]->kind == IR_INST_PHI;
+    for (size_t i = 0; i < block->block.preds.len; ++i)
+    {
+        IRInst *pred = block->block.preds.ptr[i];
+        if (has_phis)
+        {
+            if (block->block.preds.len != 1) return false;
+            for (size_t j = 0; j < target->block.preds.len; ++j)
+            {
+                if (target->block.preds.ptr[j] == pred) return false;
+            }
+        }
+
+        // A loop header cannot have both of its targets in the same place
+        IRInst *pred_term = irBlockTerminator(pred);
+        if (pred_term->kind == IR_INST_COND_BRANCH &&
+            pred_term->cond_branch.continue_block &&
+            (pred_term->cond_branch.true_block == target ||
+             pred_term->cond_branch.false_block == target))
+        {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < block->block.preds.len; ++i)
+    {
+        IRInst *pred = block->block.preds.ptr[i];
+        IRInst *pred_term = irBlockTerminator(pred);
+        if (pred_term->kind == IR_INST_BRANCH)
+        {
+            pred_term->branch.target = target;
+        }
+        else
+        {
+            if (pred_term->cond_branch.true_block == block)
+            {
+                pred_term->cond_branch.true_block = target;
+            }
+            if (pred_term->cond_branch.false_block == block)
+            {
+                pred_term->cond_branch.false_block = target;
+            }
+
+            // A selection whose sides go to the same place is not one anymore
+            if (pred_term->cond_branch.true_block == pred_term->cond_branch.false_block)
+            {
+                pred->block.insts.ptr[pred->block.insts.len - 1] = irNewBranch(m, target);
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t j = 0; j < pred->block.succs.len; ++j)
+        {
+            IRInst *succ = pred->block.succs.ptr[j];
+            if (succ != block && succ != target) pred->block.succs.ptr[kept++] = succ;
+        }
+        pred->block.succs.len = kept;
+        arrPush(m->compiler, &pred->block.succs, target);
+
+        irReplacePred(m, target, block, pred);
+    }
+
+    block->mark = IR_CFG_REMOVED;
+    return true;
+}
+
+// A loop whose continue block cannot be reached and that is only left by falling
+// off the end of its body, like the ones wrapped around inlined calls and unrolled
+// loops, does not need to be a loop
+static bool irRemoveSingleTripLoop(IRInst *header)
+{
+    IRInst *term = irBlockTerminator(header);
+    if (!term || term->kind != IR_INST_BRANCH || !term->branch.continue_block ||
+        term->branch.continue_block->block.rpo_index != UINT32_MAX)
+    {
+        return false;
+    }
+
+    IRInst *merge = term->branch.merge_block;
+    IRInst *exit = NULL;
+    for (size_t i = 0; i < merge->block.preds.len; ++i)
+    {
+        IRInst *pred = merge->block.preds.ptr[i];
+        if (pred->block.rpo_index == UINT32_MAX) continue;
+        if (exit) return false;
+        exit = pred;
+    }
+
+    if (exit)
+    {
+        IRInst *exit_term = irBlockTerminator(exit);
+        if (exit_term->kind != IR_INST_BRANCH || exit_term->branch.merge_block ||
+            (exit != header && irIsNestedIn(exit, header)))
+        {
+            return false;
+        }
+    }
+
+    term->branch.merge_block = NULL;
+    term->branch.continue_block = NULL;
+    return true;
+}
+
+// Merges straight-line blocks and bypasses the blocks that only branch somewhere
+// else, until nothing changes. Merge and continue blocks stay, as the structured
+// control flow of SPIR-V needs them.
+static bool irSimplifyFunctionCfg(IRModule *m, IRInst *func)
+{
+    if (func->func.blocks.len == 0) return false;
+
+    bool changed = false;
+    bool simplified = true;
+    while (simplified)
+    {
+        simplified = false;
+        ts__irComputeCfg(m, func);
+        changed |= irRemoveUnreachableBlocks(m, func);
+        ts__irComputeDominators(func);
+        ts__irComputeUses(m, func);
+
+        for (size_t i = 0; i < func->func.rpo.len; ++i)
+        {
+            simplified |= irRemoveSingleTripLoop(func->func.rpo.ptr[i]);
+        }
+
+        for (size_t i = 0; i < func->func.blocks.len; ++i)
+        {
+            func->func.blocks.ptr[i]->mark = 0;
+        }
+        for (size_t i = 0; i < func->func.blocks.len; ++i)
+        {
+            IRInst *term = irBlockTerminator(func->func.blocks.ptr[i]);
+            IRInst *merge = irMergeBlockOf(func->func.blocks.ptr[i]);
+            IRInst *continue_block = NULL;
+            if (term && term->kind == IR_INST_BRANCH)
+            {
+                continue_block = term->branch.continue_block;
+            }
+            else if (term && term->kind == IR_INST_COND_BRANCH)
+            {
+                continue_block = term->cond_branch.continue_block;
+            }
+
+            if (merge) merge->mark = IR_CFG_STRUCTURAL;
+            if (continue_block) continue_block->mark = IR_CFG_STRUCTURAL;
+        }
+
+        for (size_t i = 0; i < func->func.rpo.len; ++i)
+        {
+            IRInst *block = func->func.rpo.ptr[i];
+            if (block->mark & IR_CFG_REMOVED) continue;
+
+            while (irMergeSuccessor(m, block)) simplified = true;
+            if (irBypassBlock(m, block)) simplified = true;
+        }
+
+        if (!simplified) break;
+        changed = true;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < func->func.blocks.len; ++i)
+        {
+            IRInst *block = func->func.blocks.ptr[i];
+            if (!(block->mark & IR_CFG_REMOVED)) func->func.blocks.ptr[kept++] = block;
+        }
+        func->func.blocks.len = kept;
+    }
+    return changed;
+}
+
+static bool irPassSimplifyCfg(IRModule *m)
+{
+    bool changed = false;
+    for (size_t i = 0; i < m->functions.len; ++i)
+    {
+        changed |= irSimplifyFunctionCfg(m, m->functions.ptr[i]);
+    }
+    return changed;
+}
+
+// 'mark' of the blocks of the loop being processed
+#define IR_LICM_IN_LOOP 1
+#define IR_LICM_ALWAYS_RUNS 2
+
+// Whether the memory of a variable cannot be written while the shader runs: stage
+// inputs, textures, samplers, constant buffers and structured buffers
+static bool irIsReadOnlyVariable(IRInst *var)
+{
+    if (var->kind != IR_INST_VARIABLE) return false;
+
+    switch (var->var.storage_class)
+    {
+    case SpvStorageClassInput:
+    case SpvStorageClassUniformConstant: return true;
+
+    case SpvStorageClassUniform: {
+        IRType *type = var->type->ptr.sub;
+        for (size_t i = 0; i < type->decorations.len; ++i)
+        {
+            if (type->decorations.ptr[i].kind == SpvDecorationBlock) return true;
+        }
+        if (type->kind != IR_TYPE_STRUCT) return false;
+        for (uint32_t i = 0; i < type->struct_.field_decoration_count; ++i)
+        {
+            if (type->struct_.field_decorations[i].kind == SpvDecorationNonWritable)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    default: return false;
+    }
+}
+
+// Instructions that compute the same value on every iteration when their operands do.
+// Loads are only moved from read-only memory and from the Function variables that
+// have their mark cleared because the loop does not write them. Integer divisions and
+// loads that could be out of bounds are only moved out of the blocks that run
+// whenever the loop is entered.
+static bool irIsHoistable(IRInst *inst, bool always_runs)
+{
+    switch (inst->kind)
+    {
+    case IR_INST_LOAD: {
+        IRInst *root = irPointerRoot(inst->load.pointer);
+        if (irIsFunctionVariable(root) ? root->mark : !irIsReadOnlyVariable(root))
+        {
+            return false;
+        }
+        break;
+    }
+
+    case IR_INST_BUILTIN_CALL:
+        // Sampled images have to be created in the block that uses them
+        if (inst->builtin_call.kind == IR_BUILTIN_CREATE_SAMPLED_IMAGE) return false;
+        break;
+
+    default: break;
+    }
+
+    if (irIsSpeculatable(inst)) return true;
+    return always_runs && (inst->kind == IR_INST_BINARY || inst->kind == IR_INST_LOAD);
+}
+
+// Moves the instructions of the loop headed by the block at 'header_index' in
+// reverse post-order whose operands are all defined outside of it to the end of the
+// preheader. Needs the CFG, dominators and uses of the function computed, and the
+// marks of the instructions cleared.
+static bool irHoistLoopInvariants(
+    IRModule *m,
+    IRInst *func,
+    size_t header_index,
+    ArrayOfIRInstPtr *stack,
+    ArrayOfIRInstSlot *slots,
+    ArrayOfIRInstPtr *written)
+{
+    IRInst *header = func->func.rpo.ptr[header_index];
+    IRInst *term = irBlockTerminator(header);
+    if (!term) return false;
+    if (!(term->kind == IR_INST_BRANCH && term->branch.continue_block) &&
+        !(term->kind == IR_INST_COND_BRANCH && term->cond_branch.continue_block))
+    {
+        return false;
+    }
+
+    // The only block that enters the loop, and does nothing else
+    IRInst *preheader = NULL;
+    for (size_t i = 0; i < header->block.preds.len; ++i)
+    {
+        IRInst *pred = header->block.preds.ptr[i];
+        if (pred->block.rpo_index == UINT32_MAX) continue;
+        if (ts__irDominates(header, pred)) continue;
+        if (preheader) return false;
+        preheader = pred;
+    }
+    if (!preheader) return false;
+
+    IRInst *preheader_term = irBlockTerminator(preheader);
+    if (!preheader_term || preheader_term->kind != IR_INST_BRANCH) return false;
+
+    // The blocks reached from the header before its merge block, which come after
+    // the header in reverse post-order
+    IRInst *merge = irMergeBlockOf(header);
+    size_t block_count = 0;
+    stack->len = 0;
+    arrPush(m->compiler, stack, header);
+    while (stack->len > 0)
+    {
+        IRInst *block = *arrPop(stack);
+        if (block->mark || block == merge) continue;
+        block->mark = IR_LICM_IN_LOOP;
+        block_count++;
+
+        for (size_t i = 0; i < block->block.succs.len; ++i)
+        {
+            arrPush(m->compiler, stack, block->block.succs.ptr[i]);
+        }
+    }
+
+    size_t end = header_index;
+    for (size_t found = 0; found < block_count; ++end)
+    {
+        if (func->func.rpo.ptr[end]->mark) found++;
+    }
+
+    // Function variables the loop stores into, or passes to calls and atomics
+    written->len = 0;
+    for (size_t i = header_index; i < end; ++i)
+    {
+        IRInst *block = func->func.rpo.ptr[i];
+        if (!block->mark) continue;
+
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+            if (inst->kind == IR_INST_LOAD) continue;
+            if (inst->kind == IR_INST_ACCESS_CHAIN) continue;
+
+            ts__irInstOperands(m, inst, slots);
+            for (size_t k = 0; k < slots->len; ++k)
+            {
+                IRInst *operand = *slots->ptr[k];
+                if (!operand->type || operand->type->kind != IR_TYPE_POINTER) continue;
+
+                IRInst *root = irPointerRoot(operand);
+                if (irIsFunctionVariable(root) && !root->mark)
+                {
+                    root->mark = 1;
+                    arrPush(m->compiler, written, root);
+                }
+            }
+        }
+    }
+
+    // The header runs whenever the loop is entered, and so do the blocks it reaches
+    // through unconditional branches
+    for (IRInst *block = header; block->mark == IR_LICM_IN_LOOP;)
+    {
+        block->mark = IR_LICM_ALWAYS_RUNS;
+        IRInst *block_term = irBlockTerminator(block);
+        if (!block_term || block_term->kind != IR_INST_BRANCH) break;
+        block = block_term->branch.target;
+    }
+
+    // Operands are defined before their users in reverse post-order, except for phis,
+    // which are never moved
+    ArrayOfIRInstPtr hoisted = {0};
+    for (size_t i = header_index; i < end; ++i)
+    {
+        IRInst *block = func->func.rpo.ptr[i];
+        if (!block->mark) continue;
+
+        size_t kept = 0;
+        for (size_t j = 0; j < block->block.insts.len; ++j)
+        {
+            IRInst *inst = block->block.insts.ptr[j];
+
+            bool invariant = irIsHoistable(inst, block->mark == IR_LICM_ALWAYS_RUNS);
+            if (invariant)
+            {
+                ts__irInstOperands(m, inst, slots);
+                for (size_t k = 0; k < slots->len; ++k)
+                {
+                    IRInst *operand = *slots->ptr[k];
+                    if (!irIsLocalValue(operand) || !operand->parent) continue;
+                    if (operand->parent->mark)
+                    {
+                        invariant = false;
+                        break;
+                    }
+                }
+            }
+
+            if (invariant)
+            {
+                inst->parent = preheader;
+                arrPush(m->compiler, &hoisted, inst);
+            }
+            else
+            {
+                block->block.insts.ptr[kept++] = inst;
+            }
+        }
+        block->block.insts.len = kept;
+    }
+
+    for (size_t i = header_index; i < end; ++i)
+    {
+        func->func.rpo.ptr[i]->mark = 0;
+    }
+    for (size_t i = 0; i < written->len; ++i)
+    {
+        written->ptr[i]->mark = 0;
+    }
+
+    if (hoisted.len == 0) return false;
+
+    ArrayOfIRInstPtr *insts = &preheader->block.insts;
+    arrPop(insts);
+    for (size_t i = 0; i < hoisted.len; ++i)
+    {
+        arrPush(m->compiler, insts, hoisted.ptr[i]);
+    }
+    arrPush(m->compiler, insts, preheader_term);
+    return true;
+}
+
+static bool irPassLicm(IRModule *m)
+{
+    bool changed = false;
+    ArrayOfIRInstPtr stack = {0};
+    ArrayOfIRInstSlot slots = {0};
+    ArrayOfIRInstPtr written = {0};
+
+    for (size_t i = 0; i < m->functions.len; ++i)
+    {
+        IRInst *func = m->functions.ptr[i];
+        if (func->func.blocks.len == 0) continue;
+
+        ts__irComputeCfg(m, func);
+        ts__irComputeDominators(func);
+        ts__irComputeUses(m, func);
+        for (size_t j = 0; j < func->func.blocks.len; ++j)
+        {
+            IRInst *block = func->func.blocks.ptr[j];
+            block->mark = 0;
+            for (size_t k = 0; k < block->block.insts.len; ++k)
+            {
+                block->block.insts.ptr[k]->mark = 0;
+            }
+        }
+
+        // Inner loops come last in reverse post-order. They are processed first, so
+        // that what moves to their preheader can move out of the outer loops too.
+        for (size_t j = func->func.rpo.len; j-- > 0;)
+        {
+            changed |= irHoistLoopInvariants(m, func, j, &stack, &slots, &written);
+        }
+    }
+    return changed;
+}
+
+////////////////////////////////
+//
+// Pass manager
+//
+////////////////////////////////
+
+static const IRPass O1_PASSES[] = {
+    {"mem2reg", irPassMem2Reg},
+    {"sccp", irPassSccp},
+    {"unroll", irPassUnroll},
+    {"if-convert", irPassIfConvert},
+    {"dead-insts", irPassDeadInsts},
+    {"simplify-cfg", irPassSimplifyCfg},
+};
+
+static const IRPass O2_PASSES[] = {
+    {"inline", irPassInline},
+    {"mem2reg", irPassMem2Reg},
+    {"sccp", irPassSccp},
+    {"unroll", irPassUnroll},
+    {"if-convert", irPassIfConvert},
+    {"licm", irPassLicm},
+    {"gvn", irPassGvn},
+    {"dce", irPassDce},
+    {"simplify-cfg", irPassSimplifyCfg},
+};
+
+static void irRunPass(IRModule *m, const IRPass *pass)
+{
+    TsPassStats stats = {0};
+    stats.name = pass->name;
+    stats.inst_count_before = ts__irCountInsts(m);
+
+    double start = ts__getTime();
+    pass->run(m);
+    stats.milliseconds = (ts__getTime() - start) * 1000.0;
+
+    stats.inst_count_after = ts__irCountInsts(m);
+    arrPush(m->compiler, &m->pass_stats, stats);
+}
+
+void ts__irOptimize(IRModule *m, uint32_t level)
+{
+    const IRPass *passes = NULL;
+    size_t pass_count = 0;
+
+    switch (level)
+    {
+    case 0: return;
+    case 1:
+        passes = O1_PASSES;
+        pass_count = sizeof(O1_PASSES) / sizeof(O1_PASSES[0]);
+        break;
+    default:
+        passes = O2_PASSES;
+        pass_count = sizeof(O2_PASSES) / sizeof(O2_PASSES[0]);
+        break;
+    }
+
+    for (size_t i = 0; i < pass_count; ++i)
+    {
+        irRunPass(m, &passes[i]);
+    }
+}
@@ -7,11 +7,20 @@
 typedef struct Parser
 {
     TsCompiler *compiler;
+    const char *text; // Source the token locations point into
     Token *tokens;
     size_t token_count;
+    SourceLoc loc_base; // Source location of the first token
 
     ArrayOfAstDeclPtr decls;
 
+    // Names declared as templates anywhere in the module, for which 'name<' opens a
+    // template argument list instead of being a comparison
+    HashMap *template_names;
+
+    // Set when the first '>' of a '>>' token closed a template argument list
+    bool split_shift;
+
     size_t pos;
 } Parser;
 
@@ -55,7 +64,7 @@ static inline Token *parserConsume(Parser *p, TokenKind kind)
             &tok->loc,
             "unexpected token: '%.*s', expected: '%s'",
             (int)tok->loc.length,
-            &tok->loc.buffer[tok->loc.pos],
+            &p->text[tok->loc.pos],
             ts__getTokenString(kind));
         return NULL;
     }
@@ -63,30 +72,83 @@ static inline Token *parserConsume(Parser *p, TokenKind kind)
     return tok;
 }
 
-static inline Location parserBeginLoc(Parser *p)
+// Source location of the token parserPeek(p, 0) returns
+static inline SourceLoc parserBeginLoc(Parser *p)
+{
+    if (parserLengthLeft(p) <= 0)
+    {
+        return p->loc_base + (SourceLoc)(p->token_count - 1);
+    }
+    return p->loc_base + (SourceLoc)p->pos;
+}
+
+// The lexer reads '>>' as a shift, so the lists of nested templates like
+// 'StructuredBuffer<Pair<float>>' end with a single token for two closing brackets
+static bool parserAtTemplateEnd(Parser *p)
 {
-    return parserPeek(p, 0)->loc;
+    TokenKind kind = parserPeek(p, 0)->kind;
+    return p->split_shift || kind == TOKEN_GREATER || kind == TOKEN_RSHIFT;
 }
 
-static inline void parserEndLoc(Parser *p, Location *loc)
+static bool parserConsumeTemplateEnd(Parser *p)
 {
-    loc->length = (parserPeek(p, 0)->loc.pos + parserPeek(p, 0)->loc.length) - loc->pos;
+    if (p->split_shift)
+    {
+        p->split_shift = false;
+        parserNext(p, 1);
+        return true;
+    }
+
+    if (parserPeek(p, 0)->kind == TOKEN_RSHIFT)
+    {
+        p->split_shift = true;
+        return true;
+    }
+
+    return parserConsume(p, TOKEN_GREATER) != NULL;
 }
 
+static AstExpr *parsePrefixedUnaryExpr(Parser *p);
+
 static AstExpr *parseIdentExpr(Parser *p)
 {
     TsCompiler *compiler = p->compiler;
 
-    Location loc = parserBeginLoc(p);
+    SourceLoc loc = parserBeginLoc(p);
 
     switch (parserPeek(p, 0)->kind)
     {
     case TOKEN_IDENT: {
-        AstExpr *expr = NEW(compiler, AstExpr);
+        AstExpr *expr = ts__newExpr(compiler);
         expr->kind = EXPR_IDENT;
         expr->ident.name = parserNext(p, 1)->str;
 
-        parserEndLoc(p, &loc);
+        void *found = NULL;
+        if (parserPeek(p, 0)->kind == TOKEN_LESS &&
+            ts__hashGet(p->template_names, expr->ident.name, &found))
+        {
+            parserNext(p, 1);
+
+            ArrayOfAstExprId args = {0};
+            while (!parserAtTemplateEnd(p))
+            {
+                AstExpr *arg = parsePrefixedUnaryExpr(p);
+                if (!arg) return NULL;
+
+                arrPush(compiler, &args, arg->id);
+
+                if (!parserAtTemplateEnd(p))
+                {
+                    if (!parserConsume(p, TOKEN_COMMA)) return NULL;
+                }
+            }
+
+            expr->ident.template_args = args.ptr;
+            expr->ident.template_arg_count = (uint32_t)args.len;
+
+            if (!parserConsumeTemplateEnd(p)) return NULL;
+        }
+
         expr->loc = loc;
 
         return expr;
@@ -103,20 +165,17 @@ static AstExpr *parseIdentExpr(Parser *p)
     return NULL;
 }
 
-static AstExpr *parsePrefixedUnaryExpr(Parser *p);
-
 static AstExpr *parsePrimaryExpr(Parser *p)
 {
     TsCompiler *compiler = p->compiler;
 
-    Location loc = parserBeginLoc(p);
+    SourceLoc loc = parserBeginLoc(p);
 
     if (parserLengthLeft(p) == 0)
     {
-        parserEndLoc(p, &loc);
-        ts__addErr(
+        ts__addErrAt(
             p->compiler,
-            &loc,
+            loc,
             "expecting primary expression, reached end of file");
         return NULL;
     }
@@ -139,11 +198,10 @@ static AstExpr *parsePrimaryExpr(Parser *p)
     case TOKEN_FLOAT:
     case TOKEN_VECTOR_TYPE:
     case TOKEN_MATRIX_TYPE: {
-        AstExpr *expr = NEW(compiler, AstExpr);
+        AstExpr *expr = ts__newExpr(compiler);
         expr->kind = EXPR_PRIMARY;
         expr->primary.token = parserNext(p, 1);
 
-        parserEndLoc(p, &loc);
         expr->loc = loc;
 
         return expr;
@@ -159,16 +217,17 @@ static AstExpr *parsePrimaryExpr(Parser *p)
     case TOKEN_CONSTANT_BUFFER: {
         parserNext(p, 1);
 
-        AstExpr *type_expr = NEW(compiler, AstExpr);
-        type_expr->loc = parserPeek(p, 0)->loc;
+        AstExpr *type_expr = ts__newExpr(compiler);
+        type_expr->loc = parserBeginLoc(p);
         type_expr->kind = EXPR_CONSTANT_BUFFER_TYPE;
 
         if (!parserConsume(p, TOKEN_LESS)) return NULL;
 
-        type_expr->buffer.sub_expr = parsePrefixedUnaryExpr(p);
-        if (!type_expr->buffer.sub_expr) return NULL;
+        AstExpr *sub_expr = parsePrefixedUnaryExpr(p);
+        if (!sub_expr) return NULL;
+        type_expr->buffer.sub_expr = sub_expr->id;
 
-        if (!parserConsume(p, TOKEN_GREATER)) return NULL;
+        if (!parserConsumeTemplateEnd(p)) return NULL;
 
         return type_expr;
     }
@@ -176,16 +235,17 @@ static AstExpr *parsePrimaryExpr(Parser *p)
     case TOKEN_STRUCTURED_BUFFER: {
         parserNext(p, 1);
 
-        AstExpr *type_expr = NEW(compiler, AstExpr);
-        type_expr->loc = parserPeek(p, 0)->loc;
+        AstExpr *type_expr = ts__newExpr(compiler);
+        type_expr->loc = parserBeginLoc(p);
         type_expr->kind = EXPR_STRUCTURED_BUFFER_TYPE;
 
         if (!parserConsume(p, TOKEN_LESS)) return NULL;
 
-        type_expr->buffer.sub_expr = parsePrefixedUnaryExpr(p);
-        if (!type_expr->buffer.sub_expr) return NULL;
+        AstExpr *sub_expr = parsePrefixedUnaryExpr(p);
+        if (!sub_expr) return NULL;
+        type_expr->buffer.sub_expr = sub_expr->id;
 
-        if (!parserConsume(p, TOKEN_GREATER)) return NULL;
+        if (!parserConsumeTemplateEnd(p)) return NULL;
 
         return type_expr;
     }
@@ -193,16 +253,17 @@ static AstExpr *parsePrimaryExpr(Parser *p)
     case TOKEN_RW_STRUCTURED_BUFFER: {
         parserNext(p, 1);
 
-        AstExpr *type_expr = NEW(compiler, AstExpr);
-        type_expr->loc = parserPeek(p, 0)->loc;
+        AstExpr *type_expr = ts__newExpr(compiler);
+        type_expr->loc = parserBeginLoc(p);
         type_expr->kind = EXPR_RW_STRUCTURED_BUFFER_TYPE;
 
         if (!parserConsume(p, TOKEN_LESS)) return NULL;
 
-        type_expr->buffer.sub_expr = parsePrefixedUnaryExpr(p);
-        if (!type_expr->buffer.sub_expr) return NULL;
+        AstExpr *sub_expr = parsePrefixedUnaryExpr(p);
+        if (!sub_expr) return NULL;
+        type_expr->buffer.sub_expr = sub_expr->id;
 
-        if (!parserConsume(p, TOKEN_GREATER)) return NULL;
+        if (!parserConsumeTemplateEnd(p)) return NULL;
 
         return type_expr;
     }
@@ -213,8 +274,8 @@ static AstExpr *parsePrimaryExpr(Parser *p)
     case TOKEN_TEXTURE_CUBE: {
         Token *texture_kind_tok = parserNext(p, 1);
 
-        AstExpr *type_expr = NEW(compiler, AstExpr);
-        type_expr->loc = parserPeek(p, 0)->loc;
+        AstExpr *type_expr = ts__newExpr(compiler);
+        type_expr->loc = parserBeginLoc(p);
 
         switch (texture_kind_tok->kind)
         {
@@ -242,14 +303,15 @@ static AstExpr *parsePrimaryExpr(Parser *p)
         {
             if (!parserConsume(p, TOKEN_LESS)) return NULL;
 
-            type_expr->texture.sampled_type_expr = parsePrefixedUnaryExpr(p);
-            if (!type_expr->texture.sampled_type_expr) return NULL;
+            AstExpr *sampled_type_expr = parsePrefixedUnaryExpr(p);
+            if (!sampled_type_expr) return NULL;
+            type_expr->texture.sampled_type_expr = sampled_type_expr->id;
 
-            if (!parserConsume(p, TOKEN_GREATER)) return NULL;
+            if (!parserConsumeTemplateEnd(p)) return NULL;
         }
         else
         {
-            type_expr->texture.sampled_type_expr = NULL;
+            type_expr->texture.sampled_type_expr = 0;
         }
 
         return type_expr;
@@ -257,9 +319,9 @@ static AstExpr *parsePrimaryExpr(Parser *p)
 
     case TOKEN_SAMPLER:
     case TOKEN_SAMPLER_STATE: {
-        AstExpr *type_expr = NEW(compiler, AstExpr);
+        AstExpr *type_expr = ts__newExpr(compiler);
         type_expr->kind = EXPR_SAMPLER_TYPE;
-        type_expr->loc = parserPeek(p, 0)->loc;
+        type_expr->loc = parserBeginLoc(p);
 
         parserNext(p, 1);
 
@@ -283,7 +345,7 @@ static AstExpr *parsePrimaryExpr(Parser *p)
 static AstExpr *parseAccessFuncCall(Parser *p)
 {
     TsCompiler *compiler = p->compiler;
-    Location loc = parserBeginLoc(p);
+    SourceLoc loc = parserBeginLoc(p);
 
     AstExpr *expr = parsePrimaryExpr(p);
     if (!expr) return NULL;
@@ -297,25 +359,26 @@ static AstExpr *parseAccessFuncCall(Parser *p)
             // Function call expression
             parserNext(p, 1);
 
-            AstExpr *func_call = NEW(p->compiler, AstExpr);
+            AstExpr *func_call = ts__newExpr(p->compiler);
             func_call->kind = EXPR_FUNC_CALL;
-            func_call->func_call.func_expr = expr;
+            func_call->func_call.func_expr = expr->id;
 
+            ArrayOfAstExprId params = {0};
             while (!parserIsAtEnd(p) && parserPeek(p, 0)->kind != TOKEN_RPAREN)
             {
                 AstExpr *param = parseExpr(p);
                 if (!param) return NULL;
-                arrPush(p->compiler, &func_call->func_call.params, param);
+                arrPush(p->compiler, &params, param->id);
 
                 if (parserPeek(p, 0)->kind != TOKEN_RPAREN)
                 {
                     if (!parserConsume(p, TOKEN_COMMA)) return NULL;
                 }
             }
+            func_call->func_call.params = AST_LIST(AstExprList, params);
 
             if (!parserConsume(p, TOKEN_RPAREN)) return NULL;
 
-            parserEndLoc(p, &loc);
             func_call->loc = loc;
 
             expr = func_call;
@@ -325,10 +388,11 @@ static AstExpr *parseAccessFuncCall(Parser *p)
             // Access expression
 
             AstExpr *base_expr = expr;
-            expr = NEW(compiler, AstExpr);
+            expr = ts__newExpr(compiler);
             expr->kind = EXPR_ACCESS;
-            expr->access.base = base_expr;
+            expr->access.base = base_expr->id;
 
+            ArrayOfAstExprId chain = {0};
             while (parserPeek(p, 0)->kind == TOKEN_PERIOD)
             {
                 parserNext(p, 1);
@@ -336,10 +400,10 @@ static AstExpr *parseAccessFuncCall(Parser *p)
                 AstExpr *ident = parseIdentExpr(p);
                 if (!ident) return NULL;
 
-                arrPush(p->compiler, &expr->access.chain, ident);
+                arrPush(p->compiler, &chain, ident->id);
             }
+            expr->access.chain = AST_LIST(AstExprList, chain);
 
-            parserEndLoc(p, &loc);
             expr->loc = loc;
         }
         else if (parserPeek(p, 0)->kind == TOKEN_LBRACK)
@@ -351,16 +415,16 @@ static AstExpr *parseAccessFuncCall(Parser *p)
                 parserNext(p, 1);
 
                 AstExpr *left_expr = expr;
-                expr = NEW(compiler, AstExpr);
+                expr = ts__newExpr(compiler);
                 expr->kind = EXPR_SUBSCRIPT;
-                expr->subscript.left = left_expr;
-                expr->subscript.right = parseExpr(p);
-                if (!expr->subscript.right) return NULL;
+                expr->subscript.left = left_expr->id;
+                AstExpr *right = parseExpr(p);
+                if (!right) return NULL;
+                expr->subscript.right = right->id;
 
                 if (!parserConsume(p, TOKEN_RBRACK)) return NULL;
             }
 
-            parserEndLoc(p, &loc);
             expr->loc = loc;
         }
         else
@@ -376,7 +440,7 @@ static AstExpr *parsePostfixedUnaryExpr(Parser *p)
 {
     AstExpr *expr = parseAccessFuncCall(p);
 
-    Location loc = parserBeginLoc(p);
+    SourceLoc loc = parserBeginLoc(p);
 
     while (parserPeek(p, 0)->kind == TOKEN_ADDADD ||
            parserPeek(p, 0)->kind == TOKEN_SUBSUB)
@@ -392,12 +456,11 @@ static AstExpr *parsePostfixedUnaryExpr(Parser *p)
         default: assert(0); break;
         }
 
-        AstExpr *new_expr = NEW(p->compiler, AstExpr);
+        AstExpr *new_expr = ts__newExpr(p->compiler);
         new_expr->kind = EXPR_UNARY;
-        new_expr->unary.right = expr;
+        new_expr->unary.right = expr->id;
         new_expr->unary.op = op;
 
-        parserEndLoc(p, &loc);
         expr->loc = loc;
 
         expr = new_expr;
@@ -408,7 +471,7 @@ static AstExpr *parsePostfixedUnaryExpr(Parser *p)
 
 static AstExpr *parsePrefixedUnaryExpr(Parser *p)
 {
-    Location loc = parserBeginLoc(p);
+    SourceLoc loc = parserBeginLoc(p);
 
     if (parserPeek(p, 0)->kind == TOKEN_SUB || parserPeek(p, 0)->kind == TOKEN_NOT ||
         parserPeek(p, 0)->kind == TOKEN_ADDADD || parserPeek(p, 0)->kind == TOKEN_SUBSUB|| parserPeek(p, 0)->kind == TOKEN_BITNOT)
@@ -429,12 +492,11 @@ static AstExpr *parsePrefixedUnaryExpr(Parser *p)
 
         AstExpr *right = parsePrefixedUnaryExpr(p);
 
-        AstExpr *expr = NEW(p->compiler, AstExpr);
+        AstExpr *expr = ts__newExpr(p->compiler);
         expr->kind = EXPR_UNARY;
-        expr->unary.right = right;
+        expr->unary.right = right ? right->id : 0;
         expr->unary.op = op;
 
-        parserEndLoc(p, &loc);
         expr->loc = loc;
 
         return expr;
@@ -443,439 +505,282 @@ static AstExpr *parsePrefixedUnaryExpr(Parser *p)
     return parsePostfixedUnaryExpr(p);
 }
 
-static AstExpr *parseMuliplication(Parser *p)
+// Binding power of the infix operators, from loosest to tightest.
+// Operators of equal precedence associate to the left, except for assignments
+// and the ternary operator which associate to the right.
+typedef enum ExprPrecedence {
+    PREC_NONE = 0,
+    PREC_ASSIGN,
+    PREC_TERNARY,
+    PREC_LOGICAL_OR,
+    PREC_LOGICAL_AND,
+    PREC_BITOR,
+    PREC_BITXOR,
+    PREC_BITAND,
+    PREC_EQUALITY,
+    PREC_RELATIONAL,
+    PREC_SHIFT,
+    PREC_ADDITIVE,
+    PREC_MULTIPLICATIVE,
+} ExprPrecedence;
+
+static const uint8_t INFIX_PRECEDENCE[TOKEN_MAX] = {
+    [TOKEN_ASSIGN] = PREC_ASSIGN,
+    [TOKEN_ADD_ASSIGN] = PREC_ASSIGN,
+    [TOKEN_SUB_ASSIGN] = PREC_ASSIGN,
+    [TOKEN_MUL_ASSIGN] = PREC_ASSIGN,
+    [TOKEN_DIV_ASSIGN] = PREC_ASSIGN,
+    [TOKEN_MOD_ASSIGN] = PREC_ASSIGN,
+    [TOKEN_BITAND_ASSIGN] = PREC_ASSIGN,
+    [TOKEN_BITOR_ASSIGN] = PREC_ASSIGN,
+    [TOKEN_BITXOR_ASSIGN] = PREC_ASSIGN,
+    [TOKEN_LSHIFT_ASSIGN] = PREC_ASSIGN,
+    [TOKEN_RSHIFT_ASSIGN] = PREC_ASSIGN,
+
+    [TOKEN_QUESTION] = PREC_TERNARY,
+
+    [TOKEN_OR] = PREC_LOGICAL_OR,
+    [TOKEN_AND] = PREC_LOGICAL_AND,
+
+    [TOKEN_BITOR] = PREC_BITOR,
+    [TOKEN_BITXOR] = PREC_BITXOR,
+    [TOKEN_BITAND] = PREC_BITAND,
+
+    [TOKEN_EQUAL] = PREC_EQUALITY,
+    [TOKEN_NOTEQ] = PREC_EQUALITY,
+
+    [TOKEN_LESS] = PREC_RELATIONAL,
+    [TOKEN_LESSEQ] = PREC_RELATIONAL,
+    [TOKEN_GREATER] = PREC_RELATIONAL,
+    [TOKEN_GREATEREQ] = PREC_RELATIONAL,
+
+    [TOKEN_LSHIFT] = PREC_SHIFT,
+    [TOKEN_RSHIFT] = PREC_SHIFT,
+
+    [TOKEN_ADD] = PREC_ADDITIVE,
+    [TOKEN_SUB] = PREC_ADDITIVE,
+
+    [TOKEN_MUL] = PREC_MULTIPLICATIVE,
+    [TOKEN_DIV] = PREC_MULTIPLICATIVE,
+    [TOKEN_MOD] = PREC_MULTIPLICATIVE,
+};
+
+// Binary operation performed by an infix or compound assignment token.
+// Only meaningful for tokens with a precedence in INFIX_PRECEDENCE.
+static const AstBinaryOp INFIX_BINOP[TOKEN_MAX] = {
+    [TOKEN_ADD_ASSIGN] = BINOP_ADD,
+    [TOKEN_SUB_ASSIGN] = BINOP_SUB,
+    [TOKEN_MUL_ASSIGN] = BINOP_MUL,
+    [TOKEN_DIV_ASSIGN] = BINOP_DIV,
+    [TOKEN_MOD_ASSIGN] = BINOP_MOD,
+    [TOKEN_BITAND_ASSIGN] = BINOP_BITAND,
+    [TOKEN_BITOR_ASSIGN] = BINOP_BITOR,
+    [TOKEN_BITXOR_ASSIGN] = BINOP_BITXOR,
+    [TOKEN_LSHIFT_ASSIGN] = BINOP_LSHIFT,
+    [TOKEN_RSHIFT_ASSIGN] = BINOP_RSHIFT,
+
+    [TOKEN_OR] = BINOP_LOGICAL_OR,
+    [TOKEN_AND] = BINOP_LOGICAL_AND,
+
+    [TOKEN_BITOR] = BINOP_BITOR,
+    [TOKEN_BITXOR] = BINOP_BITXOR,
+    [TOKEN_BITAND] = BINOP_BITAND,
+
+    [TOKEN_EQUAL] = BINOP_EQ,
+    [TOKEN_NOTEQ] = BINOP_NOTEQ,
+
+    [TOKEN_LESS] = BINOP_LESS,
+    [TOKEN_LESSEQ] = BINOP_LESSEQ,
+    [TOKEN_GREATER] = BINOP_GREATER,
+    [TOKEN_GREATEREQ] = BINOP_GREATEREQ,
+
+    [TOKEN_LSHIFT] = BINOP_LSHIFT,
+    [TOKEN_RSHIFT] = BINOP_RSHIFT,
+
+    [TOKEN_ADD] = BINOP_ADD,
+    [TOKEN_SUB] = BINOP_SUB,
+
+    [TOKEN_MUL] = BINOP_MUL,
+    [TOKEN_DIV] = BINOP_DIV,
+    [TOKEN_MOD] = BINOP_MOD,
+};
+
+// Precedence climbing (Pratt) parser for the infix operators.
+// Parses a unary expression followed by any infix operators binding at least
+// as tightly as min_prec. Chains of operators at one precedence level are
+// handled by the loop, so only a change in precedence costs a recursive call.
+static AstExpr *parseInfixExpr(Parser *p, uint32_t min_prec)
 {
-    Location loc = parserBeginLoc(p);
+    SourceLoc loc = parserBeginLoc(p);
 
     AstExpr *expr = parsePrefixedUnaryExpr(p);
     if (!expr) return NULL;
 
-    while (!parserIsAtEnd(p) &&
-           (parserPeek(p, 0)->kind == TOKEN_MUL ||
-            parserPeek(p, 0)->kind == TOKEN_DIV ||
-            parserPeek(p, 0)->kind == TOKEN_MOD))
+    while (!parserIsAtEnd(p))
     {
-        Token *op_tok = parserNext(p, 1);
+        TokenKind op_kind = parserPeek(p, 0)->kind;
+        uint32_t prec = INFIX_PRECEDENCE[op_kind];
+        if (prec == PREC_NONE || prec < min_prec) break;
 
-        AstBinaryOp op = {0};
+        parserNext(p, 1);
 
-        switch (op_tok->kind)
+        switch (prec)
         {
-        case TOKEN_MUL: op = BINOP_MUL; break;
-        case TOKEN_DIV: op = BINOP_DIV; break;
-        case TOKEN_MOD: op = BINOP_MOD; break;
-        default: assert(0); break;
-        }
+        case PREC_ASSIGN: {
+            AstExpr *left = expr;
+            AstExpr *right = parseInfixExpr(p, PREC_ASSIGN);
+            if (!right) return NULL;
 
-        AstExpr *left = expr;
-        AstExpr *right = parsePrefixedUnaryExpr(p);
-        if (!right) return NULL;
+            expr = ts__newExpr(p->compiler);
+            expr->kind = EXPR_VAR_ASSIGN;
+            expr->var_assign.assigned_expr = left->id;
 
-        expr = NEW(p->compiler, AstExpr);
-        expr->kind = EXPR_BINARY;
-        expr->binary.left = left;
-        expr->binary.right = right;
-        expr->binary.op = op;
+            expr->loc = loc;
 
-        parserEndLoc(p, &loc);
-        expr->loc = loc;
-    }
+            if (op_kind == TOKEN_ASSIGN)
+            {
+                expr->var_assign.value_expr = right->id;
+            }
+            else
+            {
+                AstExpr *subexpr = ts__newExpr(p->compiler);
+                subexpr->kind = EXPR_BINARY;
+                subexpr->binary.op = INFIX_BINOP[op_kind];
+                subexpr->binary.left = left->id;
+                subexpr->binary.right = right->id;
+                subexpr->loc = loc;
+
+                expr->var_assign.value_expr = subexpr->id;
+            }
+            break;
+        }
 
-    return expr;
-}
+        case PREC_TERNARY: {
+            AstExpr *cond = expr;
 
-static AstExpr *parseAddition(Parser *p)
-{
-    Location loc = parserBeginLoc(p);
+            AstExpr *true_expr = parseInfixExpr(p, PREC_TERNARY);
+            if (!true_expr) return NULL;
 
-    AstExpr *expr = parseMuliplication(p);
-    if (!expr) return NULL;
+            if (!parserConsume(p, TOKEN_COLON)) return NULL;
 
-    while (!parserIsAtEnd(p) &&
-           (parserPeek(p, 0)->kind == TOKEN_ADD || parserPeek(p, 0)->kind == TOKEN_SUB))
-    {
-        Token *op_tok = parserNext(p, 1);
+            AstExpr *false_expr = parseInfixExpr(p, PREC_TERNARY);
+            if (!false_expr) return NULL;
 
-        AstBinaryOp op = {0};
+            expr = ts__newExpr(p->compiler);
+            expr->kind = EXPR_TERNARY;
+            expr->ternary.cond = cond->id;
+            expr->ternary.true_expr = true_expr->id;
+            expr->ternary.false_expr = false_expr->id;
 
-        switch (op_tok->kind)
-        {
-        case TOKEN_ADD: op = BINOP_ADD; break;
-        case TOKEN_SUB: op = BINOP_SUB; break;
-        default: assert(0); break;
+            expr->loc = loc;
+            break;
         }
 
-        AstExpr *left = expr;
-        AstExpr *right = parseMuliplication(p);
-        if (!right) return NULL;
+        default: {
+            AstExpr *left = expr;
+            AstExpr *right = parseInfixExpr(p, prec + 1);
+            if (!right) return NULL;
 
-        expr = NEW(p->compiler, AstExpr);
-        expr->kind = EXPR_BINARY;
-        expr->binary.left = left;
-        expr->binary.right = right;
-        expr->binary.op = op;
+            expr = ts__newExpr(p->compiler);
+            expr->kind = EXPR_BINARY;
+            expr->binary.left = left->id;
+            expr->binary.right = right->id;
+            expr->binary.op = INFIX_BINOP[op_kind];
 
-        parserEndLoc(p, &loc);
-        expr->loc = loc;
+            expr->loc = loc;
+            break;
+        }
+        }
     }
 
     return expr;
 }
 
-static AstExpr *parseBitShift(Parser *p)
+static AstExpr *parseExpr(Parser *p)
 {
-    Location loc = parserBeginLoc(p);
-
-    AstExpr *expr = parseAddition(p);
-    if (!expr) return NULL;
-
-    while (!parserIsAtEnd(p) &&
-           (parserPeek(p, 0)->kind == TOKEN_LSHIFT || parserPeek(p, 0)->kind == TOKEN_RSHIFT))
-    {
-        Token *op_tok = parserNext(p, 1);
-
-        AstBinaryOp op = {0};
-
-        switch (op_tok->kind)
-        {
-        case TOKEN_LSHIFT: op = BINOP_LSHIFT; break;
-        case TOKEN_RSHIFT: op = BINOP_RSHIFT; break;
-        default: assert(0); break;
-        }
-
-        AstExpr *left = expr;
-        AstExpr *right = parseAddition(p);
-        if (!right) return NULL;
-
-        expr = NEW(p->compiler, AstExpr);
-        expr->kind = EXPR_BINARY;
-        expr->binary.left = left;
-        expr->binary.right = right;
-        expr->binary.op = op;
-
-        parserEndLoc(p, &loc);
-        expr->loc = loc;
-    }
-
-    return expr;
+    return parseInfixExpr(p, PREC_ASSIGN);
 }
 
-static AstExpr *parseComparison(Parser *p)
+// Parses the attributes in front of a declaration or a statement, either '[name(...)]'
+// or '[[namespace::name(...)]]', one per pair of brackets
+static bool parseAttributes(Parser *p, AstAttributeList *attributes)
 {
-    Location loc = parserBeginLoc(p);
-
-    AstExpr *expr = parseBitShift(p);
-    if (!expr) return NULL;
+    TsCompiler *compiler = p->compiler;
 
-    while (!parserIsAtEnd(p) && (parserPeek(p, 0)->kind == TOKEN_EQUAL ||
-                                 parserPeek(p, 0)->kind == TOKEN_NOTEQ ||
-                                 parserPeek(p, 0)->kind == TOKEN_LESS ||
-                                 parserPeek(p, 0)->kind == TOKEN_LESSEQ ||
-                                 parserPeek(p, 0)->kind == TOKEN_GREATER ||
-                                 parserPeek(p, 0)->kind == TOKEN_GREATEREQ))
+    ArrayOfAstAttribute attrs = {0};
+    while (parserPeek(p, 0)->kind == TOKEN_LBRACK)
     {
-        Token *op_tok = parserNext(p, 1);
-
-        AstBinaryOp op = {0};
-
-        switch (op_tok->kind)
+        int attr_start = 0;
+        while (attr_start < 2 && parserPeek(p, 0)->kind == TOKEN_LBRACK)
         {
-        case TOKEN_EQUAL: op = BINOP_EQ; break;
-        case TOKEN_NOTEQ: op = BINOP_NOTEQ; break;
-        case TOKEN_LESS: op = BINOP_LESS; break;
-        case TOKEN_LESSEQ: op = BINOP_LESSEQ; break;
-        case TOKEN_GREATER: op = BINOP_GREATER; break;
-        case TOKEN_GREATEREQ: op = BINOP_GREATEREQ; break;
-        default: assert(0); break;
+            parserNext(p, 1);
+            attr_start++;
         }
 
-        AstExpr *left = expr;
-        AstExpr *right = parseBitShift(p);
-        if (!right) return NULL;
-
-        expr = NEW(p->compiler, AstExpr);
-        expr->kind = EXPR_BINARY;
-        expr->binary.left = left;
-        expr->binary.right = right;
-        expr->binary.op = op;
-
-        parserEndLoc(p, &loc);
-        expr->loc = loc;
-    }
-
-    return expr;
-}
-
-static AstExpr *parseBitAnd(Parser *p)
-{
-    Location loc = parserBeginLoc(p);
-
-    AstExpr *expr = parseComparison(p);
-    if (!expr) return NULL;
-
-    while (!parserIsAtEnd(p) && (parserPeek(p, 0)->kind == TOKEN_BITAND))
-    {
-        Token *op_tok = parserNext(p, 1);
+        Token *namespace = NULL;
+        Token *attr_name = NULL;
 
-        AstBinaryOp op = {0};
+        namespace = parserConsume(p, TOKEN_IDENT);
+        if (!namespace) return false;
 
-        switch (op_tok->kind)
+        if (parserPeek(p, 0)->kind == TOKEN_COLON_COLON)
         {
-        case TOKEN_BITAND: op = BINOP_BITAND; break;
-        default: assert(0); break;
+            parserNext(p, 1);
+            attr_name = parserConsume(p, TOKEN_IDENT);
+            if (!attr_name) return false;
         }
-
-        AstExpr *left = expr;
-        AstExpr *right = parseComparison(p);
-        if (!right) return NULL;
-
-        expr = NEW(p->compiler, AstExpr);
-        expr->kind = EXPR_BINARY;
-        expr->binary.left = left;
-        expr->binary.right = right;
-        expr->binary.op = op;
-
-        parserEndLoc(p, &loc);
-        expr->loc = loc;
-    }
-
-    return expr;
-}
-
-static AstExpr *parseBitXor(Parser *p)
-{
-    Location loc = parserBeginLoc(p);
-
-    AstExpr *expr = parseBitAnd(p);
-    if (!expr) return NULL;
-
-    while (!parserIsAtEnd(p) && (parserPeek(p, 0)->kind == TOKEN_BITXOR))
-    {
-        Token *op_tok = parserNext(p, 1);
-
-        AstBinaryOp op = {0};
-
-        switch (op_tok->kind)
+        else
         {
-        case TOKEN_BITXOR: op = BINOP_BITXOR; break;
-        default: assert(0); break;
+            attr_name = namespace;
+            namespace = NULL;
         }
 
-        AstExpr *left = expr;
-        AstExpr *right = parseBitAnd(p);
-        if (!right) return NULL;
-
-        expr = NEW(p->compiler, AstExpr);
-        expr->kind = EXPR_BINARY;
-        expr->binary.left = left;
-        expr->binary.right = right;
-        expr->binary.op = op;
-
-        parserEndLoc(p, &loc);
-        expr->loc = loc;
-    }
-
-    return expr;
-}
-
-static AstExpr *parseBitOr(Parser *p)
-{
-    Location loc = parserBeginLoc(p);
-
-    AstExpr *expr = parseBitXor(p);
-    if (!expr) return NULL;
-
-    while (!parserIsAtEnd(p) && (parserPeek(p, 0)->kind == TOKEN_BITOR))
-    {
-        Token *op_tok = parserNext(p, 1);
-
-        AstBinaryOp op = {0};
+        assert(attr_name);
 
-        switch (op_tok->kind)
+        ts__sbReset(&compiler->sb);
+        if (namespace)
         {
-        case TOKEN_BITOR: op = BINOP_BITOR; break;
-        default: assert(0); break;
+            ts__sbAppend(&compiler->sb, namespace->str);
+            ts__sbAppend(&compiler->sb, "::");
         }
 
-        AstExpr *left = expr;
-        AstExpr *right = parseBitXor(p);
-        if (!right) return NULL;
-
-        expr = NEW(p->compiler, AstExpr);
-        expr->kind = EXPR_BINARY;
-        expr->binary.left = left;
-        expr->binary.right = right;
-        expr->binary.op = op;
-
-        parserEndLoc(p, &loc);
-        expr->loc = loc;
-    }
-
-    return expr;
-}
-
-static AstExpr *parseLogicalAnd(Parser *p)
-{
-    Location loc = parserBeginLoc(p);
-
-    AstExpr *expr = parseBitOr(p);
-    if (!expr) return NULL;
-
-    while (!parserIsAtEnd(p) && (parserPeek(p, 0)->kind == TOKEN_AND))
-    {
-        parserNext(p, 1);
-
-        AstExpr *left = expr;
-        AstExpr *right = parseBitOr(p);
-        if (!right) return NULL;
-
-        expr = NEW(p->compiler, AstExpr);
-        expr->kind = EXPR_BINARY;
-        expr->binary.left = left;
-        expr->binary.right = right;
-        expr->binary.op = BINOP_LOGICAL_AND;
-
-        parserEndLoc(p, &loc);
-        expr->loc = loc;
-    }
-
-    return expr;
-}
-
-static AstExpr *parseLogicalOr(Parser *p)
-{
-    Location loc = parserBeginLoc(p);
-
-    AstExpr *expr = parseLogicalAnd(p);
-    if (!expr) return NULL;
-
-    while (!parserIsAtEnd(p) && (parserPeek(p, 0)->kind == TOKEN_OR))
-    {
-        parserNext(p, 1);
-
-        AstExpr *left = expr;
-        AstExpr *right = parseLogicalAnd(p);
-        if (!right) return NULL;
-
-        expr = NEW(p->compiler, AstExpr);
-        expr->kind = EXPR_BINARY;
-        expr->binary.left = left;
-        expr->binary.right = right;
-        expr->binary.op = BINOP_LOGICAL_OR;
-
-        parserEndLoc(p, &loc);
-        expr->loc = loc;
-    }
-
-    return expr;
-}
-
-static AstExpr *parseTernaryExpr(Parser *p)
-{
-    Location loc = parserBeginLoc(p);
-
-    AstExpr *expr = parseLogicalOr(p);
-    if (!expr) return NULL;
-
-    while (!parserIsAtEnd(p) && (parserPeek(p, 0)->kind == TOKEN_QUESTION))
-    {
-        parserNext(p, 1);
-
-        AstExpr *cond = expr;
-
-        AstExpr *true_expr  = parseTernaryExpr(p);
-        if (!true_expr) return NULL;
-
-        if (!parserConsume(p, TOKEN_COLON)) return NULL;
-
-        AstExpr *false_expr = parseTernaryExpr(p);
-        if (!false_expr) return NULL;
-
-        expr = NEW(p->compiler, AstExpr);
-        expr->kind = EXPR_TERNARY;
-        expr->ternary.cond = cond;
-        expr->ternary.true_expr = true_expr;
-        expr->ternary.false_expr = false_expr;
-
-        parserEndLoc(p, &loc);
-        expr->loc = loc;
-    }
-
-    return expr;
-}
-
-static AstExpr *parseAssignExpr(Parser *p)
-{
-    Location loc = parserBeginLoc(p);
-
-    AstExpr *expr = parseTernaryExpr(p);
-    if (!expr) return NULL;
-
-    while (!parserIsAtEnd(p) && (
-               parserPeek(p, 0)->kind == TOKEN_ASSIGN
-               || parserPeek(p, 0)->kind == TOKEN_ADD_ASSIGN
-               || parserPeek(p, 0)->kind == TOKEN_SUB_ASSIGN
-               || parserPeek(p, 0)->kind == TOKEN_MUL_ASSIGN
-               || parserPeek(p, 0)->kind == TOKEN_DIV_ASSIGN
-               || parserPeek(p, 0)->kind == TOKEN_MOD_ASSIGN
-               || parserPeek(p, 0)->kind == TOKEN_BITAND_ASSIGN
-               || parserPeek(p, 0)->kind == TOKEN_BITOR_ASSIGN
-               || parserPeek(p, 0)->kind == TOKEN_BITXOR_ASSIGN))
-    {
-        TokenKind op_kind = parserPeek(p, 0)->kind;
-        parserNext(p, 1);
-
-        AstExpr *left = expr;
-        AstExpr *right = parseTernaryExpr(p);
-        if (!right) return NULL;
+        ts__sbAppend(&compiler->sb, attr_name->str);
 
-        expr = NEW(p->compiler, AstExpr);
-        expr->kind = EXPR_VAR_ASSIGN;
-        expr->var_assign.assigned_expr = left;
+        AstAttribute attr = {0};
+        attr.name = ts__sbBuild(&compiler->sb, &compiler->alloc);
 
-        if (op_kind == TOKEN_ASSIGN)
+        if (parserPeek(p, 0)->kind == TOKEN_LPAREN)
         {
-            expr->var_assign.value_expr = right;
+            parserNext(p, 1);
 
-            parserEndLoc(p, &loc);
-            expr->loc = loc;
-        }
-        else
-        {
-            AstBinaryOp binop;
-            switch (op_kind)
+            ArrayOfAstExprId values = {0};
+            while (parserPeek(p, 0)->kind != TOKEN_RPAREN)
             {
-            case TOKEN_ADD_ASSIGN: binop = BINOP_ADD; break;
-            case TOKEN_SUB_ASSIGN: binop = BINOP_SUB; break;
-            case TOKEN_MUL_ASSIGN: binop = BINOP_MUL; break;
-            case TOKEN_DIV_ASSIGN: binop = BINOP_DIV; break;
-            case TOKEN_MOD_ASSIGN: binop = BINOP_MOD; break;
-            case TOKEN_BITAND_ASSIGN: binop = BINOP_BITAND; break;
-            case TOKEN_BITOR_ASSIGN: binop = BINOP_BITOR; break;
-            case TOKEN_BITXOR_ASSIGN: binop = BINOP_BITXOR; break;
-            default: assert(0); break;
+                AstExpr *value = parseExpr(p);
+                if (!value) return false;
+
+                arrPush(p->compiler, &values, value->id);
+
+                if (parserPeek(p, 0)->kind != TOKEN_RPAREN)
+                {
+                    if (!parserConsume(p, TOKEN_COMMA)) return false;
+                }
             }
+            attr.values = AST_LIST(AstExprList, values);
 
-            AstExpr *subexpr = NEW(p->compiler, AstExpr);
-            subexpr->kind = EXPR_BINARY;
-            subexpr->binary.op = binop;
-            subexpr->binary.left = left;
-            subexpr->binary.right = right;
+            if (!parserConsume(p, TOKEN_RPAREN)) return false;
+        }
 
-            expr->var_assign.value_expr = subexpr;
+        arrPush(p->compiler, &attrs, attr);
 
-            parserEndLoc(p, &loc);
-            expr->loc = loc;
-            subexpr->loc = loc;
+        for (int i = 0; i < attr_start; ++i)
+        {
+            if (!parserConsume(p, TOKEN_RBRACK)) return false;
         }
     }
 
-    return expr;
-}
-
-static AstExpr *parseExpr(Parser *p)
-{
-    return parseAssignExpr(p);
+    *attributes = AST_LIST(AstAttributeList, attrs);
+    return true;
 }
 
 static AstStmt *parseStmt(Parser *p)
@@ -889,12 +794,24 @@ static AstStmt *parseStmt(Parser *p)
         return NULL;
     }
 
+    case TOKEN_LBRACK: {
+        // Attributes of loops and if statements, such as [unroll] or [branch]
+        AstAttributeList attributes = {0};
+        if (!parseAttributes(p, &attributes)) return NULL;
+
+        AstStmt *stmt = parseStmt(p);
+        if (!stmt) return NULL;
+
+        stmt->attributes = attributes;
+        return stmt;
+    }
+
     case TOKEN_RETURN: {
-        Location stmt_loc = parserBeginLoc(p);
+        SourceLoc stmt_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
 
-        AstStmt *stmt = NEW(compiler, AstStmt);
+        AstStmt *stmt = ts__newStmt(compiler);
         stmt->kind = STMT_RETURN;
 
         if (parserPeek(p, 0)->kind != TOKEN_SEMICOLON)
@@ -902,221 +819,260 @@ static AstStmt *parseStmt(Parser *p)
             AstExpr *return_expr = parseExpr(p);
             if (!return_expr) return NULL;
 
-            stmt->return_.value = return_expr;
+            stmt->return_.value = return_expr->id;
         }
 
         if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-        parserEndLoc(p, &stmt_loc);
         stmt->loc = stmt_loc;
 
         return stmt;
     }
 
     case TOKEN_DISCARD: {
-        Location stmt_loc = parserBeginLoc(p);
+        SourceLoc stmt_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
 
-        AstStmt *stmt = NEW(compiler, AstStmt);
+        AstStmt *stmt = ts__newStmt(compiler);
         stmt->kind = STMT_DISCARD;
 
         if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-        parserEndLoc(p, &stmt_loc);
         stmt->loc = stmt_loc;
 
         return stmt;
     }
 
     case TOKEN_CONTINUE: {
-        Location stmt_loc = parserBeginLoc(p);
+        SourceLoc stmt_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
 
-        AstStmt *stmt = NEW(compiler, AstStmt);
+        AstStmt *stmt = ts__newStmt(compiler);
         stmt->kind = STMT_CONTINUE;
 
         if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-        parserEndLoc(p, &stmt_loc);
         stmt->loc = stmt_loc;
 
         return stmt;
     }
 
     case TOKEN_BREAK: {
-        Location stmt_loc = parserBeginLoc(p);
+        SourceLoc stmt_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
 
-        AstStmt *stmt = NEW(compiler, AstStmt);
+        AstStmt *stmt = ts__newStmt(compiler);
         stmt->kind = STMT_BREAK;
 
         if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-        parserEndLoc(p, &stmt_loc);
         stmt->loc = stmt_loc;
 
         return stmt;
     }
 
     case TOKEN_IF: {
-        Location stmt_loc = parserBeginLoc(p);
+        SourceLoc stmt_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
-        AstStmt *stmt = NEW(compiler, AstStmt);
+        AstStmt *stmt = ts__newStmt(compiler);
         stmt->kind = STMT_IF;
 
         if (!parserConsume(p, TOKEN_LPAREN)) return NULL;
 
-        stmt->if_.cond = parseExpr(p);
-        if (!stmt->if_.cond) return NULL;
+        AstExpr *cond = parseExpr(p);
+        if (!cond) return NULL;
+        stmt->if_.cond = cond->id;
 
         if (!parserConsume(p, TOKEN_RPAREN)) return NULL;
 
-        stmt->if_.if_stmt = parseStmt(p);
-        if (!stmt->if_.if_stmt) return NULL;
+        AstStmt *if_stmt = parseStmt(p);
+        if (!if_stmt) return NULL;
+        stmt->if_.if_stmt = if_stmt->id;
 
         if (parserPeek(p, 0)->kind == TOKEN_ELSE)
         {
             parserNext(p, 1);
 
-            stmt->if_.else_stmt = parseStmt(p);
-            if (!stmt->if_.else_stmt) return NULL;
+            AstStmt *else_stmt = parseStmt(p);
+            if (!else_stmt) return NULL;
+            stmt->if_.else_stmt = else_stmt->id;
         }
 
-        parserEndLoc(p, &stmt_loc);
         stmt->loc = stmt_loc;
 
         return stmt;
     }
 
     case TOKEN_WHILE: {
-        Location stmt_loc = parserBeginLoc(p);
+        SourceLoc stmt_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
-        AstStmt *stmt = NEW(compiler, AstStmt);
+        AstStmt *stmt = ts__newStmt(compiler);
         stmt->kind = STMT_WHILE;
 
         if (!parserConsume(p, TOKEN_LPAREN)) return NULL;
 
-        stmt->while_.cond = parseExpr(p);
-        if (!stmt->while_.cond) return NULL;
+        AstExpr *cond = parseExpr(p);
+        if (!cond) return NULL;
+        stmt->while_.cond = cond->id;
 
         if (!parserConsume(p, TOKEN_RPAREN)) return NULL;
 
-        stmt->while_.stmt = parseStmt(p);
-        if (!stmt->while_.stmt) return NULL;
+        AstStmt *body = parseStmt(p);
+        if (!body) return NULL;
+        stmt->while_.stmt = body->id;
 
-        parserEndLoc(p, &stmt_loc);
         stmt->loc = stmt_loc;
 
         return stmt;
     }
 
     case TOKEN_DO: {
-        Location stmt_loc = parserBeginLoc(p);
+        SourceLoc stmt_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
-        AstStmt *stmt = NEW(compiler, AstStmt);
+        AstStmt *stmt = ts__newStmt(compiler);
         stmt->kind = STMT_DO_WHILE;
 
-        stmt->do_while.stmt = parseStmt(p);
-        if (!stmt->do_while.stmt) return NULL;
+        AstStmt *body = parseStmt(p);
+        if (!body) return NULL;
+        stmt->do_while.stmt = body->id;
 
         if (!parserConsume(p, TOKEN_WHILE)) return NULL;
 
         if (!parserConsume(p, TOKEN_LPAREN)) return NULL;
 
-        stmt->do_while.cond = parseExpr(p);
-        if (!stmt->do_while.cond) return NULL;
+        AstExpr *cond = parseExpr(p);
+        if (!cond) return NULL;
+        stmt->do_while.cond = cond->id;
 
         if (!parserConsume(p, TOKEN_RPAREN)) return NULL;
 
         if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-        parserEndLoc(p, &stmt_loc);
         stmt->loc = stmt_loc;
 
         return stmt;
     }
 
     case TOKEN_FOR: {
-        Location stmt_loc = parserBeginLoc(p);
+        SourceLoc stmt_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
-        AstStmt *stmt = NEW(compiler, AstStmt);
+        AstStmt *stmt = ts__newStmt(compiler);
         stmt->kind = STMT_FOR;
 
         if (!parserConsume(p, TOKEN_LPAREN)) return NULL;
 
-        stmt->for_.init = NULL;
+        stmt->for_.init = 0;
         if (parserPeek(p, 0)->kind != TOKEN_SEMICOLON)
         {
-            stmt->for_.init = parseStmt(p);
-            if (!stmt->for_.init) return NULL;
+            AstStmt *init = parseStmt(p);
+            if (!init) return NULL;
+            stmt->for_.init = init->id;
         }
         else
         {
             parserNext(p, 1);
         }
 
-        stmt->for_.cond = NULL;
+        stmt->for_.cond = 0;
         if (parserPeek(p, 0)->kind != TOKEN_SEMICOLON)
         {
-            stmt->for_.cond = parseExpr(p);
-            if (!stmt->for_.cond) return NULL;
+            AstExpr *cond = parseExpr(p);
+            if (!cond) return NULL;
+            stmt->for_.cond = cond->id;
         }
 
         if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-        stmt->for_.inc = NULL;
+        stmt->for_.inc = 0;
         if (parserPeek(p, 0)->kind != TOKEN_RPAREN)
         {
-            stmt->for_.inc = parseExpr(p);
-            if (!stmt->for_.inc) return NULL;
+            AstExpr *inc = parseExpr(p);
+            if (!inc) return NULL;
+            stmt->for_.inc = inc->id;
         }
 
         if (!parserConsume(p, TOKEN_RPAREN)) return NULL;
 
-        stmt->for_.stmt = parseStmt(p);
-        if (!stmt->for_.stmt) return NULL;
+        AstStmt *body = parseStmt(p);
+        if (!body) return NULL;
+        stmt->for_.stmt = body->id;
 
-        parserEndLoc(p, &stmt_loc);
         stmt->loc = stmt_loc;
 
         return stmt;
     }
 
     case TOKEN_LCURLY: {
-        Location stmt_loc = parserBeginLoc(p);
+        SourceLoc stmt_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
 
-        AstStmt *stmt = NEW(compiler, AstStmt);
+        AstStmt *stmt = ts__newStmt(compiler);
         stmt->kind = STMT_BLOCK;
 
+        ArrayOfAstStmtId stmts = {0};
         while (parserPeek(p, 0)->kind != TOKEN_RCURLY)
         {
             AstStmt *sub_stmt = parseStmt(p);
             if (sub_stmt)
             {
-                arrPush(p->compiler, &stmt->block.stmts, sub_stmt);
+                arrPush(p->compiler, &stmts, sub_stmt->id);
             }
         }
+        stmt->block.stmts = AST_LIST(AstStmtList, stmts);
 
         if (!parserConsume(p, TOKEN_RCURLY)) return NULL;
 
-        parserEndLoc(p, &stmt_loc);
         stmt->loc = stmt_loc;
 
         return stmt;
     }
 
-    case TOKEN_CONST:
-    {
-        Location stmt_loc = parserBeginLoc(p);
+    case TOKEN_STATIC: {
+        SourceLoc stmt_loc = parserBeginLoc(p);
+
+        parserNext(p, 1);
+        if (!parserConsume(p, TOKEN_CONST)) return NULL;
+
+        AstDecl *decl = ts__newDecl(compiler);
+        decl->kind = DECL_CONST;
+
+        AstExpr *type_expr = parsePrefixedUnaryExpr(p);
+        if (!type_expr) return NULL;
+        decl->constant.type_expr = type_expr->id;
+
+        Token *name_tok = parserConsume(p, TOKEN_IDENT);
+        if (!name_tok) return NULL;
+        decl->name = name_tok->str;
+
+        if (!parserConsume(p, TOKEN_ASSIGN)) return NULL;
+
+        AstExpr *value_expr = parseExpr(p);
+        if (!value_expr) return NULL;
+        decl->constant.value_expr = value_expr->id;
+
+        AstStmt *stmt = ts__newStmt(compiler);
+        stmt->kind = STMT_DECL;
+        stmt->decl = decl->id;
+
+        if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
+
+        stmt->loc = stmt_loc;
+        decl->loc = stmt_loc;
+
+        return stmt;
+    }
+
+    case TOKEN_CONST:
+    {
+        SourceLoc stmt_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
 
@@ -1127,10 +1083,10 @@ static AstStmt *parseStmt(Parser *p)
         Token *name_tok = parserConsume(p, TOKEN_IDENT);
         if (!name_tok) return NULL;
 
-        AstDecl *decl = NEW(compiler, AstDecl);
+        AstDecl *decl = ts__newDecl(compiler);
         decl->kind = DECL_VAR;
         decl->name = name_tok->str;
-        decl->var.type_expr = type_expr;
+        decl->var.type_expr = type_expr->id;
         decl->var.immutable = true;
 
         if (parserPeek(p, 0)->kind == TOKEN_ASSIGN)
@@ -1140,16 +1096,15 @@ static AstStmt *parseStmt(Parser *p)
             AstExpr *value_expr = parseExpr(p);
             if (!value_expr) return NULL;
 
-            decl->var.value_expr = value_expr;
+            decl->var.value_expr = value_expr->id;
         }
 
-        AstStmt *stmt = NEW(compiler, AstStmt);
+        AstStmt *stmt = ts__newStmt(compiler);
         stmt->kind = STMT_DECL;
-        stmt->decl = decl;
+        stmt->decl = decl->id;
 
         if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-        parserEndLoc(p, &stmt_loc);
         stmt->loc = stmt_loc;
         decl->loc = stmt_loc;
 
@@ -1157,7 +1112,7 @@ static AstStmt *parseStmt(Parser *p)
     }
 
     default: {
-        Location stmt_loc = parserBeginLoc(p);
+        SourceLoc stmt_loc = parserBeginLoc(p);
 
         AstExpr *expr = parseExpr(p);
         if (!expr) return NULL;
@@ -1166,11 +1121,10 @@ static AstStmt *parseStmt(Parser *p)
         {
             // Expression statement
             parserNext(p, 1);
-            AstStmt *stmt = NEW(compiler, AstStmt);
+            AstStmt *stmt = ts__newStmt(compiler);
             stmt->kind = STMT_EXPR;
-            stmt->expr = expr;
+            stmt->expr = expr->id;
 
-            parserEndLoc(p, &stmt_loc);
             stmt->loc = stmt_loc;
 
             return stmt;
@@ -1180,10 +1134,10 @@ static AstStmt *parseStmt(Parser *p)
             // Variable declaration
             Token *name_tok = parserNext(p, 1);
 
-            AstDecl *decl = NEW(compiler, AstDecl);
+            AstDecl *decl = ts__newDecl(compiler);
             decl->kind = DECL_VAR;
             decl->name = name_tok->str;
-            decl->var.type_expr = expr;
+            decl->var.type_expr = expr->id;
 
             if (parserPeek(p, 0)->kind == TOKEN_ASSIGN)
             {
@@ -1192,16 +1146,15 @@ static AstStmt *parseStmt(Parser *p)
                 AstExpr *value_expr = parseExpr(p);
                 if (!value_expr) return NULL;
 
-                decl->var.value_expr = value_expr;
+                decl->var.value_expr = value_expr->id;
             }
 
-            AstStmt *stmt = NEW(compiler, AstStmt);
+            AstStmt *stmt = ts__newStmt(compiler);
             stmt->kind = STMT_DECL;
-            stmt->decl = decl;
+            stmt->decl = decl->id;
 
             if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-            parserEndLoc(p, &stmt_loc);
             decl->loc = stmt_loc;
             stmt->loc = stmt_loc;
 
@@ -1223,88 +1176,178 @@ static AstStmt *parseStmt(Parser *p)
     return NULL;
 }
 
-static AstDecl *parseTopLevel(Parser *p)
+static bool parseDecimal(const char *str, uint32_t *value)
 {
-    assert(p);
-    TsCompiler *compiler = p->compiler;
-
-    ArrayOfAstAttribute attributes = {0};
+    if (*str == '\0') return false;
 
-    int attr_start = 0;
-    if (parserPeek(p, 0)->kind == TOKEN_LBRACK)
+    uint64_t result = 0;
+    for (; *str; ++str)
     {
-        parserNext(p, 1);
-        attr_start++;
+        if (!isNumeric(*str)) return false;
+        result = result * 10 + (uint64_t)(*str - '0');
+        if (result > UINT32_MAX) return false;
     }
 
-    if (parserPeek(p, 0)->kind == TOKEN_LBRACK)
+    *value = (uint32_t)result;
+    return true;
+}
+
+// Parses 'register(b0, space1)' after the colon. The register number becomes the
+// binding and the space the descriptor set, the register class is not checked against
+// the type of the resource.
+static bool parseRegister(
+    Parser *p, TsRegisterClass *register_class, uint32_t *binding, uint32_t *space)
+{
+    if (!parserConsume(p, TOKEN_REGISTER)) return false;
+    if (!parserConsume(p, TOKEN_LPAREN)) return false;
+
+    Token *slot_tok = parserConsume(p, TOKEN_IDENT);
+    if (!slot_tok) return false;
+
+    // In the order of TsRegisterClass
+    static const char classes[] = "btus";
+    const char *found = strchr(classes, tolower((unsigned char)slot_tok->str[0]));
+    if (!slot_tok->str[0] || !found || !parseDecimal(slot_tok->str + 1, binding))
     {
-        parserNext(p, 1);
-        attr_start++;
+        ts__addErr(p->compiler, &slot_tok->loc, "invalid register: '%s'", slot_tok->str);
+        return false;
     }
+    *register_class = (TsRegisterClass)(found - classes);
 
-    if (attr_start > 0)
+    *space = 0;
+    if (parserPeek(p, 0)->kind == TOKEN_COMMA)
     {
-        Token *namespace = NULL;
-        Token *attr_name = NULL;
+        parserNext(p, 1);
 
-        namespace = parserConsume(p, TOKEN_IDENT);
-        if (!namespace) return NULL;
+        Token *space_tok = parserConsume(p, TOKEN_IDENT);
+        if (!space_tok) return false;
 
-        if (parserPeek(p, 0)->kind == TOKEN_COLON_COLON)
-        {
-            parserNext(p, 1);
-            attr_name = parserConsume(p, TOKEN_IDENT);
-            if (!attr_name) return NULL;
-        }
-        else
+        if (strncmp(space_tok->str, "space", 5) != 0 ||
+            !parseDecimal(space_tok->str + 5, space))
         {
-            attr_name = namespace;
-            namespace = NULL;
+            ts__addErr(
+                p->compiler, &space_tok->loc, "invalid register space: '%s'", space_tok->str);
+            return false;
         }
+    }
 
-        assert(attr_name);
+    return parserConsume(p, TOKEN_RPAREN) != NULL;
+}
 
-        ts__sbReset(&compiler->sb);
-        if (namespace)
+// Parses '(c1.y)' after packoffset into a byte offset, constant registers are four
+// 32-bit components wide
+static bool parsePackOffset(Parser *p, uint32_t *offset)
+{
+    if (!parserConsume(p, TOKEN_LPAREN)) return false;
+
+    Token *reg_tok = parserConsume(p, TOKEN_IDENT);
+    if (!reg_tok) return false;
+
+    uint32_t reg;
+    if ((reg_tok->str[0] != 'c' && reg_tok->str[0] != 'C') ||
+        !parseDecimal(reg_tok->str + 1, &reg) || reg >= UINT32_MAX / 16)
+    {
+        ts__addErr(p->compiler, &reg_tok->loc, "invalid packoffset: '%s'", reg_tok->str);
+        return false;
+    }
+    *offset = reg * 16;
+
+    if (parserPeek(p, 0)->kind == TOKEN_PERIOD)
+    {
+        parserNext(p, 1);
+
+        Token *comp_tok = parserConsume(p, TOKEN_IDENT);
+        if (!comp_tok) return false;
+
+        const char *comp = NULL;
+        if (strlen(comp_tok->str) == 1) comp = strchr("xyzw", comp_tok->str[0]);
+        if (!comp)
         {
-            ts__sbAppend(&compiler->sb, namespace->str);
-            ts__sbAppend(&compiler->sb, "::");
+            ts__addErr(
+                p->compiler,
+                &comp_tok->loc,
+                "invalid packoffset component: '%s'",
+                comp_tok->str);
+            return false;
         }
+        *offset += 4 * (uint32_t)(comp - "xyzw");
+    }
 
-        ts__sbAppend(&compiler->sb, attr_name->str);
+    return parserConsume(p, TOKEN_RPAREN) != NULL;
+}
 
-        AstAttribute attr = {0};
-        attr.name = ts__sbBuild(&compiler->sb, &compiler->alloc);
+// 'template <typename T, typename U>', only type parameters are supported
+static bool parseTemplateParams(Parser *p, ArrayOfAstDeclId *params)
+{
+    TsCompiler *compiler = p->compiler;
 
-        if (parserPeek(p, 0)->kind == TOKEN_LPAREN)
-        {
-            parserNext(p, 1);
+    SourceLoc loc = parserBeginLoc(p);
 
-            while (parserPeek(p, 0)->kind != TOKEN_RPAREN)
-            {
-                AstExpr *value = parseExpr(p);
-                if (!value) return NULL;
+    if (!parserConsume(p, TOKEN_TEMPLATE)) return false;
+    if (!parserConsume(p, TOKEN_LESS)) return false;
 
-                arrPush(p->compiler, &attr.values, value);
+    while (parserPeek(p, 0)->kind != TOKEN_GREATER)
+    {
+        SourceLoc param_loc = parserBeginLoc(p);
 
-                if (parserPeek(p, 0)->kind != TOKEN_RPAREN)
-                {
-                    if (!parserConsume(p, TOKEN_COMMA)) return NULL;
-                }
-            }
+        if (!parserConsume(p, TOKEN_TYPENAME)) return false;
 
-            if (!parserConsume(p, TOKEN_RPAREN)) return NULL;
+        Token *name_tok = parserConsume(p, TOKEN_IDENT);
+        if (!name_tok) return false;
+
+        AstDecl *param = ts__newDecl(compiler);
+        param->kind = DECL_TYPE_PARAM;
+        param->name = name_tok->str;
+        param->loc = param_loc;
+
+        arrPush(compiler, params, param->id);
+
+        if (parserPeek(p, 0)->kind != TOKEN_GREATER)
+        {
+            if (!parserConsume(p, TOKEN_COMMA)) return false;
         }
+    }
 
-        arrPush(p->compiler, &attributes, attr);
+    if (!parserConsume(p, TOKEN_GREATER)) return false;
 
-        for (int i = 0; i < attr_start; ++i)
+    if (params->len == 0)
+    {
+        ts__addErrAt(compiler, loc, "a template needs at least one parameter");
+        return false;
+    }
+
+    return true;
+}
+
+static AstDecl *parseTopLevel(Parser *p)
+{
+    assert(p);
+    TsCompiler *compiler = p->compiler;
+
+    if (parserPeek(p, 0)->kind == TOKEN_TEMPLATE)
+    {
+        SourceLoc template_loc = parserBeginLoc(p);
+
+        ArrayOfAstDeclId template_params = {0};
+        if (!parseTemplateParams(p, &template_params)) return NULL;
+
+        AstDecl *decl = parseTopLevel(p);
+        if (!decl) return NULL;
+
+        if (decl->kind != DECL_FUNC && decl->kind != DECL_STRUCT)
         {
-            if (!parserConsume(p, TOKEN_RBRACK)) return NULL;
+            ts__addErrAt(
+                compiler, template_loc, "only functions and structs can be templates");
+            return NULL;
         }
+
+        decl->template_params = AST_LIST(AstDeclList, template_params);
+        return decl;
     }
 
+    AstAttributeList attributes = {0};
+    if (!parseAttributes(p, &attributes)) return NULL;
+
     switch (parserPeek(p, 0)->kind)
     {
     case TOKEN_SEMICOLON: {
@@ -1312,11 +1355,15 @@ static AstDecl *parseTopLevel(Parser *p)
         return NULL;
     }
 
+    case TOKEN_STATIC:
     case TOKEN_CONST: {
-        Location decl_loc = parserBeginLoc(p);
+        SourceLoc decl_loc = parserBeginLoc(p);
 
-        parserNext(p, 1);
-        AstDecl *decl = NEW(compiler, AstDecl);
+        // 'static const' and 'const' both declare a compile-time constant
+        if (parserPeek(p, 0)->kind == TOKEN_STATIC) parserNext(p, 1);
+        if (!parserConsume(p, TOKEN_CONST)) return NULL;
+
+        AstDecl *decl = ts__newDecl(compiler);
         decl->kind = DECL_CONST;
         decl->attributes = attributes;
 
@@ -1327,17 +1374,16 @@ static AstDecl *parseTopLevel(Parser *p)
         if (!name_tok) return NULL;
 
         decl->name = name_tok->str;
-        decl->constant.type_expr = type_expr;
+        decl->constant.type_expr = type_expr->id;
 
         if (!parserConsume(p, TOKEN_ASSIGN)) return NULL;
 
         AstExpr *value_expr = parseExpr(p);
         if (!value_expr) return NULL;
-        decl->constant.value_expr = value_expr;
+        decl->constant.value_expr = value_expr->id;
 
         if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-        parserEndLoc(p, &decl_loc);
         decl->loc = decl_loc;
 
         arrPush(p->compiler, &p->decls, decl);
@@ -1345,10 +1391,10 @@ static AstDecl *parseTopLevel(Parser *p)
     }
 
     case TOKEN_GROUPSHARED: {
-        Location decl_loc = parserBeginLoc(p);
+        SourceLoc decl_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
-        AstDecl *decl = NEW(compiler, AstDecl);
+        AstDecl *decl = ts__newDecl(compiler);
         decl->kind = DECL_VAR;
         decl->attributes = attributes;
         decl->var.kind = VAR_GROUPSHARED;
@@ -1360,11 +1406,10 @@ static AstDecl *parseTopLevel(Parser *p)
         if (!name_tok) return NULL;
 
         decl->name = name_tok->str;
-        decl->var.type_expr = type_expr;
+        decl->var.type_expr = type_expr->id;
 
         if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-        parserEndLoc(p, &decl_loc);
         decl->loc = decl_loc;
 
         arrPush(p->compiler, &p->decls, decl);
@@ -1372,10 +1417,10 @@ static AstDecl *parseTopLevel(Parser *p)
     }
 
     case TOKEN_UNIFORM: {
-        Location decl_loc = parserBeginLoc(p);
+        SourceLoc decl_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
-        AstDecl *decl = NEW(compiler, AstDecl);
+        AstDecl *decl = ts__newDecl(compiler);
         decl->kind = DECL_VAR;
         decl->attributes = attributes;
         decl->var.kind = VAR_UNIFORM;
@@ -1387,11 +1432,10 @@ static AstDecl *parseTopLevel(Parser *p)
         if (!name_tok) return NULL;
 
         decl->name = name_tok->str;
-        decl->var.type_expr = type_expr;
+        decl->var.type_expr = type_expr->id;
 
         if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-        parserEndLoc(p, &decl_loc);
         decl->loc = decl_loc;
 
         arrPush(p->compiler, &p->decls, decl);
@@ -1399,10 +1443,10 @@ static AstDecl *parseTopLevel(Parser *p)
     }
 
     case TOKEN_STRUCT: {
-        Location decl_loc = parserBeginLoc(p);
+        SourceLoc decl_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
-        AstDecl *decl = NEW(compiler, AstDecl);
+        AstDecl *decl = ts__newDecl(compiler);
         decl->kind = DECL_STRUCT;
         decl->attributes = attributes;
 
@@ -1412,9 +1456,10 @@ static AstDecl *parseTopLevel(Parser *p)
 
         if (!parserConsume(p, TOKEN_LCURLY)) return NULL;
 
+        ArrayOfAstDeclId fields = {0};
         while (parserPeek(p, 0)->kind != TOKEN_RCURLY)
         {
-            Location field_decl_loc = parserBeginLoc(p);
+            SourceLoc field_decl_loc = parserBeginLoc(p);
 
             AstExpr *type_expr = parsePrefixedUnaryExpr(p);
             if (!type_expr) return NULL;
@@ -1422,10 +1467,10 @@ static AstDecl *parseTopLevel(Parser *p)
             Token *name_tok = parserConsume(p, TOKEN_IDENT);
             if (!name_tok) return NULL;
 
-            AstDecl *field_decl = NEW(compiler, AstDecl);
+            AstDecl *field_decl = ts__newDecl(compiler);
             field_decl->kind = DECL_STRUCT_FIELD;
             field_decl->name = name_tok->str;
-            field_decl->struct_field.type_expr = type_expr;
+            field_decl->struct_field.type_expr = type_expr->id;
 
             if (parserPeek(p, 0)->kind == TOKEN_COLON)
             {
@@ -1437,17 +1482,16 @@ static AstDecl *parseTopLevel(Parser *p)
 
             if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-            parserEndLoc(p, &field_decl_loc);
             field_decl->loc = field_decl_loc;
 
-            arrPush(p->compiler, &decl->struct_.fields, field_decl);
+            arrPush(p->compiler, &fields, field_decl->id);
         }
+        decl->struct_.fields = AST_LIST(AstDeclList, fields);
 
         if (!parserConsume(p, TOKEN_RCURLY)) return NULL;
 
         if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-        parserEndLoc(p, &decl_loc);
         decl->loc = decl_loc;
 
         arrPush(p->compiler, &p->decls, decl);
@@ -1455,34 +1499,26 @@ static AstDecl *parseTopLevel(Parser *p)
     }
 
     case TOKEN_CBUFFER: {
-        Location decl_loc = parserBeginLoc(p);
+        SourceLoc decl_loc = parserBeginLoc(p);
 
         parserNext(p, 1);
 
         Token *name_tok = parserConsume(p, TOKEN_IDENT);
         if (!name_tok) return NULL;
 
+        bool has_register = false;
+        TsRegisterClass register_class = TS_REGISTER_CLASS_B;
+        uint32_t register_binding = 0;
+        uint32_t register_space = 0;
+
         if (parserPeek(p, 0)->kind == TOKEN_COLON)
         {
-            // Parse register
             parserNext(p, 1);
-
-            if (!parserConsume(p, TOKEN_REGISTER)) return NULL;
-
-            if (!parserConsume(p, TOKEN_LPAREN)) return NULL;
-
-            while (!parserIsAtEnd(p) && parserPeek(p, 0)->kind != TOKEN_RPAREN)
+            if (!parseRegister(p, &register_class, &register_binding, &register_space))
             {
-                AstExpr *param = parseExpr(p);
-                if (!param) return NULL;
-
-                if (parserPeek(p, 0)->kind != TOKEN_RPAREN)
-                {
-                    if (!parserConsume(p, TOKEN_COMMA)) return NULL;
-                }
+                return NULL;
             }
-
-            if (!parserConsume(p, TOKEN_RPAREN)) return NULL;
+            has_register = true;
         }
 
         ts__sbReset(&p->compiler->sb);
@@ -1490,16 +1526,17 @@ static AstDecl *parseTopLevel(Parser *p)
         ts__sbAppend(&p->compiler->sb, "#cbuffer_struct");
         char *struct_name = ts__sbBuild(&p->compiler->sb, &p->compiler->alloc);
 
-        AstDecl *struct_decl = NEW(compiler, AstDecl);
+        AstDecl *struct_decl = ts__newDecl(compiler);
         struct_decl->kind = DECL_STRUCT;
         struct_decl->attributes = attributes;
         struct_decl->name = struct_name;
 
         if (!parserConsume(p, TOKEN_LCURLY)) return NULL;
 
+        ArrayOfAstDeclId fields = {0};
         while (parserPeek(p, 0)->kind != TOKEN_RCURLY)
         {
-            Location field_decl_loc = parserBeginLoc(p);
+            SourceLoc field_decl_loc = parserBeginLoc(p);
 
             AstExpr *type_expr = parsePrefixedUnaryExpr(p);
             if (!type_expr) return NULL;
@@ -1507,71 +1544,88 @@ static AstDecl *parseTopLevel(Parser *p)
             Token *name_tok = parserConsume(p, TOKEN_IDENT);
             if (!name_tok) return NULL;
 
-            AstDecl *field_decl = NEW(compiler, AstDecl);
+            AstDecl *field_decl = ts__newDecl(compiler);
             field_decl->kind = DECL_STRUCT_FIELD;
             field_decl->name = name_tok->str;
-            field_decl->struct_field.type_expr = type_expr;
+            field_decl->struct_field.type_expr = type_expr->id;
 
             if (parserPeek(p, 0)->kind == TOKEN_COLON)
             {
                 parserNext(p, 1);
                 Token *semantic_tok = parserConsume(p, TOKEN_IDENT);
                 if (!semantic_tok) return NULL;
-                field_decl->semantic = semantic_tok->str;
+
+                if (strcmp(semantic_tok->str, "packoffset") == 0 &&
+                    parserPeek(p, 0)->kind == TOKEN_LPAREN)
+                {
+                    if (!parsePackOffset(p, &field_decl->struct_field.packoffset))
+                    {
+                        return NULL;
+                    }
+                    field_decl->struct_field.has_packoffset = true;
+                }
+                else
+                {
+                    field_decl->semantic = semantic_tok->str;
+                }
             }
 
             if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-            parserEndLoc(p, &field_decl_loc);
             field_decl->loc = field_decl_loc;
 
-            arrPush(p->compiler, &struct_decl->struct_.fields, field_decl);
+            arrPush(p->compiler, &fields, field_decl->id);
         }
+        struct_decl->struct_.fields = AST_LIST(AstDeclList, fields);
 
         if (!parserConsume(p, TOKEN_RCURLY)) return NULL;
 
         arrPush(p->compiler, &p->decls, struct_decl); // Push anonymous struct declaration
 
-        AstExpr *struct_name_expr = NEW(compiler, AstExpr);
+        AstExpr *struct_name_expr = ts__newExpr(compiler);
         struct_name_expr->kind = EXPR_IDENT;
         struct_name_expr->ident.name = struct_name;
 
-        AstExpr *type_expr = NEW(compiler, AstExpr);
-        type_expr->loc = parserPeek(p, 0)->loc;
+        AstExpr *type_expr = ts__newExpr(compiler);
+        type_expr->loc = parserBeginLoc(p);
         type_expr->kind = EXPR_CONSTANT_BUFFER_TYPE;
-        type_expr->buffer.sub_expr = struct_name_expr;
+        type_expr->buffer.sub_expr = struct_name_expr->id;
 
-        AstDecl *decl = NEW(compiler, AstDecl);
+        AstDecl *decl = ts__newDecl(compiler);
         decl->kind = DECL_VAR;
+        decl->loc = decl_loc;
         decl->name = NULL;
         decl->var.kind = VAR_UNIFORM;
-        decl->var.type_expr = type_expr;
+        decl->var.type_expr = type_expr->id;
+        decl->var.has_register = has_register;
+        decl->var.register_class = register_class;
+        decl->var.register_binding = register_binding;
+        decl->var.register_space = register_space;
         decl->attributes = attributes;
 
         arrPush(p->compiler, &p->decls, decl);
 
         for (size_t i = 0; i < struct_decl->struct_.fields.len; ++i)
         {
-            AstDecl *field = struct_decl->struct_.fields.ptr[i];
+            AstDecl *field = ts__decl(compiler, struct_decl->struct_.fields.ptr[i]);
 
-            AstDecl *alias_decl = NEW(compiler, AstDecl);
+            AstDecl *alias_decl = ts__newDecl(compiler);
             alias_decl->kind = DECL_ALIAS;
             alias_decl->loc = field->loc;
             alias_decl->name = field->name;
-            alias_decl->alias.accessed = decl;
+            alias_decl->alias.accessed = decl->id;
 
             // Push field access alias declaration
             arrPush(p->compiler, &p->decls, alias_decl);
         }
 
-        parserEndLoc(p, &decl_loc);
         decl->loc = decl_loc;
 
         return decl;
     }
 
     default: {
-        Location decl_loc = parserBeginLoc(p);
+        SourceLoc decl_loc = parserBeginLoc(p);
 
         AstExpr *type_expr = parsePrefixedUnaryExpr(p);
         if (!type_expr) return NULL;
@@ -1583,17 +1637,18 @@ static AstDecl *parseTopLevel(Parser *p)
         {
             // Function declaration
 
-            AstDecl *decl = NEW(compiler, AstDecl);
+            AstDecl *decl = ts__newDecl(compiler);
             decl->kind = DECL_FUNC;
             decl->name = name_tok->str;
-            decl->func.return_type = type_expr;
+            decl->func.return_type = type_expr->id;
             decl->attributes = attributes;
 
             if (!parserConsume(p, TOKEN_LPAREN)) return NULL;
 
+            ArrayOfAstDeclId params = {0};
             while (parserPeek(p, 0)->kind != TOKEN_RPAREN)
             {
-                Location param_decl_loc = parserBeginLoc(p);
+                SourceLoc param_decl_loc = parserBeginLoc(p);
 
                 AstVarKind var_kind = VAR_IN_PARAM;
 
@@ -1619,10 +1674,10 @@ static AstDecl *parseTopLevel(Parser *p)
                 Token *param_name_tok = parserConsume(p, TOKEN_IDENT);
                 if (!param_name_tok) return NULL;
 
-                AstDecl *param_decl = NEW(compiler, AstDecl);
+                AstDecl *param_decl = ts__newDecl(compiler);
                 param_decl->kind = DECL_VAR;
                 param_decl->name = param_name_tok->str;
-                param_decl->var.type_expr = type_expr;
+                param_decl->var.type_expr = type_expr->id;
                 param_decl->var.kind = var_kind;
 
                 if (parserPeek(p, 0)->kind == TOKEN_COLON)
@@ -1633,10 +1688,9 @@ static AstDecl *parseTopLevel(Parser *p)
                     param_decl->semantic = semantic_tok->str;
                 }
 
-                parserEndLoc(p, &param_decl_loc);
                 param_decl->loc = param_decl_loc;
 
-                arrPush(p->compiler, &decl->func.params, param_decl);
+                arrPush(p->compiler, &params, param_decl->id);
 
                 if (parserPeek(p, 0)->kind != TOKEN_RPAREN)
                 {
@@ -1645,6 +1699,7 @@ static AstDecl *parseTopLevel(Parser *p)
             }
 
             if (!parserConsume(p, TOKEN_RPAREN)) return NULL;
+            decl->func.params = AST_LIST(AstDeclList, params);
 
             if (parserPeek(p, 0)->kind == TOKEN_COLON)
             {
@@ -1656,18 +1711,19 @@ static AstDecl *parseTopLevel(Parser *p)
 
             if (!parserConsume(p, TOKEN_LCURLY)) return NULL;
 
+            ArrayOfAstStmtId stmts = {0};
             while (parserPeek(p, 0)->kind != TOKEN_RCURLY)
             {
                 AstStmt *stmt = parseStmt(p);
                 if (stmt)
                 {
-                    arrPush(p->compiler, &decl->func.stmts, stmt);
+                    arrPush(p->compiler, &stmts, stmt->id);
                 }
             }
 
             if (!parserConsume(p, TOKEN_RCURLY)) return NULL;
+            decl->func.stmts = AST_LIST(AstStmtList, stmts);
 
-            parserEndLoc(p, &decl_loc);
             decl->loc = decl_loc;
 
             arrPush(p->compiler, &p->decls, decl);
@@ -1678,38 +1734,29 @@ static AstDecl *parseTopLevel(Parser *p)
         {
             // Parse top level uniform variable declaration
 
+            AstDecl *decl = ts__newDecl(compiler);
+            decl->kind = DECL_VAR;
+            decl->name = name_tok->str;
+            decl->var.type_expr = type_expr->id;
+            decl->var.kind = VAR_UNIFORM;
+            decl->attributes = attributes;
+
             if (parserPeek(p, 0)->kind == TOKEN_COLON)
             {
                 parserNext(p, 1);
-
-                if (!parserConsume(p, TOKEN_REGISTER)) return NULL;
-
-                if (!parserConsume(p, TOKEN_LPAREN)) return NULL;
-
-                while (!parserIsAtEnd(p) && parserPeek(p, 0)->kind != TOKEN_RPAREN)
+                if (!parseRegister(
+                        p,
+                        &decl->var.register_class,
+                        &decl->var.register_binding,
+                        &decl->var.register_space))
                 {
-                    AstExpr *param = parseExpr(p);
-                    if (!param) return NULL;
-
-                    if (parserPeek(p, 0)->kind != TOKEN_RPAREN)
-                    {
-                        if (!parserConsume(p, TOKEN_COMMA)) return NULL;
-                    }
+                    return NULL;
                 }
-
-                if (!parserConsume(p, TOKEN_RPAREN)) return NULL;
+                decl->var.has_register = true;
             }
 
             if (!parserConsume(p, TOKEN_SEMICOLON)) return NULL;
 
-            AstDecl *decl = NEW(compiler, AstDecl);
-            decl->kind = DECL_VAR;
-            decl->name = name_tok->str;
-            decl->var.type_expr = type_expr;
-            decl->var.kind = VAR_UNIFORM;
-            decl->attributes = attributes;
-
-            parserEndLoc(p, &decl_loc);
             decl->loc = decl_loc;
 
             arrPush(p->compiler, &p->decls, decl);
@@ -1729,7 +1776,473 @@ static AstDecl *parseTopLevel(Parser *p)
     return NULL;
 }
 
-ArrayOfAstDeclPtr ts__parse(TsCompiler *compiler, ArrayOfToken tokens)
+////////////////////////////////
+//
+// Parallel top level parsing
+//
+////////////////////////////////
+
+// Below this many tokens, starting threads costs more than it saves
+#ifndef TS_PARALLEL_PARSE_MIN_TOKENS
+#define TS_PARALLEL_PARSE_MIN_TOKENS (1 << 14)
+#endif
+
+#define PARSE_MAX_JOBS 16
+
+typedef struct ParseJob
+{
+    // Private arena, string builder and error list for the worker thread
+    TsCompiler compiler;
+
+    const char *text;
+    ArrayOfToken tokens;
+    SourceLoc loc_base;
+    HashMap *template_names;
+    size_t begin;
+    size_t end;
+
+    ArrayOfAstDeclPtr decls;
+    bool ok;
+} ParseJob;
+
+// Returns the index one past the top level declaration starting at 'pos', using only
+// bracket matching. A wrong guess is harmless: the job covering it will fail to end on
+// the boundary and that part gets parsed again serially.
+static size_t parserScanDeclEnd(const ArrayOfToken *tokens, size_t pos)
+{
+    int64_t depth = 0;
+    for (; pos < tokens->len; ++pos)
+    {
+        switch (tokens->ptr[pos].kind)
+        {
+        case TOKEN_LPAREN:
+        case TOKEN_LBRACK:
+        case TOKEN_LCURLY: depth++; break;
+
+        case TOKEN_RPAREN:
+        case TOKEN_RBRACK: depth--; break;
+
+        case TOKEN_RCURLY: {
+            depth--;
+            if (depth == 0)
+            {
+                // Structs, cbuffers and initializer lists end with '};'
+                if (pos + 1 < tokens->len &&
+                    tokens->ptr[pos + 1].kind == TOKEN_SEMICOLON)
+                {
+                    return pos + 2;
+                }
+                return pos + 1;
+            }
+            break;
+        }
+
+        case TOKEN_SEMICOLON: {
+            if (depth == 0) return pos + 1;
+            break;
+        }
+
+        default: break;
+        }
+
+        if (depth < 0) break;
+    }
+
+    return tokens->len;
+}
+
+static void parseJobRun(void *arg)
+{
+    ParseJob *job = arg;
+
+    Parser p = {0};
+    p.compiler = &job->compiler;
+    p.text = job->text;
+    p.tokens = job->tokens.ptr;
+    p.token_count = job->tokens.len;
+    p.loc_base = job->loc_base;
+    p.template_names = job->template_names;
+    p.pos = job->begin;
+
+    job->ok = true;
+    while (p.pos < job->end)
+    {
+        if (!parseTopLevel(&p))
+        {
+            job->ok = false;
+            break;
+        }
+    }
+
+    job->ok = job->ok && p.pos == job->end && job->compiler.errors.len == 0;
+    job->decls = p.decls;
+}
+
+// Splits the tokens into runs of whole top level declarations and parses them on
+// separate threads. Jobs are stitched back in source order until the first one that
+// did not parse cleanly; the caller continues serially from p->pos, so errors and the
+// resulting AST are exactly what a serial parse would produce.
+static void parseParallel(Parser *p, ArrayOfToken tokens, uint32_t job_count)
+{
+    TsCompiler *compiler = p->compiler;
+
+    ParseJob jobs[PARSE_MAX_JOBS];
+    job_count = TS__MIN(job_count, PARSE_MAX_JOBS);
+
+    size_t target_len = tokens.len / job_count;
+    uint32_t actual_count = 0;
+
+    size_t pos = p->pos;
+    while (pos < tokens.len && actual_count < job_count)
+    {
+        size_t begin = pos;
+        if (actual_count == job_count - 1)
+        {
+            pos = tokens.len;
+        }
+        else
+        {
+            while (pos < tokens.len && pos - begin < target_len)
+            {
+                pos = parserScanDeclEnd(&tokens, pos);
+            }
+        }
+
+        ParseJob *job = &jobs[actual_count++];
+        memset(job, 0, sizeof(*job));
+        job->text = p->text;
+        job->tokens = tokens;
+        job->loc_base = p->loc_base;
+        job->template_names = p->template_names;
+        job->begin = begin;
+        job->end = pos;
+    }
+
+    if (actual_count < 2) return;
+
+    Thread *threads[PARSE_MAX_JOBS] = {0};
+    for (uint32_t i = 0; i < actual_count; ++i)
+    {
+        ts__bumpInit(&jobs[i].compiler.alloc, 1 << 16);
+        ts__sbInit(&jobs[i].compiler.sb);
+        jobs[i].compiler.ast = compiler->ast;
+    }
+
+    // The calling thread takes the first job
+    for (uint32_t i = 1; i < actual_count; ++i)
+    {
+        threads[i] = ts__threadStart(parseJobRun, &jobs[i]);
+        if (!threads[i]) parseJobRun(&jobs[i]);
+    }
+
+    parseJobRun(&jobs[0]);
+
+    bool stitching = true;
+    for (uint32_t i = 0; i < actual_count; ++i)
+    {
+        ParseJob *job = &jobs[i];
+        if (threads[i]) ts__threadJoin(threads[i]);
+
+        stitching = stitching && job->ok;
+        if (stitching)
+        {
+            for (size_t j = 0; j < job->decls.len; ++j)
+            {
+                arrPush(compiler, &p->decls, job->decls.ptr[j]);
+            }
+            p->pos = job->end;
+
+            ts__bumpAdopt(&compiler->alloc, &job->compiler.alloc);
+        }
+        else
+        {
+            ts__bumpDestroy(&job->compiler.alloc);
+        }
+
+        ts__sbDestroy(&job->compiler.sb);
+    }
+}
+
+////////////////////////////////
+//
+// Incremental parsing
+//
+// A parse cache keeps the declarations of each top level span (as found by
+// parserScanDeclEnd) of the previous parse, serialized with the precompiled header
+// writer with source locations relative to the first token. Spans whose text did not
+// change are loaded from the cache at their new location instead of being parsed again.
+//
+////////////////////////////////
+
+typedef struct ParseCacheEntry
+{
+    uint64_t hash;
+    char *text; // From the start of the first token to the end of the last one
+    size_t text_size;
+
+    uint8_t *pch; // NULL once the entry was reused
+    size_t pch_size;
+} ParseCacheEntry;
+
+struct ParseCache
+{
+    uint64_t template_names_hash;
+    ParseCacheEntry *entries; // Sorted by hash
+    size_t entry_count;
+};
+
+ParseCache *ts__parseCacheCreate(void)
+{
+    ParseCache *cache = malloc(sizeof(*cache));
+    memset(cache, 0, sizeof(*cache));
+    return cache;
+}
+
+static void parseCacheClear(ParseCache *cache)
+{
+    for (size_t i = 0; i < cache->entry_count; ++i)
+    {
+        ParseCacheEntry *entry = &cache->entries[i];
+        free(entry->text);
+        free(entry->pch);
+    }
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->entry_count = 0;
+}
+
+void ts__parseCacheDestroy(ParseCache *cache)
+{
+    parseCacheClear(cache);
+    free(cache);
+}
+
+static int compareCacheEntries(const void *a, const void *b)
+{
+    uint64_t hash_a = ((const ParseCacheEntry *)a)->hash;
+    uint64_t hash_b = ((const ParseCacheEntry *)b)->hash;
+    return (hash_a > hash_b) - (hash_a < hash_b);
+}
+
+// Describes the span of tokens [begin, end) as a cache entry that points into the
+// source. Spans with tokens from several files do not come from one run of the text,
+// so they are not cached.
+static bool parserSpanKey(Parser *p, size_t begin, size_t end, ParseCacheEntry *key)
+{
+    Token *first = &p->tokens[begin];
+    Token *last = &p->tokens[end - 1];
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (p->tokens[i].loc.path != first->loc.path) return false;
+    }
+
+    memset(key, 0, sizeof(*key));
+    key->text = (char *)p->text + first->loc.pos;
+    key->text_size = last->loc.pos + last->loc.length - first->loc.pos;
+    key->hash = ts__hashBytes(key->text, key->text_size);
+    return true;
+}
+
+// Returns an entry that was not reused yet and whose declarations can stand for the
+// ones of 'key', or NULL
+static ParseCacheEntry *parseCacheFind(ParseCache *cache, const ParseCacheEntry *key)
+{
+    size_t lo = 0;
+    size_t hi = cache->entry_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cache->entries[mid].hash < key->hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < cache->entry_count && cache->entries[lo].hash == key->hash; ++lo)
+    {
+        ParseCacheEntry *entry = &cache->entries[lo];
+        if (entry->pch && entry->text_size == key->text_size &&
+            memcmp(entry->text, key->text, key->text_size) == 0)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static ParseCacheEntry *pushCacheEntry(
+    ParseCacheEntry *entries, size_t *count, size_t *cap, const ParseCacheEntry *entry)
+{
+    if (*count == *cap)
+    {
+        *cap *= 2;
+        entries = realloc(entries, *cap * sizeof(*entries));
+    }
+    entries[(*count)++] = *entry;
+    return entries;
+}
+
+static void parseIncremental(Parser *p, ArrayOfToken tokens, ParseCache *cache)
+{
+    TsCompiler *compiler = p->compiler;
+
+    size_t entry_count = 0;
+    size_t entry_cap = 16;
+    ParseCacheEntry *entries = malloc(entry_cap * sizeof(*entries));
+
+    while (!parserIsAtEnd(p))
+    {
+        size_t begin = p->pos;
+        size_t end = parserScanDeclEnd(&tokens, begin);
+        size_t first_decl = p->decls.len;
+
+        ParseCacheEntry entry;
+        bool cacheable = parserSpanKey(p, begin, end, &entry);
+
+        ParseCacheEntry *found = cacheable ? parseCacheFind(cache, &entry) : NULL;
+        if (found)
+        {
+            bool loaded = ts__pchLoad(
+                compiler,
+                found->pch,
+                found->pch_size,
+                p->loc_base + begin,
+                &p->decls,
+                NULL);
+            assert(loaded);
+            (void)loaded;
+            p->pos = end;
+
+            // The entry moves over to the new generation of the cache
+            entry = *found;
+            found->text = NULL;
+            found->pch = NULL;
+        }
+        else
+        {
+            bool failed = false;
+            while (p->pos < end)
+            {
+                if (!parseTopLevel(p))
+                {
+                    failed = true;
+                    break;
+                }
+            }
+            if (failed)
+            {
+                assert(compiler->errors.len > 0);
+                break;
+            }
+
+            // A span that does not end on a declaration boundary is not cached
+            if (!cacheable || p->pos != end) continue;
+
+            entry.text = memcpy(malloc(entry.text_size), entry.text, entry.text_size);
+            entry.pch = ts__pchWrite(
+                compiler,
+                p->decls.ptr + first_decl,
+                p->decls.len - first_decl,
+                NULL,
+                p->loc_base + begin,
+                &entry.pch_size);
+        }
+
+        entries = pushCacheEntry(entries, &entry_count, &entry_cap, &entry);
+    }
+
+    // After an error, the spans that were not reached stay cached for the next parse
+    bool keep_unused = compiler->errors.len > 0;
+    for (size_t i = 0; i < cache->entry_count; ++i)
+    {
+        ParseCacheEntry *old = &cache->entries[i];
+        if (!old->pch) continue;
+
+        if (keep_unused)
+        {
+            entries = pushCacheEntry(entries, &entry_count, &entry_cap, old);
+        }
+        else
+        {
+            free(old->text);
+            free(old->pch);
+        }
+    }
+    free(cache->entries);
+
+    qsort(entries, entry_count, sizeof(*entries), compareCacheEntries);
+    cache->entries = entries;
+    cache->entry_count = entry_count;
+}
+
+// Finds the names of the templates before parsing, so that uses of a template can come
+// before its declaration and declarations can be parsed in any order. Returns a hash of
+// the names, which decide how the rest of the tokens parse.
+static uint64_t parserCollectTemplateNames(
+    Parser *p, ArrayOfToken tokens, const ArrayOfAstDeclPtr *prior_decls)
+{
+    uint64_t names_hash = 0;
+
+    for (size_t i = 0; i < prior_decls->len; ++i)
+    {
+        AstDecl *decl = prior_decls->ptr[i];
+        if (decl->template_params.len > 0)
+        {
+            ts__hashSet(p->template_names, decl->name, decl);
+            names_hash += ts__hashString(decl->name);
+        }
+    }
+
+    for (size_t i = 0; i < tokens.len; ++i)
+    {
+        if (tokens.ptr[i].kind != TOKEN_TEMPLATE) continue;
+
+        // Skip the parameter list, it only holds 'typename' and identifiers
+        size_t pos = i + 1;
+        while (pos < tokens.len && tokens.ptr[pos].kind != TOKEN_GREATER) pos++;
+        pos++;
+
+        if (pos + 1 < tokens.len && tokens.ptr[pos].kind == TOKEN_STRUCT)
+        {
+            if (tokens.ptr[pos + 1].kind == TOKEN_IDENT)
+            {
+                char *name = tokens.ptr[pos + 1].str;
+                ts__hashSet(p->template_names, name, name);
+                names_hash += ts__hashString(name);
+            }
+            continue;
+        }
+
+        // A function is named by the first identifier followed by '(', past the
+        // attributes and the return type
+        int64_t brack_depth = 0;
+        for (; pos + 1 < tokens.len; ++pos)
+        {
+            Token *tok = &tokens.ptr[pos];
+            if (tok->kind == TOKEN_LBRACK) brack_depth++;
+            if (tok->kind == TOKEN_RBRACK) brack_depth--;
+            if (tok->kind == TOKEN_SEMICOLON || tok->kind == TOKEN_LCURLY) break;
+
+            if (brack_depth == 0 && tok->kind == TOKEN_IDENT &&
+                tokens.ptr[pos + 1].kind == TOKEN_LPAREN)
+            {
+                ts__hashSet(p->template_names, tok->str, tok->str);
+                names_hash += ts__hashString(tok->str);
+                break;
+            }
+        }
+    }
+
+    return names_hash;
+}
+
+ArrayOfAstDeclPtr ts__parse(
+    TsCompiler *compiler,
+    const char *text,
+    ArrayOfToken tokens,
+    const ArrayOfAstDeclPtr *prior_decls,
+    ParseCache *cache)
 {
     Parser *p = NEW(compiler, Parser);
     assert(compiler);
@@ -1737,8 +2250,37 @@ ArrayOfAstDeclPtr ts__parse(TsCompiler *compiler, ArrayOfToken tokens)
 
     memset(p, 0, sizeof(*p));
     p->compiler = compiler;
+    p->text = text;
     p->tokens = tokens.ptr;
     p->token_count = tokens.len;
+    if (tokens.len > 0)
+    {
+        p->loc_base = ts__sourceMapAdd(
+            compiler, &tokens.ptr[0].loc, sizeof(Token), (uint32_t)tokens.len);
+    }
+
+    p->template_names = NEW(compiler, HashMap);
+    ts__hashInit(compiler, p->template_names, 0);
+    uint64_t template_names_hash = parserCollectTemplateNames(p, tokens, prior_decls);
+
+    if (cache)
+    {
+        // The cached declarations were parsed with other template names in mind
+        if (cache->template_names_hash != template_names_hash)
+        {
+            parseCacheClear(cache);
+            cache->template_names_hash = template_names_hash;
+        }
+
+        parseIncremental(p, tokens, cache);
+        return p->decls;
+    }
+
+    uint32_t cpu_count = ts__getCpuCount();
+    if (cpu_count > 1 && tokens.len >= TS_PARALLEL_PARSE_MIN_TOKENS)
+    {
+        parseParallel(p, tokens, cpu_count);
+    }
 
     while (!parserIsAtEnd(p))
     {
@@ -0,0 +1,1044 @@
+/**
+ * This file is part of the tinyshader library.
+ * See tinyshader.h for license details.
+ */
+#include "tinyshader_internal.h"
+
+////////////////////////////////
+//
+// Precompiled headers
+//
+// A precompiled header is the parsed AST of a source file. The nodes are stored in the
+// in-memory layout of AstExpr/AstStmt/AstDecl, one section per pool, and refer to each
+// other by their index in the section plus one (0 stands for no node). What the nodes
+// point to (tokens, strings, id lists, attributes) goes in a data section, where every
+// pointer slot holds an offset into the section instead of an address (0 stands for
+// NULL).
+//
+// Loading copies the data section into the arena and the nodes into a run of ids of
+// each pool, then goes over one table of pointer slots to relocate and one table of id
+// slots per pool, so the blob can come straight from an mmap'd file.
+//
+// Source locations are stored relative to the origin given to ts__pchWrite and loaded
+// relative to the one given to ts__pchLoad, so the declarations can be loaded at a
+// different place in the source than the one they were parsed at. With an origin of 0
+// the locations themselves are stored, and added to the source map on load.
+//
+// The macros defined at the end of the header are stored with their values, so that
+// the source the header is loaded before sees them as if it had included the header.
+//
+// Because the node layout is stored as is, a blob is only valid for the build of the
+// library that produced it; the header records the node sizes to catch mismatches.
+//
+////////////////////////////////
+
+#define PCH_MAGIC "TSPH"
+#define PCH_VERSION 7
+
+// Node sections are indexed by AstPoolKind, the data section comes after them
+#define PCH_NODE_KINDS (AST_POOL_DECL + 1)
+#define PCH_SECTION_DATA PCH_NODE_KINDS
+
+// A slot is the section it is in and its offset in that section
+#define PCH_SLOT_SHIFT 30
+#define PCH_SLOT_MASK ((1u << PCH_SLOT_SHIFT) - 1)
+#define PCH_SLOT(section, offset)                                                        \
+    (((uint32_t)(section) << PCH_SLOT_SHIFT) | (uint32_t)(offset))
+
+typedef struct PchHeader
+{
+    char magic[4];
+    uint32_t version;
+
+    uint16_t pointer_size;
+    uint16_t token_size;
+    uint16_t expr_size;
+    uint16_t stmt_size;
+    uint16_t decl_size;
+    uint16_t attribute_size;
+    uint16_t location_size;
+
+    uint32_t size; // Total size of the blob in bytes
+
+    uint32_t data_offset;
+    uint32_t data_size;
+
+    // Arrays of 'node_counts[kind]' nodes
+    uint32_t node_offsets[PCH_NODE_KINDS];
+    uint32_t node_counts[PCH_NODE_KINDS];
+
+    uint32_t decls_offset; // Array of 'decl_count' uint32_t declaration ids
+    uint32_t decl_count;
+
+    uint32_t relocs_offset; // Array of 'reloc_count' uint32_t pointer slots
+    uint32_t reloc_count;
+
+    // Arrays of 'id_slot_counts[kind]' uint32_t slots holding ids of that kind
+    uint32_t id_slot_offsets[PCH_NODE_KINDS];
+    uint32_t id_slot_counts[PCH_NODE_KINDS];
+
+    // Array of 'loc_count' Locations in the data section, only written with origin 0
+    uint32_t locs_offset;
+    uint32_t loc_count;
+
+    // Array of 'macro_count' PchMacros in the data section
+    uint32_t macros_offset;
+    uint32_t macro_count;
+} PchHeader;
+
+typedef struct PchMacro
+{
+    char *name;
+    char *value; // NULL for macros defined without a value
+} PchMacro;
+
+typedef struct PchBuffer
+{
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} PchBuffer;
+
+// Non-zero key -> uint32_t, with open addressing
+typedef struct PchMemo
+{
+    uintptr_t *keys;
+    uint32_t *values;
+    size_t count;
+    size_t cap;
+} PchMemo;
+
+typedef struct PchWriter
+{
+    TsCompiler *compiler;
+    SourceLoc origin;
+
+    PchBuffer sections[PCH_NODE_KINDS + 1];
+
+    // Nodes in the order of their ids. A node's children are written after it is taken
+    // off this list, so deep trees do not recurse.
+    PchBuffer nodes[PCH_NODE_KINDS];
+    size_t written[PCH_NODE_KINDS];
+
+    PchBuffer relocs;
+    PchBuffer id_slots[PCH_NODE_KINDS];
+
+    // Node and token address -> id or data offset. Nodes can be shared (e.g. the left
+    // hand side of a compound assignment, or the cbuffer variable referenced by its
+    // aliases), so they must only be written once.
+    PchMemo memo;
+
+    // With origin 0, source location -> index in 'locs' plus one
+    PchMemo loc_memo;
+    PchBuffer locs;
+
+    HashMap strings; // string -> data offset
+} PchWriter;
+
+static void pchBufferGrow(PchBuffer *buf, size_t wanted)
+{
+    if (wanted <= buf->cap) return;
+
+    size_t new_cap = TS__MAX(buf->cap * 2, 4096);
+    while (new_cap < wanted) new_cap *= 2;
+
+    buf->data = realloc(buf->data, new_cap);
+    memset(buf->data + buf->cap, 0, new_cap - buf->cap);
+    buf->cap = new_cap;
+}
+
+// Appends 'size' bytes, 8-byte aligned, and returns their offset
+static uint32_t pchAppend(PchBuffer *buf, const void *data, size_t size)
+{
+    size_t offset = (buf->len + 7) & ~(size_t)7;
+    pchBufferGrow(buf, offset + size);
+    if (data) memcpy(buf->data + offset, data, size);
+    buf->len = offset + size;
+
+    assert(buf->len <= PCH_SLOT_MASK);
+    return (uint32_t)offset;
+}
+
+static void pchPushU32(PchBuffer *buf, uint32_t value)
+{
+    pchBufferGrow(buf, buf->len + sizeof(value));
+    memcpy(buf->data + buf->len, &value, sizeof(value));
+    buf->len += sizeof(value);
+}
+
+static uint8_t *pchSlot(PchWriter *w, uint32_t slot)
+{
+    return w->sections[slot >> PCH_SLOT_SHIFT].data + (slot & PCH_SLOT_MASK);
+}
+
+// Stores the data offset 'target' in the pointer slot 'slot'
+static void pchPatch(PchWriter *w, uint32_t slot, uint32_t target)
+{
+    uintptr_t value = target;
+    memcpy(pchSlot(w, slot), &value, sizeof(value));
+
+    if (target != 0) pchPushU32(&w->relocs, slot);
+}
+
+static uint64_t pchMemoHash(uintptr_t key)
+{
+    uint64_t h = (uint64_t)key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static bool pchMemoGet(PchMemo *memo, uintptr_t key, uint32_t *value)
+{
+    if (memo->cap == 0) return false;
+
+    size_t i = pchMemoHash(key) & (memo->cap - 1);
+    while (memo->keys[i])
+    {
+        if (memo->keys[i] == key)
+        {
+            *value = memo->values[i];
+            return true;
+        }
+        i = (i + 1) & (memo->cap - 1);
+    }
+    return false;
+}
+
+static void pchMemoSet(PchMemo *memo, uintptr_t key, uint32_t value)
+{
+    if ((memo->count + 1) * 2 > memo->cap)
+    {
+        uintptr_t *old_keys = memo->keys;
+        uint32_t *old_values = memo->values;
+        size_t old_cap = memo->cap;
+
+        memo->cap = TS__MAX(old_cap * 2, 256);
+        memo->keys = calloc(memo->cap, sizeof(*memo->keys));
+        memo->values = calloc(memo->cap, sizeof(*memo->values));
+        memo->count = 0;
+
+        for (size_t i = 0; i < old_cap; ++i)
+        {
+            if (old_keys[i]) pchMemoSet(memo, old_keys[i], old_values[i]);
+        }
+
+        free(old_keys);
+        free(old_values);
+    }
+
+    size_t i = pchMemoHash(key) & (memo->cap - 1);
+    while (memo->keys[i])
+    {
+        i = (i + 1) & (memo->cap - 1);
+    }
+    memo->keys[i] = key;
+    memo->values[i] = value;
+    memo->count++;
+}
+
+static uint32_t pchWriteString(PchWriter *w, const char *str)
+{
+    if (!str) return 0;
+
+    void *found = NULL;
+    if (ts__hashGet(&w->strings, str, &found)) return (uint32_t)(uintptr_t)found;
+
+    uint32_t offset = pchAppend(&w->sections[PCH_SECTION_DATA], str, strlen(str) + 1);
+    ts__hashSet(&w->strings, str, (void *)(uintptr_t)offset);
+    return offset;
+}
+
+// Returns the id the node has in the blob, queueing it if it was not written yet
+static uint32_t pchNode(PchWriter *w, AstPoolKind kind, uint32_t id)
+{
+    if (!id) return 0;
+
+    const AstPool *pool = &w->compiler->ast->pools[kind];
+    void *node = ts__astPoolGet(pool, id);
+
+    uint32_t local_id;
+    if (pchMemoGet(&w->memo, (uintptr_t)node, &local_id)) return local_id;
+
+    pchAppend(&w->sections[kind], NULL, pool->item_size);
+    pchAppend(&w->nodes[kind], &node, sizeof(node));
+
+    local_id = (uint32_t)(w->nodes[kind].len / sizeof(node));
+    pchMemoSet(&w->memo, (uintptr_t)node, local_id);
+    return local_id;
+}
+
+static void pchWriteId(PchWriter *w, uint32_t slot, AstPoolKind kind, uint32_t id)
+{
+    uint32_t local_id = pchNode(w, kind, id);
+    memcpy(pchSlot(w, slot), &local_id, sizeof(local_id));
+
+    if (local_id != 0) pchPushU32(&w->id_slots[kind], slot);
+}
+
+static void pchWriteIds(
+    PchWriter *w, uint32_t slot, AstPoolKind kind, const uint32_t *ids, uint32_t count)
+{
+    if (count == 0)
+    {
+        pchPatch(w, slot, 0);
+        return;
+    }
+
+    uint32_t elems =
+        pchAppend(&w->sections[PCH_SECTION_DATA], NULL, sizeof(uint32_t) * count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        pchWriteId(
+            w, PCH_SLOT(PCH_SECTION_DATA, elems + i * sizeof(uint32_t)), kind, ids[i]);
+    }
+    pchPatch(w, slot, elems);
+}
+
+static SourceLoc pchWriteLoc(PchWriter *w, SourceLoc loc)
+{
+    if (!loc) return 0;
+
+    if (w->origin)
+    {
+        assert(loc >= w->origin);
+        return loc - w->origin + 1;
+    }
+
+    uint32_t index;
+    if (pchMemoGet(&w->loc_memo, loc, &index)) return index;
+
+    Location resolved = ts__sourceLocResolve(w->compiler, loc);
+    pchAppend(&w->locs, &resolved, sizeof(resolved));
+
+    index = (uint32_t)(w->locs.len / sizeof(Location));
+    pchMemoSet(&w->loc_memo, loc, index);
+    return index;
+}
+
+static uint32_t pchWriteToken(PchWriter *w, Token *token)
+{
+    if (!token) return 0;
+
+    uint32_t offset;
+    if (pchMemoGet(&w->memo, (uintptr_t)token, &offset)) return offset;
+
+    // Only the parser reads token locations, the nodes have their own
+    Token copy = *token;
+    memset(&copy.loc, 0, sizeof(copy.loc));
+
+    offset = pchAppend(&w->sections[PCH_SECTION_DATA], &copy, sizeof(copy));
+    pchMemoSet(&w->memo, (uintptr_t)token, offset);
+
+    switch (token->kind)
+    {
+    case TOKEN_INT_LIT:
+    case TOKEN_FLOAT_LIT:
+    case TOKEN_VECTOR_TYPE:
+    case TOKEN_MATRIX_TYPE: break;
+
+    default: {
+        // Identifiers, keywords and string literals keep their spelling
+        pchPatch(
+            w,
+            PCH_SLOT(PCH_SECTION_DATA, offset + offsetof(Token, str)),
+            pchWriteString(w, token->str));
+        break;
+    }
+    }
+
+    return offset;
+}
+
+static void pchWriteAttributes(PchWriter *w, uint32_t slot, AstAttributeList attributes)
+{
+    if (attributes.len == 0)
+    {
+        pchPatch(w, slot, 0);
+        return;
+    }
+
+    uint32_t elems = pchAppend(
+        &w->sections[PCH_SECTION_DATA],
+        attributes.ptr,
+        sizeof(AstAttribute) * attributes.len);
+    for (uint32_t i = 0; i < attributes.len; ++i)
+    {
+        AstAttribute *attr = &attributes.ptr[i];
+        uint32_t elem = PCH_SLOT(PCH_SECTION_DATA, elems + i * sizeof(AstAttribute));
+
+        pchPatch(w, elem + offsetof(AstAttribute, name), pchWriteString(w, attr->name));
+        pchWriteIds(
+            w,
+            elem + offsetof(AstAttribute, values),
+            AST_POOL_EXPR,
+            attr->values.ptr,
+            attr->values.len);
+    }
+
+    pchPatch(w, slot, elems);
+}
+
+static void pchWriteExpr(PchWriter *w, AstExpr *expr, uint32_t offset)
+{
+    // Only the parser's output is stored, analysis results are recomputed on load
+    AstExpr copy = *expr;
+    copy.has_resolved_int = false;
+    copy.loc = pchWriteLoc(w, expr->loc);
+    copy.id = 0;
+    copy.info = 0;
+    copy.type = NULL;
+    if (expr->kind == EXPR_IDENT) copy.ident.decl = 0;
+    memcpy(pchSlot(w, offset), &copy, sizeof(copy));
+
+#define PATCH_EXPR(field)                                                                \
+    pchWriteId(w, offset + offsetof(AstExpr, field), AST_POOL_EXPR, expr->field)
+#define PATCH_EXPRS(field)                                                               \
+    pchWriteIds(                                                                         \
+        w,                                                                               \
+        offset + offsetof(AstExpr, field),                                               \
+        AST_POOL_EXPR,                                                                   \
+        expr->field.ptr,                                                                 \
+        expr->field.len)
+
+    switch (expr->kind)
+    {
+    case EXPR_PRIMARY: {
+        pchPatch(
+            w,
+            offset + offsetof(AstExpr, primary.token),
+            pchWriteToken(w, expr->primary.token));
+        break;
+    }
+
+    case EXPR_IDENT: {
+        pchPatch(
+            w,
+            offset + offsetof(AstExpr, ident.name),
+            pchWriteString(w, expr->ident.name));
+        pchWriteIds(
+            w,
+            offset + offsetof(AstExpr, ident.template_args),
+            AST_POOL_EXPR,
+            expr->ident.template_args,
+            expr->ident.template_arg_count);
+        break;
+    }
+
+    case EXPR_ACCESS: {
+        PATCH_EXPR(access.base);
+        PATCH_EXPRS(access.chain);
+        break;
+    }
+
+    case EXPR_SUBSCRIPT: {
+        PATCH_EXPR(subscript.left);
+        PATCH_EXPR(subscript.right);
+        break;
+    }
+
+    case EXPR_SAMPLER_TYPE: break;
+
+    case EXPR_TEXTURE_TYPE: {
+        PATCH_EXPR(texture.sampled_type_expr);
+        break;
+    }
+
+    case EXPR_CONSTANT_BUFFER_TYPE:
+    case EXPR_STRUCTURED_BUFFER_TYPE:
+    case EXPR_RW_STRUCTURED_BUFFER_TYPE: {
+        PATCH_EXPR(buffer.sub_expr);
+        break;
+    }
+
+    case EXPR_FUNC_CALL: {
+        PATCH_EXPR(func_call.func_expr);
+        PATCH_EXPR(func_call.self_param);
+        PATCH_EXPRS(func_call.params);
+        break;
+    }
+
+    case EXPR_VAR_ASSIGN: {
+        PATCH_EXPR(var_assign.assigned_expr);
+        PATCH_EXPR(var_assign.value_expr);
+        break;
+    }
+
+    case EXPR_UNARY: {
+        PATCH_EXPR(unary.right);
+        break;
+    }
+
+    case EXPR_BINARY: {
+        PATCH_EXPR(binary.left);
+        PATCH_EXPR(binary.right);
+        break;
+    }
+
+    case EXPR_TERNARY: {
+        PATCH_EXPR(ternary.cond);
+        PATCH_EXPR(ternary.true_expr);
+        PATCH_EXPR(ternary.false_expr);
+        break;
+    }
+
+    case EXPR_AUTO_CAST: {
+        PATCH_EXPR(auto_cast.sub);
+        break;
+    }
+    }
+
+#undef PATCH_EXPRS
+#undef PATCH_EXPR
+}
+
+static void pchWriteStmt(PchWriter *w, AstStmt *stmt, uint32_t offset)
+{
+    AstStmt copy = *stmt;
+    copy.loc = pchWriteLoc(w, stmt->loc);
+    copy.id = 0;
+    copy.always_exits = false;
+    memcpy(pchSlot(w, offset), &copy, sizeof(copy));
+
+    pchWriteAttributes(w, offset + offsetof(AstStmt, attributes), stmt->attributes);
+
+#define PATCH(field, kind)                                                               \
+    pchWriteId(w, offset + offsetof(AstStmt, field), kind, stmt->field)
+
+    switch (stmt->kind)
+    {
+    case STMT_DECL: PATCH(decl, AST_POOL_DECL); break;
+    case STMT_EXPR: PATCH(expr, AST_POOL_EXPR); break;
+    case STMT_RETURN: PATCH(return_.value, AST_POOL_EXPR); break;
+
+    case STMT_DISCARD:
+    case STMT_CONTINUE:
+    case STMT_BREAK: break;
+
+    case STMT_BLOCK: {
+        pchWriteIds(
+            w,
+            offset + offsetof(AstStmt, block.stmts),
+            AST_POOL_STMT,
+            stmt->block.stmts.ptr,
+            stmt->block.stmts.len);
+        break;
+    }
+
+    case STMT_IF: {
+        PATCH(if_.cond, AST_POOL_EXPR);
+        PATCH(if_.if_stmt, AST_POOL_STMT);
+        PATCH(if_.else_stmt, AST_POOL_STMT);
+        break;
+    }
+
+    case STMT_WHILE: {
+        PATCH(while_.cond, AST_POOL_EXPR);
+        PATCH(while_.stmt, AST_POOL_STMT);
+        break;
+    }
+
+    case STMT_DO_WHILE: {
+        PATCH(do_while.cond, AST_POOL_EXPR);
+        PATCH(do_while.stmt, AST_POOL_STMT);
+        break;
+    }
+
+    case STMT_FOR: {
+        PATCH(for_.init, AST_POOL_STMT);
+        PATCH(for_.cond, AST_POOL_EXPR);
+        PATCH(for_.inc, AST_POOL_EXPR);
+        PATCH(for_.stmt, AST_POOL_STMT);
+        break;
+    }
+    }
+
+#undef PATCH
+}
+
+static void pchWriteDecl(PchWriter *w, AstDecl *decl, uint32_t offset)
+{
+    AstDecl copy = *decl;
+    copy.has_resolved_int = false;
+    copy.loc = pchWriteLoc(w, decl->loc);
+    copy.id = 0;
+    copy.info = 0;
+    copy.type = NULL;
+    if (decl->kind == DECL_FUNC) copy.func.overload = 0;
+    if (decl->kind == DECL_ALIAS) copy.alias.field_decl = 0;
+    memcpy(pchSlot(w, offset), &copy, sizeof(copy));
+
+    pchPatch(w, offset + offsetof(AstDecl, name), pchWriteString(w, decl->name));
+    pchPatch(w, offset + offsetof(AstDecl, semantic), pchWriteString(w, decl->semantic));
+    pchWriteAttributes(w, offset + offsetof(AstDecl, attributes), decl->attributes);
+
+#define PATCH(field, kind)                                                               \
+    pchWriteId(w, offset + offsetof(AstDecl, field), kind, decl->field)
+#define PATCH_LIST(field, kind)                                                          \
+    pchWriteIds(                                                                         \
+        w, offset + offsetof(AstDecl, field), kind, decl->field.ptr, decl->field.len)
+
+    PATCH_LIST(template_params, AST_POOL_DECL);
+
+    switch (decl->kind)
+    {
+    case DECL_FUNC: {
+        PATCH_LIST(func.stmts, AST_POOL_STMT);
+        PATCH_LIST(func.params, AST_POOL_DECL);
+        PATCH(func.return_type, AST_POOL_EXPR);
+        break;
+    }
+
+    case DECL_VAR: {
+        PATCH(var.type_expr, AST_POOL_EXPR);
+        PATCH(var.value_expr, AST_POOL_EXPR);
+        break;
+    }
+
+    case DECL_CONST: {
+        PATCH(constant.type_expr, AST_POOL_EXPR);
+        PATCH(constant.value_expr, AST_POOL_EXPR);
+        break;
+    }
+
+    case DECL_ALIAS: {
+        PATCH(alias.accessed, AST_POOL_DECL);
+        break;
+    }
+
+    case DECL_STRUCT: {
+        PATCH_LIST(struct_.fields, AST_POOL_DECL);
+        break;
+    }
+
+    case DECL_STRUCT_FIELD: {
+        PATCH(struct_field.type_expr, AST_POOL_EXPR);
+        break;
+    }
+
+    case DECL_TYPE_PARAM: break;
+    }
+
+#undef PATCH_LIST
+#undef PATCH
+}
+
+// Stores the macros of 'defines' in the data section
+static void pchWriteMacros(PchWriter *w, HashMap *defines, PchHeader *header)
+{
+    header->macro_count = 0;
+    for (uint64_t i = 0; i < defines->size; ++i)
+    {
+        if (defines->hashes[i] != 0) header->macro_count++;
+    }
+    if (header->macro_count == 0) return;
+
+    PchBuffer *data = &w->sections[PCH_SECTION_DATA];
+    header->macros_offset =
+        pchAppend(data, NULL, sizeof(PchMacro) * header->macro_count);
+
+    uint32_t slot = header->macros_offset;
+    for (uint64_t i = 0; i < defines->size; ++i)
+    {
+        if (defines->hashes[i] == 0) continue;
+
+        const char *value = defines->values.ptr[defines->indices[i]];
+        pchPatch(
+            w,
+            PCH_SLOT(PCH_SECTION_DATA, slot + offsetof(PchMacro, name)),
+            pchWriteString(w, defines->keys[i]));
+        pchPatch(
+            w,
+            PCH_SLOT(PCH_SECTION_DATA, slot + offsetof(PchMacro, value)),
+            pchWriteString(w, value));
+        slot += sizeof(PchMacro);
+    }
+}
+
+uint8_t *ts__pchWrite(
+    TsCompiler *compiler,
+    AstDecl **decls,
+    size_t decl_count,
+    HashMap *defines,
+    SourceLoc origin,
+    size_t *size)
+{
+    PchWriter w = {0};
+    w.compiler = compiler;
+    w.origin = origin;
+    ts__hashInit(compiler, &w.strings, 0);
+
+    // Data offset 0 stands for NULL
+    pchAppend(&w.sections[PCH_SECTION_DATA], NULL, sizeof(uint64_t));
+
+    PchBuffer roots = {0};
+    for (size_t i = 0; i < decl_count; ++i)
+    {
+        pchPushU32(&roots, pchNode(&w, AST_POOL_DECL, decls[i]->id));
+    }
+
+    bool pending = true;
+    while (pending)
+    {
+        pending = false;
+        for (uint32_t kind = 0; kind < PCH_NODE_KINDS; ++kind)
+        {
+            size_t item_size = compiler->ast->pools[kind].item_size;
+            while (w.written[kind] * sizeof(void *) < w.nodes[kind].len)
+            {
+                size_t index = w.written[kind]++;
+                uint32_t offset = PCH_SLOT(kind, index * item_size);
+
+                void *node;
+                memcpy(&node, w.nodes[kind].data + index * sizeof(node), sizeof(node));
+
+                switch ((AstPoolKind)kind)
+                {
+                case AST_POOL_EXPR: pchWriteExpr(&w, node, offset); break;
+                case AST_POOL_STMT: pchWriteStmt(&w, node, offset); break;
+                case AST_POOL_DECL: pchWriteDecl(&w, node, offset); break;
+                default: assert(0); break;
+                }
+
+                pending = true;
+            }
+        }
+    }
+
+    PchHeader header = {0};
+    memcpy(header.magic, PCH_MAGIC, sizeof(header.magic));
+    header.version = PCH_VERSION;
+    header.pointer_size = sizeof(void *);
+    header.token_size = sizeof(Token);
+    header.expr_size = sizeof(AstExpr);
+    header.stmt_size = sizeof(AstStmt);
+    header.decl_size = sizeof(AstDecl);
+    header.attribute_size = sizeof(AstAttribute);
+    header.location_size = sizeof(Location);
+
+    if (w.locs.len > 0)
+    {
+        PchBuffer *data = &w.sections[PCH_SECTION_DATA];
+        header.locs_offset = pchAppend(data, w.locs.data, w.locs.len);
+        header.loc_count = (uint32_t)(w.locs.len / sizeof(Location));
+
+        for (uint32_t i = 0; i < header.loc_count; ++i)
+        {
+            Location loc;
+            memcpy(&loc, w.locs.data + i * sizeof(Location), sizeof(loc));
+
+            uint32_t slot = header.locs_offset + i * sizeof(Location);
+            pchPatch(
+                &w,
+                PCH_SLOT(PCH_SECTION_DATA, slot + offsetof(Location, path)),
+                pchWriteString(&w, loc.path));
+        }
+    }
+
+    if (defines) pchWriteMacros(&w, defines, &header);
+
+    PchBuffer blob = {0};
+    pchAppend(&blob, NULL, sizeof(PchHeader));
+
+    PchBuffer *data = &w.sections[PCH_SECTION_DATA];
+    header.data_offset = pchAppend(&blob, data->data, data->len);
+    header.data_size = (uint32_t)data->len;
+
+    for (uint32_t kind = 0; kind < PCH_NODE_KINDS; ++kind)
+    {
+        PchBuffer *nodes = &w.sections[kind];
+        header.node_offsets[kind] = pchAppend(&blob, nodes->data, nodes->len);
+        header.node_counts[kind] = (uint32_t)(w.nodes[kind].len / sizeof(void *));
+    }
+
+    header.decls_offset = pchAppend(&blob, roots.data, roots.len);
+    header.decl_count = (uint32_t)decl_count;
+
+    header.relocs_offset = pchAppend(&blob, w.relocs.data, w.relocs.len);
+    header.reloc_count = (uint32_t)(w.relocs.len / sizeof(uint32_t));
+
+    for (uint32_t kind = 0; kind < PCH_NODE_KINDS; ++kind)
+    {
+        PchBuffer *slots = &w.id_slots[kind];
+        header.id_slot_offsets[kind] = pchAppend(&blob, slots->data, slots->len);
+        header.id_slot_counts[kind] = (uint32_t)(slots->len / sizeof(uint32_t));
+    }
+
+    header.size = (uint32_t)blob.len;
+    memcpy(blob.data, &header, sizeof(header));
+
+    ts__hashDestroy(&w.strings);
+    for (uint32_t i = 0; i <= PCH_NODE_KINDS; ++i) free(w.sections[i].data);
+    for (uint32_t i = 0; i < PCH_NODE_KINDS; ++i)
+    {
+        free(w.nodes[i].data);
+        free(w.id_slots[i].data);
+    }
+    free(w.relocs.data);
+    free(w.locs.data);
+    free(w.memo.keys);
+    free(w.memo.values);
+    free(w.loc_memo.keys);
+    free(w.loc_memo.values);
+    free(roots.data);
+
+    *size = blob.len;
+    return blob.data;
+}
+
+typedef struct PchLoader
+{
+    TsCompiler *compiler;
+    PchHeader header;
+    uint8_t *data;                   // Copy of the data section
+    uint32_t bases[PCH_NODE_KINDS]; // Pool id of the first node of each section
+} PchLoader;
+
+static bool pchInvalid(TsCompiler *compiler)
+{
+    ts__addErrAt(compiler, 0, "invalid precompiled header");
+    return false;
+}
+
+static bool pchRangeValid(const PchHeader *header, uint32_t offset, uint64_t size)
+{
+    return (uint64_t)offset + size <= header->size;
+}
+
+// Whether a relocated pointer points into the loaded data section
+static bool pchInData(const PchLoader *l, const char *ptr)
+{
+    const uint8_t *byte = (const uint8_t *)ptr;
+    return byte > l->data && byte < l->data + l->header.data_size;
+}
+
+static uint32_t pchReadU32(const uint8_t *data, uint32_t offset, uint32_t index)
+{
+    uint32_t value;
+    memcpy(&value, data + offset + (size_t)index * sizeof(value), sizeof(value));
+    return value;
+}
+
+// Address of a slot of 'size' bytes, NULL if it is out of bounds or misaligned
+static uint8_t *pchLoadSlot(PchLoader *l, uint32_t slot, size_t size)
+{
+    uint32_t section = slot >> PCH_SLOT_SHIFT;
+    uint32_t offset = slot & PCH_SLOT_MASK;
+    if (offset % size != 0) return NULL;
+
+    if (section == PCH_SECTION_DATA)
+    {
+        if (offset + size > l->header.data_size) return NULL;
+        return l->data + offset;
+    }
+
+    const AstPool *pool = &l->compiler->ast->pools[section];
+    size_t index = offset / pool->item_size;
+    size_t within = offset % pool->item_size;
+    if (index >= l->header.node_counts[section] || within + size > pool->item_size)
+    {
+        return NULL;
+    }
+
+    return (uint8_t *)ts__astPoolGet(pool, l->bases[section] + (uint32_t)index) + within;
+}
+
+bool ts__pchLoad(
+    TsCompiler *compiler,
+    const uint8_t *data,
+    size_t size,
+    SourceLoc origin,
+    ArrayOfAstDeclPtr *decls,
+    HashMap *defines)
+{
+    PchLoader l = {0};
+    l.compiler = compiler;
+
+    PchHeader *header = &l.header;
+    if (size < sizeof(*header)) return pchInvalid(compiler);
+    memcpy(header, data, sizeof(*header));
+
+    if (memcmp(header->magic, PCH_MAGIC, sizeof(header->magic)) != 0 ||
+        header->size > size)
+    {
+        return pchInvalid(compiler);
+    }
+
+    if (header->version != PCH_VERSION || header->pointer_size != sizeof(void *) ||
+        header->token_size != sizeof(Token) || header->expr_size != sizeof(AstExpr) ||
+        header->stmt_size != sizeof(AstStmt) || header->decl_size != sizeof(AstDecl) ||
+        header->attribute_size != sizeof(AstAttribute) ||
+        header->location_size != sizeof(Location))
+    {
+        ts__addErrAt(
+            compiler,
+            0,
+            "precompiled header was produced by a different build of the compiler");
+        return false;
+    }
+
+    uint64_t decls_size = header->decl_count * 4ull;
+    uint64_t relocs_size = header->reloc_count * 4ull;
+    uint64_t locs_size = header->loc_count * (uint64_t)sizeof(Location);
+    uint64_t macros_size = header->macro_count * (uint64_t)sizeof(PchMacro);
+    bool valid = pchRangeValid(header, header->data_offset, header->data_size) &&
+                 pchRangeValid(header, header->decls_offset, decls_size) &&
+                 pchRangeValid(header, header->relocs_offset, relocs_size) &&
+                 header->locs_offset % sizeof(void *) == 0 &&
+                 header->locs_offset + locs_size <= header->data_size &&
+                 header->macros_offset % sizeof(void *) == 0 &&
+                 header->macros_offset + macros_size <= header->data_size;
+    for (uint32_t kind = 0; kind < PCH_NODE_KINDS; ++kind)
+    {
+        uint64_t nodes_size =
+            header->node_counts[kind] * (uint64_t)compiler->ast->pools[kind].item_size;
+        uint64_t slots_size = header->id_slot_counts[kind] * 4ull;
+        valid = valid && pchRangeValid(header, header->node_offsets[kind], nodes_size) &&
+                pchRangeValid(header, header->id_slot_offsets[kind], slots_size);
+    }
+    for (uint32_t i = 0; valid && i < header->decl_count; ++i)
+    {
+        uint32_t id = pchReadU32(data, header->decls_offset, i);
+        valid = id != 0 && id <= header->node_counts[AST_POOL_DECL];
+    }
+    if (!valid) return pchInvalid(compiler);
+
+    l.data = ts__bumpAlloc(&compiler->alloc, header->data_size);
+    memcpy(l.data, data + header->data_offset, header->data_size);
+
+    for (uint32_t kind = 0; kind < PCH_NODE_KINDS; ++kind)
+    {
+        uint32_t count = header->node_counts[kind];
+        if (count == 0) continue;
+
+        const AstPool *pool = &compiler->ast->pools[kind];
+        l.bases[kind] = ts__astReserve(compiler, kind, count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            memcpy(
+                ts__astPoolGet(pool, l.bases[kind] + i),
+                data + header->node_offsets[kind] + (size_t)i * pool->item_size,
+                pool->item_size);
+        }
+    }
+
+    for (uint32_t i = 0; i < header->reloc_count; ++i)
+    {
+        uint32_t slot_offset = pchReadU32(data, header->relocs_offset, i);
+        uint8_t *slot = pchLoadSlot(&l, slot_offset, sizeof(uintptr_t));
+        if (!slot) return pchInvalid(compiler);
+
+        uintptr_t target;
+        memcpy(&target, slot, sizeof(target));
+        if (target == 0 || target >= header->data_size) return pchInvalid(compiler);
+
+        target += (uintptr_t)l.data;
+        memcpy(slot, &target, sizeof(target));
+    }
+
+    for (uint32_t kind = 0; kind < PCH_NODE_KINDS; ++kind)
+    {
+        for (uint32_t i = 0; i < header->id_slot_counts[kind]; ++i)
+        {
+            uint32_t slot_offset = pchReadU32(data, header->id_slot_offsets[kind], i);
+            uint8_t *slot = pchLoadSlot(&l, slot_offset, sizeof(uint32_t));
+            if (!slot) return pchInvalid(compiler);
+
+            uint32_t id;
+            memcpy(&id, slot, sizeof(id));
+            if (id == 0 || id > header->node_counts[kind]) return pchInvalid(compiler);
+
+            id = l.bases[kind] + id - 1;
+            memcpy(slot, &id, sizeof(id));
+        }
+    }
+
+    SourceLoc loc_base = origin;
+    uint32_t loc_count = UINT32_MAX;
+    if (origin == 0)
+    {
+        loc_count = header->loc_count;
+        if (loc_count > 0)
+        {
+            loc_base = ts__sourceMapAdd(
+                compiler,
+                (const Location *)(l.data + header->locs_offset),
+                sizeof(Location),
+                loc_count);
+        }
+    }
+
+    for (uint32_t kind = 0; kind < PCH_NODE_KINDS; ++kind)
+    {
+        for (uint32_t i = 0; i < header->node_counts[kind]; ++i)
+        {
+            uint32_t id = l.bases[kind] + i;
+
+            SourceLoc *loc = NULL;
+            switch ((AstPoolKind)kind)
+            {
+            case AST_POOL_EXPR: {
+                AstExpr *expr = ts__expr(compiler, id);
+                expr->id = id;
+                expr->info = 0;
+                loc = &expr->loc;
+                break;
+            }
+            case AST_POOL_STMT: {
+                AstStmt *stmt = ts__stmt(compiler, id);
+                stmt->id = id;
+                loc = &stmt->loc;
+                break;
+            }
+            case AST_POOL_DECL: {
+                AstDecl *decl = ts__decl(compiler, id);
+                decl->id = id;
+                decl->info = 0;
+                loc = &decl->loc;
+                break;
+            }
+            default: assert(0); break;
+            }
+
+            if (*loc == 0) continue;
+            if (*loc > loc_count) return pchInvalid(compiler);
+            *loc = loc_base + *loc - 1;
+        }
+    }
+
+    for (uint32_t i = 0; defines && i < header->macro_count; ++i)
+    {
+        PchMacro *macro = (PchMacro *)(l.data + header->macros_offset) + i;
+        if (!pchInData(&l, macro->name) || (macro->value && !pchInData(&l, macro->value)))
+        {
+            return pchInvalid(compiler);
+        }
+        ts__hashSet(defines, macro->name, macro->value);
+    }
+
+    for (uint32_t i = 0; i < header->decl_count; ++i)
+    {
+        uint32_t id = pchReadU32(data, header->decls_offset, i);
+        arrPush(compiler, decls, ts__decl(compiler, l.bases[AST_POOL_DECL] + id - 1));
+    }
+
+    return true;
+}
+
+// Deep copy of a declaration as the parser produced it, without any analysis results.
+// Each instantiation of a template is analyzed on its own copy.
+AstDecl *ts__pchCloneDecl(TsCompiler *compiler, AstDecl *decl)
+{
+    // With an origin of 1 the source locations are kept as they are
+    size_t size = 0;
+    uint8_t *data = ts__pchWrite(compiler, &decl, 1, NULL, 1, &size);
+
+    ArrayOfAstDeclPtr decls = {0};
+    bool loaded = ts__pchLoad(compiler, data, size, 1, &decls, NULL);
+    free(data);
+
+    assert(loaded && decls.len == 1);
+    (void)loaded;
+    return decls.ptr[0];
+}
@@ -18,7 +18,7 @@ typedef struct Preprocessor
 {
     TsCompiler *compiler;
     StringBuilder tmp_sb;
-    HashMap defines;
+    HashMap *defines; // Not owned, see ts__preprocess
     ARRAY_OF(PreprocessorFile*) preproc_files;
 
     const char *input;
@@ -71,7 +71,6 @@ static Location preprocessorGetLoc(PreprocessorFile *f)
     loc.col = f->col;
     loc.pos = (uint32_t)f->pos;
     loc.path = f->file->path;
-    loc.buffer = f->file->text;
     return loc;
 }
 
@@ -164,7 +163,7 @@ static const char *preprocessorExpandMacro(
     else
     {
         char *define_value = NULL;
-        if (ts__hashGet(&p->defines, ident, (void**)&define_value))
+        if (ts__hashGet(p->defines, ident, (void**)&define_value))
         {
             if (define_value)
             {
@@ -370,11 +369,11 @@ static const char *ts__preprocessFile(Preprocessor *p, PreprocessorFile *f)
 
                 if (value_length > 0)
                 {
-                    ts__hashSet(&p->defines, define_name, (void*)value);
+                    ts__hashSet(p->defines, define_name, (void*)value);
                 }
                 else
                 {
-                    ts__hashSet(&p->defines, define_name, (void*)NULL);
+                    ts__hashSet(p->defines, define_name, (void*)NULL);
                 }
             }
             else if (strcmp(ident, "undef") == 0)
@@ -392,7 +391,7 @@ static const char *ts__preprocessFile(Preprocessor *p, PreprocessorFile *f)
                     break;
                 }
 
-                ts__hashRemove(&p->defines, define_name);
+                ts__hashRemove(p->defines, define_name);
             }
             else if (strcmp(ident, "ifdef") == 0)
             {
@@ -409,7 +408,7 @@ static const char *ts__preprocessFile(Preprocessor *p, PreprocessorFile *f)
                     break;
                 }
 
-                bool defined = ts__hashGet(&p->defines, define_name, NULL);
+                bool defined = ts__hashGet(p->defines, define_name, NULL);
                 arrPush(p->compiler, &p->cond_stack, defined);
             }
             else if (strcmp(ident, "ifndef") == 0)
@@ -427,7 +426,7 @@ static const char *ts__preprocessFile(Preprocessor *p, PreprocessorFile *f)
                     break;
                 }
 
-                bool defined = ts__hashGet(&p->defines, define_name, NULL);
+                bool defined = ts__hashGet(p->defines, define_name, NULL);
                 arrPush(p->compiler, &p->cond_stack, !defined);
             }
             else if (strcmp(ident, "if") == 0)
@@ -584,14 +583,16 @@ static const char *ts__preprocessFile(Preprocessor *p, PreprocessorFile *f)
     return ts__sbBuild(&f->sb, &p->compiler->alloc);
 }
 
+// 'defines' holds the macros defined before the source (e.g. by a precompiled header) and
+// is left with the ones defined at its end
 const char *ts__preprocess(
-    TsCompiler *compiler, File *base_file, size_t *out_size)
+    TsCompiler *compiler, File *base_file, HashMap *defines, size_t *out_size)
 {
     Preprocessor *p = NEW(compiler, Preprocessor);
     memset(p, 0, sizeof(*p));
     p->compiler = compiler;
+    p->defines = defines;
 
-    ts__hashInit(compiler, &p->defines, 0);
     ts__sbInit(&p->tmp_sb);
 
     PreprocessorFile *preproc_file = preprocessorFileCreate(p, base_file);
@@ -614,7 +615,6 @@ const char *ts__preprocess(
     /* printf("%s\n", final_text); */
 
     ts__sbDestroy(&p->tmp_sb);
-    ts__hashDestroy(&p->defines);
 
     *out_size = strlen(final_text);
     return final_text;
@@ -10,6 +10,8 @@
 #include "tinyshader_preprocess.c"
 #include "tinyshader_lexer.c"
 #include "tinyshader_parser.c"
+#include "tinyshader_pch.c"
 #include "tinyshader_analysis.c"
 #include "tinyshader_ir.c"
 #include "tinyshader_ast_ir.c"
+#include "tinyshader_opt.c"
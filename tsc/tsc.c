@@ -35,20 +35,98 @@ static char *loadFile(const char *path, size_t *out_size)
     return data;
 }
 
+static void printResources(TsCompilerOutput *output)
+{
+    static const char *kind_names[] = {
+        [TS_RESOURCE_CONSTANT_BUFFER] = "ConstantBuffer",
+        [TS_RESOURCE_STRUCTURED_BUFFER] = "StructuredBuffer",
+        [TS_RESOURCE_RW_STRUCTURED_BUFFER] = "RWStructuredBuffer",
+        [TS_RESOURCE_TEXTURE] = "Texture",
+        [TS_RESOURCE_SAMPLER] = "Sampler",
+    };
+
+    size_t resource_count = 0;
+    const TsResource *resources = tsCompilerOutputGetResources(output, &resource_count);
+    for (size_t i = 0; i < resource_count; ++i)
+    {
+        const TsResource *resource = &resources[i];
+        printf(
+            "%s %s: set %u, binding %u",
+            kind_names[resource->kind],
+            resource->name,
+            resource->set,
+            resource->binding);
+        if (resource->size > 0) printf(", size %zu", resource->size);
+        printf("\n");
+
+        for (size_t j = 0; j < resource->member_count; ++j)
+        {
+            const TsBufferMember *member = &resource->members[j];
+            printf(
+                "    %s: offset %zu, size %zu\n", member->name, member->offset, member->size);
+        }
+    }
+}
+
+static void printPassStats(TsCompilerOutput *output)
+{
+    size_t pass_count = 0;
+    const TsPassStats *passes = tsCompilerOutputGetPassStats(output, &pass_count);
+    for (size_t i = 0; i < pass_count; ++i)
+    {
+        const TsPassStats *pass = &passes[i];
+        printf(
+            "%s: %.3f ms, %zu -> %zu instructions\n",
+            pass->name,
+            pass->milliseconds,
+            pass->inst_count_before,
+            pass->inst_count_after);
+    }
+}
+
+static void printPhaseTimes(TsCompilerOutput *output)
+{
+    const TsPhaseTimes *times = tsCompilerOutputGetPhaseTimes(output);
+    printf("parse: %.3f ms\n", times->parse);
+    printf("analyze: %.3f ms\n", times->analyze);
+    printf("build-ir: %.3f ms\n", times->build_ir);
+    printf("optimize: %.3f ms\n", times->optimize);
+    printf("codegen: %.3f ms\n", times->codegen);
+}
+
 static bool compileStage(
     char *out_file_name,
     char *input_path,
     char *file_data,
     size_t file_size,
     char *entry_point,
-    TsShaderStage stage)
+    TsShaderStage stage,
+    const unsigned char *pch_data,
+    size_t pch_size,
+    bool emit_pch,
+    bool scalar_block_layout,
+    const unsigned int *binding_shifts,
+    int optimization_level,
+    bool reflect,
+    bool pass_stats,
+    bool phase_times)
 {
     TsCompilerOptions *options = tsCompilerOptionsCreate();
     tsCompilerOptionsSetStage(options, stage);
     tsCompilerOptionsSetSource(options, file_data, file_size, input_path, strlen(input_path));
     tsCompilerOptionsSetEntryPoint(options, entry_point, strlen(entry_point));
+    if (pch_data)
+    {
+        tsCompilerOptionsSetPrecompiledHeader(options, pch_data, pch_size);
+    }
+    tsCompilerOptionsSetScalarBlockLayout(options, scalar_block_layout);
+    for (int i = 0; i < TS_REGISTER_CLASS_COUNT; ++i)
+    {
+        tsCompilerOptionsSetBindingShift(options, (TsRegisterClass)i, binding_shifts[i]);
+    }
+    tsCompilerOptionsSetOptimizationLevel(options, optimization_level);
 
-    TsCompilerOutput *output = tsCompile(options);
+    TsCompilerOutput *output = emit_pch ? tsPrecompileHeader(options) : tsCompile(options);
     const char *errors = tsCompilerOutputGetErrors(output);
     if (errors)
     {
@@ -59,7 +137,9 @@ static bool compileStage(
     }
 
     size_t spirv_byte_size = 0;
-    const unsigned char *spirv = tsCompilerOutputGetSpirv(output, &spirv_byte_size);
+    const unsigned char *spirv = emit_pch
+                                     ? tsCompilerOutputGetPrecompiledHeader(output, &spirv_byte_size)
+                                     : tsCompilerOutputGetSpirv(output, &spirv_byte_size);
 
     FILE *f = fopen(out_file_name, "wb");
     if (!f)
@@ -75,6 +155,10 @@ static bool compileStage(
 
     fclose(f);
 
+    if (reflect) printResources(output);
+    if (pass_stats) printPassStats(output);
+    if (phase_times) printPhaseTimes(output);
+
     tsCompilerOutputDestroy(output);
     tsCompilerOptionsDestroy(options);
     return true;
@@ -88,12 +172,28 @@ int main(int argc, char *argv[])
         {"shader-stage", 'T', OPTPARSE_REQUIRED},
         {"entry-point", 'E', OPTPARSE_REQUIRED},
         {"output", 'o', OPTPARSE_REQUIRED},
+        {"pch", 'p', OPTPARSE_REQUIRED},
+        {"emit-pch", 'P', OPTPARSE_NONE},
+        {"scalar-block-layout", 'S', OPTPARSE_NONE},
+        {"binding-shift", 'B', OPTPARSE_REQUIRED},
+        {"reflect", 'R', OPTPARSE_NONE},
+        {"optimize", 'O', OPTPARSE_REQUIRED},
+        {"pass-stats", 's', OPTPARSE_NONE},
+        {"phase-times", 't', OPTPARSE_NONE},
         {0}};
 
     TsShaderStage stage = TS_SHADER_STAGE_VERTEX;
     char *out_path = "a.spv";
     char *entry_point = "main";
     char *path = NULL;
+    char *pch_path = NULL;
+    bool emit_pch = false;
+    bool scalar_block_layout = false;
+    unsigned int binding_shifts[TS_REGISTER_CLASS_COUNT] = {0};
+    bool reflect = false;
+    int optimization_level = 0;
+    bool pass_stats = false;
+    bool phase_times = false;
 
     char *arg;
     int option;
@@ -125,6 +225,43 @@ int main(int argc, char *argv[])
             break;
         case 'E': entry_point = options.optarg; break;
         case 'o': out_path = options.optarg; break;
+        case 'p': pch_path = options.optarg; break;
+        case 'P': emit_pch = true; break;
+        case 'S': scalar_block_layout = true; break;
+        case 'B': {
+            // <b|t|u|s>=<shift>, in the order of TsRegisterClass
+            static const char classes[] = "btus";
+            char letter = options.optarg[0];
+            const char *found = letter ? strchr(classes, letter) : NULL;
+            char *end = NULL;
+            unsigned long shift = 0;
+            if (found && options.optarg[1] == '=')
+            {
+                shift = strtoul(options.optarg + 2, &end, 10);
+            }
+            if (!end || end == options.optarg + 2 || *end != '\0')
+            {
+                fprintf(stderr, "Invalid binding shift: %s\n", options.optarg);
+                exit(EXIT_FAILURE);
+            }
+            binding_shifts[found - classes] = (unsigned int)shift;
+            break;
+        }
+        case 'R': reflect = true; break;
+        case 'O':
+            if (strcmp(options.optarg, "0") == 0 || strcmp(options.optarg, "1") == 0 ||
+                strcmp(options.optarg, "2") == 0)
+            {
+                optimization_level = options.optarg[0] - '0';
+            }
+            else
+            {
+                fprintf(stderr, "Unrecognized optimization level: %s\n", options.optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's': pass_stats = true; break;
+        case 't': phase_times = true; break;
         case '?':
             fprintf(stderr, "%s: %s\n", argv[0], options.errmsg);
             exit(EXIT_FAILURE);
@@ -141,16 +278,48 @@ int main(int argc, char *argv[])
         fprintf(
             stderr,
             "Usage: %s [--shader-stage <stage>] [--entry-point <entry point>] [-o "
-            "<output path>] <filename>\n", argv[0]);
+            "<output path>] [--pch <precompiled header>] [--emit-pch] "
+            "[--scalar-block-layout] [--binding-shift <b|t|u|s>=<shift>] [--reflect] "
+            "[-O <0|1|2>] [--pass-stats] "
+            "[--phase-times] "
+            "<filename>\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
     size_t file_size = 0;
     char *file_data = loadFile(path, &file_size);
 
-    bool result = compileStage(out_path, path, file_data, file_size, entry_point, stage);
+    size_t pch_size = 0;
+    char *pch_data = NULL;
+    if (pch_path)
+    {
+        pch_data = loadFile(pch_path, &pch_size);
+        if (!pch_data)
+        {
+            fprintf(stderr, "failed to open precompiled header: %s\n", pch_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    bool result = compileStage(
+        out_path,
+        path,
+        file_data,
+        file_size,
+        entry_point,
+        stage,
+        (const unsigned char *)pch_data,
+        pch_size,
+        emit_pch,
+        scalar_block_layout,
+        binding_shifts,
+        optimization_level,
+        reflect,
+        pass_stats,
+        phase_times);
 
     free(file_data);
+    if (pch_data) free(pch_data);
 
     if (!result)
     {